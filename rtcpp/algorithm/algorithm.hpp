@@ -1,48 +1,154 @@
 #pragma once
 
+#include <memory>
+#include <cstddef>
+#include <iterator>
 #include <functional>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <rtcpp/utility/prefetch.hpp>
 
 namespace rt
 {
 
-template<class RandomAccessIter, class T>
+namespace detail
+{
+
+template <class It>
+void prefetch_at(It it, std::true_type) noexcept
+{ prefetch(std::addressof(*it)); }
+
+// Proxy references, e.g. std::vector<bool>, have no address.
+template <class It>
+void prefetch_at(It, std::false_type) noexcept {}
+
+template <class It>
+void prefetch_at(It it) noexcept
+{
+  using reference = typename std::iterator_traits<It>::reference;
+  prefetch_at(it, std::is_lvalue_reference<reference>());
+}
+
+// Narrows [begin, begin + n) while it has more than m elements. The
+// result is in [begin, begin + n] on return.
+template<class RandomAccessIter, class T, class Compare>
 RandomAccessIter
-lower_bound(RandomAccessIter begin, RandomAccessIter end, const T& K)
+lower_bound_narrow( RandomAccessIter begin
+                  , typename std::iterator_traits<RandomAccessIter>::difference_type& n
+                  , typename std::iterator_traits<RandomAccessIter>::difference_type m
+                  , const T& K, Compare comp)
 {
-  if (begin == end)
-    return end;
+  while (n > m) {
+    const auto half = n / 2;
+    // Both elements the next step may read.
+    prefetch_at(begin + (n - half) / 2);
+    prefetch_at(begin + half + (n - half) / 2);
+    // A conditional move, not a branch.
+    begin += comp(begin[half], K) ? half : 0;
+    n -= half;
+  }
+  return begin;
+}
 
-  const auto N = std::distance(begin, end);
-  int l = 1;
-  int u = N;
+// Number of elements of p[0, 16) less than K.
+inline std::ptrdiff_t count_less16(const int* p, int K) noexcept
+{
+#if defined(__SSE2__)
+  const __m128i k = _mm_set1_epi32(K);
+  __m128i c = _mm_setzero_si128();
+  for (int i = 0; i < 16; i += 4) {
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    // All bits set in the lanes less than K, that is -1.
+    c = _mm_sub_epi32(c, _mm_cmplt_epi32(x, k));
+  }
+  c = _mm_add_epi32(c, _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 3, 2)));
+  c = _mm_add_epi32(c, _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(c);
+#else
+  std::ptrdiff_t c = 0;
+  for (int i = 0; i < 16; ++i)
+    c += p[i] < K;
+  return c;
+#endif
+}
 
-  for (;;) {
-    if (u < l)
-      return begin + u;
+template <class RandomAccessIter, class T, class Compare>
+struct use_count_less16 {
+  using value_type =
+    typename std::iterator_traits<RandomAccessIter>::value_type;
+  static const bool value =
+    std::is_pointer<RandomAccessIter>::value
+    && std::is_same<typename std::remove_cv<value_type>::type, int>::value
+    && std::is_same<T, int>::value
+    && (std::is_same<Compare, std::less<int>>::value
+        || std::is_same<Compare, std::less<>>::value);
+};
+
+template<class RandomAccessIter, class T, class Compare>
+RandomAccessIter
+lower_bound( RandomAccessIter begin, RandomAccessIter end, const T& K
+           , Compare comp, std::false_type)
+{
+  auto n = end - begin;
+  if (n == 0)
+    return end;
 
-    int i = (l + u) >> 1;
+  begin = lower_bound_narrow(begin, n, 1, K, comp);
+  return begin + (comp(*begin, K) ? 1 : 0);
+}
 
-    if (K < begin[i - 1]) {
-      u = i - 1;
-      continue;
-    }
+// The last steps are replaced by counting the keys less than K in a
+// window of 16 elements around the remaining ones.
+template<class RandomAccessIter, class T, class Compare>
+RandomAccessIter
+lower_bound( RandomAccessIter begin, RandomAccessIter end, const T& K
+           , Compare comp, std::true_type)
+{
+  auto n = end - begin;
+  if (n < 16)
+    return lower_bound(begin, end, K, comp, std::false_type());
+
+  begin = lower_bound_narrow(begin, n, 16, K, comp);
+  if (end - begin < 16)
+    begin = end - 16;
+  return begin + count_less16(&*begin, K);
+}
 
-    if (begin[i - 1] < K) {
-      l = i + 1;
-      continue;
-    }
+}
 
-    return begin + i - 1;
-  }
+// Returns the first element not less than K as std::lower_bound. The
+// loop has no data dependent branch and reads ahead the elements of
+// the next step. Ranges of int are finished with SSE2 when available.
+template<class RandomAccessIter, class T, class Compare>
+RandomAccessIter
+lower_bound(RandomAccessIter begin, RandomAccessIter end, const T& K, Compare comp)
+{
+  using simd = detail::use_count_less16<RandomAccessIter, T, Compare>;
+  return detail::lower_bound( begin, end, K, comp
+                            , std::integral_constant<bool, simd::value>());
 }
 
 template<class RandomAccessIter, class T>
-bool binary_search(RandomAccessIter begin, RandomAccessIter end, const T& K)
+RandomAccessIter
+lower_bound(RandomAccessIter begin, RandomAccessIter end, const T& K)
+{ return rt::lower_bound(begin, end, K, std::less<>()); }
+
+template<class RandomAccessIter, class T, class Compare>
+bool binary_search( RandomAccessIter begin, RandomAccessIter end, const T& K
+                  , Compare comp)
 {
-  auto iter = lower_bound(begin, end, K);
-  return iter != end && !(K < *iter);
+  auto iter = rt::lower_bound(begin, end, K, comp);
+  return iter != end && !comp(K, *iter);
 }
 
+template<class RandomAccessIter, class T>
+bool binary_search(RandomAccessIter begin, RandomAccessIter end, const T& K)
+{ return rt::binary_search(begin, end, K, std::less<>()); }
+
 // Assumes the range is not empty.
 template<class ForwardIt, class Compare>
 ForwardIt
@@ -8,35 +8,57 @@
 namespace rt
 {
 
+namespace detail
+{
+
+// The counting pass shared with radix_sort: counts the elements of
+// [in, in + n) for each of the m values of digit.
+template <class InIt, class Digit>
+void count_digits( InIt in, std::size_t n, std::size_t* count, std::size_t m
+                 , Digit digit)
+{
+  std::fill(count, count + m, 0);
+  for (std::size_t i = 0; i < n; ++i)
+    ++count[digit(in[i])];
+}
+
+// Moves the elements counted in count to out, in order of their digit
+// and, for equal digits, in their order in the input (stable).
+template <class InIt, class OutIt, class Digit>
+void scatter_digits( InIt in, std::size_t n, OutIt out, std::size_t* count
+                   , std::size_t m, Digit digit)
+{
+  // The first position of each digit.
+  std::size_t sum = 0;
+  for (std::size_t i = 0; i < m; ++i) {
+    const std::size_t c = count[i];
+    count[i] = sum;
+    sum += c;
+  }
+  for (std::size_t i = 0; i < n; ++i)
+    out[count[digit(in[i])]++] = std::move(in[i]);
+}
+
+}
+
 template <typename Iter>
 void
 dist_counting_sort(Iter begin, std::size_t N
   , typename std::iterator_traits<Iter>::value_type A
   , typename std::iterator_traits<Iter>::value_type B)
 {
+  typedef typename std::iterator_traits<Iter>::value_type value_type;
   const std::size_t count_size = B - A + 1;
   std::vector<std::size_t> count(count_size, 0);
-  // Counts the number of elements of each value.
-  for (std::size_t i = 0; i < N; ++i)
-    ++count[begin[i] - A];
-
-  // calculates the final position in the array.
-  --count[0]; // In c the first index is zero not 1.
-  for (std::size_t i = 1; i < count_size; ++i)
-    count[i] += count[i - 1];
+  // Index in the count array.
+  auto digit = [A](const value_type& v)
+  { return static_cast<std::size_t>(v - A); };
 
-  typedef typename std::iterator_traits<Iter>::value_type value_type;
+  detail::count_digits(begin, N, count.data(), count_size, digit);
   std::vector<value_type> out(N, 0);
-  for (std::size_t i = 0; i < N; ++i) {
-    const auto idx = begin[i] - A; // Index in the count array.
-    const auto pos = count[idx]; // Final position in output array.
-    out[pos] = begin[i]; // Assigns to the output array.
-    --count[idx];
-  }
-
+  detail::scatter_digits(begin, N, std::begin(out), count.data(), count_size, digit);
   std::copy(std::begin(out), std::end(out), begin);
 }
 
 }
 
-
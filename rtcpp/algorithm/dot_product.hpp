@@ -1,26 +1,198 @@
 #pragma once
 
+#include <cmath>
+#include <cstddef>
 #include <iterator>
+#include <type_traits>
 
-// Loop unroll by means of meta-programming.
+#include <rtcpp/utility/simd.hpp>
+
+/*
+  dot_product<n>(p1, p2) is unrolled by means of meta-programming into
+  independent partial sums, up to 8, added pairwise at the end, so that
+  the multiply-adds overlap instead of waiting for each other.
+  dot_product(p1, p2, n) does the same for lengths known at run time:
+  float and double arrays four simd_row (utility/simd.hpp) at a time,
+  other ranges four elements at a time, the remaining ones by
+  dot_product<1>, <2> or <3>. Multiply-adds are fused when compiled
+  with FMA. Both are constexpr, the run time length one without simd
+  rows in constant expressions.
+
+  The terms are added in another order than one after the other, float
+  results may differ in the last bits.
+*/
 
 namespace rt {
-  template <std::size_t n>
-  struct dot_product_impl {
-    template <typename RIter1, typename RIter2> // P is a random access iter.
-    static typename std::iterator_traits<RIter1>::value_type apply(RIter1 p1, RIter2 p2)
-    { return p1[n - 1] * p2[n - 1] + dot_product_impl<n - 1>::apply(p1, p2); }
-  };
-
-  template <>
-  struct dot_product_impl<1> {
-    template <typename RIter1, typename RIter2>
-    static typename std::iterator_traits<RIter2>::value_type apply(RIter1 p1, RIter2 p2)
-    { return p1[0] * p2[0]; }
-  };
-
-  template <std::size_t n, typename RIter1, typename RIter2>
-  typename std::iterator_traits<RIter1>::value_type dot_product(RIter1 p1, RIter2 p2)
-  { return dot_product_impl<n>::apply(p1, p2); }
+
+namespace detail {
+
+// a * b + c.
+template <typename T>
+constexpr T madd(const T& a, const T& b, const T& c) { return a * b + c; }
+
+#if defined(__FMA__)
+constexpr float madd(float a, float b, float c)
+{ return is_constant_evaluated() ? a * b + c : std::fma(a, b, c); }
+constexpr double madd(double a, double b, double c)
+{ return is_constant_evaluated() ? a * b + c : std::fma(a, b, c); }
+#endif
+
+// Partial sums used for n terms.
+constexpr std::size_t dot_accumulators(std::size_t n)
+{ return n >= 32 ? 8 : n >= 4 ? 4 : n; }
+
+// acc[i] = p1[i] * p2[i] for i in [I, A).
+template <std::size_t I, std::size_t A>
+struct dot_init {
+  template <typename T, typename RIter1, typename RIter2>
+  static constexpr void apply(T* acc, RIter1 p1, RIter2 p2)
+  {
+    acc[I] = p1[I] * p2[I];
+    dot_init<I + 1, A>::apply(acc, p1, p2);
+  }
+};
+
+template <std::size_t A>
+struct dot_init<A, A> {
+  template <typename T, typename RIter1, typename RIter2>
+  static constexpr void apply(T*, RIter1, RIter2) {}
+};
+
+// acc[i % A] += p1[i] * p2[i] for i in [I, N).
+template <std::size_t I, std::size_t N, std::size_t A>
+struct dot_step {
+  template <typename T, typename RIter1, typename RIter2>
+  static constexpr void apply(T* acc, RIter1 p1, RIter2 p2)
+  {
+    acc[I % A] = madd(T(p1[I]), T(p2[I]), acc[I % A]);
+    dot_step<I + 1, N, A>::apply(acc, p1, p2);
+  }
+};
+
+template <std::size_t N, std::size_t A>
+struct dot_step<N, N, A> {
+  template <typename T, typename RIter1, typename RIter2>
+  static constexpr void apply(T*, RIter1, RIter2) {}
+};
+
+// Sum of acc[B], ..., acc[E - 1], pairwise.
+template <std::size_t B, std::size_t E>
+struct dot_sum {
+  template <typename T>
+  static constexpr T apply(const T* acc)
+  { return dot_sum<B, (B + E) / 2>::apply(acc) + dot_sum<(B + E) / 2, E>::apply(acc); }
+};
+
+template <std::size_t B>
+struct dot_sum<B, B + 1> {
+  template <typename T>
+  static constexpr T apply(const T* acc) { return acc[B]; }
+};
+
+}
+
+template <std::size_t n>
+struct dot_product_impl {
+  static const std::size_t accumulators = detail::dot_accumulators(n);
+  template <typename RIter1, typename RIter2> // P is a random access iter.
+  static constexpr typename std::iterator_traits<RIter1>::value_type
+  apply(RIter1 p1, RIter2 p2)
+  {
+    typename std::iterator_traits<RIter1>::value_type acc[accumulators] = {};
+    detail::dot_init<0, accumulators>::apply(acc, p1, p2);
+    detail::dot_step<accumulators, n, accumulators>::apply(acc, p1, p2);
+    return detail::dot_sum<0, accumulators>::apply(acc);
+  }
+};
+
+template <>
+struct dot_product_impl<0> {
+  template <typename RIter1, typename RIter2>
+  static constexpr typename std::iterator_traits<RIter1>::value_type
+  apply(RIter1, RIter2)
+  { return 0; }
+};
+
+template <std::size_t n, typename RIter1, typename RIter2>
+constexpr typename std::iterator_traits<RIter1>::value_type
+dot_product(RIter1 p1, RIter2 p2)
+{ return dot_product_impl<n>::apply(p1, p2); }
+
+namespace detail {
+
+// The last n < 4 terms.
+template <typename RIter1, typename RIter2>
+constexpr typename std::iterator_traits<RIter1>::value_type
+dot_product_tail(RIter1 p1, RIter2 p2, std::size_t n)
+{
+  switch (n) {
+    case 1: return rt::dot_product<1>(p1, p2);
+    case 2: return rt::dot_product<2>(p1, p2);
+    case 3: return rt::dot_product<3>(p1, p2);
+    default: return 0;
+  }
+}
+
+template <typename RIter1, typename RIter2>
+constexpr typename std::iterator_traits<RIter1>::value_type
+dot_product(RIter1 p1, RIter2 p2, std::size_t n, std::false_type)
+{
+  using T = typename std::iterator_traits<RIter1>::value_type;
+  if (n < 4)
+    return dot_product_tail(p1, p2, n);
+
+  T acc[4] = {};
+  dot_init<0, 4>::apply(acc, p1, p2);
+  std::size_t i = 4;
+  for (; i + 4 <= n; i += 4)
+    dot_step<0, 4, 4>::apply(acc, p1 + i, p2 + i);
+  return dot_sum<0, 4>::apply(acc) + dot_product_tail(p1 + i, p2 + i, n - i);
+}
+
+// Four simd rows of four elements at a time.
+template <typename T>
+T dot_product(const T* p1, const T* p2, std::size_t n, std::true_type)
+{
+  using R = simd_row<T, 4>;
+  using V = typename R::type;
+  std::size_t i = 0;
+  T sum = 0;
+  if (n >= 4) {
+    V acc[4] = {R::splat(0), R::splat(0), R::splat(0), R::splat(0)};
+    for (; i + 16 <= n; i += 16) {
+      acc[0] = R::madd(R::load(p1 + i), R::load(p2 + i), acc[0]);
+      acc[1] = R::madd(R::load(p1 + i + 4), R::load(p2 + i + 4), acc[1]);
+      acc[2] = R::madd(R::load(p1 + i + 8), R::load(p2 + i + 8), acc[2]);
+      acc[3] = R::madd(R::load(p1 + i + 12), R::load(p2 + i + 12), acc[3]);
+    }
+    for (std::size_t k = 0; i + 4 <= n; i += 4, ++k)
+      acc[k] = R::madd(R::load(p1 + i), R::load(p2 + i), acc[k]);
+    sum = R::hsum(R::add(R::add(acc[0], acc[1]), R::add(acc[2], acc[3])));
+  }
+  return sum + dot_product_tail(p1 + i, p2 + i, n - i);
+}
+
+template <typename RIter1, typename RIter2>
+struct use_simd_dot {
+  using T = typename std::iterator_traits<RIter1>::value_type;
+  static const bool value = std::is_pointer<RIter1>::value
+    && std::is_pointer<RIter2>::value
+    && std::is_same<T, typename std::iterator_traits<RIter2>::value_type>::value
+    && simd_row<T, 4>::value;
+};
+
+}
+
+// The same for n known at run time.
+template <typename RIter1, typename RIter2>
+constexpr typename std::iterator_traits<RIter1>::value_type
+dot_product(RIter1 p1, RIter2 p2, std::size_t n)
+{
+  using tag = std::integral_constant<bool, detail::use_simd_dot<RIter1, RIter2>::value>;
+  if (detail::is_constant_evaluated())
+    return detail::dot_product(p1, p2, n, std::false_type());
+  return detail::dot_product(p1, p2, n, tag());
+}
+
 }
 
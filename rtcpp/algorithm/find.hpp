@@ -0,0 +1,420 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// AVX2 kernels compiled for the function only and chosen at run time
+// when the whole program is not built with -mavx2.
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__)) \
+  && (defined(__GNUC__) || defined(__clang__))
+#define RTCPP_FIND_AVX2
+#include <immintrin.h>
+#endif
+
+#include <rtcpp/memory/block_range.hpp>
+
+/*
+  rt::find and rt::count as std::find and std::count. Ranges given by
+  pointers to integers, float or double, searched for a key that
+  compares as an element, are compared 16 bytes at a time with SSE2
+  or NEON, 32 with AVX2 when the processor has it; other ranges are
+  handed to std::find and std::count.
+
+  The equal elements of a vector are turned into a bit mask, whose
+  lowest bit gives the position of the first match and whose bit count
+  the number of matches. The last elements of the range are compared
+  in one vector ending at the last element, which overlaps those
+  already compared, so that only ranges shorter than a vector have a
+  scalar loop. Floating point keys compare as with ==: -0 matches +0
+  and a NaN matches nothing.
+*/
+
+namespace rt
+{
+
+namespace detail
+{
+
+template <std::size_t N>
+struct int_lanes {};
+struct float_lanes {};
+struct double_lanes {};
+
+template <class T>
+struct lanes_of {
+  using type =
+    typename std::conditional<std::is_same<T, float>::value, float_lanes,
+    typename std::conditional<std::is_same<T, double>::value, double_lanes,
+      int_lanes<sizeof (T)>>::type>::type;
+};
+
+template <class T>
+struct is_simd_element {
+  static const bool value =
+    (std::is_integral<T>::value && !std::is_same<T, bool>::value)
+    || std::is_same<T, float>::value || std::is_same<T, double>::value;
+};
+
+template <class V, class T>
+struct is_simd_key {
+  static const bool value = std::is_floating_point<V>::value
+    ? std::is_same<V, T>::value
+    : std::is_integral<T>::value && !std::is_same<T, bool>::value;
+};
+
+template <class Iter, class T>
+struct use_simd_find {
+  using value_type =
+    typename std::remove_cv<typename std::iterator_traits<Iter>::value_type>::type;
+  static const bool value = std::is_pointer<Iter>::value
+    && is_simd_element<value_type>::value && is_simd_key<value_type, T>::value;
+};
+
+inline int count_ones(std::uint32_t x) noexcept
+{
+#if defined(__GNUC__)
+  return __builtin_popcount(x);
+#else
+  int n = 0;
+  for (; x; x &= x - 1)
+    ++n;
+  return n;
+#endif
+}
+
+// Whether an integer equal to key, of the type of the elements, is
+// equal to v. If not no element is; if so the elements equal to v
+// are those equal to key, since the comparison converts both to a
+// type at least as wide.
+template <class V, class T>
+bool same_key(V key, T v) noexcept
+{
+  using common = decltype(key + v);
+  return static_cast<common>(key) == static_cast<common>(v);
+}
+
+// Vectors of 16 bytes.
+#if defined(__SSE2__)
+
+using vec16 = __m128i;
+
+inline vec16 load16(const void* p) noexcept
+{ return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+
+inline vec16 eq16(vec16 a, vec16 b, int_lanes<1>) noexcept
+{ return _mm_cmpeq_epi8(a, b); }
+
+inline vec16 eq16(vec16 a, vec16 b, int_lanes<2>) noexcept
+{ return _mm_cmpeq_epi16(a, b); }
+
+inline vec16 eq16(vec16 a, vec16 b, int_lanes<4>) noexcept
+{ return _mm_cmpeq_epi32(a, b); }
+
+inline vec16 eq16(vec16 a, vec16 b, int_lanes<8>) noexcept
+{
+  // Both halves equal, there is no 64 bit comparison in SSE2.
+  const __m128i e = _mm_cmpeq_epi32(a, b);
+  return _mm_and_si128(e, _mm_shuffle_epi32(e, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+inline vec16 eq16(vec16 a, vec16 b, float_lanes) noexcept
+{ return _mm_castps_si128(_mm_cmpeq_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b))); }
+
+inline vec16 eq16(vec16 a, vec16 b, double_lanes) noexcept
+{ return _mm_castpd_si128(_mm_cmpeq_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b))); }
+
+// Bit i is set when byte i is.
+inline std::uint32_t mask16(vec16 v) noexcept
+{ return static_cast<std::uint32_t>(_mm_movemask_epi8(v)); }
+
+#define RTCPP_FIND_VEC16
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+using vec16 = uint8x16_t;
+
+inline vec16 load16(const void* p) noexcept
+{ return vld1q_u8(static_cast<const std::uint8_t*>(p)); }
+
+inline vec16 eq16(vec16 a, vec16 b, int_lanes<1>) noexcept
+{ return vceqq_u8(a, b); }
+
+inline vec16 eq16(vec16 a, vec16 b, int_lanes<2>) noexcept
+{ return vreinterpretq_u8_u16(vceqq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b))); }
+
+inline vec16 eq16(vec16 a, vec16 b, int_lanes<4>) noexcept
+{ return vreinterpretq_u8_u32(vceqq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b))); }
+
+inline vec16 eq16(vec16 a, vec16 b, int_lanes<8>) noexcept
+{ return vreinterpretq_u8_u64(vceqq_u64(vreinterpretq_u64_u8(a), vreinterpretq_u64_u8(b))); }
+
+inline vec16 eq16(vec16 a, vec16 b, float_lanes) noexcept
+{ return vreinterpretq_u8_u32(vceqq_f32(vreinterpretq_f32_u8(a), vreinterpretq_f32_u8(b))); }
+
+inline vec16 eq16(vec16 a, vec16 b, double_lanes) noexcept
+{ return vreinterpretq_u8_u64(vceqq_f64(vreinterpretq_f64_u8(a), vreinterpretq_f64_u8(b))); }
+
+inline std::uint32_t mask16(vec16 v) noexcept
+{
+  static const std::uint8_t w[16] =
+  {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t m = vandq_u8(v, vld1q_u8(w));
+  return vaddv_u8(vget_low_u8(m)) | (vaddv_u8(vget_high_u8(m)) << 8);
+}
+
+#define RTCPP_FIND_VEC16
+
+#endif
+
+#if defined(RTCPP_FIND_VEC16)
+
+// A vector with v in every element.
+template <class T>
+vec16 splat16(T v) noexcept
+{
+  T a[16 / sizeof (T)];
+  std::fill(a, a + 16 / sizeof (T), v);
+  return load16(a);
+}
+
+template <class T>
+const T* find16(const T* p, std::size_t n, T v) noexcept
+{
+  using lanes = typename lanes_of<T>::type;
+  const std::size_t e = 16 / sizeof (T);
+  if (n < e)
+    return std::find(p, p + n, v);
+
+  const vec16 k = splat16(v);
+  std::size_t i = 0;
+  for (; i + e <= n; i += e) {
+    const std::uint32_t m = mask16(eq16(load16(p + i), k, lanes()));
+    if (m)
+      return p + i + count_trailing_zeros(m) / sizeof (T);
+  }
+  if (i == n)
+    return p + n;
+  // The elements before i in this vector do not match.
+  const std::uint32_t m = mask16(eq16(load16(p + n - e), k, lanes()));
+  return m ? p + n - e + count_trailing_zeros(m) / sizeof (T) : p + n;
+}
+
+template <class T>
+std::size_t count16(const T* p, std::size_t n, T v) noexcept
+{
+  using lanes = typename lanes_of<T>::type;
+  const std::size_t e = 16 / sizeof (T);
+  if (n < e)
+    return static_cast<std::size_t>(std::count(p, p + n, v));
+
+  const vec16 k = splat16(v);
+  std::size_t bits = 0; // sizeof (T) per match.
+  std::size_t i = 0;
+  for (; i + e <= n; i += e)
+    bits += count_ones(mask16(eq16(load16(p + i), k, lanes())));
+  if (i != n) {
+    // Drops the elements counted already.
+    const std::uint32_t m = mask16(eq16(load16(p + n - e), k, lanes()));
+    bits += count_ones(m >> ((i - (n - e)) * sizeof (T)));
+  }
+  return bits / sizeof (T);
+}
+
+#else
+
+template <class T>
+const T* find16(const T* p, std::size_t n, T v) noexcept
+{ return std::find(p, p + n, v); }
+
+template <class T>
+std::size_t count16(const T* p, std::size_t n, T v) noexcept
+{ return static_cast<std::size_t>(std::count(p, p + n, v)); }
+
+#endif
+
+#if defined(RTCPP_FIND_AVX2)
+
+#define RTCPP_AVX2 __attribute__((target("avx2")))
+
+inline bool cpu_has_avx2() noexcept
+{
+#if defined(__AVX2__)
+  return true;
+#else
+  static const bool r = []()
+  {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return r;
+#endif
+}
+
+RTCPP_AVX2 inline __m256i load32(const void* p) noexcept
+{ return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+
+RTCPP_AVX2 inline __m256i eq32(__m256i a, __m256i b, int_lanes<1>) noexcept
+{ return _mm256_cmpeq_epi8(a, b); }
+
+RTCPP_AVX2 inline __m256i eq32(__m256i a, __m256i b, int_lanes<2>) noexcept
+{ return _mm256_cmpeq_epi16(a, b); }
+
+RTCPP_AVX2 inline __m256i eq32(__m256i a, __m256i b, int_lanes<4>) noexcept
+{ return _mm256_cmpeq_epi32(a, b); }
+
+RTCPP_AVX2 inline __m256i eq32(__m256i a, __m256i b, int_lanes<8>) noexcept
+{ return _mm256_cmpeq_epi64(a, b); }
+
+RTCPP_AVX2 inline __m256i eq32(__m256i a, __m256i b, float_lanes) noexcept
+{
+  return _mm256_castps_si256(_mm256_cmp_ps( _mm256_castsi256_ps(a)
+                                          , _mm256_castsi256_ps(b), _CMP_EQ_OQ));
+}
+
+RTCPP_AVX2 inline __m256i eq32(__m256i a, __m256i b, double_lanes) noexcept
+{
+  return _mm256_castpd_si256(_mm256_cmp_pd( _mm256_castsi256_pd(a)
+                                          , _mm256_castsi256_pd(b), _CMP_EQ_OQ));
+}
+
+RTCPP_AVX2 inline std::uint32_t mask32(__m256i v) noexcept
+{ return static_cast<std::uint32_t>(_mm256_movemask_epi8(v)); }
+
+template <class T>
+RTCPP_AVX2 __m256i splat32(T v) noexcept
+{
+  T a[32 / sizeof (T)];
+  std::fill(a, a + 32 / sizeof (T), v);
+  return load32(a);
+}
+
+template <class T>
+RTCPP_AVX2 const T* find32(const T* p, std::size_t n, T v) noexcept
+{
+  using lanes = typename lanes_of<T>::type;
+  const std::size_t e = 32 / sizeof (T);
+  if (n < e)
+    return find16(p, n, v);
+
+  const __m256i k = splat32(v);
+  std::size_t i = 0;
+  for (; i + e <= n; i += e) {
+    const std::uint32_t m = mask32(eq32(load32(p + i), k, lanes()));
+    if (m)
+      return p + i + count_trailing_zeros(m) / sizeof (T);
+  }
+  if (i == n)
+    return p + n;
+  const std::uint32_t m = mask32(eq32(load32(p + n - e), k, lanes()));
+  return m ? p + n - e + count_trailing_zeros(m) / sizeof (T) : p + n;
+}
+
+template <class T>
+RTCPP_AVX2 std::size_t count32(const T* p, std::size_t n, T v) noexcept
+{
+  using lanes = typename lanes_of<T>::type;
+  const std::size_t e = 32 / sizeof (T);
+  if (n < e)
+    return count16(p, n, v);
+
+  const __m256i k = splat32(v);
+  std::size_t bits = 0;
+  std::size_t i = 0;
+  for (; i + e <= n; i += e)
+    bits += count_ones(mask32(eq32(load32(p + i), k, lanes())));
+  if (i != n) {
+    const std::uint32_t m = mask32(eq32(load32(p + n - e), k, lanes()));
+    bits += count_ones(m >> ((i - (n - e)) * sizeof (T)));
+  }
+  return bits / sizeof (T);
+}
+
+#undef RTCPP_AVX2
+
+#endif
+
+template <class T>
+const T* find_simd(const T* p, std::size_t n, T v) noexcept
+{
+#if defined(RTCPP_FIND_AVX2)
+  if (cpu_has_avx2())
+    return find32(p, n, v);
+#endif
+  return find16(p, n, v);
+}
+
+template <class T>
+std::size_t count_simd(const T* p, std::size_t n, T v) noexcept
+{
+#if defined(RTCPP_FIND_AVX2)
+  if (cpu_has_avx2())
+    return count32(p, n, v);
+#endif
+  return count16(p, n, v);
+}
+
+template <class InputIter, class T>
+InputIter find_dispatch(InputIter begin, InputIter end, const T& v, std::false_type)
+{ return std::find(begin, end, v); }
+
+template <class Ptr, class T>
+Ptr find_dispatch(Ptr begin, Ptr end, const T& v, std::true_type)
+{
+  using value_type = typename std::remove_cv<
+    typename std::iterator_traits<Ptr>::value_type>::type;
+  const value_type key = static_cast<value_type>(v);
+  if (!same_key(key, v))
+    return end;
+  const std::size_t n = static_cast<std::size_t>(end - begin);
+  return begin + (find_simd<value_type>(begin, n, key) - begin);
+}
+
+template <class InputIter, class T>
+typename std::iterator_traits<InputIter>::difference_type
+count_dispatch(InputIter begin, InputIter end, const T& v, std::false_type)
+{ return std::count(begin, end, v); }
+
+template <class Ptr, class T>
+typename std::iterator_traits<Ptr>::difference_type
+count_dispatch(Ptr begin, Ptr end, const T& v, std::true_type)
+{
+  using value_type = typename std::remove_cv<
+    typename std::iterator_traits<Ptr>::value_type>::type;
+  using difference_type = typename std::iterator_traits<Ptr>::difference_type;
+  const value_type key = static_cast<value_type>(v);
+  if (!same_key(key, v))
+    return 0;
+  const std::size_t n = static_cast<std::size_t>(end - begin);
+  return static_cast<difference_type>(count_simd<value_type>(begin, n, key));
+}
+
+}
+
+template <class InputIter, class T>
+InputIter find(InputIter begin, InputIter end, const T& v)
+{
+  using simd = detail::use_simd_find<InputIter, T>;
+  return detail::find_dispatch( begin, end, v
+                              , std::integral_constant<bool, simd::value>());
+}
+
+template <class InputIter, class T>
+typename std::iterator_traits<InputIter>::difference_type
+count(InputIter begin, InputIter end, const T& v)
+{
+  using simd = detail::use_simd_find<InputIter, T>;
+  return detail::count_dispatch( begin, end, v
+                               , std::integral_constant<bool, simd::value>());
+}
+
+}
+
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <iterator>
+#include <type_traits>
+
+#include "find.hpp"
 
 namespace rt
 {
@@ -8,6 +11,27 @@ namespace rt
 // Faster than std::find.
 // Assumes the last element is set to the searched value.
 // std::distance(begin, last) is assumed to be at least 1.
+// Ranges rt::find vectorizes are searched with it instead, the vector
+// ending at the last element takes the place of the sentinel.
+
+namespace detail
+{
+
+template <typename ForwardIter, typename T>
+ForwardIter
+find_intrusive(ForwardIter begin, ForwardIter, const T& v, std::false_type)
+{
+  while (*begin != v)
+    ++begin;
+
+  return begin;
+}
+
+template <typename Ptr, typename T>
+Ptr find_intrusive(Ptr begin, Ptr end, const T& v, std::true_type)
+{ return rt::find(begin, end, v); }
+
+}
 
 template <typename ForwardIter, typename T>
 ForwardIter
@@ -16,8 +40,9 @@ find_intrusive(ForwardIter begin, ForwardIter end, const T& v)
   if (begin == end) // Empty range.
     return end;
 
-  while (*begin != v)
-    ++begin;
+  using simd = detail::use_simd_find<ForwardIter, T>;
+  begin = detail::find_intrusive( begin, end, v
+                                , std::integral_constant<bool, simd::value>());
 
   if (begin == std::prev(end))
     return end;
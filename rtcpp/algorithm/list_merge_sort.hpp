@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include "sort.hpp"
+
+/*
+  Sorting of linked nodes by relinking them, used by forward_list and
+  list. A chain is a sequence of nodes linked through next whose last
+  node links to end, e.g. the head of the list, so that the lists do
+  not have to be opened. Nodes hold their value in info, or are the
+  value if they are intrusive hooks (see intrusive_forward_list.hpp).
+*/
+
+namespace rt
+{
+
+// The value held by a node, hooks have their own overload.
+template <class Ptr>
+auto chain_value(Ptr p) noexcept -> decltype((p->info))
+{ return p->info; }
+
+// Merges the sorted chains a and b, both ending at end. Equivalent
+// elements of a come first. Returns the first node.
+template <class Ptr, class Compare>
+Ptr merge_chains(Ptr a, Ptr b, Ptr end, Compare& comp)
+{
+  if (a == end)
+    return b;
+  if (b == end)
+    return a;
+
+  Ptr first = a;
+  if (comp(chain_value(b), chain_value(a))) {
+    first = b;
+    b = b->next;
+  } else {
+    a = a->next;
+  }
+
+  Ptr tail = first;
+  while (a != end && b != end) {
+    if (comp(chain_value(b), chain_value(a))) {
+      tail->next = b;
+      tail = b;
+      b = b->next;
+    } else {
+      tail->next = a;
+      tail = a;
+      a = a->next;
+    }
+  }
+  tail->next = a != end ? a : b;
+  return first;
+}
+
+// Stable bottom-up merge sort of the chain starting at first. Bin i
+// holds a sorted chain of 2^i nodes or is empty, each node is carried
+// into the bins like a binary counter. Nothing is allocated. Returns
+// the new first node.
+template <class Ptr, class Compare>
+Ptr merge_sort_chain(Ptr first, Ptr end, Compare comp)
+{
+  Ptr bins[8 * sizeof (void*)];
+  std::size_t n_bins = 0;
+  while (first != end) {
+    Ptr carry = first;
+    first = first->next;
+    carry->next = end;
+    std::size_t i = 0;
+    for (; i < n_bins && bins[i] != end; ++i) {
+      carry = merge_chains(bins[i], carry, end, comp);
+      bins[i] = end;
+    }
+    if (i == n_bins)
+      ++n_bins;
+    bins[i] = carry;
+  }
+
+  // Lower bins hold later elements.
+  Ptr result = end;
+  for (std::size_t i = 0; i < n_bins; ++i)
+    result = merge_chains(bins[i], result, end, comp);
+  return result;
+}
+
+// Moves the values, in chain order, into the same nodes sorted by
+// address and relinks them in that order, so that a traversal walks
+// the buffer forward. Allocates room for the pointers and the values.
+// Returns the new first node.
+template <class Ptr>
+Ptr relayout_chain(Ptr first, Ptr end)
+{
+  using value_type =
+    typename std::remove_reference<decltype(first->info)>::type;
+  std::vector<Ptr> addr;
+  std::vector<value_type> tmp;
+  for (Ptr p = first; p != end; p = p->next) {
+    addr.push_back(p);
+    tmp.push_back(std::move(p->info));
+  }
+
+  if (addr.empty())
+    return end;
+
+  rt::sort(std::begin(addr), std::end(addr), std::less<Ptr>());
+  for (std::size_t i = 0; i < addr.size(); ++i) {
+    addr[i]->info = std::move(tmp[i]);
+    addr[i]->next = i + 1 < addr.size() ? addr[i + 1] : end;
+  }
+  return addr.front();
+}
+
+}
+
@@ -0,0 +1,382 @@
+#pragma once
+
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#include "find.hpp"
+
+/*
+  rt::minmax_element as std::minmax_element: the first smallest and
+  the last largest element, found in one pass. Ranges given by
+  pointers to integers, float or double are compared a vector at a
+  time with SSE2, or AVX2 when the processor has it (see find.hpp),
+  other ranges and those given a comparator are handed to
+  std::minmax_element.
+
+  Each lane keeps the smallest and the largest of the elements it
+  sees, and the number of the vector where it saw them, in a lane of
+  the element size; the lanes are reduced to one position when the
+  counter would overflow, every 256 vectors for bytes, and at the end.
+  The result for ranges with NaNs is unspecified.
+*/
+
+namespace rt
+{
+
+namespace detail
+{
+
+template <std::size_t N>
+struct lane_uint;
+
+template <> struct lane_uint<1> { using type = std::uint8_t; };
+template <> struct lane_uint<2> { using type = std::uint16_t; };
+template <> struct lane_uint<4> { using type = std::uint32_t; };
+template <> struct lane_uint<8> { using type = std::uint64_t; };
+
+// Vectors the last counter of a lane can tell apart.
+template <class T>
+std::size_t minmax_block() noexcept
+{
+  using index = typename lane_uint<sizeof (T)>::type;
+  const std::uint64_t m = std::numeric_limits<index>::max();
+  return static_cast<std::size_t>(
+    std::min<std::uint64_t>(m, std::numeric_limits<std::size_t>::max()));
+}
+
+// Folds the lanes of a block into the positions found so far, min
+// and max, both meaningful only if any is true. Vector k of the block
+// starts at element base + k * e.
+template <class T, std::size_t E, class Index>
+void minmax_fold( const T (&vmin)[E], const T (&vmax)[E]
+                , const Index (&imin)[E], const Index (&imax)[E]
+                , const T* p, std::size_t base
+                , std::size_t& min, std::size_t& max, bool& any) noexcept
+{
+  for (std::size_t l = 0; l < E; ++l) {
+    const std::size_t a = base + static_cast<std::size_t>(imin[l]) * E + l;
+    const std::size_t b = base + static_cast<std::size_t>(imax[l]) * E + l;
+    if (!any) {
+      min = a;
+      max = b;
+      any = true;
+      continue;
+    }
+    if (vmin[l] < p[min] || (!(p[min] < vmin[l]) && a < min))
+      min = a;
+    if (p[max] < vmax[l] || (!(vmax[l] < p[max]) && b > max))
+      max = b;
+  }
+}
+
+// The elements after the vectors.
+template <class T>
+void minmax_tail( const T* p, std::size_t i, std::size_t n
+                , std::size_t& min, std::size_t& max) noexcept
+{
+  for (; i < n; ++i) {
+    if (p[i] < p[min])
+      min = i;
+    if (!(p[i] < p[max]))
+      max = i;
+  }
+}
+
+#if defined(__SSE2__)
+
+template <class T>
+vec16 lt16(vec16 a, vec16 b, int_lanes<1>) noexcept
+{
+  if (std::is_unsigned<T>::value) {
+    const __m128i s = _mm_set1_epi8(char(0x80));
+    a = _mm_xor_si128(a, s);
+    b = _mm_xor_si128(b, s);
+  }
+  return _mm_cmplt_epi8(a, b);
+}
+
+template <class T>
+vec16 lt16(vec16 a, vec16 b, int_lanes<2>) noexcept
+{
+  if (std::is_unsigned<T>::value) {
+    const __m128i s = _mm_set1_epi16(short(0x8000));
+    a = _mm_xor_si128(a, s);
+    b = _mm_xor_si128(b, s);
+  }
+  return _mm_cmplt_epi16(a, b);
+}
+
+template <class T>
+vec16 lt16(vec16 a, vec16 b, int_lanes<4>) noexcept
+{
+  if (std::is_unsigned<T>::value) {
+    const __m128i s = _mm_set1_epi32(int(0x80000000u));
+    a = _mm_xor_si128(a, s);
+    b = _mm_xor_si128(b, s);
+  }
+  return _mm_cmplt_epi32(a, b);
+}
+
+template <class T>
+vec16 lt16(vec16 a, vec16 b, int_lanes<8>) noexcept
+{
+  if (std::is_unsigned<T>::value) {
+    const __m128i s = _mm_set1_epi64x(std::int64_t(0x8000000000000000ull));
+    a = _mm_xor_si128(a, s);
+    b = _mm_xor_si128(b, s);
+  }
+  // High halves signed, low halves unsigned.
+  const __m128i s = _mm_set1_epi64x(0x80000000);
+  const __m128i gt = _mm_cmpgt_epi32(b, a);
+  const __m128i eq = _mm_cmpeq_epi32(a, b);
+  const __m128i lo = _mm_cmpgt_epi32(_mm_xor_si128(b, s), _mm_xor_si128(a, s));
+  const __m128i r =
+    _mm_or_si128(gt, _mm_and_si128(eq, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 2, 0, 0))));
+  return _mm_shuffle_epi32(r, _MM_SHUFFLE(3, 3, 1, 1));
+}
+
+template <class T>
+vec16 lt16(vec16 a, vec16 b, float_lanes) noexcept
+{ return _mm_castps_si128(_mm_cmplt_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b))); }
+
+template <class T>
+vec16 lt16(vec16 a, vec16 b, double_lanes) noexcept
+{ return _mm_castpd_si128(_mm_cmplt_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b))); }
+
+inline vec16 add16(vec16 a, vec16 b, int_lanes<1>) noexcept
+{ return _mm_add_epi8(a, b); }
+
+inline vec16 add16(vec16 a, vec16 b, int_lanes<2>) noexcept
+{ return _mm_add_epi16(a, b); }
+
+inline vec16 add16(vec16 a, vec16 b, int_lanes<4>) noexcept
+{ return _mm_add_epi32(a, b); }
+
+inline vec16 add16(vec16 a, vec16 b, int_lanes<8>) noexcept
+{ return _mm_add_epi64(a, b); }
+
+// b where m is set, a elsewhere.
+inline vec16 blend16(vec16 a, vec16 b, vec16 m) noexcept
+{ return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a)); }
+
+template <class T>
+std::pair<std::size_t, std::size_t> minmax16(const T* p, std::size_t n) noexcept
+{
+  using lanes = typename lanes_of<T>::type;
+  using index = typename lane_uint<sizeof (T)>::type;
+  using ilanes = int_lanes<sizeof (T)>;
+  const std::size_t e = 16 / sizeof (T);
+  const std::size_t vectors = n / e;
+  const std::size_t block = minmax_block<T>();
+  const vec16 one = splat16(index(1));
+
+  std::size_t min = 0;
+  std::size_t max = 0;
+  bool any = false;
+  for (std::size_t b = 0; b < vectors; b += block) {
+    const std::size_t m = std::min(block, vectors - b);
+    const T* q = p + b * e;
+    vec16 vmin = load16(q);
+    vec16 vmax = vmin;
+    vec16 imin = _mm_setzero_si128();
+    vec16 imax = imin;
+    vec16 k = imin;
+    for (std::size_t j = 1; j < m; ++j) {
+      k = add16(k, one, ilanes());
+      const vec16 x = load16(q + j * e);
+      const vec16 lt = lt16<T>(x, vmin, lanes());
+      vmin = blend16(vmin, x, lt);
+      imin = blend16(imin, k, lt);
+      // The largest is replaced by equal elements.
+      const vec16 le = lt16<T>(x, vmax, lanes());
+      vmax = blend16(x, vmax, le);
+      imax = blend16(k, imax, le);
+    }
+    T a[16 / sizeof (T)];
+    T c[16 / sizeof (T)];
+    index ia[16 / sizeof (T)];
+    index ic[16 / sizeof (T)];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(a), vmin);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(c), vmax);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ia), imin);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ic), imax);
+    minmax_fold(a, c, ia, ic, p, b * e, min, max, any);
+  }
+  minmax_tail(p, vectors * e, n, min, max);
+  return std::make_pair(min, max);
+}
+
+#else
+
+template <class T>
+std::pair<std::size_t, std::size_t> minmax16(const T* p, std::size_t n) noexcept
+{
+  std::size_t min = 0;
+  std::size_t max = 0;
+  minmax_tail(p, 1, n, min, max);
+  return std::make_pair(min, max);
+}
+
+#endif
+
+#if defined(RTCPP_FIND_AVX2)
+
+#define RTCPP_AVX2 __attribute__((target("avx2")))
+
+template <class T>
+RTCPP_AVX2 __m256i sign32(__m256i a) noexcept
+{
+  using index = typename lane_uint<sizeof (T)>::type;
+  if (!std::is_unsigned<T>::value)
+    return a;
+  const index s = index(1) << (8 * sizeof (T) - 1);
+  return _mm256_xor_si256(a, splat32(s));
+}
+
+template <class T>
+RTCPP_AVX2 __m256i lt32(__m256i a, __m256i b, int_lanes<1>) noexcept
+{ return _mm256_cmpgt_epi8(sign32<T>(b), sign32<T>(a)); }
+
+template <class T>
+RTCPP_AVX2 __m256i lt32(__m256i a, __m256i b, int_lanes<2>) noexcept
+{ return _mm256_cmpgt_epi16(sign32<T>(b), sign32<T>(a)); }
+
+template <class T>
+RTCPP_AVX2 __m256i lt32(__m256i a, __m256i b, int_lanes<4>) noexcept
+{ return _mm256_cmpgt_epi32(sign32<T>(b), sign32<T>(a)); }
+
+template <class T>
+RTCPP_AVX2 __m256i lt32(__m256i a, __m256i b, int_lanes<8>) noexcept
+{ return _mm256_cmpgt_epi64(sign32<T>(b), sign32<T>(a)); }
+
+template <class T>
+RTCPP_AVX2 __m256i lt32(__m256i a, __m256i b, float_lanes) noexcept
+{
+  return _mm256_castps_si256(_mm256_cmp_ps( _mm256_castsi256_ps(a)
+                                          , _mm256_castsi256_ps(b), _CMP_LT_OQ));
+}
+
+template <class T>
+RTCPP_AVX2 __m256i lt32(__m256i a, __m256i b, double_lanes) noexcept
+{
+  return _mm256_castpd_si256(_mm256_cmp_pd( _mm256_castsi256_pd(a)
+                                          , _mm256_castsi256_pd(b), _CMP_LT_OQ));
+}
+
+RTCPP_AVX2 inline __m256i add32(__m256i a, __m256i b, int_lanes<1>) noexcept
+{ return _mm256_add_epi8(a, b); }
+
+RTCPP_AVX2 inline __m256i add32(__m256i a, __m256i b, int_lanes<2>) noexcept
+{ return _mm256_add_epi16(a, b); }
+
+RTCPP_AVX2 inline __m256i add32(__m256i a, __m256i b, int_lanes<4>) noexcept
+{ return _mm256_add_epi32(a, b); }
+
+RTCPP_AVX2 inline __m256i add32(__m256i a, __m256i b, int_lanes<8>) noexcept
+{ return _mm256_add_epi64(a, b); }
+
+template <class T>
+RTCPP_AVX2 std::pair<std::size_t, std::size_t>
+minmax32(const T* p, std::size_t n) noexcept
+{
+  using lanes = typename lanes_of<T>::type;
+  using index = typename lane_uint<sizeof (T)>::type;
+  using ilanes = int_lanes<sizeof (T)>;
+  const std::size_t e = 32 / sizeof (T);
+  const std::size_t vectors = n / e;
+  if (vectors == 0)
+    return minmax16(p, n);
+  const std::size_t block = minmax_block<T>();
+  const __m256i one = splat32(index(1));
+
+  std::size_t min = 0;
+  std::size_t max = 0;
+  bool any = false;
+  for (std::size_t b = 0; b < vectors; b += block) {
+    const std::size_t m = std::min(block, vectors - b);
+    const T* q = p + b * e;
+    __m256i vmin = load32(q);
+    __m256i vmax = vmin;
+    __m256i imin = _mm256_setzero_si256();
+    __m256i imax = imin;
+    __m256i k = imin;
+    for (std::size_t j = 1; j < m; ++j) {
+      k = add32(k, one, ilanes());
+      const __m256i x = load32(q + j * e);
+      const __m256i lt = lt32<T>(x, vmin, lanes());
+      vmin = _mm256_blendv_epi8(vmin, x, lt);
+      imin = _mm256_blendv_epi8(imin, k, lt);
+      const __m256i le = lt32<T>(x, vmax, lanes());
+      vmax = _mm256_blendv_epi8(x, vmax, le);
+      imax = _mm256_blendv_epi8(k, imax, le);
+    }
+    T a[32 / sizeof (T)];
+    T c[32 / sizeof (T)];
+    index ia[32 / sizeof (T)];
+    index ic[32 / sizeof (T)];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(a), vmin);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(c), vmax);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ia), imin);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ic), imax);
+    minmax_fold(a, c, ia, ic, p, b * e, min, max, any);
+  }
+  minmax_tail(p, vectors * e, n, min, max);
+  return std::make_pair(min, max);
+}
+
+#undef RTCPP_AVX2
+
+#endif
+
+template <class T>
+std::pair<std::size_t, std::size_t> minmax_simd(const T* p, std::size_t n) noexcept
+{
+#if defined(RTCPP_FIND_AVX2)
+  if (cpu_has_avx2())
+    return minmax32(p, n);
+#endif
+  return minmax16(p, n);
+}
+
+template <class ForwardIter>
+std::pair<ForwardIter, ForwardIter>
+minmax_element(ForwardIter first, ForwardIter last, std::false_type)
+{ return std::minmax_element(first, last); }
+
+template <class Ptr>
+std::pair<Ptr, Ptr> minmax_element(Ptr first, Ptr last, std::true_type)
+{
+  using value_type = typename std::remove_cv<
+    typename std::iterator_traits<Ptr>::value_type>::type;
+  if (first == last)
+    return std::make_pair(last, last);
+  const auto r = minmax_simd<value_type>(first, static_cast<std::size_t>(last - first));
+  return std::make_pair(first + r.first, first + r.second);
+}
+
+}
+
+// Smallest and largest elements, (last, last) if the range is empty.
+template <class ForwardIter>
+std::pair<ForwardIter, ForwardIter>
+minmax_element(ForwardIter first, ForwardIter last)
+{
+  using value_type = typename std::remove_cv<
+    typename std::iterator_traits<ForwardIter>::value_type>::type;
+  using simd = std::integral_constant<bool, std::is_pointer<ForwardIter>::value
+    && detail::is_simd_element<value_type>::value>;
+  return detail::minmax_element(first, last, simd());
+}
+
+template <class ForwardIter, class Compare>
+std::pair<ForwardIter, ForwardIter>
+minmax_element(ForwardIter first, ForwardIter last, Compare comp)
+{ return std::minmax_element(first, last, comp); }
+
+}
+
@@ -0,0 +1,389 @@
+#pragma once
+
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include <rtcpp/container/tbst.hpp>
+#include <rtcpp/container/forward_list.hpp>
+#include <rtcpp/memory/block_range.hpp>
+
+/*
+  Reductions over a buffer of nodes, e.g. the std::vector<node_type>
+  given to a node_alloc_header, visiting only the nodes in use. The
+  nodes are read in address order, which is much faster than chasing
+  the links of the container.
+
+  Which nodes are in use is decided either by the in use bit in the
+  tag of tbst::node (overloads without a bitmap) or by an occupancy
+  bitmap (see node_alloc_header::use_bitmap), where bit k refers to
+  p[k]. The latter works for forward_list_node too, which has no tag,
+  but counts every block handed out by the allocator, e.g. the head
+  node of rt::set, whose tag has the in use bit cleared.
+
+  When compiled with AVX2 the kernels for int keys load eight keys
+  at a time with a strided gather and mask them instead of branching.
+*/
+
+namespace rt {
+
+template <class Node>
+struct scan_traits;
+
+template <class T, class Ptr>
+struct scan_traits<tbst::node<T, Ptr>> {
+  using node_type = tbst::node<T, Ptr>;
+  using key_type = T;
+  static const bool has_tag = true;
+  static const std::size_t key_offset = offsetof(node_type, key);
+  static const std::size_t tag_offset = offsetof(node_type, tag);
+  static const T& key(const node_type& o) noexcept {return o.key;}
+};
+
+template <class T, class Ptr>
+struct scan_traits<forward_list_node<T, Ptr>> {
+  using node_type = forward_list_node<T, Ptr>;
+  using key_type = T;
+  static const bool has_tag = false;
+  static const std::size_t key_offset = offsetof(node_type, info);
+  static const T& key(const node_type& o) noexcept {return o.info;}
+};
+
+namespace detail {
+
+template <class Node>
+struct tag_mask {
+  static_assert( scan_traits<Node>::has_tag
+               , "tag_mask: Node has no tag, use a bitmap.");
+  bool operator()(const Node& o, std::size_t) const noexcept
+  {return tbst::test_in_use(o);}
+};
+
+struct bitmap_mask {
+  const std::uint64_t* bitmap;
+  template <class Node>
+  bool operator()(const Node&, std::size_t k) const noexcept
+  {return (bitmap[k / 64] >> (k % 64)) & 1;}
+};
+
+template <class Node, class Mask, class F>
+void scan(const Node* p, std::size_t n, Mask mask, F& f)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    if (mask(p[i], i))
+      f(scan_traits<Node>::key(p[i]));
+}
+
+template <class Node, class Mask>
+const Node* find(const Node* p, std::size_t n, Mask mask,
+  const typename scan_traits<Node>::key_type& v)
+{
+  for (std::size_t i = 0; i < n; ++i)
+    if (mask(p[i], i) && scan_traits<Node>::key(p[i]) == v)
+      return p + i;
+  return p + n;
+}
+
+#if defined(__AVX2__)
+
+template <class Node>
+struct use_avx2 {
+  static const bool value =
+    std::is_same<typename scan_traits<Node>::key_type, int>::value
+    && sizeof (Node) * 8 <= std::numeric_limits<int>::max();
+};
+
+// Byte offsets of eight consecutive nodes.
+template <class Node>
+inline __m256i lane_offsets() noexcept
+{
+  const int s = sizeof (Node);
+  return _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+}
+
+template <class Node>
+inline __m256i gather_keys(const Node* p, __m256i offs) noexcept
+{
+  auto base = reinterpret_cast<const char*>(p) + scan_traits<Node>::key_offset;
+  return _mm256_i32gather_epi32(reinterpret_cast<const int*>(base), offs, 1);
+}
+
+// Mask of the eight nodes starting at p[i], all bits set if in use.
+template <class Node>
+inline __m256i avx2_mask( const tag_mask<Node>&, const Node* p
+                        , std::size_t i, __m256i offs) noexcept
+{
+  auto base = reinterpret_cast<const char*>(p + i)
+            + scan_traits<Node>::tag_offset;
+  // Reads the tag and the bytes following it, they are masked out.
+  const __m256i t =
+    _mm256_i32gather_epi32(reinterpret_cast<const int*>(base), offs, 1);
+  const __m256i bit = _mm256_set1_epi32(tbst::detail::in_use_bit);
+  return _mm256_cmpeq_epi32(_mm256_and_si256(t, bit), bit);
+}
+
+template <class Node>
+inline __m256i avx2_mask( const bitmap_mask& m, const Node*
+                        , std::size_t i, __m256i) noexcept
+{
+  // i is a multiple of eight, the eight bits are in the same byte.
+  const int b = static_cast<int>((m.bitmap[i / 64] >> (i % 64)) & 0xff);
+  const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(b), lanes), lanes);
+}
+
+inline int hsum(__m256i v) noexcept
+{
+  __m128i s = _mm_add_epi32( _mm256_castsi256_si128(v)
+                           , _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(s);
+}
+
+inline std::int64_t hsum64(__m256i v) noexcept
+{
+  __m128i s = _mm_add_epi64( _mm256_castsi256_si128(v)
+                           , _mm256_extracti128_si256(v, 1));
+  s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+  return _mm_cvtsi128_si64(s);
+}
+
+template <class Node, class Mask>
+std::int64_t sum64_avx2(const Node* p, std::size_t n, Mask mask, std::size_t& i)
+{
+  const __m256i offs = lane_offsets<Node>();
+  __m256i acc = _mm256_setzero_si256();
+  for (i = 0; i + 8 <= n; i += 8) {
+    const __m256i v = _mm256_and_si256( gather_keys(p + i, offs)
+                                      , avx2_mask(mask, p, i, offs));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+  }
+  return hsum64(acc);
+}
+
+template <class Node, class Mask>
+int sum32_avx2(const Node* p, std::size_t n, Mask mask, std::size_t& i)
+{
+  const __m256i offs = lane_offsets<Node>();
+  __m256i acc = _mm256_setzero_si256();
+  for (i = 0; i + 8 <= n; i += 8) {
+    const __m256i v = _mm256_and_si256( gather_keys(p + i, offs)
+                                      , avx2_mask(mask, p, i, offs));
+    acc = _mm256_add_epi32(acc, v);
+  }
+  return hsum(acc);
+}
+
+template <class Node, class Mask>
+std::pair<int, int>
+minmax_avx2(const Node* p, std::size_t n, Mask mask, std::size_t& i)
+{
+  const __m256i offs = lane_offsets<Node>();
+  const __m256i hi = _mm256_set1_epi32(std::numeric_limits<int>::max());
+  const __m256i lo = _mm256_set1_epi32(std::numeric_limits<int>::lowest());
+  __m256i vmin = hi;
+  __m256i vmax = lo;
+  for (i = 0; i + 8 <= n; i += 8) {
+    const __m256i v = gather_keys(p + i, offs);
+    const __m256i m = avx2_mask(mask, p, i, offs);
+    vmin = _mm256_min_epi32(vmin, _mm256_blendv_epi8(hi, v, m));
+    vmax = _mm256_max_epi32(vmax, _mm256_blendv_epi8(lo, v, m));
+  }
+  alignas(32) int a[8];
+  alignas(32) int b[8];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(a), vmin);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(b), vmax);
+  std::pair<int, int> r(a[0], b[0]);
+  for (int k = 1; k < 8; ++k) {
+    r.first = a[k] < r.first ? a[k] : r.first;
+    r.second = b[k] > r.second ? b[k] : r.second;
+  }
+  return r;
+}
+
+template <class Node, class Mask>
+const Node* find_avx2(const Node* p, std::size_t n, Mask mask, int v)
+{
+  const __m256i offs = lane_offsets<Node>();
+  const __m256i key = _mm256_set1_epi32(v);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i eq = _mm256_and_si256( _mm256_cmpeq_epi32(gather_keys(p + i, offs), key)
+                                       , avx2_mask(mask, p, i, offs));
+    const int m = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+    if (m)
+      return p + i + count_trailing_zeros(m);
+  }
+
+  for (; i < n; ++i)
+    if (mask(p[i], i) && scan_traits<Node>::key(p[i]) == v)
+      return p + i;
+  return p + n;
+}
+
+#else
+
+template <class Node>
+struct use_avx2 : std::false_type {};
+
+#endif
+
+template <class Node, class Mask, class Acc>
+Acc sum(const Node* p, std::size_t n, Mask mask, Acc init, std::false_type)
+{
+  auto f = [&](const typename scan_traits<Node>::key_type& k) { init += k; };
+  scan(p, n, mask, f);
+  return init;
+}
+
+template <class Node, class Mask>
+std::pair<typename scan_traits<Node>::key_type, typename scan_traits<Node>::key_type>
+minmax(const Node* p, std::size_t n, Mask mask, std::false_type)
+{
+  using key_type = typename scan_traits<Node>::key_type;
+  std::pair<key_type, key_type> r( std::numeric_limits<key_type>::max()
+                                 , std::numeric_limits<key_type>::lowest());
+  auto f = [&](const key_type& k)
+  {
+    if (k < r.first)
+      r.first = k;
+    if (r.second < k)
+      r.second = k;
+  };
+  scan(p, n, mask, f);
+  return r;
+}
+
+template <class Node, class Mask>
+const Node* find(const Node* p, std::size_t n, Mask mask,
+  const typename scan_traits<Node>::key_type& v, std::false_type)
+{ return find(p, n, mask, v); }
+
+#if defined(__AVX2__)
+
+template <class Node, class Mask, class Acc>
+Acc sum(const Node* p, std::size_t n, Mask mask, Acc init, std::true_type)
+{
+  std::size_t i = 0;
+  if (sizeof (Acc) > sizeof (int))
+    init += sum64_avx2(p, n, mask, i);
+  else
+    init += sum32_avx2(p, n, mask, i);
+
+  for (; i < n; ++i)
+    if (mask(p[i], i))
+      init += scan_traits<Node>::key(p[i]);
+  return init;
+}
+
+template <class Node, class Mask>
+std::pair<int, int>
+minmax(const Node* p, std::size_t n, Mask mask, std::true_type)
+{
+  std::size_t i = 0;
+  auto r = minmax_avx2(p, n, mask, i);
+  for (; i < n; ++i) {
+    if (!mask(p[i], i))
+      continue;
+    const int k = scan_traits<Node>::key(p[i]);
+    r.first = k < r.first ? k : r.first;
+    r.second = k > r.second ? k : r.second;
+  }
+  return r;
+}
+
+template <class Node, class Mask>
+const Node* find(const Node* p, std::size_t n, Mask mask, int v, std::true_type)
+{ return find_avx2(p, n, mask, v); }
+
+#endif
+
+template <class Node, class Acc>
+struct use_avx2_sum {
+  static const bool value = use_avx2<Node>::value
+    && std::is_integral<Acc>::value && sizeof (Acc) >= sizeof (int);
+};
+
+}
+
+// Sum of the keys of the nodes in use in [p, p + n).
+template <class Node, class Acc>
+Acc sum_in_use(const Node* p, std::size_t n, Acc init)
+{
+  using tag = std::integral_constant<bool, detail::use_avx2_sum<Node, Acc>::value>;
+  return detail::sum(p, n, detail::tag_mask<Node>(), init, tag());
+}
+
+template <class Node, class Acc>
+Acc sum_in_use(const Node* p, std::size_t n, const std::uint64_t* bitmap, Acc init)
+{
+  using tag = std::integral_constant<bool, detail::use_avx2_sum<Node, Acc>::value>;
+  return detail::sum(p, n, detail::bitmap_mask{bitmap}, init, tag());
+}
+
+// Smallest and largest keys of the nodes in use. If there is none
+// returns (max, lowest) of the key type.
+template <class Node>
+std::pair<typename scan_traits<Node>::key_type, typename scan_traits<Node>::key_type>
+minmax_in_use(const Node* p, std::size_t n)
+{
+  using tag = std::integral_constant<bool, detail::use_avx2<Node>::value>;
+  return detail::minmax(p, n, detail::tag_mask<Node>(), tag());
+}
+
+template <class Node>
+std::pair<typename scan_traits<Node>::key_type, typename scan_traits<Node>::key_type>
+minmax_in_use(const Node* p, std::size_t n, const std::uint64_t* bitmap)
+{
+  using tag = std::integral_constant<bool, detail::use_avx2<Node>::value>;
+  return detail::minmax(p, n, detail::bitmap_mask{bitmap}, tag());
+}
+
+// Number of nodes in use whose key satisfies pred.
+template <class Node, class Pred>
+std::size_t count_if_in_use(const Node* p, std::size_t n, Pred pred)
+{
+  std::size_t c = 0;
+  auto f = [&](const typename scan_traits<Node>::key_type& k) { c += pred(k) ? 1 : 0; };
+  detail::scan(p, n, detail::tag_mask<Node>(), f);
+  return c;
+}
+
+template <class Node, class Pred>
+std::size_t count_if_in_use( const Node* p, std::size_t n
+                           , const std::uint64_t* bitmap, Pred pred)
+{
+  std::size_t c = 0;
+  auto f = [&](const typename scan_traits<Node>::key_type& k) { c += pred(k) ? 1 : 0; };
+  detail::scan(p, n, detail::bitmap_mask{bitmap}, f);
+  return c;
+}
+
+// First node in use with key v, p + n if there is none.
+template <class Node>
+const Node* find_in_use( const Node* p, std::size_t n
+                       , const typename scan_traits<Node>::key_type& v)
+{
+  using tag = std::integral_constant<bool, detail::use_avx2<Node>::value>;
+  return detail::find(p, n, detail::tag_mask<Node>(), v, tag());
+}
+
+template <class Node>
+const Node* find_in_use( const Node* p, std::size_t n
+                       , const std::uint64_t* bitmap
+                       , const typename scan_traits<Node>::key_type& v)
+{
+  using tag = std::integral_constant<bool, detail::use_avx2<Node>::value>;
+  return detail::find(p, n, detail::bitmap_mask{bitmap}, v, tag());
+}
+
+}
+
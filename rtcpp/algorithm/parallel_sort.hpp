@@ -0,0 +1,232 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include "sort.hpp"
+#include "radix_sort.hpp"
+#include "dist_counting_sort.hpp"
+
+/*
+  Parallel versions of rt::sort, radix_sort and dist_counting_sort
+  running on an executor: spawn_executor (utility/parallel.hpp),
+  thread_pool (utility/thread_pool.hpp) or any type with the same
+  size() and run(n, f) members.
+
+  The range is cut in size() contiguous chunks, one per task.
+
+  parallel_sort sorts the chunks with rt::sort and merges them pairwise
+  through the scratch buffer, each merge cut in as many independent
+  pieces as there are threads (merge path), so that all threads work
+  in every round. The result is stable with respect to the chunks, the
+  sort is not stable.
+
+  The counting sorts count each chunk into a histogram of its own, the
+  histograms are merged into the first position of each digit for each
+  chunk and the chunks are then scattered concurrently, the result is
+  stable. The histograms, size() << Bits counters, are the only
+  allocation.
+*/
+
+namespace rt
+{
+
+namespace detail
+{
+
+// Bounds of chunk i of n elements cut in k.
+inline std::pair<std::size_t, std::size_t>
+chunk(std::size_t n, std::size_t k, std::size_t i) noexcept
+{ return std::make_pair(n * i / k, n * (i + 1) / k); }
+
+// Number of elements of a among the first d of the stable merge of
+// a and b, whose elements of a come first on ties.
+template <class Iter, class Comp>
+std::size_t merge_split( Iter a, std::size_t na, Iter b, std::size_t nb
+                       , std::size_t d, Comp comp)
+{
+  std::size_t lo = d > nb ? d - nb : 0;
+  std::size_t hi = d < na ? d : na;
+  while (lo < hi) {
+    const std::size_t i = (lo + hi) / 2;
+    if (!comp(b[d - i - 1], a[i]))
+      lo = i + 1;
+    else
+      hi = i;
+  }
+  return lo;
+}
+
+// Merges [a, a + na) and [b, b + nb) into out in parts pieces.
+template <class Exec, class Iter, class OutIter, class Comp>
+void parallel_merge( Exec& exec, Iter a, std::size_t na, Iter b
+                   , std::size_t nb, OutIter out, std::size_t parts, Comp comp)
+{
+  const std::size_t n = na + nb;
+  exec.run(parts, [&](std::size_t k)
+  {
+    const auto r = chunk(n, parts, k);
+    const std::size_t i0 = merge_split(a, na, b, nb, r.first, comp);
+    const std::size_t i1 = merge_split(a, na, b, nb, r.second, comp);
+    const std::size_t j0 = r.first - i0;
+    const std::size_t j1 = r.second - i1;
+    std::merge( std::make_move_iterator(a + i0), std::make_move_iterator(a + i1)
+              , std::make_move_iterator(b + j0), std::make_move_iterator(b + j1)
+              , out + r.first, comp);
+  });
+}
+
+// One counting pass over the chunks, from in to out. Returns false,
+// moving nothing, if all elements have the same digit.
+template <class Exec, class InIt, class OutIt, class Digit>
+bool parallel_counting_pass( Exec& exec, InIt in, std::size_t n, OutIt out
+                           , std::vector<std::size_t>& count, std::size_t m
+                           , Digit digit)
+{
+  const std::size_t k = exec.size();
+  exec.run(k, [&](std::size_t t)
+  {
+    const auto r = chunk(n, k, t);
+    count_digits(in + r.first, r.second - r.first, &count[t * m], m, digit);
+  });
+
+  // The elements of digit d of chunk t go after those of smaller
+  // digits and those of digit d in earlier chunks.
+  std::size_t sum = 0;
+  for (std::size_t d = 0; d < m; ++d) {
+    std::size_t s = 0;
+    for (std::size_t t = 0; t < k; ++t)
+      s += count[t * m + d];
+    if (s == n)
+      return false;
+    for (std::size_t t = 0; t < k; ++t) {
+      const std::size_t c = count[t * m + d];
+      count[t * m + d] = sum;
+      sum += c;
+    }
+  }
+
+  exec.run(k, [&](std::size_t t)
+  {
+    const auto r = chunk(n, k, t);
+    std::size_t* pos = &count[t * m];
+    for (std::size_t i = r.first; i < r.second; ++i)
+      out[pos[digit(in[i])]++] = std::move(in[i]);
+  });
+  return true;
+}
+
+}
+
+template <class Exec, class RandomAccessIter, class Comp>
+void parallel_sort( Exec& exec, RandomAccessIter begin, RandomAccessIter end
+                  , typename std::iterator_traits<RandomAccessIter>::value_type* scratch
+                  , Comp comp)
+{
+  const std::size_t n = static_cast<std::size_t>(end - begin);
+  const std::size_t k = exec.size();
+  if (k < 2 || n < 2 * k * sort_threshold) {
+    rt::sort(begin, end, comp);
+    return;
+  }
+
+  exec.run(k, [&](std::size_t t)
+  {
+    const auto r = detail::chunk(n, k, t);
+    rt::sort(begin + r.first, begin + r.second, comp);
+  });
+
+  // Runs of width chunks, merged pairwise from one buffer to the other.
+  bool in_scratch = false;
+  for (std::size_t width = 1; width < k; width *= 2) {
+    for (std::size_t t = 0; t < k; t += 2 * width) {
+      // The first of chunk k is n.
+      const std::size_t a0 = detail::chunk(n, k, t).first;
+      const std::size_t b0 = detail::chunk(n, k, std::min(t + width, k)).first;
+      const std::size_t b1 = detail::chunk(n, k, std::min(t + 2 * width, k)).first;
+      if (in_scratch)
+        detail::parallel_merge( exec, scratch + a0, b0 - a0, scratch + b0
+                              , b1 - b0, begin + a0, exec.size(), comp);
+      else
+        detail::parallel_merge( exec, begin + a0, b0 - a0, begin + b0
+                              , b1 - b0, scratch + a0, exec.size(), comp);
+    }
+    in_scratch = !in_scratch;
+  }
+  if (in_scratch) {
+    exec.run(k, [&](std::size_t t)
+    {
+      const auto r = detail::chunk(n, k, t);
+      std::move(scratch + r.first, scratch + r.second, begin + r.first);
+    });
+  }
+}
+
+template <class Exec, class RandomAccessIter>
+void parallel_sort( Exec& exec, RandomAccessIter begin, RandomAccessIter end
+                  , typename std::iterator_traits<RandomAccessIter>::value_type* scratch)
+{
+  parallel_sort(exec, begin, end, scratch, std::less<>());
+}
+
+template < unsigned Bits = 8, class Exec, class RandomAccessIter
+         , class Key = identity_key>
+void parallel_radix_sort( Exec& exec, RandomAccessIter begin, RandomAccessIter end
+                        , typename std::iterator_traits<RandomAccessIter>::value_type* scratch
+                        , Key key = Key())
+{
+  static_assert(Bits >= 1 && Bits <= 16, "parallel_radix_sort: Incompatible digit size.");
+  using value_type = typename std::iterator_traits<RandomAccessIter>::value_type;
+  using key_type = typename std::decay<
+    decltype(key(std::declval<const value_type&>()))>::type;
+  using traits = radix_key<key_type>;
+  using unsigned_type = typename traits::type;
+
+  const std::size_t n = static_cast<std::size_t>(end - begin);
+  if (n < 2)
+    return;
+
+  const std::size_t m = std::size_t(1) << Bits;
+  std::vector<std::size_t> count(exec.size() * m);
+  bool in_scratch = false;
+  for (unsigned shift = 0; shift < std::numeric_limits<unsigned_type>::digits; shift += Bits) {
+    auto digit = [&key, shift](const value_type& v)
+    {
+      const unsigned_type u = traits::get(key(v));
+      return static_cast<std::size_t>((u >> shift) & ((1u << Bits) - 1));
+    };
+    const bool moved = in_scratch
+      ? detail::parallel_counting_pass(exec, scratch, n, begin, count, m, digit)
+      : detail::parallel_counting_pass(exec, begin, n, scratch, count, m, digit);
+    if (moved)
+      in_scratch = !in_scratch;
+  }
+  if (in_scratch)
+    std::move(scratch, scratch + n, begin);
+}
+
+template <class Exec, typename Iter>
+void
+parallel_dist_counting_sort(Exec& exec, Iter begin, std::size_t N
+  , typename std::iterator_traits<Iter>::value_type A
+  , typename std::iterator_traits<Iter>::value_type B)
+{
+  typedef typename std::iterator_traits<Iter>::value_type value_type;
+  const std::size_t count_size = B - A + 1;
+  std::vector<std::size_t> count(exec.size() * count_size);
+  auto digit = [A](const value_type& v)
+  { return static_cast<std::size_t>(v - A); };
+
+  std::vector<value_type> out(N, 0);
+  if (detail::parallel_counting_pass(exec, begin, N, std::begin(out), count, count_size, digit))
+    std::copy(std::begin(out), std::end(out), begin);
+}
+
+}
+
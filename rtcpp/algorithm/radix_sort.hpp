@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+
+#include "dist_counting_sort.hpp"
+
+/*
+  LSD radix sort on the counting pass of dist_counting_sort, for keys
+  of any width: one stable pass per digit of Bits bits, from the least
+  significant one. Passes where all keys have the same digit, e.g. the
+  high bits of timestamps, are skipped after counting.
+
+  Elements are moved between the range and a scratch buffer of at
+  least as many elements given by the caller, nothing is allocated.
+  The digit counters are on the stack, 8 << Bits bytes, which is
+  limited to 11 bits; with more bits the caller gives the counters
+  too. Key extracts the key of an element (integer or floating point);
+  signed and floating point keys are mapped to unsigned integers with
+  the same order, see radix_key. Floating point keys sort -0 before
+  +0 and NaNs by their bits, negative ones first.
+*/
+
+namespace rt
+{
+
+// Order preserving map of a key to an unsigned integer.
+template <class K, class = void>
+struct radix_key;
+
+template <class K>
+struct radix_key<K, typename std::enable_if<std::is_integral<K>::value>::type> {
+  using type = typename std::make_unsigned<K>::type;
+  static type get(K k) noexcept
+  {
+    // Flips the sign bit of signed keys.
+    const type sign = std::is_signed<K>::value
+                    ? type(1) << (std::numeric_limits<type>::digits - 1) : 0;
+    return static_cast<type>(k) ^ sign;
+  }
+};
+
+template <class K>
+struct radix_key<K, typename std::enable_if<std::is_floating_point<K>::value>::type> {
+  static_assert( std::numeric_limits<K>::is_iec559
+                 && (sizeof (K) == 4 || sizeof (K) == 8)
+               , "radix_key: Unsupported floating point type.");
+  using type = typename std::conditional< sizeof (K) == 4
+                                        , std::uint32_t, std::uint64_t>::type;
+  static type get(K k) noexcept
+  {
+    type u;
+    std::memcpy(&u, &k, sizeof u);
+    // Negative keys are ordered backwards.
+    const type sign = type(1) << (8 * sizeof (type) - 1);
+    return u & sign ? ~u : u | sign;
+  }
+};
+
+struct identity_key {
+  template <class T>
+  const T& operator()(const T& v) const noexcept { return v; }
+};
+
+// count points to 1 << Bits counters.
+template < unsigned Bits = 8, class RandomAccessIter, class Key = identity_key>
+void radix_sort( RandomAccessIter begin, RandomAccessIter end
+               , typename std::iterator_traits<RandomAccessIter>::value_type* scratch
+               , std::size_t* count, Key key = Key())
+{
+  static_assert(Bits >= 1 && Bits <= 16, "radix_sort: Incompatible digit size.");
+  using value_type = typename std::iterator_traits<RandomAccessIter>::value_type;
+  using key_type = typename std::decay<
+    decltype(key(std::declval<const value_type&>()))>::type;
+  using traits = radix_key<key_type>;
+  using unsigned_type = typename traits::type;
+
+  const std::size_t n = static_cast<std::size_t>(end - begin);
+  const std::size_t m = std::size_t(1) << Bits;
+  const unsigned key_bits = std::numeric_limits<unsigned_type>::digits;
+  // Where the elements are, in the range or in the scratch buffer.
+  bool in_scratch = false;
+  for (unsigned shift = 0; shift < key_bits; shift += Bits) {
+    auto digit = [&key, shift](const value_type& v)
+    {
+      const unsigned_type u = traits::get(key(v));
+      return static_cast<std::size_t>((u >> shift) & ((1u << Bits) - 1));
+    };
+    if (in_scratch)
+      detail::count_digits(scratch, n, count, m, digit);
+    else
+      detail::count_digits(begin, n, count, m, digit);
+    if (n == 0 || std::find(count, count + m, n) != count + m)
+      continue;
+    if (in_scratch)
+      detail::scatter_digits(scratch, n, begin, count, m, digit);
+    else
+      detail::scatter_digits(begin, n, scratch, count, m, digit);
+    in_scratch = !in_scratch;
+  }
+  if (in_scratch)
+    std::move(scratch, scratch + n, begin);
+}
+
+template < unsigned Bits = 8, class RandomAccessIter, class Key = identity_key>
+void radix_sort( RandomAccessIter begin, RandomAccessIter end
+               , typename std::iterator_traits<RandomAccessIter>::value_type* scratch
+               , Key key = Key())
+{
+  static_assert(Bits <= 11, "radix_sort: Give the counters for more than 11 bits.");
+  std::array<std::size_t, std::size_t(1) << Bits> count;
+  radix_sort<Bits>(begin, end, scratch, count.data(), key);
+}
+
+}
+
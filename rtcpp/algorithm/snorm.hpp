@@ -1,12 +1,19 @@
 #pragma once
 
+#include <cstddef>
 #include <iterator>
 
 #include "dot_product.hpp"
 
 namespace rt {
   template <std::size_t N, typename RandomAccessIter>
-  typename std::iterator_traits<RandomAccessIter>::value_type snorm(RandomAccessIter iter)
+  constexpr typename std::iterator_traits<RandomAccessIter>::value_type
+  snorm(RandomAccessIter iter)
   { return dot_product<N>(iter, iter); }
+
+  template <typename RandomAccessIter>
+  constexpr typename std::iterator_traits<RandomAccessIter>::value_type
+  snorm(RandomAccessIter iter, std::size_t n)
+  { return dot_product(iter, iter, n); }
 }
 
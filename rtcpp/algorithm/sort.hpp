@@ -0,0 +1,167 @@
+#pragma once
+
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+/*
+  Introsort: quicksort with a median of three pivot, switching to heap
+  sort when the recursion gets deeper than 2 log2(n), so the worst
+  case is O(n log n) comparisons. Ranges of at most sort_threshold
+  elements are left to a final insertion sort pass. Nothing is
+  allocated, the recursion goes into the smaller part only and is at
+  most log2(n) deep. Not stable.
+*/
+
+namespace rt
+{
+
+constexpr std::ptrdiff_t sort_threshold = 16;
+
+namespace detail
+{
+
+// Insertion sort shifting the elements instead of swapping them.
+template <class Iter, class Comp>
+void insertion_sort_shift(Iter begin, Iter end, Comp comp)
+{
+  if (begin == end)
+    return;
+
+  for (Iter i = std::next(begin); i != end; ++i) {
+    auto v = std::move(*i);
+    if (comp(v, *begin)) {
+      std::move_backward(begin, i, std::next(i));
+      *begin = std::move(v);
+      continue;
+    }
+    // *begin is not greater than v and stops the loop.
+    Iter j = i;
+    for (Iter k = std::prev(j); comp(v, *k); --k) {
+      *j = std::move(*k);
+      j = k;
+    }
+    *j = std::move(v);
+  }
+}
+
+template <class Iter, class Diff, class Comp>
+void sift_down(Iter begin, Diff i, Diff n, Comp comp)
+{
+  auto v = std::move(begin[i]);
+  for (;;) {
+    Diff c = 2 * i + 1;
+    if (c >= n)
+      break;
+    if (c + 1 < n && comp(begin[c], begin[c + 1]))
+      ++c;
+    if (!comp(v, begin[c]))
+      break;
+    begin[i] = std::move(begin[c]);
+    i = c;
+  }
+  begin[i] = std::move(v);
+}
+
+template <class Iter, class Comp>
+void heap_sort(Iter begin, Iter end, Comp comp)
+{
+  auto n = end - begin;
+  for (auto i = n / 2; i > 0; --i)
+    sift_down(begin, i - 1, n, comp);
+  while (n > 1) {
+    --n;
+    std::iter_swap(begin, begin + n);
+    sift_down(begin, decltype(n)(0), n, comp);
+  }
+}
+
+// Swaps the median of *a, *b and *c into *r.
+template <class Iter, class Comp>
+void move_median_to(Iter r, Iter a, Iter b, Iter c, Comp comp)
+{
+  if (comp(*a, *b)) {
+    if (comp(*b, *c))
+      std::iter_swap(r, b);
+    else if (comp(*a, *c))
+      std::iter_swap(r, c);
+    else
+      std::iter_swap(r, a);
+  } else if (comp(*a, *c)) {
+    std::iter_swap(r, a);
+  } else if (comp(*b, *c)) {
+    std::iter_swap(r, c);
+  } else {
+    std::iter_swap(r, b);
+  }
+}
+
+// Partitions [begin + 1, end) around the pivot in *begin. The other
+// two candidates of the median bound both scans, there is no index
+// check in the inner loops.
+template <class Iter, class Comp>
+Iter partition_pivot(Iter begin, Iter end, Comp comp)
+{
+  const Iter mid = begin + (end - begin) / 2;
+  move_median_to(begin, begin + 1, mid, end - 1, comp);
+  Iter lo = begin + 1;
+  Iter hi = end;
+  for (;;) {
+    while (comp(*lo, *begin))
+      ++lo;
+    --hi;
+    while (comp(*begin, *hi))
+      --hi;
+    if (!(lo < hi))
+      return lo;
+    std::iter_swap(lo, hi);
+    ++lo;
+  }
+}
+
+template <class Iter, class Diff, class Comp>
+void introsort_loop(Iter begin, Iter end, Diff depth, Comp comp)
+{
+  while (end - begin > sort_threshold) {
+    if (depth == 0) {
+      heap_sort(begin, end, comp);
+      return;
+    }
+    --depth;
+    const Iter cut = partition_pivot(begin, end, comp);
+    if (cut - begin < end - cut) {
+      introsort_loop(begin, cut, depth, comp);
+      begin = cut;
+    } else {
+      introsort_loop(cut, end, depth, comp);
+      end = cut;
+    }
+  }
+}
+
+}
+
+template <class RandomAccessIter, class Comp>
+void sort(RandomAccessIter begin, RandomAccessIter end, Comp comp)
+{
+  auto n = end - begin;
+  if (n < 2)
+    return;
+
+  decltype(n) depth = 0;
+  for (auto m = n; m > 1; m /= 2)
+    depth += 2;
+  detail::introsort_loop(begin, end, depth, comp);
+  // Every element is at most sort_threshold places away.
+  detail::insertion_sort_shift(begin, end, comp);
+}
+
+template <class RandomAccessIter>
+void sort(RandomAccessIter begin, RandomAccessIter end)
+{
+  rt::sort(begin, end, std::less<>());
+}
+
+}
+
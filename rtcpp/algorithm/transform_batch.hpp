@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+
+#include <rtcpp/container/matrix.hpp>
+
+/*
+  Applies one matrix to an array of vectors: out[i] = a * in[i], or
+  for a 4x4 matrix and 3-vectors the affine transform given by its
+  first three rows, out[i] = a * (in[i], 1) without the fourth
+  component.
+
+  The vectors are processed in blocks of batch_size: each block is
+  copied into one array per component (structure of arrays), every
+  output component is computed over the whole block by loops the
+  compiler turns into vector code as wide as the target allows, 4, 8
+  or 16 float lanes with SSE, AVX or AVX-512, and the results are
+  copied back. The blocks live on the stack, nothing is allocated; in
+  and out may be the same array.
+*/
+
+namespace rt {
+
+const std::size_t batch_size = 64;
+
+namespace detail {
+
+// K input components, the K-th taken as 1 when Affine.
+template <bool Affine, typename T, std::size_t M, std::size_t K
+         , std::size_t In, std::size_t Out>
+void transform_batch( const matrix<T, M, K>& a, const matrix<T, In, 1>* in
+                    , std::size_t n, matrix<T, Out, 1>* out)
+{
+  // Zero so that the lanes beyond the last block are defined.
+  T x[In][batch_size] = {};
+  T y[Out][batch_size];
+  for (std::size_t s = 0; s < n; s += batch_size) {
+    const std::size_t m = std::min(batch_size, n - s);
+    for (std::size_t i = 0; i < m; ++i)
+      for (std::size_t k = 0; k < In; ++k)
+        x[k][i] = in[s + i][k];
+
+    for (std::size_t r = 0; r < Out; ++r) {
+      const T c = Affine ? a(r, K - 1) : T(0);
+      for (std::size_t i = 0; i < batch_size; ++i)
+        y[r][i] = c;
+      for (std::size_t k = 0; k < In; ++k) {
+        const T f = a(r, k);
+        for (std::size_t i = 0; i < batch_size; ++i)
+          y[r][i] += f * x[k][i];
+      }
+    }
+
+    for (std::size_t i = 0; i < m; ++i)
+      for (std::size_t r = 0; r < Out; ++r)
+        out[s + i][r] = y[r][i];
+  }
+}
+
+}
+
+template <typename T, std::size_t M, std::size_t K>
+void transform_batch( const matrix<T, M, K>& a, const matrix<T, K, 1>* in
+                    , std::size_t n, matrix<T, M, 1>* out)
+{ detail::transform_batch<false>(a, in, n, out); }
+
+template <typename T>
+void transform_batch( const matrix<T, 4, 4>& a, const matrix<T, 3, 1>* in
+                    , std::size_t n, matrix<T, 3, 1>* out)
+{ detail::transform_batch<true>(a, in, n, out); }
+
+// Ranges of vectors held contiguously, e.g. by std::vector or
+// std::array.
+template <typename T, std::size_t M, std::size_t K, typename InRange, typename OutRange>
+void transform_batch(const matrix<T, M, K>& a, const InRange& in, OutRange& out)
+{ transform_batch(a, in.data(), in.size(), out.data()); }
+
+}
+
@@ -0,0 +1,673 @@
+#pragma once
+
+#include <memory>
+#include <limits>
+#include <cstdint>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <initializer_list>
+
+#include <rtcpp/memory/allocator_traits.hpp>
+#include <rtcpp/utility/exceptions.hpp>
+
+/*
+  A std::set implemented as a B+ tree. Every node has the same size,
+  Bytes, and holds as many keys as fit in it, so that a lookup touches
+  one or two cache lines per level instead of one per key compared.
+  Since all nodes have the same size it can be served by
+  node_allocator from a fixed buffer, like rt::set.
+
+  Leaves hold the keys and are linked in a ring through a head node,
+  the iterators walk this ring. Inner nodes hold separators and
+  children. There are no parent links, insert and erase record the
+  path from the root in a fixed size array.
+
+  Keys are moved around with plain assignments and are never
+  destroyed, so they must be trivially copyable. Insertion allocates
+  every node a split is going to need before touching the tree, so if
+  the allocator throws the set is left unchanged.
+*/
+
+namespace rt {
+
+namespace btree {
+
+template <class T, class Ptr, std::size_t Bytes>
+struct node {
+  using value_type = T;
+  using self_pointer = typename std::pointer_traits<Ptr>::template
+    rebind<node<T, Ptr, Bytes>>;
+  template<class U, class K>
+  struct rebind { using other = node<U, K, Bytes>; };
+  private:
+  static constexpr std::size_t link_size = sizeof (self_pointer);
+  static constexpr std::size_t align =
+    alignof (T) > alignof (self_pointer) ? alignof (T)
+                                         : alignof (self_pointer);
+  static constexpr std::size_t data_size =
+    Bytes - (align > sizeof (std::uint32_t) ? align
+                                            : sizeof (std::uint32_t));
+  static constexpr std::size_t round(std::size_t n) noexcept
+  { return (n + alignof (T) - 1) / alignof (T) * alignof (T); }
+  public:
+  // Leaves: previous and next leaf followed by the keys.
+  static constexpr std::size_t leaf_key_offset = round(2 * link_size);
+  static constexpr std::size_t leaf_capacity =
+    (data_size - leaf_key_offset) / sizeof (T);
+  // Inner nodes: inner_capacity + 1 children followed by the keys.
+  static constexpr std::size_t inner_capacity =
+    (data_size - link_size - alignof (T)) / (link_size + sizeof (T));
+  static constexpr std::size_t inner_key_offset =
+    round((inner_capacity + 1) * link_size);
+  private:
+  alignas(align) unsigned char data[data_size];
+  public:
+  std::uint16_t n;
+  std::uint16_t leaf;
+  self_pointer* link() noexcept
+  { return reinterpret_cast<self_pointer*>(data); }
+  T* key() noexcept
+  {
+    const std::size_t off = leaf ? leaf_key_offset : inner_key_offset;
+    return reinterpret_cast<T*>(data + off);
+  }
+  const T* key() const noexcept
+  { return const_cast<node*>(this)->key(); }
+  std::size_t capacity() const noexcept
+  { return leaf ? leaf_capacity : inner_capacity; }
+  // Smallest number of keys a node other than the root can have.
+  std::size_t min_size() const noexcept { return capacity() / 2; }
+};
+
+}
+
+template <typename T, typename Ptr>
+class btree_iterator :
+  public std::iterator<std::bidirectional_iterator_tag, const T> {
+  public:
+  Ptr m_p;
+  std::size_t m_i;
+  btree_iterator() noexcept : m_p(0), m_i(0) {}
+  btree_iterator(Ptr p, std::size_t i) noexcept : m_p(p), m_i(i) {}
+
+  btree_iterator& operator++() noexcept
+  {
+    if (++m_i == m_p->n) {
+      m_p = m_p->link()[1];
+      m_i = 0;
+    }
+    return *this;
+  }
+
+  btree_iterator operator++(int) noexcept
+  {
+    btree_iterator tmp(*this);
+    operator++();
+    return tmp;
+  }
+
+  btree_iterator& operator--() noexcept
+  {
+    if (m_i == 0) {
+      m_p = m_p->link()[0];
+      m_i = m_p->n;
+    }
+    --m_i;
+    return *this;
+  }
+
+  btree_iterator operator--(int) noexcept
+  {
+    btree_iterator tmp(*this);
+    operator--();
+    return tmp;
+  }
+
+  const T& operator*() const noexcept {return m_p->key()[m_i];}
+  const T* operator->() const noexcept {return m_p->key() + m_i;}
+};
+
+template <typename T, typename Ptr>
+bool operator==( const btree_iterator<T, Ptr>& rhs
+               , const btree_iterator<T, Ptr>& lhs) noexcept
+{ return lhs.m_p == rhs.m_p && lhs.m_i == rhs.m_i; }
+
+template <typename T, typename Ptr>
+bool operator!=( const btree_iterator<T, Ptr>& rhs
+               , const btree_iterator<T, Ptr>& lhs) noexcept
+{ return !(lhs == rhs); }
+
+template < typename T
+         , typename Compare = std::less<T>
+         , typename Allocator = std::allocator<T>
+         , std::size_t Bytes = 128>
+class btree_set {
+  static_assert( std::is_trivially_copyable<T>::value
+               , "btree_set: The key must be trivially copyable.");
+  public:
+  using key_type = T;
+  using value_type = T;
+  using size_type = std::size_t;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using reference = value_type&;
+  using const_reference = const value_type&;
+  using pointer = typename rt::allocator_traits<Allocator>::pointer;
+  using const_pointer = typename
+    rt::allocator_traits<Allocator>::const_pointer;
+  using difference_type = std::ptrdiff_t;
+  private:
+  using alloc_traits_type = rt::allocator_traits<Allocator>;
+  using void_pointer = typename alloc_traits_type::void_pointer;
+  public:
+  using node_type = btree::node<value_type, void_pointer, Bytes>;
+  private:
+  using inner_allocator_type =
+    typename alloc_traits_type::template rebind_alloc<node_type>;
+  using inner_alloc_traits_type =
+    rt::allocator_traits<inner_allocator_type>;
+  using node_pointer = typename inner_alloc_traits_type::pointer;
+  static_assert( sizeof (node_type) == Bytes
+               , "btree_set: Bytes must be a multiple of the alignment.");
+  static_assert( node_type::leaf_capacity >= 3
+               && node_type::inner_capacity >= 3
+               , "btree_set: Node too small.");
+  static_assert( node_type::leaf_capacity
+                   <= std::numeric_limits<std::uint16_t>::max()
+               , "btree_set: Node too big.");
+  // Every level has at least two children per node.
+  static constexpr std::size_t max_height = 64;
+  struct path {
+    node_pointer node[max_height];
+    std::size_t idx[max_height];
+  };
+  public:
+  using iterator = btree_iterator<T, node_pointer>;
+  using const_iterator = iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  private:
+  mutable inner_allocator_type m_inner_alloc;
+  node_pointer m_head;
+  node_pointer m_root;
+  std::size_t m_height; // Number of inner levels.
+  size_type m_size;
+  Compare m_comp;
+  node_pointer get_node() const;
+  void release_node(node_pointer p) const;
+  void release_subtree(node_pointer p, std::size_t h) const noexcept;
+  void init_head() noexcept;
+  node_pointer descend(const T& key, path& s) const noexcept;
+  std::size_t leaf_index(node_pointer p, const T& key) const noexcept
+  { return std::lower_bound(p->key(), p->key() + p->n, key, m_comp) - p->key(); }
+  std::size_t inner_index(node_pointer p, const T& key) const noexcept
+  { return std::upper_bound(p->key(), p->key() + p->n, key, m_comp) - p->key(); }
+  void rebalance(node_pointer p, std::size_t l, const path& s) noexcept;
+  public:
+  btree_set(const Compare& comp, const Allocator& alloc = Allocator());
+  explicit btree_set(const Allocator& alloc = Allocator())
+  : btree_set(Compare(), alloc) {}
+  template <typename InputIt>
+  btree_set( InputIt begin, InputIt end, const Compare& comp
+           , const Allocator& alloc = Allocator())
+  : btree_set(comp, alloc) { insert(begin, end); }
+  template <typename InputIt>
+  btree_set(InputIt begin, InputIt end, const Allocator& alloc = Allocator())
+  : btree_set(begin, end, Compare(), alloc) {}
+  btree_set( std::initializer_list<T> init, const Compare& comp
+           , const Allocator& alloc = Allocator())
+  : btree_set(std::begin(init), std::end(init), comp, alloc) {}
+  btree_set(std::initializer_list<T> init, const Allocator& alloc = Allocator())
+  : btree_set(init, Compare(), alloc) {}
+  btree_set(const btree_set& rhs);
+  btree_set(btree_set&& rhs);
+  btree_set& operator=(const btree_set& rhs);
+  btree_set& operator=(std::initializer_list<T> init);
+  ~btree_set() noexcept;
+  void clear() noexcept;
+  std::pair<iterator, bool> insert(const value_type& key);
+  template<typename InputIt>
+  void insert(InputIt begin, InputIt end);
+  template <typename K>
+  size_type erase(const K& key) noexcept;
+  template<typename K>
+  iterator find(const K& key) const noexcept;
+  template<typename K>
+  size_type count(const K& key) const noexcept
+  { return find(key) == end() ? 0 : 1; }
+  const_iterator begin() const noexcept
+  { return const_iterator(m_head->link()[1], 0); }
+  const_iterator end() const noexcept {return const_iterator(m_head, 0);}
+  const_reverse_iterator rbegin() const noexcept
+  { return const_reverse_iterator(end()); }
+  const_reverse_iterator rend() const noexcept
+  { return const_reverse_iterator(begin()); }
+  key_compare key_comp() const noexcept {return m_comp;}
+  value_compare value_comp() const noexcept {return m_comp;}
+  size_type size() const noexcept {return m_size;}
+  bool empty() const noexcept {return m_size == 0;}
+  size_type max_size() const noexcept
+  { return std::numeric_limits<size_type>::max(); }
+  Allocator get_allocator() const noexcept {return m_inner_alloc;}
+  void swap(btree_set& other) noexcept;
+};
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+btree_set<T, Compare, Allocator, Bytes>::btree_set(const Compare& comp, const Allocator& alloc)
+: m_inner_alloc(alloc_traits_type::select_on_container_copy_construction(alloc))
+, m_head(get_node())
+, m_root(0)
+, m_height(0)
+, m_size(0)
+, m_comp(comp)
+{
+  init_head();
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+btree_set<T, Compare, Allocator, Bytes>::btree_set(const btree_set& rhs)
+: m_inner_alloc(inner_alloc_traits_type::select_on_container_copy_construction(rhs.m_inner_alloc))
+, m_head(get_node())
+, m_root(0)
+, m_height(0)
+, m_size(0)
+, m_comp(rhs.m_comp)
+{
+  init_head();
+  insert(std::begin(rhs), std::end(rhs));
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+btree_set<T, Compare, Allocator, Bytes>::btree_set(btree_set&& rhs)
+: m_inner_alloc(rhs.m_inner_alloc)
+, m_head(get_node())
+, m_root(0)
+, m_height(0)
+, m_size(0)
+, m_comp(std::move(rhs.m_comp))
+{
+  init_head();
+  swap(rhs);
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+btree_set<T, Compare, Allocator, Bytes>&
+btree_set<T, Compare, Allocator, Bytes>::operator=(const btree_set& rhs)
+{
+  if (this == &rhs)
+    return *this;
+
+  clear();
+  insert(std::begin(rhs), std::end(rhs));
+  return *this;
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+btree_set<T, Compare, Allocator, Bytes>&
+btree_set<T, Compare, Allocator, Bytes>::operator=(std::initializer_list<T> init)
+{
+  clear();
+  insert(std::begin(init), std::end(init));
+  return *this;
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+btree_set<T, Compare, Allocator, Bytes>::~btree_set() noexcept
+{
+  clear();
+  release_node(m_head);
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+void btree_set<T, Compare, Allocator, Bytes>::init_head() noexcept
+{
+  m_head->n = 0;
+  m_head->leaf = 1;
+  m_head->link()[0] = m_head;
+  m_head->link()[1] = m_head;
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+typename btree_set<T, Compare, Allocator, Bytes>::node_pointer
+btree_set<T, Compare, Allocator, Bytes>::get_node() const
+{ return inner_alloc_traits_type::allocate_node(m_inner_alloc); }
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+void btree_set<T, Compare, Allocator, Bytes>::release_node(node_pointer p) const
+{ inner_alloc_traits_type::deallocate_node(m_inner_alloc, p); }
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+void btree_set<T, Compare, Allocator, Bytes>::release_subtree(
+  node_pointer p, std::size_t h) const noexcept
+{
+  if (h != 0)
+    for (std::size_t i = 0; i <= p->n; ++i)
+      release_subtree(p->link()[i], h - 1);
+
+  release_node(p);
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+void btree_set<T, Compare, Allocator, Bytes>::clear() noexcept
+{
+  if (m_root)
+    release_subtree(m_root, m_height);
+
+  m_root = 0;
+  m_height = 0;
+  m_size = 0;
+  init_head();
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+void btree_set<T, Compare, Allocator, Bytes>::swap(btree_set& other) noexcept
+{
+  std::swap(m_inner_alloc, other.m_inner_alloc);
+  std::swap(m_head, other.m_head);
+  std::swap(m_root, other.m_root);
+  std::swap(m_height, other.m_height);
+  std::swap(m_size, other.m_size);
+  std::swap(m_comp, other.m_comp);
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+typename btree_set<T, Compare, Allocator, Bytes>::node_pointer
+btree_set<T, Compare, Allocator, Bytes>::descend(const T& key, path& s) const noexcept
+{
+  // Returns the leaf where key belongs, s.node[l] is the inner node at
+  // level l and s.idx[l] the child taken.
+  node_pointer p = m_root;
+  for (std::size_t l = 0; l < m_height; ++l) {
+    const std::size_t i = inner_index(p, key);
+    s.node[l] = p;
+    s.idx[l] = i;
+    p = p->link()[i];
+  }
+  return p;
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+template <typename K>
+typename btree_set<T, Compare, Allocator, Bytes>::iterator
+btree_set<T, Compare, Allocator, Bytes>::find(const K& key) const noexcept
+{
+  if (!m_root)
+    return end();
+
+  node_pointer p = m_root;
+  for (std::size_t l = 0; l < m_height; ++l)
+    p = p->link()[inner_index(p, key)];
+
+  const std::size_t i = leaf_index(p, key);
+  if (i == p->n || m_comp(key, p->key()[i]))
+    return end();
+
+  return iterator(p, i);
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+std::pair<typename btree_set<T, Compare, Allocator, Bytes>::iterator, bool>
+btree_set<T, Compare, Allocator, Bytes>::insert(const value_type& key)
+{
+  if (!m_root) {
+    node_pointer p = get_node();
+    p->n = 1;
+    p->leaf = 1;
+    p->key()[0] = key;
+    p->link()[0] = m_head;
+    p->link()[1] = m_head;
+    m_head->link()[0] = p;
+    m_head->link()[1] = p;
+    m_root = p;
+    m_size = 1;
+    return std::make_pair(iterator(p, 0), true);
+  }
+
+  path s;
+  node_pointer p = descend(key, s);
+  std::size_t i = leaf_index(p, key);
+  if (i != p->n && !m_comp(key, p->key()[i]))
+    return std::make_pair(iterator(p, i), false);
+
+  ++m_size;
+  if (p->n < node_type::leaf_capacity) {
+    std::copy_backward(p->key() + i, p->key() + p->n, p->key() + p->n + 1);
+    p->key()[i] = key;
+    ++p->n;
+    return std::make_pair(iterator(p, i), true);
+  }
+
+  // Allocates all nodes needed by the splits up to the root.
+  std::size_t need = 1;
+  std::size_t l = m_height;
+  while (l != 0 && s.node[l - 1]->n == node_type::inner_capacity) {
+    ++need;
+    --l;
+  }
+  if (l == 0)
+    ++need;
+
+  node_pointer spare[max_height + 1];
+  std::size_t k = 0;
+  RTCPP_TRY {
+    for (; k < need; ++k)
+      spare[k] = get_node();
+  } RTCPP_CATCH_ALL {
+    while (k != 0)
+      release_node(spare[--k]);
+    --m_size;
+    RTCPP_RETHROW
+  }
+
+  // Splits the leaf, the first m keys stay.
+  const std::size_t cap = node_type::leaf_capacity;
+  const std::size_t m = (cap + 1) / 2;
+  node_pointer r = spare[--k];
+  r->leaf = 1;
+  r->n = static_cast<std::uint16_t>(cap + 1 - m);
+  T* pk = p->key();
+  T* rk = r->key();
+  for (std::size_t j = m; j <= cap; ++j)
+    rk[j - m] = j < i ? pk[j] : j == i ? key : pk[j - 1];
+  if (i < m) {
+    std::copy_backward(pk + i, pk + m - 1, pk + m);
+    pk[i] = key;
+  }
+  p->n = static_cast<std::uint16_t>(m);
+  const iterator pos = i < m ? iterator(p, i) : iterator(r, i - m);
+
+  r->link()[0] = p;
+  r->link()[1] = p->link()[1];
+  node_pointer next = p->link()[1];
+  next->link()[0] = r;
+  p->link()[1] = r;
+
+  // Inserts the separator and the new child in the parents.
+  T sep = rk[0];
+  for (l = m_height; l != 0; --l) {
+    node_pointer q = s.node[l - 1];
+    const std::size_t ci = s.idx[l - 1];
+    T* qk = q->key();
+    auto qc = q->link();
+    if (q->n < node_type::inner_capacity) {
+      std::copy_backward(qk + ci, qk + q->n, qk + q->n + 1);
+      std::copy_backward(qc + ci + 1, qc + q->n + 1, qc + q->n + 2);
+      qk[ci] = sep;
+      qc[ci + 1] = r;
+      ++q->n;
+      return std::make_pair(pos, true);
+    }
+
+    // The node has icap + 1 keys counting sep, the first im stay,
+    // key im goes up and the others move to the new node.
+    const std::size_t icap = node_type::inner_capacity;
+    const std::size_t im = (icap + 1) / 2;
+    node_pointer u = spare[--k];
+    u->leaf = 0;
+    u->n = static_cast<std::uint16_t>(icap - im);
+    T* uk = u->key();
+    auto uc = u->link();
+    for (std::size_t j = im + 1; j <= icap; ++j)
+      uk[j - im - 1] = j < ci ? qk[j] : j == ci ? sep : qk[j - 1];
+    for (std::size_t j = im + 1; j <= icap + 1; ++j)
+      uc[j - im - 1] = j <= ci ? static_cast<node_pointer>(qc[j])
+                     : j == ci + 1 ? r : static_cast<node_pointer>(qc[j - 1]);
+    const T up = im < ci ? qk[im] : im == ci ? sep : qk[im - 1];
+    if (ci < im) {
+      std::copy_backward(qk + ci, qk + im - 1, qk + im);
+      std::copy_backward(qc + ci + 1, qc + im, qc + im + 1);
+      qk[ci] = sep;
+      qc[ci + 1] = r;
+    }
+    q->n = static_cast<std::uint16_t>(im);
+    sep = up;
+    r = u;
+  }
+
+  // The root was split.
+  node_pointer root = spare[--k];
+  root->leaf = 0;
+  root->n = 1;
+  root->key()[0] = sep;
+  root->link()[0] = m_root;
+  root->link()[1] = r;
+  m_root = root;
+  ++m_height;
+  return std::make_pair(pos, true);
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+template <typename InputIt>
+void btree_set<T, Compare, Allocator, Bytes>::insert(InputIt begin, InputIt end)
+{
+  for (InputIt iter = begin; iter != end; ++iter)
+    insert(*iter);
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+template <typename K>
+typename btree_set<T, Compare, Allocator, Bytes>::size_type
+btree_set<T, Compare, Allocator, Bytes>::erase(const K& key) noexcept
+{
+  if (!m_root)
+    return 0;
+
+  path s;
+  node_pointer p = descend(key, s);
+  const std::size_t i = leaf_index(p, key);
+  if (i == p->n || m_comp(key, p->key()[i]))
+    return 0;
+
+  std::copy(p->key() + i + 1, p->key() + p->n, p->key() + i);
+  --p->n;
+  --m_size;
+  rebalance(p, m_height, s);
+  return 1;
+}
+
+template <typename T, typename Compare, typename Allocator, std::size_t Bytes>
+void btree_set<T, Compare, Allocator, Bytes>::rebalance(
+  node_pointer p, std::size_t l, const path& s) noexcept
+{
+  // p is at level l and may have too few keys. Separators of erased
+  // keys are left in the inner nodes, they still split the ranges
+  // correctly.
+  for (; l != 0 && p->n < p->min_size(); --l) {
+    node_pointer q = s.node[l - 1];
+    const std::size_t ci = s.idx[l - 1];
+    T* qk = q->key();
+    auto qc = q->link();
+    node_pointer left = ci != 0 ? static_cast<node_pointer>(qc[ci - 1]) : 0;
+    node_pointer right = ci != q->n ? static_cast<node_pointer>(qc[ci + 1]) : 0;
+    T* pk = p->key();
+    auto pc = p->link();
+
+    if (left && left->n > left->min_size()) { // Borrows from the left.
+      std::copy_backward(pk, pk + p->n, pk + p->n + 1);
+      if (p->leaf) {
+        pk[0] = left->key()[left->n - 1];
+        qk[ci - 1] = pk[0];
+      } else {
+        std::copy_backward(pc, pc + p->n + 1, pc + p->n + 2);
+        pk[0] = qk[ci - 1];
+        pc[0] = static_cast<node_pointer>(left->link()[left->n]);
+        qk[ci - 1] = left->key()[left->n - 1];
+      }
+      --left->n;
+      ++p->n;
+      return;
+    }
+
+    if (right && right->n > right->min_size()) { // Borrows from the right.
+      T* rk = right->key();
+      auto rc = right->link();
+      if (p->leaf) {
+        pk[p->n] = rk[0];
+        std::copy(rk + 1, rk + right->n, rk);
+        qk[ci] = rk[0];
+      } else {
+        pk[p->n] = qk[ci];
+        pc[p->n + 1] = static_cast<node_pointer>(rc[0]);
+        qk[ci] = rk[0];
+        std::copy(rk + 1, rk + right->n, rk);
+        std::copy(rc + 1, rc + right->n + 1, rc);
+      }
+      --right->n;
+      ++p->n;
+      return;
+    }
+
+    // Merges with a sibling, b is released.
+    const std::size_t si = left ? ci - 1 : ci;
+    node_pointer a = left ? left : p;
+    node_pointer b = left ? p : right;
+    T* ak = a->key();
+    auto ac = a->link();
+    if (a->leaf) {
+      std::copy(b->key(), b->key() + b->n, ak + a->n);
+      a->n = static_cast<std::uint16_t>(a->n + b->n);
+      node_pointer next = b->link()[1];
+      ac[1] = next;
+      next->link()[0] = a;
+    } else {
+      ak[a->n] = qk[si];
+      std::copy(b->key(), b->key() + b->n, ak + a->n + 1);
+      std::copy(b->link(), b->link() + b->n + 1, ac + a->n + 1);
+      a->n = static_cast<std::uint16_t>(a->n + b->n + 1);
+    }
+    release_node(b);
+    std::copy(qk + si + 1, qk + q->n, qk + si);
+    std::copy(qc + si + 2, qc + q->n + 1, qc + si + 1);
+    --q->n;
+    p = q;
+  }
+
+  if (m_height != 0 && m_root->n == 0) {
+    node_pointer old = m_root;
+    m_root = m_root->link()[0];
+    --m_height;
+    release_node(old);
+  } else if (m_height == 0 && m_root->n == 0) {
+    release_node(m_root);
+    m_root = 0;
+    init_head();
+  }
+}
+
+template<typename Key, typename Compare, typename Alloc, std::size_t B>
+bool operator==( const btree_set<Key, Compare, Alloc, B>& lhs
+               , const btree_set<Key, Compare, Alloc, B>& rhs) noexcept
+{
+  const bool b1 = lhs.size() == rhs.size();
+  return b1 && std::equal(std::begin(lhs), std::end(lhs), std::begin(rhs));
+}
+
+template<typename Key, typename Compare, typename Alloc, std::size_t B>
+bool operator!=( const btree_set<Key, Compare, Alloc, B>& lhs
+               , const btree_set<Key, Compare, Alloc, B>& rhs) noexcept
+{ return !(lhs == rhs); }
+
+}
+
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <utility>
+#include <iterator>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <initializer_list>
+
+#include <rtcpp/container/matrix.hpp>
+#include <rtcpp/utility/exceptions.hpp>
+
+/*
+  A row major matrix whose size is given at run time, held in a
+  std::vector with the given allocator, e.g. an arena allocator. It
+  is a matrix_expr with dynamic_size rows and cols and may be mixed
+  with matrix in expressions, a matrix is built from a dmatrix
+  expression of the right size.
+
+  Products of two dmatrix are evaluated by gemm, which multiplies by
+  blocks that fit in the caches: KC x NR slivers of the right matrix
+  and MR x KC slivers of the left one are copied contiguously and
+  multiplied MR x NR elements at a time in registers, with simd_row
+  (utility/simd.hpp) for float and double. gemm(exec, a, b, c) shares
+  the rows of c among the tasks of an executor, spawn_executor,
+  thread_pool or any type with the same size() and run(n, f) members.
+  The packing buffers are the only allocation besides the result.
+*/
+
+namespace rt {
+
+template <typename T, typename Allocator>
+class dmatrix : public matrix_expr<dmatrix<T, Allocator> > {
+  private:
+  using data_type = std::vector<T, Allocator>;
+  public:
+  static constexpr std::size_t rows = dynamic_size;
+  static constexpr std::size_t cols = dynamic_size;
+  using allocator_type = Allocator;
+  using value_type = typename data_type::value_type;
+  using size_type = typename data_type::size_type;
+  using iterator = typename data_type::iterator;
+  using const_iterator = typename data_type::const_iterator;
+  using reference = typename data_type::reference;
+  using const_reference = typename data_type::const_reference;
+  private:
+  size_type m_rows;
+  size_type m_cols;
+  data_type m_data;
+  public:
+  explicit dmatrix(const Allocator& alloc = Allocator())
+  : m_rows(0), m_cols(0), m_data(alloc) {}
+  dmatrix( size_type r, size_type c, const T& val = T()
+         , const Allocator& alloc = Allocator())
+  : m_rows(r), m_cols(c), m_data(r * c, val, alloc) {}
+  dmatrix( size_type r, size_type c, std::initializer_list<T> init
+         , const Allocator& alloc = Allocator())
+  : m_rows(r), m_cols(c), m_data(r * c, T(), alloc)
+  {
+    if (init.size() > m_data.size())
+      throw_exception(std::runtime_error("dmatrix: Too many elements."));
+    std::copy(std::begin(init), std::end(init), begin());
+  }
+  template <typename E>
+  dmatrix(const matrix_expr<E>& mat, const Allocator& alloc = Allocator())
+  : m_rows(mat.n_rows()), m_cols(mat.n_cols()), m_data(m_rows * m_cols, T(), alloc)
+  { detail::matrix_eval<E>::run(static_cast<const E&>(mat), m_data.data()); }
+  // Evaluated before it is assigned, the expression may contain *this.
+  template <typename E>
+  dmatrix& operator=(const matrix_expr<E>& mat)
+  {
+    dmatrix tmp(mat, m_data.get_allocator());
+    swap(tmp);
+    return *this;
+  }
+  allocator_type get_allocator() const {return m_data.get_allocator();}
+  size_type n_rows() const noexcept {return m_rows;}
+  size_type n_cols() const noexcept {return m_cols;}
+  size_type size() const noexcept {return m_data.size();}
+  reference operator[](size_type i) {return m_data[i];}
+  const_reference operator[](size_type i) const {return m_data[i];}
+  T* data() noexcept {return m_data.data();}
+  const T* data() const noexcept {return m_data.data();}
+  value_type operator()(size_type i, size_type j) const
+  {return m_data[row_major_idx(i, j, m_cols)];}
+  reference operator()(size_type i, size_type j)
+  {return m_data[row_major_idx(i, j, m_cols)];}
+  iterator begin() {return m_data.begin();}
+  iterator end() {return m_data.end();}
+  const_iterator begin() const {return m_data.begin();}
+  const_iterator end() const {return m_data.end();}
+  const_iterator cbegin() const {return m_data.begin();}
+  const_iterator cend() const {return m_data.end();}
+  iterator row_begin(size_type i) {return begin() + row_major_idx(i, 0, m_cols);}
+  iterator row_end(size_type i) {return row_begin(i) + m_cols;}
+  const_iterator row_cbegin(size_type i) const
+  {return cbegin() + row_major_idx(i, 0, m_cols);}
+  const_iterator row_cend(size_type i) const {return row_cbegin(i) + m_cols;}
+  // The elements are value initialized when the size changes.
+  void resize(size_type r, size_type c)
+  {
+    if (r * c != m_data.size())
+      data_type(r * c, T(), m_data.get_allocator()).swap(m_data);
+    m_rows = r;
+    m_cols = c;
+  }
+  void fill(const T& val) { std::fill(begin(), end(), val); }
+  void swap(dmatrix& other) noexcept
+  {
+    std::swap(m_rows, other.m_rows);
+    std::swap(m_cols, other.m_cols);
+    m_data.swap(other.m_data);
+  }
+  bool operator==(const dmatrix& rhs) const
+  { return m_rows == rhs.m_rows && m_cols == rhs.m_cols && m_data == rhs.m_data; }
+  bool operator!=(const dmatrix& rhs) const
+  { return !(*this == rhs);}
+};
+
+template <typename T, typename Allocator>
+struct matrix_traits<dmatrix<T, Allocator> > {
+  using container_type = std::vector<T, Allocator>;
+  using value_type = typename container_type::value_type;
+  using reference = typename container_type::reference;
+  using const_reference = typename container_type::const_reference;
+  using size_type = typename container_type::size_type;
+  using iterator = typename container_type::iterator;
+  using const_iterator = typename container_type::const_iterator;
+  using difference_type = typename container_type::difference_type;
+  static constexpr size_type rows = dynamic_size;
+  static constexpr size_type cols = dynamic_size;
+};
+
+namespace detail {
+
+// Simd rows per sliver of the right matrix, 0 for scalar code. Two for
+// float, or double in AVX registers, one when double takes two SSE2
+// registers, which would not leave enough of them.
+template <typename T>
+struct gemm_simd_rows {
+  static const std::size_t value = !simd_row<T, 4>::value ? 0
+    : std::is_same<T, float>::value || avx_double4 ? 2 : 1;
+};
+
+template <typename T>
+struct gemm_blocks {
+  static const std::size_t MR = 4; // Rows of the register tile.
+  static const std::size_t NR =    // Columns of the register tile.
+    gemm_simd_rows<T>::value == 0 ? 4 : 4 * gemm_simd_rows<T>::value;
+  static const std::size_t KC = 256; // Depth of the slivers.
+  static const std::size_t MC = 64;  // Rows of the left block.
+  static const std::size_t NC = 512; // Columns of the right block.
+};
+
+// Accumulates the product of the packed slivers a, MR x kc, and b, kc
+// x NR, into the mr x nr tile c of the result, or stores it if first.
+template <typename T, std::size_t S = gemm_simd_rows<T>::value>
+struct gemm_kernel {
+  static const std::size_t MR = gemm_blocks<T>::MR;
+  static const std::size_t NR = gemm_blocks<T>::NR;
+  static void run( std::size_t kc, const T* a, const T* b, T* c
+                 , std::size_t ldc, std::size_t mr, std::size_t nr, bool first)
+  {
+    using R = simd_row<T, 4>;
+    using V = typename R::type;
+    V acc[MR][S];
+    auto zero = [&](std::size_t i)
+    {
+      for (std::size_t s = 0; s < S; ++s)
+        acc[i][s] = R::splat(T(0));
+    };
+    unroll<0, MR>::apply(zero);
+    for (std::size_t p = 0; p < kc; ++p) {
+      V vb[S];
+      for (std::size_t s = 0; s < S; ++s)
+        vb[s] = R::load(b + 4 * s);
+      auto step = [&](std::size_t i)
+      {
+        const V va = R::splat(a[i]);
+        for (std::size_t s = 0; s < S; ++s)
+          acc[i][s] = R::madd(va, vb[s], acc[i][s]);
+      };
+      unroll<0, MR>::apply(step);
+      a += MR;
+      b += NR;
+    }
+
+    if (mr == MR && nr == NR) {
+      auto store = [&](std::size_t i)
+      {
+        T* ci = c + i * ldc;
+        for (std::size_t s = 0; s < S; ++s)
+          R::store(ci + 4 * s, first ? acc[i][s] : R::add(acc[i][s], R::load(ci + 4 * s)));
+      };
+      unroll<0, MR>::apply(store);
+      return;
+    }
+
+    T tile[MR][NR];
+    for (std::size_t i = 0; i < MR; ++i)
+      for (std::size_t s = 0; s < S; ++s)
+        R::store(&tile[i][4 * s], acc[i][s]);
+    for (std::size_t i = 0; i < mr; ++i)
+      for (std::size_t j = 0; j < nr; ++j)
+        c[i * ldc + j] = first ? tile[i][j] : c[i * ldc + j] + tile[i][j];
+  }
+};
+
+template <typename T>
+struct gemm_kernel<T, 0> {
+  static const std::size_t MR = gemm_blocks<T>::MR;
+  static const std::size_t NR = gemm_blocks<T>::NR;
+  static void run( std::size_t kc, const T* a, const T* b, T* c
+                 , std::size_t ldc, std::size_t mr, std::size_t nr, bool first)
+  {
+    T tile[MR][NR] = {};
+    for (std::size_t p = 0; p < kc; ++p) {
+      for (std::size_t i = 0; i < MR; ++i)
+        for (std::size_t j = 0; j < NR; ++j)
+          tile[i][j] += a[i] * b[j];
+      a += MR;
+      b += NR;
+    }
+    for (std::size_t i = 0; i < mr; ++i)
+      for (std::size_t j = 0; j < nr; ++j)
+        c[i * ldc + j] = first ? tile[i][j] : c[i * ldc + j] + tile[i][j];
+  }
+};
+
+// Copies the mc x kc block of a at a, lda, as slivers of MR rows,
+// column after column, the rows beyond mc zero.
+template <typename T>
+void gemm_pack_a( const T* a, std::size_t lda, std::size_t mc, std::size_t kc
+                , T* out)
+{
+  const std::size_t MR = gemm_blocks<T>::MR;
+  for (std::size_t i = 0; i < mc; i += MR) {
+    const std::size_t mr = std::min(MR, mc - i);
+    for (std::size_t p = 0; p < kc; ++p) {
+      for (std::size_t r = 0; r < mr; ++r)
+        out[r] = a[(i + r) * lda + p];
+      for (std::size_t r = mr; r < MR; ++r)
+        out[r] = T(0);
+      out += MR;
+    }
+  }
+}
+
+// Copies the kc x nc block of b at b, ldb, as slivers of NR columns,
+// row after row, the columns beyond nc zero.
+template <typename T>
+void gemm_pack_b( const T* b, std::size_t ldb, std::size_t kc, std::size_t nc
+                , T* out)
+{
+  const std::size_t NR = gemm_blocks<T>::NR;
+  for (std::size_t j = 0; j < nc; j += NR) {
+    const std::size_t nr = std::min(NR, nc - j);
+    for (std::size_t p = 0; p < kc; ++p) {
+      const T* bp = b + p * ldb + j;
+      for (std::size_t s = 0; s < nr; ++s)
+        out[s] = bp[s];
+      for (std::size_t s = nr; s < NR; ++s)
+        out[s] = T(0);
+      out += NR;
+    }
+  }
+}
+
+// c = a * b for the row major a, m x k, b, k x n, and c, m x n, with
+// leading dimensions lda, ldb and ldc.
+template <typename T>
+void gemm( std::size_t m, std::size_t n, std::size_t k, const T* a
+         , std::size_t lda, const T* b, std::size_t ldb, T* c, std::size_t ldc)
+{
+  const std::size_t MR = gemm_blocks<T>::MR;
+  const std::size_t NR = gemm_blocks<T>::NR;
+  const std::size_t KC = gemm_blocks<T>::KC;
+  const std::size_t MC = gemm_blocks<T>::MC;
+  const std::size_t NC = gemm_blocks<T>::NC;
+  if (k == 0) {
+    for (std::size_t i = 0; i < m; ++i)
+      std::fill(c + i * ldc, c + i * ldc + n, T(0));
+    return;
+  }
+
+  std::vector<T> pa(MC * KC);
+  std::vector<T> pb((std::min(n, NC) + NR - 1) / NR * NR * KC);
+  for (std::size_t jc = 0; jc < n; jc += NC) {
+    const std::size_t nc = std::min(NC, n - jc);
+    for (std::size_t pc = 0; pc < k; pc += KC) {
+      const std::size_t kc = std::min(KC, k - pc);
+      gemm_pack_b(b + pc * ldb + jc, ldb, kc, nc, pb.data());
+      for (std::size_t ic = 0; ic < m; ic += MC) {
+        const std::size_t mc = std::min(MC, m - ic);
+        gemm_pack_a(a + ic * lda + pc, lda, mc, kc, pa.data());
+        for (std::size_t jr = 0; jr < nc; jr += NR) {
+          for (std::size_t ir = 0; ir < mc; ir += MR) {
+            gemm_kernel<T>::run( kc, pa.data() + ir * kc, pb.data() + jr * kc
+                               , c + (ic + ir) * ldc + jc + jr, ldc
+                               , std::min(MR, mc - ir), std::min(NR, nc - jr)
+                               , pc == 0);
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename T, typename A1, typename A2>
+void check_gemm_dims(const dmatrix<T, A1>& a, const dmatrix<T, A2>& b)
+{
+  check_dims( a.n_cols(), b.n_rows()
+            , "gemm: Incompatible number of rows and columns.");
+}
+
+template <typename T, typename A1, typename A2>
+struct matrix_eval<matrix_prod<dmatrix<T, A1>, dmatrix<T, A2> > > {
+  static void run(const matrix_prod<dmatrix<T, A1>, dmatrix<T, A2> >& e, T* out)
+  {
+    const dmatrix<T, A1>& a = e.lhs();
+    const dmatrix<T, A2>& b = e.rhs();
+    gemm( a.n_rows(), b.n_cols(), a.n_cols(), a.data(), a.n_cols()
+        , b.data(), b.n_cols(), out, b.n_cols());
+  }
+};
+
+}
+
+// c = a * b, c is resized. c must not be a or b.
+template <typename T, typename A1, typename A2, typename A3>
+void gemm(const dmatrix<T, A1>& a, const dmatrix<T, A2>& b, dmatrix<T, A3>& c)
+{
+  detail::check_gemm_dims(a, b);
+  c.resize(a.n_rows(), b.n_cols());
+  detail::gemm( a.n_rows(), b.n_cols(), a.n_cols(), a.data(), a.n_cols()
+              , b.data(), b.n_cols(), c.data(), c.n_cols());
+}
+
+// The same with the rows of c shared among exec.size() tasks, in
+// multiples of the register tile.
+template <typename Exec, typename T, typename A1, typename A2, typename A3>
+void gemm( Exec& exec, const dmatrix<T, A1>& a, const dmatrix<T, A2>& b
+         , dmatrix<T, A3>& c)
+{
+  detail::check_gemm_dims(a, b);
+  c.resize(a.n_rows(), b.n_cols());
+  const std::size_t MR = detail::gemm_blocks<T>::MR;
+  const std::size_t tiles = (a.n_rows() + MR - 1) / MR;
+  const std::size_t parts = std::max<std::size_t>(1, std::min(exec.size(), tiles));
+  exec.run(parts, [&](std::size_t t)
+  {
+    const std::size_t i0 = std::min(a.n_rows(), tiles * t / parts * MR);
+    const std::size_t i1 = std::min(a.n_rows(), tiles * (t + 1) / parts * MR);
+    detail::gemm( i1 - i0, b.n_cols(), a.n_cols(), a.data() + i0 * a.n_cols()
+                , a.n_cols(), b.data(), b.n_cols(), c.data() + i0 * c.n_cols()
+                , c.n_cols());
+  });
+}
+
+template <typename T, typename A, typename E>
+dmatrix<T, A>& operator+=(dmatrix<T, A>& u, const matrix_expr<E>& v)
+{ return u = u + v; }
+
+template <typename T, typename A, typename E>
+dmatrix<T, A>& operator-=(dmatrix<T, A>& u, const matrix_expr<E>& v)
+{ return u = u - v; }
+
+template <typename T, typename A, typename E>
+dmatrix<T, A>& operator*=(dmatrix<T, A>& u, const matrix_expr<E>& v)
+{ return u = u * v; }
+
+template <typename T, typename A>
+dmatrix<T, A>& operator*=(dmatrix<T, A>& u, T val)
+{
+  for (auto& x : u)
+    x *= val;
+  return u;
+}
+
+template <typename T, typename A>
+std::ostream& operator<<(std::ostream& os, const dmatrix<T, A>& mat)
+{
+  for (std::size_t i = 0; i < mat.n_rows(); ++i) {
+    std::copy( mat.row_cbegin(i)
+             , mat.row_cend(i)
+             , std::ostream_iterator<T>(os, " "));
+    os << "\n";
+  }
+  os << std::endl;
+  return os;
+}
+
+}
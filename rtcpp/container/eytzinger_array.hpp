@@ -0,0 +1,157 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <functional>
+
+#include <rtcpp/memory/align.hpp>
+#include <rtcpp/utility/prefetch.hpp>
+
+/*
+  A sorted range stored in the order of a breadth first traversal of
+  the implicit complete binary search tree over it (Eytzinger layout):
+  element k has its children at 2k and 2k + 1, index 0 is unused. The
+  first levels of the tree, visited by every search, share a few cache
+  lines, and the search reads ahead the line holding the descendants
+  four levels down, where the plain binary search can only read ahead
+  both candidates of the next step.
+
+  The element array starts on a cache line. Iteration is in layout
+  order, not in key order. T must be default constructible.
+*/
+
+namespace rt {
+
+template <class T, class Compare = std::less<T>>
+class eytzinger_array {
+  public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using key_compare = Compare;
+  using const_iterator = const T*;
+  using iterator = const_iterator;
+  private:
+  // Descendants of k four levels down start at k * block.
+  static constexpr size_type block =
+    sizeof (T) < cache_line_size ? cache_line_size / sizeof (T) : 1;
+  std::vector<T> m_buffer;
+  T* m_a; // Index 0 of the layout.
+  size_type m_n;
+  Compare m_comp;
+  void allocate(size_type n);
+  template <class It>
+  void fill(It& it, size_type k);
+  // Only an address for the prefetch, it may be past the end.
+  const void* ahead(size_type k) const noexcept
+  {
+    return reinterpret_cast<const void*>(
+      reinterpret_cast<std::uintptr_t>(m_a) + k * block * sizeof (T));
+  }
+  public:
+  explicit eytzinger_array(const Compare& comp = Compare())
+  : m_a(0), m_n(0), m_comp(comp)
+  { assign(static_cast<const T*>(0), static_cast<const T*>(0)); }
+  // [begin, end) must be sorted.
+  template <class ForwardIt>
+  eytzinger_array( ForwardIt begin, ForwardIt end
+                 , const Compare& comp = Compare())
+  : m_a(0), m_n(0), m_comp(comp) { assign(begin, end); }
+  eytzinger_array(const eytzinger_array& rhs)
+  : eytzinger_array(rhs.m_comp) { *this = rhs; }
+  eytzinger_array& operator=(const eytzinger_array& rhs);
+  template <class ForwardIt>
+  void assign(ForwardIt begin, ForwardIt end);
+  const_iterator begin() const noexcept { return m_a + 1; }
+  const_iterator end() const noexcept { return m_a + 1 + m_n; }
+  size_type size() const noexcept { return m_n; }
+  bool empty() const noexcept { return m_n == 0; }
+  key_compare key_comp() const { return m_comp; }
+  // The element with layout index k, 1 <= k <= size().
+  const T& operator[](size_type k) const noexcept { return m_a[k]; }
+  size_type index(const_iterator it) const noexcept
+  { return static_cast<size_type>(it - m_a); }
+  // The first element not less than key, end() if there is none.
+  const_iterator lower_bound(const T& key) const;
+  const_iterator find(const T& key) const
+  {
+    const_iterator it = lower_bound(key);
+    return it != end() && !m_comp(key, *it) ? it : end();
+  }
+  bool contains(const T& key) const { return find(key) != end(); }
+};
+
+template <class T, class C>
+template <class It>
+void eytzinger_array<T, C>::fill(It& it, size_type k)
+{
+  // The depth is the height of the tree, about log2(n).
+  if (k > m_n)
+    return;
+  fill(it, 2 * k);
+  m_a[k] = *it;
+  ++it;
+  fill(it, 2 * k + 1);
+}
+
+template <class T, class C>
+void eytzinger_array<T, C>::allocate(size_type n)
+{
+  const bool aligned = cache_line_size % sizeof (T) == 0;
+  const size_type pad = aligned ? cache_line_size / sizeof (T) : 0;
+  m_buffer.assign(n + 1 + pad, T());
+  m_a = m_buffer.data();
+  m_n = n;
+  if (aligned) {
+    const std::uintptr_t a = reinterpret_cast<std::uintptr_t>(m_a);
+    const std::uintptr_t r = a % cache_line_size;
+    if (r)
+      m_a += (cache_line_size - r) / sizeof (T);
+  }
+}
+
+template <class T, class C>
+template <class ForwardIt>
+void eytzinger_array<T, C>::assign(ForwardIt begin, ForwardIt end)
+{
+  allocate(static_cast<size_type>(std::distance(begin, end)));
+  fill(begin, 1);
+}
+
+template <class T, class C>
+eytzinger_array<T, C>& eytzinger_array<T, C>::operator=(const eytzinger_array& rhs)
+{
+  if (this != &rhs) {
+    // The copy of the buffer may not have the same alignment.
+    m_comp = rhs.m_comp;
+    allocate(rhs.m_n);
+    std::copy(rhs.m_a + 1, rhs.m_a + 1 + m_n, m_a + 1);
+  }
+  return *this;
+}
+
+template <class T, class C>
+typename eytzinger_array<T, C>::const_iterator
+eytzinger_array<T, C>::lower_bound(const T& key) const
+{
+  size_type k = 1;
+  while (k <= m_n) {
+    prefetch(ahead(k));
+    k = 2 * k + (m_comp(m_a[k], key) ? 1 : 0);
+  }
+  // The answer is where the search last went left: drops the trailing
+  // right turns (ones) and that left turn.
+#if defined(__GNUC__)
+  k >>= __builtin_ctzll(~static_cast<unsigned long long>(k)) + 1;
+#else
+  while (k & 1)
+    k >>= 1;
+  k >>= 1;
+#endif
+  return k ? m_a + k : end();
+}
+
+}
+
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <tuple>
+#include <memory>
+#include <utility>
+#include <stdexcept>
+#include <functional>
+#include <initializer_list>
+
+#include "flat_hash_table.hpp"
+
+/*
+  A std::unordered_map with the pairs inline in an open addressing
+  table, see flat_hash_table.hpp. It takes a caller buffer as
+  flat_hash_set does, bytes_for() accounts for the whole pair.
+
+  Unlike std::unordered_map, insertion and erasure invalidate
+  references and iterators.
+*/
+
+namespace rt {
+
+namespace detail {
+
+struct first_key {
+  template <class P>
+  const typename P::first_type& operator()(const P& p) const noexcept
+  { return p.first; }
+};
+
+}
+
+template < class Key
+         , class T
+         , class Hash = std::hash<Key>
+         , class KeyEqual = std::equal_to<Key>
+         , class Allocator = std::allocator<std::pair<const Key, T>>>
+class flat_hash_map
+: public flat_hash_table< std::pair<const Key, T>, detail::first_key
+                        , Hash, KeyEqual, Allocator> {
+  using base = flat_hash_table< std::pair<const Key, T>, detail::first_key
+                              , Hash, KeyEqual, Allocator>;
+  public:
+  using mapped_type = T;
+  using typename base::iterator;
+  using typename base::value_type;
+  using base::base;
+  flat_hash_map(std::initializer_list<value_type> init) { insert(init); }
+  using base::insert;
+  void insert(std::initializer_list<value_type> init)
+  { base::insert(std::begin(init), std::end(init)); }
+  // Constructs the mapped value only if the key is not there.
+  template <class... Args>
+  std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args)
+  {
+    return this->emplace_key( key, std::piecewise_construct
+                            , std::forward_as_tuple(key)
+                            , std::forward_as_tuple(std::forward<Args>(args)...));
+  }
+  template <class M>
+  std::pair<iterator, bool> insert_or_assign(const Key& key, M&& m)
+  {
+    auto pair = try_emplace(key, std::forward<M>(m));
+    if (!pair.second)
+      pair.first->second = std::forward<M>(m);
+    return pair;
+  }
+  T& operator[](const Key& key) { return try_emplace(key).first->second; }
+  T& at(const Key& key)
+  {
+    auto iter = this->find(key);
+    if (iter == this->end())
+      throw std::out_of_range("flat_hash_map: Key not found.");
+    return iter->second;
+  }
+  const T& at(const Key& key) const
+  { return const_cast<flat_hash_map*>(this)->at(key); }
+};
+
+}
+
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <functional>
+#include <initializer_list>
+
+#include "flat_hash_table.hpp"
+
+/*
+  A std::unordered_set with the elements inline in an open addressing
+  table, see flat_hash_table.hpp. Besides the usual constructors it
+  takes a caller buffer, e.g.
+
+    std::vector<char> buffer(flat_hash_set<int>::bytes_for(1000));
+    flat_hash_set<int> s(buffer);
+
+  after which inserting up to 1000 elements allocates nothing.
+
+  Unlike std::unordered_set, insertion and erasure invalidate
+  references and iterators.
+*/
+
+namespace rt {
+
+namespace detail {
+
+struct identity_key {
+  template <class T>
+  const T& operator()(const T& v) const noexcept { return v; }
+};
+
+}
+
+template < class T
+         , class Hash = std::hash<T>
+         , class KeyEqual = std::equal_to<T>
+         , class Allocator = std::allocator<T>>
+class flat_hash_set : public flat_hash_table< T, detail::identity_key
+                                            , Hash, KeyEqual, Allocator> {
+  using base = flat_hash_table<T, detail::identity_key, Hash, KeyEqual, Allocator>;
+  public:
+  using iterator = typename base::const_iterator;
+  using const_iterator = typename base::const_iterator;
+  using base::base;
+  flat_hash_set(std::initializer_list<T> init) { insert(init); }
+  flat_hash_set& operator=(std::initializer_list<T> init)
+  {
+    this->clear();
+    insert(init);
+    return *this;
+  }
+  // Only const access, the elements are keys.
+  std::pair<const_iterator, bool> insert(const T& v) { return base::insert(v); }
+  std::pair<const_iterator, bool> insert(T&& v)
+  { return base::insert(std::move(v)); }
+  template <class InputIt>
+  void insert(InputIt begin, InputIt end) { base::insert(begin, end); }
+  void insert(std::initializer_list<T> init)
+  { base::insert(std::begin(init), std::end(init)); }
+  template <class... Args>
+  std::pair<const_iterator, bool> emplace(Args&&... args)
+  { return base::emplace(std::forward<Args>(args)...); }
+  const_iterator begin() const noexcept { return base::begin(); }
+  const_iterator end() const noexcept { return base::end(); }
+  const_iterator find(const T& key) const noexcept { return base::find(key); }
+};
+
+template <class T, class H, class E, class A>
+bool operator==(const flat_hash_set<T, H, E, A>& a, const flat_hash_set<T, H, E, A>& b)
+{
+  if (a.size() != b.size())
+    return false;
+
+  for (const auto& v: a)
+    if (!b.count(v))
+      return false;
+
+  return true;
+}
+
+template <class T, class H, class E, class A>
+bool operator!=(const flat_hash_set<T, H, E, A>& a, const flat_hash_set<T, H, E, A>& b)
+{ return !(a == b); }
+
+}
+
@@ -0,0 +1,680 @@
+#pragma once
+
+#include <new>
+#include <array>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <rtcpp/memory/align.hpp>
+#include <rtcpp/memory/block_range.hpp>
+#include <rtcpp/memory/allocator_traits.hpp>
+
+/*
+  The open addressing table behind flat_hash_set and flat_hash_map.
+  The values are kept inline in an array of slots, in front of which
+  there is one control byte per slot: empty, deleted, or the low seven
+  bits of the hash of the value in the slot. The control bytes are
+  read in aligned groups of 16 and matched all at once with SSE2 or
+  NEON (a loop otherwise), so a lookup usually touches one group and
+  compares the key of the slots whose byte matched only.
+
+  The memory is either requested from the allocator, the table then
+  doubles when full, or given by the caller in the same forms as to
+  node_alloc_header. A table on a caller buffer never allocates and
+  throws std::bad_alloc once the buffer is full, bytes_for() tells the
+  size needed for a given number of elements. After reserve(n) a
+  table does not allocate until it holds n elements.
+
+  Erasing leaves a tombstone unless the group still has an empty
+  slot. When tombstones exhaust the room the table is rehashed in
+  place, which takes time proportional to the capacity but allocates
+  nothing.
+*/
+
+namespace rt {
+
+namespace detail {
+
+using ctrl_type = signed char;
+
+const ctrl_type ctrl_empty = -128;
+const ctrl_type ctrl_deleted = -2;
+const std::size_t group_size = 16;
+// Slots per group that can be used before the table is full.
+const std::size_t group_load = 14;
+
+// Bit i is set when byte i of the (aligned) group g matches.
+inline std::uint32_t match_byte(const ctrl_type* g, ctrl_type c) noexcept
+{
+#if defined(__SSE2__)
+  const __m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(g));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8(c)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  static const std::uint8_t w[16] =
+  {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t eq = vceqq_s8(vld1q_s8(g), vdupq_n_s8(c));
+  const uint8x16_t m = vandq_u8(eq, vld1q_u8(w));
+  return vaddv_u8(vget_low_u8(m)) | (vaddv_u8(vget_high_u8(m)) << 8);
+#else
+  std::uint32_t m = 0;
+  for (std::size_t i = 0; i < group_size; ++i)
+    m |= std::uint32_t(g[i] == c) << i;
+  return m;
+#endif
+}
+
+// Empty and deleted slots, the control bytes with the sign bit.
+inline std::uint32_t match_free(const ctrl_type* g) noexcept
+{
+#if defined(__SSE2__)
+  return _mm_movemask_epi8(
+    _mm_load_si128(reinterpret_cast<const __m128i*>(g)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  static const std::uint8_t w[16] =
+  {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  const uint8x16_t neg = vcltzq_s8(vld1q_s8(g));
+  const uint8x16_t m = vandq_u8(neg, vld1q_u8(w));
+  return vaddv_u8(vget_low_u8(m)) | (vaddv_u8(vget_high_u8(m)) << 8);
+#else
+  std::uint32_t m = 0;
+  for (std::size_t i = 0; i < group_size; ++i)
+    m |= std::uint32_t(g[i] < 0) << i;
+  return m;
+#endif
+}
+
+// Spreads the bits of weak hashes, e.g. std::hash<int>, which is the
+// identity, so that both the group and the control byte vary.
+inline std::size_t mix_hash(std::size_t h) noexcept
+{
+  std::uint64_t x = h;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return static_cast<std::size_t>(x);
+}
+
+}
+
+template <class V, class Const>
+class flat_hash_iterator :
+  public std::iterator< std::forward_iterator_tag, V, std::ptrdiff_t
+                      , typename std::conditional<Const::value, const V, V>::type*
+                      , typename std::conditional<Const::value, const V, V>::type&> {
+  template <class, class, class, class, class> friend class flat_hash_table;
+  template <class, class> friend class flat_hash_iterator;
+  using value_type_ = typename std::conditional<Const::value, const V, V>::type;
+  const detail::ctrl_type* m_ctrl;
+  const detail::ctrl_type* m_end;
+  V* m_slot;
+  flat_hash_iterator( const detail::ctrl_type* c, const detail::ctrl_type* e
+                    , V* s) noexcept
+  : m_ctrl(c), m_end(e), m_slot(s) {}
+  void skip_free() noexcept
+  {
+    while (m_ctrl != m_end && *m_ctrl < 0) {
+      ++m_ctrl;
+      ++m_slot;
+    }
+  }
+  public:
+  flat_hash_iterator() noexcept : m_ctrl(0), m_end(0), m_slot(0) {}
+  // From iterator to const_iterator.
+  template <class C, class = typename std::enable_if<Const::value && !C::value>::type>
+  flat_hash_iterator(const flat_hash_iterator<V, C>& rhs) noexcept
+  : m_ctrl(rhs.m_ctrl), m_end(rhs.m_end), m_slot(rhs.m_slot) {}
+  value_type_& operator*() const noexcept { return *m_slot; }
+  value_type_* operator->() const noexcept { return m_slot; }
+  flat_hash_iterator& operator++() noexcept
+  {
+    ++m_ctrl;
+    ++m_slot;
+    skip_free();
+    return *this;
+  }
+  flat_hash_iterator operator++(int) noexcept
+  {
+    flat_hash_iterator tmp(*this);
+    operator++();
+    return tmp;
+  }
+  template <class C>
+  bool operator==(const flat_hash_iterator<V, C>& rhs) const noexcept
+  { return m_slot == rhs.m_slot; }
+  template <class C>
+  bool operator!=(const flat_hash_iterator<V, C>& rhs) const noexcept
+  { return m_slot != rhs.m_slot; }
+};
+
+// KeyOf returns the key of a value.
+template <class V, class KeyOf, class Hash, class KeyEqual, class Allocator>
+class flat_hash_table {
+  public:
+  using value_type = V;
+  using key_type = typename std::decay<
+    decltype(std::declval<KeyOf>()(std::declval<const V&>()))>::type;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+  using iterator = flat_hash_iterator<V, std::false_type>;
+  using const_iterator = flat_hash_iterator<V, std::true_type>;
+  private:
+  using ctrl_type = detail::ctrl_type;
+  using byte_allocator_type = typename
+    rt::allocator_traits<Allocator>::template rebind_alloc<char>;
+  using byte_alloc_traits_type = rt::allocator_traits<byte_allocator_type>;
+  static const size_type npos = size_type(-1);
+  byte_allocator_type m_alloc;
+  char* m_memory; // Requested from m_alloc, null on a caller buffer.
+  size_type m_memory_size;
+  ctrl_type* m_ctrl;
+  V* m_slots;
+  size_type m_groups; // A power of two, or zero.
+  size_type m_size;
+  size_type m_growth_left; // Empty slots that may still be used.
+  size_type m_reserved;
+  Hash m_hash;
+  KeyEqual m_equal;
+  KeyOf m_key_of;
+  size_type capacity_limit() const noexcept
+  { return m_groups * detail::group_load; }
+  static size_type groups_for(size_type n) noexcept;
+  static size_type bytes_for_groups(size_type g) noexcept
+  { return g * detail::group_size * (1 + sizeof (V))
+         + detail::group_size + alignof (V); }
+  size_type hash(const key_type& key) const noexcept
+  { return detail::mix_hash(m_hash(key)); }
+  bool layout(char* p, size_type s, size_type max_groups) noexcept;
+  template <class K>
+  size_type find_index(const K& key, size_type h) const noexcept;
+  size_type find_free(size_type h) const noexcept;
+  void set_ctrl(size_type i, size_type h) noexcept
+  { m_ctrl[i] = static_cast<ctrl_type>(h & 0x7F); }
+  void make_room();
+  void resize(size_type groups);
+  void drop_deletes() noexcept;
+  void release() noexcept;
+  void steal(flat_hash_table& rhs) noexcept;
+  void reset() noexcept;
+  iterator make_iter(size_type i) const noexcept
+  { return iterator(m_ctrl + i, m_ctrl + capacity(), m_slots + i); }
+  template <class U>
+  void use_buffer(U* data, size_type n);
+  protected:
+  template <class... Args>
+  std::pair<iterator, bool> emplace_key(const key_type& key, Args&&... args);
+  public:
+  explicit flat_hash_table( const Hash& hash = Hash()
+                          , const KeyEqual& equal = KeyEqual()
+                          , const Allocator& alloc = Allocator()) noexcept;
+  // The table lives in the caller's buffer, which must outlive it.
+  template <class U>
+  flat_hash_table(U* data, size_type n) : flat_hash_table()
+  { use_buffer(data, n); }
+  template <class U, std::size_t I>
+  explicit flat_hash_table(std::array<U, I>& arr) : flat_hash_table()
+  { use_buffer(arr.data(), arr.size()); }
+  template <class U, class A>
+  explicit flat_hash_table(std::vector<U, A>& arr) : flat_hash_table()
+  { use_buffer(arr.data(), arr.size()); }
+  flat_hash_table(const flat_hash_table& rhs);
+  flat_hash_table(flat_hash_table&& rhs) noexcept;
+  ~flat_hash_table() { release(); }
+  flat_hash_table& operator=(const flat_hash_table& rhs);
+  flat_hash_table& operator=(flat_hash_table&& rhs) noexcept;
+  void swap(flat_hash_table& other) noexcept;
+  // Bytes a caller buffer needs to hold n elements.
+  static size_type bytes_for(size_type n) noexcept
+  { return bytes_for_groups(groups_for(n)); }
+  std::pair<iterator, bool> insert(const V& v)
+  { return emplace_key(m_key_of(v), v); }
+  std::pair<iterator, bool> insert(V&& v)
+  { return emplace_key(m_key_of(v), std::move(v)); }
+  template <class InputIt>
+  void insert(InputIt begin, InputIt end)
+  {
+    for (; begin != end; ++begin)
+      insert(*begin);
+  }
+  template <class... Args>
+  std::pair<iterator, bool> emplace(Args&&... args)
+  {
+    V v(std::forward<Args>(args)...);
+    return insert(std::move(v));
+  }
+  iterator erase(const_iterator pos) noexcept;
+  size_type erase(const key_type& key) noexcept;
+  void clear() noexcept;
+  void reserve(size_type n);
+  iterator find(const key_type& key) noexcept;
+  const_iterator find(const key_type& key) const noexcept
+  { return const_cast<flat_hash_table*>(this)->find(key); }
+  size_type count(const key_type& key) const noexcept
+  { return find(key) != end(); }
+  iterator begin() noexcept
+  {
+    iterator iter = make_iter(0);
+    iter.skip_free();
+    return iter;
+  }
+  iterator end() noexcept { return make_iter(capacity()); }
+  const_iterator begin() const noexcept
+  { return const_cast<flat_hash_table*>(this)->begin(); }
+  const_iterator end() const noexcept
+  { return const_cast<flat_hash_table*>(this)->end(); }
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+  size_type size() const noexcept { return m_size; }
+  bool empty() const noexcept { return m_size == 0; }
+  size_type capacity() const noexcept
+  { return m_groups * detail::group_size; }
+  float load_factor() const noexcept
+  { return m_groups ? float(m_size) / capacity() : 0; }
+  hasher hash_function() const { return m_hash; }
+  key_equal key_eq() const { return m_equal; }
+  allocator_type get_allocator() const { return m_alloc; }
+};
+
+template <class V, class KO, class H, class E, class A>
+flat_hash_table<V, KO, H, E, A>::flat_hash_table( const H& hash
+                                                , const E& equal
+                                                , const A& alloc) noexcept
+: m_alloc(alloc)
+, m_hash(hash)
+, m_equal(equal)
+{
+  reset();
+}
+
+template <class V, class KO, class H, class E, class A>
+void flat_hash_table<V, KO, H, E, A>::reset() noexcept
+{
+  m_memory = 0;
+  m_memory_size = 0;
+  m_ctrl = 0;
+  m_slots = 0;
+  m_groups = 0;
+  m_size = 0;
+  m_growth_left = 0;
+  m_reserved = 0;
+}
+
+template <class V, class KO, class H, class E, class A>
+template <class U>
+void flat_hash_table<V, KO, H, E, A>::use_buffer(U* data, size_type n)
+{
+  const size_type s = n * sizeof (U);
+  if (!layout(reinterpret_cast<char*>(data), s, npos))
+    throw std::runtime_error("flat_hash_table: Buffer too small.");
+  // Never grows.
+  m_reserved = npos;
+}
+
+template <class V, class KO, class H, class E, class A>
+flat_hash_table<V, KO, H, E, A>::flat_hash_table(const flat_hash_table& rhs)
+: m_alloc(rt::allocator_traits<byte_allocator_type>::select_on_container_copy_construction(rhs.m_alloc))
+, m_hash(rhs.m_hash)
+, m_equal(rhs.m_equal)
+, m_key_of(rhs.m_key_of)
+{
+  reset();
+  reserve(rhs.size());
+  for (const auto& v: rhs)
+    insert(v);
+}
+
+template <class V, class KO, class H, class E, class A>
+flat_hash_table<V, KO, H, E, A>::flat_hash_table(flat_hash_table&& rhs) noexcept
+: m_alloc(rhs.m_alloc)
+, m_hash(rhs.m_hash)
+, m_equal(rhs.m_equal)
+, m_key_of(rhs.m_key_of)
+{
+  steal(rhs);
+}
+
+template <class V, class KO, class H, class E, class A>
+flat_hash_table<V, KO, H, E, A>&
+flat_hash_table<V, KO, H, E, A>::operator=(const flat_hash_table& rhs)
+{
+  if (this != &rhs) {
+    flat_hash_table tmp(rhs);
+    swap(tmp);
+  }
+  return *this;
+}
+
+template <class V, class KO, class H, class E, class A>
+flat_hash_table<V, KO, H, E, A>&
+flat_hash_table<V, KO, H, E, A>::operator=(flat_hash_table&& rhs) noexcept
+{
+  swap(rhs);
+  return *this;
+}
+
+template <class V, class KO, class H, class E, class A>
+void flat_hash_table<V, KO, H, E, A>::steal(flat_hash_table& rhs) noexcept
+{
+  m_memory = rhs.m_memory;
+  m_memory_size = rhs.m_memory_size;
+  m_ctrl = rhs.m_ctrl;
+  m_slots = rhs.m_slots;
+  m_groups = rhs.m_groups;
+  m_size = rhs.m_size;
+  m_growth_left = rhs.m_growth_left;
+  m_reserved = rhs.m_reserved;
+  rhs.reset();
+}
+
+template <class V, class KO, class H, class E, class A>
+void flat_hash_table<V, KO, H, E, A>::swap(flat_hash_table& other) noexcept
+{
+  std::swap(m_alloc, other.m_alloc);
+  std::swap(m_memory, other.m_memory);
+  std::swap(m_memory_size, other.m_memory_size);
+  std::swap(m_ctrl, other.m_ctrl);
+  std::swap(m_slots, other.m_slots);
+  std::swap(m_groups, other.m_groups);
+  std::swap(m_size, other.m_size);
+  std::swap(m_growth_left, other.m_growth_left);
+  std::swap(m_reserved, other.m_reserved);
+  std::swap(m_hash, other.m_hash);
+  std::swap(m_equal, other.m_equal);
+  std::swap(m_key_of, other.m_key_of);
+}
+
+template <class V, class KO, class H, class E, class A>
+typename flat_hash_table<V, KO, H, E, A>::size_type
+flat_hash_table<V, KO, H, E, A>::groups_for(size_type n) noexcept
+{
+  size_type g = 1;
+  while (g * detail::group_load < n)
+    g <<= 1;
+  return g;
+}
+
+// Places the largest power of two number of groups, at most
+// max_groups, that fits in s bytes at p.
+template <class V, class KO, class H, class E, class A>
+bool flat_hash_table<V, KO, H, E, A>::layout( char* p, size_type s
+                                            , size_type max_groups) noexcept
+{
+  align_if_needed<detail::group_size>(p, s);
+  // The slots follow the control bytes.
+  auto slots = [p](size_type g)
+  {
+    const std::uintptr_t a =
+      reinterpret_cast<std::uintptr_t>(p + g * detail::group_size);
+    return (a + alignof (V) - 1) / alignof (V) * alignof (V);
+  };
+  auto fits = [&](size_type g)
+  {
+    const std::uintptr_t end = slots(g) + g * detail::group_size * sizeof (V);
+    return end - reinterpret_cast<std::uintptr_t>(p) <= s;
+  };
+
+  if (s > std::numeric_limits<size_type>::max() / 2 || !fits(1))
+    return false;
+
+  size_type g = 1;
+  while (2 * g <= max_groups && fits(2 * g))
+    g <<= 1;
+
+  const size_type n = g * detail::group_size;
+  m_ctrl = reinterpret_cast<ctrl_type*>(p);
+  m_slots = reinterpret_cast<V*>(slots(g));
+  m_groups = g;
+  m_size = 0;
+  m_growth_left = capacity_limit();
+  std::fill(m_ctrl, m_ctrl + n, detail::ctrl_empty);
+  return true;
+}
+
+template <class V, class KO, class H, class E, class A>
+template <class K>
+typename flat_hash_table<V, KO, H, E, A>::size_type
+flat_hash_table<V, KO, H, E, A>::find_index(const K& key, size_type h) const noexcept
+{
+  if (m_size == 0)
+    return npos;
+
+  const size_type mask = m_groups - 1;
+  const ctrl_type c = static_cast<ctrl_type>(h & 0x7F);
+  size_type g = (h >> 7) & mask;
+  // Triangular steps visit every group when their number is a power
+  // of two.
+  for (size_type step = 1; ; ++step) {
+    const ctrl_type* p = m_ctrl + g * detail::group_size;
+    for (std::uint32_t m = detail::match_byte(p, c); m; m &= m - 1) {
+      const size_type i = g * detail::group_size + count_trailing_zeros(m);
+      if (m_equal(m_key_of(m_slots[i]), key))
+        return i;
+    }
+    if (detail::match_byte(p, detail::ctrl_empty))
+      return npos;
+    g = (g + step) & mask;
+  }
+}
+
+template <class V, class KO, class H, class E, class A>
+typename flat_hash_table<V, KO, H, E, A>::size_type
+flat_hash_table<V, KO, H, E, A>::find_free(size_type h) const noexcept
+{
+  const size_type mask = m_groups - 1;
+  size_type g = (h >> 7) & mask;
+  for (size_type step = 1; ; ++step) {
+    const std::uint32_t m =
+      detail::match_free(m_ctrl + g * detail::group_size);
+    if (m)
+      return g * detail::group_size + count_trailing_zeros(m);
+    g = (g + step) & mask;
+  }
+}
+
+template <class V, class KO, class H, class E, class A>
+template <class... Args>
+std::pair<typename flat_hash_table<V, KO, H, E, A>::iterator, bool>
+flat_hash_table<V, KO, H, E, A>::emplace_key( const key_type& key
+                                            , Args&&... args)
+{
+  const size_type h = hash(key);
+  size_type i = find_index(key, h);
+  if (i != npos)
+    return std::make_pair(make_iter(i), false);
+
+  if (m_growth_left == 0)
+    make_room();
+
+  i = find_free(h);
+  ::new (static_cast<void*>(m_slots + i)) V(std::forward<Args>(args)...);
+  // Tombstones are reused without taking room.
+  m_growth_left -= m_ctrl[i] == detail::ctrl_empty;
+  set_ctrl(i, h);
+  ++m_size;
+  return std::make_pair(make_iter(i), true);
+}
+
+template <class V, class KO, class H, class E, class A>
+void flat_hash_table<V, KO, H, E, A>::make_room()
+{
+  // A caller buffer can only be cleaned from tombstones.
+  if (m_reserved == npos) {
+    if (m_size == capacity_limit())
+      throw std::bad_alloc();
+    drop_deletes();
+    return;
+  }
+
+  // Below the reserved size, or when at most half the room holds
+  // elements, the tombstones are dropped instead of growing.
+  if (m_groups && (m_size < m_reserved || 2 * m_size <= capacity_limit())) {
+    drop_deletes();
+    return;
+  }
+
+  resize(m_groups ? 2 * m_groups : 1);
+}
+
+template <class V, class KO, class H, class E, class A>
+void flat_hash_table<V, KO, H, E, A>::resize(size_type groups)
+{
+  const size_type s = bytes_for_groups(groups);
+  char* p = byte_alloc_traits_type::allocate(m_alloc, s);
+  char* old_memory = m_memory;
+  const size_type old_memory_size = m_memory_size;
+  ctrl_type* old_ctrl = m_ctrl;
+  V* old_slots = m_slots;
+  const size_type old_n = capacity();
+  const size_type n = m_size;
+
+  layout(p, s, groups);
+  m_memory = p;
+  m_memory_size = s;
+  for (size_type i = 0; i < old_n; ++i) {
+    if (old_ctrl[i] < 0)
+      continue;
+    V& v = old_slots[i];
+    const size_type h = hash(m_key_of(v));
+    const size_type j = find_free(h);
+    ::new (static_cast<void*>(m_slots + j)) V(std::move(v));
+    v.~V();
+    set_ctrl(j, h);
+  }
+  m_size = n;
+  m_growth_left = capacity_limit() - n;
+
+  if (old_memory)
+    byte_alloc_traits_type::deallocate(m_alloc, old_memory, old_memory_size);
+}
+
+template <class V, class KO, class H, class E, class A>
+void flat_hash_table<V, KO, H, E, A>::drop_deletes() noexcept
+{
+  // Elements are marked deleted and put back one by one, slots of
+  // elements not yet put back are treated as free.
+  const size_type n = capacity();
+  for (size_type i = 0; i < n; ++i)
+    m_ctrl[i] = m_ctrl[i] < 0 ? detail::ctrl_empty : detail::ctrl_deleted;
+
+  for (size_type i = 0; i < n; ++i) {
+    if (m_ctrl[i] != detail::ctrl_deleted)
+      continue;
+    const size_type h = hash(m_key_of(m_slots[i]));
+    const size_type j = find_free(h);
+    if (j / detail::group_size == i / detail::group_size) {
+      set_ctrl(i, h);
+    } else if (m_ctrl[j] == detail::ctrl_empty) {
+      ::new (static_cast<void*>(m_slots + j)) V(std::move(m_slots[i]));
+      m_slots[i].~V();
+      set_ctrl(j, h);
+      m_ctrl[i] = detail::ctrl_empty;
+    } else {
+      // j holds an element yet to be put back, it takes the place of
+      // the one at i, which is visited again.
+      V tmp(std::move(m_slots[j]));
+      m_slots[j].~V();
+      ::new (static_cast<void*>(m_slots + j)) V(std::move(m_slots[i]));
+      m_slots[i].~V();
+      ::new (static_cast<void*>(m_slots + i)) V(std::move(tmp));
+      set_ctrl(j, h);
+      --i;
+    }
+  }
+  m_growth_left = capacity_limit() - m_size;
+}
+
+template <class V, class KO, class H, class E, class A>
+typename flat_hash_table<V, KO, H, E, A>::iterator
+flat_hash_table<V, KO, H, E, A>::erase(const_iterator pos) noexcept
+{
+  const size_type i = pos.m_slot - m_slots;
+  m_slots[i].~V();
+  --m_size;
+  // A probe never goes past a group with an empty slot, so the slot
+  // can become empty again.
+  const size_type g = i / detail::group_size * detail::group_size;
+  if (detail::match_byte(m_ctrl + g, detail::ctrl_empty)) {
+    m_ctrl[i] = detail::ctrl_empty;
+    ++m_growth_left;
+  } else {
+    m_ctrl[i] = detail::ctrl_deleted;
+  }
+  iterator next = make_iter(i);
+  next.skip_free();
+  return next;
+}
+
+template <class V, class KO, class H, class E, class A>
+typename flat_hash_table<V, KO, H, E, A>::size_type
+flat_hash_table<V, KO, H, E, A>::erase(const key_type& key) noexcept
+{
+  const size_type i = find_index(key, hash(key));
+  if (i == npos)
+    return 0;
+
+  erase(make_iter(i));
+  return 1;
+}
+
+template <class V, class KO, class H, class E, class A>
+typename flat_hash_table<V, KO, H, E, A>::iterator
+flat_hash_table<V, KO, H, E, A>::find(const key_type& key) noexcept
+{
+  const size_type i = find_index(key, hash(key));
+  return i == npos ? end() : make_iter(i);
+}
+
+template <class V, class KO, class H, class E, class A>
+void flat_hash_table<V, KO, H, E, A>::clear() noexcept
+{
+  const size_type n = capacity();
+  for (size_type i = 0; i < n; ++i) {
+    if (m_ctrl[i] >= 0)
+      m_slots[i].~V();
+    m_ctrl[i] = detail::ctrl_empty;
+  }
+  m_size = 0;
+  m_growth_left = capacity_limit();
+}
+
+template <class V, class KO, class H, class E, class A>
+void flat_hash_table<V, KO, H, E, A>::reserve(size_type n)
+{
+  if (m_reserved == npos) {
+    if (n > capacity_limit())
+      throw std::bad_alloc();
+    return;
+  }
+
+  m_reserved = std::max(m_reserved, n);
+  if (n > capacity_limit())
+    resize(groups_for(n));
+}
+
+template <class V, class KO, class H, class E, class A>
+void flat_hash_table<V, KO, H, E, A>::release() noexcept
+{
+  clear();
+  if (m_memory)
+    byte_alloc_traits_type::deallocate(m_alloc, m_memory, m_memory_size);
+  reset();
+}
+
+}
+
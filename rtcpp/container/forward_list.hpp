@@ -1,21 +1,36 @@
 #pragma once
 
+#include <vector>
+#include <limits>
 #include <iterator>
 #include <type_traits>
 #include <memory>
+#include <algorithm>
 
 #include <rtcpp/memory/allocator_traits.hpp>
+#include <rtcpp/utility/adopt_nodes.hpp>
+#include <rtcpp/utility/exceptions.hpp>
+#include <rtcpp/algorithm/list_merge_sort.hpp>
 
 /*
   Work in progress.
+
+  With raw pointers the head node lives inside the object. If the
+  allocator links the nodes with pointers that reach only a limited
+  range, like rt::rel_ptr, the head is requested from the allocator as
+  well, so that the whole list is in its buffer and can be handed over
+  to another process mapping it (see release).
 */
 
 namespace rt {
 
 template <class T, class Ptr>
 struct forward_list_node {
+  using value_type = T;
   using self_pointer = typename std::pointer_traits<Ptr>::template
     rebind<forward_list_node<T, Ptr>>;
+  template<class U, class K>
+  struct rebind { using other = forward_list_node<U , K>; };
   T info;
   self_pointer next;
 };
@@ -40,7 +55,7 @@ class flist_iter :
     operator++();
     return tmp;
   }
-  T& operator*() const { return head->info; }
+  T& operator*() const { return chain_value(head); }
   bool operator==(const flist_iter<T, Ptr>& rhs)
   {return head == rhs.head;}
   bool operator!=(const flist_iter<T, Ptr>& rhs)
@@ -69,7 +84,7 @@ class flist_const_iter :
     operator++();
     return tmp;
   }
-  const T& operator*() const { return head->info; }
+  const T& operator*() const { return chain_value(head); }
   bool operator==(const flist_const_iter<T, Ptr>& rhs)
   {return head == rhs.head;}
   bool operator!=(const flist_const_iter<T, Ptr>& rhs)
@@ -99,25 +114,73 @@ class forward_list {
   using iterator = flist_iter<T, node_pointer>;
   using const_iterator = flist_const_iter<T, const_node_pointer>;
   private:
+  static constexpr bool embedded_head = std::is_pointer<void_pointer>::value;
+  using head_type = typename std::conditional< embedded_head
+                                             , node_type, node_pointer>::type;
   inner_alloc_type m_inner_alloc;
-  node_type head; // Not requested from the allocator.
+  head_type m_head;
+  node_pointer head(std::true_type) const noexcept
+  {return const_cast<node_pointer>(&m_head);}
+  node_pointer head(std::false_type) const noexcept {return m_head;}
+  node_pointer head() const noexcept
+  {return head(std::integral_constant<bool, embedded_head>());}
+  void init_head(std::true_type) noexcept {}
+  void init_head(std::false_type)
+  {m_head = inner_alloct_type::allocate_node(m_inner_alloc);}
+  void release_head(std::true_type) noexcept {}
+  void release_head(std::false_type) noexcept
+  {inner_alloct_type::deallocate_node(m_inner_alloc, m_head);}
   node_pointer create_node(const T& data);
   public:
-  forward_list(const Allocator& alloc = Allocator()) noexcept;
-  iterator begin() noexcept {return iterator(head.next);}
-  iterator end() noexcept {return iterator(&head);}
+  // Allocates the head only with relative links.
+  forward_list(const Allocator& alloc = Allocator()) noexcept(embedded_head);
+  // Takes over the list of head, obtained from release on a list with an
+  // equal allocator, possibly in another process. Nothing is allocated.
+  forward_list(adopt_nodes_t, node_type* p, const Allocator& alloc = Allocator()) noexcept
+  : m_inner_alloc(alloc), m_head(p)
+  { static_assert(!embedded_head, "forward_list: The head is not allocated."); }
+  // Gives up the nodes, including the head which is returned, without
+  // releasing them. The list must not be used afterwards except to
+  // destroy it. Only available with relative links.
+  node_type* release() noexcept
+  {
+    static_assert(!embedded_head, "forward_list: The head is not allocated.");
+    node_type* p = head();
+    m_head = 0;
+    return p;
+  }
+  iterator begin() noexcept {return iterator(head()->next);}
+  iterator end() noexcept {return iterator(head());}
   size_type max_size() const noexcept { m_inner_alloc.max_size();}
   const_iterator begin() const noexcept
-  {return const_iterator(head.next);}
-  const_iterator end() const noexcept {return const_iterator(&head);}
+  {return const_iterator(head()->next);}
+  const_iterator end() const noexcept {return const_iterator(head());}
   const_iterator cbegin() const noexcept
-  {return const_iterator(head.next);}
-  const_iterator cend() const noexcept {return const_iterator(&head);}
-  ~forward_list() { clear(); }
-  bool empty() const {return head.next == &head;}
+  {return const_iterator(head()->next);}
+  const_iterator cend() const noexcept {return const_iterator(head());}
+  // The list is circular through the head, so before_begin() and end()
+  // wrap the same node.
+  iterator before_begin() noexcept {return iterator(head());}
+  const_iterator before_begin() const noexcept
+  {return const_iterator(head());}
+  const_iterator cbefore_begin() const noexcept
+  {return const_iterator(head());}
+  ~forward_list()
+  {
+    if (!head())
+      return;
+    clear();
+    release_head(std::integral_constant<bool, embedded_head>());
+  }
+  bool empty() const {return head()->next == head();}
+  allocator_type get_allocator() const {return m_inner_alloc;}
   node_pointer create_node(T&& data);
   void push_front(T&& data);
   void push_front(const T& data);
+  // As push_front but returns false, instead of throwing
+  // std::bad_alloc, when the allocator is exhausted.
+  bool try_push_front(const T& data);
+  bool try_push_front(T&& data);
   void safe_construct(node_pointer p, const T& key);
   void safe_construct(node_pointer p, T&& key);
   void remove_if(T value);
@@ -126,11 +189,78 @@ class forward_list {
   iterator insert_after(const_iterator pos, const T& K);
   iterator insert_after(const_iterator pos, T&& K);
   iterator insert_after(const_iterator pos, size_type n, const T& K);
-  void sort() { insertion_sort(std::less<T>()); }
+  // Stable merge sort, only the links change.
+  void sort() { sort(std::less<T>()); }
+  template <class Compare>
+  void sort(Compare comp)
+  { head()->next = merge_sort_chain(node_pointer(head()->next), head(), comp); }
+  // Moves the nodes of other, sorted as well, into this sorted list.
+  // The allocators must compare equal.
+  void merge(forward_list& other) { merge(other, std::less<T>()); }
+  void merge(forward_list&& other) { merge(other); }
+  template <class Compare>
+  void merge(forward_list& other, Compare comp);
+  template <class Compare>
+  void merge(forward_list&& other, Compare comp) { merge(other, comp); }
+  // Puts the elements, in list order, in the nodes sorted by address,
+  // so that traversals after a sort walk a node_allocator buffer
+  // forward. Values are moved, the nodes stay where they are.
+  void relayout() { head()->next = relayout_chain(node_pointer(head()->next), head()); }
+  // Moves the nodes themselves, so that the list walks the buffer of a
+  // node_allocator forward and the free blocks follow them. The work can
+  // be split in chunks with the compaction object. The buffer must not
+  // be shared, as in for_each_unordered.
+  class compaction;
+  void compact();
   void insertion_sort() { insertion_sort(std::less<T>()); }
   template <class Compare>
   void insertion_sort(Compare comp);
   void clear();
+  // Moves nodes from other after pos, nothing is allocated. The
+  // allocators must compare equal, e.g. share a node_alloc_header.
+  // Moves the elements of other.
+  void splice_after(const_iterator pos, forward_list& other) noexcept
+  { splice_after(pos, other, other.cbefore_begin(), other.cend()); }
+  void splice_after(const_iterator pos, forward_list&& other) noexcept
+  { splice_after(pos, other); }
+  // Moves the element after it.
+  void splice_after( const_iterator pos, forward_list& other
+                   , const_iterator it) noexcept;
+  void splice_after( const_iterator pos, forward_list&& other
+                   , const_iterator it) noexcept
+  { splice_after(pos, other, it); }
+  // Moves the elements in (first, last).
+  void splice_after( const_iterator pos, forward_list& other
+                   , const_iterator first, const_iterator last) noexcept;
+  void splice_after( const_iterator pos, forward_list&& other
+                   , const_iterator first, const_iterator last) noexcept
+  { splice_after(pos, other, first, last); }
+  // Applies f to all elements in no particular order. The nodes have
+  // no tag to tell used blocks from free ones, so the buffer is
+  // scanned only when the header has an occupancy bitmap (see
+  // node_alloc_header::use_bitmap), otherwise the list order is used.
+  // As in rt::set, the buffer must not be shared when it is scanned.
+  template <class F>
+  F for_each_unordered(F f) const
+  {
+    for_each_unordered(f, has_blocks<inner_alloc_type>());
+    return f;
+  }
+  private:
+  template <class F>
+  void for_each_unordered(F& f, std::true_type) const
+  {
+    const auto range = m_inner_alloc.blocks();
+    if (!range.size() || !range.has_bitmap()) {
+      for_each_unordered(f, std::false_type());
+      return;
+    }
+    range.for_each_used([&](const node_type& o)
+    { if (&o != head()) f(o.info); });
+  }
+  template <class F>
+  void for_each_unordered(F& f, std::false_type) const
+  { std::for_each(begin(), end(), f); }
 };
 
 template <typename T, typename Allocator>
@@ -153,38 +283,65 @@ forward_list<T, Allocator>::create_node(T&& data)
 
 template <typename T, typename Allocator>
 forward_list<T, Allocator>::
-forward_list(const Allocator& alloc) noexcept
+forward_list(const Allocator& alloc) noexcept(embedded_head)
 : m_inner_alloc(alloc)
 {
-  head.next = &head;
+  init_head(std::integral_constant<bool, embedded_head>());
+  head()->next = head();
 }
 
 template <typename T, typename Allocator>
 void forward_list<T, Allocator>::push_front(T&& data)
 {
   auto q = create_node(std::forward<T>(data));
-  q->next = head.next;
-  head.next = q;
+  q->next = head()->next;
+  head()->next = q;
 }
 
 template <typename T, typename Allocator>
 void forward_list<T, Allocator>::push_front(const T& data)
 {
   auto q = create_node(data);
-  q->next = head.next;
-  head.next = q;
+  q->next = head()->next;
+  head()->next = q;
+}
+
+template <typename T, typename Allocator>
+bool forward_list<T, Allocator>::try_push_front(const T& data)
+{
+  node_pointer q = inner_alloct_type::try_allocate_node(m_inner_alloc);
+  if (!q)
+    return false;
+
+  safe_construct(q, data);
+  q->next = head()->next;
+  head()->next = q;
+  return true;
+}
+
+template <typename T, typename Allocator>
+bool forward_list<T, Allocator>::try_push_front(T&& data)
+{
+  node_pointer q = inner_alloct_type::try_allocate_node(m_inner_alloc);
+  if (!q)
+    return false;
+
+  safe_construct(q, std::move(data));
+  q->next = head()->next;
+  head()->next = q;
+  return true;
 }
 
 template <typename T, typename Allocator>
 void forward_list<T, Allocator>::safe_construct(node_pointer p,
  const T& key)
 {
-  try {
+  RTCPP_TRY {
     inner_alloct_type::construct(m_inner_alloc,
       std::addressof(p->info), key);
-  } catch (...) {
+  } RTCPP_CATCH_ALL {
     inner_alloct_type::deallocate_node(m_inner_alloc, p);
-    throw;
+    RTCPP_RETHROW
   }
 }
 
@@ -192,30 +349,30 @@ template <typename T, typename Allocator>
 void forward_list<T, Allocator>::safe_construct(
 typename forward_list<T, Allocator>::node_pointer p, T&& key)
 {
-  try {
+  RTCPP_TRY {
     inner_alloct_type::construct(m_inner_alloc,
       std::addressof(p->info), std::forward<T>(key));
-  } catch (...) {
+  } RTCPP_CATCH_ALL {
     inner_alloct_type::deallocate_node(m_inner_alloc, p);
-    throw;
+    RTCPP_RETHROW
   }
 }
 
 template <typename T, typename Allocator>
 void forward_list<T, Allocator>::remove_if(T value)
 {
-  node_pointer* p1 = &head.next;
-  node_pointer p2 = head.next;
-  while (p2 != &head) {
+  node_pointer p1 = head();
+  node_pointer p2 = head()->next;
+  while (p2 != head()) {
     if (p2->info == value) {
       node_pointer tmp = p2->next;
       inner_alloct_type::destroy(m_inner_alloc, p2);
       inner_alloct_type::deallocate_node(m_inner_alloc, p2);
       p2 = tmp;
-      *p1 = p2;
+      p1->next = p2;
       continue;
     }
-    p1 = &p2->next;
+    p1 = p2;
     p2 = p2->next;
   }
 }
@@ -223,22 +380,22 @@ void forward_list<T, Allocator>::remove_if(T value)
 template <typename T, typename Allocator>
 void forward_list<T, Allocator>::reverse()
 {
-  node_pointer prev = &head;
-  while (head.next != &head) {
-    node_pointer middle = head.next;
-    head.next = middle->next;
+  node_pointer prev = head();
+  while (head()->next != head()) {
+    node_pointer middle = head()->next;
+    head()->next = middle->next;
     middle->next = prev;
     prev = middle;
   }
-  head.next = prev;
+  head()->next = prev;
 }
 
 template <typename T, typename Allocator>
 void forward_list<T, Allocator>::sorted_insertion(const T& K)
 {
-  node_pointer p = head.next;
-  node_pointer q = &head;
-  while (p != &head) {
+  node_pointer p = head()->next;
+  node_pointer q = head();
+  while (p != head()) {
     if (K < p->info) {
       insert_after(const_iterator(q), K);
       break;
@@ -247,7 +404,7 @@ void forward_list<T, Allocator>::sorted_insertion(const T& K)
     p = q->next;
   }
 
-  if (p == &head)
+  if (p == head())
     insert_after(const_iterator(q), K);
 }
 
@@ -257,7 +414,7 @@ forward_list<T, Allocator>::insert_after(
   typename forward_list<T, Allocator>::const_iterator pos, const T& K)
 {
   auto q = const_cast<node_pointer>(pos.get_internal_ptr());
-  auto p = q->next;
+  node_pointer p = q->next;
   auto u = create_node(K);
   q->next = u;
   u->next = p;
@@ -270,7 +427,7 @@ forward_list<T, Allocator>::insert_after(
  typename forward_list<T, Allocator>::const_iterator pos, T&& K)
 {
   auto q = const_cast<node_pointer>(pos.get_internal_ptr());
-  auto p = q->next;
+  node_pointer p = q->next;
   auto u = create_node(std::forward<T>(K));
   q->next = u;
   u->next = p;
@@ -294,11 +451,11 @@ template <typename T, typename Allocator>
 template <class Compare>
 void forward_list<T, Allocator>::insertion_sort(Compare comp)
 {
-  node_pointer a = head.next;
+  node_pointer a = head()->next;
   node_pointer b = a->next;
-  while (b != &head) {
-    node_pointer p = head.next;
-    node_pointer q = &head;
+  while (b != head()) {
+    node_pointer p = head()->next;
+    node_pointer q = head();
     while (p != b) {
       if (comp(b->info, p->info)) {
         q->next = b;
@@ -315,16 +472,289 @@ void forward_list<T, Allocator>::insertion_sort(Compare comp)
   }
 }
 
+template <typename T, typename Allocator>
+void forward_list<T, Allocator>::splice_after(
+  const_iterator pos, forward_list& other, const_iterator it) noexcept
+{
+  auto q = const_cast<node_pointer>(it.get_internal_ptr());
+  auto p = const_cast<node_pointer>(pos.get_internal_ptr());
+  if (p == q || p == q->next || q->next == other.head())
+    return;
+
+  splice_after(pos, other, it, const_iterator(q->next->next));
+}
+
+template <typename T, typename Allocator>
+void forward_list<T, Allocator>::splice_after(
+  const_iterator pos, forward_list&, const_iterator first
+  , const_iterator last) noexcept
+{
+  auto p = const_cast<node_pointer>(pos.get_internal_ptr());
+  auto f = const_cast<node_pointer>(first.get_internal_ptr());
+  auto l = const_cast<node_pointer>(last.get_internal_ptr());
+  if (f->next == l)
+    return;
+
+  node_pointer a = f->next;
+  node_pointer b = a;
+  while (b->next != l)
+    b = b->next;
+
+  f->next = l;
+  b->next = p->next;
+  p->next = a;
+}
+
+template <typename T, typename Allocator>
+template <class Compare>
+void forward_list<T, Allocator>::merge(forward_list& other, Compare comp)
+{
+  if (this == &other)
+    return;
+
+  node_pointer p = head();
+  node_pointer b = other.head()->next;
+  while (b != other.head()) {
+    while (p->next != head() && !comp(b->info, p->next->info))
+      p = p->next;
+
+    if (p->next == head()) { // The rest of other goes at the end.
+      p->next = b;
+      while (b->next != other.head())
+        b = b->next;
+      b->next = head();
+      break;
+    }
+
+    node_pointer next = b->next;
+    b->next = p->next;
+    p->next = b;
+    p = b;
+    b = next;
+  }
+  other.head()->next = other.head();
+}
+
 template <typename T, typename Allocator>
 void forward_list<T, Allocator>::clear()
 {
-  while (head.next != &head) {
-    auto p = head.next;
-    head.next = p->next;
+  while (head()->next != head()) {
+    node_pointer p = head()->next;
+    head()->next = p->next;
     inner_alloct_type::destroy(m_inner_alloc, p);
     inner_alloct_type::deallocate_node(m_inner_alloc, p);
   }
 }
 
+/*
+  Incremental defragmentation of a list in the buffer of a
+  node_allocator, done in the same steps as set::compaction. The nodes
+  have no tag and no way back to their predecessor, so the predecessor
+  of each block, null for the free ones, is kept in a table that fills
+  while the list is walked, one node per unit, before the free blocks
+  are taken. The table is the only allocation and is made by the
+  constructor. A head allocated with the nodes is moved to block 0.
+*/
+template <typename T, typename Allocator>
+class forward_list<T, Allocator>::compaction {
+  static_assert( has_blocks<inner_alloc_type>::value
+               , "forward_list: Compaction requires a node_allocator.");
+  static_assert( std::is_nothrow_move_constructible<T>::value
+               , "forward_list: Compaction moves the values.");
+  private:
+  enum class phase {scan, drain, place, give_back, done};
+  forward_list& m_list;
+  char* m_first; // Block 0.
+  std::size_t m_stride;
+  size_type m_n_blocks;
+  std::vector<node_pointer> m_prev;
+  phase m_phase;
+  size_type m_i; // Blocks drained, placed, or left to give back.
+  size_type m_n_live;
+  size_type m_n_kept;
+  node_pointer m_next; // Last node scanned or next node to place.
+  node_pointer m_spare;
+  node_pointer block(size_type i) const noexcept
+  { return reinterpret_cast<node_pointer>(m_first + i * m_stride); }
+  size_type index(node_pointer p) const noexcept
+  { return (reinterpret_cast<char*>(p) - m_first) / m_stride; }
+  // False only for a head inside the list object.
+  bool in_buffer(node_pointer p) const noexcept
+  {
+    const char* c = reinterpret_cast<const char*>(p);
+    return c >= m_first && c < m_first + m_n_blocks * m_stride;
+  }
+  void set_head(node_pointer, std::true_type) noexcept {}
+  void set_head(node_pointer p, std::false_type) noexcept {m_list.m_head = p;}
+  void relocate(node_pointer p, node_pointer to) noexcept;
+  void scan_one() noexcept;
+  void drain_one();
+  void place_one() noexcept;
+  void give_back_one();
+  void give_back(size_type kept) noexcept
+  {
+    m_n_kept = kept;
+    m_i = m_n_blocks;
+    m_phase = kept == m_n_blocks ? phase::done : phase::give_back;
+  }
+  public:
+  explicit compaction(forward_list& l);
+  ~compaction();
+  compaction(const compaction&) = delete;
+  compaction& operator=(const compaction&) = delete;
+  // Does at most budget units of work. Returns true when done.
+  bool step(std::size_t budget);
+  bool done() const noexcept { return m_phase == phase::done; }
+};
+
+template <typename T, typename Allocator>
+forward_list<T, Allocator>::compaction::compaction(forward_list& l)
+: m_list(l)
+, m_first(0)
+, m_stride(0)
+, m_n_blocks(0)
+, m_phase(phase::done)
+, m_i(0)
+, m_n_live(0)
+, m_n_kept(0)
+, m_next(l.head())
+, m_spare(0)
+{
+  const auto range = l.m_inner_alloc.blocks();
+  if (!range.size())
+    return;
+
+  m_first = reinterpret_cast<char*>(&*range.begin());
+  m_stride = range.stride();
+  m_n_blocks = range.size();
+  m_prev.resize(m_n_blocks);
+  m_phase = phase::scan;
+}
+
+template <typename T, typename Allocator>
+forward_list<T, Allocator>::compaction::~compaction()
+{
+  if (m_phase == phase::scan || m_phase == phase::done)
+    return;
+
+  while (m_phase == phase::drain)
+    drain_one();
+
+  if (m_phase == phase::place)
+    give_back(0);
+  while (m_phase == phase::give_back)
+    give_back_one();
+}
+
+template <typename T, typename Allocator>
+bool forward_list<T, Allocator>::compaction::step(std::size_t budget)
+{
+  for (; budget && m_phase != phase::done; --budget) {
+    switch (m_phase) {
+      case phase::scan: scan_one(); break;
+      case phase::drain: drain_one(); break;
+      case phase::place: place_one(); break;
+      case phase::give_back: give_back_one(); break;
+      case phase::done: break;
+    }
+  }
+  return m_phase == phase::done;
+}
+
+template <typename T, typename Allocator>
+void forward_list<T, Allocator>::compaction::scan_one() noexcept
+{
+  const node_pointer q = m_next->next;
+  if (in_buffer(q)) {
+    m_prev[index(q)] = m_next;
+    ++m_n_live;
+  }
+  m_next = q;
+  if (q != m_list.head())
+    return;
+
+  m_i = 0;
+  m_phase = m_n_live == m_n_blocks ? phase::done : phase::drain;
+}
+
+template <typename T, typename Allocator>
+void forward_list<T, Allocator>::compaction::drain_one()
+{
+  m_spare = inner_alloct_type::allocate_node(m_list.m_inner_alloc);
+  if (++m_i != m_n_blocks - m_n_live)
+    return;
+
+  m_i = 0;
+  m_next = in_buffer(m_list.head()) ? m_list.head() : node_pointer(m_list.head()->next);
+  if (m_next == m_list.head() && !in_buffer(m_next))
+    give_back(0); // Empty.
+  else
+    m_phase = phase::place;
+}
+
+template <typename T, typename Allocator>
+void forward_list<T, Allocator>::compaction::place_one() noexcept
+{
+  const node_pointer b = block(m_i);
+  const node_pointer p = m_next;
+  if (p != b) {
+    if (m_prev[m_i])
+      relocate(b, m_spare);
+    relocate(p, b);
+    m_spare = p; // Left free in any case.
+  }
+
+  m_next = b->next;
+  if (++m_i == m_n_blocks || m_next == m_list.head())
+    give_back(m_i);
+}
+
+template <typename T, typename Allocator>
+void forward_list<T, Allocator>::compaction::give_back_one()
+{
+  const node_pointer b = block(--m_i);
+  if (!m_prev[m_i])
+    inner_alloct_type::deallocate_node(m_list.m_inner_alloc, b);
+  if (m_i == m_n_kept)
+    m_phase = phase::done;
 }
 
+template <typename T, typename Allocator>
+void forward_list<T, Allocator>::compaction::relocate(
+  node_pointer p, node_pointer to) noexcept
+{
+  const size_type i = index(p);
+  const bool is_head = p == m_list.head();
+  node_pointer pred = m_prev[i];
+  if (pred == p) { // The allocated head of an empty list.
+    to->next = to;
+    pred = to;
+  } else {
+    to->next = p->next;
+    pred->next = to;
+  }
+
+  // The head holds no value.
+  if (!is_head) {
+    inner_alloct_type::construct( m_list.m_inner_alloc, std::addressof(to->info)
+                                , std::move(p->info));
+    inner_alloct_type::destroy(m_list.m_inner_alloc, std::addressof(p->info));
+  }
+
+  m_prev[index(to)] = pred;
+  m_prev[i] = 0;
+  const node_pointer s = to->next;
+  if (s != to && in_buffer(s))
+    m_prev[index(s)] = to;
+  if (is_head)
+    set_head(to, std::integral_constant<bool, embedded_head>());
+}
+
+template <typename T, typename Allocator>
+void forward_list<T, Allocator>::compact()
+{
+  compaction c(*this);
+  while (!c.step(std::numeric_limits<std::size_t>::max()));
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <functional>
+
+#include "forward_list.hpp"
+
+/*
+  A singly linked list of objects it neither copies nor owns. T derives
+  from rt::slist_hook<T>, which holds the next link, so the list and the
+  chain algorithms of list_merge_sort.hpp run on the objects themselves
+  and nothing is allocated. Tag tells the hooks apart when an object is
+  in several lists at a time. As in forward_list the list is circular
+  through a head inside the object, which therefore cannot be moved.
+*/
+
+namespace rt {
+
+template <class T, class Tag = void>
+struct slist_hook {
+  slist_hook* next;
+};
+
+// The value of a hook is the object deriving from it.
+template <class T, class Tag>
+T& chain_value(slist_hook<T, Tag>* p) noexcept
+{ return static_cast<T&>(*p); }
+
+template <class T, class Tag>
+const T& chain_value(const slist_hook<T, Tag>* p) noexcept
+{ return static_cast<const T&>(*p); }
+
+template <class T, class Tag = void>
+class intrusive_forward_list {
+  public:
+  using value_type = T;
+  using reference = T&;
+  using const_reference = const T&;
+  using hook_type = slist_hook<T, Tag>;
+  private:
+  using hook_pointer = hook_type*;
+  public:
+  using iterator = flist_iter<T, hook_pointer>;
+  using const_iterator = flist_const_iter<T, const hook_type*>;
+  private:
+  hook_type m_head;
+  hook_pointer head() const noexcept
+  { return const_cast<hook_pointer>(&m_head); }
+  static hook_pointer hook(T& v) noexcept
+  { return &static_cast<hook_type&>(v); }
+  static hook_pointer ptr(const_iterator pos) noexcept
+  { return const_cast<hook_pointer>(pos.get_internal_ptr()); }
+  public:
+  intrusive_forward_list() noexcept { m_head.next = head(); }
+  intrusive_forward_list(const intrusive_forward_list&) = delete;
+  intrusive_forward_list& operator=(const intrusive_forward_list&) = delete;
+  bool empty() const noexcept { return m_head.next == head(); }
+  iterator begin() noexcept { return iterator(m_head.next); }
+  iterator end() noexcept { return iterator(head()); }
+  const_iterator begin() const noexcept { return const_iterator(m_head.next); }
+  const_iterator end() const noexcept { return const_iterator(head()); }
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+  iterator before_begin() noexcept { return iterator(head()); }
+  const_iterator cbefore_begin() const noexcept { return const_iterator(head()); }
+  T& front() noexcept { return chain_value(m_head.next); }
+  void push_front(T& v) noexcept { insert_after(cbefore_begin(), v); }
+  void pop_front() noexcept { erase_after(cbefore_begin()); }
+  iterator insert_after(const_iterator pos, T& v) noexcept
+  {
+    const hook_pointer p = ptr(pos);
+    const hook_pointer q = hook(v);
+    q->next = p->next;
+    p->next = q;
+    return iterator(q);
+  }
+  // Unlinks the object after pos, returns the one after it.
+  iterator erase_after(const_iterator pos) noexcept
+  {
+    const hook_pointer p = ptr(pos);
+    p->next = p->next->next;
+    return iterator(p->next);
+  }
+  // Forgets all objects at once.
+  void clear() noexcept { m_head.next = head(); }
+  // The position of an object in the list, without searching.
+  iterator iterator_to(T& v) noexcept { return iterator(hook(v)); }
+  void reverse() noexcept;
+  // Stable merge sort, only the links change.
+  void sort() { sort(std::less<T>()); }
+  template <class Compare>
+  void sort(Compare comp)
+  { m_head.next = merge_sort_chain(m_head.next, head(), comp); }
+};
+
+template <class T, class Tag>
+void intrusive_forward_list<T, Tag>::reverse() noexcept
+{
+  hook_pointer prev = head();
+  hook_pointer p = m_head.next;
+  while (p != head()) {
+    const hook_pointer next = p->next;
+    p->next = prev;
+    prev = p;
+    p = next;
+  }
+  m_head.next = prev;
+}
+
+}
+
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <utility>
+#include <cstddef>
+#include <functional>
+
+#include "set.hpp"
+
+/*
+  A set of objects it neither copies nor owns. T derives from
+  rt::set_hook<T>, which holds the links and the tag of a tbst node, and
+  the algorithms of tbst.hpp and the balancing policies run on the hooks
+  directly: inserting or erasing allocates nothing and the traversal
+  reaches the objects without going through a wrapper node. The keys are
+  the objects themselves, Compare compares T. Tag tells the hooks apart
+  when an object derives from several, to be in several sets at a time.
+
+  An object is in at most one set per hook and must outlive its stay
+  there. The head lives in the set, so elements thread back to it and
+  moving a set fixes those two links. Destroying or clearing a set
+  leaves the hooks as they are, they are initialized when inserted.
+*/
+
+namespace rt {
+
+template <class T, class Tag = void>
+struct set_hook {
+  set_hook* link[2];
+  unsigned char tag;
+};
+
+// The key of a hook is the object deriving from it.
+template <class T, class Tag>
+T& key_of(set_hook<T, Tag>* p) noexcept
+{ return static_cast<T&>(*p); }
+
+template <class T, class Tag>
+const T& key_of(const set_hook<T, Tag>* p) noexcept
+{ return static_cast<const T&>(*p); }
+
+template < class T
+         , class Compare = std::less<T>
+         , class Tag = void
+         , class Balance = tbst::no_balance>
+class intrusive_set {
+  public:
+  using key_type = T;
+  using value_type = T;
+  using size_type = std::size_t;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using hook_type = set_hook<T, Tag>;
+  private:
+  using hook_pointer = hook_type*;
+  public:
+  using iterator = bst_iterator<T, hook_pointer>;
+  using const_iterator = iterator;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  private:
+  hook_type m_head;
+  size_type m_size;
+  Compare m_comp;
+  hook_pointer head() const noexcept
+  { return const_cast<hook_pointer>(&m_head); }
+  static hook_pointer hook(T& v) noexcept
+  { return &static_cast<hook_type&>(v); }
+  void reset() noexcept;
+  public:
+  explicit intrusive_set(const Compare& comp = Compare()) noexcept
+  : m_size(0), m_comp(comp) { reset(); }
+  intrusive_set(const intrusive_set&) = delete;
+  intrusive_set& operator=(const intrusive_set&) = delete;
+  intrusive_set(intrusive_set&& rhs) noexcept;
+  // Links v unless an equivalent object is already there, which is
+  // returned instead.
+  std::pair<iterator, bool> insert(T& v) noexcept;
+  // As set::emplace_hint, no search if v goes right before hint.
+  iterator insert(const_iterator hint, T& v) noexcept;
+  // Unlinks the object, returns the one after it.
+  iterator erase(const_iterator pos) noexcept;
+  template <class K>
+  size_type erase(const K& key) noexcept;
+  // Forgets all objects at once.
+  void clear() noexcept
+  {
+    reset();
+    m_size = 0;
+  }
+  // The position of an object in the set, without searching.
+  iterator iterator_to(T& v) const noexcept { return iterator(hook(v)); }
+  const_iterator begin() const noexcept
+  { return const_iterator(tbst::inorder<1>(head())); }
+  const_iterator end() const noexcept { return const_iterator(head()); }
+  const_reverse_iterator rbegin() const noexcept
+  { return const_reverse_iterator(end()); }
+  const_reverse_iterator rend() const noexcept
+  { return const_reverse_iterator(begin()); }
+  size_type size() const noexcept { return m_size; }
+  bool empty() const noexcept { return m_size == 0; }
+  key_compare key_comp() const noexcept { return m_comp; }
+  template <class K>
+  iterator find(const K& key) const
+  { return iterator(tbst::find_with_parent(head(), key, m_comp).first); }
+  template <class K>
+  size_type count(const K& key) const { return find(key) != end(); }
+  template <class K>
+  iterator lower_bound(const K& key) const
+  { return iterator(tbst::lower_bound(head(), key, m_comp)); }
+  template <class K>
+  iterator upper_bound(const K& key) const
+  { return iterator(tbst::upper_bound(head(), key, m_comp)); }
+};
+
+template <class T, class C, class Tag, class B>
+void intrusive_set<T, C, Tag, B>::reset() noexcept
+{
+  m_head.link[0] = head();
+  m_head.link[1] = head();
+  m_head.tag = tbst::detail::lbit;
+}
+
+template <class T, class C, class Tag, class B>
+intrusive_set<T, C, Tag, B>::intrusive_set(intrusive_set&& rhs) noexcept
+: m_head(rhs.m_head)
+, m_size(rhs.m_size)
+, m_comp(std::move(rhs.m_comp))
+{
+  if (rhs.empty()) {
+    reset();
+    return;
+  }
+
+  // Only the extreme elements thread to the head.
+  m_head.link[1] = head();
+  tbst::inorder<1>(head())->link[0] = head();
+  tbst::inorder<0>(head())->link[1] = head();
+  rhs.clear();
+}
+
+template <class T, class C, class Tag, class B>
+std::pair<typename intrusive_set<T, C, Tag, B>::iterator, bool>
+intrusive_set<T, C, Tag, B>::insert(T& v) noexcept
+{
+  const hook_pointer q = hook(v);
+  q->tag = 0;
+  auto make_node = [q](const T&) { return q; };
+  auto pair = B::insert(head(), v, m_comp, make_node);
+  m_size += pair.second;
+  return std::make_pair(iterator(pair.first), pair.second);
+}
+
+template <class T, class C, class Tag, class B>
+typename intrusive_set<T, C, Tag, B>::iterator
+intrusive_set<T, C, Tag, B>::insert(const_iterator hint, T& v) noexcept
+{
+  const hook_pointer q = hook(v);
+  q->tag = 0;
+  auto pair = B::insert_hint(head(), hint.m_p, q, m_comp);
+  m_size += pair.second;
+  return iterator(pair.first);
+}
+
+template <class T, class C, class Tag, class B>
+typename intrusive_set<T, C, Tag, B>::iterator
+intrusive_set<T, C, Tag, B>::erase(const_iterator pos) noexcept
+{
+  const hook_pointer next = tbst::inorder<1>(pos.m_p);
+  B::unlink(head(), pos.m_p, m_comp);
+  --m_size;
+  return iterator(next);
+}
+
+template <class T, class C, class Tag, class B>
+template <class K>
+typename intrusive_set<T, C, Tag, B>::size_type
+intrusive_set<T, C, Tag, B>::erase(const K& key) noexcept
+{
+  if (B::erase(head(), key, m_comp) == head())
+    return 0;
+
+  --m_size;
+  return 1;
+}
+
+}
+
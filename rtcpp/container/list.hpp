@@ -2,74 +2,154 @@
 
 #include <memory>
 #include <utility>
+#include <iostream>
+#include <type_traits>
+
+#include <rtcpp/memory/allocator_traits.hpp>
+#include <rtcpp/algorithm/list_merge_sort.hpp>
+
+/*
+  A circular doubly linked list. The nodes are requested one at a time
+  from the allocator (see allocator_traits::allocate_node), so the list
+  can live in the buffer of a node_allocator. The head node lives inside
+  the object, as in forward_list with raw pointers.
+*/
 
 namespace rt
 {
 
-template <class T>
+template <class T, class Ptr>
 struct list_node {
-  using pointer = list_node*;
-  pointer next;
-  pointer prev;
+  using value_type = T;
+  using self_pointer = typename std::pointer_traits<Ptr>::template
+    rebind<list_node<T, Ptr>>;
+  template<class U, class K>
+  struct rebind { using other = list_node<U , K>; };
+  self_pointer next;
+  self_pointer prev;
   T info;
-  list_node() : next(nullptr), prev(nullptr), info() {}
 };
 
 template <class T, class Allocator = std::allocator<T>>
 class list {
+  public:
+  using value_type = T;
+  using allocator_type = Allocator;
+  using alloct_type = rt::allocator_traits<Allocator>;
+  using void_pointer = typename alloct_type::void_pointer;
+  static_assert( std::is_pointer<void_pointer>::value
+               , "list: The allocator must use raw pointers.");
+  using node_type = list_node<T, void_pointer>;
+  private:
+  using inner_alloc_type =
+    typename alloct_type::template rebind_alloc<node_type>;
+  using inner_alloct_type = typename
+    rt::allocator_traits<inner_alloc_type>;
+  public:
+  using node_pointer = typename inner_alloct_type::pointer;
   private:
-  using node_type = list_node<T>;
-  using node_pointer = node_type*;
-  node_type head;
+  inner_alloc_type m_inner_alloc;
+  node_type head; // Not requested from the allocator.
+  template <class... Args>
+  node_pointer create_node(Args&&... args);
+  // Sets the prev links after next links were changed.
+  void link_prev() noexcept;
   public:
-  list();
-  node_pointer get_node() {return new node_type;}
-  void insert(node_pointer pos, node_pointer p, const T& value);
+  list(const Allocator& alloc = Allocator()) noexcept;
+  list(const list&) = delete;
+  list& operator=(const list&) = delete;
+  ~list() { clear(); }
+  bool empty() const noexcept {return head.next == &head;}
+  // Links the node p before pos.
+  void insert(node_pointer pos, node_pointer p) noexcept;
   void push_front(const T& v);
   void push_back(const T& v);
+  // Unlinks p and gives it back to the allocator.
+  void erase(node_pointer p) noexcept;
+  void clear() noexcept;
   void print() const;
-  void reverse();
-  void move_behind(node_pointer p, node_pointer q);
-  void swap_nodes(node_pointer p, node_pointer q);
-  void sort();
-  node_pointer begin() {return head.next;}
-  node_pointer end() {return &head;}
+  void reverse() noexcept;
+  void move_behind(node_pointer p, node_pointer q) noexcept;
+  void swap_nodes(node_pointer p, node_pointer q) noexcept;
+  // Stable merge sort, only the links change.
+  void sort() { sort(std::less<T>()); }
+  template <class Compare>
+  void sort(Compare comp);
+  void insertion_sort() noexcept;
+  // Moves the nodes of other, sorted as well, into this sorted list.
+  // The allocators must compare equal.
+  void merge(list& other) { merge(other, std::less<T>()); }
+  template <class Compare>
+  void merge(list& other, Compare comp);
+  // See forward_list::relayout.
+  void relayout();
+  node_pointer begin() noexcept {return head.next;}
+  node_pointer end() noexcept {return &head;}
+  allocator_type get_allocator() const {return m_inner_alloc;}
 };
 
 template <class T, class A>
-list<T, A>::list()
+list<T, A>::list(const A& alloc) noexcept
+: m_inner_alloc(alloc)
 {
   head.next = &head;
   head.prev = &head;
 }
 
 template <class T, class A>
-void list<T, A>::insert(node_pointer pos, node_pointer p,
-  const T& value)
+template <class... Args>
+typename list<T, A>::node_pointer list<T, A>::create_node(Args&&... args)
+{
+  node_pointer p = inner_alloct_type::allocate_node(m_inner_alloc);
+  try {
+    inner_alloct_type::construct( m_inner_alloc, std::addressof(p->info)
+                                , std::forward<Args>(args)...);
+  } catch (...) {
+    inner_alloct_type::deallocate_node(m_inner_alloc, p);
+    throw;
+  }
+  return p;
+}
+
+template <class T, class A>
+void list<T, A>::insert(node_pointer pos, node_pointer p) noexcept
 {
   p->prev = pos->prev;
   pos->prev = p;
   p->next = pos;
   p->prev->next = p;
 }
+
 template <class T, class A>
 void list<T, A>::push_front(const T& v)
 {
-  auto p = get_node();
-  p->info = v;
-  insert(head.next, p, v);
+  insert(head.next, create_node(v));
 }
 
 template <class T, class A>
 void list<T, A>::push_back(const T& v)
 {
-  auto p = get_node();
-  p->info = v;
-  insert(&head, p, v);
+  insert(&head, create_node(v));
+}
+
+template <class T, class A>
+void list<T, A>::erase(node_pointer p) noexcept
+{
+  p->prev->next = p->next;
+  p->next->prev = p->prev;
+  inner_alloct_type::destroy(m_inner_alloc, std::addressof(p->info));
+  inner_alloct_type::deallocate_node(m_inner_alloc, p);
+}
+
+template <class T, class A>
+void list<T, A>::clear() noexcept
+{
+  while (head.next != &head)
+    erase(head.next);
 }
 
 template <class T, class A>
-void list<T, A>::reverse()
+void list<T, A>::reverse() noexcept
 {
   node_pointer p = &head;
   do {
@@ -89,7 +169,7 @@ void list<T, A>::print() const
 }
 
 template <class T, class A>
-void list<T, A>::swap_nodes(node_pointer q, node_pointer p)
+void list<T, A>::swap_nodes(node_pointer q, node_pointer p) noexcept
 {
 
   if (q->next == p) {
@@ -113,7 +193,7 @@ void list<T, A>::swap_nodes(node_pointer q, node_pointer p)
 }
 
 template <class T, class A>
-void list<T, A>::move_behind(node_pointer q, node_pointer p)
+void list<T, A>::move_behind(node_pointer q, node_pointer p) noexcept
 {
   q->prev->next = p;
   p->next->prev = p->prev;
@@ -124,7 +204,49 @@ void list<T, A>::move_behind(node_pointer q, node_pointer p)
 }
 
 template <class T, class A>
-void list<T, A>::sort()
+void list<T, A>::link_prev() noexcept
+{
+  node_pointer prev = &head;
+  for (node_pointer p = head.next; p != &head; p = p->next) {
+    p->prev = prev;
+    prev = p;
+  }
+  head.prev = prev;
+}
+
+template <class T, class A>
+template <class Compare>
+void list<T, A>::sort(Compare comp)
+{
+  head.next = merge_sort_chain(head.next, &head, comp);
+  link_prev();
+}
+
+template <class T, class A>
+template <class Compare>
+void list<T, A>::merge(list& other, Compare comp)
+{
+  if (this == &other || other.empty())
+    return;
+
+  // Both chains end at head once other is detached from its own.
+  other.head.prev->next = &head;
+  node_pointer b = other.head.next;
+  other.head.next = &other.head;
+  other.head.prev = &other.head;
+  head.next = merge_chains(head.next, b, &head, comp);
+  link_prev();
+}
+
+template <class T, class A>
+void list<T, A>::relayout()
+{
+  head.next = relayout_chain(head.next, &head);
+  link_prev();
+}
+
+template <class T, class A>
+void list<T, A>::insertion_sort() noexcept
 {
   node_pointer p = head.next->next;
   while (p != &head) {
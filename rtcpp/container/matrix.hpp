@@ -1,23 +1,91 @@
 #pragma once
 
-#include <array>
 #include <cmath>
+#include <memory>
+#include <utility>
+#include <cstddef>
 #include <numeric>
 #include <iostream>
 #include <algorithm>
+#include <stdexcept>
+#include <type_traits>
 #include <initializer_list>
 
+#include <rtcpp/utility/simd.hpp>
+#include <rtcpp/utility/exceptions.hpp>
 #include <rtcpp/algorithm/snorm.hpp>
 
+/*
+  Products of two matrices, sums and differences of two matrices and
+  scaled matrices of float or double, with rows of 2 to 4 elements,
+  are evaluated with simd_row (utility/simd.hpp) when assigned to a
+  matrix: a product row as a sum of rows of the right matrix scaled by
+  the elements of the left row, a matrix times vector product as dot
+  products of rows. Operands of products that contain products are
+  evaluated into a matrix first (see prod_operand). Other expressions
+  are evaluated element by element through operator()(i, j).
+
+  Matrices of float or double whose size is a multiple of 16 bytes are
+  aligned to 16 bytes.
+
+  transpose(e) is an expression too, evaluated when assigned.
+
+  Construction, element access, sums, differences, scalings, products
+  and transposes are constexpr, so that constant matrices are computed
+  by the compiler; in constant expressions the elements are evaluated
+  one by one through operator()(i, j).
+
+  Expressions may mix matrices with dmatrix (dmatrix.hpp), whose rows
+  and cols are dynamic_size. Sizes known at compile time are checked
+  at compile time, the others when the expression is built, mismatches
+  throwing std::runtime_error.
+*/
+
 namespace rt {
 
-inline
+constexpr
 std::size_t row_major_idx(std::size_t i, std::size_t j,
   std::size_t n_cols) { return i * n_cols + j; }
 
 template <typename Derived>
 struct matrix_traits;
 
+// Number of rows or columns known at run time only.
+const std::size_t dynamic_size = 0;
+
+template <typename T, typename Allocator = std::allocator<T> >
+class dmatrix;
+
+namespace detail {
+
+// The size of an expression of operands of sizes a and b, which must
+// be equal unless dynamic.
+constexpr std::size_t static_dim(std::size_t a, std::size_t b)
+{ return a == dynamic_size ? b : a; }
+
+constexpr bool compatible_dims(std::size_t a, std::size_t b)
+{ return a == dynamic_size || b == dynamic_size || a == b; }
+
+// Run time check of sizes that are dynamic, the others are checked at
+// compile time.
+constexpr void check_dims(std::size_t a, std::size_t b, const char* msg)
+{
+  if (a != b)
+    throw_exception(std::runtime_error(msg));
+}
+
+// Writes the value of an expression into a row major buffer.
+template <typename E>
+struct matrix_eval;
+
+template <typename T, std::size_t S>
+struct matrix_align {
+  static constexpr std::size_t value =
+    std::is_floating_point<T>::value && S * sizeof (T) % 16 == 0 ? 16 : alignof(T);
+};
+
+}
+
 template <typename E>
 class matrix_expr {
   public:
@@ -25,10 +93,12 @@ class matrix_expr {
   using size_type = typename matrix_traits<E>::size_type;
   static constexpr std::size_t rows = matrix_traits<E>::rows;
   static constexpr std::size_t cols = matrix_traits<E>::cols;
-  value_type operator()(size_type i, size_type j) const
+  constexpr value_type operator()(size_type i, size_type j) const
   {return static_cast<const E&>(*this)(i, j);}
-  operator E&() {return static_cast<E&>(*this);}
-  operator const E&() const {return static_cast<const E&>(*this);}
+  constexpr size_type n_rows() const {return static_cast<const E&>(*this).n_rows();}
+  constexpr size_type n_cols() const {return static_cast<const E&>(*this).n_cols();}
+  constexpr operator E&() {return static_cast<E&>(*this);}
+  constexpr operator const E&() const {return static_cast<const E&>(*this);}
 };
 
 template <typename T, std::size_t M, std::size_t N>
@@ -38,33 +108,44 @@ public:
   static constexpr std::size_t cols = N;
   static constexpr std::size_t data_size = rows * cols;
 private:
-  using data_type = std::array<T, rows * cols>;
+  using traits_type = matrix_traits<matrix<T, M, N> >;
 public:
-  using value_type = typename data_type::value_type;
-  using size_type = typename data_type::size_type;
-  using iterator = typename data_type::iterator;
-  using const_iterator = typename data_type::const_iterator;
-  using reference = typename data_type::reference;
-  using const_reference = typename data_type::const_reference;
+  using value_type = typename traits_type::value_type;
+  using size_type = typename traits_type::size_type;
+  using iterator = typename traits_type::iterator;
+  using const_iterator = typename traits_type::const_iterator;
+  using reference = typename traits_type::reference;
+  using const_reference = typename traits_type::const_reference;
 private:
-  data_type m_data;
+  // A built-in array, whose elements are written by constexpr code in
+  // C++14 too.
+  alignas(detail::matrix_align<T, M * N>::value) T m_data[data_size];
+  // The elements of mat in constant expressions, else zero, which
+  // the compiler drops as they are overwritten, unlike a memset.
+  template <typename E, std::size_t... I>
+  constexpr matrix(const E& mat, std::index_sequence<I...>)
+  : m_data{(detail::is_constant_evaluated() ? mat(I / N, I % N) : T())...} {}
 public:
   constexpr matrix() : m_data() {}
-  explicit matrix(const T& val) { fill(val);};
-  reference operator[](size_type i) {return m_data[i];}
-  const_reference operator[](size_type i) const {return m_data[i];}
-  value_type operator()(size_type i, size_type j) const
+  constexpr explicit matrix(const T& val) : m_data() { fill(val);};
+  constexpr reference operator[](size_type i) {return m_data[i];}
+  constexpr const_reference operator[](size_type i) const {return m_data[i];}
+  constexpr T* data() noexcept {return m_data;}
+  constexpr const T* data() const noexcept {return m_data;}
+  constexpr size_type n_rows() const noexcept {return M;}
+  constexpr size_type n_cols() const noexcept {return N;}
+  constexpr value_type operator()(size_type i, size_type j) const
   {return m_data[row_major_idx(i, j, N)];}
-  reference operator()(size_type i, size_type j)
+  constexpr reference operator()(size_type i, size_type j)
   {return m_data[row_major_idx(i, j, N)];}
-  iterator begin() {return m_data.begin();}
-  iterator end() {return m_data.end();}
-  const_iterator begin() const {return m_data.begin();}
-  const_iterator end() const {return m_data.end();}
-  const_iterator cbegin() const {return m_data.begin();}
-  const_iterator cend() const {return m_data.end();}
+  constexpr iterator begin() {return m_data;}
+  constexpr iterator end() {return m_data + data_size;}
+  constexpr const_iterator begin() const {return m_data;}
+  constexpr const_iterator end() const {return m_data + data_size;}
+  constexpr const_iterator cbegin() const {return m_data;}
+  constexpr const_iterator cend() const {return m_data + data_size;}
   const_iterator row_cbegin(size_type i) const
-  {return m_data.begin() + row_major_idx(i, 0, N);}
+  {return m_data + row_major_idx(i, 0, N);}
   reference front() {return *begin();}
   const_reference front() const {return *cbegin();}
   reference back() {return *(begin() + data_size);}
@@ -73,45 +154,60 @@ public:
   const_iterator row_cend(size_type i) const
   {return row_cbegin(i) + N;}
   iterator row_begin(size_type i)
-  {return m_data.begin() + row_major_idx(i, 0, N);}
+  {return m_data + row_major_idx(i, 0, N);}
   iterator row_end(size_type i) {return row_begin(i) + N;}
+  // Evaluated element by element in constant expressions.
   template <typename E>
-  matrix(const matrix_expr<E>& mat)
+  constexpr matrix(const matrix_expr<E>& mat)
+  : matrix(static_cast<const E&>(mat), std::make_index_sequence<data_size>())
   {
-    static_assert(E::rows == rows, "Matrix with incompatible number of rows.");
-    static_assert(E::cols == cols, "Matrix with incompatible number of columns.");
-    for (size_type i = 0; i < rows; ++i)
-      for (size_type j = 0; j < cols; ++j)
-        m_data[row_major_idx(i, j, cols)] = mat(i, j);
+    static_assert( detail::compatible_dims(E::rows, rows)
+                 , "Matrix with incompatible number of rows.");
+    static_assert( detail::compatible_dims(E::cols, cols)
+                 , "Matrix with incompatible number of columns.");
+    if (E::rows == dynamic_size || E::cols == dynamic_size) {
+      detail::check_dims(mat.n_rows(), rows, "matrix: Incompatible number of rows.");
+      detail::check_dims(mat.n_cols(), cols, "matrix: Incompatible number of columns.");
+    }
+    if (!detail::is_constant_evaluated())
+      detail::matrix_eval<E>::run(static_cast<const E&>(mat), m_data);
   }
-  matrix(std::initializer_list<T> init)
-  { std::copy(std::begin(init), std::end(init), begin()); }
-  matrix& operator=(const matrix<T,M,N>& rhs)
+  constexpr matrix(std::initializer_list<T> init) : m_data()
+  { *this = init; }
+  // Trivial, so that it is inlined, vectorized or elided.
+  matrix& operator=(const matrix<T,M,N>& rhs) = default;
+  constexpr matrix<T,M,N>& operator=(std::initializer_list<T> init)
   {
-    if (this != &rhs)
-      std::copy(std::begin(rhs), std::end(rhs), begin());
+    size_type i = 0;
+    for (const T& v : init)
+      m_data[i++] = v;
     return *this;
   }
-  matrix<T,M,N>& operator=(std::initializer_list<T> init)
-  { std::copy(std::begin(init), std::end(init), begin()); }
-  bool operator==(const matrix<T,M,N>& rhs) const
-  { return std::equal(cbegin(), cend(), rhs.cbegin()); }
-  bool operator!=(const matrix<T,M,N>& rhs) const
+  constexpr bool operator==(const matrix<T,M,N>& rhs) const
+  {
+    for (size_type i = 0; i < data_size; ++i)
+      if (!(m_data[i] == rhs.m_data[i]))
+        return false;
+    return true;
+  }
+  constexpr bool operator!=(const matrix<T,M,N>& rhs) const
   { return !(*this == rhs);}
-  void fill(const T& val)
-  { std::fill(std::begin(m_data), std::end(m_data), val);};
+  constexpr void fill(const T& val)
+  {
+    for (size_type i = 0; i < data_size; ++i)
+      m_data[i] = val;
+  }
 };
 
 template <typename T, std::size_t M, std::size_t N>
 struct matrix_traits<matrix<T, M, N> > {
-  using container_type = std::array<T, M * N>;
-  using value_type = typename container_type::value_type;
-  using reference = typename container_type::reference;
-  using const_reference = typename container_type::const_reference;
-  using size_type = typename container_type::size_type;
-  using iterator = typename container_type::iterator;
-  using const_iterator = typename container_type::const_iterator;
-  using difference_type = typename container_type::difference_type;
+  using value_type = T;
+  using reference = T&;
+  using const_reference = const T&;
+  using size_type = std::size_t;
+  using iterator = T*;
+  using const_iterator = const T*;
+  using difference_type = std::ptrdiff_t;
   static constexpr size_type rows = M;
   static constexpr size_type cols = N;
 };
@@ -123,26 +219,38 @@ class matrix_diff : public matrix_expr<matrix_diff<E1, E2> > {
   public:
   using size_type = typename E1::size_type;
   using value_type = typename E1::value_type;
-  static constexpr size_type rows = E1::rows;
-  static constexpr size_type cols = E1::cols;
-  matrix_diff(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
+  static constexpr size_type rows = detail::static_dim(E1::rows, E2::rows);
+  static constexpr size_type cols = detail::static_dim(E1::cols, E2::cols);
+  static_assert( detail::compatible_dims(E1::rows, E2::rows)
+                 && detail::compatible_dims(E1::cols, E2::cols)
+               , "Matrices of different sizes.");
+  constexpr matrix_diff(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
   : m_u(u)
   , m_v(v)
-  {}
-  value_type operator()(size_type i, size_type j) const
+  {
+    if (E1::rows == dynamic_size || E2::rows == dynamic_size)
+      detail::check_dims(u.n_rows(), v.n_rows(), "matrix_diff: Matrices of different sizes.");
+    if (E1::cols == dynamic_size || E2::cols == dynamic_size)
+      detail::check_dims(u.n_cols(), v.n_cols(), "matrix_diff: Matrices of different sizes.");
+  }
+  constexpr size_type n_rows() const {return m_u.n_rows();}
+  constexpr size_type n_cols() const {return m_u.n_cols();}
+  constexpr value_type operator()(size_type i, size_type j) const
   {return m_u(i, j) - m_v(i, j);}
+  constexpr const E1& lhs() const {return m_u;}
+  constexpr const E2& rhs() const {return m_v;}
 };
 
 template <typename E1, typename E2>
 struct matrix_traits<matrix_diff<E1, E2> > {
   using value_type = typename E1::value_type;
   using size_type = typename E1::size_type;
-  static constexpr size_type rows = E1::rows;
-  static constexpr size_type cols = E1::cols;
+  static constexpr size_type rows = detail::static_dim(E1::rows, E2::rows);
+  static constexpr size_type cols = detail::static_dim(E1::cols, E2::cols);
 };
 
 template <typename E1, typename E2>
-matrix_diff<E1, E2> const operator-(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
+constexpr matrix_diff<E1, E2> const operator-(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
 { return matrix_diff<E1, E2>(u, v); }
 
 template <typename E1, typename E2>
@@ -152,25 +260,37 @@ class matrix_sum : public matrix_expr<matrix_sum<E1, E2> > {
   public:
   using size_type = typename E1::size_type;
   using value_type = typename E1::value_type;
-  static constexpr size_type rows = E1::rows;
-  static constexpr size_type cols = E1::cols;
-  matrix_sum(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
+  static constexpr size_type rows = detail::static_dim(E1::rows, E2::rows);
+  static constexpr size_type cols = detail::static_dim(E1::cols, E2::cols);
+  static_assert( detail::compatible_dims(E1::rows, E2::rows)
+                 && detail::compatible_dims(E1::cols, E2::cols)
+               , "Matrices of different sizes.");
+  constexpr matrix_sum(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
   : m_u(u)
   , m_v(v)
-  {}
-  value_type operator()(size_type i, size_type j) const {return m_u(i, j) + m_v(i, j);}
+  {
+    if (E1::rows == dynamic_size || E2::rows == dynamic_size)
+      detail::check_dims(u.n_rows(), v.n_rows(), "matrix_sum: Matrices of different sizes.");
+    if (E1::cols == dynamic_size || E2::cols == dynamic_size)
+      detail::check_dims(u.n_cols(), v.n_cols(), "matrix_sum: Matrices of different sizes.");
+  }
+  constexpr size_type n_rows() const {return m_u.n_rows();}
+  constexpr size_type n_cols() const {return m_u.n_cols();}
+  constexpr value_type operator()(size_type i, size_type j) const {return m_u(i, j) + m_v(i, j);}
+  constexpr const E1& lhs() const {return m_u;}
+  constexpr const E2& rhs() const {return m_v;}
 };
 
 template <typename E1, typename E2>
 struct matrix_traits<matrix_sum<E1, E2> > {
   using value_type = typename E1::value_type;
   using size_type = typename E1::size_type;
-  static constexpr size_type rows = E1::rows;
-  static constexpr size_type cols = E1::cols;
+  static constexpr size_type rows = detail::static_dim(E1::rows, E2::rows);
+  static constexpr size_type cols = detail::static_dim(E1::cols, E2::cols);
 };
 
 template <typename E1, typename E2>
-matrix_sum<E1, E2> const operator+(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
+constexpr matrix_sum<E1, E2> const operator+(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
 { return matrix_sum<E1, E2>(u, v); }
 
 template <typename E>
@@ -184,12 +304,16 @@ class matrix_scaled : public matrix_expr<matrix_scaled<E> > {
   value_type m_val; 
   const E& m_v;
   public:
-  matrix_scaled(value_type val, const matrix_expr<E>& v)
+  constexpr matrix_scaled(value_type val, const matrix_expr<E>& v)
   : m_val(val)
   , m_v(v)
   {}
-  value_type operator()(size_type i, size_type j) const
+  constexpr value_type operator()(size_type i, size_type j) const
   {return m_val * m_v(i, j);}
+  constexpr value_type scale() const {return m_val;}
+  constexpr const E& expr() const {return m_v;}
+  constexpr size_type n_rows() const {return m_v.n_rows();}
+  constexpr size_type n_cols() const {return m_v.n_cols();}
 };
 
 template <typename E>
@@ -201,43 +325,127 @@ struct matrix_traits<matrix_scaled<E> > {
 };
 
 template <typename E>
-matrix_scaled<E> const operator*(typename E::value_type val, const matrix_expr<E>& v)
+constexpr matrix_scaled<E> const operator*(typename E::value_type val, const matrix_expr<E>& v)
 { return matrix_scaled<E>(val, v); }
 
 template <typename E>
-matrix_scaled<E> const operator*(const matrix_expr<E>& v, typename E::value_type val)
+constexpr matrix_scaled<E> const operator*(const matrix_expr<E>& v, typename E::value_type val)
 { return matrix_scaled<E>(val, v); }
 
 template <typename E>
-matrix_scaled<E> const operator/(const matrix_expr<E>& v, typename E::value_type val)
+constexpr matrix_scaled<E> const operator/(const matrix_expr<E>& v, typename E::value_type val)
 {
   const double tmp = static_cast<double>(1) / val;
   return matrix_scaled<E>(tmp, v);
 }
 
+template <typename E>
+class matrix_transpose : public matrix_expr<matrix_transpose<E> > {
+  public:
+  using value_type = typename E::value_type;
+  using size_type = typename E::size_type;
+  static constexpr size_type rows = E::cols;
+  static constexpr size_type cols = E::rows;
+  private:
+  const E& m_v;
+  public:
+  constexpr explicit matrix_transpose(const matrix_expr<E>& v)
+  : m_v(v)
+  {}
+  constexpr value_type operator()(size_type i, size_type j) const
+  {return m_v(j, i);}
+  constexpr const E& expr() const {return m_v;}
+  constexpr size_type n_rows() const {return m_v.n_cols();}
+  constexpr size_type n_cols() const {return m_v.n_rows();}
+};
+
+template <typename E>
+struct matrix_traits<matrix_transpose<E> > {
+  using value_type = typename E::value_type;
+  using size_type = typename E::size_type;
+  static constexpr size_type rows = E::cols;
+  static constexpr size_type cols = E::rows;
+};
+
+// Lazy, the elements are read from the expression when evaluated.
+template <typename E>
+constexpr matrix_transpose<E> const transpose(const matrix_expr<E>& v)
+{ return matrix_transpose<E>(v); }
+
+template <typename E1, typename E2>
+class matrix_prod;
+
+// Whether evaluating an element of E computes products.
+template <typename E>
+struct has_prod : std::false_type {};
+
+template <typename E1, typename E2>
+struct has_prod<matrix_prod<E1, E2> > : std::true_type {};
+
+template <typename E1, typename E2>
+struct has_prod<matrix_sum<E1, E2> >
+: std::integral_constant<bool, has_prod<E1>::value || has_prod<E2>::value> {};
+
+template <typename E1, typename E2>
+struct has_prod<matrix_diff<E1, E2> >
+: std::integral_constant<bool, has_prod<E1>::value || has_prod<E2>::value> {};
+
+template <typename E>
+struct has_prod<matrix_scaled<E> > : has_prod<E> {};
+
+template <typename E>
+struct has_prod<matrix_transpose<E> > : has_prod<E> {};
+
+// How a product holds an operand. Each element of an operand is read
+// once per row or column of the other, so operands with products are
+// evaluated once into a matrix when the product is built, instead of
+// at every read, which would make chained products exponential. Sums
+// and scalings of matrices stay lazy.
+template <typename E>
+struct prod_operand {
+  using value_type = typename E::value_type;
+  using eval_type = typename std::conditional<
+    E::rows == dynamic_size || E::cols == dynamic_size
+    , dmatrix<value_type>, matrix<value_type, E::rows, E::cols> >::type;
+  using type = typename std::conditional< has_prod<E>::value
+    , const eval_type, const E&>::type;
+};
+
 template <typename E1, typename E2>
 class matrix_prod : public matrix_expr<matrix_prod<E1, E2> > {
   private:
-  static_assert(E1::cols == E2::rows, "Incompatible number of rows and columns.");
-  const E1& m_u;
-  const E2& m_v;
+  static_assert( detail::compatible_dims(E1::cols, E2::rows)
+               , "Incompatible number of rows and columns.");
+  typename prod_operand<E1>::type m_u;
+  typename prod_operand<E2>::type m_v;
   public:
+  using lhs_type = typename std::decay<typename prod_operand<E1>::type>::type;
+  using rhs_type = typename std::decay<typename prod_operand<E2>::type>::type;
   using size_type = typename E1::size_type;
   using value_type = typename E1::value_type;
   static constexpr size_type rows = E1::rows;
   static constexpr size_type cols = E2::cols;
-  matrix_prod(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
+  constexpr matrix_prod(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
   : m_u(u)
   , m_v(v)
-  {}
-  value_type operator()(size_type i, size_type j) const
+  {
+    if (E1::cols == dynamic_size || E2::rows == dynamic_size)
+      detail::check_dims( u.n_cols(), v.n_rows()
+                        , "matrix_prod: Incompatible number of rows and columns.");
+  }
+  constexpr value_type operator()(size_type i, size_type j) const
   {
     value_type tmp = 0;
-    for (size_type k = 0; k < E2::rows; ++k)
+    const size_type n = m_v.n_rows();
+    for (size_type k = 0; k < n; ++k)
       tmp += m_u(i, k) * m_v(k, j);
 
     return tmp;
   }
+  constexpr const lhs_type& lhs() const {return m_u;}
+  constexpr const rhs_type& rhs() const {return m_v;}
+  constexpr size_type n_rows() const {return m_u.n_rows();}
+  constexpr size_type n_cols() const {return m_v.n_cols();}
 };
 
 template <typename E1, typename E2>
@@ -249,9 +457,179 @@ struct matrix_traits<matrix_prod<E1, E2> > {
 };
 
 template <typename E1, typename E2>
-matrix_prod<E1, E2> const operator*(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
+constexpr matrix_prod<E1, E2> const operator*(const matrix_expr<E1>& u, const matrix_expr<E2>& v)
 { return matrix_prod<E1, E2>(u, v); }
 
+namespace detail {
+
+template <typename E, typename T>
+constexpr void eval_elements(const E& e, T* out)
+{
+  const std::size_t m = e.n_rows();
+  const std::size_t n = e.n_cols();
+  for (std::size_t i = 0; i < m; ++i)
+    for (std::size_t j = 0; j < n; ++j)
+      out[row_major_idx(i, j, n)] = e(i, j);
+}
+
+template <typename E>
+struct matrix_eval {
+  template <typename T>
+  static void run(const E& e, T* out) { eval_elements(e, out); }
+};
+
+// Calls f(I), ..., f(N - 1), unrolled.
+template <std::size_t I, std::size_t N>
+struct unroll {
+  template <typename F>
+  static void apply(F& f)
+  {
+    f(I);
+    unroll<I + 1, N>::apply(f);
+  }
+};
+
+template <std::size_t N>
+struct unroll<N, N> {
+  template <typename F>
+  static void apply(F&) {}
+};
+
+// Elements processed at a time by the element wise kernels: the whole
+// matrix, a row or, if 0, one.
+template <typename T, std::size_t M, std::size_t N>
+struct elementwise_width {
+  static const std::size_t value =
+    simd_row<T, M * N>::value ? M * N : simd_row<T, N>::value ? N : 0;
+};
+
+struct add_op {
+  template <typename R, typename V>
+  static V row(V a, V b) noexcept { return R::add(a, b); }
+  template <typename T>
+  static T scalar(T a, T b) noexcept { return a + b; }
+};
+
+struct sub_op {
+  template <typename R, typename V>
+  static V row(V a, V b) noexcept { return R::sub(a, b); }
+  template <typename T>
+  static T scalar(T a, T b) noexcept { return a - b; }
+};
+
+template <typename Op, typename T, std::size_t S, std::size_t W>
+void elementwise(const T* a, const T* b, T* out, std::integral_constant<std::size_t, W>)
+{
+  using R = simd_row<T, W>;
+  auto f = [&](std::size_t i)
+  { R::store(out + i * W, Op::template row<R>(R::load(a + i * W), R::load(b + i * W))); };
+  unroll<0, S / W>::apply(f);
+}
+
+template <typename Op, typename T, std::size_t S>
+void elementwise(const T* a, const T* b, T* out, std::integral_constant<std::size_t, 0>)
+{
+  for (std::size_t i = 0; i < S; ++i)
+    out[i] = Op::scalar(a[i], b[i]);
+}
+
+template <typename T, std::size_t M, std::size_t N>
+struct matrix_eval<matrix_sum<matrix<T, M, N>, matrix<T, M, N> > > {
+  using width = std::integral_constant<std::size_t, elementwise_width<T, M, N>::value>;
+  static void run(const matrix_sum<matrix<T, M, N>, matrix<T, M, N> >& e, T* out)
+  { elementwise<add_op, T, M * N>(e.lhs().data(), e.rhs().data(), out, width()); }
+};
+
+template <typename T, std::size_t M, std::size_t N>
+struct matrix_eval<matrix_diff<matrix<T, M, N>, matrix<T, M, N> > > {
+  using width = std::integral_constant<std::size_t, elementwise_width<T, M, N>::value>;
+  static void run(const matrix_diff<matrix<T, M, N>, matrix<T, M, N> >& e, T* out)
+  { elementwise<sub_op, T, M * N>(e.lhs().data(), e.rhs().data(), out, width()); }
+};
+
+template <typename T, std::size_t M, std::size_t N>
+struct matrix_eval<matrix_scaled<matrix<T, M, N> > > {
+  using expr_type = matrix_scaled<matrix<T, M, N> >;
+  static const std::size_t W = elementwise_width<T, M, N>::value;
+  static void run(const expr_type& e, T* out, std::integral_constant<std::size_t, 0>)
+  {
+    const T* a = e.expr().data();
+    for (std::size_t i = 0; i < M * N; ++i)
+      out[i] = e.scale() * a[i];
+  }
+  template <std::size_t V>
+  static void run(const expr_type& e, T* out, std::integral_constant<std::size_t, V>)
+  {
+    using R = simd_row<T, V>;
+    const T* a = e.expr().data();
+    const typename R::type s = R::splat(e.scale());
+    auto f = [&](std::size_t i)
+    { R::store(out + i * V, R::mul(s, R::load(a + i * V))); };
+    unroll<0, M * N / V>::apply(f);
+  }
+  static void run(const expr_type& e, T* out)
+  { run(e, out, std::integral_constant<std::size_t, W>()); }
+};
+
+// 1 for rows of the right matrix, 2 for dot products with a vector, 0
+// element by element. Both operands must be held as matrices.
+template <typename E1, typename E2>
+struct prod_kernel {
+  using T = typename E1::value_type;
+  static const std::size_t K = E1::cols;
+  static const std::size_t N = E2::cols;
+  static const bool leaves =
+    std::is_same<typename matrix_prod<E1, E2>::lhs_type, matrix<T, E1::rows, K> >::value
+    && std::is_same<typename matrix_prod<E1, E2>::rhs_type, matrix<T, K, N> >::value;
+  static const int value = !leaves ? 0
+                         : N > 1 && simd_row<T, N>::value ? 1
+                         : N == 1 && simd_row<T, K>::value ? 2 : 0;
+};
+
+template <typename E1, typename E2>
+struct matrix_eval<matrix_prod<E1, E2> > {
+  using expr_type = matrix_prod<E1, E2>;
+  using T = typename E1::value_type;
+  static const std::size_t M = E1::rows;
+  static const std::size_t K = E1::cols;
+  static const std::size_t N = E2::cols;
+  static void run(const expr_type& e, T* out, std::integral_constant<int, 0>)
+  { eval_elements(e, out); }
+  static void run(const expr_type& e, T* out, std::integral_constant<int, 1>)
+  {
+    using R = simd_row<T, N>;
+    using V = typename R::type;
+    const T* a = e.lhs().data();
+    const T* b = e.rhs().data();
+    // The rows of the right matrix are loaded once, kept in registers.
+    V rb[K];
+    auto load = [&](std::size_t k) { rb[k] = R::load(b + k * N); };
+    unroll<0, K>::apply(load);
+    auto row = [&](std::size_t i)
+    {
+      V acc = R::mul(R::splat(a[i * K]), rb[0]);
+      auto step = [&](std::size_t k)
+      { acc = R::madd(R::splat(a[i * K + k]), rb[k], acc); };
+      unroll<1, K>::apply(step);
+      R::store(out + i * N, acc);
+    };
+    unroll<0, M>::apply(row);
+  }
+  static void run(const expr_type& e, T* out, std::integral_constant<int, 2>)
+  {
+    using R = simd_row<T, K>;
+    const T* a = e.lhs().data();
+    const typename R::type v = R::load(e.rhs().data());
+    auto row = [&](std::size_t i)
+    { out[i] = R::hsum(R::mul(R::load(a + i * K), v)); };
+    unroll<0, M>::apply(row);
+  }
+  static void run(const expr_type& e, T* out)
+  { run(e, out, std::integral_constant<int, prod_kernel<E1, E2>::value>()); }
+};
+
+}
+
 template <typename E>
 void operator+=( matrix<typename E::value_type, E::rows, E::cols >& u
                , const matrix_expr<E>& v)
@@ -290,23 +668,12 @@ void operator*=( matrix< typename E::value_type, E::rows, E::cols>& u
   u = tmp;
 }
 
-template <typename T, std::size_t M, std::size_t N>
-matrix<T, N, M> transpose(const matrix<T, M, N>& mat)
-{
-  matrix<T, N, M> tmp;
-  for (std::size_t i = 0; i < M; ++i)
-    for (std::size_t j = 0; j < N; ++j)
-      tmp(j, i) = mat(i, j);
-
-  return tmp;
-}
-
 template <typename T, std::size_t N>
-T snorm(const matrix<T, N, 1>& mat) // Squared norm.
+constexpr T snorm(const matrix<T, N, 1>& mat) // Squared norm.
 { return snorm<N>(mat.cbegin());}
 
 template <typename T, std::size_t N>
-T snorm(const matrix<T, 1, N>& mat)
+constexpr T snorm(const matrix<T, 1, N>& mat)
 { return snorm<N>(mat.cbegin());}
 
 template <typename T, std::size_t M, std::size_t N>
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include <stdexcept>
+
+#include <rtcpp/container/matrix.hpp>
+#include <rtcpp/utility/exceptions.hpp>
+
+/*
+  Determinant, inverse, LU and Cholesky decompositions and solvers for
+  square matrices of compile time size, all on the stack.
+
+  determinant and inverse are closed forms for sizes 1 to 4, the 4x4
+  ones through its 2x2 minors, larger sizes go through LU with partial
+  pivoting. The loops of LU and Cholesky have compile time bounds and
+  are unrolled by the compiler for small sizes.
+
+  A matrix is singular, or not positive definite for Cholesky, when a
+  pivot is exactly zero, or not positive. inverse, lu and cholesky then
+  throw std::runtime_error; try_inverse, try_lu and try_cholesky return
+  false instead, for solvers that handle it themselves.
+*/
+
+namespace rt {
+
+template <typename T, std::size_t N>
+struct lu_decomposition {
+  // L below the diagonal, its unit diagonal implied, and U above and
+  // on it, of the rows of a in the order perm.
+  matrix<T, N, N> lu;
+  std::size_t perm[N];
+  int sign; // Of the permutation.
+};
+
+namespace detail {
+
+template <typename T>
+constexpr T abs_value(T a) { return a < T(0) ? -a : a; }
+
+template <typename T, std::size_t N>
+bool lu_decomp(const matrix<T, N, N>& a, lu_decomposition<T, N>& out)
+{
+  matrix<T, N, N>& m = out.lu;
+  m = a;
+  out.sign = 1;
+  for (std::size_t i = 0; i < N; ++i)
+    out.perm[i] = i;
+
+  for (std::size_t k = 0; k < N; ++k) {
+    std::size_t p = k;
+    for (std::size_t i = k + 1; i < N; ++i)
+      if (abs_value(m(i, k)) > abs_value(m(p, k)))
+        p = i;
+    if (m(p, k) == T(0))
+      return false;
+    if (p != k) {
+      for (std::size_t j = 0; j < N; ++j)
+        std::swap(m(p, j), m(k, j));
+      std::swap(out.perm[p], out.perm[k]);
+      out.sign = -out.sign;
+    }
+    const T inv = T(1) / m(k, k);
+    for (std::size_t i = k + 1; i < N; ++i) {
+      const T f = m(i, k) * inv;
+      m(i, k) = f;
+      for (std::size_t j = k + 1; j < N; ++j)
+        m(i, j) -= f * m(k, j);
+    }
+  }
+  return true;
+}
+
+// Closed forms, inverse returns false if singular.
+template <typename T, std::size_t N>
+struct small_matrix {
+  static T determinant(const matrix<T, N, N>& a)
+  {
+    lu_decomposition<T, N> d;
+    if (!lu_decomp(a, d))
+      return T(0);
+    T det = T(d.sign);
+    for (std::size_t i = 0; i < N; ++i)
+      det *= d.lu(i, i);
+    return det;
+  }
+  static bool inverse(const matrix<T, N, N>& a, matrix<T, N, N>& out);
+};
+
+template <typename T>
+struct small_matrix<T, 1> {
+  static constexpr T determinant(const matrix<T, 1, 1>& a) { return a[0]; }
+  static constexpr bool inverse(const matrix<T, 1, 1>& a, matrix<T, 1, 1>& out)
+  {
+    if (a[0] == T(0))
+      return false;
+    out[0] = T(1) / a[0];
+    return true;
+  }
+};
+
+template <typename T>
+struct small_matrix<T, 2> {
+  static constexpr T determinant(const matrix<T, 2, 2>& a)
+  { return a[0] * a[3] - a[1] * a[2]; }
+  static constexpr bool inverse(const matrix<T, 2, 2>& a, matrix<T, 2, 2>& out)
+  {
+    const T det = determinant(a);
+    if (det == T(0))
+      return false;
+    const T s = T(1) / det;
+    out = { s * a[3], -s * a[1], -s * a[2], s * a[0] };
+    return true;
+  }
+};
+
+template <typename T>
+struct small_matrix<T, 3> {
+  static constexpr T determinant(const matrix<T, 3, 3>& a)
+  {
+    return a[0] * (a[4] * a[8] - a[5] * a[7])
+         - a[1] * (a[3] * a[8] - a[5] * a[6])
+         + a[2] * (a[3] * a[7] - a[4] * a[6]);
+  }
+  static constexpr bool inverse(const matrix<T, 3, 3>& a, matrix<T, 3, 3>& out)
+  {
+    // Cofactors of the first column.
+    const T c00 = a[4] * a[8] - a[5] * a[7];
+    const T c10 = a[2] * a[7] - a[1] * a[8];
+    const T c20 = a[1] * a[5] - a[2] * a[4];
+    const T det = a[0] * c00 + a[3] * c10 + a[6] * c20;
+    if (det == T(0))
+      return false;
+    const T s = T(1) / det;
+    out = { s * c00, s * c10, s * c20
+          , s * (a[5] * a[6] - a[3] * a[8])
+          , s * (a[0] * a[8] - a[2] * a[6])
+          , s * (a[2] * a[3] - a[0] * a[5])
+          , s * (a[3] * a[7] - a[4] * a[6])
+          , s * (a[1] * a[6] - a[0] * a[7])
+          , s * (a[0] * a[4] - a[1] * a[3]) };
+    return true;
+  }
+};
+
+template <typename T>
+struct small_matrix<T, 4> {
+  // 2x2 minors of the two upper rows, s, and of the two lower, c.
+  struct minors {
+    T s0, s1, s2, s3, s4, s5;
+    T c0, c1, c2, c3, c4, c5;
+    constexpr explicit minors(const matrix<T, 4, 4>& a)
+    : s0(a[0] * a[5] - a[4] * a[1]), s1(a[0] * a[6] - a[4] * a[2])
+    , s2(a[0] * a[7] - a[4] * a[3]), s3(a[1] * a[6] - a[5] * a[2])
+    , s4(a[1] * a[7] - a[5] * a[3]), s5(a[2] * a[7] - a[6] * a[3])
+    , c0(a[8] * a[13] - a[12] * a[9]), c1(a[8] * a[14] - a[12] * a[10])
+    , c2(a[8] * a[15] - a[12] * a[11]), c3(a[9] * a[14] - a[13] * a[10])
+    , c4(a[9] * a[15] - a[13] * a[11]), c5(a[10] * a[15] - a[14] * a[11])
+    {}
+    constexpr T determinant() const
+    { return s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0; }
+  };
+  static constexpr T determinant(const matrix<T, 4, 4>& a)
+  { return minors(a).determinant(); }
+  static constexpr bool inverse(const matrix<T, 4, 4>& a, matrix<T, 4, 4>& out)
+  {
+    const minors m(a);
+    const T det = m.determinant();
+    if (det == T(0))
+      return false;
+    const T s = T(1) / det;
+    out = { s * ( a[5] * m.c5 - a[6] * m.c4 + a[7] * m.c3)
+          , s * (-a[1] * m.c5 + a[2] * m.c4 - a[3] * m.c3)
+          , s * ( a[13] * m.s5 - a[14] * m.s4 + a[15] * m.s3)
+          , s * (-a[9] * m.s5 + a[10] * m.s4 - a[11] * m.s3)
+          , s * (-a[4] * m.c5 + a[6] * m.c2 - a[7] * m.c1)
+          , s * ( a[0] * m.c5 - a[2] * m.c2 + a[3] * m.c1)
+          , s * (-a[12] * m.s5 + a[14] * m.s2 - a[15] * m.s1)
+          , s * ( a[8] * m.s5 - a[10] * m.s2 + a[11] * m.s1)
+          , s * ( a[4] * m.c4 - a[5] * m.c2 + a[7] * m.c0)
+          , s * (-a[0] * m.c4 + a[1] * m.c2 - a[3] * m.c0)
+          , s * ( a[12] * m.s4 - a[13] * m.s2 + a[15] * m.s0)
+          , s * (-a[8] * m.s4 + a[9] * m.s2 - a[11] * m.s0)
+          , s * (-a[4] * m.c3 + a[5] * m.c1 - a[6] * m.c0)
+          , s * ( a[0] * m.c3 - a[1] * m.c1 + a[2] * m.c0)
+          , s * (-a[12] * m.s3 + a[13] * m.s1 - a[14] * m.s0)
+          , s * ( a[8] * m.s3 - a[9] * m.s1 + a[10] * m.s0) };
+    return true;
+  }
+};
+
+// Solves l * x = b in place, l lower triangular, its diagonal taken
+// as one if Unit.
+template <bool Unit, typename T, std::size_t N, std::size_t K>
+void forward_subst(const matrix<T, N, N>& l, matrix<T, N, K>& b)
+{
+  for (std::size_t i = 0; i < N; ++i)
+    for (std::size_t c = 0; c < K; ++c) {
+      T x = b(i, c);
+      for (std::size_t k = 0; k < i; ++k)
+        x -= l(i, k) * b(k, c);
+      b(i, c) = Unit ? x : x / l(i, i);
+    }
+}
+
+// Solves u * x = b in place, u upper triangular, or the transpose of
+// u if Transposed.
+template <bool Transposed, typename T, std::size_t N, std::size_t K>
+void backward_subst(const matrix<T, N, N>& u, matrix<T, N, K>& b)
+{
+  for (std::size_t i = N; i-- > 0;)
+    for (std::size_t c = 0; c < K; ++c) {
+      T x = b(i, c);
+      for (std::size_t k = i + 1; k < N; ++k)
+        x -= (Transposed ? u(k, i) : u(i, k)) * b(k, c);
+      b(i, c) = x / u(i, i);
+    }
+}
+
+}
+
+template <typename T, std::size_t N>
+bool detail::small_matrix<T, N>::inverse(const matrix<T, N, N>& a, matrix<T, N, N>& out)
+{
+  lu_decomposition<T, N> d;
+  if (!lu_decomp(a, d))
+    return false;
+  for (std::size_t i = 0; i < N; ++i)
+    for (std::size_t j = 0; j < N; ++j)
+      out(i, j) = d.perm[i] == j ? T(1) : T(0);
+  forward_subst<true>(d.lu, out);
+  backward_subst<false>(d.lu, out);
+  return true;
+}
+
+template <typename T, std::size_t N>
+constexpr T determinant(const matrix<T, N, N>& a)
+{ return detail::small_matrix<T, N>::determinant(a); }
+
+// out = a^-1, left unchanged and false returned if a is singular.
+template <typename T, std::size_t N>
+constexpr bool try_inverse(const matrix<T, N, N>& a, matrix<T, N, N>& out)
+{
+  matrix<T, N, N> tmp;
+  if (!detail::small_matrix<T, N>::inverse(a, tmp))
+    return false;
+  out = tmp;
+  return true;
+}
+
+template <typename T, std::size_t N>
+constexpr matrix<T, N, N> inverse(const matrix<T, N, N>& a)
+{
+  matrix<T, N, N> out;
+  if (!detail::small_matrix<T, N>::inverse(a, out))
+    throw_exception(std::runtime_error("inverse: Singular matrix."));
+  return out;
+}
+
+template <typename T, std::size_t N>
+bool try_lu(const matrix<T, N, N>& a, lu_decomposition<T, N>& out)
+{ return detail::lu_decomp(a, out); }
+
+template <typename T, std::size_t N>
+lu_decomposition<T, N> lu(const matrix<T, N, N>& a)
+{
+  lu_decomposition<T, N> d;
+  if (!detail::lu_decomp(a, d))
+    throw_exception(std::runtime_error("lu: Singular matrix."));
+  return d;
+}
+
+// x such that a * x = b for the decomposition d of a.
+template <typename T, std::size_t N, std::size_t K>
+matrix<T, N, K> solve(const lu_decomposition<T, N>& d, const matrix<T, N, K>& b)
+{
+  matrix<T, N, K> x;
+  for (std::size_t i = 0; i < N; ++i)
+    for (std::size_t c = 0; c < K; ++c)
+      x(i, c) = b(d.perm[i], c);
+  detail::forward_subst<true>(d.lu, x);
+  detail::backward_subst<false>(d.lu, x);
+  return x;
+}
+
+// l lower triangular such that a = l * transpose(l), for a symmetric,
+// of which the lower half is read, positive definite.
+template <typename T, std::size_t N>
+bool try_cholesky(const matrix<T, N, N>& a, matrix<T, N, N>& l)
+{
+  matrix<T, N, N> tmp;
+  for (std::size_t j = 0; j < N; ++j) {
+    T d = a(j, j);
+    for (std::size_t k = 0; k < j; ++k)
+      d -= tmp(j, k) * tmp(j, k);
+    if (!(d > T(0)))
+      return false;
+    const T ljj = std::sqrt(d);
+    const T inv = T(1) / ljj;
+    tmp(j, j) = ljj;
+    for (std::size_t i = j + 1; i < N; ++i) {
+      T x = a(i, j);
+      for (std::size_t k = 0; k < j; ++k)
+        x -= tmp(i, k) * tmp(j, k);
+      tmp(i, j) = x * inv;
+    }
+  }
+  l = tmp;
+  return true;
+}
+
+template <typename T, std::size_t N>
+matrix<T, N, N> cholesky(const matrix<T, N, N>& a)
+{
+  matrix<T, N, N> l;
+  if (!try_cholesky(a, l))
+    throw_exception(std::runtime_error("cholesky: Matrix not positive definite."));
+  return l;
+}
+
+// x such that a * x = b for the Cholesky factor l of a.
+template <typename T, std::size_t N, std::size_t K>
+matrix<T, N, K> cholesky_solve(const matrix<T, N, N>& l, const matrix<T, N, K>& b)
+{
+  matrix<T, N, K> x = b;
+  detail::forward_subst<false>(l, x);
+  detail::backward_subst<true>(l, x);
+  return x;
+}
+
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <new>
+#include <array>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include <rtcpp/memory/align.hpp>
+
+/*
+  Bounded lock-free queue for any number of producer and consumer
+  threads, on a caller buffer as spsc_queue. Each slot carries a
+  sequence number next to the element: it equals the position of the
+  slot when the slot is free for the producer that claims that
+  position, and the position plus one when it holds the element. A
+  push claims a position by advancing the tail with a CAS, then
+  constructs the element and publishes it through the sequence
+  number, pop does the same on the head. push_n and pop_n claim all
+  the consecutive slots that are ready with a single CAS.
+
+  A thread stopped between claiming a slot and publishing it holds
+  back the threads on the other side that reach that slot (but not
+  the ones on its own side). Construction and destruction are not
+  thread safe.
+*/
+
+namespace rt {
+
+template <class T>
+class mpmc_queue {
+  private:
+  struct slot_type {
+    std::atomic<std::size_t> seq;
+    typename std::aligned_storage<sizeof (T), alignof (T)>::type storage;
+    T* get() noexcept { return reinterpret_cast<T*>(&storage); }
+  };
+  alignas(cache_line_size) std::atomic<std::size_t> m_head;
+  alignas(cache_line_size) std::atomic<std::size_t> m_tail;
+  alignas(cache_line_size) slot_type* m_slots;
+  std::size_t m_mask;
+  void layout(char* p, std::size_t s);
+  slot_type& slot(std::size_t i) const noexcept { return m_slots[i & m_mask]; }
+  // Claims up to n positions from the index, whose slots have the
+  // sequence number position + off, returns the first position and
+  // how many.
+  std::pair<std::size_t, std::size_t>
+  claim(std::atomic<std::size_t>& index, std::size_t n, std::size_t off) noexcept;
+  public:
+  using value_type = T;
+  using size_type = std::size_t;
+  template <class U>
+  mpmc_queue(U* data, size_type n)
+  { layout(reinterpret_cast<char*>(data), n * sizeof (U)); }
+  template <class U, std::size_t I>
+  explicit mpmc_queue(std::array<U, I>& arr)
+  : mpmc_queue(arr.data(), arr.size()) {}
+  template <class U, class A>
+  explicit mpmc_queue(std::vector<U, A>& arr)
+  : mpmc_queue(arr.data(), arr.size()) {}
+  mpmc_queue(const mpmc_queue&) = delete;
+  mpmc_queue& operator=(const mpmc_queue&) = delete;
+  ~mpmc_queue();
+  // Bytes a buffer needs for a capacity of n, a power of two.
+  static constexpr size_type bytes_for(size_type n) noexcept
+  { return n * sizeof (slot_type) + alignof (slot_type); }
+  // The element must be nothrow constructible from args, a claimed
+  // slot can not be given back.
+  template <class... Args>
+  bool try_emplace(Args&&... args) noexcept;
+  bool try_push(const T& v) noexcept { return try_emplace(v); }
+  bool try_push(T&& v) noexcept { return try_emplace(std::move(v)); }
+  // Copies at most n elements from in, returns how many.
+  size_type push_n(const T* in, size_type n) noexcept;
+  bool try_pop(T& v) noexcept { return pop_n(&v, 1) == 1; }
+  // Moves at most n elements to out, returns how many.
+  size_type pop_n(T* out, size_type n) noexcept;
+  // A snapshot, possibly stale by the time it returns.
+  size_type size() const noexcept
+  {
+    const std::size_t head = m_head.load(std::memory_order_acquire);
+    const std::size_t tail = m_tail.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+  }
+  bool empty() const noexcept { return size() == 0; }
+  size_type capacity() const noexcept { return m_mask + 1; }
+};
+
+template <class T>
+void mpmc_queue<T>::layout(char* p, std::size_t s)
+{
+  align_if_needed<alignof (slot_type)>(p, s);
+  if (s < sizeof (slot_type) || s > std::size_t(-1) / 2)
+    throw std::runtime_error("mpmc_queue: Buffer too small.");
+
+  m_slots = reinterpret_cast<slot_type*>(p);
+  m_mask = floor_pow2(s / sizeof (slot_type)) - 1;
+  for (std::size_t i = 0; i <= m_mask; ++i)
+    ::new (static_cast<void*>(&m_slots[i].seq)) std::atomic<std::size_t>(i);
+  m_head.store(0, std::memory_order_relaxed);
+  m_tail.store(0, std::memory_order_relaxed);
+}
+
+template <class T>
+mpmc_queue<T>::~mpmc_queue()
+{
+  const std::size_t tail = m_tail.load(std::memory_order_acquire);
+  for (std::size_t i = m_head.load(std::memory_order_relaxed); i != tail; ++i)
+    slot(i).get()->~T();
+}
+
+template <class T>
+std::pair<std::size_t, std::size_t>
+mpmc_queue<T>::claim( std::atomic<std::size_t>& index, std::size_t n
+                    , std::size_t off) noexcept
+{
+  std::size_t pos = index.load(std::memory_order_relaxed);
+  for (;;) {
+    // The slots ready for pos, pos + 1, ... can only be taken by
+    // whoever moves the index past them.
+    std::size_t k = 0;
+    for (; k < n; ++k) {
+      const std::size_t seq =
+        slot(pos + k).seq.load(std::memory_order_acquire);
+      if (seq != pos + k + off)
+        break;
+    }
+    if (k == 0) {
+      const std::size_t seq = slot(pos).seq.load(std::memory_order_acquire);
+      // Behind pos, the slot is still in use on the other side: full
+      // or empty.
+      if (static_cast<std::ptrdiff_t>(seq - (pos + off)) < 0)
+        return std::make_pair(pos, 0);
+      pos = index.load(std::memory_order_relaxed);
+      continue;
+    }
+    if (index.compare_exchange_weak( pos, pos + k
+                                   , std::memory_order_relaxed
+                                   , std::memory_order_relaxed))
+      return std::make_pair(pos, k);
+  }
+}
+
+template <class T>
+template <class... Args>
+bool mpmc_queue<T>::try_emplace(Args&&... args) noexcept
+{
+  static_assert( std::is_nothrow_constructible<T, Args&&...>::value
+               , "mpmc_queue: Element construction must not throw.");
+  const auto c = claim(m_tail, 1, 0);
+  if (c.second == 0)
+    return false;
+
+  slot_type& s = slot(c.first);
+  ::new (static_cast<void*>(s.get())) T(std::forward<Args>(args)...);
+  s.seq.store(c.first + 1, std::memory_order_release);
+  return true;
+}
+
+template <class T>
+std::size_t mpmc_queue<T>::push_n(const T* in, std::size_t n) noexcept
+{
+  static_assert( std::is_nothrow_copy_constructible<T>::value
+               , "mpmc_queue: Element copy must not throw.");
+  const auto c = claim(m_tail, n, 0);
+  for (std::size_t i = 0; i < c.second; ++i) {
+    slot_type& s = slot(c.first + i);
+    ::new (static_cast<void*>(s.get())) T(in[i]);
+    s.seq.store(c.first + i + 1, std::memory_order_release);
+  }
+  return c.second;
+}
+
+template <class T>
+std::size_t mpmc_queue<T>::pop_n(T* out, std::size_t n) noexcept
+{
+  static_assert( std::is_nothrow_move_assignable<T>::value
+               , "mpmc_queue: Element move must not throw.");
+  const auto c = claim(m_head, n, 1);
+  for (std::size_t i = 0; i < c.second; ++i) {
+    slot_type& s = slot(c.first + i);
+    T* p = s.get();
+    out[i] = std::move(*p);
+    p->~T();
+    // Free for the producer one lap later.
+    s.seq.store(c.first + i + capacity(), std::memory_order_release);
+  }
+  return c.second;
+}
+
+}
+
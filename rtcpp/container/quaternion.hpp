@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#include <rtcpp/container/matrix.hpp>
+#include <rtcpp/utility/simd.hpp>
+
+/*
+  Rotations in 3D as unit quaternions, held as x, y, z, w: a 4 x 1
+  matrix_expr, so that they can be added and scaled like vectors, e.g.
+  to interpolate, and built from such an expression. operator* is the
+  quaternion product, 16 multiplies to compose two rotations against
+  27 for 3x3 matrices, one SSE2 register for float; q * v rotates a
+  3-vector. Products of unit quaternions drift from unit length much
+  more slowly than matrices from orthogonality, normalize fixes it in
+  4 multiplies and a square root.
+
+  They convert to and from 3x3 rotation matrices. affine3 (affine3.hpp)
+  combines them with a translation.
+*/
+
+namespace rt {
+
+template <typename T>
+class quaternion : public matrix_expr<quaternion<T> > {
+  public:
+  static constexpr std::size_t rows = 4;
+  static constexpr std::size_t cols = 1;
+  using value_type = T;
+  using size_type = std::size_t;
+  using vector_type = matrix<T, 3, 1>;
+  private:
+  alignas(detail::matrix_align<T, 4>::value) T m_data[4];
+  public:
+  // The identity.
+  constexpr quaternion() : m_data{0, 0, 0, 1} {}
+  constexpr quaternion(T w, T x, T y, T z) : m_data{x, y, z, w} {}
+  template <typename E>
+  constexpr quaternion(const matrix_expr<E>& e)
+  : m_data{e(0, 0), e(1, 0), e(2, 0), e(3, 0)}
+  {
+    static_assert( detail::compatible_dims(E::rows, 4)
+                   && detail::compatible_dims(E::cols, 1)
+                 , "Quaternion from an expression that is not 4 x 1.");
+  }
+  // From a rotation matrix.
+  explicit quaternion(const matrix<T, 3, 3>& m);
+  // Of angle radians about the unit vector axis.
+  static quaternion from_axis_angle(const vector_type& axis, T angle)
+  {
+    const T s = std::sin(angle / 2);
+    return quaternion(std::cos(angle / 2), s * axis[0], s * axis[1], s * axis[2]);
+  }
+  constexpr T w() const {return m_data[3];}
+  constexpr T x() const {return m_data[0];}
+  constexpr T y() const {return m_data[1];}
+  constexpr T z() const {return m_data[2];}
+  constexpr T* data() noexcept {return m_data;}
+  constexpr const T* data() const noexcept {return m_data;}
+  constexpr T& operator[](size_type i) {return m_data[i];}
+  constexpr const T& operator[](size_type i) const {return m_data[i];}
+  constexpr value_type operator()(size_type i, size_type) const {return m_data[i];}
+  constexpr size_type n_rows() const noexcept {return 4;}
+  constexpr size_type n_cols() const noexcept {return 1;}
+  constexpr bool operator==(const quaternion& q) const
+  {
+    return m_data[0] == q.m_data[0] && m_data[1] == q.m_data[1]
+        && m_data[2] == q.m_data[2] && m_data[3] == q.m_data[3];
+  }
+  constexpr bool operator!=(const quaternion& q) const {return !(*this == q);}
+};
+
+template <typename T>
+struct matrix_traits<quaternion<T> > {
+  using value_type = T;
+  using size_type = std::size_t;
+  static constexpr size_type rows = 4;
+  static constexpr size_type cols = 1;
+};
+
+namespace detail {
+
+template <typename T>
+constexpr quaternion<T> quat_mul(const quaternion<T>& a, const quaternion<T>& b)
+{
+  return quaternion<T>( a.w() * b.w() - a.x() * b.x() - a.y() * b.y() - a.z() * b.z()
+                      , a.w() * b.x() + a.x() * b.w() + a.y() * b.z() - a.z() * b.y()
+                      , a.w() * b.y() - a.x() * b.z() + a.y() * b.w() + a.z() * b.x()
+                      , a.w() * b.z() + a.x() * b.y() - a.y() * b.x() + a.z() * b.w());
+}
+
+#if defined(__SSE2__)
+
+// Each lane a sum of four products of shuffled lanes, the signs of
+// two of them flipped in the w lane by xor.
+inline quaternion<float> quat_mul(const quaternion<float>& qa, const quaternion<float>& qb)
+{
+  const __m128 a = _mm_load_ps(qa.data());
+  const __m128 b = _mm_load_ps(qb.data());
+  const __m128 neg_w = _mm_set_ps(-0.f, 0.f, 0.f, 0.f);
+  const __m128 t0 = _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3)), b);
+  const __m128 t1 = _mm_mul_ps( _mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 2, 1, 0))
+                              , _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 3, 3)));
+  const __m128 t2 = _mm_mul_ps( _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 2, 1))
+                              , _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 0, 2)));
+  const __m128 t3 = _mm_mul_ps( _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 1, 0, 2))
+                              , _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 0, 2, 1)));
+  quaternion<float> q;
+  _mm_store_ps(q.data(), _mm_sub_ps(_mm_add_ps(t0, _mm_xor_ps(_mm_add_ps(t1, t2), neg_w)), t3));
+  return q;
+}
+
+#endif
+
+}
+
+// The rotation b then a.
+template <typename T>
+constexpr quaternion<T> operator*(const quaternion<T>& a, const quaternion<T>& b)
+{
+  return detail::is_constant_evaluated() ? detail::quat_mul<T>(a, b)
+                                         : detail::quat_mul(a, b);
+}
+
+template <typename T>
+constexpr quaternion<T> conjugate(const quaternion<T>& q)
+{ return quaternion<T>(q.w(), -q.x(), -q.y(), -q.z()); }
+
+template <typename T>
+constexpr T dot(const quaternion<T>& a, const quaternion<T>& b)
+{ return a.x() * b.x() + a.y() * b.y() + a.z() * b.z() + a.w() * b.w(); }
+
+// The inverse rotation is the conjugate for unit quaternions.
+template <typename T>
+constexpr quaternion<T> inverse(const quaternion<T>& q)
+{
+  const T s = T(1) / dot(q, q);
+  return quaternion<T>(s * q.w(), -s * q.x(), -s * q.y(), -s * q.z());
+}
+
+template <typename T>
+quaternion<T> normalize(const quaternion<T>& q)
+{
+  const T s = T(1) / std::sqrt(dot(q, q));
+  return quaternion<T>(s * q.w(), s * q.x(), s * q.y(), s * q.z());
+}
+
+// v rotated by the unit quaternion q: v + w t + u x t with t = 2 u x v,
+// u the vector part of q. 18 multiplies against 9 for a matrix, to
+// rotate many vectors by the same q convert it with to_matrix.
+template <typename T>
+constexpr matrix<T, 3, 1> operator*(const quaternion<T>& q, const matrix<T, 3, 1>& v)
+{
+  // t = 2 u x v.
+  const T tx = 2 * (q.y() * v[2] - q.z() * v[1]);
+  const T ty = 2 * (q.z() * v[0] - q.x() * v[2]);
+  const T tz = 2 * (q.x() * v[1] - q.y() * v[0]);
+  return { v[0] + q.w() * tx + q.y() * tz - q.z() * ty
+         , v[1] + q.w() * ty + q.z() * tx - q.x() * tz
+         , v[2] + q.w() * tz + q.x() * ty - q.y() * tx };
+}
+
+// Spherical interpolation from a, t = 0, to b, t = 1, along the
+// shortest arc; linear and normalized when they are close.
+template <typename T>
+quaternion<T> slerp(const quaternion<T>& a, const quaternion<T>& b, T t)
+{
+  T d = dot(a, b);
+  const T sign = d < 0 ? T(-1) : T(1);
+  d *= sign;
+  if (d > T(0.9995))
+    return normalize(quaternion<T>((1 - t) * a + (sign * t) * b));
+  const T theta = std::acos(d);
+  const T s = T(1) / std::sin(theta);
+  const T sa = std::sin((1 - t) * theta) * s;
+  const T sb = std::sin(t * theta) * s * sign;
+  return quaternion<T>(sa * a + sb * b);
+}
+
+// The rotation matrix of the unit quaternion q.
+template <typename T>
+constexpr matrix<T, 3, 3> to_matrix(const quaternion<T>& q)
+{
+  const T x2 = q.x() + q.x();
+  const T y2 = q.y() + q.y();
+  const T z2 = q.z() + q.z();
+  const T xx = q.x() * x2, yy = q.y() * y2, zz = q.z() * z2;
+  const T xy = q.x() * y2, xz = q.x() * z2, yz = q.y() * z2;
+  const T wx = q.w() * x2, wy = q.w() * y2, wz = q.w() * z2;
+  return { 1 - (yy + zz), xy - wz, xz + wy
+         , xy + wz, 1 - (xx + zz), yz - wx
+         , xz - wy, yz + wx, 1 - (xx + yy) };
+}
+
+// Shepperd's method, dividing by the largest of the four possible
+// pivots.
+template <typename T>
+quaternion<T>::quaternion(const matrix<T, 3, 3>& m)
+{
+  const T tr = m(0, 0) + m(1, 1) + m(2, 2);
+  if (tr > 0) {
+    const T s = 2 * std::sqrt(tr + 1);
+    *this = quaternion(s / 4, (m(2, 1) - m(1, 2)) / s, (m(0, 2) - m(2, 0)) / s
+                      , (m(1, 0) - m(0, 1)) / s);
+  } else if (m(0, 0) > m(1, 1) && m(0, 0) > m(2, 2)) {
+    const T s = 2 * std::sqrt(1 + m(0, 0) - m(1, 1) - m(2, 2));
+    *this = quaternion((m(2, 1) - m(1, 2)) / s, s / 4, (m(0, 1) + m(1, 0)) / s
+                      , (m(0, 2) + m(2, 0)) / s);
+  } else if (m(1, 1) > m(2, 2)) {
+    const T s = 2 * std::sqrt(1 + m(1, 1) - m(0, 0) - m(2, 2));
+    *this = quaternion((m(0, 2) - m(2, 0)) / s, (m(0, 1) + m(1, 0)) / s, s / 4
+                      , (m(1, 2) + m(2, 1)) / s);
+  } else {
+    const T s = 2 * std::sqrt(1 + m(2, 2) - m(0, 0) - m(1, 1));
+    *this = quaternion((m(1, 0) - m(0, 1)) / s, (m(0, 2) + m(2, 0)) / s
+                      , (m(1, 2) + m(2, 1)) / s, s / 4);
+  }
+}
+
+}
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
+#include <functional>
+
+#include <rtcpp/memory/align.hpp>
+#include <rtcpp/utility/exceptions.hpp>
+
+#include "set.hpp"
+
+/*
+  A set for many reader threads and few updates. It keeps a few
+  versions of an rt::set, each on its own allocator, one of them the
+  current one. Readers run lock free on the current version through a
+  reader handle, writers serialize on a mutex, copy the current version
+  into a free one, change the copy and publish it:
+
+    rt::rcu_set<int, std::less<int>, alloc_type> s({alloc1, alloc2, alloc3}, 8);
+    s.insert(3);                                   // Writer.
+    rt::rcu_set<int, std::less<int>, alloc_type>::reader r(s);
+    r.read([](const auto& v) { return v.count(3); });  // Reader.
+
+  With node_allocators on headers of their own the copy is the buffer
+  copy of set(rhs, alloc), otherwise node by node. Either way it is
+  linear in the size, so several changes go in one call of update
+  where possible.
+
+  Reclamation is epoch based. A reader stores the global epoch in its
+  slot for the duration of read, a writer that replaces a version
+  advances the epoch and the old version is reused once no reader has
+  a smaller epoch in its slot. Its nodes go back to the allocator in
+  batches of at most n with reclaim(n), called by the writer between
+  updates so that they cost no more than the copy. An update that
+  finds no reclaimed version frees the rest itself, and waits if all
+  are still being read, which two versions make likely.
+
+  A reader handle is used by one thread at a time, reads do not nest,
+  and the handles must be gone when the set is destroyed.
+*/
+
+namespace rt {
+
+template < typename T
+         , typename Compare = std::less<T>
+         , typename Allocator = std::allocator<T>
+         , typename Balance = tbst::no_balance>
+class rcu_set {
+  public:
+  using set_type = set<T, Compare, Allocator, Balance>;
+  using value_type = T;
+  using size_type = std::size_t;
+  using allocator_type = Allocator;
+  class reader;
+  private:
+  // Padded to a cache line so that readers do not share lines; a
+  // vector does not align it further.
+  struct reader_slot {
+    std::atomic<std::uint64_t> epoch; // 0 outside read.
+    std::atomic<bool> taken;
+    char pad[cache_line_size - sizeof (std::atomic<std::uint64_t>) - sizeof (std::atomic<bool>)];
+  };
+  std::vector<set_type> m_sets;
+  // The epoch each version was replaced at, 0 if never published.
+  std::vector<std::uint64_t> m_retired;
+  std::vector<reader_slot> m_readers;
+  std::atomic<size_type> m_current;
+  std::atomic<std::uint64_t> m_epoch;
+  std::mutex m_mutex;
+  bool quiescent(size_type i) const noexcept;
+  size_type acquire_version() noexcept;
+  public:
+  // One version per allocator, at least two, and at most readers
+  // handles at a time.
+  rcu_set( const std::vector<Allocator>& allocs, size_type readers
+         , const Compare& comp = Compare());
+  rcu_set(const rcu_set&) = delete;
+  rcu_set& operator=(const rcu_set&) = delete;
+  // Calls f with a copy of the current version and publishes it.
+  template <typename F>
+  void update(F f);
+  bool insert(const T& key);
+  size_type erase(const T& key);
+  // Releases at most n nodes of the versions no reader can see anymore,
+  // returns how many.
+  size_type reclaim(size_type n);
+  size_type versions() const noexcept {return m_sets.size();}
+};
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+class rcu_set<T, Compare, Allocator, Balance>::reader {
+  private:
+  const rcu_set* m_set;
+  reader_slot* m_slot;
+  struct leave {
+    reader_slot* slot;
+    ~leave() { slot->epoch.store(0, std::memory_order_release); }
+  };
+  public:
+  explicit reader(rcu_set& s);
+  reader(const reader&) = delete;
+  reader& operator=(const reader&) = delete;
+  ~reader() { m_slot->taken.store(false, std::memory_order_release); }
+  // Calls f with the current version, which does not change meanwhile,
+  // and returns its result. Nothing of the version may escape f.
+  template <typename F>
+  auto read(F f) const -> decltype(f(std::declval<const set_type&>()))
+  {
+    const std::uint64_t e = m_set->m_epoch.load(std::memory_order_acquire);
+    m_slot->epoch.store(e, std::memory_order_seq_cst);
+    const leave l{m_slot};
+    return f(m_set->m_sets[m_set->m_current.load(std::memory_order_seq_cst)]);
+  }
+};
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+rcu_set<T, Compare, Allocator, Balance>::reader::reader(rcu_set& s)
+: m_set(&s)
+, m_slot(0)
+{
+  for (reader_slot& r : s.m_readers) {
+    bool expected = false;
+    if (r.taken.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      m_slot = &r;
+      return;
+    }
+  }
+  throw_exception(std::runtime_error("rcu_set: Too many readers."));
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+rcu_set<T, Compare, Allocator, Balance>::rcu_set( const std::vector<Allocator>& allocs
+                                                , size_type readers
+                                                , const Compare& comp)
+: m_retired(allocs.size(), 0)
+, m_readers(readers)
+, m_current(0)
+, m_epoch(1)
+{
+  if (allocs.size() < 2)
+    throw_exception(std::runtime_error("rcu_set: At least two versions are needed."));
+
+  m_sets.reserve(allocs.size());
+  for (const Allocator& a : allocs)
+    m_sets.emplace_back(comp, a);
+  for (reader_slot& r : m_readers) {
+    r.epoch.store(0, std::memory_order_relaxed);
+    r.taken.store(false, std::memory_order_relaxed);
+  }
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+bool rcu_set<T, Compare, Allocator, Balance>::quiescent(size_type i) const noexcept
+{
+  const std::uint64_t r = m_retired[i];
+  for (const reader_slot& s : m_readers) {
+    const std::uint64_t e = s.epoch.load(std::memory_order_seq_cst);
+    if (e != 0 && e < r)
+      return false;
+  }
+  return true;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+typename rcu_set<T, Compare, Allocator, Balance>::size_type
+rcu_set<T, Compare, Allocator, Balance>::acquire_version() noexcept
+{
+  const size_type c = m_current.load(std::memory_order_relaxed);
+  for (;;) {
+    // The one with the fewest nodes left among those not read.
+    size_type w = c;
+    for (size_type i = 0; i < m_sets.size(); ++i)
+      if (i != c && quiescent(i) && (w == c || m_sets[i].size() < m_sets[w].size()))
+        w = i;
+    if (w != c) {
+      m_sets[w].clear();
+      return w;
+    }
+    std::this_thread::yield();
+  }
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename F>
+void rcu_set<T, Compare, Allocator, Balance>::update(F f)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const size_type c = m_current.load(std::memory_order_relaxed);
+  const size_type w = acquire_version();
+  m_retired[w] = 0;
+  m_sets[w].assign(m_sets[c]);
+  f(m_sets[w]);
+  m_current.store(w, std::memory_order_seq_cst);
+  m_retired[c] = m_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+bool rcu_set<T, Compare, Allocator, Balance>::insert(const T& key)
+{
+  bool inserted = false;
+  update([&](set_type& s) { inserted = s.insert(key).second; });
+  return inserted;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+typename rcu_set<T, Compare, Allocator, Balance>::size_type
+rcu_set<T, Compare, Allocator, Balance>::erase(const T& key)
+{
+  size_type n = 0;
+  update([&](set_type& s) { n = s.erase(key); });
+  return n;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+typename rcu_set<T, Compare, Allocator, Balance>::size_type
+rcu_set<T, Compare, Allocator, Balance>::reclaim(size_type n)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const size_type c = m_current.load(std::memory_order_relaxed);
+  size_type released = 0;
+  for (size_type i = 0; i < m_sets.size() && released < n; ++i) {
+    if (i == c || m_sets[i].empty() || !quiescent(i))
+      continue;
+    set_type& s = m_sets[i];
+    while (released < n && !s.empty()) {
+      s.erase(s.begin());
+      ++released;
+    }
+  }
+  return released;
+}
+
+}
@@ -1,15 +1,24 @@
+#pragma once
+
 #include <memory>
 #include <limits>
 #include <utility>
 #include <iterator>
+#include <vector>
 #include <algorithm>
 #include <functional>
 #include <type_traits>
 #include <initializer_list>
 
 #include <rtcpp/memory/allocator_traits.hpp>
+#include <rtcpp/utility/sorted_unique.hpp>
+#include <rtcpp/utility/adopt_nodes.hpp>
+#include <rtcpp/utility/prefetch.hpp>
+#include <rtcpp/utility/parallel.hpp>
+#include <rtcpp/utility/exceptions.hpp>
 
 #include "tbst.hpp"
+#include "tbst_balance.hpp"
 
 /*
   Implements a std::set as a threaded binary search tree. That means
@@ -17,6 +26,15 @@
   faster than a balanced implementation as a degenerate tree is very
   rare and there is no balancing overhead.
 
+  Pass tbst::avl_balance as Balance to bound the height when keys
+  arrive mostly sorted, the threading and the traversal are the same.
+  tbst::ranked<> keeps subtree sizes in the nodes as well, for nth,
+  rank and count_range.
+
+  Strictly increasing ranges given to an empty set, or ranges tagged
+  with rt::sorted_unique, are built in one pass into a perfectly
+  balanced tree whose nodes are allocated in breadth first order.
+
   NEWS: It supports allocators that can serve only one object at a
   time: allocator_type::allocate_node();
 */
@@ -57,7 +75,11 @@ class bst_iterator :
     return tmp;
   }
 
-  T operator*() const noexcept {return m_p->key;}
+  const T& operator*() const noexcept
+  {
+    using tbst::key_of; // Or the overload for intrusive hooks.
+    return key_of(m_p);
+  }
 };
 
 template <typename T, typename Ptr>
@@ -72,7 +94,8 @@ bool operator!=( const bst_iterator<T, Ptr>& rhs
 
 template < typename T
          , typename Compare = std::less<T>
-         , typename Allocator = std::allocator<T>>
+         , typename Allocator = std::allocator<T>
+         , typename Balance = tbst::no_balance>
 class set {
   public:
   using key_type = T;
@@ -90,7 +113,8 @@ class set {
   using alloc_traits_type = rt::allocator_traits<Allocator>;
   using void_pointer = typename alloc_traits_type::void_pointer;
   public:
-  using node_type = tbst::node<value_type, void_pointer>;
+  using node_type =
+    typename tbst::balance_node<Balance, value_type, void_pointer>::type;
   private:
   using inner_allocator_type =
     typename alloc_traits_type::template rebind_alloc<node_type>;
@@ -107,31 +131,120 @@ class set {
   private:
   mutable inner_allocator_type m_inner_alloc;
   node_pointer m_head;
+  size_type m_size;
   Compare m_comp;
   void copy(set& rhs) const noexcept;
+  // Copies the whole buffer, if the allocators allow it, see copy.
+  bool clone(set& rhs, std::true_type) const noexcept;
+  bool clone(set&, std::false_type) const noexcept {return false;}
+  static void rebase_links(node_type& o, std::ptrdiff_t d, std::true_type) noexcept;
+  static void rebase_links(node_type&, std::ptrdiff_t, std::false_type) noexcept {}
   node_pointer get_node() const;
+  // Null when the allocator is exhausted.
+  node_pointer try_get_node() const;
   void release_node(node_pointer p) const;
-  void safe_construct(node_pointer p, const value_type& key) const;
+  template <typename... Args>
+  void safe_construct(node_pointer p, Args&&... args) const;
+  template <typename... Args>
+  node_pointer make_node(Args&&... args) const;
+  void drop_node(node_pointer p) const noexcept;
+  node_pointer build_shape(size_type n);
+  // Number of nodes below node k of build_shape, itself included.
+  static size_type subtree_size(size_type k, size_type n) noexcept;
+  static void shape_count(node_pointer q, size_type k, size_type n, std::true_type) noexcept
+  { q->count = subtree_size(k, n); }
+  static void shape_count(node_pointer, size_type, size_type, std::false_type) noexcept {}
+  template <typename ForwardIt>
+  void fill_subtree(node_pointer root, ForwardIt begin, node_pointer prev, node_pointer next);
+  template <typename ForwardIt>
+  void bulk_build(ForwardIt begin, size_type n);
+  template <typename ForwardIt>
+  void bulk_build(ForwardIt begin, size_type n, std::size_t threads);
+  void release_subtree(node_pointer p) const noexcept;
+  // Inorder bounds of about parts ranges, the first is begin().
+  std::vector<iterator> split(std::size_t parts) const;
+  template <typename InputIt>
+  void insert_range(InputIt begin, InputIt end, std::input_iterator_tag);
+  template <typename ForwardIt>
+  void insert_range(ForwardIt begin, ForwardIt end, std::forward_iterator_tag);
+  template <typename ForwardIt, typename F>
+  void find_group(ForwardIt first, ForwardIt last, F& f) const;
+  template <typename F>
+  void for_each_unordered(F& f, std::true_type) const;
+  template <typename F>
+  void for_each_unordered(F& f, std::false_type) const;
   public:
   set(const Compare& comp, const Allocator& alloc = Allocator());
   explicit set(const Allocator& alloc = Allocator())
   : set(Compare(), alloc) {}
   set(const set& rhs) noexcept;
+  // Copies rhs with nodes from alloc. When the allocators are
+  // node_allocators with node_stack on two different headers, each used
+  // by one set only, the one of alloc at least as big, and the keys are
+  // trivially copyable, the buffer is copied at once and the links
+  // rebased in one pass over it, instead of copying the nodes one by
+  // one. Nothing to rebase with relative links. Same requirement on the
+  // buffer as for_each_unordered.
+  set(const set& rhs, const Allocator& alloc) noexcept;
   set& operator=(const set& rhs) noexcept;
+  // As operator= but keeps the allocator, so that the nodes come from
+  // it, with the buffer copy of set(rhs, alloc) when possible.
+  void assign(const set& rhs) noexcept;
   set& operator=(std::initializer_list<T> init) noexcept;
   template <typename InputIt>
   set(InputIt begin, InputIt end, const Compare& comp, const Allocator& alloc = Allocator());
   template <typename InputIt>
   set(InputIt begin, InputIt end, const Allocator& alloc = Allocator())
   : set(begin, end, Compare(), alloc) {}
+  template <typename InputIt>
+  set( sorted_unique_t, InputIt begin, InputIt end, const Compare& comp
+     , const Allocator& alloc = Allocator());
+  template <typename InputIt>
+  set(sorted_unique_t, InputIt begin, InputIt end, const Allocator& alloc = Allocator())
+  : set(sorted_unique, begin, end, Compare(), alloc) {}
   set(std::initializer_list<T> init, const Compare& comp, const Allocator& alloc = Allocator())
   : set(std::begin(init), std::end(init), comp, alloc) {}
   set(std::initializer_list<T> init, const Allocator& alloc = Allocator())
   : set(init, Compare(), alloc) {}
   set(set&& rhs);
+  // Takes over the n elements in the tree of head, obtained from release
+  // on a set with an equal allocator, possibly in another process mapping
+  // the same file. Nothing is allocated.
+  set(adopt_nodes_t, node_type* head, size_type n, const Compare& comp = Compare(), const Allocator& alloc = Allocator())
+  : m_inner_alloc(alloc_traits_type::select_on_container_copy_construction(alloc))
+  , m_head(head), m_size(n), m_comp(comp) {}
+  // Gives up the nodes without releasing them, they stay in the buffer
+  // of the allocator, and returns the head of the tree. The set must not
+  // be used afterwards except to destroy it.
+  node_type* release() noexcept
+  {
+    node_type* p = std::addressof(*m_head);
+    m_head = 0;
+    m_size = 0;
+    return p;
+  }
   ~set() noexcept;
   void clear() noexcept;
   std::pair<iterator, bool> insert(const value_type& key) noexcept;
+  std::pair<iterator, bool> insert(value_type&& key);
+  // As insert but an exhausted allocator is reported by returning
+  // end() and false instead of std::bad_alloc. Usable with
+  // -fno-exceptions.
+  std::pair<iterator, bool> try_insert(const value_type& key) noexcept;
+  std::pair<iterator, bool> try_insert(value_type&& key);
+  iterator insert(const_iterator hint, const value_type& key)
+  { return emplace_hint(hint, key); }
+  iterator insert(const_iterator hint, value_type&& key)
+  { return emplace_hint(hint, std::move(key)); }
+  // The node is constructed before the search, and released if the key
+  // is already present.
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args);
+  // If the element goes right before hint, e.g. hint is end() and keys
+  // are increasing, it is linked there without searching the tree. The
+  // AVL policy needs the path from the root anyway and ignores it.
+  template <typename... Args>
+  iterator emplace_hint(const_iterator hint, Args&&... args);
   const_iterator begin() const noexcept
   {return const_iterator(tbst::inorder<1>(m_head));}
   const_iterator end() const noexcept {return const_iterator(m_head);}
@@ -139,26 +252,446 @@ class set {
   const_reverse_iterator rend() const noexcept {return const_reverse_iterator(begin());}
   key_compare key_comp() const noexcept {return m_comp;}
   value_compare value_comp() const noexcept {return m_comp;}
-  size_type size() const noexcept {return std::distance(begin(), end());}
-  bool empty() const noexcept {return begin() == end();}
+  size_type size() const noexcept {return m_size;}
+  bool empty() const noexcept {return m_size == 0;}
   Allocator get_allocator() const noexcept {return m_inner_alloc;}
   template<typename K>
   size_type count(const K& x) const noexcept;
   template<typename K>
   iterator find(const K& x) const;
+  // Range queries, one descent from the root each.
+  template<typename K>
+  iterator lower_bound(const K& x) const
+  { return iterator(tbst::lower_bound(m_head, x, m_comp)); }
+  template<typename K>
+  iterator upper_bound(const K& x) const
+  { return iterator(tbst::upper_bound(m_head, x, m_comp)); }
+  // Order statistics in the height of the tree, with tbst::ranked as
+  // Balance only. The element at position k in order, or end().
+  const_iterator nth(size_type k) const noexcept
+  {
+    static_assert(tbst::is_ranked<node_type>::value, "set: nth needs tbst::ranked.");
+    return const_iterator(tbst::select(m_head, k));
+  }
+  // The number of elements less than x, the position of lower_bound(x).
+  template<typename K>
+  size_type rank(const K& x) const
+  {
+    static_assert(tbst::is_ranked<node_type>::value, "set: rank needs tbst::ranked.");
+    return tbst::rank(m_head, x, m_comp);
+  }
+  // The number of elements in [lo, hi).
+  template<typename K>
+  size_type count_range(const K& lo, const K& hi) const
+  {
+    const size_type r = rank(hi);
+    const size_type l = rank(lo);
+    return r > l ? r - l : 0;
+  }
+  // Keys are unique, the range has at most one element and the upper
+  // end is the successor of the lower one.
+  template<typename K>
+  std::pair<iterator, iterator> equal_range(const K& x) const
+  {
+    iterator iter = lower_bound(x);
+    if (iter != end() && !m_comp(x, *iter))
+      return std::make_pair(iter, std::next(iter));
+    return std::make_pair(iter, iter);
+  }
+  // Looks up many keys at a time, the searches advance in lock step
+  // and prefetch their next node so that the cache misses overlap.
+  // Writes one iterator per key to out, end() if it is not found.
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt find_many(ForwardIt first, ForwardIt last, OutputIt out) const
+  {
+    auto f = [&](node_pointer p) { *out++ = iterator(p); };
+    find_group(first, last, f);
+    return out;
+  }
+  // Number of keys in [first, last) present in the set.
+  template <typename ForwardIt>
+  size_type count_many(ForwardIt first, ForwardIt last) const
+  {
+    size_type n = 0;
+    auto f = [&](node_pointer p) { n += p != m_head; };
+    find_group(first, last, f);
+    return n;
+  }
   template<typename K>
   size_type max_size() const noexcept { return std::numeric_limits<size_type>::max(); }
   template<typename InputIt>
   void insert(InputIt begin, InputIt end) noexcept;
+  // The range must be sorted and unique. It is built in one pass if
+  // the set is empty, otherwise inserted element by element.
+  template<typename InputIt>
+  void insert(sorted_unique_t, InputIt begin, InputIt end);
+  // Same as above with up to threads threads, 0 for one per core. The
+  // range should be random access, each thread fills the keys of a
+  // subtree from its own slice of it. The nodes are still allocated by
+  // the calling thread.
+  template<typename ForwardIt>
+  void insert(sorted_unique_t, ForwardIt begin, ForwardIt end, std::size_t threads);
+  // Applies f to all elements, concurrently from up to threads threads.
+  // The tree is split at its top levels into inorder ranges.
+  template <typename F>
+  void parallel_for_each(F f, std::size_t threads = 0) const;
+  // Reduces the elements in order with an associative op, the ranges
+  // are reduced in parallel and then combined on this thread.
+  template <typename U, typename BinaryOp>
+  U parallel_reduce(U init, BinaryOp op, std::size_t threads = 0) const;
   void swap(set& other) noexcept;
+  // Owns a node extracted from a set. node_type is already the name of
+  // the tree node, so the handle is called node_handle.
+  class node_handle {
+    private:
+    friend class set;
+    node_pointer m_p;
+    typename std::aligned_storage< sizeof (inner_allocator_type)
+                                 , alignof (inner_allocator_type)>::type m_alloc;
+    inner_allocator_type& alloc() noexcept
+    { return *reinterpret_cast<inner_allocator_type*>(&m_alloc); }
+    node_handle(node_pointer p, const inner_allocator_type& a) noexcept
+    : m_p(p) { ::new (&m_alloc) inner_allocator_type(a); }
+    node_pointer release() noexcept
+    {
+      node_pointer p = m_p;
+      alloc().~inner_allocator_type();
+      m_p = 0;
+      return p;
+    }
+    void reset() noexcept
+    {
+      if (!m_p)
+        return;
+      inner_alloc_traits_type::destroy(alloc(), std::addressof(m_p->key));
+      tbst::mark_free(m_p);
+      inner_alloc_traits_type::deallocate_node(alloc(), m_p);
+      release();
+    }
+    public:
+    using value_type = T;
+    using allocator_type = Allocator;
+    node_handle() noexcept : m_p(0) {}
+    node_handle(node_handle&& rhs) noexcept : m_p(0)
+    {
+      if (rhs.m_p)
+        ::new (&m_alloc) inner_allocator_type(rhs.alloc());
+      m_p = rhs.m_p;
+      if (rhs.m_p)
+        rhs.release();
+    }
+    node_handle& operator=(node_handle&& rhs) noexcept
+    {
+      if (this == &rhs)
+        return *this;
+      reset();
+      if (rhs.m_p) {
+        ::new (&m_alloc) inner_allocator_type(rhs.alloc());
+        m_p = rhs.m_p;
+        rhs.release();
+      }
+      return *this;
+    }
+    ~node_handle() noexcept { reset(); }
+    bool empty() const noexcept { return !m_p; }
+    explicit operator bool() const noexcept { return m_p != 0; }
+    value_type& value() const noexcept { return m_p->key; }
+    allocator_type get_allocator() const
+    { return *reinterpret_cast<const inner_allocator_type*>(&m_alloc); }
+  };
+  struct insert_return_type {
+    iterator position;
+    bool inserted;
+    node_handle node;
+  };
+  // Unlinks the node, nothing is released.
+  template <typename K>
+  node_handle extract(const K& key) noexcept;
+  // As erase by position, without a search where Balance allows it.
+  node_handle extract(const_iterator pos) noexcept;
+  // The handle must come from a set with an equal allocator. If the key
+  // is already present the node is given back in the result.
+  insert_return_type insert(node_handle&& nh) noexcept;
+  // Moves the elements of src that are not in *this. If the allocators
+  // compare equal, e.g. they share a node_alloc_header, the nodes are
+  // relinked and nothing is allocated, otherwise they are copied. The
+  // trees are walked together in order, each node is put with a hint:
+  // without balancing nothing is searched, O(n + m), while avl_balance
+  // and ranked search the path to rebalance, O(m log(n + m)).
+  void merge(set& src);
+  void merge(set&& src) { merge(src); }
   template <typename K>
   size_type erase(const K& key);
+  // Erase by position does not search the tree, the parent is found
+  // through the threads. Returns the element after the erased ones.
+  iterator erase(const_iterator pos) noexcept;
+  iterator erase(const_iterator first, const_iterator last) noexcept;
+  // Applies f to all elements in no particular order. If the allocator
+  // exposes its buffer (see node_allocator::blocks) it is scanned
+  // sequentially, which is much faster than an inorder traversal, or
+  // only the used blocks are visited if the header has a bitmap. In
+  // that case the buffer must not be shared with other containers,
+  // as their nodes would be visited as well.
+  template <typename F>
+  F for_each_unordered(F f) const
+  {
+    for_each_unordered(f, has_blocks<inner_allocator_type>());
+    return f;
+  }
+  // Relocates the nodes so that the inorder traversal walks the buffer
+  // of the allocator forward, with all free blocks after them. The work
+  // can be split in chunks with the compaction object, compact() does
+  // it at once. Same requirement on the buffer as for_each_unordered.
+  class compaction;
+  void compact();
+};
+
+/*
+  Incremental defragmentation of a set whose nodes live in the buffer of
+  a node_allocator. Each call to step does a bounded amount of work, so
+  that it can run in a realtime thread between other tasks:
+
+  1. The free blocks are taken from the avail stack, one per unit.
+  2. The k-th node in inorder, the head first, is moved to block k,
+     one node per unit. The node that was there, if any, is moved out
+     to a spare free block first. The parent and the threads pointing
+     to a node are found through the threads, in O(height).
+  3. The blocks after the nodes go back to the stack, one per unit, in
+     reverse order so that the next allocations walk the free tail
+     forward.
+
+  Between steps the set is consistent and can be read, but iterators
+  are invalidated and it must not be modified until step returns true,
+  the avail stack is empty meanwhile. A compaction destroyed earlier
+  gives back the free blocks it holds. Nothing is allocated. Moving a
+  node requires a free block, with a full buffer nothing is done.
+*/
+template <typename T, typename Compare, typename Allocator, typename Balance>
+class set<T, Compare, Allocator, Balance>::compaction {
+  static_assert( has_blocks<inner_allocator_type>::value
+               , "set: Compaction requires a node_allocator.");
+  static_assert( std::is_nothrow_move_constructible<T>::value
+               , "set: Compaction moves the keys.");
+  private:
+  enum class phase {drain, place, give_back, done};
+  set& m_set;
+  char* m_first; // Block 0.
+  std::size_t m_stride;
+  size_type m_n_blocks;
+  phase m_phase;
+  size_type m_i; // Blocks drained, placed, or left to give back.
+  size_type m_n_free;
+  size_type m_n_kept; // Blocks not given back.
+  node_pointer m_next; // Next node to place.
+  node_pointer m_spare;
+  node_pointer block(size_type i) const noexcept
+  { return reinterpret_cast<node_pointer>(m_first + i * m_stride); }
+  // The head is not marked in use.
+  bool is_free(node_pointer b) const noexcept
+  { return b != m_set.m_head && !tbst::test_in_use(*b); }
+  void relocate(node_pointer p, node_pointer to) noexcept;
+  void drain_one();
+  void place_one() noexcept;
+  void give_back_one();
+  // Gives back, from the end, the free blocks down to block kept.
+  void give_back(size_type kept) noexcept
+  {
+    m_n_kept = kept;
+    m_i = m_n_blocks;
+    m_phase = kept == m_n_blocks ? phase::done : phase::give_back;
+  }
+  public:
+  explicit compaction(set& s);
+  ~compaction();
+  compaction(const compaction&) = delete;
+  compaction& operator=(const compaction&) = delete;
+  // Does at most budget units of work. Returns true when done.
+  bool step(std::size_t budget);
+  bool done() const noexcept { return m_phase == phase::done; }
 };
 
-template <typename T, typename Compare, typename Allocator>
-set<T, Compare, Allocator>::set(set<T, Compare, Allocator>&& rhs)
+template <typename T, typename Compare, typename Allocator, typename Balance>
+set<T, Compare, Allocator, Balance>::compaction::compaction(set& s)
+: m_set(s)
+, m_first(0)
+, m_stride(0)
+, m_n_blocks(0)
+, m_phase(phase::done)
+, m_i(0)
+, m_n_free(0)
+, m_n_kept(0)
+, m_next(0)
+, m_spare(0)
+{
+  const auto range = s.m_inner_alloc.blocks();
+  // Headers on a slab_chain have no buffer to compact.
+  if (!range.size())
+    return;
+
+  // The buffer holds only the nodes of this set, head included.
+  m_first = reinterpret_cast<char*>(&*range.begin());
+  m_stride = range.stride();
+  m_n_blocks = range.size();
+  m_n_free = m_n_blocks - (s.m_size + 1);
+  if (m_n_free)
+    m_phase = phase::drain;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+set<T, Compare, Allocator, Balance>::compaction::~compaction()
+{
+  if (m_phase == phase::done)
+    return;
+
+  while (m_phase == phase::drain)
+    drain_one();
+
+  // Placed or not, the blocks not in use are ours.
+  if (m_phase == phase::place)
+    give_back(0);
+  while (m_phase == phase::give_back)
+    give_back_one();
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+bool set<T, Compare, Allocator, Balance>::compaction::step(std::size_t budget)
+{
+  for (; budget && m_phase != phase::done; --budget) {
+    switch (m_phase) {
+      case phase::drain: drain_one(); break;
+      case phase::place: place_one(); break;
+      case phase::give_back: give_back_one(); break;
+      case phase::done: break;
+    }
+  }
+  return m_phase == phase::done;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::compaction::drain_one()
+{
+  // Cleared tags tell the free blocks from the elements from now on.
+  m_spare = inner_alloc_traits_type::allocate_node(m_set.m_inner_alloc);
+  m_spare->tag = 0;
+  if (++m_i == m_n_free) {
+    m_phase = phase::place;
+    m_i = 0;
+    m_next = m_set.m_head;
+  }
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::compaction::place_one() noexcept
+{
+  const node_pointer b = block(m_i);
+  const node_pointer p = m_next;
+  if (p != b) {
+    if (!is_free(b))
+      relocate(b, m_spare);
+    relocate(p, b);
+    m_spare = p; // Left free in any case.
+  }
+
+  m_next = tbst::inorder<1>(b);
+  if (++m_i == m_n_blocks || m_next == m_set.m_head)
+    give_back(m_i);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::compaction::give_back_one()
+{
+  const node_pointer b = block(--m_i);
+  if (is_free(b))
+    inner_alloc_traits_type::deallocate_node(m_set.m_inner_alloc, b);
+  if (m_i == m_n_kept)
+    m_phase = phase::done;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::compaction::relocate(
+  node_pointer p, node_pointer to) noexcept
+{
+  const node_pointer head = m_set.m_head;
+  if (p == head) {
+    // Only the extreme nodes thread to the head.
+    if (!tbst::has_null_link<0>::apply(head)) {
+      tbst::inorder<1>(head)->link[0] = to;
+      tbst::inorder<0>(head)->link[1] = to;
+      to->link[0] = head->link[0];
+    } else {
+      to->link[0] = to;
+    }
+    to->link[1] = to;
+    to->tag = head->tag;
+    m_set.m_head = to;
+    head->tag = 0;
+    return;
+  }
+
+  // The parent and, if p has children, its inorder neighbours in them.
+  const node_pointer parent = tbst::find_parent(head, p);
+  const node_pointer pred =
+    tbst::has_null_link<0>::apply(p) ? node_pointer(0) : tbst::inorder<0>(p);
+  const node_pointer succ =
+    tbst::has_null_link<1>::apply(p) ? node_pointer(0) : tbst::inorder<1>(p);
+
+  to->link[0] = p->link[0];
+  to->link[1] = p->link[1];
+  to->tag = p->tag;
+  tbst::copy_count(to, p);
+  inner_alloc_traits_type::construct( m_set.m_inner_alloc, std::addressof(to->key)
+                                    , std::move(p->key));
+  inner_alloc_traits_type::destroy(m_set.m_inner_alloc, std::addressof(p->key));
+  p->tag = 0;
+
+  parent->link[parent->link[0] == p ? 0 : 1] = to;
+  if (pred)
+    pred->link[1] = to;
+  if (succ)
+    succ->link[0] = to;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::compact()
+{
+  compaction c(*this);
+  while (!c.step(std::numeric_limits<std::size_t>::max()));
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename F>
+void set<T, Compare, Allocator, Balance>::for_each_unordered(F& f, std::true_type) const
+{
+  const auto range = m_inner_alloc.blocks();
+  if (!range.size()) {
+    for_each_unordered(f, std::false_type());
+    return;
+  }
+
+  if (range.has_bitmap()) {
+    range.for_each_used([&](const node_type& o)
+    { if (&o != m_head) f(o.key); });
+    return;
+  }
+
+  for (const node_type& o: range)
+    if (tbst::test_in_use(o) && &o != m_head)
+      f(o.key);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename F>
+void set<T, Compare, Allocator, Balance>::for_each_unordered(F& f, std::false_type) const
+{
+  for (auto iter = begin(); iter != end(); ++iter)
+    f(*iter);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+set<T, Compare, Allocator, Balance>::set(set<T, Compare, Allocator, Balance>&& rhs)
 : m_inner_alloc(rhs.m_inner_alloc)
 , m_head(get_node())
+, m_size(0)
 , m_comp(std::move(rhs.m_comp))
 {
   m_head->link[0] = m_head;
@@ -166,34 +699,130 @@ set<T, Compare, Allocator>::set(set<T, Compare, Allocator>&& rhs)
   m_head->tag = tbst::detail::lbit;
   std::swap(m_inner_alloc, rhs.m_inner_alloc);
   std::swap(m_head, rhs.m_head);
+  std::swap(m_size, rhs.m_size);
 }
 
-template <typename T, typename Compare, typename Allocator>
+template <typename T, typename Compare, typename Allocator, typename Balance>
 template <typename K>
-typename set<T, Compare, Allocator>::size_type
-set<T, Compare, Allocator>::erase(const K& key)
+typename set<T, Compare, Allocator, Balance>::size_type
+set<T, Compare, Allocator, Balance>::erase(const K& key)
 {
-  auto pair = find_with_parent(m_head, key, m_comp);
-  const_node_pointer q = pair.first;
-  const_node_pointer pq = pair.second;
-  if (q == m_head)
+  node_pointer r = Balance::erase(m_head, key, m_comp);
+  if (r == m_head)
     return 0;
 
-  node_pointer r = tbst::erase_node<1>(const_cast<node_pointer>(pq), const_cast<node_pointer>(q));
-  release_node(r);
+  drop_node(r);
+  --m_size;
   return 1;
 }
 
-template <typename T, typename Compare, typename Allocator>
-void set<T, Compare, Allocator>::swap(set<T, Compare, Allocator>& other) noexcept
+template <typename T, typename Compare, typename Allocator, typename Balance>
+typename set<T, Compare, Allocator, Balance>::iterator
+set<T, Compare, Allocator, Balance>::erase(const_iterator pos) noexcept
+{
+  node_pointer p = pos.m_p;
+  node_pointer next = tbst::inorder<1>(p);
+  // Nodes are relinked, not their keys moved, so next stays valid.
+  drop_node(Balance::unlink(m_head, p, m_comp));
+  --m_size;
+  return iterator(next);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+typename set<T, Compare, Allocator, Balance>::iterator
+set<T, Compare, Allocator, Balance>::erase(const_iterator first, const_iterator last) noexcept
+{
+  if (first == begin() && last == end()) {
+    clear();
+    return end();
+  }
+
+  while (first != last)
+    first = erase(first);
+
+  return last;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::swap(set<T, Compare, Allocator, Balance>& other) noexcept
 {
   std::swap(m_inner_alloc, other.m_inner_alloc);
   std::swap(m_head, other.m_head);
+  std::swap(m_size, other.m_size);
   std::swap(m_comp, other.m_comp);
 }
 
-template <typename T, typename Compare, typename Allocator>
-set<T, Compare, Allocator>& set<T, Compare, Allocator>::operator=(const set<T, Compare, Allocator>& rhs) noexcept
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename K>
+typename set<T, Compare, Allocator, Balance>::node_handle
+set<T, Compare, Allocator, Balance>::extract(const K& key) noexcept
+{
+  node_pointer r = Balance::erase(m_head, key, m_comp);
+  if (r == m_head)
+    return node_handle();
+
+  --m_size;
+  return node_handle(r, m_inner_alloc);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+typename set<T, Compare, Allocator, Balance>::node_handle
+set<T, Compare, Allocator, Balance>::extract(const_iterator pos) noexcept
+{
+  node_pointer r = Balance::unlink(m_head, pos.m_p, m_comp);
+  --m_size;
+  return node_handle(r, m_inner_alloc);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+typename set<T, Compare, Allocator, Balance>::insert_return_type
+set<T, Compare, Allocator, Balance>::insert(node_handle&& nh) noexcept
+{
+  if (nh.empty())
+    return insert_return_type{end(), false, node_handle()};
+
+  node_pointer q = nh.m_p;
+  auto make_node = [q](const value_type&) { return q; };
+  auto pair = Balance::insert(m_head, q->key, m_comp, make_node);
+  if (!pair.second)
+    return insert_return_type{iterator(pair.first), false, std::move(nh)};
+
+  nh.release();
+  ++m_size;
+  return insert_return_type{iterator(q), true, node_handle()};
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::merge(set<T, Compare, Allocator, Balance>& src)
+{
+  if (this == &src)
+    return;
+
+  // Both trees are walked in order, q is the first element of *this
+  // not less than p, before which p goes.
+  const bool splice = m_inner_alloc == src.m_inner_alloc;
+  node_pointer q = tbst::inorder<1>(m_head);
+  node_pointer p = tbst::inorder<1>(src.m_head);
+  while (p != src.m_head) {
+    node_pointer next = tbst::inorder<1>(p);
+    while (q != m_head && m_comp(q->key, p->key))
+      q = tbst::inorder<1>(q);
+    if (q == m_head || m_comp(p->key, q->key)) {
+      if (splice) {
+        Balance::insert_hint(m_head, q, Balance::unlink(src.m_head, p, src.m_comp), m_comp);
+        --src.m_size;
+        ++m_size;
+      } else {
+        emplace_hint(iterator(q), p->key);
+        src.erase(iterator(p));
+      }
+    }
+    p = next;
+  }
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+set<T, Compare, Allocator, Balance>& set<T, Compare, Allocator, Balance>::operator=(const set<T, Compare, Allocator, Balance>& rhs) noexcept
 {
   // This ctor can fail if the allocator runs out of memory.
   if (this == &rhs)
@@ -208,18 +837,30 @@ set<T, Compare, Allocator>& set<T, Compare, Allocator>::operator=(const set<T, C
   return *this;
 }
 
-template <typename T, typename Compare, typename Allocator>
-set<T, Compare, Allocator>& set<T, Compare, Allocator>::operator=(std::initializer_list<T> init) noexcept
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::assign(const set<T, Compare, Allocator, Balance>& rhs) noexcept
+{
+  if (this == &rhs)
+    return;
+
+  clear();
+  m_comp = rhs.m_comp;
+  rhs.copy(*this);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+set<T, Compare, Allocator, Balance>& set<T, Compare, Allocator, Balance>::operator=(std::initializer_list<T> init) noexcept
 {
   clear();
   insert(std::begin(init), std::end(init));
   return *this;
 }
 
-template <typename T, typename Compare, typename Allocator>
-set<T, Compare, Allocator>::set(const set<T, Compare, Allocator>& rhs) noexcept
+template <typename T, typename Compare, typename Allocator, typename Balance>
+set<T, Compare, Allocator, Balance>::set(const set<T, Compare, Allocator, Balance>& rhs) noexcept
 : m_inner_alloc(inner_alloc_traits_type::select_on_container_copy_construction(rhs.m_inner_alloc))
 , m_head(get_node())
+, m_size(0)
 {
   m_head->link[0] = m_head;
   m_head->link[1] = m_head;
@@ -228,10 +869,11 @@ set<T, Compare, Allocator>::set(const set<T, Compare, Allocator>& rhs) noexcept
   rhs.copy(*this);
 }
 
-template <typename T, typename Compare, typename Allocator>
-set<T, Compare, Allocator>::set(const Compare& comp, const Allocator& alloc)
+template <typename T, typename Compare, typename Allocator, typename Balance>
+set<T, Compare, Allocator, Balance>::set(const Compare& comp, const Allocator& alloc)
 : m_inner_alloc(alloc_traits_type::select_on_container_copy_construction(alloc))
 , m_head(get_node())
+, m_size(0)
 , m_comp(comp)
 {
   m_head->link[0] = m_head;
@@ -239,11 +881,12 @@ set<T, Compare, Allocator>::set(const Compare& comp, const Allocator& alloc)
   m_head->tag = tbst::detail::lbit;
 }
 
-template <typename T, typename Compare, typename Allocator>
+template <typename T, typename Compare, typename Allocator, typename Balance>
 template <typename InputIt>
-set<T, Compare, Allocator>::set(InputIt begin, InputIt end, const Compare& comp, const Allocator& alloc)
+set<T, Compare, Allocator, Balance>::set(InputIt begin, InputIt end, const Compare& comp, const Allocator& alloc)
 : m_inner_alloc(alloc_traits_type::select_on_container_copy_construction(alloc))
 , m_head(get_node())
+, m_size(0)
 , m_comp(comp)
 {
   m_head->link[0] = m_head;
@@ -252,14 +895,33 @@ set<T, Compare, Allocator>::set(InputIt begin, InputIt end, const Compare& comp,
   insert(begin, end);
 }
 
-template <typename T, typename Compare, typename Allocator>
-void set<T, Compare, Allocator>::clear() noexcept
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename InputIt>
+set<T, Compare, Allocator, Balance>::set(sorted_unique_t, InputIt begin, InputIt end, const Compare& comp, const Allocator& alloc)
+: m_inner_alloc(alloc_traits_type::select_on_container_copy_construction(alloc))
+, m_head(get_node())
+, m_size(0)
+, m_comp(comp)
+{
+  m_head->link[0] = m_head;
+  m_head->link[1] = m_head;
+  m_head->tag = tbst::detail::lbit;
+  RTCPP_TRY {
+    insert(sorted_unique, begin, end);
+  } RTCPP_CATCH_ALL {
+    release_node(m_head);
+    RTCPP_RETHROW
+  }
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::clear() noexcept
 {
   node_pointer p = m_head;
   for (;;) {
     node_pointer q = tbst::inorder<1>(p);
     if (p != m_head) {
-      inner_alloc_traits_type::destroy(m_inner_alloc, &q->key);
+      inner_alloc_traits_type::destroy(m_inner_alloc, std::addressof(p->key));
       release_node(p);
     }
     if (q == m_head)
@@ -269,24 +931,76 @@ void set<T, Compare, Allocator>::clear() noexcept
   m_head->link[0] = m_head;
   m_head->link[1] = m_head;
   m_head->tag = tbst::detail::lbit;
+  m_size = 0;
 }
 
-template <typename T, typename Compare, typename Allocator>
-set<T, Compare, Allocator>::~set() noexcept
+template <typename T, typename Compare, typename Allocator, typename Balance>
+set<T, Compare, Allocator, Balance>::~set() noexcept
 {
+  if (!m_head)
+    return;
+
   clear();
   release_node(m_head);
 }
 
-template <typename T, typename Compare, typename Allocator>
-void set<T, Compare, Allocator>::copy(set<T, Compare, Allocator>& rhs) const noexcept
+template <typename T, typename Compare, typename Allocator, typename Balance>
+set<T, Compare, Allocator, Balance>::set(const set<T, Compare, Allocator, Balance>& rhs, const Allocator& alloc) noexcept
+: set(rhs.m_comp, alloc)
+{
+  rhs.copy(*this);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::rebase_links(node_type& o, std::ptrdiff_t d, std::true_type) noexcept
 {
+  using link_type = typename node_type::self_pointer;
+  for (link_type& l : o.link)
+    l = reinterpret_cast<link_type>(reinterpret_cast<char*>(l) + d);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+bool set<T, Compare, Allocator, Balance>::clone(set<T, Compare, Allocator, Balance>& rhs, std::true_type) const noexcept
+{
+  if (rhs.m_size != 0 || !rhs.m_inner_alloc.copy_buffer(m_inner_alloc))
+    return false;
+
+  const auto range = rhs.m_inner_alloc.blocks();
+  const std::ptrdiff_t d = reinterpret_cast<char*>(&*std::begin(range))
+                         - reinterpret_cast<char*>(&*std::begin(m_inner_alloc.blocks()));
+  rhs.m_head = reinterpret_cast<node_pointer>(reinterpret_cast<char*>(std::addressof(*m_head)) + d);
+  rhs.m_size = m_size;
+
+  const std::integral_constant<bool, std::is_pointer<void_pointer>::value> raw;
+  auto f = [=](node_type& o) { rebase_links(o, d, raw); };
+  if (!raw)
+    return true;
+  if (range.has_bitmap()) {
+    range.for_each_used(f);
+    return true;
+  }
+  // The tag of the head has no in_use bit.
+  for (node_type& o: range)
+    if (tbst::test_in_use(o) || &o == std::addressof(*rhs.m_head))
+      f(o);
+  return true;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::copy(set<T, Compare, Allocator, Balance>& rhs) const noexcept
+{
+  using clonable = std::integral_constant< bool
+                                         , has_copy_buffer<inner_allocator_type>::value
+                                        && std::is_trivially_copyable<T>::value>;
+  if (clone(rhs, clonable()))
+    return;
+
   const_node_pointer p = m_head;
   node_pointer q = rhs.m_head;
 
   for (;;) {
     if (!tbst::has_null_link<0>::apply(p)) {
-      node_pointer tmp = get_node();
+      node_pointer tmp = rhs.get_node();
       tbst::attach_node<0>(q, tmp);
     }
 
@@ -297,86 +1011,177 @@ void set<T, Compare, Allocator>::copy(set<T, Compare, Allocator>& rhs) const noe
       break;
 
     if (!tbst::has_null_link<1>::apply(p)) {
-      node_pointer tmp = get_node();
+      node_pointer tmp = rhs.get_node();
       tbst::attach_node<1>(q, tmp);
     }
 
-    q->key = p->key;
+    inner_alloc_traits_type::construct(rhs.m_inner_alloc, std::addressof(q->key), p->key);
+    q->tag = (q->tag & ~tbst::detail::balance_mask)
+           | (p->tag & tbst::detail::balance_mask);
+    tbst::copy_count(q, p);
   }
+  rhs.m_size = m_size;
 }
 
-template <typename T, typename Compare, typename Allocator>
-typename set<T, Compare, Allocator>::node_pointer
-set<T, Compare, Allocator>::get_node() const
+template <typename T, typename Compare, typename Allocator, typename Balance>
+typename set<T, Compare, Allocator, Balance>::node_pointer
+set<T, Compare, Allocator, Balance>::get_node() const
 { 
   auto p = inner_alloc_traits_type::allocate_node(m_inner_alloc);
   tbst::mark_in_use(p);
   return p;
 }
 
-template <typename T, typename Compare, typename Allocator>
-void set<T, Compare, Allocator>::release_node(
-  typename set<T, Compare, Allocator>::node_pointer p) const
+template <typename T, typename Compare, typename Allocator, typename Balance>
+typename set<T, Compare, Allocator, Balance>::node_pointer
+set<T, Compare, Allocator, Balance>::try_get_node() const
+{
+  auto p = inner_alloc_traits_type::try_allocate_node(m_inner_alloc);
+  if (p)
+    tbst::mark_in_use(p);
+  return p;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::release_node(
+  typename set<T, Compare, Allocator, Balance>::node_pointer p) const
 { 
   tbst::mark_free(p);
   inner_alloc_traits_type::deallocate_node(m_inner_alloc, p);
 }
 
-template <typename T, typename Compare, typename Allocator>
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename... Args>
 void
-set<T, Compare, Allocator>::safe_construct(
-  typename set<T, Compare, Allocator>::node_pointer p
-  , const typename set<T, Compare, Allocator>::value_type& key) const
+set<T, Compare, Allocator, Balance>::safe_construct(
+  typename set<T, Compare, Allocator, Balance>::node_pointer p
+  , Args&&... args) const
 {
-  try {
-    inner_alloc_traits_type::construct(m_inner_alloc, std::addressof(p->key), key);
-  } catch (...) {
+  RTCPP_TRY {
+    inner_alloc_traits_type::construct( m_inner_alloc, std::addressof(p->key)
+                                      , std::forward<Args>(args)...);
+  } RTCPP_CATCH_ALL {
     release_node(p);
-    throw;
+    RTCPP_RETHROW
   }
 }
 
-template <typename T, typename Compare, typename Allocator>
-std::pair<typename set<T, Compare, Allocator>::iterator, bool>
-set<T, Compare, Allocator>::insert(const typename set<T, Compare, Allocator>::value_type& key) noexcept
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename... Args>
+typename set<T, Compare, Allocator, Balance>::node_pointer
+set<T, Compare, Allocator, Balance>::make_node(Args&&... args) const
 {
-  if (tbst::has_null_link<0>::apply(m_head)) { // The tree is empty
+  node_pointer q = get_node();
+  safe_construct(q, std::forward<Args>(args)...);
+  return q;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::drop_node(node_pointer p) const noexcept
+{
+  inner_alloc_traits_type::destroy(m_inner_alloc, std::addressof(p->key));
+  release_node(p);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+std::pair<typename set<T, Compare, Allocator, Balance>::iterator, bool>
+set<T, Compare, Allocator, Balance>::insert(const typename set<T, Compare, Allocator, Balance>::value_type& key) noexcept
+{
+  auto make_node = [this](const value_type& k)
+  {
     node_pointer q = get_node();
-    safe_construct(q, key);
-    tbst::attach_node<0>(m_head, q);
-    return std::make_pair(const_iterator(q), true);
+    safe_construct(q, k);
+    return q;
+  };
+  auto pair = Balance::insert(m_head, key, m_comp, make_node);
+  if (pair.second)
+    ++m_size;
+  return std::make_pair(iterator(pair.first), pair.second);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+std::pair<typename set<T, Compare, Allocator, Balance>::iterator, bool>
+set<T, Compare, Allocator, Balance>::insert(value_type&& key)
+{
+  // The key is moved only once it is known to be absent.
+  auto f = [&](const value_type&) { return make_node(std::move(key)); };
+  auto pair = Balance::insert(m_head, key, m_comp, f);
+  if (pair.second)
+    ++m_size;
+  return std::make_pair(iterator(pair.first), pair.second);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+std::pair<typename set<T, Compare, Allocator, Balance>::iterator, bool>
+set<T, Compare, Allocator, Balance>::try_insert(const value_type& key) noexcept
+{
+  auto make_node = [this](const value_type& k)
+  {
+    node_pointer q = try_get_node();
+    if (q)
+      safe_construct(q, k);
+    return q;
+  };
+  auto pair = Balance::insert(m_head, key, m_comp, make_node);
+  if (pair.second)
+    ++m_size;
+  return std::make_pair(iterator(pair.first), pair.second);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+std::pair<typename set<T, Compare, Allocator, Balance>::iterator, bool>
+set<T, Compare, Allocator, Balance>::try_insert(value_type&& key)
+{
+  auto f = [&](const value_type&)
+  {
+    node_pointer q = try_get_node();
+    if (q)
+      safe_construct(q, std::move(key));
+    return q;
+  };
+  auto pair = Balance::insert(m_head, key, m_comp, f);
+  if (pair.second)
+    ++m_size;
+  return std::make_pair(iterator(pair.first), pair.second);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename... Args>
+std::pair<typename set<T, Compare, Allocator, Balance>::iterator, bool>
+set<T, Compare, Allocator, Balance>::emplace(Args&&... args)
+{
+  node_pointer q = make_node(std::forward<Args>(args)...);
+  auto f = [q](const value_type&) { return q; };
+  auto pair = Balance::insert(m_head, q->key, m_comp, f);
+  if (!pair.second) {
+    drop_node(q);
+    return std::make_pair(iterator(pair.first), false);
   }
 
-  node_pointer p = m_head->link[0];
-  for (;;) {
-    if (m_comp(key, p->key)) {
-      if (!tbst::has_null_link<0>::apply(p)) {
-        p = p->link[0];
-      } else {
-        node_pointer q = get_node();
-        safe_construct(q, key);
-        tbst::attach_node<0>(p, q);
-        return std::make_pair(q, true);
-      }
-    } else if (m_comp(p->key, key)) {
-      if (!tbst::has_null_link<1>::apply(p)) {
-        p = p->link[1];
-      } else {
-        node_pointer q = get_node();
-        safe_construct(q, key);
-        tbst::attach_node<1>(p, q);
-        return std::make_pair(q, true);
-      }
-    } else {
-      return std::make_pair(p, false);
-    }
+  ++m_size;
+  return std::make_pair(iterator(q), true);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename... Args>
+typename set<T, Compare, Allocator, Balance>::iterator
+set<T, Compare, Allocator, Balance>::emplace_hint(const_iterator hint, Args&&... args)
+{
+  node_pointer q = make_node(std::forward<Args>(args)...);
+  auto pair = Balance::insert_hint(m_head, hint.m_p, q, m_comp);
+  if (!pair.second) {
+    drop_node(q);
+    return iterator(pair.first);
   }
+
+  ++m_size;
+  return iterator(q);
 }
 
-template <typename T, typename Compare, typename Allocator>
+template <typename T, typename Compare, typename Allocator, typename Balance>
 template <typename K>
-typename set<T, Compare, Allocator>::size_type
-set<T, Compare, Allocator>::count(const K& key) const noexcept
+typename set<T, Compare, Allocator, Balance>::size_type
+set<T, Compare, Allocator, Balance>::count(const K& key) const noexcept
 {
   if (tbst::has_null_link<0>::apply(m_head)) // The tree is empty
     return 0;
@@ -399,10 +1204,10 @@ set<T, Compare, Allocator>::count(const K& key) const noexcept
   }
 }
 
-template <typename T, typename Compare, typename Allocator>
+template <typename T, typename Compare, typename Allocator, typename Balance>
 template <typename K>
-typename set<T, Compare, Allocator>::iterator
-set<T, Compare, Allocator>::find(const K& key) const
+typename set<T, Compare, Allocator, Balance>::iterator
+set<T, Compare, Allocator, Balance>::find(const K& key) const
 {
   // The function below is not the most efficient because it
   // has an additional pointer to chase the parent pointer.
@@ -410,31 +1215,440 @@ set<T, Compare, Allocator>::find(const K& key) const
   return find_with_parent(m_head, key, m_comp).first;
 }
 
-template <typename T, typename Compare, typename Allocator>
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename ForwardIt, typename F>
+void set<T, Compare, Allocator, Balance>::find_group(ForwardIt first, ForwardIt last, F& f) const
+{
+  // Searches in flight, enough to cover the memory latency.
+  constexpr std::size_t group = 16;
+  ForwardIt key[group];
+  node_pointer p[group];
+  node_pointer res[group];
+  const bool empty_tree = tbst::has_null_link<0>::apply(m_head);
+
+  while (first != last) {
+    std::size_t n = 0;
+    for (; n < group && first != last; ++n, ++first) {
+      key[n] = first;
+      res[n] = m_head;
+      p[n] = empty_tree ? node_pointer(0) : node_pointer(m_head->link[0]);
+      if (p[n])
+        prefetch(std::addressof(*p[n]));
+    }
+
+    for (std::size_t active = empty_tree ? 0 : n; active != 0;) {
+      for (std::size_t i = 0; i < n; ++i) {
+        node_pointer q = p[i];
+        if (!q)
+          continue;
+
+        std::size_t d = 0;
+        if (m_comp(*key[i], q->key)) {
+          d = 0;
+        } else if (m_comp(q->key, *key[i])) {
+          d = 1;
+        } else {
+          res[i] = q;
+          p[i] = 0;
+          --active;
+          continue;
+        }
+
+        const bool null = d ? tbst::has_null_link<1>::apply(q)
+                            : tbst::has_null_link<0>::apply(q);
+        if (null) {
+          p[i] = 0;
+          --active;
+          continue;
+        }
+
+        p[i] = q->link[d];
+        prefetch(std::addressof(*p[i]));
+      }
+    }
+
+    for (std::size_t i = 0; i < n; ++i)
+      f(res[i]);
+  }
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename InputIt>
+void set<T, Compare, Allocator, Balance>::insert(InputIt begin, InputIt end) noexcept
+{
+  using category = typename std::iterator_traits<InputIt>::iterator_category;
+  insert_range(begin, end, category());
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename InputIt>
+void set<T, Compare, Allocator, Balance>::insert_range(InputIt begin, InputIt end, std::input_iterator_tag)
+{
+  for (InputIt iter = begin; iter != end; ++iter)
+    insert(*iter);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename ForwardIt>
+void set<T, Compare, Allocator, Balance>::insert_range(ForwardIt begin, ForwardIt end, std::forward_iterator_tag)
+{
+  auto not_less = [this](const T& a, const T& b) { return !m_comp(a, b); };
+  if (empty() && std::adjacent_find(begin, end, not_less) == end) {
+    insert(sorted_unique, begin, end);
+    return;
+  }
+
+  insert_range(begin, end, std::input_iterator_tag());
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
 template <typename InputIt>
-void set<T, Compare, Allocator>::insert(InputIt begin, InputIt end) noexcept
+void set<T, Compare, Allocator, Balance>::insert(sorted_unique_t, InputIt begin, InputIt end)
+{
+  using category = typename std::iterator_traits<InputIt>::iterator_category;
+  const bool forward =
+    std::is_base_of<std::forward_iterator_tag, category>::value;
+  if (!forward || !empty() || !std::is_nothrow_copy_constructible<T>::value) {
+    insert_range(begin, end, std::input_iterator_tag());
+    return;
+  }
+
+  bulk_build(begin, std::distance(begin, end));
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename ForwardIt>
+void set<T, Compare, Allocator, Balance>::insert(sorted_unique_t, ForwardIt begin, ForwardIt end, std::size_t threads)
 {
-  for (InputIt iter = begin; iter != end; ++iter) {
-    auto pair = insert(*iter);
-    if (!pair.second)
-       continue;
+  if (!empty() || !std::is_nothrow_copy_constructible<T>::value) {
+    insert_range(begin, end, std::input_iterator_tag());
+    return;
   }
+
+  bulk_build(begin, std::distance(begin, end), threads ? threads : hardware_threads());
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+std::vector<typename set<T, Compare, Allocator, Balance>::iterator>
+set<T, Compare, Allocator, Balance>::split(std::size_t parts) const
+{
+  // The nodes above level d in inorder, they bound at most 2^d ranges.
+  std::size_t d = 0;
+  while ((std::size_t(1) << d) < parts)
+    ++d;
+
+  std::vector<iterator> bounds(1, begin());
+  if (tbst::has_null_link<0>::apply(m_head))
+    return bounds;
+
+  auto walk = [&](node_pointer p, std::size_t level, const auto& self) -> void
+  {
+    if (level == d)
+      return;
+    if (!tbst::has_null_link<0>::apply(p))
+      self(p->link[0], level + 1, self);
+    if (bounds.back().m_p != p)
+      bounds.push_back(iterator(p));
+    if (!tbst::has_null_link<1>::apply(p))
+      self(p->link[1], level + 1, self);
+  };
+  walk(m_head->link[0], 0, walk);
+  return bounds;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename F>
+void set<T, Compare, Allocator, Balance>::parallel_for_each(F f, std::size_t threads) const
+{
+  if (!threads)
+    threads = hardware_threads();
+
+  // More ranges than threads in case the tree is unbalanced.
+  std::vector<iterator> bounds = split(4 * threads);
+  bounds.push_back(end());
+  const std::size_t n = bounds.size() - 1;
+  const std::size_t m = std::min(threads, n);
+  parallel_run(m, [&](std::size_t i)
+  {
+    for (std::size_t j = i; j < n; j += m)
+      std::for_each(bounds[j], bounds[j + 1], std::ref(f));
+  });
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename U, typename BinaryOp>
+U set<T, Compare, Allocator, Balance>::parallel_reduce(U init, BinaryOp op, std::size_t threads) const
+{
+  if (!threads)
+    threads = hardware_threads();
+
+  std::vector<iterator> bounds = split(4 * threads);
+  bounds.push_back(end());
+  const std::size_t n = bounds.size() - 1;
+
+  // Each range starts from its first element, so init is used once.
+  std::vector<std::unique_ptr<U>> partial(n);
+  const std::size_t m = std::min(threads, n);
+  parallel_run(m, [&](std::size_t i)
+  {
+    for (std::size_t j = i; j < n; j += m) {
+      iterator iter = bounds[j];
+      if (iter == bounds[j + 1])
+        continue;
+      std::unique_ptr<U> acc(new U(*iter));
+      for (++iter; iter != bounds[j + 1]; ++iter)
+        *acc = op(std::move(*acc), *iter);
+      partial[j] = std::move(acc);
+    }
+  });
+
+  for (auto& o: partial)
+    if (o)
+      init = op(std::move(init), std::move(*o));
+
+  return init;
 }
 
-template<typename Key, typename Compare, typename Alloc>
-bool operator==( const set<Key, Compare, Alloc>& lhs
-               , const set<Key, Compare, Alloc>& rhs) noexcept
+template <typename T, typename Compare, typename Allocator, typename Balance>
+void set<T, Compare, Allocator, Balance>::release_subtree(node_pointer p) const noexcept
+{
+  if (!tbst::has_null_link<0>::apply(p))
+    release_subtree(p->link[0]);
+  if (!tbst::has_null_link<1>::apply(p))
+    release_subtree(p->link[1]);
+  release_node(p);
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+typename set<T, Compare, Allocator, Balance>::node_pointer
+set<T, Compare, Allocator, Balance>::build_shape(size_type n)
+{
+  // Builds a complete binary tree, the shape is fixed by n. Node k,
+  // counting from 1 in breadth first order, has children 2k and 2k + 1
+  // and the nodes are allocated in that order. Those still waiting
+  // for their children are queued through their right link, which is
+  // a thread and gets its final value in fill_subtree.
+  using namespace tbst::detail;
+  std::size_t lg = 0; // floor(log2(n))
+  while ((n >> lg) > 1)
+    ++lg;
+
+  // Height of the subtree of node k at level l.
+  auto height = [=](std::size_t k, std::size_t l) -> std::size_t
+  {
+    if (k > n)
+      return 0;
+    const std::size_t t = lg - l;
+    return ((k << t) <= n) ? t + 1 : t;
+  };
+
+  // The balance factor of node k at level l, used by avl_balance.
+  auto tag = [=](std::size_t k, std::size_t l) -> unsigned char
+  {
+    const bool b = height(2 * k, l + 1) != height(2 * k + 1, l + 1);
+    return static_cast<unsigned char>(
+      lbit | rbit | in_use_bit | (b ? lhigh_bit : 0));
+  };
+
+  const tbst::is_ranked<node_type> ranked;
+  node_pointer root = get_node();
+  root->tag = tag(1, 0);
+  shape_count(root, 1, n, ranked);
+  node_pointer front = root;
+  node_pointer back = root;
+  std::size_t level = 0;
+  for (std::size_t k = 2; k <= n; ++k) {
+    if ((k & (k - 1)) == 0)
+      ++level;
+
+    node_pointer q;
+    RTCPP_TRY {
+      q = get_node();
+    } RTCPP_CATCH_ALL {
+      release_subtree(root);
+      RTCPP_RETHROW
+    }
+    q->tag = tag(k, level);
+    shape_count(q, k, n, ranked);
+
+    if (k % 2 == 0) {
+      front->link[0] = q;
+      tbst::unset_link_null<0>::apply(front);
+    } else {
+      node_pointer next = front->link[1];
+      front->link[1] = q;
+      tbst::unset_link_null<1>::apply(front);
+      front = next;
+    }
+    back->link[1] = q;
+    back = q;
+  }
+
+  return root;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+typename set<T, Compare, Allocator, Balance>::size_type
+set<T, Compare, Allocator, Balance>::subtree_size(size_type k, size_type n) noexcept
+{
+  // The descendants of k on each level are consecutive in breadth
+  // first order.
+  size_type m = 0;
+  for (size_type a = k, b = k; a <= n; a = 2 * a, b = 2 * b + 1)
+    m += std::min(b, n) - a + 1;
+  return m;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename ForwardIt>
+void set<T, Compare, Allocator, Balance>::fill_subtree(node_pointer root, ForwardIt begin, node_pointer prev, node_pointer next)
+{
+  // Inorder traversal setting the keys and the threads. prev and next
+  // are the inorder neighbours of the subtree, only the null links of
+  // the subtree are written.
+  node_pointer stack[8 * sizeof (size_type)];
+  std::size_t top = 0;
+  node_pointer p = root;
+  for (;;) {
+    for (; p; p = tbst::has_null_link<0>::apply(p) ? node_pointer(0)
+                                                   : node_pointer(p->link[0]))
+      stack[top++] = p;
+
+    if (top == 0)
+      break;
+
+    node_pointer x = stack[--top];
+    inner_alloc_traits_type::construct(m_inner_alloc, std::addressof(x->key), *begin);
+    ++begin;
+    if (tbst::has_null_link<0>::apply(x))
+      x->link[0] = prev;
+    if (tbst::has_null_link<1>::apply(prev))
+      prev->link[1] = x;
+    prev = x;
+    p = tbst::has_null_link<1>::apply(x) ? node_pointer(0)
+                                        : node_pointer(x->link[1]);
+  }
+  prev->link[1] = next;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename ForwardIt>
+void set<T, Compare, Allocator, Balance>::bulk_build(ForwardIt begin, size_type n)
+{
+  if (n == 0)
+    return;
+
+  node_pointer root = build_shape(n);
+  fill_subtree(root, begin, m_head, m_head);
+  m_head->link[0] = root;
+  tbst::unset_link_null<0>::apply(m_head);
+  m_size = n;
+}
+
+template <typename T, typename Compare, typename Allocator, typename Balance>
+template <typename ForwardIt>
+void set<T, Compare, Allocator, Balance>::bulk_build(ForwardIt begin, size_type n, std::size_t threads)
+{
+  // The nodes are allocated here in breadth first order, the allocators
+  // are not required to be thread safe. The subtrees rooted at level d
+  // get their keys and threads in parallel, each from its own slice of
+  // the input, the nodes above them on this thread.
+  std::size_t d = 0;
+  while ((std::size_t(1) << d) < threads && (n >> (d + 1)) > 1)
+    ++d;
+
+  if (threads < 2 || d == 0 || n < (size_type(1) << 14)) {
+    bulk_build(begin, n);
+    return;
+  }
+
+  struct task {
+    node_pointer root;
+    size_type offset;
+    node_pointer prev;
+    node_pointer next;
+  };
+
+  node_pointer root = build_shape(n);
+  std::vector<task> tasks;
+  tasks.reserve(std::size_t(1) << d);
+
+  // Inorder walk of the levels above d. All of them are full since
+  // d <= floor(log2(n)), so those nodes have both children.
+  size_type offset = 0;
+  node_pointer prev = m_head;
+  auto walk = [&](node_pointer p, size_type k, std::size_t level, const auto& self) -> void
+  {
+    if (level == d) {
+      tasks.push_back(task{p, offset, prev, m_head});
+      offset += subtree_size(k, n);
+      return;
+    }
+    self(p->link[0], 2 * k, level + 1, self);
+    inner_alloc_traits_type::construct( m_inner_alloc, std::addressof(p->key)
+                                      , *std::next(begin, offset));
+    ++offset;
+    tasks.back().next = p;
+    prev = p;
+    self(p->link[1], 2 * k + 1, level + 1, self);
+  };
+  walk(root, 1, 0, walk);
+
+  // Starting a thread can fail, the tasks it did not run are done here.
+  std::vector<char> done(tasks.size(), 0);
+  auto run = [&](std::size_t j)
+  {
+    const task& t = tasks[j];
+    fill_subtree(t.root, std::next(begin, t.offset), t.prev, t.next);
+    done[j] = 1;
+  };
+  RTCPP_TRY {
+    parallel_run(threads, [&](std::size_t i)
+    {
+      for (std::size_t j = i; j < tasks.size(); j += threads)
+        run(j);
+    });
+  } RTCPP_CATCH_ALL {
+    for (std::size_t j = 0; j < tasks.size(); ++j)
+      if (!done[j])
+        run(j);
+  }
+
+  m_head->link[0] = root;
+  tbst::unset_link_null<0>::apply(m_head);
+  m_size = n;
+}
+
+template<typename Key, typename Compare, typename Alloc, typename Balance>
+bool operator==( const set<Key, Compare, Alloc, Balance>& lhs
+               , const set<Key, Compare, Alloc, Balance>& rhs) noexcept
 {
   const bool b1 = lhs.size() == rhs.size();
   const bool b2 = std::equal(std::begin(lhs), std::end(lhs), std::begin(rhs));
   return b1 && b2;
 }
 
-template<typename Key, typename Compare, typename Alloc>
-bool operator!=( const set<Key, Compare, Alloc>& lhs
-               , const set<Key, Compare, Alloc>& rhs) noexcept
+template<typename Key, typename Compare, typename Alloc, typename Balance>
+bool operator!=( const set<Key, Compare, Alloc, Balance>& lhs
+               , const set<Key, Compare, Alloc, Balance>& rhs) noexcept
 { return !(lhs == rhs); }
 
+// Erases the elements that satisfy pred in one inorder pass. Returns the
+// number of erased elements.
+template<typename Key, typename Compare, typename Alloc, typename Balance, typename Pred>
+typename set<Key, Compare, Alloc, Balance>::size_type
+erase_if(set<Key, Compare, Alloc, Balance>& c, Pred pred)
+{
+  const auto n = c.size();
+  for (auto iter = c.begin(); iter != c.end();) {
+    if (pred(*iter))
+      iter = c.erase(iter);
+    else
+      ++iter;
+  }
+  return n - c.size();
+}
+
 }
 
 namespace std {
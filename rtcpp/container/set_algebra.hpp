@@ -0,0 +1,170 @@
+#pragma once
+
+#include <iterator>
+
+#include "set.hpp"
+
+/*
+  Union, intersection, difference and symmetric difference of two
+  rt::set. Both trees are walked in order through their threads and
+  the result, which comes out sorted and unique, is built with the
+  bulk build of rt::set, so the whole operation is linear. The sets
+  must use equivalent comparison objects.
+
+  set_op_iterator computes the result lazily and can also be used
+  with any pair of sorted unique ranges.
+*/
+
+namespace rt {
+
+enum class set_op {union_op, intersection_op, difference_op, symmetric_difference_op};
+
+template <typename Iter, typename Compare, set_op Op>
+class set_op_iterator :
+  public std::iterator< std::forward_iterator_tag
+                      , const typename std::iterator_traits<Iter>::value_type> {
+  private:
+  Iter m_a;
+  Iter m_a_end;
+  Iter m_b;
+  Iter m_b_end;
+  Compare m_comp;
+  // Skips the elements that do not belong to the result.
+  void settle();
+  public:
+  using value_type = typename std::iterator_traits<Iter>::value_type;
+  set_op_iterator() = default;
+  set_op_iterator( Iter a, Iter a_end, Iter b, Iter b_end
+                 , const Compare& comp = Compare())
+  : m_a(a), m_a_end(a_end), m_b(b), m_b_end(b_end), m_comp(comp)
+  { settle(); }
+  const value_type& operator*() const
+  {
+    if (m_a == m_a_end)
+      return *m_b;
+    if (m_b == m_b_end)
+      return *m_a;
+    return m_comp(*m_b, *m_a) ? *m_b : *m_a;
+  }
+  const value_type* operator->() const { return std::addressof(**this); }
+  set_op_iterator& operator++();
+  set_op_iterator operator++(int)
+  {
+    set_op_iterator tmp(*this);
+    operator++();
+    return tmp;
+  }
+  bool operator==(const set_op_iterator& rhs) const
+  { return m_a == rhs.m_a && m_b == rhs.m_b; }
+  bool operator!=(const set_op_iterator& rhs) const
+  { return !(*this == rhs); }
+};
+
+template <typename Iter, typename Compare, set_op Op>
+void set_op_iterator<Iter, Compare, Op>::settle()
+{
+  for (;;) {
+    if (m_a == m_a_end) {
+      if (Op == set_op::intersection_op || Op == set_op::difference_op)
+        m_b = m_b_end;
+      return;
+    }
+
+    if (m_b == m_b_end) {
+      if (Op == set_op::intersection_op)
+        m_a = m_a_end;
+      return;
+    }
+
+    if (m_comp(*m_a, *m_b)) {
+      if (Op != set_op::intersection_op)
+        return;
+      ++m_a;
+    } else if (m_comp(*m_b, *m_a)) {
+      if (Op == set_op::union_op || Op == set_op::symmetric_difference_op)
+        return;
+      ++m_b;
+    } else {
+      if (Op == set_op::union_op || Op == set_op::intersection_op)
+        return;
+      ++m_a;
+      ++m_b;
+    }
+  }
+}
+
+template <typename Iter, typename Compare, set_op Op>
+set_op_iterator<Iter, Compare, Op>&
+set_op_iterator<Iter, Compare, Op>::operator++()
+{
+  if (m_a == m_a_end) {
+    ++m_b;
+  } else if (m_b == m_b_end) {
+    ++m_a;
+  } else if (m_comp(*m_a, *m_b)) {
+    ++m_a;
+  } else if (m_comp(*m_b, *m_a)) {
+    ++m_b;
+  } else {
+    ++m_a;
+    ++m_b;
+  }
+  settle();
+  return *this;
+}
+
+template <set_op Op, typename T, typename C, typename A, typename B>
+set<T, C, A, B>
+make_set_op(const set<T, C, A, B>& s1, const set<T, C, A, B>& s2, const A& alloc)
+{
+  using iter = typename set<T, C, A, B>::const_iterator;
+  using op_iter = set_op_iterator<iter, C, Op>;
+  const C comp = s1.key_comp();
+  op_iter first(s1.begin(), s1.end(), s2.begin(), s2.end(), comp);
+  op_iter last(s1.end(), s1.end(), s2.end(), s2.end(), comp);
+  return set<T, C, A, B>(sorted_unique, first, last, comp, alloc);
+}
+
+template <typename T, typename C, typename A, typename B>
+set<T, C, A, B>
+set_union(const set<T, C, A, B>& s1, const set<T, C, A, B>& s2, const A& alloc)
+{ return make_set_op<set_op::union_op>(s1, s2, alloc); }
+
+template <typename T, typename C, typename A, typename B>
+set<T, C, A, B>
+set_union(const set<T, C, A, B>& s1, const set<T, C, A, B>& s2)
+{ return set_union(s1, s2, s1.get_allocator()); }
+
+template <typename T, typename C, typename A, typename B>
+set<T, C, A, B>
+set_intersection(const set<T, C, A, B>& s1, const set<T, C, A, B>& s2, const A& alloc)
+{ return make_set_op<set_op::intersection_op>(s1, s2, alloc); }
+
+template <typename T, typename C, typename A, typename B>
+set<T, C, A, B>
+set_intersection(const set<T, C, A, B>& s1, const set<T, C, A, B>& s2)
+{ return set_intersection(s1, s2, s1.get_allocator()); }
+
+template <typename T, typename C, typename A, typename B>
+set<T, C, A, B>
+set_difference(const set<T, C, A, B>& s1, const set<T, C, A, B>& s2, const A& alloc)
+{ return make_set_op<set_op::difference_op>(s1, s2, alloc); }
+
+template <typename T, typename C, typename A, typename B>
+set<T, C, A, B>
+set_difference(const set<T, C, A, B>& s1, const set<T, C, A, B>& s2)
+{ return set_difference(s1, s2, s1.get_allocator()); }
+
+template <typename T, typename C, typename A, typename B>
+set<T, C, A, B>
+set_symmetric_difference( const set<T, C, A, B>& s1, const set<T, C, A, B>& s2
+                        , const A& alloc)
+{ return make_set_op<set_op::symmetric_difference_op>(s1, s2, alloc); }
+
+template <typename T, typename C, typename A, typename B>
+set<T, C, A, B>
+set_symmetric_difference(const set<T, C, A, B>& s1, const set<T, C, A, B>& s2)
+{ return set_symmetric_difference(s1, s2, s1.get_allocator()); }
+
+}
+
@@ -0,0 +1,387 @@
+#pragma once
+
+#include <cerrno>
+#include <limits>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <iterator>
+#include <stdexcept>
+#include <functional>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <rtcpp/memory/align.hpp>
+#include <rtcpp/memory/rel_ptr.hpp>
+#include <rtcpp/memory/node_stack.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/node_alloc_header.hpp>
+#include <rtcpp/utility/exceptions.hpp>
+
+#include "set.hpp"
+#include "forward_list.hpp"
+
+/*
+  Saves rt::set and rt::forward_list to a file that is loaded again
+  without inserting the elements one by one: a 64 byte header, with a
+  version, the sizes of the key and the node, the element count and a
+  checksum, followed by the image of a node_alloc_header buffer holding
+  exactly the nodes of the container, linked with 32 bit rt::rel_ptr so
+  that the image does not depend on where it is loaded. A set is saved
+  as the perfectly balanced tree of its keys, whatever its shape in
+  memory, with the counts of tbst::ranked if it has them.
+
+  The container loaded must use a node_allocator with node_stack and
+  std::uint32_t indexes, whose nodes have that layout, and the keys
+  must be trivially copyable. There are two ways to load:
+
+  load_snapshot  Reads the image in one sequential pass into the buffer
+                 of a header not linked yet and at least as big, the
+                 rest of the buffer becomes the free blocks.
+  mapped_snapshot
+                 Maps the file copy on write and uses the image as the
+                 buffer of its header. Nothing is read until the nodes
+                 are touched, except by the checksum if verified. The
+                 pool is full: insertions take the blocks freed by
+                 erasures.
+
+  Both give the head and size of the nodes, which the container adopts
+  with an allocator of the header, see adopt_nodes. The byte order is
+  that of the machine, a file from one of the other order is rejected
+  as not being a snapshot.
+*/
+
+namespace rt {
+
+enum class snapshot_kind : std::uint32_t
+{ set = 1, avl_set = 2, forward_list = 3, ranked_set = 4, ranked_avl_set = 5 };
+
+struct snapshot_header {
+  static constexpr std::uint64_t magic_value = 0x706e737070637472; // "rtcppsnp"
+  static constexpr std::uint32_t current_version = 1;
+  std::uint64_t magic;
+  std::uint32_t version;
+  std::uint32_t kind;
+  std::uint32_t key_size;
+  std::uint32_t block_size;
+  std::uint64_t size; // Elements.
+  std::uint64_t image_size; // In bytes.
+  std::uint64_t head; // Offset in the image.
+  std::uint64_t checksum; // Of the image.
+  std::uint64_t reserved;
+};
+
+static_assert(sizeof (snapshot_header) == 64, "snapshot: Bad header.");
+
+// The nodes of a loaded snapshot, to be adopted by a Container.
+template <class Container>
+struct snapshot_nodes {
+  typename Container::node_type* head;
+  std::size_t size;
+};
+
+// Fletcher sums of 64 bit words, the last one padded with zeros. All
+// calls but the last must pass a multiple of 8 bytes.
+class snapshot_checksum {
+  private:
+  std::uint64_t m_a = 0;
+  std::uint64_t m_b = 0;
+  public:
+  void update(const char* p, std::size_t n) noexcept
+  {
+    for (; n != 0; p += 8) {
+      std::uint64_t w = 0;
+      const std::size_t k = n < 8 ? n : 8;
+      std::memcpy(&w, p, k);
+      m_a += w;
+      m_b += m_a;
+      n -= k;
+    }
+  }
+  std::uint64_t value() const noexcept
+  { return m_a ^ (m_b * 0x9e3779b97f4a7c15ull); }
+};
+
+template <class Container>
+struct snapshot_traits;
+
+namespace detail {
+
+// Ranked sets have kinds of their own, their nodes carry the counts.
+template <class Balance>
+struct snapshot_set_kind {
+  static constexpr snapshot_kind value =
+    std::is_same<Balance, tbst::no_balance>::value ? snapshot_kind::set
+                                                   : snapshot_kind::avl_set;
+};
+
+template <class Base>
+struct snapshot_set_kind<tbst::ranked<Base>> {
+  static constexpr snapshot_kind value =
+    std::is_same<Base, tbst::no_balance>::value ? snapshot_kind::ranked_set
+                                                : snapshot_kind::ranked_avl_set;
+};
+
+}
+
+template <class T, class Compare, class Allocator, class Balance>
+struct snapshot_traits<set<T, Compare, Allocator, Balance>> {
+  using node_type =
+    typename tbst::balance_node<Balance, T, rel_ptr<void, std::int32_t>>::type;
+  using allocator_type = node_allocator<T, node_type, node_stack, std::uint32_t>;
+  using image_type = set<T, Compare, allocator_type, Balance>;
+  static constexpr snapshot_kind kind = detail::snapshot_set_kind<Balance>::value;
+  static std::size_t size(const set<T, Compare, Allocator, Balance>& s) noexcept
+  { return s.size(); }
+  // Builds the image of s in the buffer of h, returns the head.
+  static node_type*
+  build(const set<T, Compare, Allocator, Balance>& s, node_alloc_header& h)
+  {
+    image_type img( sorted_unique, std::begin(s), std::end(s), s.key_comp()
+                  , allocator_type(&h));
+    return img.release();
+  }
+};
+
+template <class T, class Allocator>
+struct snapshot_traits<forward_list<T, Allocator>> {
+  using node_type = forward_list_node<T, rel_ptr<void, std::int32_t>>;
+  using allocator_type = node_allocator<T, node_type, node_stack, std::uint32_t>;
+  using image_type = forward_list<T, allocator_type>;
+  static constexpr snapshot_kind kind = snapshot_kind::forward_list;
+  static std::size_t size(const forward_list<T, Allocator>& l)
+  { return std::size_t(std::distance(std::begin(l), std::end(l))); }
+  static node_type*
+  build(const forward_list<T, Allocator>& l, node_alloc_header& h)
+  {
+    image_type img{allocator_type(&h)};
+    auto pos = img.before_begin();
+    for (const T& v : l)
+      pos = img.insert_after(pos, v);
+    return img.release();
+  }
+};
+
+namespace detail {
+
+// The image holds the avail stack block, the head and the nodes, in
+// blocks of block_size that the 32 bit indexes of the stack can reach.
+inline bool snapshot_layout_ok(const snapshot_header& sh) noexcept
+{
+  const std::uint64_t b = sh.block_size;
+  return b != 0 && b % sizeof (std::uint32_t) == 0
+      && sh.image_size % b == 0 && sh.image_size >= 2 * b
+      && sh.image_size / sizeof (std::uint32_t) <= std::numeric_limits<std::uint32_t>::max()
+      && sh.head % b == 0 && sh.head < sh.image_size
+      && sh.size <= sh.image_size / b;
+}
+
+template <class Container>
+void check_snapshot(const snapshot_header& sh)
+{
+  using traits = snapshot_traits<Container>;
+  using node_type = typename traits::node_type;
+  static_assert( std::is_same<typename Container::node_type, node_type>::value
+               , "snapshot: The container does not link its nodes with 32 bit rel_ptr.");
+  if (sh.magic != snapshot_header::magic_value)
+    throw_exception(std::runtime_error("snapshot: Not a snapshot."));
+  if (sh.version != snapshot_header::current_version)
+    throw_exception(std::runtime_error("snapshot: Unsupported version."));
+  if ( sh.kind != static_cast<std::uint32_t>(traits::kind)
+    || sh.key_size != sizeof (typename node_type::value_type)
+    || sh.block_size != sizeof (node_type))
+    throw_exception(std::runtime_error("snapshot: Incompatible container."));
+  if (!snapshot_layout_ok(sh))
+    throw_exception(std::runtime_error("snapshot: Corrupted header."));
+}
+
+// Writes the snapshot of c through write(p, n).
+template <class Container, class Write>
+void save_snapshot(const Container& c, Write write)
+{
+  using traits = snapshot_traits<Container>;
+  using node_type = typename traits::node_type;
+  static_assert( std::is_trivially_copyable<typename node_type::value_type>::value
+               , "snapshot: The keys must be trivially copyable.");
+
+  // The image is built in memory first, the avail stack block, the
+  // head and the nodes.
+  const std::size_t n = traits::size(c);
+  std::vector<node_type> buffer(n + 2);
+  node_alloc_header h(buffer);
+  const node_type* head = traits::build(c, h);
+
+  snapshot_header sh;
+  std::memset(&sh, 0, sizeof sh);
+  sh.magic = snapshot_header::magic_value;
+  sh.version = snapshot_header::current_version;
+  sh.kind = static_cast<std::uint32_t>(traits::kind);
+  sh.key_size = sizeof (typename node_type::value_type);
+  sh.block_size = sizeof (node_type);
+  sh.size = n;
+  sh.image_size = h.buffer_size;
+  sh.head = std::uint64_t(reinterpret_cast<const char*>(head) - h.buffer);
+  snapshot_checksum sum;
+  sum.update(h.buffer, h.buffer_size);
+  sh.checksum = sum.value();
+
+  write(reinterpret_cast<const char*>(&sh), sizeof sh);
+  write(h.buffer, h.buffer_size);
+}
+
+}
+
+template <class Container>
+void save_snapshot(std::ostream& os, const Container& c)
+{
+  detail::save_snapshot(c, [&](const char* p, std::size_t n)
+  {
+    if (!os.write(p, std::streamsize(n)))
+      throw_exception(std::runtime_error("save_snapshot: Cannot write."));
+  });
+}
+
+// Writes to the file descriptor fd, e.g. a file or a socket.
+template <class Container>
+void save_snapshot(int fd, const Container& c)
+{
+  detail::save_snapshot(c, [=](const char* p, std::size_t n)
+  {
+    while (n != 0) {
+      const ::ssize_t r = ::write(fd, p, n);
+      if (r < 0 && errno == EINTR)
+        continue;
+      if (r <= 0)
+        throw_exception(std::runtime_error("save_snapshot: Cannot write."));
+      p += r;
+      n -= std::size_t(r);
+    }
+  });
+}
+
+// Reads a snapshot of a Container from is into the buffer of h, which
+// must not be in use by an allocator yet.
+template <class Container>
+snapshot_nodes<Container> load_snapshot(std::istream& is, node_alloc_header& h)
+{
+  using node_type = typename snapshot_traits<Container>::node_type;
+  constexpr std::size_t S = sizeof (node_type);
+
+  snapshot_header sh;
+  if (!is.read(reinterpret_cast<char*>(&sh), sizeof sh))
+    throw_exception(std::runtime_error("load_snapshot: Not a snapshot."));
+  detail::check_snapshot<Container>(sh);
+
+  if (h.n_alloc != 0 || h.bitmap || h.slabs || h.classes)
+    throw_exception(std::runtime_error("load_snapshot: Header already in use."));
+  constexpr std::size_t A = alignof (node_type) > sizeof (char*) ? alignof (node_type) : sizeof (char*);
+  align_if_needed<A>(h.buffer, h.buffer_size);
+  if (h.buffer_size < sh.image_size)
+    throw_exception(std::runtime_error("load_snapshot: Buffer too small."));
+  if (h.buffer_size / sizeof (std::uint32_t) > std::numeric_limits<std::uint32_t>::max())
+    throw_exception(std::runtime_error("load_snapshot: Buffer too big for the index type."));
+
+  snapshot_checksum sum;
+  const std::size_t chunk = std::size_t(1) << 20;
+  for (std::size_t off = 0; off < sh.image_size; off += chunk) {
+    const std::size_t k = std::min<std::size_t>(chunk, sh.image_size - off);
+    if (!is.read(h.buffer + off, std::streamsize(k)))
+      throw_exception(std::runtime_error("load_snapshot: Truncated snapshot."));
+    sum.update(h.buffer + off, k);
+  }
+  if (sum.value() != sh.checksum)
+    throw_exception(std::runtime_error("load_snapshot: Bad checksum."));
+
+  // The blocks after the image go on the avail stack.
+  constexpr std::size_t r = S / sizeof (std::uint32_t);
+  auto idx = reinterpret_cast<std::uint32_t*>(h.buffer);
+  for (std::size_t b = sh.image_size / S; b < h.buffer_size / S; ++b) {
+    idx[b * r] = idx[0];
+    idx[0] = std::uint32_t(b * r);
+  }
+  h.assume_linked(S);
+  return {reinterpret_cast<node_type*>(h.buffer + sh.head), std::size_t(sh.size)};
+}
+
+// A snapshot file mapped copy on write, changes to the nodes are not
+// written back to it.
+class mapped_snapshot {
+  private:
+  void* m_addr;
+  std::size_t m_size;
+  node_alloc_header m_header;
+  const snapshot_header& info() const noexcept
+  { return *static_cast<const snapshot_header*>(m_addr); }
+  char* image() const noexcept
+  { return static_cast<char*>(m_addr) + sizeof (snapshot_header); }
+  public:
+  // The checksum makes all the image be read once.
+  explicit mapped_snapshot(const char* path, bool verify = true);
+  ~mapped_snapshot() { ::munmap(m_addr, m_size); }
+  mapped_snapshot(const mapped_snapshot&) = delete;
+  mapped_snapshot& operator=(const mapped_snapshot&) = delete;
+  // For the allocators of the container, already linked.
+  node_alloc_header& header() noexcept { return m_header; }
+  std::size_t size() const noexcept { return std::size_t(info().size); }
+  // The nodes, to be adopted once.
+  template <class Container>
+  snapshot_nodes<Container> nodes() const
+  {
+    detail::check_snapshot<Container>(info());
+    using node_type = typename Container::node_type;
+    return {reinterpret_cast<node_type*>(image() + info().head), size()};
+  }
+};
+
+inline mapped_snapshot::mapped_snapshot(const char* path, bool verify)
+: m_addr(MAP_FAILED)
+, m_size(0)
+{
+  const int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    throw_exception(std::runtime_error("mapped_snapshot: Cannot open the file."));
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || std::size_t(st.st_size) <= sizeof (snapshot_header)) {
+    ::close(fd);
+    throw_exception(std::runtime_error("mapped_snapshot: Not a snapshot."));
+  }
+  m_size = static_cast<std::size_t>(st.st_size);
+  m_addr = ::mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (m_addr == MAP_FAILED)
+    throw_exception(std::runtime_error("mapped_snapshot: Cannot map the file."));
+
+  const snapshot_header& sh = info();
+  const char* error = nullptr;
+  if (sh.magic != snapshot_header::magic_value)
+    error = "mapped_snapshot: Not a snapshot.";
+  else if (sh.version != snapshot_header::current_version)
+    error = "mapped_snapshot: Unsupported version.";
+  else if (sh.image_size != m_size - sizeof (snapshot_header))
+    error = "mapped_snapshot: Truncated snapshot.";
+  else if (!detail::snapshot_layout_ok(sh))
+    error = "mapped_snapshot: Corrupted header.";
+  if (!error && verify) {
+    snapshot_checksum sum;
+    sum.update(image(), std::size_t(sh.image_size));
+    if (sum.value() != sh.checksum)
+      error = "mapped_snapshot: Bad checksum.";
+  }
+  if (error) {
+    ::munmap(m_addr, m_size);
+    throw_exception(std::runtime_error(error));
+  }
+
+  m_header = node_alloc_header(image(), std::size_t(sh.image_size));
+  m_header.assume_linked(sh.block_size);
+}
+
+}
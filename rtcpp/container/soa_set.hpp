@@ -0,0 +1,368 @@
+#pragma once
+
+#include <new>
+#include <array>
+#include <limits>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <iterator>
+#include <stdexcept>
+#include <functional>
+#include <type_traits>
+
+#include <rtcpp/memory/align.hpp>
+#include <rtcpp/utility/exceptions.hpp>
+
+#include "tbst.hpp"
+#include "tbst_balance.hpp"
+
+/*
+  Ordered set with the nodes stored as a structure of arrays: the keys,
+  the left links, the right links and the tags of the threaded tree
+  are parallel arrays in a buffer given by the caller, indexed by the
+  node index. The tree algorithms are those of rt::set (see tbst.hpp
+  and tbst_balance.hpp), they see the nodes through soa_ptr, a handle
+  whose operator-> yields references into the arrays.
+
+  A scan over the keys in buffer order, e.g. for SIMD comparisons,
+  reads only the key array, which starts on a cache line: see keys(),
+  in_use() and for_each_key(). Index 0 is the head of the tree and
+  is never in use. Free nodes are kept on a stack linked through the
+  left links and nodes never used are handed out from a bump index,
+  as in bump_node_stack, so the buffer is not touched before it is
+  needed. Inserting into a full set throws std::bad_alloc, try_insert
+  returns end() instead.
+
+  Keys must be trivially copyable, free slots of the key array hold
+  stale values. The set refers to itself through the handles and can
+  not be copied or moved.
+*/
+
+namespace rt {
+
+template <class T, class Index>
+struct soa_arrays {
+  T* keys;
+  Index* link[2];
+  unsigned char* tags;
+};
+
+template <class T, class Index>
+class soa_ptr {
+  public:
+  using arrays_type = soa_arrays<T, Index>;
+  // A link of a node, assigning a handle stores its index.
+  class link_ref {
+    private:
+    Index& m_r;
+    const arrays_type* m_a;
+    public:
+    link_ref(Index& r, const arrays_type* a) noexcept : m_r(r), m_a(a) {}
+    link_ref(const link_ref&) = default;
+    link_ref& operator=(const link_ref& rhs) noexcept
+    {
+      m_r = rhs.m_r;
+      return *this;
+    }
+    link_ref& operator=(const soa_ptr& p) noexcept
+    {
+      m_r = p.m_i;
+      return *this;
+    }
+    operator soa_ptr() const noexcept { return soa_ptr(m_a, m_r); }
+  };
+  class links {
+    private:
+    const arrays_type* m_a;
+    Index m_i;
+    public:
+    links(const arrays_type* a, Index i) noexcept : m_a(a), m_i(i) {}
+    link_ref operator[](std::size_t d) const noexcept
+    { return link_ref(m_a->link[d][m_i], m_a); }
+  };
+  // What the algorithms see as the node.
+  struct view {
+    links link;
+    unsigned char& tag;
+    T& key;
+    view* operator->() noexcept { return this; }
+  };
+  private:
+  const arrays_type* m_a;
+  Index m_i;
+  public:
+  soa_ptr() noexcept : m_a(0), m_i(0) {}
+  soa_ptr(const arrays_type* a, Index i) noexcept : m_a(a), m_i(i) {}
+  view operator->() const noexcept
+  { return view {links(m_a, m_i), m_a->tags[m_i], m_a->keys[m_i]}; }
+  Index index() const noexcept { return m_i; }
+  friend bool operator==(const soa_ptr& a, const soa_ptr& b) noexcept
+  { return a.m_i == b.m_i; }
+  friend bool operator!=(const soa_ptr& a, const soa_ptr& b) noexcept
+  { return a.m_i != b.m_i; }
+};
+
+template <class T, class Index>
+class soa_set_iterator {
+  public:
+  using iterator_category = std::bidirectional_iterator_tag;
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const T*;
+  using reference = const T&;
+  using node_pointer = soa_ptr<T, Index>;
+  private:
+  node_pointer m_p;
+  public:
+  soa_set_iterator() noexcept {}
+  explicit soa_set_iterator(node_pointer p) noexcept : m_p(p) {}
+  soa_set_iterator& operator++() noexcept
+  {
+    m_p = tbst::inorder<1>(m_p);
+    return *this;
+  }
+  soa_set_iterator operator++(int) noexcept
+  {
+    soa_set_iterator tmp(*this);
+    operator++();
+    return tmp;
+  }
+  soa_set_iterator& operator--() noexcept
+  {
+    m_p = tbst::inorder<0>(m_p);
+    return *this;
+  }
+  soa_set_iterator operator--(int) noexcept
+  {
+    soa_set_iterator tmp(*this);
+    operator--();
+    return tmp;
+  }
+  reference operator*() const noexcept { return m_p->key; }
+  pointer operator->() const noexcept { return &m_p->key; }
+  node_pointer node() const noexcept { return m_p; }
+  bool operator==(const soa_set_iterator& rhs) const noexcept
+  { return m_p == rhs.m_p; }
+  bool operator!=(const soa_set_iterator& rhs) const noexcept
+  { return m_p != rhs.m_p; }
+};
+
+template < class T, class Compare = std::less<T>
+         , class Balance = tbst::no_balance
+         , class Index = std::uint32_t>
+class soa_set {
+  static_assert( std::is_trivially_copyable<T>::value
+               , "soa_set: Keys must be trivially copyable.");
+  static_assert( std::is_unsigned<Index>::value
+               , "soa_set: Index must be an unsigned integer.");
+  public:
+  using key_type = T;
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using key_compare = Compare;
+  using value_compare = Compare;
+  using index_type = Index;
+  using node_pointer = soa_ptr<T, Index>;
+  using const_iterator = soa_set_iterator<T, Index>;
+  using iterator = const_iterator;
+  private:
+  static constexpr size_type key_align =
+    alignof (T) > cache_line_size ? alignof (T) : cache_line_size;
+  static constexpr size_type node_bytes = sizeof (T) + 2 * sizeof (Index) + 1;
+  soa_arrays<T, Index> m_a;
+  size_type m_capacity; // Nodes besides the head.
+  Index m_free; // Top of the stack of free nodes.
+  Index m_bump; // First node never used.
+  size_type m_size;
+  Compare m_comp;
+  node_pointer head() const noexcept { return node_pointer(&m_a, 0); }
+  void layout(char* p, std::size_t s);
+  void reset() noexcept;
+  // A null handle when the set is full.
+  node_pointer try_make_node(const T& key) noexcept;
+  node_pointer make_node(const T& key);
+  void release(node_pointer p) noexcept;
+  public:
+  template <class U>
+  soa_set(U* data, size_type n, const Compare& comp = Compare())
+  : m_comp(comp)
+  { layout(reinterpret_cast<char*>(data), n * sizeof (U)); }
+  template <class U, std::size_t I>
+  explicit soa_set(std::array<U, I>& arr, const Compare& comp = Compare())
+  : soa_set(arr.data(), arr.size(), comp) {}
+  template <class U, class A>
+  explicit soa_set(std::vector<U, A>& arr, const Compare& comp = Compare())
+  : soa_set(arr.data(), arr.size(), comp) {}
+  soa_set(const soa_set&) = delete;
+  soa_set& operator=(const soa_set&) = delete;
+  // Bytes a buffer needs for a capacity of n keys.
+  static constexpr size_type bytes_for(size_type n) noexcept
+  { return (n + 1) * node_bytes + key_align + alignof (Index); }
+  std::pair<iterator, bool> insert(const T& key);
+  // Returns end() and false when the set is full instead of throwing.
+  std::pair<iterator, bool> try_insert(const T& key) noexcept;
+  template <class InputIt>
+  void insert(InputIt begin, InputIt end)
+  {
+    for (; begin != end; ++begin)
+      insert(*begin);
+  }
+  size_type erase(const T& key) noexcept;
+  iterator erase(const_iterator pos) noexcept;
+  void clear() noexcept { reset(); }
+  const_iterator find(const T& key) const
+  {
+    return const_iterator(tbst::find_with_parent(head(), key, m_comp).first);
+  }
+  size_type count(const T& key) const { return find(key) != end() ? 1 : 0; }
+  const_iterator lower_bound(const T& key) const
+  { return const_iterator(tbst::lower_bound(head(), key, m_comp)); }
+  const_iterator upper_bound(const T& key) const
+  { return const_iterator(tbst::upper_bound(head(), key, m_comp)); }
+  const_iterator begin() const noexcept
+  { return const_iterator(tbst::inorder<1>(head())); }
+  const_iterator end() const noexcept { return const_iterator(head()); }
+  size_type size() const noexcept { return m_size; }
+  bool empty() const noexcept { return m_size == 0; }
+  size_type capacity() const noexcept { return m_capacity; }
+  key_compare key_comp() const { return m_comp; }
+  // The key array, indexed as the nodes, and one past the last node
+  // ever used. Only the keys of the nodes in use are meaningful.
+  const T* keys() const noexcept { return m_a.keys; }
+  size_type extent() const noexcept { return m_bump; }
+  bool in_use(size_type i) const noexcept
+  { return m_a.tags[i] & tbst::detail::in_use_bit; }
+  size_type index(const_iterator it) const noexcept
+  { return it.node().index(); }
+  // Applies f to the keys in buffer order, not in key order.
+  template <class F>
+  void for_each_key(F f) const
+  {
+    for (size_type i = 1; i < m_bump; ++i)
+      if (in_use(i))
+        f(m_a.keys[i]);
+  }
+};
+
+template <class T, class C, class B, class I>
+void soa_set<T, C, B, I>::layout(char* p, std::size_t s)
+{
+  const std::size_t s0 = s;
+  align_if_needed<key_align>(p, s);
+  if (s > s0 || s < alignof (I) + 2 * node_bytes)
+    throw_exception(std::runtime_error("soa_set: Buffer too small."));
+
+  // The head takes one node, the bump index must not wrap.
+  std::size_t m = (s - alignof (I)) / node_bytes;
+  if (m > std::numeric_limits<I>::max())
+    m = std::numeric_limits<I>::max();
+  m_capacity = m - 1;
+
+  m_a.keys = reinterpret_cast<T*>(p);
+  char* q = p + m * sizeof (T);
+  std::size_t r = s - m * sizeof (T);
+  align_if_needed<alignof (I)>(q, r);
+  m_a.link[0] = reinterpret_cast<I*>(q);
+  m_a.link[1] = m_a.link[0] + m;
+  m_a.tags = reinterpret_cast<unsigned char*>(m_a.link[1] + m);
+  reset();
+}
+
+template <class T, class C, class B, class I>
+void soa_set<T, C, B, I>::reset() noexcept
+{
+  // Nodes beyond the bump index are not looked at, their tags need no
+  // clearing.
+  m_a.link[0][0] = 0;
+  m_a.link[1][0] = 0;
+  m_a.tags[0] = tbst::detail::lbit;
+  m_free = 0;
+  m_bump = 1;
+  m_size = 0;
+}
+
+template <class T, class C, class B, class I>
+typename soa_set<T, C, B, I>::node_pointer
+soa_set<T, C, B, I>::make_node(const T& key)
+{
+  const node_pointer p = try_make_node(key);
+  if (p == node_pointer())
+    throw_exception(std::bad_alloc());
+  return p;
+}
+
+template <class T, class C, class B, class I>
+typename soa_set<T, C, B, I>::node_pointer
+soa_set<T, C, B, I>::try_make_node(const T& key) noexcept
+{
+  I i = m_free;
+  if (i)
+    m_free = m_a.link[0][i];
+  else if (m_bump <= m_capacity)
+    i = m_bump++;
+  else
+    return node_pointer();
+
+  m_a.keys[i] = key;
+  // attach_node keeps the bit.
+  m_a.tags[i] = tbst::detail::in_use_bit;
+  ++m_size;
+  return node_pointer(&m_a, i);
+}
+
+template <class T, class C, class B, class I>
+void soa_set<T, C, B, I>::release(node_pointer p) noexcept
+{
+  const I i = p.index();
+  m_a.tags[i] = 0;
+  m_a.link[0][i] = m_free;
+  m_free = i;
+  --m_size;
+}
+
+template <class T, class C, class B, class I>
+std::pair<typename soa_set<T, C, B, I>::iterator, bool>
+soa_set<T, C, B, I>::insert(const T& key)
+{
+  auto f = [this](const T& k) { return make_node(k); };
+  const auto pair = B::insert(head(), key, m_comp, f);
+  return std::make_pair(iterator(pair.first), pair.second);
+}
+
+template <class T, class C, class B, class I>
+std::pair<typename soa_set<T, C, B, I>::iterator, bool>
+soa_set<T, C, B, I>::try_insert(const T& key) noexcept
+{
+  auto f = [this](const T& k) { return try_make_node(k); };
+  const auto pair = B::insert(head(), key, m_comp, f);
+  return std::make_pair(iterator(pair.first), pair.second);
+}
+
+template <class T, class C, class B, class I>
+typename soa_set<T, C, B, I>::size_type
+soa_set<T, C, B, I>::erase(const T& key) noexcept
+{
+  const node_pointer p = B::erase(head(), key, m_comp);
+  if (p == head())
+    return 0;
+
+  release(p);
+  return 1;
+}
+
+template <class T, class C, class B, class I>
+typename soa_set<T, C, B, I>::iterator
+soa_set<T, C, B, I>::erase(const_iterator pos) noexcept
+{
+  // Nodes are relinked, not copied, the successor stays valid.
+  const node_pointer p = pos.node();
+  const iterator next(tbst::inorder<1>(p));
+  release(B::unlink(head(), p, m_comp));
+  return next;
+}
+
+}
+
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <new>
+#include <array>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+
+#include <rtcpp/memory/align.hpp>
+
+/*
+  Bounded lock-free queue for one producer thread and one consumer
+  thread. The slots live in a buffer given by the caller, e.g. the
+  std::vector or std::array also accepted by node_alloc_header, and
+  the elements are constructed in them when pushed and destroyed when
+  popped, so the buffer needs no particular content. The capacity is
+  the largest power of two number of elements that fits, bytes_for()
+  tells the size needed for a given capacity.
+
+  The head, written by the consumer, and the tail, written by the
+  producer, are on cache lines of their own. Each side keeps a copy of
+  the index of the other and reads the shared one only when the copy
+  says the queue is full (or empty). push_n and pop_n publish many
+  elements with a single store.
+
+  Construction and destruction are not thread safe, the remaining
+  elements are destroyed with the queue.
+*/
+
+namespace rt {
+
+template <class T>
+class spsc_queue {
+  private:
+  struct alignas(cache_line_size) consumer_side {
+    std::atomic<std::size_t> head;
+    std::size_t tail_copy;
+  };
+  struct alignas(cache_line_size) producer_side {
+    std::atomic<std::size_t> tail;
+    std::size_t head_copy;
+  };
+  consumer_side m_c;
+  producer_side m_p;
+  T* m_slots;
+  std::size_t m_mask;
+  void layout(char* p, std::size_t s);
+  T* slot(std::size_t i) const noexcept { return m_slots + (i & m_mask); }
+  // Free slots seen by the producer, reading the head if less than n.
+  std::size_t room(std::size_t tail, std::size_t n) noexcept;
+  // Elements seen by the consumer, reading the tail if less than n.
+  std::size_t available(std::size_t head, std::size_t n) noexcept;
+  public:
+  using value_type = T;
+  using size_type = std::size_t;
+  template <class U>
+  spsc_queue(U* data, size_type n)
+  { layout(reinterpret_cast<char*>(data), n * sizeof (U)); }
+  template <class U, std::size_t I>
+  explicit spsc_queue(std::array<U, I>& arr)
+  : spsc_queue(arr.data(), arr.size()) {}
+  template <class U, class A>
+  explicit spsc_queue(std::vector<U, A>& arr)
+  : spsc_queue(arr.data(), arr.size()) {}
+  spsc_queue(const spsc_queue&) = delete;
+  spsc_queue& operator=(const spsc_queue&) = delete;
+  ~spsc_queue();
+  // Bytes a buffer needs for a capacity of n, a power of two.
+  static constexpr size_type bytes_for(size_type n) noexcept
+  { return n * sizeof (T) + alignof (T); }
+  // Producer side.
+  template <class... Args>
+  bool try_emplace(Args&&... args);
+  bool try_push(const T& v) { return try_emplace(v); }
+  bool try_push(T&& v) { return try_emplace(std::move(v)); }
+  // Copies at most n elements from in, returns how many.
+  size_type push_n(const T* in, size_type n);
+  // Consumer side.
+  bool try_pop(T& v);
+  // Moves at most n elements to out, returns how many.
+  size_type pop_n(T* out, size_type n);
+  // Exact only when called from one of the two threads while the
+  // other is idle.
+  size_type size() const noexcept
+  {
+    return m_p.tail.load(std::memory_order_acquire)
+         - m_c.head.load(std::memory_order_acquire);
+  }
+  bool empty() const noexcept { return size() == 0; }
+  size_type capacity() const noexcept { return m_mask + 1; }
+};
+
+template <class T>
+void spsc_queue<T>::layout(char* p, std::size_t s)
+{
+  align_if_needed<alignof (T)>(p, s);
+  if (s < sizeof (T) || s > std::size_t(-1) / 2)
+    throw std::runtime_error("spsc_queue: Buffer too small.");
+
+  m_slots = reinterpret_cast<T*>(p);
+  m_mask = floor_pow2(s / sizeof (T)) - 1;
+  m_c.head.store(0, std::memory_order_relaxed);
+  m_c.tail_copy = 0;
+  m_p.tail.store(0, std::memory_order_relaxed);
+  m_p.head_copy = 0;
+}
+
+template <class T>
+spsc_queue<T>::~spsc_queue()
+{
+  const std::size_t tail = m_p.tail.load(std::memory_order_acquire);
+  for (std::size_t i = m_c.head.load(std::memory_order_relaxed); i != tail; ++i)
+    slot(i)->~T();
+}
+
+template <class T>
+std::size_t spsc_queue<T>::room(std::size_t tail, std::size_t n) noexcept
+{
+  std::size_t r = capacity() - (tail - m_p.head_copy);
+  if (r < n) {
+    m_p.head_copy = m_c.head.load(std::memory_order_acquire);
+    r = capacity() - (tail - m_p.head_copy);
+  }
+  return r;
+}
+
+template <class T>
+std::size_t spsc_queue<T>::available(std::size_t head, std::size_t n) noexcept
+{
+  std::size_t a = m_c.tail_copy - head;
+  if (a < n) {
+    m_c.tail_copy = m_p.tail.load(std::memory_order_acquire);
+    a = m_c.tail_copy - head;
+  }
+  return a;
+}
+
+template <class T>
+template <class... Args>
+bool spsc_queue<T>::try_emplace(Args&&... args)
+{
+  const std::size_t tail = m_p.tail.load(std::memory_order_relaxed);
+  if (room(tail, 1) == 0)
+    return false;
+
+  ::new (static_cast<void*>(slot(tail))) T(std::forward<Args>(args)...);
+  m_p.tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+template <class T>
+std::size_t spsc_queue<T>::push_n(const T* in, std::size_t n)
+{
+  const std::size_t tail = m_p.tail.load(std::memory_order_relaxed);
+  n = std::min(n, room(tail, n));
+  std::size_t i = 0;
+  try {
+    for (; i < n; ++i)
+      ::new (static_cast<void*>(slot(tail + i))) T(in[i]);
+  } catch (...) {
+    m_p.tail.store(tail + i, std::memory_order_release);
+    throw;
+  }
+  m_p.tail.store(tail + n, std::memory_order_release);
+  return n;
+}
+
+template <class T>
+bool spsc_queue<T>::try_pop(T& v)
+{
+  const std::size_t head = m_c.head.load(std::memory_order_relaxed);
+  if (available(head, 1) == 0)
+    return false;
+
+  T* p = slot(head);
+  v = std::move(*p);
+  p->~T();
+  m_c.head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+template <class T>
+std::size_t spsc_queue<T>::pop_n(T* out, std::size_t n)
+{
+  const std::size_t head = m_c.head.load(std::memory_order_relaxed);
+  n = std::min(n, available(head, n));
+  for (std::size_t i = 0; i < n; ++i) {
+    T* p = slot(head + i);
+    out[i] = std::move(*p);
+    p->~T();
+  }
+  m_c.head.store(head + n, std::memory_order_release);
+  return n;
+}
+
+}
+
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <initializer_list>
+
+#include <rtcpp/memory/node_stack.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/static_node_storage.hpp>
+
+#include "forward_list.hpp"
+
+/*
+  An rt::forward_list with room for N elements embedded in the object,
+  the counterpart of static_set: the index is chosen from N, the list
+  is copied element by element and not moved, construction is not
+  constexpr. As the links are relative unless N is huge, the head is
+  taken from the buffer. Inserting into a full list throws
+  std::bad_alloc, try_push_front returns false instead.
+*/
+
+namespace rt {
+
+template <class T>
+struct static_forward_list_node {
+  template <class P>
+  using type = forward_list_node<T, P>;
+};
+
+template <class T, std::size_t N>
+struct static_forward_list_traits {
+  using index_type =
+    typename static_index<static_forward_list_node<T>::template type, N>::type;
+  using allocator_type =
+    node_allocator<T, forward_list_node<T, void*>, node_stack, index_type>;
+  using node_type =
+    forward_list_node<T, typename allocator_type::void_pointer>;
+};
+
+template <class T, std::size_t N>
+class static_forward_list
+: private static_node_storage<typename static_forward_list_traits<T, N>::node_type, N>
+, public forward_list<T, typename static_forward_list_traits<T, N>::allocator_type> {
+  private:
+  using traits_type = static_forward_list_traits<T, N>;
+  using storage_type =
+    static_node_storage<typename traits_type::node_type, N>;
+  using base_type = forward_list<T, typename traits_type::allocator_type>;
+  template <class InputIt>
+  void append(InputIt begin, InputIt end)
+  {
+    auto pos = this->before_begin();
+    for (; begin != end; ++begin)
+      pos = this->insert_after(pos, *begin);
+  }
+  public:
+  using index_type = typename traits_type::index_type;
+  using allocator_type = typename traits_type::allocator_type;
+  using size_type = typename base_type::size_type;
+  static constexpr size_type capacity() noexcept { return N; }
+  static_forward_list()
+  : storage_type(), base_type(allocator_type(&this->m_header)) {}
+  template <class InputIt>
+  static_forward_list(InputIt begin, InputIt end)
+  : static_forward_list() { append(begin, end); }
+  static_forward_list(std::initializer_list<T> init)
+  : static_forward_list(init.begin(), init.end()) {}
+  static_forward_list(const static_forward_list& rhs)
+  : static_forward_list(rhs.begin(), rhs.end()) {}
+  static_forward_list& operator=(const static_forward_list& rhs)
+  {
+    if (this != &rhs) {
+      this->clear();
+      append(rhs.begin(), rhs.end());
+    }
+    return *this;
+  }
+  static_forward_list& operator=(std::initializer_list<T> init)
+  {
+    this->clear();
+    append(init.begin(), init.end());
+    return *this;
+  }
+  // The buffers stay where they are, the elements are exchanged.
+  void swap(static_forward_list& other)
+  {
+    const static_forward_list tmp(*this);
+    *this = other;
+    other = tmp;
+  }
+  size_type max_size() const noexcept { return N; }
+};
+
+}
+
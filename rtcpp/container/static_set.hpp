@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+
+#include <rtcpp/memory/node_stack.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/static_node_storage.hpp>
+
+#include "set.hpp"
+#include "tbst.hpp"
+
+/*
+  An rt::set with room for N elements embedded in the object, e.g. on
+  the stack, so there is no separate buffer, header and allocator to
+  set up:
+
+    rt::static_set<int, 64> s {5, 3, 1};
+
+  The index of the allocator is the smallest of std::uint16_t,
+  std::uint32_t and std::size_t that addresses the buffer, the nodes
+  are then linked with rel_ptr of the same width (see static_index).
+
+  The allocator refers to the buffer through its header, both inside
+  the object, so a static_set is copied element by element and not
+  moved. Construction links the buffer and can not be constexpr.
+  insert is noexcept as in rt::set: inserting a new key into a full
+  set terminates, check full() first or use try_insert.
+*/
+
+namespace rt {
+
+template <class T>
+struct static_set_node {
+  template <class P>
+  using type = tbst::node<T, P>;
+};
+
+template < class T, std::size_t N, class Compare = std::less<T>
+         , class Balance = tbst::no_balance>
+class static_set;
+
+template <class T, std::size_t N>
+struct static_set_traits {
+  using index_type =
+    typename static_index<static_set_node<T>::template type, N>::type;
+  using allocator_type =
+    node_allocator<T, tbst::node<T, void*>, node_stack, index_type>;
+  using node_type = tbst::node<T, typename allocator_type::void_pointer>;
+};
+
+template <class T, std::size_t N, class Compare, class Balance>
+class static_set
+: private static_node_storage<typename static_set_traits<T, N>::node_type, N>
+, public set< T, Compare
+            , typename static_set_traits<T, N>::allocator_type, Balance> {
+  private:
+  using traits_type = static_set_traits<T, N>;
+  using storage_type =
+    static_node_storage<typename traits_type::node_type, N>;
+  using base_type =
+    set<T, Compare, typename traits_type::allocator_type, Balance>;
+  public:
+  using index_type = typename traits_type::index_type;
+  using allocator_type = typename traits_type::allocator_type;
+  using size_type = typename base_type::size_type;
+  static constexpr size_type capacity() noexcept { return N; }
+  explicit static_set(const Compare& comp = Compare())
+  : storage_type(), base_type(comp, allocator_type(&this->m_header)) {}
+  template <class InputIt>
+  static_set(InputIt begin, InputIt end, const Compare& comp = Compare())
+  : storage_type()
+  , base_type(begin, end, comp, allocator_type(&this->m_header)) {}
+  static_set(std::initializer_list<T> init, const Compare& comp = Compare())
+  : static_set(init.begin(), init.end(), comp) {}
+  static_set(const static_set& rhs)
+  : static_set(rhs.begin(), rhs.end(), rhs.key_comp()) {}
+  static_set& operator=(const static_set& rhs) noexcept
+  {
+    if (this != &rhs) {
+      this->clear();
+      this->insert(rhs.begin(), rhs.end());
+    }
+    return *this;
+  }
+  static_set& operator=(std::initializer_list<T> init) noexcept
+  {
+    this->clear();
+    this->insert(init.begin(), init.end());
+    return *this;
+  }
+  // The buffers stay where they are, the elements are exchanged.
+  void swap(static_set& other) noexcept
+  {
+    const static_set tmp(*this);
+    *this = other;
+    other = tmp;
+  }
+  bool full() const noexcept { return this->size() == N; }
+  size_type max_size() const noexcept { return N; }
+};
+
+}
+
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <ostream>
+#include <type_traits>
 
   /*
 
@@ -29,6 +30,10 @@ namespace detail {
   constexpr int rbit = 1;
   constexpr int lbit = 2;
   constexpr int in_use_bit = 4;
+  // Spare bits used by the balancing policies.
+  constexpr int lhigh_bit = 8;
+  constexpr int rhigh_bit = 16;
+  constexpr int balance_mask = lhigh_bit | rhigh_bit;
 }
 
 template <typename T, typename Ptr>
@@ -44,6 +49,34 @@ struct node {
   value_type key;
 };
 
+// A node that also counts the nodes of its subtree, itself included,
+// kept by the ranked balancing policy.
+template <typename T, typename Ptr>
+struct ranked_node {
+  typedef T value_type;
+  using self_pointer = typename std::pointer_traits<Ptr>::template
+    rebind<ranked_node<T, Ptr>>;
+  template<class U, class K>
+  struct rebind { using other = ranked_node<U , K>; };
+
+  self_pointer link[2];
+  unsigned char tag;
+  std::size_t count;
+  value_type key;
+};
+
+template <typename Node>
+struct is_ranked : std::false_type {};
+
+template <typename T, typename Ptr>
+struct is_ranked<ranked_node<T, Ptr>> : std::true_type {};
+
+// The key held by a node. Intrusive hooks have their own overload (see
+// intrusive_set.hpp), the algorithms below only get at keys through it.
+template <typename Ptr>
+auto key_of(Ptr p) noexcept -> decltype((p->key))
+{ return p->key; }
+
 template <class T, class Ptr>
 std::ostream&
 operator<<(std::ostream& os, const node<T, Ptr*>& o)
@@ -121,6 +154,35 @@ struct has_null_link<1> {
   {return p->tag & detail::rbit;}
 };
 
+// Nodes in the subtree of p in direction I, none for a thread.
+template <std::size_t I, typename Ptr>
+std::size_t child_count(Ptr p) noexcept
+{ return has_null_link<I>::apply(p) ? 0 : std::size_t(p->link[I]->count); }
+
+template <typename Ptr>
+auto update_count(Ptr p, int) noexcept -> decltype(void(p->count))
+{ p->count = 1 + child_count<0>(p) + child_count<1>(p); }
+
+template <typename Ptr>
+void update_count(Ptr, long) noexcept {}
+
+// Recomputes the count of p from those of its children, does nothing
+// on nodes without counts.
+template <typename Ptr>
+void update_count(Ptr p) noexcept
+{ update_count(p, 0); }
+
+template <typename P, typename Q>
+auto copy_count(P to, Q from, int) noexcept -> decltype(void(to->count = from->count))
+{ to->count = from->count; }
+
+template <typename P, typename Q>
+void copy_count(P, Q, long) noexcept {}
+
+template <typename P, typename Q>
+void copy_count(P to, Q from) noexcept
+{ copy_count(to, from, 0); }
+
 template <std::size_t I>
 struct get_null_link;
 
@@ -202,7 +264,7 @@ void attach_node(Ptr p, Ptr q) noexcept
   q->link[I] = p->link[I];
   q->tag = get_null_link<O>::apply(q) | get_null_link<I>::apply(p);
   p->link[I] = q;
-  p->tag = get_null_link<O>::apply(p);
+  p->tag = get_null_link<O>::apply(p) | (p->tag & detail::balance_mask);
   q->link[O] = p;
   set_link_null<O>::apply(q);
 
@@ -213,13 +275,13 @@ void attach_node(Ptr p, Ptr q) noexcept
 }
 
 template <std::size_t I, typename Ptr>
-Ptr erase_node_lr_non_null(Ptr* linker, Ptr q) noexcept
+Ptr erase_node_lr_non_null(Ptr pq, std::size_t d, Ptr q) noexcept
 {
   // I = 0: The inorder predecessor replaces the erased node.
   // I = 1: The inorder sucessor replaces the erased node.
   const std::size_t O = index_helper<I>::other;
   typedef Ptr node_pointer;
-  node_pointer u = const_cast<node_pointer>(inorder_parent<I>(q));
+  node_pointer u = inorder_parent<I>(q);
   node_pointer s = q->link[I];
   if (u != q)
     s = u->link[O];
@@ -235,16 +297,16 @@ Ptr erase_node_lr_non_null(Ptr* linker, Ptr q) noexcept
     s->link[I] = q->link[I];;
     unset_link_null<I>::apply(s);
   }
-  *linker = s;
+  pq->link[d] = s;
   return q;
 }
 
 template <std::size_t I, typename Ptr>
-Ptr erase_node_one_null(Ptr* linker, Ptr q) noexcept
+Ptr erase_node_one_null(Ptr pq, std::size_t d, Ptr q) noexcept
 {
   const std::size_t O = index_helper<I>::other;
   typedef Ptr node_pointer;
-  node_pointer u = const_cast<node_pointer>(inorder_parent<O>(q));
+  node_pointer u = inorder_parent<O>(q);
   node_pointer s = q->link[O];
   if (u != q)
     s = u->link[I];
@@ -257,7 +319,7 @@ Ptr erase_node_one_null(Ptr* linker, Ptr q) noexcept
     s->link[O] = q->link[O];;
     unset_link_null<O>::apply(s);
   }
-  *linker = s;
+  pq->link[d] = s;
   return q;
 }
 
@@ -267,18 +329,18 @@ Ptr erase_node(Ptr pq, Ptr q) noexcept
   // p is parent of q. We do not handle the case p = q
   // Returns the erased node to be released elsewhere.
   // WARNING: Still unfinished.
+  // The links are not taken by address so that they can be fancy
+  // pointers, d is the direction of q in pq.
   const std::size_t O = index_helper<I>::other;
-  Ptr* linker = &pq->link[O];
-  if (pq->link[I] == q)
-    linker = &pq->link[I];
+  const std::size_t d = pq->link[I] == q ? I : O;
   if (!has_null_link<O>::apply(q) && !has_null_link<I>::apply(q))
-    return erase_node_lr_non_null<I>(linker, q);
+    return erase_node_lr_non_null<I>(pq, d, q);
 
   if (has_null_link<O>::apply(q) && !has_null_link<I>::apply(q))
-    return erase_node_one_null<O>(linker, q);
+    return erase_node_one_null<O>(pq, d, q);
 
   if (!has_null_link<O>::apply(q) && has_null_link<I>::apply(q))
-    return erase_node_one_null<I>(linker, q);
+    return erase_node_one_null<I>(pq, d, q);
 
   if (pq->link[O] == q) { // Both links are null
     set_link_null<O>::apply(pq);
@@ -291,6 +353,33 @@ Ptr erase_node(Ptr pq, Ptr q) noexcept
   return q;
 }
 
+template <typename Ptr>
+Ptr find_parent(Ptr head, Ptr p) noexcept
+{
+  // Finds the parent of p without searching from the root. If p is a
+  // left child the rightmost node of its subtree threads to the parent,
+  // if it is a right child the leftmost one does. Both spines are walked
+  // in lock step, so the cost is bounded by the shorter one that works.
+  Ptr l = p;
+  Ptr r = p;
+  for (;;) {
+    if (has_null_link<1>::apply(r)) {
+      Ptr s = r->link[1];
+      if (s->link[0] == p)
+        return s;
+    } else {
+      r = r->link[1];
+    }
+    if (has_null_link<0>::apply(l)) {
+      Ptr t = l->link[0];
+      if (t != head && t->link[1] == p)
+        return t;
+    } else {
+      l = l->link[0];
+    }
+  }
+}
+
 template <class Ptr, class K, class Comp>
 std::pair<Ptr, Ptr>
 find_with_parent(Ptr head, const K& key, const Comp& comp)
@@ -301,14 +390,14 @@ find_with_parent(Ptr head, const K& key, const Comp& comp)
   Ptr u = head; // pointer to the parent pointer.
   Ptr p = head->link[0];
   for (;;) {
-    if (comp(key, p->key)) {
+    if (comp(key, key_of(p))) {
       if (!has_null_link<0>::apply(p)) {
         u = p;
         p = p->link[0];
       } else {
         return std::make_pair(head, head);
       }
-    } else if (comp(p->key, key)) {
+    } else if (comp(key_of(p), key)) {
       if (!has_null_link<1>::apply(p)) {
         u = p;
         p = p->link[1];
@@ -322,6 +411,95 @@ find_with_parent(Ptr head, const K& key, const Comp& comp)
 }
 
 
+
+template <class Ptr, class Pred>
+Ptr partition_point(Ptr head, Pred pred)
+{
+  // Returns the first node for which pred is false, or head. pred must
+  // be true for a prefix of the inorder sequence.
+  if (has_null_link<0>::apply(head))
+    return head;
+
+  Ptr r = head;
+  Ptr p = head->link[0];
+  for (;;) {
+    if (pred(key_of(p))) {
+      if (has_null_link<1>::apply(p))
+        return r;
+      p = p->link[1];
+    } else {
+      r = p;
+      if (has_null_link<0>::apply(p))
+        return r;
+      p = p->link[0];
+    }
+  }
+}
+
+template <class Ptr, class K, class Comp>
+Ptr lower_bound(Ptr head, const K& key, const Comp& comp)
+{
+  using value_type = typename std::remove_reference<decltype(key_of(head))>::type;
+  return partition_point(head, [&](const value_type& v)
+  { return comp(v, key); });
+}
+
+template <class Ptr, class K, class Comp>
+Ptr upper_bound(Ptr head, const K& key, const Comp& comp)
+{
+  using value_type = typename std::remove_reference<decltype(key_of(head))>::type;
+  return partition_point(head, [&](const value_type& v)
+  { return !comp(key, v); });
+}
+
+// The two below need the counts of ranked_node.
+
+template <class Ptr>
+Ptr select(Ptr head, std::size_t k) noexcept
+{
+  // Returns the node at position k in order, or head if there is none.
+  if (has_null_link<0>::apply(head))
+    return head;
+
+  Ptr p = head->link[0];
+  for (;;) {
+    const std::size_t l = child_count<0>(p);
+    if (k == l)
+      return p;
+    if (k < l) {
+      p = p->link[0];
+    } else {
+      if (has_null_link<1>::apply(p))
+        return head;
+      k -= l + 1;
+      p = p->link[1];
+    }
+  }
+}
+
+template <class Ptr, class K, class Comp>
+std::size_t rank(Ptr head, const K& key, const Comp& comp)
+{
+  // Returns the number of keys less than key.
+  if (has_null_link<0>::apply(head))
+    return 0;
+
+  std::size_t r = 0;
+  Ptr p = head->link[0];
+  for (;;) {
+    if (comp(key_of(p), key)) {
+      r += child_count<0>(p) + 1;
+      if (has_null_link<1>::apply(p))
+        return r;
+      p = p->link[1];
+    } else {
+      if (has_null_link<0>::apply(p))
+        return r;
+      p = p->link[0];
+    }
+  }
+}
+
 }
 }
 
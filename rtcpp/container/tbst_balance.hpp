@@ -0,0 +1,553 @@
+#pragma once
+
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+
+#include <rtcpp/utility/exceptions.hpp>
+
+#include "tbst.hpp"
+
+/*
+  Balancing policies for rt::set. They implement insertion and erasure
+  on the threaded tree, all other operations are shared.
+
+  no_balance: The plain unbalanced tree.
+
+  avl_balance: An AVL tree. The balance factor is kept in two spare bits
+  of the node tag, so the node layout does not change. There are no
+  parent links, the path from the head is recorded in a fixed size
+  array on the stack, an AVL tree with 2^64 nodes is less than 92 levels
+  high. Rotations only relink nodes, nothing is allocated besides the
+  inserted node.
+
+  ranked<Base>: Base, no_balance or avl_balance, on tbst::ranked_node,
+  which also holds the size of its subtree, for the order statistics
+  of rt::set (nth, rank, count_range) in the height of the tree. The
+  counts on the search path are adjusted before Base changes the tree,
+  and the rotations of avl_balance recompute those of the nodes they
+  move. That costs one more search per insertion and erasure.
+
+  make_node may return a null Ptr(), e.g. when the allocator is
+  exhausted: the tree is left as it was and insert returns the head.
+*/
+
+namespace rt { namespace tbst {
+
+namespace detail {
+  constexpr std::size_t avl_max_height = 96;
+
+  constexpr int null_bit(std::size_t d) noexcept
+  { return d ? rbit : lbit; }
+}
+
+struct no_balance {
+  template <class Ptr, class K, class Comp, class F>
+  static std::pair<Ptr, bool>
+  insert(Ptr head, const K& key, const Comp& comp, F make_node);
+  // Links the constructed node q right before hint if its key belongs
+  // there, otherwise searches from the root. Returns the node with the
+  // key and whether q was linked.
+  template <class Ptr, class Comp>
+  static std::pair<Ptr, bool>
+  insert_hint(Ptr head, Ptr hint, Ptr q, const Comp& comp);
+  // Returns the unlinked node or head if the key is not present.
+  template <class Ptr, class K, class Comp>
+  static Ptr erase(Ptr head, const K& key, const Comp& comp) noexcept;
+  // Unlinks p, its parent is found through the threads.
+  template <class Ptr, class Comp>
+  static Ptr unlink(Ptr head, Ptr p, const Comp&) noexcept
+  { return erase_node<1>(find_parent(head, p), p); }
+};
+
+template <class Ptr, class K, class Comp, class F>
+std::pair<Ptr, bool>
+no_balance::insert(Ptr head, const K& key, const Comp& comp, F make_node)
+{
+  if (has_null_link<0>::apply(head)) { // The tree is empty
+    Ptr q = make_node(key);
+    if (q == Ptr())
+      return std::make_pair(head, false);
+    attach_node<0>(head, q);
+    return std::make_pair(q, true);
+  }
+
+  Ptr p = head->link[0];
+  for (;;) {
+    if (comp(key, key_of(p))) {
+      if (!has_null_link<0>::apply(p)) {
+        p = p->link[0];
+      } else {
+        Ptr q = make_node(key);
+        if (q == Ptr())
+          return std::make_pair(head, false);
+        attach_node<0>(p, q);
+        return std::make_pair(q, true);
+      }
+    } else if (comp(key_of(p), key)) {
+      if (!has_null_link<1>::apply(p)) {
+        p = p->link[1];
+      } else {
+        Ptr q = make_node(key);
+        if (q == Ptr())
+          return std::make_pair(head, false);
+        attach_node<1>(p, q);
+        return std::make_pair(q, true);
+      }
+    } else {
+      return std::make_pair(p, false);
+    }
+  }
+}
+
+template <class Ptr, class Comp>
+std::pair<Ptr, bool>
+no_balance::insert_hint(Ptr head, Ptr hint, Ptr q, const Comp& comp)
+{
+  Ptr pred = inorder<0>(hint);
+  const bool before = hint == head || comp(key_of(q), key_of(hint));
+  const bool after = pred == head || comp(key_of(pred), key_of(q));
+  if (!before || !after) {
+    auto make_node = [q](const typename std::remove_reference<
+                           decltype(key_of(q))>::type&) { return q; };
+    return insert(head, key_of(q), comp, make_node);
+  }
+
+  // Either hint has no left child or its predecessor has no right one.
+  if (has_null_link<0>::apply(hint))
+    attach_node<0>(hint, q);
+  else
+    attach_node<1>(pred, q);
+  return std::make_pair(q, true);
+}
+
+template <class Ptr, class K, class Comp>
+Ptr no_balance::erase(Ptr head, const K& key, const Comp& comp) noexcept
+{
+  auto pair = find_with_parent(head, key, comp);
+  if (pair.first == head)
+    return head;
+
+  return erase_node<1>(pair.second, pair.first);
+}
+
+class avl_balance {
+  private:
+  template <class Ptr>
+  static bool is_thread(Ptr p, std::size_t d) noexcept
+  { return p->tag & detail::null_bit(d); }
+  template <class Ptr>
+  static void set_thread(Ptr p, std::size_t d, bool b) noexcept
+  {
+    if (b)
+      p->tag |= detail::null_bit(d);
+    else
+      p->tag &= ~detail::null_bit(d);
+  }
+  // -1 if the left subtree is higher, 1 if the right one is.
+  template <class Ptr>
+  static int balance(Ptr p) noexcept
+  {
+    if (p->tag & detail::lhigh_bit)
+      return -1;
+    return (p->tag & detail::rhigh_bit) ? 1 : 0;
+  }
+  template <class Ptr>
+  static void set_balance(Ptr p, int b) noexcept
+  {
+    p->tag &= ~detail::balance_mask;
+    if (b < 0)
+      p->tag |= detail::lhigh_bit;
+    else if (b > 0)
+      p->tag |= detail::rhigh_bit;
+  }
+  template <class Ptr>
+  static Ptr rotate(Ptr a, std::size_t d) noexcept;
+  template <class Ptr>
+  struct path {
+    Ptr node[detail::avl_max_height];
+    unsigned char dir[detail::avl_max_height];
+    std::size_t n;
+  };
+  public:
+  template <class Ptr, class K, class Comp, class F>
+  static std::pair<Ptr, bool>
+  insert(Ptr head, const K& key, const Comp& comp, F make_node);
+  // The path from the root is needed to rebalance, so the hint is not
+  // used.
+  template <class Ptr, class Comp>
+  static std::pair<Ptr, bool>
+  insert_hint(Ptr head, Ptr, Ptr q, const Comp& comp)
+  {
+    auto make_node = [q](const typename std::remove_reference<
+                           decltype(key_of(q))>::type&) { return q; };
+    return insert(head, key_of(q), comp, make_node);
+  }
+  template <class Ptr, class K, class Comp>
+  static Ptr erase(Ptr head, const K& key, const Comp& comp) noexcept;
+  // Rebalancing needs the path from the root, so p is searched by key.
+  template <class Ptr, class Comp>
+  static Ptr unlink(Ptr head, Ptr p, const Comp& comp) noexcept
+  { return erase(head, key_of(p), comp); }
+};
+
+template <class Ptr>
+Ptr avl_balance::rotate(Ptr a, std::size_t d) noexcept
+{
+  // The subtree of a in direction d is two levels higher than the
+  // other. Returns the new root of the subtree, the caller relinks it.
+  const std::size_t o = 1 - d;
+  const int h = d ? 1 : -1;
+  Ptr b = a->link[d];
+  const int bb = balance(b);
+  if (bb != -h) { // Single rotation.
+    if (is_thread(b, o)) {
+      a->link[d] = b;
+      set_thread(a, d, true);
+    } else {
+      a->link[d] = static_cast<Ptr>(b->link[o]);
+    }
+    b->link[o] = a;
+    set_thread(b, o, false);
+    set_balance(a, bb ? 0 : h);
+    set_balance(b, bb ? 0 : -h);
+    update_count(a);
+    update_count(b);
+    return b;
+  }
+
+  Ptr c = b->link[o];
+  const int bc = balance(c);
+  const bool cd = is_thread(c, d);
+  const bool co = is_thread(c, o);
+  b->link[o] = static_cast<Ptr>(c->link[d]);
+  a->link[d] = static_cast<Ptr>(c->link[o]);
+  c->link[d] = b;
+  c->link[o] = a;
+  if (cd) {
+    b->link[o] = c;
+    set_thread(b, o, true);
+    set_thread(c, d, false);
+  }
+  if (co) {
+    a->link[d] = c;
+    set_thread(a, d, true);
+    set_thread(c, o, false);
+  }
+  set_balance(a, bc == h ? -h : 0);
+  set_balance(b, bc == -h ? h : 0);
+  set_balance(c, 0);
+  update_count(a);
+  update_count(b);
+  update_count(c);
+  return c;
+}
+
+template <class Ptr, class K, class Comp, class F>
+std::pair<Ptr, bool>
+avl_balance::insert(Ptr head, const K& key, const Comp& comp, F make_node)
+{
+  if (has_null_link<0>::apply(head)) {
+    Ptr q = make_node(key);
+    if (q == Ptr())
+      return std::make_pair(head, false);
+    attach_node<0>(head, q);
+    return std::make_pair(q, true);
+  }
+
+  path<Ptr> s;
+  s.node[0] = head;
+  s.dir[0] = 0;
+  s.n = 1;
+  Ptr p = head->link[0];
+  std::size_t d = 0;
+  for (;;) {
+    if (comp(key, key_of(p)))
+      d = 0;
+    else if (comp(key_of(p), key))
+      d = 1;
+    else
+      return std::make_pair(p, false);
+    s.node[s.n] = p;
+    s.dir[s.n++] = static_cast<unsigned char>(d);
+    if (is_thread(p, d))
+      break;
+    p = p->link[d];
+  }
+
+  Ptr q = make_node(key);
+  if (q == Ptr())
+    return std::make_pair(head, false);
+  if (d)
+    attach_node<1>(p, q);
+  else
+    attach_node<0>(p, q);
+
+  // Walks up while the subtree got higher.
+  for (std::size_t i = s.n - 1; i > 0; --i) {
+    Ptr a = s.node[i];
+    const int h = s.dir[i] ? 1 : -1;
+    const int b = balance(a);
+    if (b == 0) {
+      set_balance(a, h);
+      continue;
+    }
+    if (b == -h) {
+      set_balance(a, 0);
+      break;
+    }
+    s.node[i - 1]->link[s.dir[i - 1]] = rotate(a, s.dir[i]);
+    break;
+  }
+
+  return std::make_pair(q, true);
+}
+
+template <class Ptr, class K, class Comp>
+Ptr avl_balance::erase(Ptr head, const K& key, const Comp& comp) noexcept
+{
+  if (has_null_link<0>::apply(head))
+    return head;
+
+  path<Ptr> s;
+  s.node[0] = head;
+  s.dir[0] = 0;
+  s.n = 1;
+  Ptr p = head->link[0];
+  for (;;) {
+    std::size_t d = 0;
+    if (comp(key, key_of(p)))
+      d = 0;
+    else if (comp(key_of(p), key))
+      d = 1;
+    else
+      break;
+    if (is_thread(p, d))
+      return head;
+    s.node[s.n] = p;
+    s.dir[s.n++] = static_cast<unsigned char>(d);
+    p = p->link[d];
+  }
+
+  Ptr q = s.node[s.n - 1];
+  const std::size_t dq = s.dir[s.n - 1];
+  if (is_thread(p, 1)) {
+    if (!is_thread(p, 0)) {
+      // The predecessor threads to p, now it threads to the successor.
+      Ptr t = p->link[0];
+      while (!is_thread(t, 1))
+        t = t->link[1];
+      t->link[1] = static_cast<Ptr>(p->link[1]);
+      q->link[dq] = static_cast<Ptr>(p->link[0]);
+    } else {
+      q->link[dq] = static_cast<Ptr>(p->link[dq]);
+      set_thread(q, dq, true);
+    }
+  } else {
+    Ptr r = p->link[1];
+    if (is_thread(r, 0)) {
+      // The right child of p takes its place.
+      r->link[0] = static_cast<Ptr>(p->link[0]);
+      set_thread(r, 0, is_thread(p, 0));
+      if (!is_thread(r, 0)) {
+        Ptr t = r->link[0];
+        while (!is_thread(t, 1))
+          t = t->link[1];
+        t->link[1] = r;
+      }
+      q->link[dq] = r;
+      set_balance(r, balance(p));
+      s.node[s.n] = r;
+      s.dir[s.n++] = 1;
+    } else {
+      // The inorder successor of p takes its place.
+      const std::size_t j = s.n++;
+      s.dir[j] = 1;
+      Ptr u;
+      for (;;) {
+        s.node[s.n] = r;
+        s.dir[s.n++] = 0;
+        u = r->link[0];
+        if (is_thread(u, 0))
+          break;
+        r = u;
+      }
+
+      if (is_thread(u, 1)) {
+        r->link[0] = u;
+        set_thread(r, 0, true);
+      } else {
+        r->link[0] = static_cast<Ptr>(u->link[1]);
+      }
+
+      u->link[0] = static_cast<Ptr>(p->link[0]);
+      if (!is_thread(p, 0)) {
+        Ptr t = p->link[0];
+        while (!is_thread(t, 1))
+          t = t->link[1];
+        t->link[1] = u;
+        set_thread(u, 0, false);
+      }
+      u->link[1] = static_cast<Ptr>(p->link[1]);
+      set_thread(u, 1, false);
+      q->link[dq] = u;
+      set_balance(u, balance(p));
+      s.node[j] = u;
+    }
+  }
+
+  // Walks up while the subtree got shorter.
+  for (std::size_t i = s.n - 1; i > 0; --i) {
+    Ptr a = s.node[i];
+    const std::size_t d = s.dir[i];
+    const int h = d ? 1 : -1;
+    const int b = balance(a);
+    if (b == 0) {
+      set_balance(a, -h);
+      break;
+    }
+    if (b == h) {
+      set_balance(a, 0);
+      continue;
+    }
+    const int bc = balance(static_cast<Ptr>(a->link[1 - d]));
+    s.node[i - 1]->link[s.dir[i - 1]] = rotate(a, 1 - d);
+    if (bc == 0)
+      break;
+  }
+
+  return p;
+}
+
+namespace detail {
+  // Whether an erased node with only a left child is replaced by its
+  // inorder predecessor rather than by the child. Otherwise both
+  // policies replace a node with a right child by its successor.
+  template <class Balance>
+  struct erases_to_predecessor : std::false_type {};
+
+  template <>
+  struct erases_to_predecessor<no_balance> : std::true_type {};
+}
+
+template <class Base = avl_balance>
+struct ranked {
+  private:
+  // Adds d to the counts on the search path of key, stopping at stop.
+  template <class Ptr, class K, class Comp>
+  static void add_on_path(Ptr head, Ptr stop, const K& key, const Comp& comp, int d) noexcept;
+  // The inorder neighbour of p in its subtree I takes its place, the
+  // nodes above that one there lose one.
+  template <std::size_t I, class Ptr>
+  static void replace_count(Ptr p) noexcept;
+  public:
+  template <class Ptr, class K, class Comp, class F>
+  static std::pair<Ptr, bool>
+  insert(Ptr head, const K& key, const Comp& comp, F make_node);
+  template <class Ptr, class Comp>
+  static std::pair<Ptr, bool>
+  insert_hint(Ptr head, Ptr, Ptr q, const Comp& comp)
+  {
+    auto make_node = [q](const typename std::remove_reference<
+                           decltype(key_of(q))>::type&) { return q; };
+    return insert(head, key_of(q), comp, make_node);
+  }
+  template <class Ptr, class K, class Comp>
+  static Ptr erase(Ptr head, const K& key, const Comp& comp) noexcept;
+  template <class Ptr, class Comp>
+  static Ptr unlink(Ptr head, Ptr p, const Comp& comp) noexcept
+  { return erase(head, key_of(p), comp); }
+};
+
+// The node a policy keeps, tbst::node unless it needs more.
+template <class Balance, class T, class Ptr>
+struct balance_node {
+  using type = node<T, Ptr>;
+};
+
+template <class Base, class T, class Ptr>
+struct balance_node<ranked<Base>, T, Ptr> {
+  using type = ranked_node<T, Ptr>;
+};
+
+template <class Base>
+template <class Ptr, class K, class Comp>
+void ranked<Base>::add_on_path(Ptr head, Ptr stop, const K& key, const Comp& comp, int d) noexcept
+{
+  if (has_null_link<0>::apply(head))
+    return;
+
+  Ptr p = head->link[0];
+  while (p != stop) {
+    p->count += d;
+    if (comp(key, key_of(p))) {
+      if (has_null_link<0>::apply(p))
+        return;
+      p = p->link[0];
+    } else {
+      if (has_null_link<1>::apply(p))
+        return;
+      p = p->link[1];
+    }
+  }
+}
+
+template <class Base>
+template <class Ptr, class K, class Comp, class F>
+std::pair<Ptr, bool>
+ranked<Base>::insert(Ptr head, const K& key, const Comp& comp, F make_node)
+{
+  const Ptr p = find_with_parent(head, key, comp).first;
+  if (p != head)
+    return std::make_pair(p, false);
+
+  add_on_path(head, head, key, comp, 1);
+  auto make_leaf = [&make_node](const K& k)
+  {
+    Ptr q = make_node(k);
+    if (q != Ptr())
+      q->count = 1;
+    return q;
+  };
+  // A node that cannot be made leaves the tree as it was.
+  RTCPP_TRY {
+    const auto pair = Base::insert(head, key, comp, make_leaf);
+    if (!pair.second)
+      add_on_path(head, head, key, comp, -1);
+    return pair;
+  } RTCPP_CATCH_ALL {
+    add_on_path(head, head, key, comp, -1);
+    RTCPP_RETHROW
+  }
+}
+
+template <class Base>
+template <class Ptr, class K, class Comp>
+Ptr ranked<Base>::erase(Ptr head, const K& key, const Comp& comp) noexcept
+{
+  const Ptr p = find_with_parent(head, key, comp).first;
+  if (p == head)
+    return head;
+
+  add_on_path(head, p, key, comp, -1);
+  if (!has_null_link<1>::apply(p))
+    replace_count<1>(p);
+  else if (!has_null_link<0>::apply(p) && detail::erases_to_predecessor<Base>::value)
+    replace_count<0>(p);
+  return Base::erase(head, key, comp);
+}
+
+template <class Base>
+template <std::size_t I, class Ptr>
+void ranked<Base>::replace_count(Ptr p) noexcept
+{
+  const std::size_t O = index_helper<I>::other;
+  Ptr u = p->link[I];
+  for (; !has_null_link<O>::apply(u); u = u->link[O])
+    --u->count;
+  u->count = p->count - 1;
+}
+
+}
+}
+
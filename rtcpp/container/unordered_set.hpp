@@ -0,0 +1,621 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <initializer_list>
+
+#include <rtcpp/memory/allocator_traits.hpp>
+
+/*
+  A std::unordered_set with chained buckets that grows by linear
+  hashing: when the load factor is exceeded one bucket is split in two,
+  so an insertion moves the nodes of a single chain instead of
+  rehashing the whole table. The buckets live in segments whose sizes
+  double, a segment is requested from the allocator when the first
+  bucket in it is split into and nothing is ever copied or zeroed
+  beyond the bucket that is being created. reserve() requests all
+  segments up front, after it only the nodes are allocated.
+
+  The nodes are requested one at a time (see
+  allocator_traits::allocate_node), so they can come from the buffer
+  of a node_allocator, the segments are array allocations. Nodes keep
+  their hash, splitting a bucket does not call Hash.
+
+  Insertion invalidates iterators, as a split may move nodes to
+  another bucket, but not references. Erasure does not split or merge
+  buckets, the table never shrinks.
+*/
+
+namespace rt {
+
+// Index of the most significant bit set, x must not be zero.
+inline int log2_floor(std::uint64_t x) noexcept
+{
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(x);
+#else
+  int n = 0;
+  while (x >>= 1)
+    ++n;
+  return n;
+#endif
+}
+
+template <class T, class Ptr>
+struct hash_node {
+  using value_type = T;
+  using self_pointer = typename std::pointer_traits<Ptr>::template
+    rebind<hash_node<T, Ptr>>;
+  template<class U, class K>
+  struct rebind { using other = hash_node<U , K>; };
+  self_pointer next;
+  std::size_t hash;
+  T info;
+};
+
+template < class T
+         , class Hash = std::hash<T>
+         , class KeyEqual = std::equal_to<T>
+         , class Allocator = std::allocator<T>>
+class unordered_set {
+  public:
+  using key_type = T;
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using allocator_type = Allocator;
+  using reference = value_type&;
+  using const_reference = const value_type&;
+  private:
+  using alloc_traits_type = rt::allocator_traits<Allocator>;
+  using void_pointer = typename alloc_traits_type::void_pointer;
+  static_assert( std::is_pointer<void_pointer>::value
+               , "unordered_set: The allocator must use raw pointers.");
+  public:
+  using node_type = hash_node<T, void_pointer>;
+  private:
+  using inner_allocator_type =
+    typename alloc_traits_type::template rebind_alloc<node_type>;
+  using inner_alloc_traits_type =
+    rt::allocator_traits<inner_allocator_type>;
+  using node_pointer = typename inner_alloc_traits_type::pointer;
+  using segment_allocator_type =
+    typename alloc_traits_type::template rebind_alloc<node_pointer>;
+  using segment_alloc_traits_type =
+    rt::allocator_traits<segment_allocator_type>;
+  using segment_pointer = typename segment_alloc_traits_type::pointer;
+  static constexpr int max_segments = 8 * sizeof (size_type);
+  public:
+  class const_iterator :
+    public std::iterator<std::forward_iterator_tag, const T> {
+    friend class unordered_set;
+    const unordered_set* m_s;
+    size_type m_b;
+    node_pointer m_p;
+    const_iterator(const unordered_set* s, size_type b, node_pointer p) noexcept
+    : m_s(s), m_b(b), m_p(p) {}
+    public:
+    const_iterator() noexcept : m_s(0), m_b(0), m_p(0) {}
+    const T& operator*() const noexcept { return m_p->info; }
+    const T* operator->() const noexcept { return std::addressof(m_p->info); }
+    const_iterator& operator++() noexcept
+    {
+      m_p = m_p->next;
+      if (!m_p)
+        *this = m_s->first_from(m_b + 1);
+      return *this;
+    }
+    const_iterator operator++(int) noexcept
+    {
+      const_iterator tmp(*this);
+      operator++();
+      return tmp;
+    }
+    friend bool operator==( const const_iterator& a
+                          , const const_iterator& b) noexcept
+    { return a.m_p == b.m_p; }
+    friend bool operator!=( const const_iterator& a
+                          , const const_iterator& b) noexcept
+    { return a.m_p != b.m_p; }
+  };
+  using iterator = const_iterator;
+  private:
+  inner_allocator_type m_inner_alloc;
+  segment_allocator_type m_segment_alloc;
+  // Segment 0 holds the first m_base buckets, segment k > 0 the
+  // m_base << (k - 1) buckets that follow.
+  std::array<segment_pointer, max_segments> m_segments;
+  size_type m_base;
+  int m_level;
+  size_type m_split; // Next bucket to split at this level.
+  size_type m_size;
+  float m_max_load;
+  Hash m_hash;
+  KeyEqual m_equal;
+  node_pointer& bucket(size_type b) const noexcept;
+  size_type segment_size(int k) const noexcept
+  { return k == 0 ? m_base : m_base << (k - 1); }
+  size_type bucket_index(size_type h) const noexcept;
+  const_iterator first_from(size_type b) const noexcept;
+  void add_segment(int k);
+  bool needs_split(size_type n) const noexcept
+  { return n > m_max_load * bucket_count(); }
+  void split() noexcept;
+  void grow_for(size_type n);
+  template <class K>
+  node_pointer find_node(const K& key, size_type h) const noexcept;
+  void link(node_pointer p) noexcept;
+  template <class... Args>
+  node_pointer create_node(Args&&... args);
+  void drop_node(node_pointer p) noexcept;
+  template <class K>
+  std::pair<const_iterator, bool> insert_unique(K&& key);
+  void release_segments() noexcept;
+  void init(size_type n) noexcept;
+  void steal(unordered_set& rhs) noexcept;
+  public:
+  // n is rounded up to a power of two, it is the size of segment 0.
+  explicit unordered_set( size_type n = 16
+                        , const Hash& hash = Hash()
+                        , const KeyEqual& equal = KeyEqual()
+                        , const Allocator& alloc = Allocator());
+  explicit unordered_set(const Allocator& alloc)
+  : unordered_set(16, Hash(), KeyEqual(), alloc) {}
+  unordered_set( std::initializer_list<T> init
+               , const Allocator& alloc = Allocator())
+  : unordered_set(16, Hash(), KeyEqual(), alloc) { insert(init); }
+  unordered_set(const unordered_set& rhs);
+  unordered_set(unordered_set&& rhs) noexcept;
+  ~unordered_set();
+  unordered_set& operator=(const unordered_set& rhs);
+  unordered_set& operator=(unordered_set&& rhs) noexcept;
+  unordered_set& operator=(std::initializer_list<T> init);
+  void swap(unordered_set& other) noexcept;
+  // Looks the key up before requesting a node.
+  std::pair<iterator, bool> insert(const T& key) { return insert_unique(key); }
+  std::pair<iterator, bool> insert(T&& key)
+  { return insert_unique(std::move(key)); }
+  template <class InputIt>
+  void insert(InputIt begin, InputIt end);
+  void insert(std::initializer_list<T> init)
+  { insert(std::begin(init), std::end(init)); }
+  template <class... Args>
+  std::pair<iterator, bool> emplace(Args&&... args);
+  iterator erase(const_iterator pos) noexcept;
+  size_type erase(const T& key) noexcept;
+  void clear() noexcept;
+  // Requests the segments for n elements, does not split any bucket.
+  void reserve(size_type n);
+  const_iterator begin() const noexcept { return first_from(0); }
+  const_iterator end() const noexcept
+  { return const_iterator(this, bucket_count(), 0); }
+  const_iterator cbegin() const noexcept { return begin(); }
+  const_iterator cend() const noexcept { return end(); }
+  iterator find(const T& key) const noexcept;
+  size_type count(const T& key) const noexcept { return find(key) != end(); }
+  size_type size() const noexcept { return m_size; }
+  bool empty() const noexcept { return m_size == 0; }
+  size_type bucket_count() const noexcept
+  { return (m_base << m_level) + m_split; }
+  float load_factor() const noexcept
+  { return static_cast<float>(m_size) / bucket_count(); }
+  float max_load_factor() const noexcept { return m_max_load; }
+  // Takes effect on the next insertions, one split each while the
+  // load factor is above ml. As each also adds a node, a load factor
+  // above 1 comes down towards ml, one below stays below 1.
+  void max_load_factor(float ml) noexcept { m_max_load = ml; }
+  hasher hash_function() const { return m_hash; }
+  key_equal key_eq() const { return m_equal; }
+  allocator_type get_allocator() const { return m_inner_alloc; }
+};
+
+template <class T, class H, class E, class A>
+unordered_set<T, H, E, A>::unordered_set( size_type n, const H& hash
+                                        , const E& equal, const A& alloc)
+: m_inner_alloc(alloc)
+, m_segment_alloc(alloc)
+, m_max_load(1)
+, m_hash(hash)
+, m_equal(equal)
+{
+  init(n);
+}
+
+template <class T, class H, class E, class A>
+unordered_set<T, H, E, A>::unordered_set(const unordered_set& rhs)
+: m_inner_alloc(alloc_traits_type::select_on_container_copy_construction(rhs.m_inner_alloc))
+, m_segment_alloc(m_inner_alloc)
+, m_max_load(rhs.m_max_load)
+, m_hash(rhs.m_hash)
+, m_equal(rhs.m_equal)
+{
+  init(rhs.m_base);
+  try {
+    reserve(rhs.size());
+    insert(std::begin(rhs), std::end(rhs));
+  } catch (...) {
+    clear();
+    release_segments();
+    throw;
+  }
+}
+
+template <class T, class H, class E, class A>
+unordered_set<T, H, E, A>::unordered_set(unordered_set&& rhs) noexcept
+: m_inner_alloc(rhs.m_inner_alloc)
+, m_segment_alloc(rhs.m_segment_alloc)
+, m_hash(rhs.m_hash)
+, m_equal(rhs.m_equal)
+{
+  steal(rhs);
+}
+
+template <class T, class H, class E, class A>
+unordered_set<T, H, E, A>::~unordered_set()
+{
+  clear();
+  release_segments();
+}
+
+template <class T, class H, class E, class A>
+unordered_set<T, H, E, A>&
+unordered_set<T, H, E, A>::operator=(const unordered_set& rhs)
+{
+  if (this != &rhs) {
+    unordered_set tmp(rhs);
+    swap(tmp);
+  }
+  return *this;
+}
+
+template <class T, class H, class E, class A>
+unordered_set<T, H, E, A>&
+unordered_set<T, H, E, A>::operator=(unordered_set&& rhs) noexcept
+{
+  swap(rhs);
+  return *this;
+}
+
+template <class T, class H, class E, class A>
+unordered_set<T, H, E, A>&
+unordered_set<T, H, E, A>::operator=(std::initializer_list<T> init)
+{
+  clear();
+  insert(init);
+  return *this;
+}
+
+template <class T, class H, class E, class A>
+void unordered_set<T, H, E, A>::init(size_type n) noexcept
+{
+  m_segments.fill(0);
+  m_base = 1;
+  while (m_base < n)
+    m_base <<= 1;
+  m_level = 0;
+  m_split = 0;
+  m_size = 0;
+}
+
+template <class T, class H, class E, class A>
+void unordered_set<T, H, E, A>::steal(unordered_set& rhs) noexcept
+{
+  m_segments = rhs.m_segments;
+  m_base = rhs.m_base;
+  m_level = rhs.m_level;
+  m_split = rhs.m_split;
+  m_size = rhs.m_size;
+  m_max_load = rhs.m_max_load;
+  rhs.init(rhs.m_base);
+}
+
+template <class T, class H, class E, class A>
+void unordered_set<T, H, E, A>::swap(unordered_set& other) noexcept
+{
+  std::swap(m_inner_alloc, other.m_inner_alloc);
+  std::swap(m_segment_alloc, other.m_segment_alloc);
+  std::swap(m_segments, other.m_segments);
+  std::swap(m_base, other.m_base);
+  std::swap(m_level, other.m_level);
+  std::swap(m_split, other.m_split);
+  std::swap(m_size, other.m_size);
+  std::swap(m_max_load, other.m_max_load);
+  std::swap(m_hash, other.m_hash);
+  std::swap(m_equal, other.m_equal);
+}
+
+template <class T, class H, class E, class A>
+typename unordered_set<T, H, E, A>::node_pointer&
+unordered_set<T, H, E, A>::bucket(size_type b) const noexcept
+{
+  if (b < m_base)
+    return m_segments[0][b];
+
+  const int k = log2_floor(b / m_base);
+  return m_segments[k + 1][b - (m_base << k)];
+}
+
+template <class T, class H, class E, class A>
+typename unordered_set<T, H, E, A>::size_type
+unordered_set<T, H, E, A>::bucket_index(size_type h) const noexcept
+{
+  const size_type low = (m_base << m_level) - 1;
+  const size_type b = h & low;
+  // Buckets before the split pointer are already addressed with one
+  // more bit.
+  return b < m_split ? h & ((low << 1) | 1) : b;
+}
+
+template <class T, class H, class E, class A>
+typename unordered_set<T, H, E, A>::const_iterator
+unordered_set<T, H, E, A>::first_from(size_type b) const noexcept
+{
+  if (m_size != 0)
+    for (const size_type n = bucket_count(); b < n; ++b)
+      if (bucket(b))
+        return const_iterator(this, b, bucket(b));
+
+  return end();
+}
+
+template <class T, class H, class E, class A>
+void unordered_set<T, H, E, A>::add_segment(int k)
+{
+  if (k >= max_segments)
+    throw std::bad_alloc();
+
+  const size_type n = segment_size(k);
+  segment_pointer s = segment_alloc_traits_type::allocate(m_segment_alloc, n);
+  // Only segment 0 is used before being split into.
+  if (k == 0)
+    std::fill(s, s + n, node_pointer(0));
+  m_segments[k] = s;
+}
+
+template <class T, class H, class E, class A>
+void unordered_set<T, H, E, A>::grow_for(size_type n)
+{
+  if (!m_segments[0])
+    add_segment(0);
+
+  // The split of bucket 0 at a level starts a new segment.
+  if (needs_split(n) && m_split == 0 && !m_segments[m_level + 1])
+    add_segment(m_level + 1);
+}
+
+template <class T, class H, class E, class A>
+void unordered_set<T, H, E, A>::split() noexcept
+{
+  const size_type half = m_base << m_level;
+  const size_type mask = (half << 1) - 1;
+  node_pointer* lo = &bucket(m_split);
+  node_pointer* hi = &bucket(m_split + half);
+  node_pointer p = *lo;
+  // Keeps the relative order of the nodes in both chains.
+  while (p) {
+    const node_pointer next = p->next;
+    if ((p->hash & mask) == m_split) {
+      *lo = p;
+      lo = &p->next;
+    } else {
+      *hi = p;
+      hi = &p->next;
+    }
+    p = next;
+  }
+  *lo = 0;
+  *hi = 0;
+
+  if (++m_split == half) {
+    ++m_level;
+    m_split = 0;
+  }
+}
+
+template <class T, class H, class E, class A>
+void unordered_set<T, H, E, A>::reserve(size_type n)
+{
+  grow_for(0);
+  size_type buckets = m_base;
+  for (int k = 1; n > m_max_load * buckets; ++k) {
+    if (!m_segments[k])
+      add_segment(k);
+    buckets += segment_size(k);
+  }
+}
+
+template <class T, class H, class E, class A>
+template <class K>
+typename unordered_set<T, H, E, A>::node_pointer
+unordered_set<T, H, E, A>::find_node(const K& key, size_type h) const noexcept
+{
+  for (node_pointer p = bucket(bucket_index(h)); p; p = p->next)
+    if (p->hash == h && m_equal(p->info, key))
+      return p;
+
+  return 0;
+}
+
+template <class T, class H, class E, class A>
+void unordered_set<T, H, E, A>::link(node_pointer p) noexcept
+{
+  node_pointer& head = bucket(bucket_index(p->hash));
+  p->next = head;
+  head = p;
+  ++m_size;
+  // At most one split, so that the cost of an insertion is bounded
+  // even right after max_load_factor was lowered. A split that starts a
+  // segment has it from grow_for.
+  if (needs_split(m_size) && (m_split != 0 || m_segments[m_level + 1]))
+    split();
+}
+
+template <class T, class H, class E, class A>
+template <class... Args>
+typename unordered_set<T, H, E, A>::node_pointer
+unordered_set<T, H, E, A>::create_node(Args&&... args)
+{
+  node_pointer p = inner_alloc_traits_type::allocate_node(m_inner_alloc);
+  try {
+    inner_alloc_traits_type::construct( m_inner_alloc, std::addressof(p->info)
+                                      , std::forward<Args>(args)...);
+  } catch (...) {
+    inner_alloc_traits_type::deallocate_node(m_inner_alloc, p);
+    throw;
+  }
+  return p;
+}
+
+template <class T, class H, class E, class A>
+void unordered_set<T, H, E, A>::drop_node(node_pointer p) noexcept
+{
+  inner_alloc_traits_type::destroy(m_inner_alloc, std::addressof(p->info));
+  inner_alloc_traits_type::deallocate_node(m_inner_alloc, p);
+}
+
+template <class T, class H, class E, class A>
+template <class... Args>
+std::pair<typename unordered_set<T, H, E, A>::iterator, bool>
+unordered_set<T, H, E, A>::emplace(Args&&... args)
+{
+  grow_for(m_size + 1);
+  node_pointer p = create_node(std::forward<Args>(args)...);
+  p->hash = m_hash(p->info);
+  const node_pointer q = find_node(p->info, p->hash);
+  if (q) {
+    drop_node(p);
+    return std::make_pair(find(q->info), false);
+  }
+
+  link(p);
+  return std::make_pair(const_iterator(this, bucket_index(p->hash), p), true);
+}
+
+template <class T, class H, class E, class A>
+template <class K>
+std::pair<typename unordered_set<T, H, E, A>::iterator, bool>
+unordered_set<T, H, E, A>::insert_unique(K&& key)
+{
+  const size_type h = m_hash(key);
+  if (m_size != 0) {
+    const node_pointer q = find_node(key, h);
+    if (q)
+      return std::make_pair(const_iterator(this, bucket_index(h), q), false);
+  }
+
+  grow_for(m_size + 1);
+  node_pointer p = create_node(std::forward<K>(key));
+  p->hash = h;
+  link(p);
+  return std::make_pair(const_iterator(this, bucket_index(h), p), true);
+}
+
+template <class T, class H, class E, class A>
+template <class InputIt>
+void unordered_set<T, H, E, A>::insert(InputIt begin, InputIt end)
+{
+  for (; begin != end; ++begin)
+    insert(*begin);
+}
+
+template <class T, class H, class E, class A>
+typename unordered_set<T, H, E, A>::iterator
+unordered_set<T, H, E, A>::find(const T& key) const noexcept
+{
+  if (m_size == 0)
+    return end();
+
+  const size_type h = m_hash(key);
+  const node_pointer p = find_node(key, h);
+  return p ? const_iterator(this, bucket_index(h), p) : end();
+}
+
+template <class T, class H, class E, class A>
+typename unordered_set<T, H, E, A>::iterator
+unordered_set<T, H, E, A>::erase(const_iterator pos) noexcept
+{
+  const_iterator next = pos;
+  ++next;
+  node_pointer* pp = &bucket(pos.m_b);
+  while (*pp != pos.m_p)
+    pp = &(*pp)->next;
+  *pp = pos.m_p->next;
+  drop_node(pos.m_p);
+  --m_size;
+  return next;
+}
+
+template <class T, class H, class E, class A>
+typename unordered_set<T, H, E, A>::size_type
+unordered_set<T, H, E, A>::erase(const T& key) noexcept
+{
+  const_iterator pos = find(key);
+  if (pos == end())
+    return 0;
+
+  erase(pos);
+  return 1;
+}
+
+template <class T, class H, class E, class A>
+void unordered_set<T, H, E, A>::clear() noexcept
+{
+  if (m_size == 0)
+    return;
+
+  for (size_type b = 0; b < bucket_count(); ++b) {
+    node_pointer p = bucket(b);
+    while (p) {
+      const node_pointer next = p->next;
+      drop_node(p);
+      p = next;
+    }
+    bucket(b) = 0;
+  }
+  m_size = 0;
+}
+
+template <class T, class H, class E, class A>
+void unordered_set<T, H, E, A>::release_segments() noexcept
+{
+  for (int k = 0; k < max_segments; ++k)
+    if (m_segments[k])
+      segment_alloc_traits_type::deallocate( m_segment_alloc, m_segments[k]
+                                           , segment_size(k));
+  m_segments.fill(0);
+}
+
+template <class T, class H, class E, class A>
+bool operator==( const unordered_set<T, H, E, A>& a
+               , const unordered_set<T, H, E, A>& b)
+{
+  if (a.size() != b.size())
+    return false;
+
+  for (const auto& v: a)
+    if (!b.count(v))
+      return false;
+
+  return true;
+}
+
+template <class T, class H, class E, class A>
+bool operator!=( const unordered_set<T, H, E, A>& a
+               , const unordered_set<T, H, E, A>& b)
+{ return !(a == b); }
+
+template <class T, class H, class E, class A>
+void swap(unordered_set<T, H, E, A>& a, unordered_set<T, H, E, A>& b) noexcept
+{ a.swap(b); }
+
+}
+
@@ -5,11 +5,22 @@
 
 namespace rt {
 
+// Size of the cache line, to keep data written by different threads
+// apart.
+constexpr std::size_t cache_line_size = 64;
+
+constexpr bool is_pow2(std::size_t n) noexcept
+{ return (n > 0) && ((n & (n - 1)) == 0); }
+
 template <std::size_t N>
 struct is_power_of_two {
-  static constexpr bool value = (N > 0) && ((N & (N - 1)) == 0);
+  static constexpr bool value = is_pow2(N);
 };
 
+// The largest power of two not above n, which must not be zero.
+constexpr std::size_t floor_pow2(std::size_t n) noexcept
+{ return is_pow2(n) ? n : floor_pow2(n & (n - 1)); }
+
 // returns true if a is aligned with respect to N i.e. the remainder of a
 // divided by b is zero. N must be a power of two.
 template <std::size_t N>
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+
+#include "align.hpp"
+
+/*
+  Stack policy adapter laying out the blocks of the buffer on A byte
+  boundaries: the stack is instantiated for a block of the size of
+  the node rounded up to a multiple of A, and the buffer is aligned on
+  A when it is linked. With A = 16, 32 or 64 nodes never straddle two
+  cache lines and scans over the blocks (see block_range) get aligned
+  loads. With A = cache_line_size nodes written by different threads
+  never share a line, at the cost of a line per node, e.g.
+
+    rt::node_allocator< int, Node
+                      , rt::aligned<rt::atomic_node_stack, rt::cache_line_size>::type>
+
+  It works with the stacks that link the buffer of the header:
+  node_stack, atomic_node_stack, magazine_node_stack and
+  bump_node_stack. Blocks are never less aligned than the node. The
+  blocks of slab_chain and size_class_pool are aligned at most on
+  std::max_align_t.
+*/
+
+namespace rt {
+
+template <class T, std::size_t A>
+struct alignas(T) alignas(A) aligned_block {
+  static_assert(is_pow2(A), "aligned_block: A must be a power of two.");
+  unsigned char data[sizeof (T)];
+};
+
+template <template <class, class> class Stack, std::size_t A>
+struct aligned {
+  template <class T, class Index>
+  using type = Stack<aligned_block<T, A>, Index>;
+};
+
+}
+
@@ -1,11 +1,29 @@
 #pragma once
 
+#include <new>
 #include <type_traits>
 
 #include "node_traits.hpp"
 
+#include <rtcpp/utility/exceptions.hpp>
+
 namespace rt {
 
+RTCPP_HAS_NESTED_TYPE(void_pointer)
+
+// Uses Alloc::void_pointer if provided, so that allocators can make
+// the containers link their nodes with fancy pointers.
+template <typename Alloc, bool B = has_void_pointer<Alloc>::value>
+struct void_pointer_helper {
+  using type = typename Alloc::void_pointer;
+};
+
+template <typename Alloc>
+struct void_pointer_helper<Alloc, false> {
+  using type = typename std::pointer_traits<
+    typename Alloc::pointer>::template rebind<void>;
+};
+
 template <typename Alloc>
 struct allocator_traits {
   using allocator_type = Alloc;
@@ -18,8 +36,7 @@ struct allocator_traits {
   using const_void_pointer =
     typename std::pointer_traits<pointer>::template
       rebind<const void>;
-  using void_pointer =
-    typename std::pointer_traits<pointer>::template rebind<void>;
+  using void_pointer = typename void_pointer_helper<Alloc>::type;
   using const_pointer = typename allocator_type::const_pointer;
   using propagate_on_container_copy_assignment = std::true_type;
   using propagate_on_container_move_assignment = std::true_type;
@@ -41,6 +58,30 @@ struct allocator_traits {
     !has_allocate_node<Alloc2>::value, pointer>::type
   allocate_node(Alloc2& a) {return a.allocate(1);}
 
+  // A null pointer when the allocator is exhausted. Allocators without
+  // try_allocate_node report it with std::bad_alloc, which is caught
+  // unless exceptions are disabled.
+  template <typename Alloc2 = allocator_type>
+  static typename std::enable_if<
+    has_try_allocate_node<Alloc2>::value, pointer>::type
+  try_allocate_node(Alloc2& a) {return a.try_allocate_node();}
+
+  template <typename Alloc2 = allocator_type>
+  static typename std::enable_if<
+    !has_try_allocate_node<Alloc2>::value, pointer>::type
+  try_allocate_node(Alloc2& a)
+  {
+#if RTCPP_EXCEPTIONS
+    try {
+      return allocate_node(a);
+    } catch (const std::bad_alloc&) {
+      return pointer();
+    }
+#else
+    return allocate_node(a);
+#endif
+  }
+
   static pointer allocate(Alloc& a, size_type n)
   {return a.allocate(n);}
 
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <new>
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+#include "align.hpp"
+
+#include <rtcpp/utility/exceptions.hpp>
+
+/*
+  Monotonic arena for array allocations, the counterpart of the node
+  buffer of node_alloc_header. Allocations are carved out of a caller
+  buffer by bumping a pointer, aligned for the element type, and
+  throw std::bad_alloc when the buffer is exhausted. Deallocating the
+  most recent array gives its bytes back, other deallocations are
+  no-ops until release(), e.g. a growing vector leaves its old
+  buffers behind.
+
+  Give it to node_alloc_header::use_arena() and the allocators serve
+  their array allocations from it instead of std::allocator, so a
+  container gets both its nodes and its arrays from preallocated
+  memory. It is not thread safe.
+*/
+
+namespace rt {
+
+class array_arena {
+  private:
+  char* m_begin;
+  char* m_top;
+  char* m_end;
+  public:
+  template <class U>
+  array_arena(U* data, std::size_t n) noexcept
+  : m_begin(reinterpret_cast<char*>(data))
+  , m_top(m_begin)
+  , m_end(m_begin + n * sizeof (U)) {}
+  template <class U, std::size_t I>
+  explicit array_arena(std::array<U, I>& arr) noexcept
+  : array_arena(arr.data(), arr.size()) {}
+  template <class U, class A>
+  explicit array_arena(std::vector<U, A>& arr) noexcept
+  : array_arena(arr.data(), arr.size()) {}
+  array_arena(const array_arena&) = delete;
+  array_arena& operator=(const array_arena&) = delete;
+  template <class T>
+  T* allocate(std::size_t n);
+  template <class T>
+  void deallocate(T* p, std::size_t n) noexcept;
+  // Forgets all arrays at once.
+  void release() noexcept { m_top = m_begin; }
+  bool owns(const void* p) const noexcept
+  { return m_begin <= p && p < m_end; }
+  std::size_t used() const noexcept
+  { return static_cast<std::size_t>(m_top - m_begin); }
+  std::size_t remaining() const noexcept
+  { return static_cast<std::size_t>(m_end - m_top); }
+  std::size_t capacity() const noexcept
+  { return static_cast<std::size_t>(m_end - m_begin); }
+};
+
+template <class T>
+T* array_arena::allocate(std::size_t n)
+{
+  char* p = m_top;
+  std::size_t s = remaining();
+  align_if_needed<alignof (T)>(p, s);
+  // The padding may not fit either.
+  if (s > remaining() || n > s / sizeof (T))
+    throw_exception(std::bad_alloc());
+
+  m_top = p + n * sizeof (T);
+  return reinterpret_cast<T*>(p);
+}
+
+template <class T>
+void array_arena::deallocate(T* p, std::size_t n) noexcept
+{
+  char* q = reinterpret_cast<char*>(p);
+  if (q + n * sizeof (T) == m_top)
+    m_top = q;
+}
+
+}
+
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+
+#include "node_stack.hpp"
+#include "node_alloc_header.hpp"
+
+#include <rtcpp/utility/exceptions.hpp>
+
+/*
+  Lock-free counterpart of node_stack. The avail stack is linked
+  exactly like in node_stack, the difference is that the top of the
+  stack (the first Index in the buffer) is replaced by a tagged word:
+  the lower 32 bits hold the index of the top block and the upper
+  32 bits a counter that is incremented on every update to avoid the
+  ABA problem. Pop and push are a single CAS on that word, so many
+  allocators, each one living in its own thread, can share the same
+  node_alloc_header.
+
+  The buffer must not be larger than 2^32 indexes. Construction (the
+  linking of the buffer) is not thread safe, all allocators have to
+  be rebound before the header is shared among the threads.
+*/
+
+namespace rt {
+
+template <class T, class Index>
+class atomic_node_stack {
+  static_assert( sizeof (std::atomic<Index>) == sizeof (Index)
+               , "atomic_node_stack: Index is not lock-free.");
+  public:
+  using word_type = std::uint64_t;
+  static const word_type idx_mask = 0xffffffff;
+  node_alloc_header* header;
+  // used only when default constructed.
+  node_alloc_header header_dummy;
+  private:
+  std::atomic<word_type>* top() const noexcept
+  {return reinterpret_cast<std::atomic<word_type>*>(header->buffer);}
+  std::atomic<Index>* link(Index i) const noexcept
+  {
+    auto p = reinterpret_cast<Index*>(header->buffer);
+    return reinterpret_cast<std::atomic<Index>*>(&p[i]);
+  }
+  static word_type make_word(word_type old, Index i) noexcept
+  {return (((old >> 32) + 1) << 32) | i;}
+  public:
+  atomic_node_stack() : header(&header_dummy) {}
+  atomic_node_stack(node_alloc_header* header);
+  Index pop() noexcept;
+  void push(Index p) noexcept;
+  // Pops at most n indexes into out, returns how many were popped.
+  std::size_t pop_n(Index* out, std::size_t n) noexcept;
+  // Pushes the n indexes in a single CAS.
+  void push_n(const Index* in, std::size_t n) noexcept;
+  void mark(Index i, bool used) noexcept
+  {
+    if (!header->bitmap)
+      return;
+    const std::size_t k = i * sizeof (Index) / header->block_size;
+    const word_type bit = word_type(1) << (k % 64);
+    auto w = reinterpret_cast<std::atomic<word_type>*>(&header->bitmap[k / 64]);
+    if (used)
+      w->fetch_or(bit, std::memory_order_relaxed);
+    else
+      w->fetch_and(~bit, std::memory_order_relaxed);
+  }
+  void* address(Index i) const noexcept
+  {return &reinterpret_cast<Index*>(header->buffer)[i];}
+  Index index(const void* p) const noexcept
+  {
+    return static_cast<const Index*>(p)
+         - reinterpret_cast<const Index*>(header->buffer);
+  }
+  bool operator==(const atomic_node_stack& rhs) const noexcept
+  {return header == rhs.header;}
+  void swap(atomic_node_stack& other) noexcept
+  {std::swap(header, other.header);}
+};
+
+template <class T, class Index>
+atomic_node_stack<T, Index>::atomic_node_stack(node_alloc_header* h)
+: header(h)
+{
+  static_assert( sizeof (T) >= sizeof (word_type)
+               , "atomic_node_stack: incompatible node size.");
+  const bool linked = header->n_alloc != 0;
+  // Checked before linking, which leaves the header changed. Aligning
+  // only shrinks the buffer.
+  if (!linked && header->buffer_size / sizeof (Index) > idx_mask)
+    throw_exception(std::runtime_error("atomic_node_stack: Buffer too big."));
+
+  link_header<sizeof (T), Index, alignof (T)>(header);
+  if (linked)
+    return;
+
+  // Replaces the top index written by link_stack by a tagged word.
+  const Index i = reinterpret_cast<Index*>(header->buffer)[0];
+  ::new (static_cast<void*>(header->buffer)) std::atomic<word_type>(i);
+}
+
+template <class T, class Index>
+Index atomic_node_stack<T, Index>::pop() noexcept
+{
+  // If the top block is taken by another thread between the load
+  // and the CAS, the index read from it may be garbage, but then the
+  // counter has changed and the CAS fails.
+  word_type old = top()->load(std::memory_order_acquire);
+  for (;;) {
+    const Index i = static_cast<Index>(old & idx_mask);
+    if (!i)
+      return 0;
+    const Index next = link(i)->load(std::memory_order_relaxed);
+    if (top()->compare_exchange_weak( old, make_word(old, next)
+                                    , std::memory_order_acq_rel
+                                    , std::memory_order_acquire))
+      return i;
+  }
+}
+
+template <class T, class Index>
+void atomic_node_stack<T, Index>::push(Index idx) noexcept
+{
+  word_type old = top()->load(std::memory_order_relaxed);
+  for (;;) {
+    link(idx)->store( static_cast<Index>(old & idx_mask)
+                    , std::memory_order_relaxed);
+    if (top()->compare_exchange_weak( old, make_word(old, idx)
+                                    , std::memory_order_release
+                                    , std::memory_order_relaxed))
+      return;
+  }
+}
+
+template <class T, class Index>
+std::size_t
+atomic_node_stack<T, Index>::pop_n(Index* out, std::size_t n) noexcept
+{
+  // Walking the chain below the top to detach many blocks in one CAS
+  // would read links of blocks already taken by other threads, so the
+  // blocks are popped one by one.
+  std::size_t i = 0;
+  for (; i != n; ++i) {
+    out[i] = pop();
+    if (!out[i])
+      break;
+  }
+  return i;
+}
+
+template <class T, class Index>
+void
+atomic_node_stack<T, Index>::push_n(const Index* in, std::size_t n) noexcept
+{
+  if (!n)
+    return;
+
+  // The blocks are still owned by us, they can be chained without
+  // synchronization.
+  for (std::size_t i = 1; i != n; ++i)
+    link(in[i - 1])->store(in[i], std::memory_order_relaxed);
+
+  word_type old = top()->load(std::memory_order_relaxed);
+  for (;;) {
+    link(in[n - 1])->store( static_cast<Index>(old & idx_mask)
+                          , std::memory_order_relaxed);
+    if (top()->compare_exchange_weak( old, make_word(old, in[0])
+                                    , std::memory_order_release
+                                    , std::memory_order_relaxed))
+      return;
+  }
+}
+
+}
+
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "node_alloc_header.hpp"
+
+/*
+  Range over all blocks of the buffer of a node_alloc_header as laid
+  out by link_stack, in address order. Block 0 holds the top of the
+  avail stack and is not part of the range. Free and used blocks
+  alike are visited, it is up to the container to tell them apart,
+  e.g. rt::set with tbst::test_in_use. Blocks that have never been
+  used keep the content the buffer had when the header was built,
+  so the buffer should be zero initialized.
+
+  If the header has an occupancy bitmap, for_each_used() visits only
+  the blocks in use, jumping over free runs one word at a time without
+  touching the blocks themselves.
+
+  Headers built on a slab_chain or a size_class_pool produce an empty
+  range.
+*/
+
+namespace rt {
+
+// Index of the least significant bit set, x must not be zero.
+inline int count_trailing_zeros(std::uint64_t x) noexcept
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(x);
+#else
+  int n = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    ++n;
+  }
+  return n;
+#endif
+}
+
+template <class T>
+class block_iterator :
+  public std::iterator<std::forward_iterator_tag, T> {
+  private:
+  char* m_p;
+  std::size_t m_stride;
+  public:
+  block_iterator(char* p, std::size_t stride) noexcept
+  : m_p(p), m_stride(stride) {}
+  block_iterator& operator++() noexcept
+  {
+    m_p += m_stride;
+    return *this;
+  }
+  block_iterator operator++(int) noexcept
+  {
+    block_iterator tmp(*this);
+    operator++();
+    return tmp;
+  }
+  T& operator*() const noexcept {return *reinterpret_cast<T*>(m_p);}
+  T* operator->() const noexcept {return reinterpret_cast<T*>(m_p);}
+  bool operator==(const block_iterator& rhs) const noexcept
+  {return m_p == rhs.m_p;}
+  bool operator!=(const block_iterator& rhs) const noexcept
+  {return !(*this == rhs);}
+};
+
+template <class T>
+class block_range {
+  private:
+  char* m_first;
+  std::size_t m_stride;
+  std::size_t m_n;
+  const std::uint64_t* m_bitmap;
+  public:
+  using iterator = block_iterator<T>;
+  explicit block_range(const node_alloc_header* h) noexcept
+  : m_first(h->buffer)
+  , m_stride(h->block_size)
+  , m_n(0)
+  , m_bitmap(h->bitmap)
+  {
+    if (h->slabs || h->classes || !m_stride)
+      return;
+
+    // The header buffer has already been aligned by link_header.
+    m_n = h->buffer_size / m_stride;
+    if (m_n)
+      --m_n;
+    m_first += m_stride;
+  }
+  iterator begin() const noexcept {return iterator(m_first, m_stride);}
+  iterator end() const noexcept
+  {return iterator(m_first + m_n * m_stride, m_stride);}
+  std::size_t size() const noexcept {return m_n;}
+  std::size_t stride() const noexcept {return m_stride;}
+  bool has_bitmap() const noexcept {return m_bitmap != 0;}
+  // Applies f to the blocks in use. Requires has_bitmap().
+  template <class F>
+  void for_each_used(F f) const;
+};
+
+template <class T>
+template <class F>
+void block_range<T>::for_each_used(F f) const
+{
+  // Bit k refers to block k of the buffer that is one block before
+  // m_first.
+  char* const base = m_first - m_stride;
+  const std::size_t n_words = (m_n + 1 + 63) / 64;
+  for (std::size_t i = 0; i < n_words; ++i) {
+    std::uint64_t w = m_bitmap[i];
+    while (w) {
+      const std::size_t k = 64 * i + count_trailing_zeros(w);
+      w &= w - 1;
+      f(*reinterpret_cast<T*>(base + k * m_stride));
+    }
+  }
+}
+
+}
+
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <utility>
+#include <stdexcept>
+
+#include "link_stack.hpp"
+#include "node_stack.hpp"
+#include "node_alloc_header.hpp"
+
+/*
+  Avail stack that does not link the buffer on construction. Blocks
+  that were never used are handed out from a bump index that walks
+  the buffer forward, only released blocks go to a stack as in
+  node_stack. Construction is O(1) and touches only the first block,
+  so the pages of a large buffer are faulted as the nodes are used
+  instead of all at startup (see also huge_pool::prefault for the
+  opposite trade-off).
+
+  Both the top of the stack and the bump index live in the first
+  block, the buffer can therefore be reopened as with node_stack, e.g.
+  through mapped_pool. Nodes must be at least two indexes big. It is
+  not thread safe.
+*/
+
+namespace rt {
+
+template <class T, class Index>
+class bump_node_stack : public node_stack<T, Index> {
+  public:
+  using node_stack<T, Index>::header;
+  private:
+  Index m_stride; // Block size in indexes.
+  Index m_end; // One past the last block.
+  Index* top() const noexcept
+  {return reinterpret_cast<Index*>(header->buffer);}
+  public:
+  bump_node_stack() : m_stride(0), m_end(0) {}
+  bump_node_stack(node_alloc_header* h);
+  Index pop() noexcept;
+  void push(Index p) noexcept;
+  // Blocks never handed out.
+  std::size_t untouched() const noexcept
+  {return m_stride ? (m_end - top()[1]) / m_stride : 0;}
+  void swap(bump_node_stack& other) noexcept
+  {
+    node_stack<T, Index>::swap(other);
+    std::swap(m_stride, other.m_stride);
+    std::swap(m_end, other.m_end);
+  }
+};
+
+template <class T, class Index>
+bump_node_stack<T, Index>::bump_node_stack(node_alloc_header* h)
+{
+  static_assert( sizeof (T) >= 2 * sizeof (Index)
+               , "bump_node_stack: incompatible node size.");
+  header = h;
+  link_header< sizeof (T), Index, alignof (T)
+             , &init_bump_stack<sizeof (T), Index>>(h);
+  m_stride = static_cast<Index>(h->block_size / sizeof (Index));
+  m_end = static_cast<Index>(h->buffer_size / h->block_size * m_stride);
+}
+
+template <class T, class Index>
+Index bump_node_stack<T, Index>::pop() noexcept
+{
+  Index* p = top();
+  const Index i = p[0];
+  if (i) {
+    p[0] = p[i];
+    return i;
+  }
+
+  const Index b = p[1];
+  if (b == m_end)
+    return 0;
+
+  p[1] = b + m_stride;
+  return b;
+}
+
+template <class T, class Index>
+void bump_node_stack<T, Index>::push(Index idx) noexcept
+{
+  Index* p = top();
+  p[idx] = p[0];
+  p[0] = idx;
+}
+
+}
+
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "node_alloc_header.hpp"
+
+/*
+  A node_alloc_header whose buffer is an anonymous mapping (Linux)
+  provisioned for the realtime path: backed by huge pages when
+  possible, optionally bound to a NUMA node, pre-faulted so that no
+  page fault happens on the first touch of a node, and optionally
+  locked in memory.
+
+  With use_hugetlb the mapping is first tried with MAP_HUGETLB, which
+  needs pages reserved in /proc/sys/vm/nr_hugepages, and falls back to
+  regular pages with a transparent huge page hint (see huge_pages()).
+  Binding uses the mbind system call directly, there is no dependency
+  on libnuma. Pre-faulting writes one byte per page after binding, so
+  the pages come from the chosen node.
+
+  See numa_pools for one pool per NUMA node.
+*/
+
+namespace rt {
+
+class huge_pool {
+  public:
+  // Size the mapping is rounded to when huge pages are requested.
+  static constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+  enum options : unsigned {
+    use_hugetlb = 1, // Try MAP_HUGETLB first.
+    use_thp = 2, // madvise(MADV_HUGEPAGE).
+    prefault = 4,
+    lock = 8, // mlock, fails beyond RLIMIT_MEMLOCK.
+    defaults = use_hugetlb | use_thp | prefault
+  };
+  private:
+  void* m_addr;
+  std::size_t m_size; // Of the mapping.
+  bool m_huge;
+  int m_numa_node;
+  node_alloc_header m_header;
+  void bind(int numa_node);
+  void release() noexcept { ::munmap(m_addr, m_size); }
+  public:
+  // Maps at least size bytes. A negative numa_node leaves the memory
+  // policy of the process alone.
+  explicit huge_pool( std::size_t size, unsigned opts = defaults
+                    , int numa_node = -1);
+  ~huge_pool() { release(); }
+  huge_pool(const huge_pool&) = delete;
+  huge_pool& operator=(const huge_pool&) = delete;
+  node_alloc_header& header() noexcept { return m_header; }
+  // Whether the mapping was made with MAP_HUGETLB.
+  bool huge_pages() const noexcept { return m_huge; }
+  int numa_node() const noexcept { return m_numa_node; }
+  void* data() const noexcept { return m_addr; }
+  std::size_t size() const noexcept { return m_size; }
+};
+
+inline huge_pool::huge_pool(std::size_t size, unsigned opts, int numa_node)
+: m_addr(MAP_FAILED)
+, m_size(size)
+, m_huge(false)
+, m_numa_node(numa_node)
+{
+  if (size == 0)
+    throw std::runtime_error("huge_pool: Incompatible size.");
+
+  const int prot = PROT_READ | PROT_WRITE;
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (opts & (use_hugetlb | use_thp))
+    m_size = (size + huge_page_size - 1) & ~(huge_page_size - 1);
+
+#ifdef MAP_HUGETLB
+  if (opts & use_hugetlb) {
+    m_addr = ::mmap(0, m_size, prot, flags | MAP_HUGETLB, -1, 0);
+    m_huge = m_addr != MAP_FAILED;
+  }
+#endif
+  if (m_addr == MAP_FAILED)
+    m_addr = ::mmap(0, m_size, prot, flags, -1, 0);
+  if (m_addr == MAP_FAILED)
+    throw std::runtime_error("huge_pool: Cannot map the buffer.");
+
+#ifdef MADV_HUGEPAGE
+  // Only a hint, e.g. THP may be disabled.
+  if (!m_huge && (opts & use_thp))
+    ::madvise(m_addr, m_size, MADV_HUGEPAGE);
+#endif
+
+  try {
+    if (numa_node >= 0)
+      bind(numa_node);
+
+    if (opts & prefault) {
+      const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+      volatile char* p = static_cast<char*>(m_addr);
+      for (std::size_t i = 0; i < m_size; i += page)
+        p[i] = 0;
+    }
+
+    if ((opts & lock) && ::mlock(m_addr, m_size) != 0)
+      throw std::runtime_error("huge_pool: Cannot lock the buffer.");
+  } catch (...) {
+    release();
+    throw;
+  }
+
+  m_header = node_alloc_header(static_cast<char*>(m_addr), m_size);
+}
+
+inline void huge_pool::bind(int numa_node)
+{
+#ifdef SYS_mbind
+  const std::size_t bits = 8 * sizeof (unsigned long);
+  const std::size_t n = static_cast<std::size_t>(numa_node);
+  unsigned long mask[16] = {};
+  if (n >= 16 * bits)
+    throw std::runtime_error("huge_pool: Incompatible NUMA node.");
+
+  mask[n / bits] = 1UL << (n % bits);
+  const int mpol_bind = 2;
+  // The kernel reads maxnode - 1 bits.
+  const long ret = ::syscall( SYS_mbind, m_addr, m_size, mpol_bind
+                            , mask, 16 * bits + 1, 0);
+  if (ret != 0)
+    throw std::runtime_error("huge_pool: Cannot bind to the NUMA node.");
+#else
+  throw std::runtime_error("huge_pool: NUMA binding not supported.");
+#endif
+}
+
+}
+
@@ -21,6 +21,9 @@ namespace rt {
 template <std::size_t S, class Index = std::size_t>
 void link_stack(char* p, std::size_t n)
 {
+  static_assert( S % sizeof (Index) == 0
+               , "link_stack: Block size must be a multiple of the index size.");
+
   // TODO: check alignment of pointers.
 
   // Number of blocks of size S available.
@@ -38,5 +41,25 @@ void link_stack(char* p, std::size_t n)
     idx[i * r] = (i - 1) * r;
 }
 
+  /*
+
+  Lazy counterpart of link_stack for the same buffer and block size:
+  nothing is linked, the first block holds the top of an empty stack
+  followed by the index of the first block never handed out, see
+  bump_node_stack. Only the first block is touched.
+
+  */
+
+template <std::size_t S, class Index = std::size_t>
+void init_bump_stack(char* p, std::size_t)
+{
+  static_assert( S >= 2 * sizeof (Index) && S % sizeof (Index) == 0
+               , "init_bump_stack: Incompatible block size.");
+
+  auto idx = reinterpret_cast<Index*>(p);
+  idx[0] = 0;
+  idx[1] = S / sizeof (Index);
+}
+
 }
 
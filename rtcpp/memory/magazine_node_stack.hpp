@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+
+#include "atomic_node_stack.hpp"
+#include "node_alloc_header.hpp"
+
+/*
+  Avail stack with a small cache (the magazine) of free indexes in
+  front of an atomic_node_stack. Pops and pushes are served from the
+  magazine and only when it is empty (full) half of it is refilled
+  from (drained to) the shared stack, so most allocations do not touch
+  the cache line holding the top of the shared stack. Refilling and
+  draining move at most N / 2 indexes, the time spent in an
+  allocation is therefore bounded by N.
+
+  The magazine belongs to the allocator instance, not to the thread,
+  and is not synchronized: each thread must use its own allocator.
+  Copies start with an empty magazine and the free indexes it holds
+  are given back to the shared stack on destruction, so the header
+  must outlive the allocators.
+*/
+
+namespace rt {
+
+template <class T, class Index, std::size_t N>
+class basic_magazine_node_stack : private atomic_node_stack<T, Index> {
+  static_assert(N >= 2 && N % 2 == 0, "magazine_node_stack: invalid size.");
+  using shared_type = atomic_node_stack<T, Index>;
+  public:
+  static const std::size_t capacity = N;
+  using shared_type::header;
+  using shared_type::address;
+  using shared_type::index;
+  using shared_type::mark;
+  private:
+  std::array<Index, N> magazine;
+  std::size_t n;
+  public:
+  basic_magazine_node_stack() : n(0) {}
+  basic_magazine_node_stack(node_alloc_header* h) : shared_type(h), n(0) {}
+  basic_magazine_node_stack(const basic_magazine_node_stack& rhs)
+  : shared_type(rhs), n(0) {}
+  basic_magazine_node_stack& operator=(const basic_magazine_node_stack& rhs)
+  {
+    if (this != &rhs) {
+      flush();
+      header = rhs.header;
+    }
+    return *this;
+  }
+  ~basic_magazine_node_stack() { flush(); }
+  Index pop() noexcept;
+  void push(Index p) noexcept;
+  // Gives all indexes in the magazine back to the shared stack.
+  void flush() noexcept
+  {
+    shared_type::push_n(magazine.data(), n);
+    n = 0;
+  }
+  std::size_t size() const noexcept {return n;}
+  bool operator==(const basic_magazine_node_stack& rhs) const noexcept
+  {return header == rhs.header;}
+  void swap(basic_magazine_node_stack& other) noexcept
+  {
+    shared_type::swap(other);
+    std::swap(magazine, other.magazine);
+    std::swap(n, other.n);
+  }
+};
+
+template <class T, class Index, std::size_t N>
+Index basic_magazine_node_stack<T, Index, N>::pop() noexcept
+{
+  if (!n)
+    n = shared_type::pop_n(magazine.data(), N / 2);
+
+  return n ? magazine[--n] : 0;
+}
+
+template <class T, class Index, std::size_t N>
+void basic_magazine_node_stack<T, Index, N>::push(Index idx) noexcept
+{
+  if (n == N) {
+    shared_type::push_n(magazine.data() + N / 2, N / 2);
+    n = N / 2;
+  }
+  magazine[n++] = idx;
+}
+
+template <class T, class Index>
+using magazine_node_stack = basic_magazine_node_stack<T, Index, 32>;
+
+}
+
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "node_alloc_header.hpp"
+
+/*
+  A node_alloc_header whose buffer is a file mapped with mmap (POSIX).
+  The avail stack already lives in the buffer and uses indexes, so the
+  only state that has to survive a restart is the block size, which is
+  kept with a few user slots in a small superblock at the start of the
+  file.
+
+  For the nodes to be usable at another address, e.g. when the file
+  is mapped again or by other processes, their links must be relative:
+  use a node_allocator with an Index smaller than a pointer, so that
+  its void_pointer is an rt::rel_ptr. Iterators and pointers held by a
+  process are of course only valid in its own mapping, store offsets
+  in the slots instead (see offset and address).
+
+  A container that is to be kept in the file has to give up its nodes
+  before it is destroyed, see set::release.
+*/
+
+namespace rt {
+
+class mapped_pool {
+  public:
+  static constexpr std::size_t n_slots = 13;
+  static constexpr std::uint64_t magic = 0x6c6f6f7070637472; // "rtcppool"
+  private:
+  struct superblock {
+    std::uint64_t magic;
+    std::uint64_t block_size;
+    std::uint64_t buffer_size;
+    std::uint64_t slots[n_slots];
+  };
+  static_assert(sizeof (superblock) == 128, "mapped_pool: Bad superblock.");
+  int m_fd;
+  void* m_addr;
+  std::size_t m_size; // Of the mapping.
+  bool m_created;
+  node_alloc_header m_header;
+  superblock* super() const noexcept
+  { return static_cast<superblock*>(m_addr); }
+  char* data() const noexcept
+  { return static_cast<char*>(m_addr) + sizeof (superblock); }
+  public:
+  // Opens the pool in path, creating it with size bytes if the file
+  // does not exist or is empty. An existing file keeps its size.
+  mapped_pool(const char* path, std::size_t size);
+  ~mapped_pool();
+  mapped_pool(const mapped_pool&) = delete;
+  mapped_pool& operator=(const mapped_pool&) = delete;
+  // Whether the file was created, i.e. there is nothing to reopen.
+  bool created() const noexcept { return m_created; }
+  node_alloc_header& header() noexcept { return m_header; }
+  // Words kept in the file for the user, e.g. the head of a set.
+  std::uint64_t& slot(std::size_t i) noexcept { return super()->slots[i]; }
+  // Offsets from the start of the buffer are the same in all mappings.
+  std::uint64_t offset(const void* p) const noexcept
+  { return static_cast<const char*>(p) - data(); }
+  void* address(std::uint64_t off) const noexcept { return data() + off; }
+  // Writes the superblock and flushes the mapping to the file.
+  void sync();
+};
+
+inline mapped_pool::mapped_pool(const char* path, std::size_t size)
+: m_fd(::open(path, O_RDWR | O_CREAT, 0644))
+, m_addr(MAP_FAILED)
+, m_size(0)
+, m_created(false)
+{
+  if (m_fd < 0)
+    throw std::runtime_error("mapped_pool: Cannot open the file.");
+
+  struct stat st;
+  if (::fstat(m_fd, &st) != 0) {
+    ::close(m_fd);
+    throw std::runtime_error("mapped_pool: Cannot stat the file.");
+  }
+
+  m_created = st.st_size == 0;
+  m_size = m_created ? size : static_cast<std::size_t>(st.st_size);
+  if (m_size <= sizeof (superblock) || (m_created && ::ftruncate(m_fd, m_size) != 0)) {
+    ::close(m_fd);
+    throw std::runtime_error("mapped_pool: Incompatible file size.");
+  }
+
+  m_addr = ::mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (m_addr == MAP_FAILED) {
+    ::close(m_fd);
+    throw std::runtime_error("mapped_pool: Cannot map the file.");
+  }
+
+  const std::size_t n = m_size - sizeof (superblock);
+  if (m_created) {
+    super()->magic = magic;
+    super()->block_size = 0;
+    super()->buffer_size = n;
+    for (auto& o: super()->slots)
+      o = 0;
+  } else if (super()->magic != magic || super()->buffer_size != n) {
+    ::munmap(m_addr, m_size);
+    ::close(m_fd);
+    throw std::runtime_error("mapped_pool: Not a pool file.");
+  }
+
+  m_header = node_alloc_header(data(), n);
+  if (super()->block_size)
+    m_header.assume_linked(super()->block_size);
+}
+
+inline void mapped_pool::sync()
+{
+  super()->block_size = m_header.block_size;
+  if (::msync(m_addr, m_size, MS_SYNC) != 0)
+    throw std::runtime_error("mapped_pool: Cannot sync the file.");
+}
+
+inline mapped_pool::~mapped_pool()
+{
+  super()->block_size = m_header.block_size;
+  ::munmap(m_addr, m_size);
+  ::close(m_fd);
+}
+
+}
+
@@ -2,14 +2,33 @@
 
 #include <array>
 #include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+#include <rtcpp/utility/exceptions.hpp>
 
 namespace rt {
 
+class slab_chain;
+class array_arena;
+class size_class_pool;
+class node_alloc_stats;
+
 struct node_alloc_header {
   char* buffer;
   std::size_t buffer_size; // In bytes
   std::size_t n_alloc; // Number of allocators using this header.
   std::size_t block_size; // Size of blocks returned by allocate_node
+  slab_chain* slabs; // Used instead of the buffer by slab_node_stack.
+  // Used instead of the buffer by size_class_node_stack.
+  size_class_pool* classes;
+  // Optional occupancy bitmap, bit i is set when block i is in use.
+  std::uint64_t* bitmap;
+  std::size_t bitmap_size; // In words.
+  // Optional, serves the array allocations instead of std::allocator.
+  array_arena* arena;
+  // Optional, updated by the counting stack policies (see rt::counted).
+  node_alloc_stats* stats;
 
   template <class U>
   node_alloc_header(U* data, std::size_t size)
@@ -17,9 +36,15 @@ struct node_alloc_header {
   , buffer_size(size * sizeof (U))
   , n_alloc(0)
   , block_size(0)
+  , slabs(0)
+  , classes(0)
+  , bitmap(0)
+  , bitmap_size(0)
+  , arena(0)
+  , stats(0)
   {
     if (buffer_size < sizeof (char*))
-      throw std::runtime_error("node_alloc_header: Incompatible buffer size.");
+      throw_exception(std::runtime_error("node_alloc_header: Incompatible buffer size."));
   }
 
   template <class U, std::size_t I>
@@ -32,7 +57,52 @@ struct node_alloc_header {
   : node_alloc_header( reinterpret_cast<char*>(&arr.front())
                      , arr.size() * sizeof (U)) {}
 
-  node_alloc_header() : buffer(0) , buffer_size(0) , n_alloc(0) {}
+  explicit node_alloc_header(slab_chain& s)
+  : buffer(0) , buffer_size(0) , n_alloc(0), block_size(0), slabs(&s)
+  , classes(0), bitmap(0), bitmap_size(0), arena(0), stats(0) {}
+
+  explicit node_alloc_header(size_class_pool& p)
+  : buffer(0) , buffer_size(0) , n_alloc(0), block_size(0), slabs(0)
+  , classes(&p), bitmap(0), bitmap_size(0), arena(0), stats(0) {}
+
+  node_alloc_header()
+  : buffer(0) , buffer_size(0) , n_alloc(0), block_size(0), slabs(0)
+  , classes(0), bitmap(0), bitmap_size(0), arena(0), stats(0) {}
+
+  // Number of words needed by the bitmap for blocks of size S.
+  std::size_t bitmap_words(std::size_t s) const noexcept
+  {return (buffer_size / s + 63) / 64;}
+
+  // Makes the allocators keep track of used blocks in data. Must be
+  // called before the buffer is linked. The bitmap is cleared on
+  // linking.
+  void use_bitmap(std::uint64_t* data, std::size_t n)
+  {
+    if (n_alloc != 0)
+      throw_exception(std::runtime_error("node_alloc_header: Buffer already linked."));
+    bitmap = data;
+    bitmap_size = n;
+  }
+
+  void use_bitmap(std::vector<std::uint64_t>& data)
+  { use_bitmap(data.data(), data.size()); }
+
+  // Makes the allocators request arrays from a instead of
+  // std::allocator. Arrays not in the arena, e.g. allocated before
+  // the call, are still given back to std::allocator.
+  void use_arena(array_arena& a) noexcept { arena = &a; }
+
+  // Makes the allocators with a counting stack update s.
+  void use_stats(node_alloc_stats& s) noexcept { stats = &s; }
+
+  // The buffer already holds an avail stack for blocks of size s, e.g.
+  // it is a file linked in a previous run, so it must not be relinked.
+  // Counts as one allocator.
+  void assume_linked(std::size_t s) noexcept
+  {
+    block_size = s;
+    n_alloc = 1;
+  }
 };
 
 }
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include <rtcpp/utility/exceptions.hpp>
+
+#include "align.hpp"
+#include "node_alloc_header.hpp"
+
+/*
+  Usage counters of a node_alloc_header, updated by the allocators
+  whose stack policy is wrapped with rt::counted, e.g.
+
+    rt::node_alloc_stats stats;
+    header.use_stats(stats);
+    rt::node_allocator<int, Node, rt::counted<rt::atomic_node_stack>::type> a(&header);
+
+  Allocators with the plain policies do not touch the counters, so
+  there is no cost when they are disabled. The counts of each thread
+  are kept on a cache line of their own, only the number of live
+  nodes (needed for the high-water mark) is shared. Threads are given
+  a slot on their first allocation, beyond max_threads they share the
+  slots round robin. All updates are relaxed, a snapshot taken while
+  other threads allocate is only approximate.
+
+  Failed allocations are the pops that found the stack empty, or
+  threw as slab_node_stack does.
+*/
+
+namespace rt {
+
+// Plain snapshot of the counters, e.g. for the export to a monitoring
+// system. Only fields will be added, at the end.
+struct node_alloc_counters {
+  std::uint64_t live; // Nodes currently allocated.
+  std::uint64_t high_water; // Maximum of live.
+  std::uint64_t allocations;
+  std::uint64_t deallocations;
+  std::uint64_t failures;
+};
+
+class node_alloc_stats {
+  public:
+  static const std::size_t max_threads = 64;
+  private:
+  struct alignas(cache_line_size) thread_counters {
+    std::atomic<std::uint64_t> allocations;
+    std::atomic<std::uint64_t> deallocations;
+    std::atomic<std::uint64_t> failures;
+  };
+  alignas(cache_line_size) std::atomic<std::uint64_t> m_live;
+  std::atomic<std::uint64_t> m_high_water;
+  std::atomic<std::size_t> m_n_threads;
+  std::array<thread_counters, max_threads> m_threads;
+  // Index of the calling thread, the same for all stats objects.
+  static std::size_t thread_index() noexcept;
+  thread_counters& local() noexcept;
+  public:
+  node_alloc_stats() noexcept { reset(); }
+  node_alloc_stats(const node_alloc_stats&) = delete;
+  node_alloc_stats& operator=(const node_alloc_stats&) = delete;
+  void on_allocate() noexcept;
+  void on_deallocate() noexcept;
+  void on_failure() noexcept
+  { local().failures.fetch_add(1, std::memory_order_relaxed); }
+  // Not thread safe.
+  void reset() noexcept;
+  // The high-water mark starts again from the live nodes.
+  void reset_high_water() noexcept
+  {
+    m_high_water.store( m_live.load(std::memory_order_relaxed)
+                      , std::memory_order_relaxed);
+  }
+  node_alloc_counters totals() const noexcept;
+  // Counts of slot i, i < n_threads(). The live nodes of a thread are
+  // allocations - deallocations, which is not meaningful if nodes are
+  // released by other threads. high_water is not tracked per thread.
+  node_alloc_counters thread(std::size_t i) const noexcept;
+  std::size_t n_threads() const noexcept;
+};
+
+inline std::size_t node_alloc_stats::thread_index() noexcept
+{
+  static std::atomic<std::size_t> next(0);
+  thread_local const std::size_t i = next.fetch_add(1);
+  return i;
+}
+
+inline node_alloc_stats::thread_counters& node_alloc_stats::local() noexcept
+{
+  const std::size_t i = thread_index();
+  const std::size_t k = i < max_threads ? i + 1 : max_threads;
+  std::size_t n = m_n_threads.load(std::memory_order_relaxed);
+  while (n < k
+         && !m_n_threads.compare_exchange_weak(n, k, std::memory_order_relaxed));
+  return m_threads[i % max_threads];
+}
+
+inline void node_alloc_stats::on_allocate() noexcept
+{
+  local().allocations.fetch_add(1, std::memory_order_relaxed);
+  const std::uint64_t live = m_live.fetch_add(1, std::memory_order_relaxed) + 1;
+  std::uint64_t hw = m_high_water.load(std::memory_order_relaxed);
+  while (hw < live
+         && !m_high_water.compare_exchange_weak(hw, live, std::memory_order_relaxed));
+}
+
+inline void node_alloc_stats::on_deallocate() noexcept
+{
+  local().deallocations.fetch_add(1, std::memory_order_relaxed);
+  m_live.fetch_sub(1, std::memory_order_relaxed);
+}
+
+inline void node_alloc_stats::reset() noexcept
+{
+  m_live.store(0, std::memory_order_relaxed);
+  m_high_water.store(0, std::memory_order_relaxed);
+  m_n_threads.store(0, std::memory_order_relaxed);
+  for (auto& t: m_threads) {
+    t.allocations.store(0, std::memory_order_relaxed);
+    t.deallocations.store(0, std::memory_order_relaxed);
+    t.failures.store(0, std::memory_order_relaxed);
+  }
+}
+
+inline std::size_t node_alloc_stats::n_threads() const noexcept
+{ return m_n_threads.load(std::memory_order_relaxed); }
+
+inline node_alloc_counters node_alloc_stats::thread(std::size_t i) const noexcept
+{
+  const thread_counters& t = m_threads[i];
+  const std::uint64_t a = t.allocations.load(std::memory_order_relaxed);
+  const std::uint64_t d = t.deallocations.load(std::memory_order_relaxed);
+  return node_alloc_counters
+  { a - d, 0, a, d, t.failures.load(std::memory_order_relaxed) };
+}
+
+inline node_alloc_counters node_alloc_stats::totals() const noexcept
+{
+  node_alloc_counters c
+  { m_live.load(std::memory_order_relaxed)
+  , m_high_water.load(std::memory_order_relaxed), 0, 0, 0 };
+  for (const auto& t: m_threads) {
+    c.allocations += t.allocations.load(std::memory_order_relaxed);
+    c.deallocations += t.deallocations.load(std::memory_order_relaxed);
+    c.failures += t.failures.load(std::memory_order_relaxed);
+  }
+  return c;
+}
+
+// Stack policy counting the operations of Stack in the stats of the
+// header, see counted.
+template <template <class, class> class Stack, class T, class Index>
+class counting_node_stack : public Stack<T, Index> {
+  private:
+  using base_type = Stack<T, Index>;
+  static node_alloc_header* checked(node_alloc_header* h)
+  {
+    if (!h->stats)
+      throw_exception(std::runtime_error("counting_node_stack: Header has no stats."));
+    return h;
+  }
+  public:
+  counting_node_stack() {}
+  counting_node_stack(node_alloc_header* h) : base_type(checked(h)) {}
+  Index pop()
+  {
+    Index i = 0;
+    RTCPP_TRY {
+      i = base_type::pop();
+    } RTCPP_CATCH_ALL {
+      this->header->stats->on_failure();
+      RTCPP_RETHROW
+    }
+    if (i)
+      this->header->stats->on_allocate();
+    else
+      this->header->stats->on_failure();
+    return i;
+  }
+  void push(Index i) noexcept
+  {
+    base_type::push(i);
+    this->header->stats->on_deallocate();
+  }
+};
+
+// Adapts counting_node_stack to the Stack parameter of the
+// allocators: counted<node_stack>::type.
+template <template <class, class> class Stack>
+struct counted {
+  template <class T, class Index>
+  using type = counting_node_stack<Stack, T, Index>;
+};
+
+}
+
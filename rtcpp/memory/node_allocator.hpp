@@ -2,23 +2,45 @@
 
 #include <utility>
 #include <memory>
+#include <cstring>
+#include <algorithm>
 #include <exception>
 #include <type_traits>
 
+#include "rel_ptr.hpp"
+#include "array_arena.hpp"
 #include "node_stack.hpp"
+#include "block_range.hpp"
 #include "node_traits.hpp"
 #include "node_alloc_header.hpp"
 
+#include <rtcpp/utility/exceptions.hpp>
+
 /*
   This is the prototype allocator I have implemented for the proposal.
   Please, read the proposal in doc/proposal_allocator.pdf
+
+  The Stack parameter selects how the avail stack is managed, for
+  example rt::atomic_node_stack to share the header among threads.
+
+  Index is the type stored in the avail stack. When it is smaller
+  than a pointer, e.g. std::uint32_t or std::uint16_t, the containers
+  also link their nodes with an rt::rel_ptr of the same width (see
+  void_pointer), which makes the nodes smaller. The buffer must then
+  be small enough to be addressed by both.
+
+  Arrays, i.e. allocate(n) for types other than the node, come from
+  the arena of the header (see node_alloc_header::use_arena), or from
+  std::allocator when there is none.
 */
 
 namespace rt {
 
-template <typename T, typename NodeType>
+template < typename T, typename NodeType
+         , template <class, class> class Stack = node_stack
+         , typename Index = std::size_t>
 class node_allocator {
-  static_assert( ((sizeof (NodeType)) >= (sizeof (char*)))
+  static_assert( ((sizeof (NodeType)) >= (sizeof (Index)))
                , "node_allocator: incompatible node size.");
   public:
   using size_type = std::size_t;
@@ -28,23 +50,33 @@ class node_allocator {
   using const_reference = const T&;
   using reference = T&;
   using value_type = T;
-  using Index = std::size_t;
+  using index_type = Index;
+  using void_pointer = typename std::conditional<
+    (sizeof (Index) < sizeof (void*))
+    , rel_ptr<void, typename std::make_signed<Index>::type>
+    , void*>::type;
   template<class U>
-  struct rebind { using other = node_allocator<U , NodeType>; };
+  struct rebind
+  { using other = node_allocator<U , NodeType, Stack, Index>; };
   public:
   node_alloc_header* header;
-  node_stack<T, std::size_t> stack;
-  std::allocator<T> std_alloc; // Used for array allocations.
+  Stack<T, Index> stack;
+  // Used for array allocations when the header has no arena.
+  std::allocator<T> std_alloc;
   public:
   node_allocator(node_alloc_header* p) : header(p) {}
   // Constructor for the node type with a different pointer type.
   template<typename U, typename K = T>
-  node_allocator( const node_allocator<U, NodeType>& alloc
+  node_allocator( const node_allocator<U, NodeType, Stack, Index>& alloc
                 , typename std::enable_if<is_same_node_type<K, NodeType>::value, void*>::type p = 0)
   : header(alloc.header)
-  , stack(header) {}
+  , stack(header)
+  {
+    if (header->buffer_size > pointer_range<void_pointer>::max_distance)
+      throw_exception(std::runtime_error("node_allocator: Buffer too big for the pointer type."));
+  }
   template<typename U, typename K = T>
-  node_allocator( const node_allocator<U, NodeType>& alloc
+  node_allocator( const node_allocator<U, NodeType, Stack, Index>& alloc
                 , typename std::enable_if<!is_same_node_type<K, NodeType>::value, void*>::type p = 0)
   : header(alloc.header) {}
   template <typename U = T>
@@ -52,30 +84,50 @@ class node_allocator {
     is_same_node_type<U, NodeType>::value, pointer>::type
   allocate_node()
   {
-    const auto i = stack.pop(); 
+    const pointer p = try_allocate_node();
+    if (!p)
+      throw_exception(std::bad_alloc());
+    return p;
+  }
+  // Returns a null pointer when the buffer is exhausted.
+  template <typename U = T>
+  typename std::enable_if<
+    is_same_node_type<U, NodeType>::value, pointer>::type
+  try_allocate_node()
+  {
+    const auto i = stack.pop();
     if (!i)
-      throw std::bad_alloc();
+      return 0;
 
-    const auto p = reinterpret_cast<Index*>(stack.header->buffer);
-    return reinterpret_cast<pointer>(&p[i]);
+    stack.mark(i, true);
+    return reinterpret_cast<pointer>(stack.address(i));
   }
   template <typename U = T>
   typename std::enable_if<
     !is_same_node_type<U, NodeType>::value, pointer>::type
   allocate(size_type n, std::allocator<void>::const_pointer hint = 0)
-  {return std_alloc.allocate(n, hint);}
+  {
+    if (header->arena)
+      return header->arena->template allocate<T>(n);
+    return std_alloc.allocate(n, hint);
+  }
   template <typename U = T>
-  typename std::enable_if<std::is_same<U, NodeType>::value>::type
+  typename std::enable_if<is_same_node_type<U, NodeType>::value>::type
   deallocate_node(pointer p)
   {
-    const auto a = reinterpret_cast<Index*>(stack.header->buffer);
-    const auto b = reinterpret_cast<Index*>(p);
-    stack.push(b - a);
+    const auto i = stack.index(p);
+    stack.mark(i, false);
+    stack.push(i);
   }
   template <typename U = T>
-  typename std::enable_if<!std::is_same<U, NodeType>::value>::type
+  typename std::enable_if<!is_same_node_type<U, NodeType>::value>::type
   deallocate(pointer p, size_type n)
-  { std_alloc.deallocate(p, n); }
+  {
+    if (header->arena && header->arena->owns(p))
+      header->arena->deallocate(p, n);
+    else
+      std_alloc.deallocate(p, n);
+  }
   template<typename U>
   void destroy(U* p) {p->~U();}
   template< typename U, typename... Args>
@@ -86,23 +138,77 @@ class node_allocator {
     stack.swap(other.stack);
     std::swap(header, other.header);
   }
+  // All blocks in the buffer, see block_range.
+  block_range<T> blocks() const noexcept
+  {return block_range<T>(stack.header);}
+  // Makes the buffer a copy of the one of other, for containers that
+  // copy all their nodes at once and rebase their links, see set. The
+  // blocks past those of other are zeroed and become free. Only with
+  // node_stack; returns false and changes nothing if either header is
+  // used by other allocators, counts statistics, or has a bitmap when
+  // the other has none, or if the buffer is smaller.
+  template <typename U = T>
+  typename std::enable_if< is_same_node_type<U, NodeType>::value
+                        && std::is_same<Stack<U, Index>, node_stack<U, Index>>::value
+                         , bool>::type
+  copy_buffer(const node_allocator& other) noexcept;
   pointer address(reference x) const noexcept { return std::addressof(x); }
   const_pointer address(const_reference x) const noexcept
   { return std::addressof(x); }
 };
 
-template <typename T, typename K, typename U, typename V>
-bool operator==( const node_allocator<T, K>& alloc1
-               , const node_allocator<U, V>& alloc2)
+template < typename T, typename NodeType
+         , template <class, class> class Stack, typename Index>
+template <typename U>
+typename std::enable_if< is_same_node_type<U, NodeType>::value
+                      && std::is_same<Stack<U, Index>, node_stack<U, Index>>::value
+                       , bool>::type
+node_allocator<T, NodeType, Stack, Index>::copy_buffer(const node_allocator& other) noexcept
+{
+  const node_alloc_header& src = *other.header;
+  node_alloc_header& dst = *header;
+  if ( &src == &dst || src.n_alloc != 1 || dst.n_alloc != 1
+    || src.slabs || src.classes || dst.slabs || dst.classes
+    || src.stats || dst.stats || !src.bitmap != !dst.bitmap
+    || src.block_size != dst.block_size || src.buffer_size > dst.buffer_size
+    || src.bitmap_size > dst.bitmap_size)
+    return false;
+
+  std::memcpy(dst.buffer, src.buffer, src.buffer_size);
+  if (dst.bitmap) {
+    std::copy(src.bitmap, src.bitmap + src.bitmap_size, dst.bitmap);
+    std::fill(dst.bitmap + src.bitmap_size, dst.bitmap + dst.bitmap_size, 0);
+  }
+
+  const std::size_t s = dst.block_size;
+  const std::size_t r = s / sizeof (Index);
+  const std::size_t m = src.buffer_size / s;
+  const std::size_t n = dst.buffer_size / s;
+  std::memset(dst.buffer + m * s, 0, (n - m) * s);
+  auto idx = reinterpret_cast<Index*>(dst.buffer);
+  for (std::size_t b = m; b < n; ++b) {
+    idx[b * r] = idx[0];
+    idx[0] = static_cast<Index>(b * r);
+  }
+  return true;
+}
+
+template < typename T, typename K, typename U, typename V
+         , template <class, class> class S, typename I>
+bool operator==( const node_allocator<T, K, S, I>& alloc1
+               , const node_allocator<U, V, S, I>& alloc2)
 {return alloc1.stack == alloc2.stack;}
 
-template <typename T, typename K, typename U, typename V>
-bool operator!=( const node_allocator<T, K>& alloc1
-               , const node_allocator<U, V>& alloc2)
+template < typename T, typename K, typename U, typename V
+         , template <class, class> class S, typename I>
+bool operator!=( const node_allocator<T, K, S, I>& alloc1
+               , const node_allocator<U, V, S, I>& alloc2)
 {return !(alloc1 == alloc2);}
 
-template <typename T, typename K, typename U, typename V>
-void swap(rt::node_allocator<T, K>& s1, rt::node_allocator<U, V>& s2)
+template < typename T, typename K, typename U, typename V
+         , template <class, class> class S, typename I>
+void swap( rt::node_allocator<T, K, S, I>& s1
+         , rt::node_allocator<U, V, S, I>& s2)
 {
   s1.swap(s2); // Put some static assert here.
 }
@@ -8,8 +8,11 @@
 #include <type_traits>
 
 #include "node_stack.hpp"
+#include "array_arena.hpp"
 #include "node_alloc_header.hpp"
 
+#include <rtcpp/utility/exceptions.hpp>
+
 /*
   Implementation of a node allocator.  It performs constant time
   allocation on a pre-allocated buffer.
@@ -24,6 +27,9 @@
   copy construction this buffer is divided in blocks and linked
   together. Copy construction occurrs inside the container with
   the new rebound allocator type.
+
+  As in node_allocator, the Stack parameter selects the avail stack
+  implementation e.g. rt::atomic_node_stack.
 */
 
 namespace rt {
@@ -35,7 +41,8 @@ struct is_node {
 };
 
 template <typename T, std::size_t S = sizeof (T),
-          bool B = is_node<T>::value >
+          bool B = is_node<T>::value,
+          template <class, class> class Stack = node_stack>
 class node_allocator_lazy {
   public:
   node_alloc_header* header;
@@ -51,7 +58,7 @@ class node_allocator_lazy {
   template<typename U>
   struct rebind {
     using other = node_allocator_lazy<U, sizeof (U),
-      is_node<U>::value>;
+      is_node<U>::value, Stack>;
   };
   void swap(node_allocator_lazy& other) noexcept
   {
@@ -60,19 +67,31 @@ class node_allocator_lazy {
   node_allocator_lazy(node_alloc_header* p) : header(p) {}
   template<typename U>
   node_allocator_lazy(const node_allocator_lazy< U, sizeof (U)
-                           , is_node<U>::value>& alloc)
+                           , is_node<U>::value, Stack>& alloc)
   : header(alloc.header) {}
   template<typename U>
   void destroy(U* p) {p->~U();}
   template< typename U, typename... Args>
   void construct(U* p, Args&&... args)
   {::new((void *)p) U(std::forward<Args>(args)...);}
-  pointer allocate(size_type n) { return alloc.allocate(n); }
-  void deallocate(pointer p, size_type n) { alloc.deallocate(p, n); }
+  pointer allocate(size_type n)
+  {
+    if (header->arena)
+      return header->arena->template allocate<T>(n);
+    return alloc.allocate(n);
+  }
+  void deallocate(pointer p, size_type n)
+  {
+    if (header->arena && header->arena->owns(p))
+      header->arena->deallocate(p, n);
+    else
+      alloc.deallocate(p, n);
+  }
 };
 
-template <typename T , std::size_t N>
-class node_allocator_lazy<T, N, true> {
+template < typename T , std::size_t N
+         , template <class, class> class Stack>
+class node_allocator_lazy<T, N, true, Stack> {
   public:
   using value_type = T;
   using pointer = T*;
@@ -84,32 +103,41 @@ class node_allocator_lazy<T, N, true> {
   using Index = std::size_t;
   template<class U>
   struct rebind {
-    using other = node_allocator_lazy<U, sizeof (U), is_node<U>::value>;
+    using other = node_allocator_lazy<U, sizeof (U), is_node<U>::value
+                                     , Stack>;
   };
   public:
   node_alloc_header* header;
-  node_stack<T, Index> stack;
+  Stack<T, Index> stack;
   public:
   node_allocator_lazy(node_alloc_header* p) : header(p) {}
   template<typename U>
   node_allocator_lazy(const node_allocator_lazy<U, sizeof (U),
-                      is_node<U>::value>& alloc)
+                      is_node<U>::value, Stack>& alloc)
   : header(alloc.header), stack(header) {}
   pointer allocate_node()
   {
-    const auto i = stack.pop(); 
+    const pointer p = try_allocate_node();
+    if (!p)
+      throw_exception(std::bad_alloc());
+    return p;
+  }
+  // Returns a null pointer when the buffer is exhausted.
+  pointer try_allocate_node()
+  {
+    const auto i = stack.pop();
     if (!i)
-      throw std::bad_alloc();
+      return 0;
 
-    const auto p = reinterpret_cast<Index*>(stack.header->buffer);
-    return reinterpret_cast<pointer>(&p[i]);
+    stack.mark(i, true);
+    return reinterpret_cast<pointer>(stack.address(i));
   }
   pointer allocate(size_type) { return allocate_node(); }
   void deallocate_node(pointer p)
   {
-    const auto a = reinterpret_cast<Index*>(stack.header->buffer);
-    const auto b = reinterpret_cast<Index*>(p);
-    stack.push(b - a);
+    const auto i = stack.index(p);
+    stack.mark(i, false);
+    stack.push(i);
   }
   void deallocate(pointer p, size_type) { deallocate_node(p); }
   template<typename U>
@@ -129,24 +157,27 @@ class node_allocator_lazy<T, N, true> {
   constexpr std::size_t max_size() const {return 1;}
 };
 
-template <typename T>
-bool operator==( const node_allocator_lazy<T>& alloc1
-               , const node_allocator_lazy<T>& alloc2)
+template < typename T, std::size_t S, bool B
+         , template <class, class> class Stack>
+bool operator==( const node_allocator_lazy<T, S, B, Stack>& alloc1
+               , const node_allocator_lazy<T, S, B, Stack>& alloc2)
 {return alloc1.stack == alloc2.stack;}
 
-template <typename T>
-bool operator!=( const node_allocator_lazy<T>& alloc1
-               , const node_allocator_lazy<T>& alloc2)
+template < typename T, std::size_t S, bool B
+         , template <class, class> class Stack>
+bool operator!=( const node_allocator_lazy<T, S, B, Stack>& alloc1
+               , const node_allocator_lazy<T, S, B, Stack>& alloc2)
 {return !(alloc1 == alloc2);}
 
 }
 
 namespace std {
 
-template <typename T>
-struct allocator_traits<rt::node_allocator_lazy<T>> {
+template < typename T, std::size_t S, bool B
+         , template <class, class> class Stack>
+struct allocator_traits<rt::node_allocator_lazy<T, S, B, Stack>> {
   using is_always_equal = std::false_type;
-  using allocator_type = typename rt::node_allocator_lazy<T>;
+  using allocator_type = typename rt::node_allocator_lazy<T, S, B, Stack>;
   using size_type = typename allocator_type::size_type;
   using pointer = typename allocator_type::pointer;
   using value_type = typename allocator_type::value_type;
@@ -160,6 +191,8 @@ struct allocator_traits<rt::node_allocator_lazy<T>> {
   template<typename U>
   using rebind_alloc =
     typename allocator_type::template rebind<U>::other;
+  template<typename U>
+  using rebind_traits = allocator_traits<rebind_alloc<U>>;
   static allocator_type
     select_on_container_copy_construction(const allocator_type& a)
     {return a;}
@@ -167,6 +200,8 @@ struct allocator_traits<rt::node_allocator_lazy<T>> {
   {return a.allocate(n);}
   static pointer allocate_node(allocator_type& a)
   {return a.allocate_node();}
+  static pointer try_allocate_node(allocator_type& a)
+  {return a.try_allocate_node();}
   static void deallocate( allocator_type& a, pointer p
                         , size_type n) {a.deallocate(p, n);}
   static void deallocate_node( allocator_type& a
@@ -179,8 +214,10 @@ struct allocator_traits<rt::node_allocator_lazy<T>> {
   constexpr std::size_t max_size(allocator_type& a) const {return a.max_size();}
 };
 
-template <typename T>
-void swap(rt::node_allocator_lazy<T>& s1, rt::node_allocator_lazy<T>& s2)
+template < typename T, std::size_t S, bool B
+         , template <class, class> class Stack>
+void swap( rt::node_allocator_lazy<T, S, B, Stack>& s1
+         , rt::node_allocator_lazy<T, S, B, Stack>& s2)
 {
   s1.swap(s2);
 }
@@ -5,12 +5,17 @@
 #include <cstring>
 #include <exception>
 #include <array>
+#include <cstdint>
 #include <algorithm>
+#include <limits>
+#include <stdexcept>
 
 #include "link_stack.hpp"
 #include "align.hpp"
 #include "node_alloc_header.hpp"
 
+#include <rtcpp/utility/exceptions.hpp>
+
 namespace rt {
 
 template <class T, class Index>
@@ -25,33 +30,75 @@ class node_stack {
   node_stack(node_alloc_header* header);
   Index pop() noexcept;
   void push(Index p) noexcept;
+  // Conversion between the indexes in the stack and block addresses.
+  void* address(Index i) const noexcept
+  {return &reinterpret_cast<Index*>(header->buffer)[i];}
+  Index index(const void* p) const noexcept
+  {
+    return static_cast<const Index*>(p)
+         - reinterpret_cast<const Index*>(header->buffer);
+  }
+  // Updates the occupancy bitmap, if any, for the block of index i.
+  void mark(Index i, bool used) noexcept
+  {
+    if (!header->bitmap)
+      return;
+    const std::size_t k = i * sizeof (Index) / header->block_size;
+    const std::uint64_t bit = std::uint64_t(1) << (k % 64);
+    if (used)
+      header->bitmap[k / 64] |= bit;
+    else
+      header->bitmap[k / 64] &= ~bit;
+  }
   bool operator==(const node_stack& rhs) const noexcept
   {return header == rhs.header;}
   void swap(node_stack& other) noexcept
   {std::swap(header, other.header);}
 };
 
-template <class T, class Index>
-node_stack<T, Index>::node_stack(node_alloc_header* header)
-: header(header)
+// Splits the header buffer in blocks of size S and links them if it
+// has not been done yet by another allocator. Used by the stacks, Link
+// lays out the avail stack (see init_bump_stack for a lazy one). The
+// buffer is aligned on A or the pointer size, whichever is bigger, so
+// blocks of a size multiple of A are aligned on A as well.
+template < std::size_t S, class Index, std::size_t A = sizeof (char*)
+         , void (*Link)(char*, std::size_t) = &link_stack<S, Index>>
+void link_header(node_alloc_header* header)
 {
-  constexpr std::size_t S = sizeof (T);
+  const std::size_t ptr_size = sizeof (char*);
   std::size_t n = header->buffer_size;
-  align_if_needed<ptr_size>(header->buffer, n);
+  align_if_needed<(A > ptr_size ? A : ptr_size)>(header->buffer, n);
+  header->buffer_size = n;
   const std::size_t min_size = 2 * S;
   if (n < min_size)
-    throw std::runtime_error("node_stack: There is not enough space.");
+    throw_exception(std::runtime_error("node_stack: There is not enough space."));
+
+  // Indexes are in units of sizeof (Index).
+  if (n / sizeof (Index) > std::numeric_limits<Index>::max())
+    throw_exception(std::runtime_error("node_stack: Buffer too big for the index type."));
 
   if (header->n_alloc != 0) { // Links only once.
     if (header->block_size < S)
-      throw std::runtime_error("node_stack: Avail stack already linked for node with incompatible size.");
+      throw_exception(std::runtime_error("node_stack: Avail stack already linked for node with incompatible size."));
   } else { // Links only once.
-    link_stack<S, Index>(header->buffer, n);
+    if (header->bitmap) {
+      if (64 * header->bitmap_size < n / S)
+        throw_exception(std::runtime_error("node_stack: Bitmap too small."));
+      std::fill(header->bitmap, header->bitmap + header->bitmap_size, 0);
+    }
+    Link(header->buffer, n);
     header->block_size = S;
   }
   ++header->n_alloc;
 }
 
+template <class T, class Index>
+node_stack<T, Index>::node_stack(node_alloc_header* header)
+: header(header)
+{
+  link_header<sizeof (T), Index, alignof (T)>(header);
+}
+
 template <class T, class Index>
 Index node_stack<T, Index>::pop() noexcept
 {
@@ -69,5 +69,56 @@ struct allocate_node_helper
 template<typename Alloc>
 using has_allocate_node = typename allocate_node_helper<Alloc>::type;
 
+template<typename Alloc1>
+struct try_allocate_node_helper
+{
+  template<typename Alloc2,
+    typename = decltype(std::declval<Alloc2*>()->try_allocate_node())>
+  static std::true_type test(int);
+
+  template<typename>
+  static std::false_type test(...);
+
+  using type = decltype(test<Alloc1>(0));
+};
+
+template<typename Alloc>
+using has_try_allocate_node = typename try_allocate_node_helper<Alloc>::type;
+
+template<typename Alloc1>
+struct blocks_helper
+{
+  template<typename Alloc2,
+    typename = decltype(std::declval<const Alloc2*>()->blocks())>
+  static std::true_type test(int);
+
+  template<typename>
+  static std::false_type test(...);
+
+  using type = decltype(test<Alloc1>(0));
+};
+
+// Whether the allocator can expose its buffer, see block_range.
+template<typename Alloc>
+using has_blocks = typename blocks_helper<Alloc>::type;
+
+template<typename Alloc1>
+struct copy_buffer_helper
+{
+  template<typename Alloc2,
+    typename = decltype(std::declval<Alloc2*>()->copy_buffer(std::declval<const Alloc2&>()))>
+  static std::true_type test(int);
+
+  template<typename>
+  static std::false_type test(...);
+
+  using type = decltype(test<Alloc1>(0));
+};
+
+// Whether the allocator can copy the buffer of another at once, see
+// node_allocator::copy_buffer.
+template<typename Alloc>
+using has_copy_buffer = typename copy_buffer_helper<Alloc>::type;
+
 }
 
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdio>
+#include <cstddef>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "huge_pool.hpp"
+#include "node_alloc_header.hpp"
+
+/*
+  One huge_pool per NUMA node of the machine, each bound to its node,
+  so that a thread allocates its nodes from memory local to the CPU it
+  runs on: local() returns the header of the pool of the calling
+  thread. Threads should be pinned, a thread that migrates keeps
+  allocating from the pool it got first.
+
+  Threads on the same node share a header, use an allocator with
+  rt::atomic_node_stack and link each pool before the threads start,
+  e.g. by rebinding an allocator to the node type in the thread that
+  creates the pools.
+*/
+
+namespace rt {
+
+class numa_pools {
+  private:
+  std::vector<std::unique_ptr<huge_pool>> m_pools;
+  public:
+  // Maps size bytes on each node.
+  explicit numa_pools( std::size_t size
+                     , unsigned opts = huge_pool::defaults);
+  numa_pools(const numa_pools&) = delete;
+  numa_pools& operator=(const numa_pools&) = delete;
+  // Number of NUMA nodes, 1 when the system does not say.
+  static std::size_t n_nodes() noexcept;
+  // The node of the CPU the calling thread runs on.
+  static std::size_t current_node() noexcept;
+  std::size_t size() const noexcept { return m_pools.size(); }
+  huge_pool& pool(std::size_t node) noexcept { return *m_pools[node]; }
+  node_alloc_header& header(std::size_t node) noexcept
+  { return m_pools[node]->header(); }
+  node_alloc_header& local() noexcept
+  {
+    const std::size_t node = current_node();
+    return header(node < size() ? node : 0);
+  }
+};
+
+inline numa_pools::numa_pools(std::size_t size, unsigned opts)
+{
+  const std::size_t n = n_nodes();
+  m_pools.reserve(n);
+  // No binding on machines without NUMA.
+  for (std::size_t i = 0; i < n; ++i)
+    m_pools.emplace_back(
+      new huge_pool(size, opts, n == 1 ? -1 : static_cast<int>(i)));
+}
+
+inline std::size_t numa_pools::n_nodes() noexcept
+{
+  // A list of ranges as "0-3" or "0,2-3", the last node is enough.
+  std::FILE* f = std::fopen("/sys/devices/system/node/online", "r");
+  if (!f)
+    return 1;
+
+  unsigned long last = 0;
+  int c = 0;
+  unsigned long v = 0;
+  bool digits = false;
+  while ((c = std::fgetc(f)) != EOF) {
+    if ('0' <= c && c <= '9') {
+      v = 10 * v + static_cast<unsigned long>(c - '0');
+      digits = true;
+    } else if (digits) {
+      last = v;
+      v = 0;
+      digits = false;
+    }
+  }
+  if (digits)
+    last = v;
+  std::fclose(f);
+  return last + 1;
+}
+
+inline std::size_t numa_pools::current_node() noexcept
+{
+#ifdef SYS_getcpu
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (::syscall(SYS_getcpu, &cpu, &node, 0) == 0)
+    return node;
+#endif
+  return 0;
+}
+
+}
+
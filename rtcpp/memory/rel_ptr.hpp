@@ -0,0 +1,112 @@
+#pragma once
+
+#include <limits>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/*
+  A self-relative pointer: instead of an address it stores the
+  distance, in units of sizeof (Offset), from itself to the pointee.
+  With Offset = std::int16_t or std::int32_t container nodes can link
+  to each other with fewer bytes than a raw pointer, provided all the
+  nodes live close enough to each other, for example in the buffer of
+  a node_alloc_header (see max_distance). The smallest value of Offset
+  is used to represent the null pointer.
+
+  Since the offset depends on where the object lives, copies always
+  recompute it and a rel_ptr must never be moved with memcpy. It
+  converts implicitly to and from T*, so algorithms should use raw
+  pointers for local variables and keep rel_ptr only inside nodes.
+*/
+
+namespace rt {
+
+template <class T, class Offset = std::int32_t>
+class rel_ptr {
+  static_assert( std::is_signed<Offset>::value
+               , "rel_ptr: Offset must be a signed integer.");
+  public:
+  using element_type = T;
+  using offset_type = Offset;
+  using difference_type = std::ptrdiff_t;
+  template <class U>
+  using rebind = rel_ptr<U, Offset>;
+  static constexpr std::ptrdiff_t unit = sizeof (Offset);
+  static constexpr Offset null_value = std::numeric_limits<Offset>::min();
+  // Maximum distance in bytes between the pointer and the pointee.
+  static constexpr std::size_t max_distance =
+    static_cast<std::size_t>(std::numeric_limits<Offset>::max()) * unit;
+  private:
+  Offset m_off;
+  // The arithmetic is done on integers: the compiler can not tell that
+  // a rel_ptr and its pointee are in the same buffer, e.g. for a copy
+  // of a link on the stack.
+  std::uintptr_t address() const noexcept
+  { return reinterpret_cast<std::uintptr_t>(this); }
+  void set(const void* p) noexcept
+  {
+    if (!p) {
+      m_off = null_value;
+      return;
+    }
+    const std::ptrdiff_t d = static_cast<std::ptrdiff_t>(
+      reinterpret_cast<std::uintptr_t>(p) - address());
+    assert(d % unit == 0);
+    assert( d / unit > std::numeric_limits<Offset>::min()
+         && d / unit <= std::numeric_limits<Offset>::max());
+    m_off = static_cast<Offset>(d / unit);
+  }
+  public:
+  rel_ptr() noexcept : m_off(null_value) {}
+  rel_ptr(std::nullptr_t) noexcept : m_off(null_value) {}
+  rel_ptr(T* p) noexcept { set(p); }
+  rel_ptr(const rel_ptr& rhs) noexcept { set(rhs.get()); }
+  template < class U
+           , class = typename std::enable_if<
+               std::is_convertible<U*, T*>::value>::type>
+  rel_ptr(const rel_ptr<U, Offset>& rhs) noexcept
+  { set(static_cast<T*>(rhs.get())); }
+  rel_ptr& operator=(const rel_ptr& rhs) noexcept
+  {
+    set(rhs.get());
+    return *this;
+  }
+  rel_ptr& operator=(T* p) noexcept
+  {
+    set(p);
+    return *this;
+  }
+  T* get() const noexcept
+  {
+    if (m_off == null_value)
+      return nullptr;
+    const std::uintptr_t p =
+      address() + static_cast<std::uintptr_t>(std::ptrdiff_t(m_off) * unit);
+    return reinterpret_cast<T*>(p);
+  }
+  operator T*() const noexcept {return get();}
+  T* operator->() const noexcept {return get();}
+  typename std::add_lvalue_reference<T>::type operator*() const noexcept
+  {return *get();}
+  template <class U = T>
+  static rel_ptr pointer_to(U& r) noexcept {return rel_ptr(&r);}
+};
+
+// The range of addresses a pointer type can reach from where it is
+// stored.
+template <class Ptr>
+struct pointer_range {
+  static constexpr std::size_t max_distance =
+    std::numeric_limits<std::size_t>::max();
+};
+
+template <class T, class Offset>
+struct pointer_range<rel_ptr<T, Offset>> {
+  static constexpr std::size_t max_distance =
+    rel_ptr<T, Offset>::max_distance;
+};
+
+}
+
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "node_alloc_header.hpp"
+#include "atomic_node_stack.hpp"
+
+/*
+  A node pool in a POSIX shared memory segment, to be used by allocators
+  living in different processes at the same time. Allocators must be
+  node_allocator<T, Node, atomic_node_stack, Index> with the Node and
+  Index of the pool: the avail stack and its tagged top are in the
+  segment, and the CAS on a lock-free atomic works across processes as
+  well as across threads.
+
+  The process creating the segment links the buffer before publishing
+  it, the others wait for that and only attach. As with mapped_pool an
+  Index smaller than a pointer is needed so that the containers link
+  their nodes with rt::rel_ptr, the segment is mapped at a different
+  address in each process. The slots are atomic words that processes
+  can use to exchange offsets, e.g. of a list released by one of them
+  (see forward_list::release).
+*/
+
+namespace rt {
+
+template <class Node, class Index = std::uint32_t>
+class shm_pool {
+  static_assert( ATOMIC_LLONG_LOCK_FREE == 2
+               , "shm_pool: The avail stack would not be address free.");
+  public:
+  static constexpr std::size_t n_slots = 13;
+  static constexpr std::uint64_t magic = 0x6d68737070637472; // "rtcppshm"
+  private:
+  struct superblock {
+    std::atomic<std::uint64_t> ready; // magic once linked.
+    std::uint64_t block_size;
+    std::uint64_t buffer_size;
+    std::atomic<std::uint64_t> slots[n_slots];
+  };
+  static_assert(sizeof (superblock) == 128, "shm_pool: Bad superblock.");
+  int m_fd;
+  void* m_addr;
+  std::size_t m_size;
+  bool m_created;
+  node_alloc_header m_header;
+  superblock* super() const noexcept
+  { return static_cast<superblock*>(m_addr); }
+  char* data() const noexcept
+  { return static_cast<char*>(m_addr) + sizeof (superblock); }
+  void fail(const char* msg)
+  {
+    if (m_addr != MAP_FAILED)
+      ::munmap(m_addr, m_size);
+    ::close(m_fd);
+    throw std::runtime_error(msg);
+  }
+  void create(std::size_t size);
+  void attach(std::chrono::milliseconds timeout);
+  public:
+  // Creates the segment name with size bytes or, if it already exists,
+  // attaches to it, waiting at most timeout for its creator to link it.
+  shm_pool( const char* name, std::size_t size
+          , std::chrono::milliseconds timeout = std::chrono::seconds(5));
+  ~shm_pool();
+  shm_pool(const shm_pool&) = delete;
+  shm_pool& operator=(const shm_pool&) = delete;
+  bool created() const noexcept { return m_created; }
+  node_alloc_header& header() noexcept { return m_header; }
+  std::atomic<std::uint64_t>& slot(std::size_t i) noexcept
+  { return super()->slots[i]; }
+  // Offsets from the start of the buffer are the same in all processes.
+  std::uint64_t offset(const void* p) const noexcept
+  { return static_cast<const char*>(p) - data(); }
+  void* address(std::uint64_t off) const noexcept { return data() + off; }
+  // Removes the name, the segment lives until the last process unmaps it.
+  static void remove(const char* name) noexcept { ::shm_unlink(name); }
+};
+
+template <class Node, class Index>
+shm_pool<Node, Index>::shm_pool( const char* name, std::size_t size
+                               , std::chrono::milliseconds timeout)
+: m_fd(::shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600))
+, m_addr(MAP_FAILED)
+, m_size(size)
+, m_created(m_fd >= 0)
+{
+  if (m_created) {
+    // A segment that could not be set up is not left for others to
+    // attach to.
+    try {
+      create(size);
+    } catch (...) {
+      ::shm_unlink(name);
+      throw;
+    }
+    return;
+  }
+
+  if (errno != EEXIST)
+    throw std::runtime_error("shm_pool: Cannot create the segment.");
+
+  m_fd = ::shm_open(name, O_RDWR, 0600);
+  if (m_fd < 0)
+    throw std::runtime_error("shm_pool: Cannot open the segment.");
+
+  attach(timeout);
+}
+
+template <class Node, class Index>
+void shm_pool<Node, Index>::create(std::size_t size)
+{
+  if (size <= sizeof (superblock) || ::ftruncate(m_fd, size) != 0)
+    fail("shm_pool: Incompatible segment size.");
+
+  m_addr = ::mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (m_addr == MAP_FAILED)
+    fail("shm_pool: Cannot map the segment.");
+
+  // The new segment is zero filled, ready is 0 until the end.
+  const std::size_t n = size - sizeof (superblock);
+  m_header = node_alloc_header(data(), n);
+  try {
+    atomic_node_stack<Node, Index> stack(&m_header);
+  } catch (const std::exception& e) {
+    fail(e.what());
+  }
+
+  for (auto& o: super()->slots)
+    o.store(0, std::memory_order_relaxed);
+  super()->block_size = m_header.block_size;
+  super()->buffer_size = n;
+  super()->ready.store(magic, std::memory_order_release);
+}
+
+template <class Node, class Index>
+void shm_pool<Node, Index>::attach(std::chrono::milliseconds timeout)
+{
+  // The creator may not have set the size or linked the buffer yet.
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  auto wait = [&]()
+  {
+    if (std::chrono::steady_clock::now() > deadline)
+      fail("shm_pool: The segment was not initialized in time.");
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  };
+
+  struct stat st;
+  for (;;) {
+    if (::fstat(m_fd, &st) != 0)
+      fail("shm_pool: Cannot stat the segment.");
+    if (static_cast<std::size_t>(st.st_size) > sizeof (superblock))
+      break;
+    wait();
+  }
+
+  m_size = st.st_size;
+  m_addr = ::mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (m_addr == MAP_FAILED)
+    fail("shm_pool: Cannot map the segment.");
+
+  while (super()->ready.load(std::memory_order_acquire) != magic)
+    wait();
+
+  if (super()->block_size != sizeof (Node))
+    fail("shm_pool: Segment linked for another node type.");
+
+  m_header = node_alloc_header(data(), super()->buffer_size);
+  m_header.assume_linked(super()->block_size);
+}
+
+template <class Node, class Index>
+shm_pool<Node, Index>::~shm_pool()
+{
+  ::munmap(m_addr, m_size);
+  ::close(m_fd);
+}
+
+}
+
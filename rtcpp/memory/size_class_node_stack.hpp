@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <stdexcept>
+
+#include "size_class_pool.hpp"
+#include "node_alloc_header.hpp"
+
+/*
+  Avail stack for a header constructed on a size_class_pool. Each
+  stack uses the class of its node type, so allocators for nodes of
+  different sizes share the header and its memory budget. As in
+  slab_node_stack the "index" handed to the allocator is the address
+  of the block itself.
+*/
+
+namespace rt {
+
+template <class T, class Index>
+class size_class_node_stack {
+  public:
+  node_alloc_header* header;
+  // used only when default constructed.
+  node_alloc_header header_dummy;
+  std::size_t m_class;
+  public:
+  size_class_node_stack() : header(&header_dummy), m_class(0) {}
+  size_class_node_stack(node_alloc_header* header);
+  Index pop() noexcept
+  {return reinterpret_cast<std::uintptr_t>(header->classes->pop(m_class));}
+  void push(Index i) noexcept
+  {header->classes->push(m_class, reinterpret_cast<char*>(i));}
+  void* address(Index i) const noexcept
+  {return reinterpret_cast<void*>(i);}
+  Index index(const void* p) const noexcept
+  {return reinterpret_cast<std::uintptr_t>(p);}
+  // There is no bitmap to update.
+  void mark(Index, bool) noexcept {}
+  bool operator==(const size_class_node_stack& rhs) const noexcept
+  {return header == rhs.header;}
+  void swap(size_class_node_stack& other) noexcept
+  {
+    std::swap(header, other.header);
+    std::swap(m_class, other.m_class);
+  }
+};
+
+template <class T, class Index>
+size_class_node_stack<T, Index>::size_class_node_stack(node_alloc_header* h)
+: header(h)
+, m_class(size_class_pool::class_of(sizeof (T), alignof (T)))
+{
+  static_assert( sizeof (Index) >= sizeof (std::uintptr_t)
+               , "size_class_node_stack: Index cannot hold an address.");
+  if (!header->classes)
+    throw std::runtime_error("size_class_node_stack: Header has no size class pool.");
+
+  ++header->n_alloc;
+}
+
+}
+
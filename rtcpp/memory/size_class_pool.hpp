@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include "align.hpp"
+
+/*
+  Segregated-fit replacement for the single buffer of node_alloc_header.
+  The caller buffer is one memory budget shared by blocks of different
+  sizes: sizes are rounded up to a multiple of the pointer size and
+  each of the resulting classes has its own avail stack and bump
+  region, so allocators rebound to any node type can share the header.
+
+  A class that runs out of blocks carves a chunk of chunk_size bytes
+  (or a single block if bigger) from the untouched part of the
+  buffer. Released blocks go back to the stack of their class and are
+  not given to other classes. pop() is O(1) and returns a null pointer
+  when the class is empty and the buffer exhausted.
+
+  Use it through node_alloc_header(size_class_pool&) and an allocator
+  with the rt::size_class_node_stack policy. It is not thread safe.
+*/
+
+namespace rt {
+
+class size_class_pool {
+  public:
+  static const std::size_t granularity = sizeof (char*);
+  static const std::size_t max_block_size = 1024;
+  static const std::size_t n_classes = max_block_size / granularity;
+  private:
+  struct size_class {
+    char* avail;
+    char* bump;
+    char* bump_end;
+    std::size_t n_used; // Blocks handed out.
+  };
+  std::array<size_class, n_classes> m_classes;
+  char* m_top; // Beginning of the part not given to any class.
+  char* m_end;
+  std::size_t m_chunk_size;
+  bool refill(size_class& c, std::size_t s) noexcept;
+  public:
+  template <class U>
+  size_class_pool(U* data, std::size_t n, std::size_t chunk_size = 4096);
+  template <class U, std::size_t I>
+  explicit size_class_pool(std::array<U, I>& arr, std::size_t chunk_size = 4096)
+  : size_class_pool(arr.data(), arr.size(), chunk_size) {}
+  template <class U, class A>
+  explicit size_class_pool(std::vector<U, A>& arr, std::size_t chunk_size = 4096)
+  : size_class_pool(arr.data(), arr.size(), chunk_size) {}
+  size_class_pool(const size_class_pool&) = delete;
+  size_class_pool& operator=(const size_class_pool&) = delete;
+  // The class serving blocks of the given size and alignment.
+  static std::size_t class_of(std::size_t size, std::size_t align);
+  static std::size_t class_size(std::size_t c) noexcept
+  {return (c + 1) * granularity;}
+  char* pop(std::size_t c) noexcept;
+  void push(std::size_t c, char* p) noexcept;
+  // Blocks of class c currently handed out.
+  std::size_t used(std::size_t c) const noexcept
+  {return m_classes[c].n_used;}
+  // Bytes not yet given to any class.
+  std::size_t remaining() const noexcept
+  {return static_cast<std::size_t>(m_end - m_top);}
+};
+
+template <class U>
+size_class_pool::size_class_pool(U* data, std::size_t n, std::size_t chunk_size)
+: m_top(reinterpret_cast<char*>(data))
+, m_end(m_top + n * sizeof (U))
+, m_chunk_size(chunk_size)
+{
+  for (size_class& c: m_classes)
+    c = size_class {0, 0, 0, 0};
+}
+
+inline
+std::size_t size_class_pool::class_of(std::size_t size, std::size_t align)
+{
+  if (align > alignof (std::max_align_t))
+    throw std::runtime_error("size_class_pool: Node alignment not supported.");
+
+  const std::size_t a = align > granularity ? align : granularity;
+  const std::size_t s = size + (a - size % a) % a;
+  if (s == 0 || s > max_block_size)
+    throw std::runtime_error("size_class_pool: Node too big.");
+
+  return s / granularity - 1;
+}
+
+inline
+bool size_class_pool::refill(size_class& c, std::size_t s) noexcept
+{
+  // Chunks start aligned for any class.
+  char* p = m_top;
+  std::size_t r = remaining();
+  align_if_needed<alignof (std::max_align_t)>(p, r);
+  if (r > remaining() || r < s)
+    return false;
+
+  std::size_t n = (m_chunk_size < s ? s : m_chunk_size) / s * s;
+  if (n > r)
+    n = r / s * s; // The tail of the buffer.
+
+  c.bump = p;
+  c.bump_end = p + n;
+  m_top = c.bump_end;
+  return true;
+}
+
+inline
+char* size_class_pool::pop(std::size_t i) noexcept
+{
+  size_class& c = m_classes[i];
+  char* p = c.avail;
+  if (p) {
+    c.avail = *reinterpret_cast<char**>(p);
+  } else {
+    const std::size_t s = class_size(i);
+    if (c.bump == c.bump_end && !refill(c, s))
+      return 0;
+    p = c.bump;
+    c.bump += s;
+  }
+  ++c.n_used;
+  return p;
+}
+
+inline
+void size_class_pool::push(std::size_t i, char* p) noexcept
+{
+  size_class& c = m_classes[i];
+  *reinterpret_cast<char**>(p) = c.avail;
+  c.avail = p;
+  --c.n_used;
+}
+
+}
+
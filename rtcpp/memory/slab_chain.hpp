@@ -0,0 +1,202 @@
+#pragma once
+
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+
+/*
+  A growable replacement for the single buffer of node_alloc_header.
+
+  The chain owns a list of slabs obtained from an upstream resource
+  (operator new by default). Slabs grow geometrically: each new slab
+  is twice as big as the previous one. Blocks are carved out of the
+  most recent slab by bumping a pointer, so adding a slab does not
+  require a linking pass. Released blocks go to an intrusive LIFO
+  that is used before the bump region, as in link_stack although here
+  the links are addresses since blocks live in different slabs.
+
+  Allocation is O(1) amortized. A new slab is allocated only when the
+  free list, the bump region and the reserved slabs are exhausted.
+  Realtime callers can avoid upstream allocations on the hot path by
+  calling reserve() beforehand.
+
+  Use it through node_alloc_header(slab_chain&) and an allocator with
+  the rt::slab_node_stack policy.
+*/
+
+namespace rt {
+
+class slab_chain {
+  public:
+  using allocate_type = void* (*)(std::size_t);
+  using deallocate_type = void (*)(void*, std::size_t);
+  private:
+  struct slab {
+    slab* next;
+    std::size_t size; // In bytes, including this header.
+  };
+  static const std::size_t slab_header_size =
+    (sizeof (slab) + alignof (std::max_align_t) - 1)
+    & ~(alignof (std::max_align_t) - 1);
+  static void* new_allocate(std::size_t n) {return ::operator new(n);}
+  static void new_deallocate(void* p, std::size_t) {::operator delete(p);}
+  allocate_type m_allocate;
+  deallocate_type m_deallocate;
+  slab* m_used; // Slabs already being bumped, most recent first.
+  slab* m_reserved; // Slabs not touched yet.
+  char* m_avail; // Top of the stack of released blocks.
+  char* m_bump;
+  char* m_bump_end;
+  std::size_t m_next_size;
+  std::size_t m_block_size;
+  std::size_t m_n_avail; // Blocks in the free list.
+  std::size_t m_reserved_size; // Sum of the reserved slab sizes.
+  slab* new_slab(std::size_t size);
+  void next_slab();
+  public:
+  explicit slab_chain( std::size_t first_size = 4096
+                     , allocate_type a = &new_allocate
+                     , deallocate_type d = &new_deallocate);
+  slab_chain(const slab_chain&) = delete;
+  slab_chain& operator=(const slab_chain&) = delete;
+  ~slab_chain();
+  // Sets the size of the blocks, called by the stacks on linking.
+  void link(std::size_t block_size);
+  std::size_t block_size() const noexcept {return m_block_size;}
+  // Makes sure at least n bytes worth of blocks can be served without
+  // calling the upstream allocator.
+  void reserve(std::size_t n);
+  // Number of bytes that can be served without calling upstream.
+  std::size_t capacity() const noexcept;
+  char* pop();
+  void push(char* p) noexcept;
+};
+
+inline
+slab_chain::slab_chain( std::size_t first_size
+                      , allocate_type a, deallocate_type d)
+: m_allocate(a)
+, m_deallocate(d)
+, m_used(0)
+, m_reserved(0)
+, m_avail(0)
+, m_bump(0)
+, m_bump_end(0)
+, m_next_size(first_size)
+, m_block_size(0)
+, m_n_avail(0)
+, m_reserved_size(0)
+{
+  if (first_size <= slab_header_size)
+    throw std::runtime_error("slab_chain: Slab size too small.");
+}
+
+inline
+slab_chain::~slab_chain()
+{
+  slab* lists[] = {m_used, m_reserved};
+  for (slab* s: lists) {
+    while (s) {
+      slab* next = s->next;
+      m_deallocate(s, s->size);
+      s = next;
+    }
+  }
+}
+
+inline
+slab_chain::slab* slab_chain::new_slab(std::size_t size)
+{
+  if (size < m_next_size)
+    size = m_next_size;
+
+  void* p = m_allocate(size);
+  if (!p)
+    throw std::bad_alloc();
+
+  m_next_size = 2 * size;
+  slab* s = static_cast<slab*>(p);
+  s->next = 0;
+  s->size = size;
+  return s;
+}
+
+inline
+void slab_chain::next_slab()
+{
+  slab* s = m_reserved;
+  if (s) {
+    m_reserved = s->next;
+    m_reserved_size -= s->size - slab_header_size;
+  } else {
+    s = new_slab(slab_header_size + m_block_size);
+  }
+  s->next = m_used;
+  m_used = s;
+  m_bump = reinterpret_cast<char*>(s) + slab_header_size;
+  m_bump_end = reinterpret_cast<char*>(s) + s->size;
+}
+
+inline
+void slab_chain::link(std::size_t block_size)
+{
+  if (m_block_size == 0) {
+    if (block_size < sizeof (char*))
+      throw std::runtime_error("slab_chain: Incompatible block size.");
+    m_block_size = block_size;
+    return;
+  }
+  if (m_block_size < block_size)
+    throw std::runtime_error("slab_chain: Already linked for node with incompatible size.");
+}
+
+inline
+std::size_t slab_chain::capacity() const noexcept
+{
+  return m_n_avail * m_block_size + m_reserved_size
+       + static_cast<std::size_t>(m_bump_end - m_bump);
+}
+
+inline
+void slab_chain::reserve(std::size_t n)
+{
+  const std::size_t c = capacity();
+  if (c >= n)
+    return;
+
+  slab* s = new_slab(slab_header_size + n - c);
+  s->next = m_reserved;
+  m_reserved = s;
+  m_reserved_size += s->size - slab_header_size;
+}
+
+inline
+char* slab_chain::pop()
+{
+  if (m_avail) {
+    char* p = m_avail;
+    m_avail = *reinterpret_cast<char**>(p);
+    --m_n_avail;
+    return p;
+  }
+
+  while (static_cast<std::size_t>(m_bump_end - m_bump) < m_block_size)
+    next_slab(); // Slabs smaller than a block are skipped.
+
+  char* p = m_bump;
+  m_bump += m_block_size;
+  return p;
+}
+
+inline
+void slab_chain::push(char* p) noexcept
+{
+  *reinterpret_cast<char**>(p) = m_avail;
+  m_avail = p;
+  ++m_n_avail;
+}
+
+}
+
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+
+#include "slab_chain.hpp"
+#include "node_alloc_header.hpp"
+
+/*
+  Avail stack for a header constructed on a slab_chain. The blocks do
+  not live in a single buffer, therefore the "index" handed to the
+  allocator is the address of the block itself. Unlike the other
+  stacks pop() may allocate a new slab and throw std::bad_alloc.
+*/
+
+namespace rt {
+
+template <class T, class Index>
+class slab_node_stack {
+  public:
+  node_alloc_header* header;
+  // used only when default constructed.
+  node_alloc_header header_dummy;
+  public:
+  slab_node_stack() : header(&header_dummy) {}
+  slab_node_stack(node_alloc_header* header);
+  Index pop()
+  {return reinterpret_cast<std::uintptr_t>(header->slabs->pop());}
+  void push(Index i) noexcept
+  {header->slabs->push(reinterpret_cast<char*>(i));}
+  void* address(Index i) const noexcept
+  {return reinterpret_cast<void*>(i);}
+  Index index(const void* p) const noexcept
+  {return reinterpret_cast<std::uintptr_t>(p);}
+  // Slabs are not scanned, there is no bitmap to update.
+  void mark(Index, bool) noexcept {}
+  bool operator==(const slab_node_stack& rhs) const noexcept
+  {return header == rhs.header;}
+  void swap(slab_node_stack& other) noexcept
+  {std::swap(header, other.header);}
+};
+
+template <class T, class Index>
+slab_node_stack<T, Index>::slab_node_stack(node_alloc_header* h)
+: header(h)
+{
+  static_assert( sizeof (Index) >= sizeof (std::uintptr_t)
+               , "slab_node_stack: Index cannot hold an address.");
+  if (!header->slabs)
+    throw std::runtime_error("slab_node_stack: Header has no slab chain.");
+
+  header->slabs->link(sizeof (T));
+  header->block_size = header->slabs->block_size();
+  ++header->n_alloc;
+}
+
+}
+
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "rel_ptr.hpp"
+#include "node_stack.hpp"
+#include "node_allocator.hpp"
+#include "node_alloc_header.hpp"
+
+/*
+  Building blocks of the containers with a capacity fixed at compile
+  time, see static_set and static_forward_list.
+
+  static_index chooses the smallest index type of the allocator for
+  which a buffer of N nodes fits both the index and the links of the
+  nodes, NodeOf<P> being the node type with links of type P. The
+  buffer has two blocks more than N: the first one holds the top of
+  the avail stack and the other the head of the container.
+
+  static_node_storage embeds such a buffer and its header. It is
+  meant to be the first base of the container (base-from-member), so
+  that the header exists when the allocator is given to the container.
+  Copies get a buffer of their own, the elements are copied by the
+  container.
+*/
+
+namespace rt {
+
+template <template <class> class NodeOf, std::size_t N, class Index>
+struct static_index_fits {
+  using void_pointer = typename node_allocator<
+    int, NodeOf<void*>, node_stack, Index>::void_pointer;
+  static constexpr std::size_t bytes = (N + 2) * sizeof (NodeOf<void_pointer>);
+  static constexpr bool value =
+    bytes / sizeof (Index) <= std::numeric_limits<Index>::max()
+    && bytes <= pointer_range<void_pointer>::max_distance;
+};
+
+template <template <class> class NodeOf, std::size_t N>
+struct static_index {
+  using type = typename std::conditional<
+    static_index_fits<NodeOf, N, std::uint16_t>::value, std::uint16_t
+    , typename std::conditional<
+        static_index_fits<NodeOf, N, std::uint32_t>::value, std::uint32_t
+        , std::size_t>::type>::type;
+};
+
+template <class Node, std::size_t N>
+class static_node_storage {
+  static_assert(N > 0, "static_node_storage: Capacity must not be zero.");
+  protected:
+  alignas (sizeof (char*)) alignas (Node) std::array<Node, N + 2> m_buffer;
+  node_alloc_header m_header;
+  static_node_storage() : m_header(m_buffer) {}
+  static_node_storage(const static_node_storage&) : static_node_storage() {}
+  static_node_storage& operator=(const static_node_storage&) = delete;
+};
+
+}
+
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace rt {
+
+// Tells a container to take over nodes that another container of the
+// same type released, e.g. nodes left in a mapped file, instead of
+// allocating its own.
+struct adopt_nodes_t { explicit adopt_nodes_t() = default; };
+
+constexpr adopt_nodes_t adopt_nodes {};
+
+}
+
@@ -0,0 +1,531 @@
+#pragma once
+
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ostream>
+#include <utility>
+#include <iomanip>
+#include <algorithm>
+
+#include "perf_counter.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define RTCPP_HAS_TSC 1
+#else
+#define RTCPP_HAS_TSC 0
+#endif
+
+/*
+  The harness of the benchmarks in src/benchmarks. bench_runner::run
+  times warmup + reps calls of a function, the first warmup ones
+  discarded, and keeps the median, p99, mean, standard deviation, min
+  and max of the others, in nanoseconds per call. A setup function may
+  build the state of each call outside the timed region, e.g. a
+  container to fill again. print writes the results as aligned text,
+  CSV or JSON, so that the numbers of the graphs in doc/fig can be
+  produced and compared by scripts; bench_table does the same for
+  benchmarks with other columns.
+
+  Times are read from std::chrono::steady_clock, or from the time stamp
+  counter on x86, calibrated once against it, which costs a few cycles
+  instead of a call; the TSC must be invariant, as on any recent x86.
+
+  parse_bench_options takes the options below out of argv, so that
+  each benchmark parses only its own arguments:
+
+    --reps=N      Timed calls, 10 by default.
+    --warmup=N    Calls before, 1 by default.
+    --format=F    text, csv or json.
+    --clock=C     steady or tsc.
+    --counters=L  Hardware events counted around each call, e.g.
+                  l1d_misses,llc_misses,dtlb_misses, or all of them.
+
+  The mean count per call of each event that could be opened is
+  printed next to the timings, see perf_counter.hpp; the others are
+  left out, named below the text output.
+
+  do_not_optimize(v) makes the compiler assume v is read, and
+  clobber_memory() that all memory is, so that the computations being
+  timed are not removed as dead code.
+*/
+
+namespace rt {
+
+template <typename T>
+inline void do_not_optimize(const T& v) noexcept
+{
+#if defined(__GNUC__)
+  asm volatile("" : : "r,m"(v) : "memory");
+#else
+  const volatile char* p = reinterpret_cast<const volatile char*>(&v);
+  (void) *p;
+#endif
+}
+
+inline void clobber_memory() noexcept
+{
+#if defined(__GNUC__)
+  asm volatile("" : : : "memory");
+#endif
+}
+
+enum class bench_clock {steady, tsc};
+
+enum class bench_format {text, csv, json};
+
+namespace detail {
+
+inline std::uint64_t steady_ns() noexcept
+{
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline std::uint64_t tsc_ticks() noexcept
+{
+#if RTCPP_HAS_TSC
+  // The fences keep the timed instructions on their side of the read.
+  _mm_lfence();
+  const std::uint64_t t = __rdtsc();
+  _mm_lfence();
+  return t;
+#else
+  return steady_ns();
+#endif
+}
+
+// Over 20 ms of the steady clock.
+inline double calibrate_tsc() noexcept
+{
+#if RTCPP_HAS_TSC
+  const std::uint64_t n0 = steady_ns();
+  const std::uint64_t t0 = tsc_ticks();
+  std::uint64_t n1 = n0;
+  while (n1 - n0 < 20000000)
+    n1 = steady_ns();
+  const std::uint64_t t1 = tsc_ticks();
+  return double(n1 - n0) / double(t1 - t0);
+#else
+  return 1;
+#endif
+}
+
+}
+
+// Nanoseconds per tick of the TSC, 1 where there is none.
+inline double tsc_ns_per_tick() noexcept
+{
+  static const double r = detail::calibrate_tsc();
+  return r;
+}
+
+// Nanoseconds since start or the last restart.
+class stopwatch {
+  private:
+  bench_clock m_clock;
+  double m_scale;
+  std::uint64_t m_start;
+  std::uint64_t now() const noexcept
+  { return m_clock == bench_clock::tsc ? detail::tsc_ticks() : detail::steady_ns(); }
+  public:
+  explicit stopwatch(bench_clock c = bench_clock::steady) noexcept
+  : m_clock(c)
+  , m_scale(c == bench_clock::tsc ? tsc_ns_per_tick() : 1)
+  , m_start(now())
+  {}
+  void restart() noexcept { m_start = now(); }
+  double elapsed_ns() const noexcept { return double(now() - m_start) * m_scale; }
+};
+
+struct bench_stats {
+  double median = 0;
+  double p99 = 0;
+  double mean = 0;
+  double stddev = 0;
+  double min = 0;
+  double max = 0;
+};
+
+// The p quantile, 0 <= p <= 1, of sorted samples by the nearest rank.
+inline double quantile(const std::vector<double>& sorted, double p)
+{
+  if (sorted.empty())
+    return 0;
+  const double r = std::ceil(p * double(sorted.size()));
+  const std::size_t i = r < 1 ? 0 : std::size_t(r) - 1;
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+inline bench_stats compute_stats(std::vector<double> samples)
+{
+  bench_stats s;
+  if (samples.empty())
+    return s;
+  std::sort(std::begin(samples), std::end(samples));
+  const std::size_t n = samples.size();
+  s.min = samples.front();
+  s.max = samples.back();
+  s.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+  s.p99 = quantile(samples, 0.99);
+  double sum = 0;
+  for (double v : samples)
+    sum += v;
+  s.mean = sum / double(n);
+  double sq = 0;
+  for (double v : samples)
+    sq += (v - s.mean) * (v - s.mean);
+  s.stddev = n > 1 ? std::sqrt(sq / double(n - 1)) : 0;
+  return s;
+}
+
+struct bench_result {
+  std::string name;
+  std::size_t n; // The size benchmarked.
+  std::size_t reps;
+  bench_stats stats;
+  // The mean count per call of each event of the options, 0 for those
+  // that could not be counted.
+  std::vector<double> counts;
+};
+
+struct bench_options {
+  std::size_t reps = 10;
+  std::size_t warmup = 1;
+  bench_format format = bench_format::text;
+  bench_clock clock = bench_clock::steady;
+  std::vector<perf_event> counters;
+};
+
+const char* const bench_options_usage =
+  "Options:\n"
+  "--reps=N: Timed repetitions, 10 by default.\n"
+  "--warmup=N: Untimed repetitions before, 1 by default.\n"
+  "--format=F: text, csv or json.\n"
+  "--clock=C: steady or tsc.\n"
+  "--counters=L: Comma separated hardware events counted, e.g.\n"
+  "  instructions,branch_misses,l1d_misses,llc_misses,dtlb_misses, or all.\n";
+
+namespace detail {
+
+inline bool parse_size(const char* s, std::size_t& v)
+{
+  char* end = nullptr;
+  const unsigned long long r = std::strtoull(s, &end, 10);
+  if (end == s || *end != '\0' || *s == '-')
+    return false;
+  v = std::size_t(r);
+  return true;
+}
+
+// v is the value of option name in arg, if arg is one.
+inline bool match_option(const char* arg, const char* name, const char*& v)
+{
+  const std::size_t n = std::strlen(name);
+  if (std::strncmp(arg, name, n) != 0 || arg[n] != '=')
+    return false;
+  v = arg + n + 1;
+  return true;
+}
+
+// The comma separated events of s, or all of them.
+inline bool parse_perf_events(const char* s, std::vector<perf_event>& events)
+{
+  events.clear();
+  if (std::strcmp(s, "all") == 0) {
+    for (std::size_t i = 0; i < perf_event_count; ++i)
+      events.push_back(perf_event(i));
+    return true;
+  }
+  const std::string list = s;
+  std::size_t begin = 0;
+  for (;;) {
+    const std::size_t end = std::min(list.find(',', begin), list.size());
+    perf_event e;
+    if (!parse_perf_event(list.substr(begin, end - begin).c_str(), e))
+      return false;
+    events.push_back(e);
+    if (end == list.size())
+      return true;
+    begin = end + 1;
+  }
+}
+
+inline void write_csv_field(std::ostream& os, const std::string& s)
+{
+  if (s.find_first_of(",\"\n") == std::string::npos) {
+    os << s;
+    return;
+  }
+  os << '"';
+  for (char c : s) {
+    if (c == '"')
+      os << '"';
+    os << c;
+  }
+  os << '"';
+}
+
+inline void write_json_string(std::ostream& os, const std::string& s)
+{
+  os << '"';
+  for (char c : s) {
+    switch (c) {
+      case '"': os << "\\\""; break;
+      case '\\': os << "\\\\"; break;
+      case '\n': os << "\\n"; break;
+      case '\t': os << "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof buf, "\\u%04x", static_cast<unsigned>(c));
+          os << buf;
+        } else {
+          os << c;
+        }
+    }
+  }
+  os << '"';
+}
+
+}
+
+// Removes the options above from argv and argc, leaving argv[0] and
+// the other arguments in order. Returns false on an option it does
+// not know or a bad value, other arguments starting with -- included.
+inline bool parse_bench_options(int& argc, char* argv[], bench_options& opts)
+{
+  int out = 1;
+  for (int i = 1; i < argc; ++i) {
+    const char* a = argv[i];
+    const char* v = nullptr;
+    if (std::strncmp(a, "--", 2) != 0) {
+      argv[out++] = argv[i];
+    } else if (detail::match_option(a, "--reps", v)) {
+      if (!detail::parse_size(v, opts.reps) || opts.reps == 0)
+        return false;
+    } else if (detail::match_option(a, "--warmup", v)) {
+      if (!detail::parse_size(v, opts.warmup))
+        return false;
+    } else if (detail::match_option(a, "--format", v)) {
+      if (std::strcmp(v, "text") == 0)
+        opts.format = bench_format::text;
+      else if (std::strcmp(v, "csv") == 0)
+        opts.format = bench_format::csv;
+      else if (std::strcmp(v, "json") == 0)
+        opts.format = bench_format::json;
+      else
+        return false;
+    } else if (detail::match_option(a, "--clock", v)) {
+      if (std::strcmp(v, "steady") == 0)
+        opts.clock = bench_clock::steady;
+      else if (std::strcmp(v, "tsc") == 0)
+        opts.clock = bench_clock::tsc;
+      else
+        return false;
+    } else if (detail::match_option(a, "--counters", v)) {
+      if (!detail::parse_perf_events(v, opts.counters))
+        return false;
+    } else {
+      return false;
+    }
+  }
+  argv[out] = nullptr;
+  argc = out;
+  return true;
+}
+
+// Rows of text labels, e.g. the name of what was measured, followed
+// by numbers, printed in one of the formats. Each number column has its
+// count of decimals.
+class bench_table {
+  public:
+  struct column {
+    std::string name;
+    int precision;
+  };
+  private:
+  struct row {
+    std::vector<std::string> labels;
+    std::vector<double> values;
+  };
+  std::vector<std::string> m_labels;
+  std::vector<column> m_columns;
+  std::vector<row> m_rows;
+  void print_text(std::ostream& os) const;
+  public:
+  bench_table(std::vector<std::string> labels, std::vector<column> columns)
+  : m_labels(std::move(labels))
+  , m_columns(std::move(columns))
+  {}
+  void add(std::vector<std::string> labels, std::vector<double> values)
+  {
+    labels.resize(m_labels.size());
+    values.resize(m_columns.size());
+    m_rows.push_back({std::move(labels), std::move(values)});
+  }
+  std::size_t size() const noexcept {return m_rows.size();}
+  void print(std::ostream& os, bench_format f) const;
+};
+
+inline void bench_table::print_text(std::ostream& os) const
+{
+  std::vector<std::size_t> w;
+  for (std::size_t j = 0; j < m_labels.size(); ++j) {
+    w.push_back(m_labels[j].size());
+    for (const row& r : m_rows)
+      w[j] = std::max(w[j], r.labels[j].size());
+  }
+  for (std::size_t j = 0; j < m_labels.size(); ++j)
+    os << std::left << std::setw(int(w[j]) + 1) << m_labels[j];
+  os << std::right;
+  for (const column& c : m_columns)
+    os << std::setw(int(std::max<std::size_t>(c.name.size() + 2, 12))) << c.name;
+  os << '\n';
+  for (const row& r : m_rows) {
+    for (std::size_t j = 0; j < m_labels.size(); ++j)
+      os << std::left << std::setw(int(w[j]) + 1) << r.labels[j];
+    os << std::right;
+    for (std::size_t j = 0; j < m_columns.size(); ++j)
+      os << std::setw(int(std::max<std::size_t>(m_columns[j].name.size() + 2, 12)))
+         << std::setprecision(m_columns[j].precision) << r.values[j];
+    os << '\n';
+  }
+}
+
+inline void bench_table::print(std::ostream& os, bench_format f) const
+{
+  const std::ios::fmtflags flags = os.flags();
+  const std::streamsize precision = os.precision();
+  os << std::fixed;
+  switch (f) {
+    case bench_format::csv:
+      for (std::size_t j = 0; j < m_labels.size(); ++j)
+        os << (j ? "," : "") << m_labels[j];
+      for (std::size_t j = 0; j < m_columns.size(); ++j)
+        os << (j || !m_labels.empty() ? "," : "") << m_columns[j].name;
+      os << '\n';
+      for (const row& r : m_rows) {
+        for (std::size_t j = 0; j < m_labels.size(); ++j) {
+          os << (j ? "," : "");
+          detail::write_csv_field(os, r.labels[j]);
+        }
+        for (std::size_t j = 0; j < m_columns.size(); ++j)
+          os << (j || !m_labels.empty() ? "," : "")
+             << std::setprecision(m_columns[j].precision) << r.values[j];
+        os << '\n';
+      }
+      break;
+    case bench_format::json:
+      os << "[\n";
+      for (std::size_t i = 0; i < m_rows.size(); ++i) {
+        const row& r = m_rows[i];
+        os << "  {";
+        for (std::size_t j = 0; j < m_labels.size(); ++j) {
+          os << (j ? ", " : "");
+          detail::write_json_string(os, m_labels[j]);
+          os << ": ";
+          detail::write_json_string(os, r.labels[j]);
+        }
+        for (std::size_t j = 0; j < m_columns.size(); ++j) {
+          os << (j || !m_labels.empty() ? ", " : "");
+          detail::write_json_string(os, m_columns[j].name);
+          os << ": " << std::setprecision(m_columns[j].precision) << r.values[j];
+        }
+        os << "}" << (i + 1 < m_rows.size() ? ",\n" : "\n");
+      }
+      os << "]\n";
+      break;
+    case bench_format::text:
+    default:
+      print_text(os);
+  }
+  os.flags(flags);
+  os.precision(precision);
+}
+
+class bench_runner {
+  private:
+  bench_options m_opts;
+  perf_counters m_counters;
+  std::vector<bench_result> m_results;
+  public:
+  explicit bench_runner(const bench_options& opts = bench_options())
+  : m_opts(opts)
+  , m_counters(opts.counters)
+  {}
+  bench_runner(const bench_runner&) = delete;
+  bench_runner& operator=(const bench_runner&) = delete;
+  const bench_options& options() const noexcept {return m_opts;}
+  const std::vector<bench_result>& results() const noexcept {return m_results;}
+  const perf_counters& counters() const noexcept {return m_counters;}
+  // Times f(s) with s = setup() built before each call.
+  template <typename Setup, typename F>
+  const bench_result& run(const std::string& name, std::size_t n, Setup setup, F f)
+  {
+    std::vector<double> samples;
+    samples.reserve(m_opts.reps);
+    std::vector<std::uint64_t> counts(m_counters.size());
+    std::vector<double> sums(m_counters.size());
+    for (std::size_t i = 0; i < m_opts.warmup + m_opts.reps; ++i) {
+      auto s = setup();
+      clobber_memory();
+      m_counters.start();
+      const stopwatch w(m_opts.clock);
+      f(s);
+      clobber_memory();
+      const double t = w.elapsed_ns();
+      m_counters.stop(counts.data());
+      if (i >= m_opts.warmup) {
+        samples.push_back(t);
+        for (std::size_t j = 0; j < counts.size(); ++j)
+          sums[j] += double(counts[j]);
+      }
+    }
+    for (double& c : sums)
+      c /= double(m_opts.reps);
+    m_results.push_back( { name, n, m_opts.reps, compute_stats(std::move(samples))
+                         , std::move(sums) });
+    return m_results.back();
+  }
+  template <typename F>
+  const bench_result& run(const std::string& name, std::size_t n, F f)
+  { return run(name, n, [](){ return 0; }, [&](int){ f(); }); }
+  void print(std::ostream& os) const;
+};
+
+inline void bench_runner::print(std::ostream& os) const
+{
+  std::vector<bench_table::column> columns =
+  { {"n", 0}, {"reps", 0}, {"median_ns", 1}, {"p99_ns", 1}
+  , {"mean_ns", 1}, {"stddev_ns", 1}, {"min_ns", 1}, {"max_ns", 1} };
+  std::string missing;
+  for (std::size_t j = 0; j < m_counters.size(); ++j) {
+    const char* e = perf_event_name(m_counters.event(j));
+    if (m_counters.valid(j))
+      columns.push_back({e, 1});
+    else
+      missing += std::string(missing.empty() ? "" : ", ") + e;
+  }
+  bench_table t({"name"}, std::move(columns));
+  for (const bench_result& r : m_results) {
+    const bench_stats& s = r.stats;
+    std::vector<double> v = { double(r.n), double(r.reps), s.median, s.p99
+                            , s.mean, s.stddev, s.min, s.max };
+    for (std::size_t j = 0; j < m_counters.size(); ++j)
+      if (m_counters.valid(j))
+        v.push_back(r.counts[j]);
+    t.add({r.name}, std::move(v));
+  }
+  t.print(os, m_opts.format);
+  if (!missing.empty() && m_opts.format == bench_format::text)
+    os << "Counters not available: " << missing << '\n';
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdlib>
+
+/*
+  Lets the headers on the allocation path compile with -fno-exceptions.
+  Errors are then fatal: throw_exception aborts, and the cleanup of the
+  RTCPP_CATCH_ALL blocks is dropped as nothing can be thrown. Code that
+  must not abort on exhaustion uses the try_ functions, e.g.
+  set::try_insert, which report it in their result.
+*/
+
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define RTCPP_EXCEPTIONS 1
+#else
+#define RTCPP_EXCEPTIONS 0
+#endif
+
+#if RTCPP_EXCEPTIONS
+#define RTCPP_TRY try
+#define RTCPP_CATCH_ALL catch (...)
+#define RTCPP_RETHROW throw;
+#else
+#define RTCPP_TRY if (true)
+#define RTCPP_CATCH_ALL else
+#define RTCPP_RETHROW
+#endif
+
+namespace rt {
+
+template <class E>
+[[noreturn]] void throw_exception(const E& e)
+{
+#if RTCPP_EXCEPTIONS
+  throw e;
+#else
+  (void) e;
+  std::abort();
+#endif
+}
+
+}
+
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+/*
+  A histogram of latencies, or any unsigned 64 bit values, in the
+  style of HdrHistogram: values below 2^SubBits have a bucket each, and
+  every power of two above is split in 2^(SubBits - 1) buckets of equal
+  width, so that a value is known within 1 / 2^(SubBits - 1) of itself,
+  1.6% with the default 7, at any magnitude.
+
+  The buckets are a member array, about 30 KB by default, so that
+  record is a few instructions that neither allocate nor fail, and can
+  be called in the loop being measured, on a realtime thread. value_at
+  gives quantiles such as p99.99 as the highest value of the bucket
+  holding them, never below the true one; histograms of several threads
+  are summed with merge.
+*/
+
+namespace rt {
+
+namespace detail {
+
+inline unsigned histogram_log2(std::uint64_t x) noexcept
+{
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(x);
+#else
+  unsigned n = 0;
+  while (x >>= 1)
+    ++n;
+  return n;
+#endif
+}
+
+}
+
+template <unsigned SubBits = 7>
+class latency_histogram {
+  static_assert(SubBits >= 1 && SubBits < 32, "latency_histogram: Bad precision.");
+  public:
+  static constexpr std::uint64_t sub_buckets = std::uint64_t(1) << SubBits;
+  static constexpr std::uint64_t half = sub_buckets / 2;
+  static constexpr std::size_t n_buckets = sub_buckets + (64 - SubBits) * half;
+  private:
+  std::array<std::uint64_t, n_buckets> m_counts;
+  std::uint64_t m_count;
+  std::uint64_t m_min;
+  std::uint64_t m_max;
+  double m_sum;
+  public:
+  latency_histogram() noexcept { reset(); }
+  static std::size_t bucket(std::uint64_t v) noexcept
+  {
+    if (v < sub_buckets)
+      return std::size_t(v);
+    const unsigned e = detail::histogram_log2(v);
+    const unsigned shift = e - (SubBits - 1);
+    return std::size_t(sub_buckets + (e - SubBits) * half + ((v >> shift) - half));
+  }
+  // The smallest and largest values of bucket i.
+  static std::uint64_t lowest(std::size_t i) noexcept
+  {
+    if (i < sub_buckets)
+      return i;
+    const std::uint64_t k = i - sub_buckets;
+    const unsigned shift = unsigned(k / half) + 1;
+    return (half + k % half) << shift;
+  }
+  static std::uint64_t highest(std::size_t i) noexcept
+  {
+    if (i < sub_buckets)
+      return i;
+    const unsigned shift = unsigned((i - sub_buckets) / half) + 1;
+    return lowest(i) + ((std::uint64_t(1) << shift) - 1);
+  }
+  void record(std::uint64_t v) noexcept
+  {
+    ++m_counts[bucket(v)];
+    ++m_count;
+    m_min = std::min(m_min, v);
+    m_max = std::max(m_max, v);
+    m_sum += double(v);
+  }
+  void merge(const latency_histogram& other) noexcept
+  {
+    for (std::size_t i = 0; i < n_buckets; ++i)
+      m_counts[i] += other.m_counts[i];
+    m_count += other.m_count;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+    m_sum += other.m_sum;
+  }
+  void reset() noexcept
+  {
+    m_counts.fill(0);
+    m_count = 0;
+    m_min = std::numeric_limits<std::uint64_t>::max();
+    m_max = 0;
+    m_sum = 0;
+  }
+  std::uint64_t count() const noexcept {return m_count;}
+  std::uint64_t count(std::size_t bucket) const noexcept {return m_counts[bucket];}
+  // 0 when empty.
+  std::uint64_t min() const noexcept {return m_count ? m_min : 0;}
+  std::uint64_t max() const noexcept {return m_max;}
+  double mean() const noexcept {return m_count ? m_sum / double(m_count) : 0;}
+  // The value below or at which a fraction q of them are, 0 <= q <= 1,
+  // at most max().
+  std::uint64_t value_at(double q) const noexcept
+  {
+    if (m_count == 0)
+      return 0;
+    const double r = q * double(m_count);
+    std::uint64_t rank = r < 1 ? 1 : std::uint64_t(r);
+    if (double(rank) < r)
+      ++rank;
+    rank = std::min(rank, m_count);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < n_buckets; ++i) {
+      seen += m_counts[i];
+      if (seen >= rank)
+        return std::min(highest(i), m_max);
+    }
+    return m_max;
+  }
+};
+
+}
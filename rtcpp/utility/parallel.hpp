@@ -0,0 +1,71 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <exception>
+
+#include "exceptions.hpp"
+
+namespace rt {
+
+// The number of threads to use when the caller passes 0.
+inline std::size_t hardware_threads() noexcept
+{
+  const std::size_t n = std::thread::hardware_concurrency();
+  return n ? n : 1;
+}
+
+// Runs f(0), ..., f(n - 1) concurrently, f(0) on the calling thread, and
+// waits for all of them. The first exception thrown, in index order, is
+// rethrown after all have finished.
+template <class F>
+void parallel_run(std::size_t n, F f)
+{
+  if (n == 0)
+    return;
+
+  std::vector<std::exception_ptr> errors(n);
+  std::vector<std::thread> threads;
+  threads.reserve(n - 1);
+  RTCPP_TRY {
+    for (std::size_t i = 1; i < n; ++i) {
+      threads.emplace_back([&f, &errors, i]()
+      {
+        RTCPP_TRY {
+          f(i);
+        } RTCPP_CATCH_ALL {
+          errors[i] = std::current_exception();
+        }
+      });
+    }
+    f(0);
+  } RTCPP_CATCH_ALL {
+    errors[0] = std::current_exception();
+  }
+
+  for (auto& t: threads)
+    t.join();
+
+  for (auto& e: errors)
+    if (e)
+      std::rethrow_exception(e);
+}
+
+// Executor starting new threads on each run, see thread_pool for one
+// that keeps them. The parallel algorithms take any type with the same
+// members: size(), the number of threads used, and run(n, f), which
+// calls f(0), ..., f(n - 1) concurrently and returns when all are done.
+class spawn_executor {
+  private:
+  std::size_t m_size;
+  public:
+  explicit spawn_executor(std::size_t threads = 0) noexcept
+  : m_size(threads ? threads : hardware_threads()) {}
+  std::size_t size() const noexcept { return m_size; }
+  template <class F>
+  void run(std::size_t n, F f) const { parallel_run(n, f); }
+};
+
+}
+
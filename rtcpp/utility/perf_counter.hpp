@@ -0,0 +1,189 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define RTCPP_HAS_PERF_EVENT 1
+#else
+#define RTCPP_HAS_PERF_EVENT 0
+#endif
+
+/*
+  A hardware event counted for the calling thread, in user space only,
+  through the Linux perf_event_open system call. The counter is opened
+  stopped; start resets and enables it, stop disables it and returns
+  the count since start. When the kernel has more events than hardware
+  counters it shares them in time, and the count is scaled by the
+  fraction of the time it was running.
+
+  perf_counters starts and stops several of them together, e.g. the
+  ones given with --counters to the benchmarks; perf_event_name and
+  parse_perf_event convert the events from and to their names:
+
+    cycles, instructions, cache_references, cache_misses,
+    branch_misses, l1d_misses, llc_misses, dtlb_misses
+
+  The last three count the data reads that miss the L1 data cache, the
+  last level cache and the data TLB.
+
+  Opening fails without the kernel support, outside Linux, in
+  containers that filter the system call, or when
+  /proc/sys/kernel/perf_event_paranoid is above 2; valid() is then
+  false and stop returns 0, so that benchmarks print the counts only
+  where they exist.
+*/
+
+namespace rt {
+
+enum class perf_event
+{ cycles, instructions, cache_references, cache_misses, branch_misses
+, l1d_misses, llc_misses, dtlb_misses };
+
+constexpr std::size_t perf_event_count = 8;
+
+inline const char* perf_event_name(perf_event e) noexcept
+{
+  static const char* const names[] =
+  { "cycles", "instructions", "cache_references", "cache_misses"
+  , "branch_misses", "l1d_misses", "llc_misses", "dtlb_misses" };
+  return names[static_cast<int>(e)];
+}
+
+// Returns false on an unknown name.
+inline bool parse_perf_event(const char* name, perf_event& e) noexcept
+{
+  for (std::size_t i = 0; i < perf_event_count; ++i) {
+    if (std::strcmp(name, perf_event_name(perf_event(i))) == 0) {
+      e = perf_event(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+class perf_counter {
+  private:
+  int m_fd;
+  public:
+  explicit perf_counter(perf_event e) noexcept;
+  perf_counter(const perf_counter&) = delete;
+  perf_counter& operator=(const perf_counter&) = delete;
+  perf_counter(perf_counter&& other) noexcept : m_fd(other.m_fd) { other.m_fd = -1; }
+  perf_counter& operator=(perf_counter&& other) noexcept
+  {
+    std::swap(m_fd, other.m_fd);
+    return *this;
+  }
+  ~perf_counter();
+  bool valid() const noexcept {return m_fd >= 0;}
+  void start() noexcept;
+  std::uint64_t stop() noexcept;
+};
+
+#if RTCPP_HAS_PERF_EVENT
+
+namespace detail {
+
+constexpr std::uint64_t perf_cache_miss(std::uint64_t cache) noexcept
+{
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+               | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+}
+
+inline perf_counter::perf_counter(perf_event e) noexcept
+{
+  static const std::uint64_t configs[] =
+  { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS
+  , PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES
+  , PERF_COUNT_HW_BRANCH_MISSES
+  , detail::perf_cache_miss(PERF_COUNT_HW_CACHE_L1D)
+  , detail::perf_cache_miss(PERF_COUNT_HW_CACHE_LL)
+  , detail::perf_cache_miss(PERF_COUNT_HW_CACHE_DTLB) };
+  const int i = static_cast<int>(e);
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof attr);
+  attr.type = i < 5 ? PERF_TYPE_HARDWARE : PERF_TYPE_HW_CACHE;
+  attr.size = sizeof attr;
+  attr.config = configs[i];
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  m_fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+inline perf_counter::~perf_counter()
+{
+  if (m_fd >= 0)
+    ::close(m_fd);
+}
+
+inline void perf_counter::start() noexcept
+{
+  if (m_fd < 0)
+    return;
+  ::ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+  ::ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+inline std::uint64_t perf_counter::stop() noexcept
+{
+  if (m_fd < 0)
+    return 0;
+  ::ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+  // The count, the time enabled and the time running.
+  std::uint64_t v[3] = {0, 0, 0};
+  if (::read(m_fd, v, sizeof v) != sizeof v || v[2] == 0)
+    return 0;
+  if (v[2] == v[1])
+    return v[0];
+  return std::uint64_t(double(v[0]) * double(v[1]) / double(v[2]));
+}
+
+#else
+
+inline perf_counter::perf_counter(perf_event) noexcept : m_fd(-1) {}
+inline perf_counter::~perf_counter() {}
+inline void perf_counter::start() noexcept {}
+inline std::uint64_t perf_counter::stop() noexcept {return 0;}
+
+#endif
+
+class perf_counters {
+  private:
+  std::vector<perf_event> m_events;
+  std::vector<perf_counter> m_counters;
+  public:
+  explicit perf_counters(std::vector<perf_event> events = {})
+  : m_events(std::move(events))
+  {
+    m_counters.reserve(m_events.size());
+    for (perf_event e : m_events)
+      m_counters.emplace_back(e);
+  }
+  std::size_t size() const noexcept {return m_events.size();}
+  perf_event event(std::size_t i) const noexcept {return m_events[i];}
+  bool valid(std::size_t i) const noexcept {return m_counters[i].valid();}
+  void start() noexcept
+  {
+    for (perf_counter& c : m_counters)
+      c.start();
+  }
+  // Writes the count of each event to counts[i], in the order given.
+  void stop(std::uint64_t* counts) noexcept
+  {
+    for (std::size_t i = m_counters.size(); i-- > 0;)
+      counts[i] = m_counters[i].stop();
+  }
+};
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+namespace rt {
+
+// Hints the processor to bring the cache line of p in for a read. Does
+// nothing on compilers without the builtin.
+inline void prefetch(const void* p) noexcept
+{
+#if defined(__GNUC__)
+  __builtin_prefetch(p);
+#else
+  (void)p;
+#endif
+}
+
+}
+
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX__) || defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+/*
+  A row of 2, 3 or 4 float or double, the rows of the small matrices
+  of 3D math, held in SSE2 registers: one for float, two for double,
+  one AVX register for four double when compiled with AVX. Rows are
+  loaded and stored without touching the elements after them, rows of
+  three included; the lanes beyond the row are zero after a load. The
+  multiply-adds use FMA when compiled with it.
+
+  simd_row<T, N>::value tells whether there is such a row, which is
+  false for other types or sizes and when not compiled for x86 with
+  SSE2; the algorithms using it fall back to scalar loops, as they do
+  in constant expressions (see is_constant_evaluated).
+*/
+
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define RTCPP_IS_CONSTANT_EVALUATED 1
+#endif
+#endif
+#if !defined(RTCPP_IS_CONSTANT_EVALUATED) && defined(__GNUC__) \
+  && !defined(__clang__) && __GNUC__ >= 9
+#define RTCPP_IS_CONSTANT_EVALUATED 1
+#endif
+
+namespace rt {
+
+template <class T, std::size_t N, class = void>
+struct simd_row {
+  static const bool value = false;
+};
+
+namespace detail {
+
+// Whether called in a constant expression, where the intrinsics are
+// not allowed and the algorithms take their scalar code. Without
+// compiler support it is false and those using simd rows are not
+// constant expressions.
+constexpr bool is_constant_evaluated() noexcept
+{
+#if defined(RTCPP_IS_CONSTANT_EVALUATED)
+  return __builtin_is_constant_evaluated();
+#else
+  return false;
+#endif
+}
+
+// Whether simd_row<double, 4> is one register.
+#if defined(__SSE2__) && defined(__AVX__)
+const bool avx_double4 = true;
+#else
+const bool avx_double4 = false;
+#endif
+
+}
+
+#if defined(__SSE2__)
+
+namespace detail {
+
+inline __m128 load_ps(const float* p, std::integral_constant<std::size_t, 2>) noexcept
+{ return _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(p)); }
+
+inline __m128 load_ps(const float* p, std::integral_constant<std::size_t, 3>) noexcept
+{
+  const __m128 lo = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(p));
+  return _mm_movelh_ps(lo, _mm_load_ss(p + 2));
+}
+
+inline __m128 load_ps(const float* p, std::integral_constant<std::size_t, 4>) noexcept
+{ return _mm_loadu_ps(p); }
+
+inline void store_ps(float* p, __m128 v, std::integral_constant<std::size_t, 2>) noexcept
+{ _mm_storel_pi(reinterpret_cast<__m64*>(p), v); }
+
+inline void store_ps(float* p, __m128 v, std::integral_constant<std::size_t, 3>) noexcept
+{
+  _mm_storel_pi(reinterpret_cast<__m64*>(p), v);
+  _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+}
+
+inline void store_ps(float* p, __m128 v, std::integral_constant<std::size_t, 4>) noexcept
+{ _mm_storeu_ps(p, v); }
+
+}
+
+template <std::size_t N>
+struct simd_row<float, N, typename std::enable_if<N >= 2 && N <= 4>::type> {
+  static const bool value = true;
+  using type = __m128;
+  using size = std::integral_constant<std::size_t, N>;
+  static type load(const float* p) noexcept { return detail::load_ps(p, size()); }
+  static void store(float* p, type v) noexcept { detail::store_ps(p, v, size()); }
+  static type splat(float a) noexcept { return _mm_set1_ps(a); }
+  static type add(type a, type b) noexcept { return _mm_add_ps(a, b); }
+  static type sub(type a, type b) noexcept { return _mm_sub_ps(a, b); }
+  static type mul(type a, type b) noexcept { return _mm_mul_ps(a, b); }
+  // a * b + c.
+  static type madd(type a, type b, type c) noexcept
+  {
+#if defined(__FMA__)
+    return _mm_fmadd_ps(a, b, c);
+#else
+    return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+  }
+  // Sum of the lanes, those beyond the row must be zero.
+  static float hsum(type v) noexcept
+  {
+    const __m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1))));
+  }
+};
+
+template <>
+struct simd_row<double, 2> {
+  static const bool value = true;
+  using type = __m128d;
+  static type load(const double* p) noexcept { return _mm_loadu_pd(p); }
+  static void store(double* p, type v) noexcept { _mm_storeu_pd(p, v); }
+  static type splat(double a) noexcept { return _mm_set1_pd(a); }
+  static type add(type a, type b) noexcept { return _mm_add_pd(a, b); }
+  static type sub(type a, type b) noexcept { return _mm_sub_pd(a, b); }
+  static type mul(type a, type b) noexcept { return _mm_mul_pd(a, b); }
+  static type madd(type a, type b, type c) noexcept
+  {
+#if defined(__FMA__)
+    return _mm_fmadd_pd(a, b, c);
+#else
+    return _mm_add_pd(_mm_mul_pd(a, b), c);
+#endif
+  }
+  static double hsum(type v) noexcept
+  { return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v))); }
+};
+
+#if defined(__AVX__)
+
+template <>
+struct simd_row<double, 4> {
+  static const bool value = true;
+  using type = __m256d;
+  static type load(const double* p) noexcept { return _mm256_loadu_pd(p); }
+  static void store(double* p, type v) noexcept { _mm256_storeu_pd(p, v); }
+  static type splat(double a) noexcept { return _mm256_set1_pd(a); }
+  static type add(type a, type b) noexcept { return _mm256_add_pd(a, b); }
+  static type sub(type a, type b) noexcept { return _mm256_sub_pd(a, b); }
+  static type mul(type a, type b) noexcept { return _mm256_mul_pd(a, b); }
+  static type madd(type a, type b, type c) noexcept
+  {
+#if defined(__FMA__)
+    return _mm256_fmadd_pd(a, b, c);
+#else
+    return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+  }
+  static double hsum(type v) noexcept
+  {
+    return simd_row<double, 2>::hsum(
+      _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1)));
+  }
+};
+
+#endif
+
+// Three doubles, or four without AVX, in two registers.
+template <std::size_t N>
+struct simd_row<double, N, typename std::enable_if<N == 3
+  || (N == 4 && !detail::avx_double4)>::type> {
+  static const bool value = true;
+  using half = simd_row<double, 2>;
+  struct type {
+    __m128d lo;
+    __m128d hi;
+  };
+  static type load(const double* p) noexcept
+  {
+    return type { _mm_loadu_pd(p)
+                , N == 4 ? _mm_loadu_pd(p + 2) : _mm_load_sd(p + 2)};
+  }
+  static void store(double* p, type v) noexcept
+  {
+    _mm_storeu_pd(p, v.lo);
+    if (N == 4)
+      _mm_storeu_pd(p + 2, v.hi);
+    else
+      _mm_store_sd(p + 2, v.hi);
+  }
+  static type splat(double a) noexcept
+  { return type {_mm_set1_pd(a), _mm_set1_pd(a)}; }
+  static type add(type a, type b) noexcept
+  { return type {half::add(a.lo, b.lo), half::add(a.hi, b.hi)}; }
+  static type sub(type a, type b) noexcept
+  { return type {half::sub(a.lo, b.lo), half::sub(a.hi, b.hi)}; }
+  static type mul(type a, type b) noexcept
+  { return type {half::mul(a.lo, b.lo), half::mul(a.hi, b.hi)}; }
+  static type madd(type a, type b, type c) noexcept
+  { return type {half::madd(a.lo, b.lo, c.lo), half::madd(a.hi, b.hi, c.hi)}; }
+  static double hsum(type v) noexcept
+  { return half::hsum(_mm_add_pd(v.lo, v.hi)); }
+};
+
+#endif
+
+}
+
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace rt {
+
+// Tells a container that a range is sorted according to its comparison
+// object and has no equivalent elements, so that it can be built in one
+// pass.
+struct sorted_unique_t { explicit sorted_unique_t() = default; };
+
+constexpr sorted_unique_t sorted_unique {};
+
+}
+
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <condition_variable>
+
+#include "parallel.hpp"
+#include "exceptions.hpp"
+
+/*
+  Threads started once and reused by run(n, f), which calls f(0), ...,
+  f(n - 1) on the workers and the calling thread and returns when all
+  have finished, as parallel_run does but without starting threads.
+  n may be larger than size(), the calls are then shared. The first
+  exception thrown, in index order, is rethrown by run.
+
+  One run at a time, concurrent calls wait for each other. f must not
+  call run on the same pool.
+*/
+
+namespace rt {
+
+class thread_pool {
+  private:
+  std::vector<std::thread> m_threads;
+  std::mutex m_run_mutex; // Serializes the runs.
+  std::mutex m_mutex;
+  std::condition_variable m_start;
+  std::condition_variable m_done;
+  void (*m_call)(void*, std::size_t);
+  void* m_f;
+  std::size_t m_n;
+  std::atomic<std::size_t> m_next;
+  std::size_t m_busy; // Workers still in the run.
+  std::uint64_t m_generation;
+  bool m_stop;
+  std::exception_ptr m_error;
+  std::size_t m_error_index;
+  template <class F>
+  static void call(void* f, std::size_t i) { (*static_cast<F*>(f))(i); }
+  void work();
+  void drain();
+  public:
+  // Uses threads threads including the caller of run, the machine's
+  // hardware threads if 0.
+  explicit thread_pool(std::size_t threads = 0);
+  ~thread_pool();
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+  std::size_t size() const noexcept { return m_threads.size() + 1; }
+  template <class F>
+  void run(std::size_t n, F f);
+};
+
+inline thread_pool::thread_pool(std::size_t threads)
+: m_call(0), m_f(0), m_n(0), m_next(0), m_busy(0), m_generation(0)
+, m_stop(false), m_error_index(0)
+{
+  const std::size_t n = threads ? threads : hardware_threads();
+  m_threads.reserve(n - 1);
+  RTCPP_TRY {
+    for (std::size_t i = 1; i < n; ++i)
+      m_threads.emplace_back([this]() { work(); });
+  } RTCPP_CATCH_ALL {
+    // Runs with the threads that could be started.
+  }
+}
+
+inline thread_pool::~thread_pool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_start.notify_all();
+  for (auto& t: m_threads)
+    t.join();
+}
+
+inline void thread_pool::drain()
+{
+  for (;;) {
+    const std::size_t i = m_next.fetch_add(1, std::memory_order_relaxed);
+    if (i >= m_n)
+      return;
+    RTCPP_TRY {
+      m_call(m_f, i);
+    } RTCPP_CATCH_ALL {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_error || i < m_error_index) {
+        m_error = std::current_exception();
+        m_error_index = i;
+      }
+    }
+  }
+}
+
+inline void thread_pool::work()
+{
+  std::uint64_t seen = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_start.wait(lock, [&]() { return m_stop || m_generation != seen; });
+      if (m_stop)
+        return;
+      seen = m_generation;
+    }
+    drain();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--m_busy == 0)
+      m_done.notify_one();
+  }
+}
+
+template <class F>
+void thread_pool::run(std::size_t n, F f)
+{
+  std::lock_guard<std::mutex> run_lock(m_run_mutex);
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_call = &call<F>;
+    m_f = &f;
+    m_n = n;
+    m_next.store(0, std::memory_order_relaxed);
+    m_busy = m_threads.size();
+    m_error = std::exception_ptr();
+    ++m_generation;
+  }
+  m_start.notify_all();
+  drain();
+
+  std::exception_ptr e;
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [&]() { return m_busy == 0; });
+    e = m_error;
+  }
+  if (e)
+    std::rethrow_exception(e);
+}
+
+}
+
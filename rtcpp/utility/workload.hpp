@@ -0,0 +1,357 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+#include "parallel.hpp"
+#include "exceptions.hpp"
+
+/*
+  Keys and traces of operations for tests and benchmarks, unlike
+  make_rand_data reproducible: the same options give the same keys on
+  every run, platform and count of threads. The output is cut in chunks
+  of 2^16 elements, each drawn from a splitmix64 stream of its own
+  derived from the seed, so that the chunks are generated concurrently
+  on an executor, spawn_executor or thread_pool, e.g. for datasets of
+  100M keys and more.
+
+  The distributions of make_keys, of keys in [0, range) unless noted:
+
+    uniform        Independent and uniform.
+    sorted         The distinct keys i * max(1, range / n) in order.
+    reverse        The same from the largest down.
+    nearly_sorted  sorted with a fraction displaced of the keys swapped
+                   with one at most distance positions after.
+    zipfian        rank - 1 for ranks drawn with probability
+                   proportional to 1 / rank^zipf_exponent, the smallest
+                   keys the most frequent.
+    clustered      Uniform in one of clusters ranges of width
+                   cluster_width * range at random places.
+    time_series    Increasing timestamps with random gaps of mean
+                   max(1, range / n), about range at the end, displaced
+                   as in nearly_sorted to model late arrivals.
+
+  make_trace pairs keys of any of them with operations drawn with the
+  weights of a trace_mix.
+*/
+
+namespace rt {
+
+// Small, fast and the same everywhere, unlike the distributions of
+// <random> whose output depends on the standard library.
+class splitmix64 {
+  private:
+  std::uint64_t m_state;
+  public:
+  using result_type = std::uint64_t;
+  explicit splitmix64(std::uint64_t seed = 0) noexcept : m_state(seed) {}
+  static constexpr result_type min() noexcept {return 0;}
+  static constexpr result_type max() noexcept {return ~result_type(0);}
+  result_type operator()() noexcept
+  {
+    std::uint64_t z = (m_state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+  // Uniform in [0, 1).
+  double uniform() noexcept
+  { return double((*this)() >> 11) * (1.0 / 9007199254740992.0); }
+  // Uniform in [0, n), n > 0.
+  std::uint64_t below(std::uint64_t n) noexcept {return (*this)() % n;}
+};
+
+// Ranks in [1, n] with probability proportional to 1 / rank^exponent,
+// in constant time by rejection-inversion (Hormann and Derflinger).
+class zipf_distribution {
+  private:
+  std::uint64_t m_n;
+  double m_exponent;
+  double m_h_x1;
+  double m_h_n;
+  double m_s;
+  // log1p(x) / x and expm1(x) / x, exact near 0.
+  static double helper1(double x) noexcept
+  { return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x)); }
+  static double helper2(double x) noexcept
+  { return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x)); }
+  double h(double x) const noexcept {return std::exp(-m_exponent * std::log(x));}
+  double h_integral(double x) const noexcept
+  {
+    const double l = std::log(x);
+    return helper2((1 - m_exponent) * l) * l;
+  }
+  double h_integral_inverse(double x) const noexcept
+  {
+    double t = x * (1 - m_exponent);
+    if (t < -1)
+      t = -1;
+    return std::exp(helper1(t) * x);
+  }
+  public:
+  zipf_distribution(std::uint64_t n, double exponent)
+  : m_n(n)
+  , m_exponent(exponent)
+  {
+    if (n == 0)
+      throw_exception(std::runtime_error("zipf_distribution: No ranks."));
+    if (!(exponent > 0))
+      throw_exception(std::runtime_error("zipf_distribution: Exponent not positive."));
+    m_h_x1 = h_integral(1.5) - 1;
+    m_h_n = h_integral(double(n) + 0.5);
+    m_s = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+  }
+  std::uint64_t operator()(splitmix64& g) const noexcept
+  {
+    for (;;) {
+      const double u = m_h_n + g.uniform() * (m_h_x1 - m_h_n);
+      const double x = h_integral_inverse(u);
+      double k = std::floor(x + 0.5);
+      if (k < 1)
+        k = 1;
+      else if (k > double(m_n))
+        k = double(m_n);
+      if (k - x <= m_s || u >= h_integral(k + 0.5) - h(k))
+        return std::uint64_t(k);
+    }
+  }
+};
+
+enum class key_distribution
+{ uniform, sorted, reverse, nearly_sorted, zipfian, clustered, time_series };
+
+constexpr std::size_t key_distribution_count = 7;
+
+inline const char* key_distribution_name(key_distribution d) noexcept
+{
+  static const char* const names[] =
+  { "uniform", "sorted", "reverse", "nearly_sorted", "zipfian", "clustered"
+  , "time_series" };
+  return names[static_cast<int>(d)];
+}
+
+// Returns false on an unknown name.
+inline bool parse_key_distribution(const char* name, key_distribution& d) noexcept
+{
+  for (std::size_t i = 0; i < key_distribution_count; ++i) {
+    if (std::strcmp(name, key_distribution_name(key_distribution(i))) == 0) {
+      d = key_distribution(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+struct key_options {
+  key_distribution distribution = key_distribution::uniform;
+  std::uint64_t seed = 1;
+  std::uint64_t range = std::uint64_t(1) << 30;
+  double displaced = 0.01;
+  std::size_t distance = 16;
+  double zipf_exponent = 0.99;
+  std::size_t clusters = 16;
+  double cluster_width = 0.001;
+};
+
+enum class trace_op : std::uint8_t {insert, find, erase};
+
+template <class T>
+struct trace_entry {
+  trace_op op;
+  T key;
+};
+
+// Relative weights of the operations.
+struct trace_mix {
+  double insert = 0.25;
+  double find = 0.5;
+  double erase = 0.25;
+};
+
+namespace detail {
+
+constexpr std::size_t workload_chunk = std::size_t(1) << 16;
+
+// The generator of chunk c of a seed.
+inline splitmix64 chunk_stream(std::uint64_t seed, std::size_t c) noexcept
+{
+  splitmix64 a(seed);
+  splitmix64 b(c);
+  return splitmix64(a() ^ b());
+}
+
+// Calls f(c, begin, end) for the chunks of n elements, spread over the
+// threads of exec.
+template <class Exec, class F>
+void for_each_chunk(Exec& exec, std::size_t n, F f)
+{
+  const std::size_t chunks = (n + workload_chunk - 1) / workload_chunk;
+  const std::size_t t = std::max<std::size_t>(1, std::min(exec.size(), chunks));
+  exec.run(t, [&](std::size_t k)
+  {
+    for (std::size_t c = k; c < chunks; c += t)
+      f(c, c * workload_chunk, std::min(n, (c + 1) * workload_chunk));
+  });
+}
+
+// Swaps a fraction of the elements of [a + b, a + e) with one at
+// most distance after, in the chunk.
+template <class T>
+void displace( T* a, std::size_t b, std::size_t e, splitmix64& g
+             , double fraction, std::size_t distance) noexcept
+{
+  if (distance == 0 || fraction <= 0)
+    return;
+  for (std::size_t j = b; j < e; ++j) {
+    if (g.uniform() < fraction) {
+      const std::size_t k = std::min<std::size_t>(e - 1, j + 1 + g.below(distance));
+      std::swap(a[j], a[k]);
+    }
+  }
+}
+
+}
+
+template <class T, class Exec>
+std::vector<T> make_keys(Exec& exec, std::size_t n, const key_options& o)
+{
+  if (o.range == 0)
+    throw_exception(std::runtime_error("make_keys: Empty range."));
+
+  std::vector<T> keys(n);
+  T* a = keys.data();
+  const std::uint64_t range = o.range;
+  const std::uint64_t stride = std::max<std::uint64_t>(1, range / std::max<std::size_t>(n, 1));
+  switch (o.distribution) {
+    case key_distribution::uniform:
+      detail::for_each_chunk(exec, n, [&](std::size_t c, std::size_t b, std::size_t e)
+      {
+        splitmix64 g = detail::chunk_stream(o.seed, c);
+        for (std::size_t j = b; j < e; ++j)
+          a[j] = T(g.below(range));
+      });
+      break;
+    case key_distribution::sorted:
+    case key_distribution::reverse:
+    case key_distribution::nearly_sorted:
+      detail::for_each_chunk(exec, n, [&](std::size_t c, std::size_t b, std::size_t e)
+      {
+        for (std::size_t j = b; j < e; ++j) {
+          const std::size_t i = o.distribution == key_distribution::reverse ? n - 1 - j : j;
+          a[j] = T(std::uint64_t(i) * stride);
+        }
+        if (o.distribution == key_distribution::nearly_sorted) {
+          splitmix64 g = detail::chunk_stream(o.seed, c);
+          detail::displace(a, b, e, g, o.displaced, o.distance);
+        }
+      });
+      break;
+    case key_distribution::zipfian:
+    {
+      const zipf_distribution z(range, o.zipf_exponent);
+      detail::for_each_chunk(exec, n, [&](std::size_t c, std::size_t b, std::size_t e)
+      {
+        splitmix64 g = detail::chunk_stream(o.seed, c);
+        for (std::size_t j = b; j < e; ++j)
+          a[j] = T(z(g) - 1);
+      });
+      break;
+    }
+    case key_distribution::clustered:
+    {
+      std::vector<std::uint64_t> centers(std::max<std::size_t>(o.clusters, 1));
+      splitmix64 gc(~o.seed);
+      for (std::uint64_t& x : centers)
+        x = gc.below(range);
+      const std::uint64_t width =
+        std::max<std::uint64_t>(1, std::uint64_t(o.cluster_width * double(range)));
+      detail::for_each_chunk(exec, n, [&](std::size_t c, std::size_t b, std::size_t e)
+      {
+        splitmix64 g = detail::chunk_stream(o.seed, c);
+        for (std::size_t j = b; j < e; ++j) {
+          const std::uint64_t x = centers[g.below(centers.size())] + g.below(width);
+          a[j] = T(std::min(x, range - 1));
+        }
+      });
+      break;
+    }
+    case key_distribution::time_series:
+    {
+      // The gaps of each chunk summed in a first pass, then shifted by
+      // the sum of the chunks before.
+      const std::size_t chunks = (n + detail::workload_chunk - 1) / detail::workload_chunk;
+      std::vector<std::uint64_t> offsets(chunks + 1);
+      std::vector<std::uint64_t> times(n);
+      std::uint64_t* t = times.data();
+      detail::for_each_chunk(exec, n, [&](std::size_t c, std::size_t b, std::size_t e)
+      {
+        splitmix64 g = detail::chunk_stream(o.seed, c);
+        std::uint64_t sum = 0;
+        for (std::size_t j = b; j < e; ++j) {
+          sum += 1 + g.below(2 * stride - 1);
+          t[j] = sum;
+        }
+        offsets[c + 1] = sum;
+      });
+      for (std::size_t c = 1; c <= chunks; ++c)
+        offsets[c] += offsets[c - 1];
+      detail::for_each_chunk(exec, n, [&](std::size_t c, std::size_t b, std::size_t e)
+      {
+        for (std::size_t j = b; j < e; ++j)
+          a[j] = T(offsets[c] + t[j] - 1);
+        splitmix64 g = detail::chunk_stream(~o.seed, c);
+        detail::displace(a, b, e, g, o.displaced, o.distance);
+      });
+      break;
+    }
+  }
+  return keys;
+}
+
+template <class T>
+std::vector<T> make_keys(std::size_t n, const key_options& o)
+{
+  spawn_executor exec(1);
+  return make_keys<T>(exec, n, o);
+}
+
+// m operations on keys of o, in the proportions of mix.
+template <class T, class Exec>
+std::vector<trace_entry<T>>
+make_trace(Exec& exec, std::size_t m, const key_options& o, const trace_mix& mix = trace_mix())
+{
+  const double total = mix.insert + mix.find + mix.erase;
+  if (!(total > 0) || mix.insert < 0 || mix.find < 0 || mix.erase < 0)
+    throw_exception(std::runtime_error("make_trace: Bad mix."));
+
+  const std::vector<T> keys = make_keys<T>(exec, m, o);
+  std::vector<trace_entry<T>> trace(m);
+  const double insert = mix.insert / total;
+  const double find = insert + mix.find / total;
+  detail::for_each_chunk(exec, m, [&](std::size_t c, std::size_t b, std::size_t e)
+  {
+    splitmix64 g = detail::chunk_stream(o.seed ^ 0x5bd1e995u, c);
+    for (std::size_t j = b; j < e; ++j) {
+      const double u = g.uniform();
+      trace[j].op = u < insert ? trace_op::insert : u < find ? trace_op::find : trace_op::erase;
+      trace[j].key = keys[j];
+    }
+  });
+  return trace;
+}
+
+template <class T>
+std::vector<trace_entry<T>>
+make_trace(std::size_t m, const key_options& o, const trace_mix& mix = trace_mix())
+{
+  spawn_executor exec(1);
+  return make_trace<T>(exec, m, o, mix);
+}
+
+}
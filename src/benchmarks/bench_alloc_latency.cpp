@@ -0,0 +1,275 @@
+#include <set>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include <config.h>
+
+#ifdef GNU_FOUND
+#include <ext/mt_allocator.h>
+#include <ext/pool_allocator.h>
+#include <ext/bitmap_allocator.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/utility/bench.hpp>
+#include <rtcpp/utility/to_number.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+#include <rtcpp/utility/latency_histogram.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/allocator_traits.hpp>
+#include <rtcpp/memory/node_allocator_lazy.hpp>
+
+#include "heap_frag.hpp"
+
+// Latency of every allocate_node and deallocate_node call, in a
+// histogram per allocator and scenario. A round allocates n nodes and
+// frees them in random order:
+//
+// warm: Rounds one after the other, the allocator in cache.
+// cold: The caches are flushed before each call by writing a buffer
+//       twice the size of the last level cache, at most 64 MB, in
+//       rounds of 100 calls.
+
+using node_type = rt::set<int>::node_type;
+using histogram = rt::latency_histogram<>;
+
+struct latency_row {
+  std::string name;
+  std::string scenario;
+  std::string op;
+  histogram h;
+};
+
+struct config {
+  std::size_t n; // Nodes per round.
+  std::size_t cold_n;
+  rt::bench_options opts;
+  std::vector<char> evict;
+};
+
+std::size_t cache_size()
+{
+#if defined(__linux__) && defined(_SC_LEVEL3_CACHE_SIZE)
+  const long s = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (s > 0)
+    return std::size_t(s);
+#endif
+  return 32 << 20;
+}
+
+void evict_caches(std::vector<char>& buffer)
+{
+  for (std::size_t i = 0; i < buffer.size(); i += 64)
+    ++buffer[i];
+  rt::clobber_memory();
+}
+
+bool pin_to_cpu(int cpu)
+{
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof set, &set) == 0;
+#else
+  (void) cpu;
+  return false;
+#endif
+}
+
+std::uint64_t now(rt::bench_clock c)
+{
+  return c == rt::bench_clock::tsc ? rt::detail::tsc_ticks()
+                                   : rt::detail::steady_ns();
+}
+
+// One round of calls, cold or not.
+template <class Alloc>
+void run_round( Alloc& a, config& cfg, std::size_t n, bool cold, std::mt19937& gen
+              , histogram& ha, histogram& hd)
+{
+  using traits = rt::allocator_traits<Alloc>;
+  const rt::bench_clock c = cfg.opts.clock;
+  std::vector<node_type*> nodes(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (cold)
+      evict_caches(cfg.evict);
+    const std::uint64_t t0 = now(c);
+    nodes[i] = traits::allocate_node(a);
+    const std::uint64_t t1 = now(c);
+    rt::do_not_optimize(nodes[i]);
+    ha.record(t1 - t0);
+  }
+  std::shuffle(std::begin(nodes), std::end(nodes), gen);
+  for (std::size_t i = 0; i < n; ++i) {
+    if (cold)
+      evict_caches(cfg.evict);
+    const std::uint64_t t0 = now(c);
+    traits::deallocate_node(a, nodes[i]);
+    const std::uint64_t t1 = now(c);
+    hd.record(t1 - t0);
+  }
+}
+
+template <class Alloc>
+void bench( std::vector<latency_row>& rows, const std::string& name
+          , Alloc a, config& cfg)
+{
+  std::mt19937 gen(1);
+  histogram skip;
+  for (std::size_t i = 0; i < cfg.opts.warmup; ++i)
+    run_round(a, cfg, cfg.n, false, gen, skip, skip);
+
+  latency_row ra{name, "warm", "allocate", histogram()};
+  latency_row rd{name, "warm", "deallocate", histogram()};
+  for (std::size_t i = 0; i < cfg.opts.reps; ++i)
+    run_round(a, cfg, cfg.n, false, gen, ra.h, rd.h);
+  rows.push_back(ra);
+  rows.push_back(rd);
+
+  ra.h.reset();
+  rd.h.reset();
+  ra.scenario = rd.scenario = "cold";
+  for (std::size_t i = 0; i < cfg.opts.reps; ++i)
+    run_round(a, cfg, cfg.cold_n, true, gen, ra.h, rd.h);
+  rows.push_back(ra);
+  rows.push_back(rd);
+}
+
+// Threads allocating, freeing and writing memory until stop is set.
+void load(const std::atomic<bool>& stop, std::size_t seed)
+{
+  std::mt19937 gen(static_cast<unsigned>(seed));
+  std::vector<char> buffer(cache_size());
+  std::multiset<int> s;
+  while (!stop.load(std::memory_order_relaxed)) {
+    for (int i = 0; i < 1000; ++i)
+      s.insert(int(gen()));
+    s.clear();
+    for (std::size_t i = 0; i < buffer.size(); i += 64)
+      buffer[i] = char(i);
+    rt::do_not_optimize(buffer[0]);
+  }
+}
+
+void print( std::ostream& os, const std::vector<latency_row>& rows
+          , const config& cfg, std::size_t n, double scale)
+{
+  const double qs[] = {0.5, 0.9, 0.99, 0.999, 0.9999};
+  rt::bench_table t( {"name", "scenario", "op"}
+                   , { {"n", 0}, {"count", 0}, {"p50_ns", 1}, {"p90_ns", 1}
+                     , {"p99_ns", 1}, {"p99.9_ns", 1}, {"p99.99_ns", 1}
+                     , {"max_ns", 1}, {"mean_ns", 1} });
+  for (const latency_row& r : rows) {
+    std::vector<double> v = {double(n), double(r.h.count())};
+    for (double q : qs)
+      v.push_back(scale * double(r.h.value_at(q)));
+    v.push_back(scale * double(r.h.max()));
+    v.push_back(scale * r.h.mean());
+    t.add({r.name, r.scenario, r.op}, v);
+  }
+  t.print(os, cfg.opts.format);
+}
+
+int main(int argc, char* argv[])
+{
+  config cfg;
+  cfg.opts.clock = rt::bench_clock::tsc;
+  if ( !rt::parse_bench_options(argc, argv, cfg.opts)
+    || argc < 3 || argc > 5) {
+    std::cout <<
+    "\nUsage: $ ./bench_alloc_latency [options] N B C L\n"
+    "N: Nodes allocated and freed per round, --reps rounds.\n"
+    "B: Chars between, fragments the heap when not 0.\n"
+    "C: Optional. The cpu the benchmark is pinned to, none if -1.\n"
+    "L: Optional. Threads of concurrent allocations and memory\n"
+    "   traffic, 0 by default.\n"
+    << rt::bench_options_usage <<
+    "The clock is the TSC unless --clock=steady.\n\n"
+    "The program outputs the latency quantiles of allocate_node and\n"
+    "deallocate_node for each allocator, with the caches warm and cold.\n"
+    "The timer row is the cost of reading the clock, included in all.\n"
+    << std::endl;
+    return 0;
+  }
+
+  const std::size_t N = rt::to_number<std::size_t>(argv[1]);
+  const std::size_t B = rt::to_number<std::size_t>(argv[2]);
+  const int C = argc > 3 ? rt::to_number<int>(argv[3]) : -1;
+  const std::size_t L = argc > 4 ? rt::to_number<std::size_t>(argv[4]) : 0;
+
+  if (C >= 0 && !pin_to_cpu(C)) {
+    std::cout << "Could not pin to cpu " << C << std::endl;
+    return 1;
+  }
+
+  cfg.n = N;
+  cfg.cold_n = std::min<std::size_t>(N, 100);
+  cfg.evict.resize(std::min<std::size_t>(2 * cache_size(), 64 << 20));
+
+  std::vector<char*> pointers;
+  if (B != 0) {
+    const std::vector<int> data =
+      rt::make_rand_data<int>(N, 1, std::numeric_limits<int>::max());
+    pointers = rt::heap_frag<std::set<int>>(B, data); // Fragments the heap.
+  }
+
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < L; ++i)
+    threads.emplace_back(load, std::cref(stop), i);
+
+  std::vector<latency_row> rows;
+  {
+    latency_row r{"timer", "warm", "none", histogram()};
+    for (std::size_t i = 0; i < cfg.opts.reps * N; ++i) {
+      const std::uint64_t t0 = now(cfg.opts.clock);
+      const std::uint64_t t1 = now(cfg.opts.clock);
+      r.h.record(t1 - t0);
+    }
+    rows.push_back(r);
+  }
+
+  bench(rows, "std::allocator", std::allocator<node_type>(), cfg);
+  {
+    std::vector<node_type> buffer(N + 2);
+    rt::node_alloc_header header(buffer);
+    using alloc_type = rt::node_allocator<int, node_type>;
+    using node_alloc_type = alloc_type::rebind<node_type>::other;
+    bench(rows, "rt::node_allocator", node_alloc_type(alloc_type(&header)), cfg);
+  }
+  {
+    std::vector<node_type> buffer(N + 2);
+    rt::node_alloc_header header(buffer);
+    using alloc_type = rt::node_allocator_lazy<int>;
+    using node_alloc_type = alloc_type::rebind<node_type>::other;
+    bench(rows, "rt::node_allocator_lazy", node_alloc_type(alloc_type(&header)), cfg);
+  }
+#ifdef GNU_FOUND
+  bench(rows, "__gnu_cxx::__pool_alloc", __gnu_cxx::__pool_alloc<node_type>(), cfg);
+  bench(rows, "__gnu_cxx::bitmap_allocator", __gnu_cxx::bitmap_allocator<node_type>(), cfg);
+  bench(rows, "__gnu_cxx::__mt_alloc", __gnu_cxx::__mt_alloc<node_type>(), cfg);
+#endif
+
+  stop = true;
+  for (auto& t : threads)
+    t.join();
+
+  const double scale = cfg.opts.clock == rt::bench_clock::tsc ? rt::tsc_ns_per_tick() : 1;
+  print(std::cout, rows, cfg, N, scale);
+  std::for_each( std::begin(pointers), std::end(pointers)
+               , [](char* p){ delete p;});
+  return 0;
+}
@@ -0,0 +1,379 @@
+#include <new>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/container/list.hpp>
+#include <rtcpp/container/mpmc_queue.hpp>
+#include <rtcpp/utility/bench.hpp>
+#include <rtcpp/utility/workload.hpp>
+#include <rtcpp/utility/to_number.hpp>
+#include <rtcpp/utility/perf_counter.hpp>
+#include <rtcpp/memory/node_stack.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/atomic_node_stack.hpp>
+#include <rtcpp/memory/magazine_node_stack.hpp>
+
+// Every thread runs its trace of operations on its own container,
+// except for the queue which they all share. The containers take their
+// nodes from std::allocator, from a node_alloc_header per thread, or
+// from one header shared through an atomic_node_stack or a
+// magazine_node_stack. The threads start together; a repetition lasts
+// from the first start to the last end.
+
+using op = rt::trace_entry<int>;
+
+// Half finds, a quarter each of inserts and erases, of keys in [0, 2n).
+std::vector<op> make_trace(std::size_t m, std::size_t n, unsigned seed)
+{
+  rt::key_options o;
+  o.range = 2 * n;
+  o.seed = seed;
+  return rt::make_trace<int>(m, o);
+}
+
+struct counts {
+  std::uint64_t cache_misses = 0;
+  std::uint64_t cache_references = 0;
+};
+
+// Runs work(i) on threads i = 0, ..., t - 1, returns the seconds from
+// the first start to the last end.
+template <class Work>
+double run_threads(std::size_t t, Work& work, counts& c)
+{
+  std::atomic<std::size_t> ready(0);
+  std::atomic<bool> go(false);
+  std::vector<std::uint64_t> begin(t), end(t);
+  std::vector<counts> per_thread(t);
+  auto f = [&](std::size_t i)
+  {
+    rt::perf_counter misses(rt::perf_event::cache_misses);
+    rt::perf_counter refs(rt::perf_event::cache_references);
+    ++ready;
+    while (!go.load(std::memory_order_acquire))
+      std::this_thread::yield();
+    refs.start();
+    misses.start();
+    begin[i] = rt::detail::steady_ns();
+    work.run(i);
+    end[i] = rt::detail::steady_ns();
+    per_thread[i].cache_misses = misses.stop();
+    per_thread[i].cache_references = refs.stop();
+  };
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < t; ++i)
+    threads.emplace_back(f, i);
+  while (ready.load() != t)
+    std::this_thread::yield();
+  go.store(true, std::memory_order_release);
+  for (auto& th : threads)
+    th.join();
+  for (const counts& p : per_thread) {
+    c.cache_misses += p.cache_misses;
+    c.cache_references += p.cache_references;
+  }
+  const std::uint64_t b = *std::min_element(std::begin(begin), std::end(begin));
+  const std::uint64_t e = *std::max_element(std::begin(end), std::end(end));
+  return double(e - b) * 1e-9;
+}
+
+// How the containers get their nodes.
+enum class pool {std_alloc, per_thread, shared};
+
+template <class Container>
+struct work_base {
+  using container_type = Container;
+  std::vector<std::unique_ptr<std::vector<typename Container::node_type>>> buffers;
+  std::vector<std::unique_ptr<rt::node_alloc_header>> headers;
+  std::vector<std::unique_ptr<Container>> containers;
+  std::vector<std::vector<op>> traces;
+};
+
+template <class Alloc, class Work>
+typename std::enable_if<std::is_void<Alloc>::value>::type
+make_containers(Work& w, std::size_t t, std::size_t, pool)
+{
+  for (std::size_t i = 0; i < t; ++i)
+    w.containers.emplace_back(new typename Work::container_type);
+}
+
+// Builds t containers of at most nodes nodes, sharing a header or not,
+// all before the threads start as atomic_node_stack requires. A shared
+// header has room for the nodes cached in magazines.
+template <class Alloc, class Work>
+typename std::enable_if<!std::is_void<Alloc>::value>::type
+make_containers(Work& w, std::size_t t, std::size_t nodes, pool p)
+{
+  using node_type = typename Work::container_type::node_type;
+  for (std::size_t i = 0; i < t; ++i) {
+    if (i == 0 || p == pool::per_thread) {
+      const std::size_t n = p == pool::shared ? t * (nodes + 32) : nodes;
+      w.buffers.emplace_back(new std::vector<node_type>(n + 2));
+      w.headers.emplace_back(new rt::node_alloc_header(*w.buffers.back()));
+    }
+    w.containers.emplace_back(
+      new typename Work::container_type(Alloc(w.headers.back().get())));
+  }
+}
+
+template <class Container>
+struct set_work : work_base<Container> {
+  using work_base<Container>::containers;
+  using work_base<Container>::traces;
+  // The even keys, shuffled as in order they would make the trees
+  // without balancing lists.
+  void fill(std::size_t n, std::size_t m)
+  {
+    std::vector<int> keys(n);
+    for (std::size_t k = 0; k < n; ++k)
+      keys[k] = int(2 * k);
+    for (std::size_t i = 0; i < containers.size(); ++i) {
+      rt::splitmix64 g(i + 1);
+      std::shuffle(std::begin(keys), std::end(keys), g);
+      for (int k : keys)
+        containers[i]->insert(k);
+      traces.push_back(make_trace(m, n, unsigned(i + 1)));
+    }
+  }
+  void run(std::size_t i)
+  {
+    Container& s = *containers[i];
+    std::size_t hits = 0;
+    for (const op& o : traces[i]) {
+      switch (o.op) {
+        case rt::trace_op::find: hits += s.find(o.key) != std::end(s); break;
+        case rt::trace_op::insert: s.insert(o.key); break;
+        case rt::trace_op::erase: s.erase(o.key); break;
+      }
+    }
+    rt::do_not_optimize(hits);
+  }
+};
+
+// Pushes on inserts and pops on erases, finds look at the front.
+template <class Container>
+struct list_work : work_base<Container> {
+  using work_base<Container>::containers;
+  using work_base<Container>::traces;
+  void fill(std::size_t n, std::size_t m)
+  {
+    for (std::size_t i = 0; i < containers.size(); ++i) {
+      for (std::size_t k = 0; k < n; ++k)
+        containers[i]->push_front(int(k));
+      traces.push_back(make_trace(m, n, unsigned(i + 1)));
+    }
+  }
+  void run(std::size_t i)
+  {
+    Container& l = *containers[i];
+    std::size_t hits = 0;
+    for (const op& o : traces[i]) {
+      switch (o.op) {
+        case rt::trace_op::find:
+          hits += !l.empty() && l.begin()->info == o.key;
+          break;
+        case rt::trace_op::insert: l.push_front(o.key); break;
+        case rt::trace_op::erase:
+          if (!l.empty())
+            l.erase(l.begin());
+          break;
+      }
+    }
+    rt::do_not_optimize(hits);
+  }
+};
+
+// A queue shared by all threads, pushes and pops in turn.
+// The queue is placed by hand on a cache line, new does not align
+// beyond alignof (std::max_align_t) before C++17.
+struct queue_work {
+  using queue_type = rt::mpmc_queue<int>;
+  std::vector<char> buffer;
+  std::vector<char> storage;
+  queue_type* queue = nullptr;
+  std::vector<std::vector<op>> traces;
+  queue_work() = default;
+  queue_work(const queue_work&) = delete;
+  queue_work& operator=(const queue_work&) = delete;
+  ~queue_work()
+  {
+    if (queue)
+      queue->~queue_type();
+  }
+  void make(std::size_t t, std::size_t n, std::size_t m)
+  {
+    std::size_t cap = 1;
+    while (cap < t * (n + m))
+      cap *= 2;
+    buffer.resize(queue_type::bytes_for(cap));
+    storage.resize(sizeof (queue_type) + alignof (queue_type));
+    void* p = storage.data();
+    std::size_t space = storage.size();
+    queue = ::new (std::align(alignof (queue_type), sizeof (queue_type), p, space))
+      queue_type(buffer);
+    for (std::size_t i = 0; i < t; ++i) {
+      for (std::size_t k = 0; k < n; ++k)
+        queue->try_push(int(k));
+      traces.push_back(make_trace(m, n, unsigned(i + 1)));
+    }
+  }
+  void run(std::size_t i)
+  {
+    std::size_t hits = 0;
+    int v = 0;
+    const std::vector<op>& trace = traces[i];
+    for (std::size_t k = 0; k < trace.size(); ++k) {
+      if (k % 2 == 0)
+        hits += queue->try_push(trace[k].key);
+      else
+        hits += queue->try_pop(v);
+    }
+    rt::do_not_optimize(hits);
+  }
+};
+
+struct config {
+  std::vector<std::size_t> threads;
+  std::size_t n; // Elements per container.
+  std::size_t m; // Operations per thread.
+  rt::bench_options opts;
+  bool counters;
+};
+
+// make(t) returns the work of t threads.
+template <class Make>
+void bench( rt::bench_table& table, const std::string& name, const config& cfg
+          , Make make)
+{
+  double base = 0;
+  for (std::size_t t : cfg.threads) {
+    std::vector<double> mops;
+    counts c;
+    for (std::size_t r = 0; r < cfg.opts.warmup + cfg.opts.reps; ++r) {
+      auto w = make(t);
+      counts rc;
+      const double s = run_threads(t, *w, rc);
+      if (r < cfg.opts.warmup)
+        continue;
+      mops.push_back(double(t * cfg.m) / s * 1e-6);
+      c.cache_misses += rc.cache_misses;
+      c.cache_references += rc.cache_references;
+    }
+    const rt::bench_stats st = rt::compute_stats(mops);
+    if (t == cfg.threads.front())
+      base = st.median / double(t);
+    const double ops = double(cfg.opts.reps * t * cfg.m);
+    std::vector<double> v =
+    { double(t), double(cfg.m), st.median, st.stddev, st.median / base };
+    if (cfg.counters) {
+      v.push_back(double(c.cache_misses) / ops);
+      v.push_back(c.cache_references ? double(c.cache_misses) / double(c.cache_references) : 0);
+    }
+    table.add({name}, v);
+  }
+}
+
+template <class Container, class Alloc>
+void bench_set(rt::bench_table& table, const std::string& name, const config& cfg, pool p)
+{
+  bench(table, name, cfg, [&](std::size_t t)
+  {
+    std::unique_ptr<set_work<Container>> w(new set_work<Container>);
+    make_containers<Alloc>(*w, t, 2 * cfg.n + 1, p);
+    w->fill(cfg.n, cfg.m);
+    return w;
+  });
+}
+
+template <class Container, class Alloc>
+void bench_list(rt::bench_table& table, const std::string& name, const config& cfg, pool p)
+{
+  bench(table, name, cfg, [&](std::size_t t)
+  {
+    std::unique_ptr<list_work<Container>> w(new list_work<Container>);
+    make_containers<Alloc>(*w, t, cfg.n + cfg.m + 1, p);
+    w->fill(cfg.n, cfg.m);
+    return w;
+  });
+}
+
+int main(int argc, char* argv[])
+{
+  config cfg;
+  if (!rt::parse_bench_options(argc, argv, cfg.opts) || argc != 4) {
+    std::cout <<
+    "\nUsage: $ ./bench_concurrent [options] T N M\n"
+    "T: The most threads, runs with 1, 2, 4, ..., T.\n"
+    "N: Elements in each container before, keys in [0, 2N).\n"
+    "M: Operations per thread: on sets half finds, a quarter each of\n"
+    "   inserts and erases, on lists the same with front, push_front\n"
+    "   and pop of the front, on the queue pushes and pops in turn.\n"
+    << rt::bench_options_usage <<
+    "\nThe program outputs the millions of operations per second of all\n"
+    "threads, and the speedup over one thread times the thread count.\n"
+    "Where perf_event_open is available it adds the last level cache\n"
+    "misses per operation and their ratio to the references.\n"
+    << std::endl;
+    return 0;
+  }
+
+  const std::size_t T = rt::to_number<std::size_t>(argv[1]);
+  cfg.n = rt::to_number<std::size_t>(argv[2]);
+  cfg.m = rt::to_number<std::size_t>(argv[3]);
+  for (std::size_t t = 1; t < T; t *= 2)
+    cfg.threads.push_back(t);
+  cfg.threads.push_back(std::max<std::size_t>(T, 1));
+  cfg.counters = rt::perf_counter(rt::perf_event::cache_misses).valid();
+
+  std::vector<rt::bench_table::column> columns =
+  { {"threads", 0}, {"ops_per_thread", 0}, {"median_mops", 3}
+  , {"stddev_mops", 3}, {"speedup", 2} };
+  if (cfg.counters) {
+    columns.push_back({"llc_misses_per_op", 3});
+    columns.push_back({"llc_miss_ratio", 3});
+  }
+  rt::bench_table table({"name"}, columns);
+
+  using set_node = rt::set<int>::node_type;
+  using set_alloc = rt::node_allocator<int, set_node>;
+  using set_atomic = rt::node_allocator<int, set_node, rt::atomic_node_stack>;
+  using set_magazine = rt::node_allocator<int, set_node, rt::magazine_node_stack>;
+  bench_set<rt::set<int>, void>(table, "set std::allocator", cfg, pool::std_alloc);
+  bench_set<rt::set<int, std::less<int>, set_alloc>, set_alloc>
+    (table, "set header per thread", cfg, pool::per_thread);
+  bench_set<rt::set<int, std::less<int>, set_atomic>, set_atomic>
+    (table, "set shared atomic_node_stack", cfg, pool::shared);
+  bench_set<rt::set<int, std::less<int>, set_magazine>, set_magazine>
+    (table, "set shared magazine_node_stack", cfg, pool::shared);
+
+  using list_node = rt::list<int>::node_type;
+  using list_alloc = rt::node_allocator<int, list_node>;
+  using list_atomic = rt::node_allocator<int, list_node, rt::atomic_node_stack>;
+  using list_magazine = rt::node_allocator<int, list_node, rt::magazine_node_stack>;
+  bench_list<rt::list<int>, void>(table, "list std::allocator", cfg, pool::std_alloc);
+  bench_list<rt::list<int, list_alloc>, list_alloc>
+    (table, "list header per thread", cfg, pool::per_thread);
+  bench_list<rt::list<int, list_atomic>, list_atomic>
+    (table, "list shared atomic_node_stack", cfg, pool::shared);
+  bench_list<rt::list<int, list_magazine>, list_magazine>
+    (table, "list shared magazine_node_stack", cfg, pool::shared);
+
+  bench(table, "shared mpmc_queue", cfg, [&](std::size_t t)
+  {
+    std::unique_ptr<queue_work> w(new queue_work);
+    w->make(t, cfg.n, cfg.m);
+    return w;
+  });
+
+  table.print(std::cout, cfg.opts.format);
+  return 0;
+}
@@ -5,18 +5,20 @@
 #include <algorithm>
 #include <functional>
 
+#include <rtcpp/algorithm/find.hpp>
 #include <rtcpp/algorithm/find_intrusive.hpp>
 #include <rtcpp/utility/to_number.hpp>
 #include <rtcpp/utility/make_rand_data.hpp>
-#include <rtcpp/utility/timer.hpp>
+#include <rtcpp/utility/bench.hpp>
 
 int main(int argc, char* argv[])
 {
-  if (argc != 2) {
+  rt::bench_options opts;
+  if (!rt::parse_bench_options(argc, argv, opts) || argc != 2) {
     std::cout <<
-    "\nUsage: $ ./bench_find N\n"
+    "\nUsage: $ ./bench_find [options] N\n"
     "N: The start size.\n"
-    << std::endl;
+    << rt::bench_options_usage << std::endl;
 
     return 0;
   }
@@ -28,38 +30,43 @@ int main(int argc, char* argv[])
                            , std::numeric_limits<int>::min()
                            , std::numeric_limits<int>::max());
 
-  std::cout << "rt::find_intrusive" << std::endl;
+  bool ok = true;
+  rt::bench_runner r(opts);
+  r.run("rt::find_intrusive", n, [&]()
   {
     const auto a = std::begin(data);
     const auto b = std::end(data);
-    rt::timer t;
     for (std::size_t i = 0; i < n; ++i) {
       data.back() = data[i];
       auto iter = rt::find_intrusive(a, b, data[i]);
-      if (iter == b) {
-        std::cout << "Something wrong ..." << std::endl;
-        return 1;
-      }
+      ok = ok && iter != b;
     }
-  }
-  std::cout << std::endl;
-  std::cout << "std::find" << std::endl;
+  });
+  r.run("std::find", n, [&]()
   {
     const auto a = std::begin(data);
     auto b = std::end(data);
     --b;
-    rt::timer t;
     for (std::size_t i = 0; i < n; ++i) {
       data.back() = data[i];
       auto iter = std::find(a, b, data[i]);
-      if (iter == b) {
-        std::cout << "Something wrong ..." << std::endl;
-        return 1;
-      }
+      ok = ok && iter != b;
     }
-  }
+  });
+  r.run("rt::find", n, [&]()
+  {
+    const int* a = data.data();
+    const int* b = a + n;
+    for (std::size_t i = 0; i < n; ++i) {
+      auto iter = rt::find(a, b, data[i]);
+      ok = ok && iter != b;
+    }
+  });
 
-  std::cout << std::endl;
+  if (!ok) {
+    std::cout << "Something wrong ..." << std::endl;
+    return 1;
+  }
+  r.print(std::cout);
   return 0;
 }
-
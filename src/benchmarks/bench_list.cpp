@@ -22,26 +22,23 @@
 
 int main(int argc, char* argv[])
 {
-  if ((argc != 5) && (argc != 6)) {
+  rt::bench_options opts;
+  if (!rt::parse_bench_options(argc, argv, opts) || ((argc != 5) && (argc != 6))) {
     std::cout <<
-    "\nUsage: $ ./bench_set N S K B F\n"
+    "\nUsage: $ ./bench_list [options] N S K B F\n"
     "N: The start size.\n"
     "S: The step size.\n"
     "K: How many steps.\n"
     "B: Chars between.\n"
     "F: Optional. If provided will not fragment the heap before benchmarks.\n"
-    << std::endl;
+    << rt::bench_options_usage << std::endl;
     std::cout <<
-    "The program output has the following layout: \n"
-    "(0) (1) (2) (3) (4) (5): \n"
-    "Where: \n"
-    "(0)  Number of elements.\n"
+    "The program outputs one result per list type and size:\n"
     "(1)  std::list<std::alloc>\n"
     "(2)  std::list<rt::alloc>\n"
     "(3)  std::list<__gnu_cxx::__pool_alloc>\n"
     "(4)  std::list<__gnu_cxx::bitmap_alloc>\n"
     "(5)  std::list<__mt_alloc>\n"
-    //"(6)  std::vector<>\n"
     << std::endl;
 
     return 0;
@@ -64,62 +61,45 @@ int main(int argc, char* argv[])
   if (frag) 
     pointers = heap_frag_list(B, data); // Fragments the heap.
 
-  std::cout << "std::list<int>" << std::endl;
+  bench_runner r(opts);
   for (std::size_t i = 0; i < K; ++i) {
     const std::size_t n = N + i * S;
-    std::cout << n << " ";
-    print_list_bench<std::list<int>>( std::list<int>()
-                                    , std::begin(data)
-                                    , n); // (1)
-    std::cout << std::endl;
+    print_list_bench( r, "(1) std::list<int>", []{ return std::list<int>(); }
+                    , std::begin(data), n);
   }
 
-  std::cout << "std::list<int, rt::node_allocator_lazy<int>>" << std::endl;
   for (std::size_t i = 0; i < K; ++i) {
     const std::size_t n = N + i * S;
-    std::cout << n << " ";
-    {
-      std::vector<char> buffer((n + 2) * 40, 0);
-      rt::node_alloc_header header(buffer);
-      rt::node_allocator_lazy<int> alloc(&header);
-      std::list<int, rt::node_allocator_lazy<int>> s(alloc);
-      print_list_bench(s, std::begin(data), n); // (2)
-    }
-    std::cout << std::endl;
+    std::vector<char> buffer((n + 2) * 40, 0);
+    rt::node_alloc_header header(buffer);
+    rt::node_allocator_lazy<int> alloc(&header);
+    using list_type = std::list<int, rt::node_allocator_lazy<int>>;
+    print_list_bench( r, "(2) std::list<int, rt::node_allocator_lazy<int>>"
+                    , [&]{ return list_type(alloc); }, std::begin(data), n);
   }
 #ifdef GNU_FOUND
-  std::cout << "std::list<int, __gnu_cxx::__pool_alloc<int>>()" << std::endl;
   for (std::size_t i = 0; i < K; ++i) {
     const std::size_t n = N + i * S;
-    std::cout << n << " ";
-    print_list_bench( std::list<int, __gnu_cxx::__pool_alloc<int>>()
-                    , std::begin(data)
-                    , n); // (3)
-    std::cout << std::endl;
+    print_list_bench( r, "(3) std::list<int, __gnu_cxx::__pool_alloc<int>>"
+                    , []{ return std::list<int, __gnu_cxx::__pool_alloc<int>>(); }
+                    , std::begin(data), n);
   }
-  std::cout << "std::list<int, __gnu_cxx::bitmap_allocator<int>>()" << std::endl;
   for (std::size_t i = 0; i < K; ++i) {
     const std::size_t n = N + i * S;
-    std::cout << n << " ";
-    print_list_bench( std::list<int, __gnu_cxx::bitmap_allocator<int>>()
-                    , std::begin(data)
-                    , n); // (4)
-    std::cout << std::endl;
+    print_list_bench( r, "(4) std::list<int, __gnu_cxx::bitmap_allocator<int>>"
+                    , []{ return std::list<int, __gnu_cxx::bitmap_allocator<int>>(); }
+                    , std::begin(data), n);
   }
-  std::cout << "std::list<int, __gnu_cxx::__mt_alloc<int>>()" << std::endl;
   for (std::size_t i = 0; i < K; ++i) {
     const std::size_t n = N + i * S;
-    std::cout << n << " ";
-    print_list_bench( std::list<int, __gnu_cxx::__mt_alloc<int>>()
-                    , std::begin(data)
-                    , n); // (5)
-    std::cout << std::endl;
+    print_list_bench( r, "(5) std::list<int, __gnu_cxx::__mt_alloc<int>>"
+                    , []{ return std::list<int, __gnu_cxx::__mt_alloc<int>>(); }
+                    , std::begin(data), n);
   }
 #endif
+  r.print(std::cout);
   std::for_each( std::begin(pointers)
                , std::end(pointers)
                , [](char* p){ delete p;});
-  std::cout << std::endl;
   return 0;
 }
-
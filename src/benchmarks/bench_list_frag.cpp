@@ -10,21 +10,18 @@
 
 int main(int argc, char* argv[])
 {
-  if ((argc != 5) && (argc != 6)) {
+  rt::bench_options opts;
+  if (!rt::parse_bench_options(argc, argv, opts) || ((argc != 5) && (argc != 6))) {
     std::cout <<
-    "\nUsage: $ ./bench_set N S K B F\n"
+    "\nUsage: $ ./bench_list_frag [options] N S K B F\n"
     "N: The start size.\n"
     "S: The step size.\n"
     "K: How many steps.\n"
     "B: Chars between.\n"
     "F: Optional. If provided will not fragment the heap before benchmarks.\n"
-    << std::endl;
-    std::cout <<
-    "The program output has the following layout: \n"
-    "(0) (1): \n"
-    "Where: \n"
-    "(0)  Number of elements.\n"
-    "(1)  std::list<std::alloc>\n"
+    << rt::bench_options_usage <<
+    "\nThe program outputs one result per size of\n"
+    "std::list<std::alloc>\n"
     << std::endl;
 
     return 0;
@@ -47,19 +44,15 @@ int main(int argc, char* argv[])
   if (frag) 
     pointers = heap_frag_list(B, data); // Fragments the heap.
 
-  std::cout << data.size() << " " << frag << " " << B << std::endl;
+  const std::string name = frag ? "std::list<int> fragmented" : "std::list<int>";
+  bench_runner r(opts);
   for (std::size_t i = 0; i < K; ++i) {
     const std::size_t n = N + i * S;
-    std::cout << n << " ";
-    print_list_bench<std::list<int>>( std::list<int>()
-                                    , std::begin(data)
-                                    , n);
-    std::cout << std::endl;
+    print_list_bench(r, name, []{ return std::list<int>(); }, std::begin(data), n);
   }
+  r.print(std::cout);
   std::for_each( std::begin(pointers)
                , std::end(pointers)
                , [](char* p){ delete p;});
-  std::cout << std::endl;
   return 0;
 }
-
@@ -16,6 +16,7 @@
 #endif
 
 #include <rtcpp/utility/to_number.hpp>
+#include <rtcpp/memory/huge_pool.hpp>
 #include <rtcpp/memory/node_allocator_lazy.hpp>
 #include <rtcpp/utility/make_rand_data.hpp>
 
@@ -52,35 +53,29 @@ using type5 = set_type<__gnu_cxx::__mt_alloc<int>>;
 
 int main(int argc, char* argv[])
 {
-  if ((argc != 5) && (argc != 6)) {
+  rt::bench_options opts;
+  if (!rt::parse_bench_options(argc, argv, opts) || ((argc != 5) && (argc != 6))) {
     std::cout <<
-    "\nUsage: $ ./bench_set N S K B F\n"
+    "\nUsage: $ ./bench_set [options] N S K B F\n"
     "N: The start size.\n"
     "S: The step size.\n"
     "K: How many steps.\n"
     "B: Chars between.\n"
     "F: Optional (any value). If provided will not fragment the\n"
-    "   heap before benchmarks.\n\n"
-    "The program outputs has the following layout: \n"
-    "(0) (1) (2) (3) (4) (5): \n"
-    "Where: \n"
-    "(0)  Number of elements.\n"
+    "   heap before benchmarks.\n"
+    << rt::bench_options_usage <<
+    "\nThe program outputs one result per set type and size:\n"
     "(1)  std::set<std::alloc>\n"
     "(2)  std::set<rt::alloc>\n"
     "(3)  std::set<__gnu_cxx::__pool_alloc>\n"
     "(4)  std::set<__gnu_cxx::bitmap_alloc>\n"
-    "(5)  std::set<__mt_alloc>\n\n";
+    "(5)  std::set<__mt_alloc>\n"
+    "(6)  std::set<rt::alloc> on a pre-faulted huge_pool\n\n";
     return 0;
   }
 
   using namespace rt;
 
-  std::cout << argv[0] << " "
-            << argv[1] << " "
-            << argv[2] << " "
-            << argv[3] << " "
-            << argv[4] << "\n";
-            
   const int N = to_number<int>(argv[1]);
   const int S = to_number<int>(argv[2]);
   const int K = to_number<int>(argv[3]);
@@ -95,50 +90,40 @@ int main(int argc, char* argv[])
   if (frag) // Fragments the heap.
     pointers = heap_frag<std::set<int>>(B, data);
 
-  std::cout << "(1)" << std::endl;
+  bench_runner r(opts);
   for (int i = 0; i < K; ++i) {
     const int n = N + i * S;
-    std::cout << n << " ";
-    print_set_bench(type1(), std::begin(data), n); // (1)
-    std::cout << std::endl;
+    print_set_bench(r, "(1) std::alloc", []{ return type1(); }, std::begin(data), n);
   }
-  std::cout << "(2)" << std::endl;
   for (int i = 0; i < K; ++i) {
     const int n = N + i * S;
-    std::cout << n << " ";
     std::vector<char> buffer((n + 2) * node_size, 0);
     rt::node_alloc_header header(buffer);
     typename type2::allocator_type alloc(&header);
-    type2 s(alloc);
-    print_set_bench(s, std::begin(data), n);
-    std::cout << std::endl;
+    print_set_bench(r, "(2) rt::alloc", [&]{ return type2(alloc); }, std::begin(data), n);
   }
 #ifdef GNU_FOUND
-  std::cout << "(3)" << std::endl;
   for (int i = 0; i < K; ++i) {
     const int n = N + i * S;
-    std::cout << n << " ";
-    print_set_bench(type3(), std::begin(data), n);
-    std::cout << std::endl;
+    print_set_bench(r, "(3) __pool_alloc", []{ return type3(); }, std::begin(data), n);
   }
-  std::cout << "(4)" << std::endl;
   for (int i = 0; i < K; ++i) {
     const int n = N + i * S;
-    std::cout << n << " ";
-    print_set_bench(type4(), std::begin(data), n);
-    std::cout << std::endl;
+    print_set_bench(r, "(4) bitmap_alloc", []{ return type4(); }, std::begin(data), n);
   }
-  std::cout << "(5)" << std::endl;
   for (int i = 0; i < K; ++i) {
     const int n = N + i * S;
-    std::cout << n << " ";
-    print_set_bench(type5(), std::begin(data), n);
-    std::cout << std::endl;
+    print_set_bench(r, "(5) __mt_alloc", []{ return type5(); }, std::begin(data), n);
   }
 #endif
-  std::cout << std::endl;
+  for (int i = 0; i < K; ++i) {
+    const int n = N + i * S;
+    rt::huge_pool pool((n + 2) * node_size);
+    typename type2::allocator_type alloc(&pool.header());
+    print_set_bench(r, "(6) rt::alloc huge_pool", [&]{ return type2(alloc); }, std::begin(data), n);
+  }
+  r.print(std::cout);
   std::for_each( std::begin(pointers), std::end(pointers)
                , [](char* p){ delete p;});
   return 0;
 }
-
@@ -8,18 +8,21 @@
 #include <rtcpp/container/set.hpp>
 #include <rtcpp/utility/to_number.hpp>
 #include <rtcpp/utility/make_rand_data.hpp>
-#include <rtcpp/utility/timer.hpp>
+#include <rtcpp/utility/bench.hpp>
 #include <rtcpp/memory/node_allocator.hpp>
 
 #include "heap_frag.hpp"
 
 int main(int argc, char* argv[])
 {
-  if (argc != 3) {
+  rt::bench_options opts;
+  if (!rt::parse_bench_options(argc, argv, opts) || argc != 3) {
     std::cout <<
-    "\nUsage: $ ./bench_set N B F\n"
+    "\nUsage: $ ./bench_traverse [options] N B\n"
     "N: The start size.\n"
     "B: Chars between.\n"
+    << rt::bench_options_usage <<
+    "\nEach repetition traverses a container of N elements once.\n"
     << std::endl;
     return 0;
   }
@@ -38,66 +41,82 @@ int main(int argc, char* argv[])
   using set_type = rt::set<int, std::less<int>, alloc_type>;
   using node_type = typename set_type::node_type;
 
-  // Buffer to hold the nodes.
-  std::vector<node_type> buffer(N + 1);
+  // Buffer to hold the nodes and the head of the set.
+  std::vector<node_type> buffer(N + 2);
 
   const auto a = std::begin(data);
   const auto b = std::end(data);
 
-  //for (auto a: set)
-  //  std::cout << a << " ";
-  //std::cout << std::endl;;
-
-  const int k = 100;
-  int v;
+  rt::bench_runner r(opts);
   {
-    std::cout << "Traversing rt::set<int>: ";
     std::vector<char*> pointers;
     if (frag) // Fragments the heap.
       pointers = rt::heap_frag<rt::set<int>>(B, data);
 
     rt::set<int> rt_set(a, b);
-    {
-      rt::timer t;
-      for (int i = 0; i < k; ++i)
-        v = std::accumulate(std::begin(rt_set), std::end(rt_set), 0);
-    }
+    r.run("rt::set<int>", N, [&]()
+    { rt::do_not_optimize(std::accumulate(std::begin(rt_set), std::end(rt_set), 0)); });
     std::for_each( std::begin(pointers), std::end(pointers)
                  , [](char* p){ delete p;});
-    std::cout << v << std::endl;
-  }
-  std::cout << "Traversing rt::vector<int>: ";
-  {
-    rt::timer t;
-    for (int i = 0; i < k; ++i)
-      v = std::accumulate(std::begin(data), std::end(data), 0);
   }
-  std::cout << v << std::endl;
+  r.run("std::vector<int>", N, [&]()
+  { rt::do_not_optimize(std::accumulate(std::begin(data), std::end(data), 0)); });
 
   rt::node_alloc_header header(buffer);
   alloc_type alloc(&header);
 
   set_type set(a, b, alloc);
-  std::cout << "Traversing rt::set<int, node_allocator>: ";
-  {
-    rt::timer t;
-    for (int i = 0; i < k; ++i)
-      v = std::accumulate(std::begin(set), std::end(set), 0);
-  }
-  std::cout << v << std::endl;
+  r.run("rt::set<int, node_allocator>", N, [&]()
+  { rt::do_not_optimize(std::accumulate(std::begin(set), std::end(set), 0)); });
 
   auto func = [](int init, const node_type& node)
   { return rt::tbst::test_in_use(node) ? init + node.key : init; };
 
-  std::cout << "Traversing std::vector<node_type>: ";
+  r.run("std::vector<node_type>", N, [&]()
+  {
+    rt::do_not_optimize(std::accumulate( std::begin(buffer), std::end(buffer)
+                                       , 0, func));
+  });
+
+  r.run("rt::set<int, node_allocator> unordered", N, [&]()
   {
-    rt::timer t;
-    for (int i = 0; i < k; ++i)
-      v = std::accumulate( std::begin(buffer), std::end(buffer)
-                         , 0, func);
+    int v = 0;
+    set.for_each_unordered([&](int o){ v += o; });
+    rt::do_not_optimize(v);
+  });
+
+  // Sparse pools: only one element in ten is left.
+  std::vector<node_type> buffer1(N + 2);
+  std::vector<node_type> buffer2(N + 2);
+  rt::node_alloc_header header1(buffer1);
+  rt::node_alloc_header header2(buffer2);
+  std::vector<std::uint64_t> bitmap(header2.bitmap_words(sizeof (node_type)));
+  header2.use_bitmap(bitmap);
+  alloc_type alloc1(&header1);
+  alloc_type alloc2(&header2);
+  set_type sparse1(a, b, alloc1);
+  set_type sparse2(a, b, alloc2);
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    if (i % 10 != 0) {
+      sparse1.erase(data[i]);
+      sparse2.erase(data[i]);
+    }
   }
-  std::cout << v << std::endl;
 
+  r.run("sparse rt::set<int, node_allocator> unordered", N, [&]()
+  {
+    int v = 0;
+    sparse1.for_each_unordered([&](int o){ v += o; });
+    rt::do_not_optimize(v);
+  });
+
+  r.run("sparse rt::set<int, node_allocator> with bitmap", N, [&]()
+  {
+    int v = 0;
+    sparse2.for_each_unordered([&](int o){ v += o; });
+    rt::do_not_optimize(v);
+  });
+
+  r.print(std::cout);
   return 0;
 }
-
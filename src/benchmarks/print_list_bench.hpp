@@ -1,16 +1,29 @@
 #pragma once
 
-#include <rtcpp/utility/timer.hpp>
+#include <string>
+#include <iterator>
+#include <algorithm>
+
+#include <rtcpp/utility/bench.hpp>
 
 namespace rt {
 
-template <typename C, typename Iter>
-void print_list_bench(C c, Iter begin, std::size_t n)
+template <typename Make, typename Iter>
+void print_list_bench( bench_runner& r, const std::string& name, Make make
+                     , Iter begin, std::size_t n)
 {
+  // make: Returns an empty list, can be an std::list with any allocator.
+  // begin: Iterator pointing to random data.
+  // n: Size of random data.
   const std::size_t s = n / 2;
-  c.insert(std::end(c), begin, begin + s);
+  auto setup = [&]()
+  {
+    auto c = make();
+    c.insert(std::end(c), begin, begin + s);
+    return c;
+  };
+  auto body = [&](decltype(make())& c)
   {
-    rt::timer t;
     for (std::size_t i = 0; i <= s; ++i) {
       auto iter = std::find( std::begin(c)
                            , std::end(c)
@@ -27,7 +40,8 @@ void print_list_bench(C c, Iter begin, std::size_t n)
         c.erase(iter);
       c.push_front(begin[i]);
     }
-  }
+  };
+  r.run(name, n, setup, body);
 }
 
 }
@@ -1,15 +1,20 @@
 #pragma once
 
+#include <string>
+#include <numeric>
+#include <iterator>
 #include <algorithm>
 
-#include <rtcpp/utility/timer.hpp>
+#include <rtcpp/utility/bench.hpp>
 
 namespace rt {
 
-template <typename C, typename RandomAccessIter>
-void print_set_bench(C c, RandomAccessIter begin, std::size_t n)
+template <typename Make, typename RandomAccessIter>
+void print_set_bench( bench_runner& r, const std::string& name, Make make
+                    , RandomAccessIter begin, std::size_t n)
 {
-  // c: Set instance, can be an std::set, std::unordered_set, etc.
+  // make: Returns an empty set, can be an std::set,
+  // std::unordered_set, etc.
   // begin: Iterator pointing to random data.
   // n: Size of random data.
   //
@@ -17,28 +22,35 @@ void print_set_bench(C c, RandomAccessIter begin, std::size_t n)
   // and deletions are made together to maximize cache misses.
 
   const std::size_t s = n / 2;
-  int sum = 0; // Dummy variable.
-  int repeat = 10;
+  const std::size_t repeat = 10;
   // Inserts the first half of the random data in the set. do not
   // participate in the benchmark.
-  c.insert(begin, begin + s);
+  auto setup = [&]()
   {
-    rt::timer t;
+    auto c = make();
+    c.insert(begin, begin + s);
+    return c;
+  };
+  auto body = [&](decltype(make())& c)
+  {
+    unsigned sum = 0;
     for (std::size_t i = 0; i <= s; ++i) {
       c.erase(begin[i]); // Removes already inserted random data.
       c.insert(begin[n - i - 1]); // Inserts the second half of random data.
       // Traverses the container every *repeat* times
       if (i % repeat == 0)
-        sum = std::accumulate(std::begin(c), std::end(c), 0);
+        sum += std::accumulate(std::begin(c), std::end(c), 0u);
     }
     // Same purpose as the loop above.
     for (std::size_t i = 0; i <= s; ++i) {
       c.erase(begin[n - i - 1]); // Removes the second half.
       c.insert(begin[i]); // Inserts the first half again.
       if (i % repeat == 0)
-        sum = std::accumulate(std::begin(c), std::end(c), 0);
+        sum += std::accumulate(std::begin(c), std::end(c), 0u);
     }
-  }
+    do_not_optimize(sum);
+  };
+  r.run(name, n, setup, body);
 }
 
 }
@@ -1,6 +1,8 @@
 #include <array>
 #include <unordered_set>
 
+#include <rtcpp/container/unordered_set.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
 #include <rtcpp/memory/node_allocator_lazy.hpp>
 #include <rtcpp/utility/print.hpp>
 
@@ -15,5 +17,19 @@ int main()
   t1 = {5, 3, 7, 20, 1, 44, 22, 8};
 
   print(t1);
+
+  // The bucket segments are requested by reserve, insertions then
+  // only take nodes from the buffer.
+  using set_type = rt::unordered_set<int>;
+  using alloc_type = rt::node_allocator<int, set_type::node_type>;
+  std::array<set_type::node_type, 20> buffer2 = {{}};
+  rt::node_alloc_header header2(buffer2);
+  alloc_type alloc2(&header2);
+  rt::unordered_set<int, std::hash<int>, std::equal_to<int>, alloc_type>
+    t2(alloc2);
+  t2.reserve(buffer2.size());
+  t2 = {5, 3, 7, 20, 1, 44, 22, 8};
+
+  print(t2);
 }
 
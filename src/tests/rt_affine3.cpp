@@ -0,0 +1,85 @@
+#include <cmath>
+#include <stdexcept>
+
+#include <rtcpp/container/affine3.hpp>
+
+using namespace rt;
+
+template <typename T, std::size_t M, std::size_t N>
+bool near(const matrix<T, M, N>& a, const matrix<T, M, N>& b, T eps)
+{
+  for (std::size_t i = 0; i < M * N; ++i)
+    if (std::abs(a[i] - b[i]) > eps)
+      return false;
+  return true;
+}
+
+template <typename T>
+bool near(const affine3<T>& a, const affine3<T>& b, T eps)
+{
+  for (std::size_t i = 0; i < 12; ++i)
+    if (std::abs(a.data()[i] - b.data()[i]) > eps)
+      return false;
+  return true;
+}
+
+template <typename T>
+bool test_type(T eps)
+{
+  using aff = affine3<T>;
+  using vec = matrix<T, 3, 1>;
+  using mat = matrix<T, 3, 3>;
+  using mat4 = matrix<T, 4, 4>;
+
+  const quaternion<T> q = normalize(quaternion<T>(T(0.1), T(-0.7), T(0.5), T(0.2)));
+  const aff a(q, vec{1, -2, 3});
+  const aff b(mat{2, 1, 0, 0, 1, -1, 1, 0, 3}, vec{T(0.5), 0, -1});
+  const vec p = {T(1.5), -2, T(0.25)};
+
+  // Against 4x4 matrices.
+  const mat4 ma = a;
+  const mat4 mb = b;
+  const mat4 mab = ma * mb;
+  const aff ab = a * b;
+  if (!near(mat4(ab), mab, eps) || !near(aff(mab), ab, eps))
+    return false;
+  if (mab(3, 0) != 0 || mab(3, 1) != 0 || mab(3, 2) != 0 || mab(3, 3) != 1)
+    return false;
+
+  // b then a on points.
+  if (!near(ab * p, a * (b * p), eps))
+    return false;
+  if (!near(a * p, vec(q * p + a.translation()), eps))
+    return false;
+  if (!near(a.linear(), to_matrix(q), eps) || a.translation() != vec{1, -2, 3})
+    return false;
+
+  if (!near(inverse(b) * b, aff(), eps) || !near(b * inverse(b), aff(), eps))
+    return false;
+  if (!near(rigid_inverse(a) * a, aff(), eps) || !near(inverse(a), rigid_inverse(a), eps))
+    return false;
+  if (!near(inverse(b) * (b * p), p, eps))
+    return false;
+
+  try {
+    inverse(aff(mat{1, 2, 3, 2, 4, 6, 0, 0, 1}));
+    return false;
+  } catch (const std::runtime_error&) {}
+  return true;
+}
+
+// In constant expressions.
+constexpr affine3<int> ai(matrix<int, 3, 3>{0, -1, 0, 1, 0, 0, 0, 0, 1}, {1, 2, 3});
+constexpr affine3<int> aj(matrix<int, 3, 3>{2, 0, 0, 0, 2, 0, 0, 0, 2}, {0, 0, -1});
+static_assert(ai * matrix<int, 3, 1>{1, 0, 0} == matrix<int, 3, 1>{1, 3, 3}, "");
+static_assert((ai * aj) * matrix<int, 3, 1>{1, 1, 1} == ai * (aj * matrix<int, 3, 1>{1, 1, 1}), "");
+static_assert(rigid_inverse(ai) * ai == affine3<int>(), "");
+static_assert(matrix<int, 4, 4>(ai)(3, 3) == 1, "");
+
+int main()
+{
+  if (!test_type<float>(1e-5f) || !test_type<double>(1e-12))
+    return 1;
+
+  return 0;
+}
@@ -37,6 +37,12 @@ int main()
   if (align_next<8>(27) != 32)
     return 1;
 
+  if (is_pow2(0) || is_pow2(12) || !is_pow2(1) || !is_pow2(4096))
+    return 1;
+
+  if (floor_pow2(1) != 1 || floor_pow2(12) != 8 || floor_pow2(4096) != 4096)
+    return 1;
+
   return 0;
 }
 
@@ -0,0 +1,89 @@
+#include <set>
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/container/forward_list.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/aligned_stack.hpp>
+#include <rtcpp/memory/bump_node_stack.hpp>
+#include <rtcpp/memory/atomic_node_stack.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+// Elements are at the same offset in all nodes as in node.
+template <std::size_t A, class C, class V>
+bool aligned_nodes(const C& c, const V& node, const void* elem)
+{
+  const std::uintptr_t off = reinterpret_cast<std::uintptr_t>(elem)
+                           - reinterpret_cast<std::uintptr_t>(&node);
+  for (auto it = std::begin(c); it != std::end(c); ++it)
+    if ((reinterpret_cast<std::uintptr_t>(&*it) - off) % A != 0)
+      return false;
+  return true;
+}
+
+template <template <class, class> class Stack, std::size_t A>
+bool test_set()
+{
+  using node_type = rt::set<int>::node_type;
+  using alloc_type =
+    rt::node_allocator<int, node_type, rt::aligned<Stack, A>::template type>;
+  using set_type = rt::set<int, std::less<int>, alloc_type>;
+
+  const int n = 500;
+  std::vector<int> data = rt::make_rand_data<int>(n, 1, 4 * n);
+  std::set<int> ref(std::begin(data), std::end(data));
+
+  // Misaligned on purpose.
+  const std::size_t block = (sizeof (node_type) + A - 1) / A * A;
+  std::vector<char> buffer((n + 3) * block);
+  rt::node_alloc_header header(buffer.data() + 1, buffer.size() - 1);
+  const alloc_type alloc(&header);
+  set_type t1(alloc);
+  t1.insert(std::begin(data), std::end(data));
+
+  const node_type node {};
+  return header.block_size == block && header.buffer_size >= (n + 1) * block
+      && std::equal(std::begin(ref), std::end(ref), std::begin(t1))
+      && aligned_nodes<A>(t1, node, &node.key);
+}
+
+bool test_list()
+{
+  // Nodes of 16 bytes on their own lines.
+  using node_type = rt::forward_list<long>::node_type;
+  using alloc_type =
+    rt::node_allocator< int, node_type
+                      , rt::aligned<rt::node_stack, rt::cache_line_size>::type>;
+  std::vector<char> buffer(100 * rt::cache_line_size);
+  rt::node_alloc_header header(buffer);
+  const alloc_type alloc(&header);
+  rt::forward_list<long, alloc_type> l1(alloc);
+  for (long i = 0; i < 50; ++i)
+    l1.push_front(i);
+  long i = 50;
+  for (auto o: l1)
+    if (o != --i)
+      return false;
+
+  const node_type node {};
+  return header.block_size == rt::cache_line_size
+      && aligned_nodes<rt::cache_line_size>(l1, node, &node.info);
+}
+
+int main()
+{
+  if (!test_set<rt::node_stack, 16>() || !test_set<rt::node_stack, 64>())
+    return 1;
+  if (!test_set<rt::atomic_node_stack, 32>())
+    return 1;
+  if (!test_set<rt::bump_node_stack, 64>())
+    return 1;
+  if (!test_list())
+    return 1;
+
+  return 0;
+}
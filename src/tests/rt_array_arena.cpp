@@ -0,0 +1,87 @@
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <rtcpp/memory/array_arena.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/container/unordered_set.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+bool test_arena()
+{
+  std::array<std::uint64_t, 16> buffer;
+  rt::array_arena arena(buffer);
+  if (arena.capacity() != sizeof buffer || arena.used() != 0)
+    return false;
+
+  // Aligned for each type, LIFO deallocation rewinds.
+  char* c = arena.allocate<char>(3);
+  double* d = arena.allocate<double>(2);
+  if (reinterpret_cast<std::uintptr_t>(d) % alignof (double) != 0
+      || reinterpret_cast<char*>(d) < c + 3 || arena.used() != 24)
+    return false;
+  arena.deallocate(d, 2);
+  if (arena.used() != 8 || arena.allocate<double>(1) != d)
+    return false;
+
+  // Not the last one, nothing changes.
+  arena.deallocate(c, 3);
+  if (arena.used() != 16 || !arena.owns(c) || arena.owns(buffer.data() + 16))
+    return false;
+
+  try {
+    arena.allocate<std::uint64_t>(15);
+    return false;
+  } catch (const std::bad_alloc&) {
+  }
+  if (arena.allocate<std::uint64_t>(14) == 0 || arena.remaining() != 0)
+    return false;
+
+  arena.release();
+  return arena.used() == 0 && arena.allocate<char>(128) == reinterpret_cast<char*>(buffer.data());
+}
+
+// Nodes from the header buffer, arrays from the arena.
+bool test_node_allocator(const std::vector<int>& data)
+{
+  using set_type = rt::unordered_set<int>;
+  using node_type = set_type::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+
+  std::vector<node_type> nodes(data.size() + 1);
+  std::vector<char> arrays(1 << 16);
+  rt::array_arena arena(arrays);
+  rt::node_alloc_header header(nodes);
+  header.use_arena(arena);
+  alloc_type alloc(&header);
+
+  rt::unordered_set<int, std::hash<int>, std::equal_to<int>, alloc_type> s(alloc);
+  s.reserve(data.size());
+  const std::size_t used = arena.used();
+  if (used == 0)
+    return false;
+  s.insert(std::begin(data), std::end(data));
+  if (arena.used() != used)
+    return false;
+
+  // A vector gets its buffers from the arena as well.
+  std::vector<int, alloc_type> v(alloc);
+  v.assign(std::begin(data), std::end(data));
+  if (!arena.owns(v.data()) || !std::equal(std::begin(v), std::end(v), std::begin(data)))
+    return false;
+
+  for (int k: data)
+    if (!s.count(k))
+      return false;
+  return s.size() <= data.size();
+}
+
+int main()
+{
+  const std::vector<int> data = rt::make_rand_data<int>(1000, 1, 100000);
+  if (!test_arena() || !test_node_allocator(data))
+    return 1;
+
+  return 0;
+}
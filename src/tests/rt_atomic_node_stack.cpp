@@ -0,0 +1,226 @@
+#include <set>
+#include <array>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/atomic_node_stack.hpp>
+#include <rtcpp/memory/magazine_node_stack.hpp>
+
+bool test_single_thread()
+{
+  using T = std::size_t;
+  using Index = std::size_t;
+  constexpr T n = 10;
+  std::array<T, n> arr = {{}};
+
+  rt::node_alloc_header header(arr);
+  rt::atomic_node_stack<T, Index> stack(&header);
+
+  // Same order as rt::node_stack.
+  for (T i = n - 1; i != 0; --i)
+    if (stack.pop() != i)
+      return false;
+
+  if (stack.pop())
+    return false;
+
+  stack.push(3);
+  stack.push(7);
+  if (stack.pop() != 7 || stack.pop() != 3 || stack.pop())
+    return false;
+
+  return true;
+}
+
+bool test_many_threads()
+{
+  using T = std::size_t;
+  using Index = std::size_t;
+  constexpr std::size_t n = 1000;
+  std::vector<T> arr(n);
+
+  rt::node_alloc_header header(arr);
+  rt::atomic_node_stack<T, Index> stack(&header);
+
+  const int n_threads = 4;
+  const int rounds = 20000;
+  auto func = [&]()
+  {
+    rt::atomic_node_stack<T, Index> s(stack);
+    std::array<Index, 8> tmp;
+    for (int i = 0; i < rounds; ++i) {
+      for (auto& o: tmp)
+        o = s.pop();
+      for (auto o: tmp)
+        if (o)
+          s.push(o);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < n_threads; ++i)
+    threads.emplace_back(func);
+
+  for (auto& t: threads)
+    t.join();
+
+  // Every block must be in the stack exactly once.
+  std::vector<Index> idxs;
+  while (const Index i = stack.pop())
+    idxs.push_back(i);
+
+  std::sort(std::begin(idxs), std::end(idxs));
+  if (std::adjacent_find(std::begin(idxs), std::end(idxs)) != std::end(idxs))
+    return false;
+
+  return idxs.size() == n - 1;
+}
+
+bool test_batch()
+{
+  using T = std::size_t;
+  using Index = std::size_t;
+  constexpr T n = 10;
+  std::array<T, n> arr = {{}};
+
+  rt::node_alloc_header header(arr);
+  rt::atomic_node_stack<T, Index> stack(&header);
+
+  std::array<Index, n> tmp = {{}};
+  if (stack.pop_n(tmp.data(), 4) != 4)
+    return false;
+
+  stack.push_n(tmp.data(), 4);
+  if (stack.pop_n(tmp.data(), n) != n - 1)
+    return false;
+
+  // Pushing and popping in batch must preserve the order.
+  stack.push_n(tmp.data(), n - 1);
+  for (T i = n - 1; i != 0; --i)
+    if (stack.pop() != i)
+      return false;
+
+  return true;
+}
+
+bool test_magazine()
+{
+  using T = std::size_t;
+  using Index = std::size_t;
+  using stack_type = rt::basic_magazine_node_stack<T, Index, 4>;
+  constexpr std::size_t n = 20;
+  std::array<T, n> arr = {{}};
+
+  rt::node_alloc_header header(arr);
+  rt::atomic_node_stack<T, Index> shared(&header);
+  {
+    stack_type stack(&header);
+    // A refill takes half of the magazine from the shared stack.
+    const Index a = stack.pop();
+    if (!a || stack.size() != 1)
+      return false;
+
+    stack_type copy(stack);
+    if (copy.size() != 0)
+      return false;
+
+    std::vector<Index> idxs;
+    while (const Index i = copy.pop())
+      idxs.push_back(i);
+
+    // The one left in stack's magazine is not available to copy.
+    if (idxs.size() != n - 3)
+      return false;
+
+    // A drain leaves half of the magazine.
+    for (auto i: idxs)
+      copy.push(i);
+    if (copy.size() == 0 || copy.size() > stack_type::capacity)
+      return false;
+
+    stack.push(a);
+  }
+
+  // All indexes are given back on destruction.
+  std::vector<Index> idxs;
+  while (const Index i = shared.pop())
+    idxs.push_back(i);
+
+  std::sort(std::begin(idxs), std::end(idxs));
+  if (std::adjacent_find(std::begin(idxs), std::end(idxs)) != std::end(idxs))
+    return false;
+
+  return idxs.size() == n - 1;
+}
+
+template <template <class, class> class Stack>
+bool test_shared_header()
+{
+  using node_type = rt::set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type, Stack>;
+  using set_type = rt::set<int, std::less<int>, alloc_type>;
+
+  const int n = 1000;
+  std::vector<node_type> buffer(4 * n);
+  rt::node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+
+  // Links the buffer before it is shared.
+  set_type s1(alloc);
+  set_type s2(alloc);
+  auto func = [&](set_type& s, int first)
+  {
+    for (int i = 0; i < n; ++i)
+      s.insert(first + i);
+  };
+
+  std::thread t1(func, std::ref(s1), 0);
+  std::thread t2(func, std::ref(s2), n);
+  t1.join();
+  t2.join();
+
+  std::vector<int> tmp;
+  std::copy(std::begin(s1), std::end(s1), std::back_inserter(tmp));
+  std::copy(std::begin(s2), std::end(s2), std::back_inserter(tmp));
+  if ((int) tmp.size() != 2 * n)
+    return false;
+
+  for (int i = 0; i < 2 * n; ++i)
+    if (tmp[i] != i)
+      return false;
+
+  return true;
+}
+
+int main()
+{
+  try {
+    if (!test_single_thread())
+      return 1;
+
+    if (!test_many_threads())
+      return 1;
+
+    if (!test_batch())
+      return 1;
+
+    if (!test_magazine())
+      return 1;
+
+    if (!test_shared_header<rt::atomic_node_stack>())
+      return 1;
+
+    if (!test_shared_header<rt::magazine_node_stack>())
+      return 1;
+  } catch (const std::exception& e) {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
@@ -0,0 +1,206 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <rtcpp/utility/bench.hpp>
+#include <rtcpp/utility/perf_counter.hpp>
+
+bool test_stats()
+{
+  const rt::bench_stats s = rt::compute_stats({5, 1, 4, 2, 3});
+  if (s.median != 3 || s.min != 1 || s.max != 5 || s.mean != 3 || s.p99 != 5)
+    return false;
+  if (std::abs(s.stddev - std::sqrt(2.5)) > 1e-12)
+    return false;
+
+  if (rt::compute_stats({4, 1, 3, 2}).median != 2.5)
+    return false;
+
+  std::vector<double> v;
+  for (int i = 1; i <= 1000; ++i)
+    v.push_back(i);
+  if (rt::quantile(v, 0.99) != 990 || rt::quantile(v, 0) != 1 || rt::quantile(v, 1) != 1000)
+    return false;
+  return rt::compute_stats({}).max == 0;
+}
+
+bool test_options()
+{
+  char a0[] = "bench", a1[] = "10", a2[] = "--reps=3", a3[] = "--format=csv";
+  char a4[] = "20", a5[] = "--clock=tsc", a6[] = "--warmup=0";
+  char* argv[] = {a0, a1, a2, a3, a4, a5, a6, nullptr};
+  int argc = 7;
+  rt::bench_options opts;
+  if (!rt::parse_bench_options(argc, argv, opts))
+    return false;
+  if (argc != 3 || std::string(argv[1]) != "10" || std::string(argv[2]) != "20" || argv[3])
+    return false;
+  if ( opts.reps != 3 || opts.warmup != 0 || opts.format != rt::bench_format::csv
+    || opts.clock != rt::bench_clock::tsc)
+    return false;
+
+  char c1[] = "--counters=l1d_misses,dtlb_misses", c2[] = "--counters=all";
+  char* argv3[] = {a0, c1, nullptr};
+  int argc3 = 2;
+  if ( !rt::parse_bench_options(argc3, argv3, opts) || opts.counters.size() != 2
+    || opts.counters[1] != rt::perf_event::dtlb_misses)
+    return false;
+  char* argv4[] = {a0, c1, c2, nullptr};
+  int argc4 = 3;
+  if ( !rt::parse_bench_options(argc4, argv4, opts) || argc4 != 1
+    || opts.counters.size() != rt::perf_event_count)
+    return false;
+
+  const char* bad[] = { "--reps=0", "--reps=x", "--warmup=-1", "--format=xml", "--foo"
+                      , "--counters=", "--counters=cycles,", "--counters=misses" };
+  for (const char* b : bad) {
+    std::string s = b;
+    char* argv2[] = {a0, &s[0], nullptr};
+    int argc2 = 2;
+    rt::bench_options o;
+    if (rt::parse_bench_options(argc2, argv2, o))
+      return false;
+  }
+  return true;
+}
+
+bool test_runner()
+{
+  rt::bench_options opts;
+  opts.reps = 5;
+  opts.warmup = 2;
+  opts.format = rt::bench_format::csv;
+  rt::bench_runner r(opts);
+
+  int calls = 0;
+  int setups = 0;
+  r.run("loop, \"n\"", 100, [&]()
+  {
+    ++calls;
+    unsigned s = 0;
+    for (unsigned i = 0; i < 1000; ++i)
+      rt::do_not_optimize(s += i);
+  });
+  r.run("setup", 7, [&]() { ++setups; return std::vector<int>(10, 1); }
+       , [&](std::vector<int>& v) { if (v.size() != 10) setups = -100; v.clear(); });
+  if (calls != 7 || setups != 7 || r.results().size() != 2 || r.results()[0].reps != 5)
+    return false;
+  const rt::bench_stats& s = r.results()[0].stats;
+  if (!(s.min > 0 && s.min <= s.median && s.median <= s.p99 && s.p99 <= s.max))
+    return false;
+
+  std::ostringstream csv;
+  r.print(csv);
+  const std::string c = csv.str();
+  if (c.find("name,n,reps,median_ns,") != 0 || c.find("\"loop, \"\"n\"\"\",100,5,") == std::string::npos)
+    return false;
+
+  opts.format = rt::bench_format::json;
+  rt::bench_runner j(opts);
+  j.run("a\"b", 1, []{});
+  std::ostringstream json;
+  j.print(json);
+  if (json.str().find("[\n  {\"name\": \"a\\\"b\", \"n\": 1, \"reps\": 5,") != 0)
+    return false;
+
+  // The TSC clock against the steady one.
+  rt::stopwatch tsc(rt::bench_clock::tsc);
+  rt::stopwatch steady;
+  while (steady.elapsed_ns() < 2e6) {}
+  const double t = tsc.elapsed_ns();
+  return t > 1e6 && t < 1e8;
+}
+
+bool test_table()
+{
+  rt::bench_table t({"name", "kind"}, {{"threads", 0}, {"mops", 2}});
+  t.add({"a,b", "x"}, {4, 1.5});
+  t.add({"c"}, {1});
+  if (t.size() != 2)
+    return false;
+
+  std::ostringstream csv;
+  t.print(csv, rt::bench_format::csv);
+  if (csv.str() != "name,kind,threads,mops\n\"a,b\",x,4,1.50\nc,,1,0.00\n")
+    return false;
+
+  std::ostringstream json;
+  t.print(json, rt::bench_format::json);
+  if (json.str().find("[\n  {\"name\": \"a,b\", \"kind\": \"x\", \"threads\": 4, \"mops\": 1.50},\n") != 0)
+    return false;
+
+  std::ostringstream text;
+  t.print(text, rt::bench_format::text);
+  return text.str().find("name kind") == 0;
+}
+
+bool test_counters()
+{
+  rt::bench_options opts;
+  opts.reps = 3;
+  opts.counters = {rt::perf_event::instructions, rt::perf_event::l1d_misses};
+  rt::bench_runner r(opts);
+  r.run("loop", 1, []
+  {
+    unsigned s = 0;
+    for (unsigned i = 0; i < 100000; ++i)
+      rt::do_not_optimize(s += i);
+  });
+  const rt::bench_result& res = r.results()[0];
+  if (res.counts.size() != 2)
+    return false;
+  if (r.counters().valid(0) ? res.counts[0] < 100000 : res.counts[0] != 0)
+    return false;
+
+  std::ostringstream text;
+  r.print(text);
+  const std::string t = text.str();
+  for (std::size_t i = 0; i < 2; ++i) {
+    const std::string name = rt::perf_event_name(r.counters().event(i));
+    if (r.counters().valid(i) != (t.find(" " + name) < t.find('\n')))
+      return false;
+  }
+  return r.counters().valid(0) || t.find("Counters not available: instructions") != std::string::npos;
+}
+
+bool test_perf_counter()
+{
+  rt::perf_event e;
+  if (!rt::parse_perf_event("dtlb_misses", e) || e != rt::perf_event::dtlb_misses)
+    return false;
+  if (rt::parse_perf_event("dtlb", e))
+    return false;
+
+  // Where the counters are not available stop returns 0.
+  rt::perf_counter c(rt::perf_event::instructions);
+  c.start();
+  unsigned s = 0;
+  for (unsigned i = 0; i < 100000; ++i)
+    rt::do_not_optimize(s += i);
+  const std::uint64_t n = c.stop();
+  return c.valid() ? n >= 100000 : n == 0;
+}
+
+int main()
+{
+  if (!test_stats())
+    return 1;
+
+  if (!test_options())
+    return 1;
+
+  if (!test_runner())
+    return 1;
+
+  if (!test_table())
+    return 1;
+
+  if (!test_perf_counter())
+    return 1;
+
+  if (!test_counters())
+    return 1;
+
+  return 0;
+}
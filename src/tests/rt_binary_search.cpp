@@ -1,12 +1,61 @@
 #include <array>
+#include <deque>
 #include <vector>
 #include <limits>
 #include <algorithm>
+#include <functional>
 
 #include <rtcpp/utility/make_rand_data.hpp>
 #include <rtcpp/algorithm/insertion_sort.hpp>
 #include <rtcpp/algorithm/algorithm.hpp>
 
+// Compares with std::lower_bound for every key around the elements.
+template <class C, class Compare>
+bool same_bounds(const C& c, Compare comp)
+{
+  for (auto k: c) {
+    for (auto d: {-1, 0, 1}) {
+      const auto key = k + d;
+      auto it = rt::lower_bound(std::begin(c), std::end(c), key, comp);
+      if (it != std::lower_bound(std::begin(c), std::end(c), key, comp))
+        return false;
+    }
+  }
+  return true;
+}
+
+// All sizes around the SIMD window, with duplicates.
+bool test_int()
+{
+  for (int n = 0; n < 100; ++n) {
+    std::vector<int> data = rt::make_rand_data<int>(n, 1, n / 2 + 1, 1);
+    std::sort(std::begin(data), std::end(data));
+    if (!same_bounds(data, std::less<int>()))
+      return false;
+    const std::vector<int>& cdata = data;
+    auto it = rt::lower_bound(std::begin(cdata), std::end(cdata), 1 << 30);
+    if (it != std::end(cdata))
+      return false;
+    // Pointers to int take the SIMD path.
+    const int* p = cdata.data();
+    for (int k = -1; k <= n / 2 + 2; ++k)
+      if (rt::lower_bound(p, p + n, k) != std::lower_bound(p, p + n, k))
+        return false;
+    if (n && rt::lower_bound(p, p + n, std::numeric_limits<int>::min()) != p)
+      return false;
+  }
+  return true;
+}
+
+bool test_other()
+{
+  std::vector<int> data = rt::make_rand_data<int>(1000, 1, 300, 1);
+  std::sort(std::begin(data), std::end(data), std::greater<int>());
+  std::deque<double> d(std::begin(data), std::end(data));
+  return same_bounds(data, std::greater<int>())
+      && same_bounds(d, std::greater<double>());
+}
+
 int main()
 {
   std::array<int, 10> data = {1, 20, 32, 44, 51, 69, 70, 87, 91, 101};
@@ -21,6 +70,9 @@ int main()
     if (rt::binary_search(std::begin(data), std::end(data), 10))
       return 1;
 
+  if (!test_int() || !test_other())
+    return 1;
+
   return 0;
 }
 
@@ -0,0 +1,180 @@
+#include <set>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/btree_set.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+template <class C>
+bool check(const C& t1, const std::set<typename C::value_type>& ref)
+{
+  if (t1.size() != ref.size())
+    return false;
+
+  if (!std::equal(std::begin(t1), std::end(t1), std::begin(ref)))
+    return false;
+
+  if (std::distance(std::begin(t1), std::end(t1)) !=
+      static_cast<std::ptrdiff_t>(ref.size()))
+    return false;
+
+  return std::equal(t1.rbegin(), t1.rend(), ref.rbegin());
+}
+
+template <class C>
+bool test_random(C& t1, const std::vector<int>& data)
+{
+  std::set<int> ref;
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<std::size_t> dist(0, data.size() - 1);
+
+  for (std::size_t i = 0; i < 4 * data.size(); ++i) {
+    const int v = data[dist(gen)];
+    if (gen() % 3 == 0) {
+      if (t1.erase(v) != ref.erase(v))
+        return false;
+    } else {
+      auto pair = t1.insert(v);
+      if (*pair.first != v || pair.second != ref.insert(v).second)
+        return false;
+    }
+  }
+
+  if (!check(t1, ref))
+    return false;
+
+  for (auto o: data) {
+    auto iter = t1.find(o);
+    if (t1.count(o) != ref.count(o))
+      return false;
+    if (ref.count(o) && (iter == t1.end() || *iter != o))
+      return false;
+  }
+
+  C t2(t1);
+  if (t2 != t1)
+    return false;
+
+  C t3(std::move(t2));
+  if (t3 != t1 || !t2.empty())
+    return false;
+
+  // Removes everything in increasing and then random order.
+  for (auto o: ref)
+    t3.erase(o);
+
+  if (!t3.empty() || t3.begin() != t3.end())
+    return false;
+
+  for (auto o: data)
+    t1.erase(o);
+
+  return t1.empty() && t1.begin() == t1.end();
+}
+
+template <class C>
+bool test_sorted(C& t1, int n)
+{
+  std::set<int> ref;
+  for (int i = 0; i < n; ++i) {
+    t1.insert(i);
+    ref.insert(i);
+  }
+
+  for (int i = n; i > -n; --i) {
+    t1.insert(i);
+    ref.insert(i);
+  }
+
+  for (int i = -n + 1; i < n; i += 3) {
+    t1.erase(i);
+    ref.erase(i);
+  }
+
+  if (!check(t1, ref))
+    return false;
+
+  t1.clear();
+  return t1.empty();
+}
+
+bool test_bad_alloc()
+{
+  // Insertions that cannot get their nodes leave the set unchanged.
+  using node_type = rt::btree_set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  std::vector<node_type> buffer(20);
+  rt::node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  rt::btree_set<int, std::less<int>, alloc_type> t1(alloc);
+  std::set<int> ref;
+  try {
+    for (int i = 0;; ++i) {
+      t1.insert(i);
+      ref.insert(i);
+    }
+  } catch (const std::bad_alloc&) {
+  }
+
+  if (!check(t1, ref))
+    return false;
+
+  for (auto o: ref)
+    t1.erase(o);
+
+  return t1.empty();
+}
+
+int main()
+{
+  std::vector<int> data = rt::make_rand_data<int>(5000, 1, 1000000);
+
+  rt::btree_set<int> t1;
+  if (!test_random(t1, data))
+    return 1;
+
+  rt::btree_set<int, std::less<int>, std::allocator<int>, 64> t2;
+  if (!test_random(t2, data))
+    return 1;
+
+  if (!test_sorted(t2, 3000))
+    return 1;
+
+  using node_type = rt::btree_set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  using alloc32_type =
+    rt::node_allocator<int, node_type, rt::node_stack, std::uint32_t>;
+  using set32_type = rt::btree_set<int, std::less<int>, alloc32_type>;
+  static_assert( set32_type::node_type::inner_capacity
+               > node_type::inner_capacity
+               , "Compact links should give more children.");
+
+  std::vector<node_type> buffer1(1000);
+  rt::node_alloc_header header1(buffer1);
+  alloc_type alloc1(&header1);
+  rt::btree_set<int, std::less<int>, alloc_type> t3(alloc1);
+  if (!test_random(t3, data))
+    return 1;
+
+  if (!test_sorted(t3, 3000))
+    return 1;
+
+  std::vector<char> buffer2(128 * 1000);
+  rt::node_alloc_header header2(buffer2);
+  alloc32_type alloc2(&header2);
+  set32_type t4(alloc2);
+  if (!test_random(t4, data))
+    return 1;
+
+  if (!test_bad_alloc())
+    return 1;
+
+  return 0;
+}
+
@@ -0,0 +1,87 @@
+#include <set>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/bump_node_stack.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+bool test_stack()
+{
+  using T = std::array<std::size_t, 2>;
+  using Index = std::size_t;
+  const std::size_t n = 10;
+  const std::size_t fill = 0xabcdef;
+  std::vector<T> buffer(n, T {{fill, fill}});
+  rt::node_alloc_header header(buffer);
+
+  rt::bump_node_stack<T, Index> stack(&header);
+  // Only the first block is written.
+  for (std::size_t i = 1; i < n; ++i)
+    if (buffer[i][0] != fill || buffer[i][1] != fill)
+      return false;
+  if (stack.untouched() != n - 1)
+    return false;
+
+  // Never used blocks come in address order.
+  std::vector<Index> v;
+  for (std::size_t i = 0; i < 3; ++i)
+    v.push_back(stack.pop());
+  if (v != std::vector<Index>({2, 4, 6}) || stack.untouched() != n - 4)
+    return false;
+
+  // Released blocks are used first.
+  stack.push(4);
+  stack.push(2);
+  if (stack.pop() != 2 || stack.pop() != 4 || stack.pop() != 8)
+    return false;
+
+  std::size_t k = 0;
+  while (stack.pop())
+    ++k;
+  return k == n - 5 && stack.untouched() == 0 && stack.pop() == 0;
+}
+
+bool test_set()
+{
+  using node_type = rt::set<int>::node_type;
+  using alloc_type =
+    rt::node_allocator<int, node_type, rt::bump_node_stack>;
+  using set_type = rt::set<int, std::less<int>, alloc_type>;
+
+  const int n = 1000;
+  std::vector<int> data = rt::make_rand_data<int>(n, 1, 4 * n);
+  std::set<int> ref(std::begin(data), std::end(data));
+
+  std::vector<node_type> buffer(n + 2);
+  rt::node_alloc_header header(buffer);
+  const alloc_type alloc(&header);
+  set_type t1(alloc);
+  for (int k = 0; k < 3; ++k) {
+    t1.insert(std::begin(data), std::end(data));
+    if (!std::equal(std::begin(ref), std::end(ref), std::begin(t1)))
+      return false;
+    t1.clear();
+  }
+
+  // All blocks but the first and the head of the set can be used.
+  alloc_type::rebind<node_type>::other a(alloc);
+  std::size_t k = 0;
+  try {
+    for (;; ++k)
+      a.allocate_node();
+  } catch (const std::bad_alloc&) {
+  }
+  return k == buffer.size() - 2;
+}
+
+int main()
+{
+  if (!test_stack() || !test_set())
+    return 1;
+
+  return 0;
+}
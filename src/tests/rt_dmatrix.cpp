@@ -0,0 +1,134 @@
+#include <vector>
+#include <stdexcept>
+
+#include <rtcpp/container/dmatrix.hpp>
+#include <rtcpp/utility/thread_pool.hpp>
+
+// Small integers, so that the products are exact in float and double.
+template <typename T>
+rt::dmatrix<T> gen(std::size_t m, std::size_t n, std::size_t seed)
+{
+  rt::dmatrix<T> a(m, n);
+  for (std::size_t i = 0; i < m; ++i)
+    for (std::size_t j = 0; j < n; ++j)
+      a(i, j) = static_cast<T>((i * 7 + j * 3 + seed) % 9) - 4;
+  return a;
+}
+
+template <typename T>
+rt::dmatrix<T> naive_prod(const rt::dmatrix<T>& a, const rt::dmatrix<T>& b)
+{
+  rt::dmatrix<T> c(a.n_rows(), b.n_cols());
+  for (std::size_t i = 0; i < a.n_rows(); ++i)
+    for (std::size_t j = 0; j < b.n_cols(); ++j)
+      for (std::size_t k = 0; k < a.n_cols(); ++k)
+        c(i, j) += a(i, k) * b(k, j);
+  return c;
+}
+
+template <typename T>
+bool test_gemm()
+{
+  rt::thread_pool pool(3);
+  const std::size_t sizes[][3] =
+  { {1, 1, 1}, {7, 5, 3}, {4, 8, 16}, {33, 17, 65}, {130, 300, 9}
+  , {300, 257, 130}, {5, 600, 520}, {0, 3, 4}, {3, 0, 4} };
+  for (const auto& s : sizes) {
+    const rt::dmatrix<T> a = gen<T>(s[0], s[1], 1);
+    const rt::dmatrix<T> b = gen<T>(s[1], s[2], 2);
+    const rt::dmatrix<T> c = naive_prod(a, b);
+
+    const rt::dmatrix<T> d = a * b;
+    if (d != c)
+      return false;
+
+    rt::dmatrix<T> e;
+    rt::gemm(a, b, e);
+    if (e != c)
+      return false;
+
+    rt::dmatrix<T> f(2, 2, T(1));
+    rt::gemm(pool, a, b, f);
+    if (f != c)
+      return false;
+  }
+  return true;
+}
+
+bool test_expr()
+{
+  const rt::dmatrix<int> a(2, 2, {1, 2, 3, 4});
+  const rt::matrix<int, 2, 2> b = {1, 0, 2, 1};
+
+  // Mixed with static sizes.
+  const rt::matrix<int, 2, 2> c = a * b + 2 * a - b;
+  const rt::matrix<int, 2, 2> r = {6, 6, 15, 11};
+  if (c != r)
+    return false;
+
+  rt::dmatrix<int> d = b * a * a;
+  if (d.n_rows() != 2 || d.n_cols() != 2 || d != rt::dmatrix<int>(2, 2, {7, 10, 29, 42}))
+    return false;
+
+  // The expression contains the result.
+  d = d * a - d;
+  if (d != rt::dmatrix<int>(2, 2, {30, 44, 126, 184}))
+    return false;
+
+  d += a;
+  d *= 2;
+  if (d != rt::dmatrix<int>(2, 2, {62, 92, 258, 376}))
+    return false;
+
+  const rt::dmatrix<int> t = transpose(rt::dmatrix<int>(2, 3, {1, 2, 3, 4, 5, 6}));
+  if (t != rt::dmatrix<int>(3, 2, {1, 4, 2, 5, 3, 6}))
+    return false;
+
+  const rt::matrix<int, 2, 1> v = {1, 1};
+  const rt::matrix<int, 3, 1> w = t * v;
+  if (w != rt::matrix<int, 3, 1>{5, 7, 9})
+    return false;
+  return true;
+}
+
+bool test_mismatch()
+{
+  const rt::dmatrix<int> a(2, 3);
+  const rt::dmatrix<int> b(2, 3);
+  const rt::matrix<int, 2, 2> c;
+  try {
+    const rt::dmatrix<int> d = a * b;
+    (void) d;
+    return false;
+  } catch (const std::runtime_error&) {}
+  try {
+    const rt::dmatrix<int> d = a + c;
+    (void) d;
+    return false;
+  } catch (const std::runtime_error&) {}
+  try {
+    const rt::matrix<int, 2, 2> d = a - b;
+    (void) d;
+    return false;
+  } catch (const std::runtime_error&) {}
+  try {
+    rt::dmatrix<int> d;
+    rt::gemm(a, b, d);
+    return false;
+  } catch (const std::runtime_error&) {}
+  return true;
+}
+
+int main()
+{
+  if (!test_gemm<float>() || !test_gemm<double>() || !test_gemm<int>())
+    return 1;
+
+  if (!test_expr())
+    return 1;
+
+  if (!test_mismatch())
+    return 1;
+
+  return 0;
+}
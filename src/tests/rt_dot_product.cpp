@@ -0,0 +1,69 @@
+#include <vector>
+#include <numeric>
+
+#include <rtcpp/algorithm/snorm.hpp>
+#include <rtcpp/algorithm/dot_product.hpp>
+
+// Small integers, so that the float sums are exact in any order.
+template <typename T>
+std::vector<T> gen(std::size_t n, std::size_t seed)
+{
+  std::vector<T> v(n);
+  for (std::size_t i = 0; i < n; ++i)
+    v[i] = static_cast<T>((i * 5 + seed) % 7) - 3;
+  return v;
+}
+
+template <typename T, std::size_t N>
+bool test_static()
+{
+  const std::vector<T> a = gen<T>(N, 1);
+  const std::vector<T> b = gen<T>(N, 2);
+  const T r = std::inner_product(a.begin(), a.end(), b.begin(), T(0));
+  return rt::dot_product<N>(a.data(), b.data()) == r
+      && rt::dot_product<N>(a.begin(), b.begin()) == r
+      && rt::snorm<N>(a.begin()) == std::inner_product(a.begin(), a.end(), a.begin(), T(0));
+}
+
+template <typename T>
+bool test_runtime()
+{
+  for (std::size_t n = 0; n < 100; ++n) {
+    const std::vector<T> a = gen<T>(n, 1);
+    const std::vector<T> b = gen<T>(n, 2);
+    const T r = std::inner_product(a.begin(), a.end(), b.begin(), T(0));
+    if (rt::dot_product(a.data(), b.data(), n) != r)
+      return false;
+    if (rt::dot_product(a.begin(), b.begin(), n) != r)
+      return false;
+    if (rt::snorm(a.data(), n) != std::inner_product(a.begin(), a.end(), a.begin(), T(0)))
+      return false;
+    // Offsets not aligned to the simd rows.
+    if (n > 2 && rt::dot_product(a.data() + 1, b.data() + 2, n - 2)
+        != std::inner_product(a.begin() + 1, a.end() - 1, b.begin() + 2, T(0)))
+      return false;
+  }
+  return true;
+}
+
+template <typename T>
+bool test_all()
+{
+  return test_static<T, 1>() && test_static<T, 2>() && test_static<T, 3>()
+      && test_static<T, 4>() && test_static<T, 7>() && test_static<T, 16>()
+      && test_static<T, 33>() && test_static<T, 100>() && test_runtime<T>();
+}
+
+constexpr int a5[] = {1, 2, 3, 4, 5};
+static_assert(rt::dot_product<5>(a5, a5) == 55, "");
+static_assert(rt::dot_product(a5, a5 + 1, 4) == 40, "");
+constexpr double d6[] = {0.5, 1, 1.5, 2, 2.5, 3};
+static_assert(rt::snorm(d6, 6) == 22.75, "");
+
+int main()
+{
+  if (!test_all<float>() || !test_all<double>() || !test_all<int>())
+    return 1;
+
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include <string>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/memory/align.hpp>
+#include <rtcpp/container/eytzinger_array.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+// Compares with std::lower_bound on the sorted range.
+template <class E, class C, class K>
+bool same_bound(const E& e, const C& sorted, const K& key)
+{
+  auto it = e.lower_bound(key);
+  auto ref = std::lower_bound( std::begin(sorted), std::end(sorted), key
+                             , e.key_comp());
+  if (ref == std::end(sorted))
+    return it == e.end() && !e.contains(key);
+  return it != e.end() && *it == *ref
+      && e.contains(key) == !e.key_comp()(key, *ref);
+}
+
+bool test_sizes()
+{
+  for (int n = 0; n < 200; ++n) {
+    std::vector<int> data = rt::make_rand_data<int>(n, 1, 2 * n + 1);
+    std::sort(std::begin(data), std::end(data));
+    data.erase(std::unique(std::begin(data), std::end(data)), std::end(data));
+    const rt::eytzinger_array<int> e(std::begin(data), std::end(data));
+    if (e.size() != data.size())
+      return false;
+    if (reinterpret_cast<std::uintptr_t>(&e[0] + 0) % rt::cache_line_size)
+      return false;
+    // Same elements, in another order.
+    std::vector<int> tmp(std::begin(e), std::end(e));
+    std::sort(std::begin(tmp), std::end(tmp));
+    if (tmp != data)
+      return false;
+    for (int k = 0; k <= 2 * n + 2; ++k)
+      if (!same_bound(e, data, k))
+        return false;
+    // Children of k are at 2k and 2k + 1.
+    for (std::size_t k = 2; k <= e.size(); ++k)
+      if ((e[k] < e[k / 2]) != (k % 2 == 0))
+        return false;
+  }
+  return true;
+}
+
+bool test_copy()
+{
+  std::vector<std::string> data {"e", "d", "c", "b", "a"};
+  using array_type = rt::eytzinger_array<std::string, std::greater<std::string>>;
+  const array_type e1(std::begin(data), std::end(data));
+  array_type e2;
+  if (!e2.empty() || e2.lower_bound("a") != e2.end())
+    return false;
+  e2 = e1;
+  const array_type e3(e2);
+  for (const auto& k: {"a", "bb", "c", "f", "0"})
+    if (!same_bound(e3, data, std::string(k)))
+      return false;
+  return e3.index(e3.find("b")) != 0 && e3.find("bb") == e3.end();
+}
+
+int main()
+{
+  if (!test_sizes())
+    return 1;
+  if (!test_copy())
+    return 1;
+
+  return 0;
+}
+
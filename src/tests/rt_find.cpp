@@ -0,0 +1,111 @@
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+
+#include <rtcpp/algorithm/find.hpp>
+
+// Every size around the vector widths, the key at every position,
+// several matches and none.
+template <class T>
+bool test_type()
+{
+  for (std::size_t n = 0; n < 80; ++n) {
+    std::vector<T> v(n);
+    for (std::size_t i = 0; i < n; ++i)
+      v[i] = static_cast<T>(i % 50 + 1);
+    const T* p = v.data();
+    for (std::size_t i = 0; i <= n; ++i) {
+      const T key = i < n ? v[i] : T(0);
+      if (rt::find(p, p + n, key) != std::find(p, p + n, key))
+        return false;
+      if (rt::count(p, p + n, key) != std::count(p, p + n, key))
+        return false;
+    }
+    // Matches in all elements.
+    std::vector<T> w(n, T(7));
+    if (rt::count(w.data(), w.data() + n, T(7)) != static_cast<std::ptrdiff_t>(n))
+      return false;
+    if (rt::find(w.data(), w.data() + n, T(7)) != w.data())
+      return false;
+#if defined(RTCPP_FIND_AVX2)
+    // The kernels not chosen on this machine.
+    if (rt::detail::find16(p, n, T(3)) != std::find(p, p + n, T(3)))
+      return false;
+    if (rt::detail::count16(w.data(), n, T(7)) != n)
+      return false;
+    if (rt::detail::cpu_has_avx2()) {
+      if (rt::detail::find32(p, n, T(3)) != std::find(p, p + n, T(3)))
+        return false;
+      if (rt::detail::count32(w.data(), n, T(7)) != n)
+        return false;
+    }
+#endif
+  }
+  return true;
+}
+
+// Keys of another type compare as with ==.
+bool test_mixed_keys()
+{
+  const unsigned char u[] = {1, 200, 255, 3, 255};
+  if (rt::find(u, u + 5, 255) != u + 2 || rt::count(u, u + 5, 255) != 2)
+    return false;
+  if (rt::find(u, u + 5, -1) != u + 5 || rt::count(u, u + 5, 511) != 0)
+    return false;
+  const signed char s[] = {5, -1, 0, -1};
+  if (rt::find(s, s + 4, -1L) != s + 1 || rt::count(s, s + 4, 255u) != 0)
+    return false;
+  const unsigned w[] = {1, 4294967295u, 2};
+  if (rt::find(w, w + 3, -1) != w + 1)
+    return false;
+  const std::int64_t l[] = {0, std::numeric_limits<std::int64_t>::min(), -1, 4294967295};
+  return rt::find(l, l + 4, -1) == l + 2 && rt::find(l, l + 4, 4294967295u) == l + 3
+      && rt::find(l, l + 4, std::numeric_limits<std::int64_t>::min()) == l + 1;
+}
+
+bool test_floating()
+{
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  std::vector<double> d(37, nan);
+  d[20] = -0.0;
+  d[30] = 0.0;
+  if (rt::find(d.data(), d.data() + d.size(), 0.0) != d.data() + 20)
+    return false;
+  if (rt::count(d.data(), d.data() + d.size(), nan) != 0)
+    return false;
+  std::vector<float> f(19, 1.5f);
+  f[18] = -0.0f;
+  return rt::count(f.data(), f.data() + f.size(), 0.0f) == 1
+      && rt::find(f.data(), f.data() + f.size(), 1.5f) == f.data();
+}
+
+// Other iterators go to the std algorithms.
+bool test_iterators()
+{
+  std::vector<bool> b = {false, false, true, true};
+  const int a[] = {1, 2, 3, 2};
+  return rt::find(std::begin(b), std::end(b), true) == std::begin(b) + 2
+      && rt::count(std::begin(b), std::end(b), true) == 2
+      && rt::find(std::rbegin(a), std::rend(a), 2) == std::rbegin(a)
+      && rt::count(std::begin(a), std::end(a), 2) == 2;
+}
+
+int main()
+{
+  if (!test_type<char>() || !test_type<std::uint8_t>() || !test_type<std::int16_t>()
+      || !test_type<int>() || !test_type<std::uint32_t>()
+      || !test_type<std::int64_t>() || !test_type<std::uint64_t>()
+      || !test_type<float>() || !test_type<double>())
+    return 1;
+  if (!test_mixed_keys())
+    return 1;
+  if (!test_floating())
+    return 1;
+  if (!test_iterators())
+    return 1;
+
+  return 0;
+}
+
@@ -0,0 +1,188 @@
+#include <map>
+#include <set>
+#include <array>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+
+#include <rtcpp/container/flat_hash_set.hpp>
+#include <rtcpp/container/flat_hash_map.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+// Counts the tables requested, see test_reserve.
+static std::size_t n_allocs = 0;
+
+template <class T>
+struct counting_allocator : std::allocator<T> {
+  template <class U>
+  struct rebind { using other = counting_allocator<U>; };
+  counting_allocator() = default;
+  template <class U>
+  counting_allocator(const counting_allocator<U>&) noexcept {}
+  T* allocate(std::size_t n)
+  {
+    ++n_allocs;
+    return std::allocator<T>::allocate(n);
+  }
+};
+
+template <class S, class T>
+bool same_elements(const S& s, const std::set<T>& ref)
+{
+  std::vector<T> v(std::begin(s), std::end(s));
+  std::sort(std::begin(v), std::end(v));
+  return s.size() == ref.size()
+      && std::equal(std::begin(v), std::end(v), std::begin(ref), std::end(ref));
+}
+
+// Inserts and erases at random, which leaves tombstones behind.
+template <class S, class T>
+bool churn(S& s, std::set<T>& ref, const std::vector<T>& data, std::size_t max_size)
+{
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    const T& k = data[i];
+    if (i % 3 == 2 || ref.size() == max_size) {
+      if (s.erase(k) != ref.erase(k))
+        return false;
+    } else {
+      const auto pair = s.insert(k);
+      if (pair.second != ref.insert(k).second || *pair.first != k)
+        return false;
+    }
+  }
+  for (const T& k: data)
+    if (s.count(k) != ref.count(k))
+      return false;
+  return same_elements(s, ref);
+}
+
+template <class S, class T>
+bool test_set(S& s, const std::vector<T>& data, std::size_t max_size)
+{
+  std::set<T> ref;
+  if (!churn(s, ref, data, max_size))
+    return false;
+
+  // Erasing by position returns the next element.
+  for (auto iter = s.begin(); iter != s.end();) {
+    if (std::hash<T>()(*iter) % 2) {
+      ref.erase(*iter);
+      iter = s.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+  if (!same_elements(s, ref))
+    return false;
+
+  // The copy has its own memory.
+  S copy(s);
+  if (copy != s || !same_elements(copy, ref))
+    return false;
+  S moved(std::move(copy));
+  if (!copy.empty() || copy.begin() != copy.end() || moved != s)
+    return false;
+
+  s.clear();
+  return s.empty() && s.begin() == s.end() && !s.count(data[0]);
+}
+
+std::vector<std::string> to_strings(const std::vector<int>& data)
+{
+  std::vector<std::string> v;
+  for (int k: data)
+    v.push_back(std::to_string(k) + "-long-enough-to-allocate");
+  return v;
+}
+
+bool test_buffer(const std::vector<int>& data)
+{
+  // Room for n elements, the churn rehashes in place several times.
+  const std::size_t n = 300;
+  using set_type = rt::flat_hash_set<int>;
+  std::vector<char> buffer(set_type::bytes_for(n));
+  set_type s(buffer);
+  if (s.capacity() * 14 / 16 < n)
+    return false;
+  for (int i = 0; i < 5; ++i)
+    if (!test_set(s, data, n))
+      return false;
+
+  // Until it is full.
+  try {
+    for (int i = 0; ; ++i)
+      s.insert(i);
+  } catch (const std::bad_alloc&) {
+  }
+  if (s.size() < n)
+    return false;
+
+  std::array<std::uint64_t, 512> buffer2;
+  rt::flat_hash_set<std::string> s2(buffer2);
+  return test_set(s2, to_strings(data), 40);
+}
+
+bool test_reserve(const std::vector<int>& data)
+{
+  using set_type = rt::flat_hash_set< int, std::hash<int>, std::equal_to<int>
+                                    , counting_allocator<int>>;
+  const std::size_t n = 1000;
+  set_type s;
+  s.reserve(n);
+  const std::size_t allocs = n_allocs;
+  std::set<int> ref;
+  return churn(s, ref, data, n) && n_allocs == allocs;
+}
+
+bool test_map(const std::vector<int>& data)
+{
+  rt::flat_hash_map<int, std::string> m;
+  std::map<int, std::string> ref;
+  for (int k: data) {
+    m[k] += "a";
+    ref[k] += "a";
+  }
+  if (m.size() != ref.size())
+    return false;
+  for (const auto& p: ref)
+    if (m.at(p.first) != p.second)
+      return false;
+
+  if (m.try_emplace(data[0], "b").second || m.at(data[0]) == "b")
+    return false;
+  m.insert_or_assign(data[0], "b");
+  if (m.at(data[0]) != "b" || !m.try_emplace(-1, 3, 'c').second || m.at(-1) != "ccc")
+    return false;
+
+  for (auto& p: m)
+    p.second = std::to_string(p.first);
+  for (const auto& p: m)
+    if (p.second != std::to_string(p.first))
+      return false;
+
+  try {
+    m.at(-2);
+    return false;
+  } catch (const std::out_of_range&) {
+  }
+  return m.erase(-1) == 1 && m.size() == ref.size();
+}
+
+int main()
+{
+  const std::vector<int> data = rt::make_rand_data<int>(5000, 1, 1500);
+
+  rt::flat_hash_set<int> s1;
+  if (!test_set(s1, data, data.size()))
+    return 1;
+
+  rt::flat_hash_set<std::string> s2;
+  if (!test_set(s2, to_strings(data), data.size()))
+    return 1;
+
+  if (!test_buffer(data) || !test_reserve(data) || !test_map(data))
+    return 1;
+
+  return 0;
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <vector>
+#include <numeric>
 #include <random>
 #include <algorithm>
 #include <functional>
@@ -7,6 +8,7 @@
 #include <rtcpp/utility/make_rand_data.hpp>
 #include <rtcpp/utility/print.hpp>
 #include <rtcpp/container/forward_list.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
 
 using namespace rt;
 
@@ -72,6 +74,260 @@ int foo::n_mv_ctor = 0;
 int foo::n_copy_assignment = 0;
 int foo::n_mv_assignment = 0;
 
+bool test_for_each_unordered()
+{
+  using node_type = forward_list<int>::node_type;
+  using alloc_type = node_allocator<int, node_type>;
+  const int n = 100;
+  std::vector<node_type> buffer(n + 1);
+  node_alloc_header header(buffer);
+  std::vector<std::uint64_t> bitmap(header.bitmap_words(sizeof (node_type)));
+  header.use_bitmap(bitmap);
+
+  alloc_type alloc(&header);
+  forward_list<int, alloc_type> l(alloc);
+  for (int i = 0; i < n; ++i)
+    l.push_front(i % 7);
+
+  l.remove_if(3);
+
+  int acc = 0;
+  l.for_each_unordered([&](int o){ acc += o; });
+  return acc == std::accumulate(std::begin(l), std::end(l), 0);
+}
+
+bool test_splice_after()
+{
+  // Nodes move between lists sharing the buffer, which is full.
+  using node_type = forward_list<int>::node_type;
+  using alloc_type = node_allocator<int, node_type>;
+  std::vector<node_type> buffer(7);
+  node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  forward_list<int, alloc_type> l1(alloc);
+  forward_list<int, alloc_type> l2(alloc);
+  for (int i = 3; i > 0; --i) {
+    l1.push_front(i);
+    l2.push_front(10 * i);
+  }
+
+  // l1: 1 2 3, l2: 10 20 30
+  l1.splice_after(l1.cbegin(), l2, l2.cbegin());
+  std::vector<int> r1 = {1, 20, 2, 3};
+  std::vector<int> r2 = {10, 30};
+  if (!std::equal(std::begin(r1), std::end(r1), std::begin(l1)))
+    return false;
+  if (!std::equal(std::begin(r2), std::end(r2), std::begin(l2)))
+    return false;
+
+  // The last element has nothing after it.
+  auto last = std::next(l2.cbegin());
+  l1.splice_after(l1.cbegin(), l2, last);
+  if (std::distance(std::begin(l2), std::end(l2)) != 2)
+    return false;
+
+  l2.splice_after(l2.cbefore_begin(), l1);
+  std::vector<int> r3 = {1, 20, 2, 3, 10, 30};
+  if (!l1.empty() || !std::equal(std::begin(r3), std::end(r3), std::begin(l2)))
+    return false;
+
+  // Moves (1, 3) to an empty list.
+  auto first = l2.cbegin();
+  auto end = std::next(first, 3);
+  l1.splice_after(l1.cbefore_begin(), l2, first, end);
+  std::vector<int> r4 = {20, 2};
+  std::vector<int> r5 = {1, 3, 10, 30};
+  if (!std::equal(std::begin(r4), std::end(r4), std::begin(l1)))
+    return false;
+  return std::equal(std::begin(r5), std::end(r5), std::begin(l2))
+      && std::distance(std::begin(l2), std::end(l2)) == 4;
+}
+
+template <class L>
+bool test_merge_sort(L& l, const std::vector<int>& data)
+{
+  // Pairs of key and position, equal keys must keep their order.
+  using value_type = std::pair<int, int>;
+  auto comp = [](const value_type& a, const value_type& b)
+  { return a.first < b.first; };
+  std::vector<value_type> ref;
+  for (std::size_t i = 0; i < data.size(); ++i)
+    ref.push_back(std::make_pair(data[i] % 100, static_cast<int>(i)));
+
+  for (auto iter = ref.rbegin(); iter != ref.rend(); ++iter)
+    l.push_front(*iter);
+
+  l.sort(comp);
+  std::stable_sort(std::begin(ref), std::end(ref), comp);
+  if (!std::equal(std::begin(ref), std::end(ref), std::begin(l)))
+    return false;
+
+  // After relayout a traversal walks the buffer forward.
+  l.relayout();
+  if (!std::equal(std::begin(ref), std::end(ref), std::begin(l)))
+    return false;
+  const value_type* prev = 0;
+  for (auto& o: l) {
+    if (prev && &o < prev)
+      return false;
+    prev = &o;
+  }
+
+  // The other list's elements go after the equal ones of this list.
+  L other(l.get_allocator());
+  std::vector<value_type> tmp;
+  for (int i = 0; i < 150; i += 3)
+    tmp.push_back(std::make_pair(i % 110, -1));
+  std::stable_sort(std::begin(tmp), std::end(tmp), comp);
+  for (auto iter = tmp.rbegin(); iter != tmp.rend(); ++iter)
+    other.push_front(*iter);
+
+  std::vector<value_type> merged;
+  std::merge( std::begin(ref), std::end(ref), std::begin(tmp), std::end(tmp)
+            , std::back_inserter(merged), comp);
+  l.merge(other, comp);
+  if (!other.empty()
+      || !std::equal(std::begin(merged), std::end(merged), std::begin(l))
+      || std::distance(std::begin(l), std::end(l))
+         != static_cast<std::ptrdiff_t>(merged.size()))
+    return false;
+
+  l.clear();
+  l.sort(comp);
+  l.merge(other, comp);
+  return l.empty();
+}
+
+bool test_merge_sort()
+{
+  std::vector<int> data = make_rand_data<int>(10000, 1, 1000000);
+  using value_type = std::pair<int, int>;
+  forward_list<value_type> l1;
+  if (!test_merge_sort(l1, data))
+    return false;
+
+  // Relative links, the head is in the buffer as well.
+  using node_type32 =
+    forward_list_node<value_type, rel_ptr<void, std::int32_t>>;
+  using alloc_type32 =
+    node_allocator<value_type, node_type32, node_stack, std::uint32_t>;
+  std::vector<node_type32> buffer(2 * data.size());
+  node_alloc_header header(buffer);
+  alloc_type32 alloc(&header);
+  forward_list<value_type, alloc_type32> l2(alloc);
+  return test_merge_sort(l2, data);
+}
+
+// Blocks left in the avail stack of the header of alloc.
+template <class Node, class Alloc>
+std::size_t count_free_blocks(const Alloc& alloc)
+{
+  typename Alloc::template rebind<Node>::other a(alloc);
+  std::vector<Node*> blocks;
+  try {
+    for (;;)
+      blocks.push_back(a.allocate_node());
+  } catch (const std::bad_alloc&) {}
+  for (auto iter = blocks.rbegin(); iter != blocks.rend(); ++iter)
+    a.deallocate_node(*iter);
+  return blocks.size();
+}
+
+// Churns a list alone in its buffer and compacts it a few nodes at a
+// time.
+template <class L>
+bool test_compaction(L& l, const node_alloc_header& header, std::size_t budget)
+{
+  using node_type = typename L::node_type;
+  const std::vector<int> data = make_rand_data<int>(2000, 1, 1000000);
+  std::vector<int> ref;
+  auto churn = [&]()
+  {
+    for (auto o: data)
+      l.push_front(o);
+    for (std::size_t i = 0; i < 100; ++i)
+      l.remove_if(data[i * 7]);
+    auto iter = l.begin();
+    for (int i = 0; iter != l.end(); ++iter, ++i)
+      if (i % 5 == 0)
+        iter = l.insert_after(iter, -i);
+    ref.assign(std::begin(l), std::end(l));
+  };
+
+  // The head, if allocated, and then the nodes in list order from block
+  // 0, the next allocation takes the block after them.
+  const char* first = header.buffer + header.block_size;
+  auto at = [&](std::size_t k)
+  { return reinterpret_cast<const node_type*>(first + k * header.block_size); };
+  auto compacted = [&]()
+  {
+    std::size_t k = 0;
+    if (!std::is_pointer<typename L::void_pointer>::value
+        && l.before_begin().get_internal_ptr() != at(k++))
+      return false;
+    for (auto iter = l.begin(); iter != l.end(); ++iter, ++k)
+      if (iter.get_internal_ptr() != at(k))
+        return false;
+    l.push_front(-1);
+    const bool next = l.begin().get_internal_ptr() == at(k);
+    l.remove_if(-1);
+    return next && std::equal(std::begin(ref), std::end(ref), std::begin(l));
+  };
+
+  churn();
+  std::size_t n_free = count_free_blocks<node_type>(l.get_allocator());
+  {
+    typename L::compaction c(l);
+    while (!c.step(budget))
+      if (!std::equal(std::begin(ref), std::end(ref), std::begin(l)))
+        return false;
+  }
+  if (!compacted() || count_free_blocks<node_type>(l.get_allocator()) != n_free)
+    return false;
+
+  // Abandoned halfway, the free blocks are given back.
+  churn();
+  n_free = count_free_blocks<node_type>(l.get_allocator());
+  {
+    typename L::compaction c(l);
+    c.step(ref.size() + n_free + ref.size() / 2);
+  }
+  if (count_free_blocks<node_type>(l.get_allocator()) != n_free
+      || !std::equal(std::begin(ref), std::end(ref), std::begin(l)))
+    return false;
+
+  l.compact();
+  if (!compacted())
+    return false;
+
+  l.clear();
+  ref.clear();
+  l.compact();
+  return compacted();
+}
+
+bool test_compaction()
+{
+  using node_type = forward_list<int>::node_type;
+  using alloc_type = node_allocator<int, node_type>;
+  std::vector<char> buffer(8000 * sizeof (node_type));
+  node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  forward_list<int, alloc_type> l1(alloc);
+  if (!test_compaction(l1, header, 9))
+    return false;
+
+  // The head is in the buffer and moves as well.
+  using node_type32 = forward_list_node<int, rel_ptr<void, std::int32_t>>;
+  using alloc_type32 =
+    node_allocator<int, node_type32, node_stack, std::uint32_t>;
+  std::vector<char> buffer2(8000 * sizeof (node_type32));
+  node_alloc_header header2(buffer2);
+  alloc_type32 alloc2(&header2);
+  forward_list<int, alloc_type32> l2(alloc2);
+  return test_compaction(l2, header2, 1);
+}
+
 bool test_push_front_copy()
 {
   std::cout << "test_push_front_copy" << std::endl;
@@ -179,6 +435,12 @@ int main()
   l.remove_if(2);
   l.remove_if(4);
 
+  const int total = std::accumulate(std::begin(l), std::end(l), 0);
+  int acc = 0;
+  l.for_each_unordered([&](int o){ acc += o; });
+  if (acc != total)
+    return 1;
+
   l.clear();
   if (!l.empty())
     return 1;
@@ -188,6 +450,18 @@ int main()
 
   if (!test_push_front_move())
     return 1;
+
+  if (!test_for_each_unordered())
+    return 1;
+
+  if (!test_splice_after())
+    return 1;
+
+  if (!test_merge_sort())
+    return 1;
+
+  if (!test_compaction())
+    return 1;
   
   l.clear();
   l.insert_after(l.begin(), 3, 10);
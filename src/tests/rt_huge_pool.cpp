@@ -0,0 +1,117 @@
+#include <set>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/memory/huge_pool.hpp>
+#include <rtcpp/memory/numa_pools.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/atomic_node_stack.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+using node_type = rt::set<int>::node_type;
+using alloc_type = rt::node_allocator<int, node_type, rt::atomic_node_stack>;
+using node_alloc_type = alloc_type::rebind<node_type>::other;
+using set_type = rt::set<int, std::less<int>, alloc_type>;
+
+bool fill(rt::node_alloc_header& header, int n)
+{
+  std::vector<int> data = rt::make_rand_data<int>(n, 1, 1000000);
+  std::set<int> ref(std::begin(data), std::end(data));
+  const alloc_type alloc(&header);
+  set_type s(alloc);
+  s.insert(std::begin(data), std::end(data));
+  return std::equal(std::begin(ref), std::end(ref), std::begin(s))
+      && s.size() == ref.size();
+}
+
+bool test_pool()
+{
+  // Rounded to a huge page, which may or may not be available.
+  rt::huge_pool pool(1000);
+  if (pool.size() != rt::huge_pool::huge_page_size)
+    return false;
+  std::cout << "Huge pages: " << pool.huge_pages() << std::endl;
+
+  const std::size_t n = pool.size() / sizeof (node_type);
+  if (!fill(pool.header(), static_cast<int>(n / 2)))
+    return false;
+
+  // Small pages, no rounding.
+  rt::huge_pool small(4096 * 3, rt::huge_pool::prefault);
+  return !small.huge_pages() && small.size() == 4096 * 3
+      && fill(small.header(), 100);
+}
+
+// Binding and locking depend on the system, e.g. RLIMIT_MEMLOCK.
+bool test_optional()
+{
+  const int node = static_cast<int>(rt::numa_pools::current_node());
+  const unsigned opts = rt::huge_pool::defaults | rt::huge_pool::lock;
+  try {
+    rt::huge_pool pool(1 << 16, opts, node);
+    return pool.numa_node() == node && fill(pool.header(), 1000);
+  } catch (const std::exception& e) {
+    std::cout << e.what() << std::endl;
+  }
+  return true;
+}
+
+bool test_numa_pools()
+{
+  rt::numa_pools pools(1 << 20);
+  if (pools.size() != rt::numa_pools::n_nodes() || pools.size() == 0)
+    return false;
+
+  // Links the pools before the threads share them.
+  std::vector<node_alloc_type> allocs;
+  for (std::size_t i = 0; i < pools.size(); ++i)
+    allocs.push_back(node_alloc_type(alloc_type(&pools.header(i))));
+
+  const int n_threads = 4;
+  std::vector<int> ok(n_threads, 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&, t]()
+    {
+      rt::node_alloc_header& h = pools.local();
+      const std::size_t i = static_cast<std::size_t>(&h - &pools.header(0));
+      node_alloc_type a(allocs[i]);
+      std::vector<node_type*> nodes;
+      for (int j = 0; j < 1000; ++j)
+        nodes.push_back(a.allocate_node());
+      const char* begin = static_cast<const char*>(pools.pool(i).data());
+      const char* end = begin + pools.pool(i).size();
+      ok[t] = 1;
+      for (auto p: nodes) {
+        const char* q = reinterpret_cast<const char*>(p);
+        if (q < begin || q >= end)
+          ok[t] = 0;
+        a.deallocate_node(p);
+      }
+    });
+  }
+  for (auto& t: threads)
+    t.join();
+  return std::count(std::begin(ok), std::end(ok), 0) == 0;
+}
+
+int main()
+{
+  try {
+    if (!test_pool())
+      return 1;
+    if (!test_optional())
+      return 1;
+    if (!test_numa_pools())
+      return 1;
+  } catch (const std::exception& e) {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
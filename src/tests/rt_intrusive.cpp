@@ -0,0 +1,164 @@
+#include <set>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/intrusive_set.hpp>
+#include <rtcpp/container/intrusive_forward_list.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+struct by_id {};
+struct by_prio {};
+
+// A pooled message, in two sets and a list at the same time.
+struct msg : rt::set_hook<msg, by_id>
+           , rt::set_hook<msg, by_prio>
+           , rt::slist_hook<msg> {
+  int id;
+  int prio;
+};
+
+struct id_less {
+  bool operator()(const msg& a, const msg& b) const { return a.id < b.id; }
+  bool operator()(int a, const msg& b) const { return a < b.id; }
+  bool operator()(const msg& a, int b) const { return a.id < b; }
+};
+
+struct prio_less {
+  bool operator()(const msg& a, const msg& b) const
+  { return a.prio < b.prio || (a.prio == b.prio && a.id < b.id); }
+};
+
+template <class S>
+bool same_ids(const S& s, const std::set<int>& ref)
+{
+  return s.size() == ref.size()
+      && std::equal(std::begin(s), std::end(s), std::begin(ref)
+                   , [](const msg& m, int id) { return m.id == id; })
+      && std::equal(s.rbegin(), s.rend(), ref.rbegin()
+                   , [](const msg& m, int id) { return m.id == id; });
+}
+
+template <class Balance>
+bool test_set(const std::vector<int>& data)
+{
+  using id_set = rt::intrusive_set<msg, id_less, by_id, Balance>;
+  using prio_set = rt::intrusive_set<msg, prio_less, by_prio, Balance>;
+  std::vector<msg> pool(data.size());
+  id_set s1;
+  prio_set s2;
+  std::set<int> ref;
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    pool[i].id = data[i];
+    pool[i].prio = data[i] % 7;
+    const bool inserted = s1.insert(pool[i]).second;
+    if (inserted != ref.insert(data[i]).second)
+      return false;
+    if (inserted)
+      s2.insert(pool[i]);
+  }
+
+  if (!same_ids(s1, ref) || s2.size() != s1.size()
+      || !std::is_sorted(std::begin(s2), std::end(s2), prio_less()))
+    return false;
+
+  // The elements are the pooled objects themselves.
+  for (auto& o: pool)
+    if (s1.count(o.id) != 1 || &*s1.find(o.id) != &*s1.find(o))
+      return false;
+
+  for (int k: {-1, data[3], data[3] + 1})
+    if (s1.lower_bound(k) != std::find_if(std::begin(s1), std::end(s1)
+                                         , [&](const msg& m) { return m.id >= k; }))
+      return false;
+
+  // Erase by position from one set, by key from the other.
+  for (std::size_t i = 0; i < pool.size(); i += 3) {
+    auto iter = s1.find(pool[i].id);
+    if (iter == s1.end() || &*iter != &pool[i])
+      continue;
+    s1.erase(iter);
+    if (s2.erase(pool[i]) != 1)
+      return false;
+    ref.erase(pool[i].id);
+  }
+  if (!same_ids(s1, ref) || s2.size() != s1.size())
+    return false;
+
+  // Reinserted with another priority.
+  for (std::size_t i = 0; i < pool.size(); i += 3) {
+    if (!s1.insert(pool[i]).second)
+      continue;
+    pool[i].prio = -1;
+    s2.insert(s2.begin(), pool[i]);
+    ref.insert(pool[i].id);
+  }
+  if (!same_ids(s1, ref) || s2.size() != s1.size()
+      || !std::is_sorted(std::begin(s2), std::end(s2), prio_less()))
+    return false;
+
+  auto iter = s1.iterator_to(pool[1]);
+  if (&*iter != &pool[1])
+    return false;
+
+  // The extreme elements thread to the new head.
+  id_set s3(std::move(s1));
+  if (!s1.empty() || !same_ids(s3, ref))
+    return false;
+
+  s3.clear();
+  return s3.empty() && s3.begin() == s3.end();
+}
+
+bool test_forward_list(const std::vector<int>& data)
+{
+  std::vector<msg> pool(data.size());
+  rt::intrusive_forward_list<msg> l;
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    pool[i].id = data[i];
+    pool[i].prio = i;
+    l.push_front(pool[i]);
+  }
+
+  if (&l.front() != &pool.back())
+    return false;
+
+  l.reverse();
+  if (!std::equal(std::begin(l), std::end(l), std::begin(pool)
+                 , [](const msg& a, const msg& b) { return &a == &b; }))
+    return false;
+
+  // Stable, equal ids keep the insertion order.
+  l.sort([](const msg& a, const msg& b) { return a.id < b.id; });
+  auto by_id_then_pos = [](const msg& a, const msg& b)
+  { return a.id < b.id || (a.id == b.id && a.prio < b.prio); };
+  if (!std::is_sorted(std::begin(l), std::end(l), by_id_then_pos)
+      || std::distance(std::begin(l), std::end(l)) != static_cast<long>(pool.size()))
+    return false;
+
+  // Unlinks the second and the first, the first goes back.
+  l.erase_after(l.iterator_to(l.front()));
+  msg& first = l.front();
+  l.pop_front();
+  l.insert_after(l.cbefore_begin(), first);
+  if (&l.front() != &first
+      || std::distance(l.cbegin(), l.cend()) != static_cast<long>(pool.size()) - 1)
+    return false;
+
+  l.clear();
+  return l.empty();
+}
+
+int main()
+{
+  const std::vector<int> data = rt::make_rand_data<int>(2000, 1, 1500);
+  if (!test_set<rt::tbst::no_balance>(data))
+    return 1;
+  if (!test_set<rt::tbst::avl_balance>(data))
+    return 1;
+  if (!test_forward_list(data))
+    return 1;
+  return 0;
+}
+
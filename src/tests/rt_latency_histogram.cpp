@@ -0,0 +1,92 @@
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <rtcpp/utility/latency_histogram.hpp>
+
+using histogram = rt::latency_histogram<>;
+
+bool test_buckets()
+{
+  // Every value falls in its bucket, whose width is within the
+  // precision, and the buckets are contiguous.
+  std::mt19937_64 gen(1);
+  for (int i = 0; i < 100000; ++i) {
+    const std::uint64_t v = gen() >> (gen() % 64);
+    const std::size_t b = histogram::bucket(v);
+    if (b >= histogram::n_buckets || v < histogram::lowest(b) || v > histogram::highest(b))
+      return false;
+    if (histogram::highest(b) - histogram::lowest(b) > histogram::lowest(b) / 64)
+      return false;
+  }
+  for (std::size_t b = 0; b + 1 < histogram::n_buckets; ++b)
+    if (histogram::highest(b) + 1 != histogram::lowest(b + 1))
+      return false;
+  return histogram::bucket(0) == 0 && histogram::bucket(127) == 127
+      && histogram::highest(histogram::n_buckets - 1) == UINT64_MAX;
+}
+
+bool test_quantiles()
+{
+  histogram h;
+  if (h.count() != 0 || h.value_at(0.5) != 0 || h.min() != 0 || h.max() != 0)
+    return false;
+
+  // Exact below 128.
+  for (std::uint64_t v = 1; v <= 100; ++v)
+    h.record(v);
+  if (h.value_at(0.5) != 50 || h.value_at(0.99) != 99 || h.value_at(1) != 100)
+    return false;
+  if (h.value_at(0) != 1 || h.min() != 1 || h.mean() != 50.5)
+    return false;
+
+  // One outlier in 10^4 shows at p99.99 only.
+  histogram t;
+  for (int i = 0; i < 9999; ++i)
+    t.record(1000);
+  t.record(1000000);
+  const std::uint64_t p9999 = t.value_at(0.9999);
+  const std::uint64_t p99999 = t.value_at(0.99999);
+  if (p9999 < 1000 || p9999 > 1000 + 1000 / 64 || p99999 != 1000000)
+    return false;
+
+  // Against sorted samples, never below them and within the precision.
+  std::mt19937_64 gen(2);
+  std::vector<std::uint64_t> v;
+  histogram r;
+  for (int i = 0; i < 100000; ++i) {
+    const std::uint64_t x = 100 + gen() % (std::uint64_t(1) << (10 + i % 20));
+    v.push_back(x);
+    r.record(x);
+  }
+  std::sort(std::begin(v), std::end(v));
+  const double qs[] = {0.5, 0.9, 0.99, 0.999, 0.9999};
+  for (double q : qs) {
+    const std::uint64_t e = v[std::size_t(q * double(v.size())) - 1];
+    const std::uint64_t a = r.value_at(q);
+    if (a < e || a > e + e / 64)
+      return false;
+  }
+  if (r.max() != v.back() || r.min() != v.front() || r.value_at(1) != v.back())
+    return false;
+
+  // merge is the histogram of both.
+  histogram m = h;
+  m.merge(t);
+  if (m.count() != 10100 || m.min() != 1 || m.max() != 1000000 || m.value_at(0.005) != 51)
+    return false;
+  m.reset();
+  return m.count() == 0 && m.count(histogram::bucket(1000)) == 0;
+}
+
+int main()
+{
+  if (!test_buckets())
+    return 1;
+
+  if (!test_quantiles())
+    return 1;
+
+  return 0;
+}
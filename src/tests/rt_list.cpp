@@ -5,6 +5,95 @@
 #include <functional>
 
 #include <rtcpp/container/list.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+template <class L>
+std::vector<int> to_vector(L& l)
+{
+  std::vector<int> v;
+  for (auto p = l.begin(); p != l.end(); p = p->next)
+    v.push_back(p->info);
+  return v;
+}
+
+template <class L>
+std::vector<int> to_vector_reverse(L& l)
+{
+  std::vector<int> v;
+  for (auto p = l.end()->prev; p != l.end(); p = p->prev)
+    v.push_back(p->info);
+  return v;
+}
+
+template <class L>
+bool test_list(L& l, const std::vector<int>& data)
+{
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    if (i % 2)
+      l.push_front(data[i]);
+    else
+      l.push_back(data[i]);
+  }
+
+  std::vector<int> v = to_vector(l);
+  std::vector<int> r = to_vector_reverse(l);
+  std::reverse(std::begin(r), std::end(r));
+  if (v.size() != data.size() || v != r)
+    return false;
+
+  l.reverse();
+  std::reverse(std::begin(v), std::end(v));
+  if (to_vector(l) != v)
+    return false;
+
+  l.swap_nodes(l.begin(), l.begin()->next);
+  std::swap(v[0], v[1]);
+  l.swap_nodes(l.begin(), l.end()->prev);
+  std::swap(v.front(), v.back());
+  if (to_vector(l) != v)
+    return false;
+
+  l.sort();
+  std::sort(std::begin(v), std::end(v));
+  if (to_vector(l) != v || to_vector_reverse(l).front() != v.back())
+    return false;
+
+  l.reverse();
+  l.insertion_sort();
+  if (to_vector(l) != v)
+    return false;
+
+  // The nodes are in list order in memory afterwards.
+  l.relayout();
+  auto r2 = to_vector_reverse(l);
+  if (to_vector(l) != v || !std::equal(std::begin(v), std::end(v), r2.rbegin()))
+    return false;
+  for (auto p = l.begin(); p->next != l.end(); p = p->next)
+    if (p->next < p)
+      return false;
+
+  L other(l.get_allocator());
+  for (int i = 0; i < 20; ++i)
+    other.push_back(i * 5000);
+  v.insert(std::end(v), 20, 0);
+  for (int i = 0; i < 20; ++i)
+    v[v.size() - 20 + i] = i * 5000;
+  std::inplace_merge(std::begin(v), std::end(v) - 20, std::end(v));
+  l.merge(other);
+  auto r3 = to_vector_reverse(l);
+  if (!other.empty() || to_vector(l) != v
+      || !std::equal(std::begin(v), std::end(v), r3.rbegin()))
+    return false;
+
+  l.erase(l.begin());
+  v.erase(std::begin(v));
+  if (to_vector(l) != v)
+    return false;
+
+  l.clear();
+  return l.empty() && l.begin() == l.end();
+}
 
 int main()
 {
@@ -28,6 +117,30 @@ int main()
   l.print();
   std::cout << "________" << std::endl;
 
+  l.clear();
+  std::vector<int> data = make_rand_data<int>(500, 1, 100000);
+  if (!test_list(l, data))
+    return 1;
+
+  // The nodes come from the buffer and go back to it, a buffer with
+  // room for the elements only is enough for many rounds.
+  using node_type = list<int>::node_type;
+  using alloc_type = node_allocator<int, node_type>;
+  std::vector<node_type> buffer(data.size() + 21);
+  node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  list<int, alloc_type> l2(alloc);
+  for (int i = 0; i < 10; ++i)
+    if (!test_list(l2, data))
+      return 1;
+
+  try {
+    for (std::size_t i = 0; i <= data.size() + 20; ++i)
+      l2.push_back(0);
+    return 1;
+  } catch (const std::bad_alloc&) {
+  }
+
   return 0;
 }
 
@@ -0,0 +1,91 @@
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <functional>
+
+#include <unistd.h>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/memory/mapped_pool.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+using node_type = rt::set<int>::node_type;
+using alloc_type =
+  rt::node_allocator<int, node_type, rt::node_stack, std::uint32_t>;
+using set_type = rt::set<int, std::less<int>, alloc_type>;
+
+// Keeps the set in the pool, its head and size go to the slots.
+void store(rt::mapped_pool& pool, set_type& s)
+{
+  pool.slot(1) = s.size();
+  pool.slot(0) = pool.offset(s.release());
+  pool.sync();
+}
+
+set_type load(rt::mapped_pool& pool, const alloc_type& alloc)
+{
+  auto head = static_cast<set_type::node_type*>(pool.address(pool.slot(0)));
+  return set_type(rt::adopt_nodes, head, pool.slot(1), std::less<int>(), alloc);
+}
+
+int main()
+{
+  const std::string path =
+    "rt_mapped_pool." + std::to_string(::getpid()) + ".bin";
+  std::remove(path.c_str());
+
+  std::vector<int> data = rt::make_rand_data<int>(2000, 1, 1000000);
+  std::set<int> ref(std::begin(data), std::end(data));
+
+  {
+    rt::mapped_pool pool(path.c_str(), 1 << 20);
+    if (!pool.created())
+      return 1;
+    alloc_type alloc(&pool.header());
+    set_type s(alloc);
+    s.insert(std::begin(data), std::end(data));
+    store(pool, s);
+  }
+
+  bool ok = true;
+  {
+    // The first mapping stays alive so that the second one is at
+    // another address and only relative links can work.
+    rt::mapped_pool pool1(path.c_str(), 0);
+    rt::mapped_pool pool2(path.c_str(), 0);
+    ok = !pool1.created() && !pool2.created()
+      && pool1.address(0) != pool2.address(0);
+
+    alloc_type alloc(&pool2.header());
+    set_type s = load(pool2, alloc);
+    ok = ok && s.size() == ref.size()
+       && std::equal(std::begin(s), std::end(s), std::begin(ref));
+
+    // The avail stack has survived as well.
+    for (int i = 0; i < 100; ++i) {
+      s.insert(-i);
+      ref.insert(-i);
+    }
+    for (std::size_t i = 0; i < data.size(); i += 3) {
+      s.erase(data[i]);
+      ref.erase(data[i]);
+    }
+    store(pool2, s);
+  }
+
+  if (ok) {
+    rt::mapped_pool pool(path.c_str(), 0);
+    alloc_type alloc(&pool.header());
+    set_type s = load(pool, alloc);
+    ok = s.size() == ref.size()
+      && std::equal(std::begin(s), std::end(s), std::begin(ref))
+      && std::equal(s.rbegin(), s.rend(), ref.rbegin());
+  }
+
+  std::remove(path.c_str());
+  return ok ? 0 : 1;
+}
+
@@ -131,6 +131,89 @@ bool test_assign_mult()
   return true;
 }
 
+// Each product of the chain is evaluated once, evaluating the last
+// element by element would need 3^39 multiplications per element.
+bool test_chain()
+{
+  typedef matrix<int, 3, 3> mat_type;
+  const mat_type p = {0, 1, 0, 0, 0, 1, 1, 0, 0}; // A cyclic permutation.
+  const mat_type id = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  const mat_type m = p * p * p * p * p * p * p * p * p * p
+                   * p * p * p * p * p * p * p * p * p * p
+                   * p * p * p * p * p * p * p * p * p * p
+                   * p * p * p * p * p * p * p * p * p * p;
+  if (m != mat_type(p))
+    return false;
+  // Products inside sums and scalings.
+  const mat_type q = (2 * (p * p) + id) * (p - id * p * p);
+  mat_type pp = p * p;
+  mat_type l = 2 * pp + id;
+  mat_type r = p - pp;
+  return q == mat_type(l * r);
+}
+
+// The vectorized kernels give the values of the element wise
+// definitions, exactly with these inputs.
+template <typename T, std::size_t M, std::size_t K, std::size_t N>
+bool test_kernels()
+{
+  matrix<T, M, K> a;
+  matrix<T, K, N> b;
+  matrix<T, M, N> c;
+  for (std::size_t i = 0; i < M * K; ++i)
+    a[i] = static_cast<T>(i % 7) / 4 - 1;
+  for (std::size_t i = 0; i < K * N; ++i)
+    b[i] = static_cast<T>(i % 5) / 2 + 1;
+  for (std::size_t i = 0; i < M * N; ++i)
+    c[i] = static_cast<T>(i % 3) - 2;
+
+  const matrix<T, M, N> p = a * b;
+  for (std::size_t i = 0; i < M; ++i) {
+    for (std::size_t j = 0; j < N; ++j) {
+      T s = 0;
+      for (std::size_t k = 0; k < K; ++k)
+        s += a(i, k) * b(k, j);
+      if (p(i, j) != s)
+        return false;
+    }
+  }
+  const matrix<T, M, N> s = p + c;
+  const matrix<T, M, N> d = p - c;
+  const matrix<T, M, N> x = 3 * c;
+  for (std::size_t i = 0; i < M * N; ++i)
+    if (s[i] != p[i] + c[i] || d[i] != p[i] - c[i] || x[i] != 3 * c[i])
+      return false;
+  return true;
+}
+
+template <typename T>
+bool test_kernels()
+{
+  return test_kernels<T, 2, 2, 2>() && test_kernels<T, 3, 3, 3>()
+      && test_kernels<T, 4, 4, 4>() && test_kernels<T, 4, 4, 1>()
+      && test_kernels<T, 3, 3, 1>() && test_kernels<T, 2, 3, 4>()
+      && test_kernels<T, 4, 2, 3>() && test_kernels<T, 1, 4, 1>()
+      && test_kernels<T, 5, 3, 6>();
+}
+
+// Folded by the compiler, a rotation by 90 degrees about z followed
+// by a translation.
+constexpr matrix<float, 4, 4> rot = { 0, -1, 0, 0
+                                    , 1,  0, 0, 0
+                                    , 0,  0, 1, 0
+                                    , 0,  0, 0, 1 };
+constexpr matrix<float, 4, 4> shift = { 1, 0, 0, 2
+                                      , 0, 1, 0, 3
+                                      , 0, 0, 1, 4
+                                      , 0, 0, 0, 1 };
+constexpr matrix<float, 4, 4> xform = shift * rot;
+constexpr matrix<float, 4, 1> pt = xform * matrix<float, 4, 1>{1, 0, 0, 1};
+static_assert(pt(0, 0) == 2 && pt(1, 0) == 4 && pt(2, 0) == 4 && pt(3, 0) == 1, "");
+constexpr matrix<float, 4, 4> sym = 2.f * (rot + transpose(rot)) / 4.f - rot * rot;
+static_assert(sym(0, 0) == 1 && sym(0, 1) == 0 && sym(2, 2) == 0 && sym(3, 3) == 0, "");
+static_assert(snorm(matrix<int, 3, 1>{1, 2, 3}) == 14, "");
+static_assert(matrix<int, 2, 2>(3) == matrix<int, 2, 2>{3, 3, 3, 3}, "");
+
 int main()
 {
   typedef matrix<int, 2, 2> mat_type;
@@ -178,6 +261,15 @@ int main()
   if (!test_div2())
     return 1;
 
+  if (!test_chain())
+    return 1;
+
+  if (!test_kernels<float>() || !test_kernels<double>() || !test_kernels<int>())
+    return 1;
+
+  if (alignof(matrix<float, 4, 4>) != 16 || sizeof (matrix<float, 3, 1>) != 12)
+    return 1;
+
   std::cout << "tmp1:\n";
   std::cout << tmp1 << "\n";
   std::cout << "tmp2:\n";
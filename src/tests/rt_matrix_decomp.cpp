@@ -0,0 +1,120 @@
+#include <cmath>
+#include <stdexcept>
+
+#include <rtcpp/container/matrix_decomp.hpp>
+
+using namespace rt;
+
+// Diagonally dominant, so that it is invertible and well conditioned.
+template <typename T, std::size_t N>
+matrix<T, N, N> gen(std::size_t seed)
+{
+  matrix<T, N, N> a;
+  for (std::size_t i = 0; i < N; ++i)
+    for (std::size_t j = 0; j < N; ++j)
+      a(i, j) = static_cast<T>((i * 7 + j * 3 + seed) % 5) - 2
+              + (i == j ? T(3 * N) : T(0));
+  return a;
+}
+
+template <typename T, std::size_t M, std::size_t N>
+bool near(const matrix<T, M, N>& a, const matrix<T, M, N>& b, T eps)
+{
+  for (std::size_t i = 0; i < M * N; ++i)
+    if (std::abs(a[i] - b[i]) > eps)
+      return false;
+  return true;
+}
+
+template <typename T, std::size_t N>
+matrix<T, N, N> identity()
+{
+  matrix<T, N, N> id;
+  for (std::size_t i = 0; i < N; ++i)
+    id(i, i) = 1;
+  return id;
+}
+
+template <typename T, std::size_t N>
+bool test_size(T eps)
+{
+  using mat = matrix<T, N, N>;
+  using vec = matrix<T, N, 1>;
+  const mat a = gen<T, N>(1);
+  const mat id = identity<T, N>();
+
+  const mat inv = inverse(a);
+  if (!near(mat(a * inv), id, eps) || !near(mat(inv * a), id, eps))
+    return false;
+
+  // The closed forms against LU.
+  const lu_decomposition<T, N> d = lu(a);
+  T det = T(d.sign);
+  for (std::size_t i = 0; i < N; ++i)
+    det *= d.lu(i, i);
+  if (std::abs(determinant(a) - det) > eps * std::abs(det))
+    return false;
+
+  vec b;
+  for (std::size_t i = 0; i < N; ++i)
+    b[i] = T(i) - 1;
+  if (!near(vec(a * solve(d, b)), b, eps))
+    return false;
+
+  // Symmetric positive definite.
+  const mat s = a * transpose(a);
+  const mat l = cholesky(s);
+  for (std::size_t i = 0; i < N; ++i)
+    for (std::size_t j = i + 1; j < N; ++j)
+      if (l(i, j) != 0)
+        return false;
+  if (!near(mat(l * transpose(l)), s, eps * 100 * N)
+      || !near(vec(s * cholesky_solve(l, b)), b, eps * 100 * N))
+    return false;
+
+  // Singular, two equal rows or zero.
+  mat z = a;
+  for (std::size_t j = 0; j < N; ++j)
+    z(N - 1, j) = N > 1 ? z(0, j) : T(0);
+  mat out = id;
+  if (std::abs(determinant(z)) > eps || try_inverse(z, out) || out != id)
+    return false;
+  lu_decomposition<T, N> dz;
+  if (try_lu(z, dz))
+    return false;
+  if (try_cholesky(mat(-1 * s), out))
+    return false;
+  try {
+    inverse(z);
+    return false;
+  } catch (const std::runtime_error&) {}
+  return true;
+}
+
+template <typename T>
+bool test_all(T eps)
+{
+  return test_size<T, 1>(eps) && test_size<T, 2>(eps) && test_size<T, 3>(eps)
+      && test_size<T, 4>(eps) && test_size<T, 5>(eps) && test_size<T, 7>(eps);
+}
+
+static_assert(determinant(matrix<int, 3, 3>{2, 0, 1, 1, 3, 2, 1, 1, 2}) == 6, "");
+static_assert(determinant(matrix<int, 4, 4>{1, 2, 0, 0, 3, 4, 0, 0, 0, 0, 2, 1, 0, 0, 1, 1}) == -2, "");
+static_assert(inverse(matrix<double, 2, 2>{1, 2, 3, 4}) == matrix<double, 2, 2>{-2, 1, 1.5, -0.5}, "");
+
+int main()
+{
+  if (!test_all<float>(1e-4f) || !test_all<double>(1e-10))
+    return 1;
+
+  // Lazy transpose of an expression.
+  const matrix<int, 2, 3> a = {1, 2, 3, 4, 5, 6};
+  const matrix<int, 3, 2> t = transpose(2 * a);
+  if (t != matrix<int, 3, 2>{2, 8, 4, 10, 6, 12})
+    return 1;
+  const matrix<int, 2, 2> p = transpose(a * transpose(a));
+  if (p != matrix<int, 2, 2>{14, 32, 32, 77})
+    return 1;
+
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include <limits>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/algorithm/minmax_element.hpp>
+
+template <class T>
+bool same(const std::vector<T>& v)
+{
+  const T* p = v.data();
+  const auto a = rt::minmax_element(p, p + v.size());
+  const auto b = std::minmax_element(p, p + v.size());
+#if defined(RTCPP_FIND_AVX2)
+  // The kernel not chosen on this machine.
+  if (!v.empty()) {
+    const auto c = rt::detail::minmax16(p, v.size());
+    if (p + c.first != b.first || p + c.second != b.second)
+      return false;
+  }
+#endif
+  return a == b;
+}
+
+// Random values in a small range, so there are ties, and all equal,
+// at every size around the vector widths.
+template <class T>
+bool test_type(T lo, T hi)
+{
+  std::mt19937 gen(sizeof (T));
+  std::uniform_int_distribution<int> dist(0, 9);
+  for (std::size_t n = 0; n < 140; ++n) {
+    std::vector<T> v(n);
+    for (auto& o: v)
+      o = static_cast<T>(dist(gen) < 5 ? lo : hi);
+    for (auto& o: v)
+      o = dist(gen) == 0 ? static_cast<T>(o / 2) : o;
+    if (!same(v))
+      return false;
+    std::fill(std::begin(v), std::end(v), hi);
+    if (!same(v))
+      return false;
+  }
+  return true;
+}
+
+// Ranges longer than the lane counters can count, for bytes 256
+// vectors.
+template <class T>
+bool test_blocks()
+{
+  std::vector<T> v(20000);
+  for (std::size_t i = 0; i < v.size(); ++i)
+    v[i] = static_cast<T>(i % 97 + 1);
+  v[9000] = 0;
+  v[13001] = 0;
+  v[17000] = std::numeric_limits<T>::max();
+  v[19999] = std::numeric_limits<T>::max();
+  if (!same(v))
+    return false;
+  v[4] = std::numeric_limits<T>::lowest();
+  return same(v);
+}
+
+bool test_iterators()
+{
+  const std::vector<bool> b = {true, false, true, false};
+  const auto r = rt::minmax_element(std::begin(b), std::end(b));
+  if (r.first != std::begin(b) + 1 || r.second != std::begin(b) + 2)
+    return false;
+  const int a[] = {4, 1, 9, 1, 9};
+  const auto s = rt::minmax_element(std::begin(a), std::end(a), std::greater<int>());
+  return s.first == a + 2 && s.second == a + 3;
+}
+
+int main()
+{
+  if (!test_type<std::int8_t>(-128, 127) || !test_type<std::uint8_t>(3, 250)
+      || !test_type<std::int16_t>(-30000, 30000) || !test_type<std::uint16_t>(1, 65000)
+      || !test_type<int>(-2000000000, 2000000000)
+      || !test_type<std::uint32_t>(1, 4000000000u)
+      || !test_type<std::int64_t>(-5000000000, 6000000000)
+      || !test_type<std::uint64_t>(2, 12000000000000000000ull)
+      || !test_type<float>(-1.5f, 3.25f) || !test_type<double>(-1e300, 1e300))
+    return 1;
+  if (!test_blocks<std::uint8_t>() || !test_blocks<std::int8_t>()
+      || !test_blocks<std::int16_t>() || !test_blocks<float>()
+      || !test_blocks<std::uint64_t>())
+    return 1;
+  if (!test_iterators())
+    return 1;
+
+  return 0;
+}
+
@@ -0,0 +1,149 @@
+#include <thread>
+#include <vector>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/container/forward_list.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/node_allocator_lazy.hpp>
+#include <rtcpp/memory/node_alloc_stats.hpp>
+#include <rtcpp/memory/atomic_node_stack.hpp>
+
+bool test_set()
+{
+  using node_type = rt::set<int>::node_type;
+  using alloc_type =
+    rt::node_allocator<int, node_type, rt::counted<rt::node_stack>::type>;
+  using node_alloc_type = alloc_type::rebind<node_type>::other;
+  using set_type = rt::set<int, std::less<int>, alloc_type>;
+
+  // Room for the head and 10 nodes.
+  std::vector<node_type> buffer(12);
+  rt::node_alloc_stats stats;
+  rt::node_alloc_header header(buffer);
+  header.use_stats(stats);
+
+  const alloc_type alloc(&header);
+  set_type t1(alloc);
+  for (int i = 0; i < 8; ++i)
+    t1.insert(i);
+  for (int i = 0; i < 5; ++i)
+    t1.erase(i);
+
+  auto c = stats.totals();
+  // The set holds a head node.
+  if (c.live != 4 || c.high_water != 9 || c.allocations != 9
+      || c.deallocations != 5 || c.failures != 0)
+    return false;
+
+  node_alloc_type a(alloc);
+  std::vector<node_type*> nodes;
+  try {
+    for (;;)
+      nodes.push_back(a.allocate_node());
+  } catch (const std::bad_alloc&) {
+  }
+  for (auto p: nodes)
+    a.deallocate_node(p);
+
+  c = stats.totals();
+  if (nodes.size() != 7 || c.live != 4 || c.high_water != 11
+      || c.failures != 1)
+    return false;
+
+  stats.reset_high_water();
+  return stats.totals().high_water == 4 && stats.n_threads() == 1
+      && stats.thread(0).allocations == c.allocations;
+}
+
+bool test_lazy()
+{
+  using alloc_type =
+    rt::node_allocator_lazy< int, sizeof (int), false
+                           , rt::counted<rt::node_stack>::type>;
+  std::vector<char> buffer(4096);
+  rt::node_alloc_stats stats;
+  rt::node_alloc_header header(buffer);
+  header.use_stats(stats);
+  const alloc_type alloc(&header);
+  rt::forward_list<int, alloc_type> l1(alloc);
+  for (int i = 0; i < 10; ++i)
+    l1.push_front(i);
+  l1.remove_if(9);
+  const auto c = stats.totals();
+  return c.live == 9 && c.allocations == 10 && c.deallocations == 1;
+}
+
+bool test_threads()
+{
+  using node_type = rt::set<int>::node_type;
+  using alloc_type =
+    rt::node_allocator< int, node_type
+                      , rt::counted<rt::atomic_node_stack>::type>;
+  using node_alloc_type = alloc_type::rebind<node_type>::other;
+
+  const int n_threads = 4;
+  const int n = 1000;
+  std::vector<node_type> buffer(n_threads * n + 1);
+  rt::node_alloc_stats stats;
+  rt::node_alloc_header header(buffer);
+  header.use_stats(stats);
+  const alloc_type base(&header);
+  const node_alloc_type alloc(base);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&alloc, t]()
+    {
+      node_alloc_type a(alloc);
+      std::vector<node_type*> nodes;
+      for (int i = 0; i < n; ++i)
+        nodes.push_back(a.allocate_node());
+      // Keeps t nodes.
+      for (int i = t; i < n; ++i)
+        a.deallocate_node(nodes[i]);
+    });
+  }
+  for (auto& t: threads)
+    t.join();
+
+  const auto c = stats.totals();
+  if (c.live != 6 || c.allocations != n_threads * n || c.failures != 0)
+    return false;
+  if (c.high_water < n || c.high_water > n_threads * n)
+    return false;
+
+  // Thread slots are assigned on first use, the main thread did not
+  // allocate.
+  std::uint64_t sum = 0;
+  std::size_t used = 0;
+  for (std::size_t i = 0; i < stats.n_threads(); ++i) {
+    sum += stats.thread(i).allocations;
+    used += stats.thread(i).allocations != 0;
+  }
+  return sum == c.allocations && used == n_threads;
+}
+
+bool test_no_stats()
+{
+  using node_type = rt::set<int>::node_type;
+  using alloc_type =
+    rt::node_allocator<int, node_type, rt::counted<rt::node_stack>::type>;
+  std::vector<node_type> buffer(10);
+  rt::node_alloc_header header(buffer);
+  const alloc_type alloc(&header);
+  try {
+    rt::set<int, std::less<int>, alloc_type> t1(alloc);
+  } catch (const std::exception& e) {
+    return header.n_alloc == 0;
+  }
+  return false;
+}
+
+int main()
+{
+  if (!test_set() || !test_lazy() || !test_threads() || !test_no_stats())
+    return 1;
+
+  return 0;
+}
@@ -0,0 +1,129 @@
+#include <vector>
+#include <numeric>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/container/forward_list.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/algorithm/node_scan.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+// Forwards to the tag or to the bitmap overloads.
+template <class Node, class Acc>
+Acc sum(const Node* p, std::size_t n, std::nullptr_t, Acc init)
+{ return rt::sum_in_use(p, n, init); }
+
+template <class Node, class Acc>
+Acc sum(const Node* p, std::size_t n, const std::uint64_t* bitmap, Acc init)
+{ return rt::sum_in_use(p, n, bitmap, init); }
+
+template <class Node>
+std::pair<int, int> minmax(const Node* p, std::size_t n, std::nullptr_t)
+{ return rt::minmax_in_use(p, n); }
+
+template <class Node>
+std::pair<int, int>
+minmax(const Node* p, std::size_t n, const std::uint64_t* bitmap)
+{ return rt::minmax_in_use(p, n, bitmap); }
+
+template <class Node, class Pred>
+std::size_t count_if(const Node* p, std::size_t n, std::nullptr_t, Pred pred)
+{ return rt::count_if_in_use(p, n, pred); }
+
+template <class Node, class Pred>
+std::size_t
+count_if(const Node* p, std::size_t n, const std::uint64_t* bitmap, Pred pred)
+{ return rt::count_if_in_use(p, n, bitmap, pred); }
+
+template <class Node>
+const Node* find(const Node* p, std::size_t n, std::nullptr_t, int v)
+{ return rt::find_in_use(p, n, v); }
+
+template <class Node>
+const Node* find(const Node* p, std::size_t n, const std::uint64_t* bitmap, int v)
+{ return rt::find_in_use(p, n, bitmap, v); }
+
+template <class C, class Node, class Bitmap>
+bool check(const C& c, const std::vector<Node>& buffer, Bitmap bitmap)
+{
+  const std::vector<int> tmp(std::begin(c), std::end(c));
+  const Node* p = buffer.data();
+  const std::size_t n = buffer.size();
+
+  const long long sum1 = std::accumulate(std::begin(tmp), std::end(tmp), 0ll);
+  if (sum1 != sum(p, n, bitmap, 0ll))
+    return false;
+
+  const int s1 = std::accumulate(std::begin(tmp), std::end(tmp), 0);
+  if (s1 != sum(p, n, bitmap, 0))
+    return false;
+
+  const auto mm1 = std::minmax_element(std::begin(tmp), std::end(tmp));
+  const auto mm2 = minmax(p, n, bitmap);
+  if (*mm1.first != mm2.first || *mm1.second != mm2.second)
+    return false;
+
+  auto pred = [](int a){ return a % 3 == 0; };
+  const std::size_t c1 = std::count_if(std::begin(tmp), std::end(tmp), pred);
+  if (c1 != count_if(p, n, bitmap, pred))
+    return false;
+
+  for (auto o: tmp) {
+    const Node* q = find(p, n, bitmap, o);
+    if (q == p + n || rt::scan_traits<Node>::key(*q) != o)
+      return false;
+  }
+
+  return find(p, n, bitmap, -1) == p + n;
+}
+
+bool test_set(const std::vector<int>& data)
+{
+  using node_type = rt::set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+
+  std::vector<node_type> buffer(data.size() + 2);
+  rt::node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  rt::set<int, std::less<int>, alloc_type> t1(alloc);
+  t1.insert(std::begin(data), std::end(data));
+  for (std::size_t i = 0; i < data.size(); i += 2)
+    t1.erase(data[i]);
+
+  // The bitmap also has the head node, only the tag can be used.
+  return check(t1, buffer, nullptr);
+}
+
+bool test_forward_list(const std::vector<int>& data)
+{
+  using node_type = rt::forward_list<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+
+  std::vector<node_type> buffer(data.size() + 1);
+  rt::node_alloc_header header(buffer);
+  std::vector<std::uint64_t> bitmap(header.bitmap_words(sizeof (node_type)));
+  header.use_bitmap(bitmap);
+  alloc_type alloc(&header);
+  rt::forward_list<int, alloc_type> l1(alloc);
+  for (auto o: data)
+    l1.push_front(o);
+  for (std::size_t i = 0; i < data.size(); i += 5)
+    l1.remove_if(data[i]);
+
+  return check(l1, buffer, bitmap.data());
+}
+
+int main()
+{
+  std::vector<int> data = rt::make_rand_data<int>(1001, 0, 1000000);
+  if (!test_set(data))
+    return 1;
+
+  if (!test_forward_list(data))
+    return 1;
+
+  return 0;
+}
+
@@ -0,0 +1,114 @@
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+#include <rtcpp/utility/parallel.hpp>
+#include <rtcpp/utility/thread_pool.hpp>
+#include <rtcpp/algorithm/parallel_sort.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+struct record {
+  std::uint32_t key;
+  std::size_t seq;
+};
+
+template <class Exec>
+bool test_sorts(Exec& exec)
+{
+  for (std::size_t n: {0, 1, 5, 100, 1000, 100000}) {
+    std::vector<int> data = rt::make_rand_data<int>(n, -100000, 100000, 1);
+    std::vector<int> ref = data;
+    std::sort(std::begin(ref), std::end(ref));
+    std::vector<int> scratch(n);
+
+    std::vector<int> v = data;
+    rt::parallel_sort(exec, std::begin(v), std::end(v), scratch.data());
+    if (v != ref)
+      return false;
+
+    std::deque<int> d(std::begin(data), std::end(data));
+    rt::parallel_sort(exec, std::begin(d), std::end(d), scratch.data(), std::greater<int>());
+    if (!std::equal(std::begin(ref), std::end(ref), d.rbegin()))
+      return false;
+
+    v = data;
+    rt::parallel_radix_sort<11>(exec, std::begin(v), std::end(v), scratch.data());
+    if (v != ref)
+      return false;
+
+    std::vector<int> small = rt::make_rand_data<int>(n, -20, 200, 1);
+    std::vector<int> small_ref = small;
+    std::sort(std::begin(small_ref), std::end(small_ref));
+    rt::parallel_dist_counting_sort(exec, std::begin(small), n, -20, 200);
+    if (small != small_ref)
+      return false;
+  }
+  return true;
+}
+
+// Equal keys keep their order across the chunks.
+template <class Exec>
+bool test_stable(Exec& exec)
+{
+  std::vector<int> keys = rt::make_rand_data<int>(50000, 0, 100, 1);
+  std::vector<record> v;
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    v.push_back(record {static_cast<std::uint32_t>(keys[i]), i});
+  std::vector<record> scratch(v.size());
+  rt::parallel_radix_sort<8>( exec, std::begin(v), std::end(v), scratch.data()
+                            , [](const record& r) { return r.key; });
+  for (std::size_t i = 1; i < v.size(); ++i)
+    if (v[i - 1].key > v[i].key
+        || (v[i - 1].key == v[i].key && v[i - 1].seq > v[i].seq))
+      return false;
+  return true;
+}
+
+bool test_pool()
+{
+  rt::thread_pool pool(4);
+  if (pool.size() != 4)
+    return false;
+  // More calls than threads, several runs.
+  for (int r = 0; r < 50; ++r) {
+    std::vector<int> hits(37, 0);
+    pool.run(hits.size(), [&](std::size_t i) { ++hits[i]; });
+    if (std::count(std::begin(hits), std::end(hits), 1) != 37)
+      return false;
+  }
+  try {
+    pool.run(10, [](std::size_t i)
+    {
+      if (i == 3 || i == 7)
+        throw std::runtime_error(std::to_string(i));
+    });
+    return false;
+  } catch (const std::runtime_error& e) {
+    if (std::string(e.what()) != "3")
+      return false;
+  }
+  std::string s;
+  pool.run(1, [&](std::size_t) { s = "done"; });
+  return s == "done";
+}
+
+int main()
+{
+  rt::thread_pool pool(4);
+  rt::spawn_executor spawn(3);
+  rt::spawn_executor serial(1);
+  if (!test_sorts(pool) || !test_sorts(spawn) || !test_sorts(serial))
+    return 1;
+  if (!test_stable(pool) || !test_stable(spawn))
+    return 1;
+  if (!test_pool())
+    return 1;
+
+  return 0;
+}
+
@@ -0,0 +1,98 @@
+#include <cmath>
+
+#include <rtcpp/container/quaternion.hpp>
+
+using namespace rt;
+
+template <typename T, std::size_t M, std::size_t N>
+bool near(const matrix<T, M, N>& a, const matrix<T, M, N>& b, T eps)
+{
+  for (std::size_t i = 0; i < M * N; ++i)
+    if (std::abs(a[i] - b[i]) > eps)
+      return false;
+  return true;
+}
+
+// Equal up to the sign, q and -q being the same rotation.
+template <typename T>
+bool near(const quaternion<T>& a, const quaternion<T>& b, T eps)
+{
+  const T s = dot(a, b) < 0 ? T(-1) : T(1);
+  for (std::size_t i = 0; i < 4; ++i)
+    if (std::abs(a[i] - s * b[i]) > eps)
+      return false;
+  return true;
+}
+
+template <typename T>
+bool test_type(T eps)
+{
+  using quat = quaternion<T>;
+  using vec = matrix<T, 3, 1>;
+  using mat = matrix<T, 3, 3>;
+
+  const quat a = normalize(quat::from_axis_angle(vec{1, 2, 3}, T(0.3)));
+  const quat a2 = quat::from_axis_angle(vec{T(0.6), 0, T(0.8)}, T(-2.5));
+  const quat b = normalize(quat(T(0.1), T(-0.7), T(0.5), T(0.2)));
+  const vec v = {T(1.5), -2, T(0.25)};
+
+  // The product against the product of matrices and their rotations.
+  const quat ab = a * b;
+  if (!near(mat(to_matrix(a) * to_matrix(b)), to_matrix(ab), eps))
+    return false;
+  if (!near(ab * v, vec(to_matrix(ab) * v), eps))
+    return false;
+  if (!near(a2 * (b * v), vec(to_matrix(a2 * b) * v), eps))
+    return false;
+
+  // Quarter turn about z.
+  const quat qz = quat::from_axis_angle(vec{0, 0, 1}, T(std::acos(-1.0) / 2));
+  if (!near(qz * vec{1, 0, 0}, vec{0, 1, 0}, eps))
+    return false;
+
+  // Round trips through matrices, all four branches of the conversion.
+  const quat rs[] = { a, a2, b, qz, quat(0, 1, 0, 0), quat(0, 0, 1, 0)
+                    , quat(0, 0, 0, 1), normalize(quat(T(0.1), 2, 1, T(0.5)))
+                    , normalize(quat(T(0.1), 1, 2, T(0.5)))
+                    , normalize(quat(T(0.1), T(0.5), 1, 2)) };
+  for (const quat& r : rs)
+    if (!near(quat(to_matrix(r)), r, eps))
+      return false;
+
+  if (!near(a * inverse(a), quat(), eps) || !near(a * conjugate(a), quat(), eps))
+    return false;
+  const quat s = 2 * b;
+  if (!near(s * inverse(s), quat(), eps))
+    return false;
+  if (std::abs(dot(normalize(s), normalize(s)) - 1) > eps)
+    return false;
+
+  // slerp, its end points, midpoint and the shortest arc.
+  if (!near(slerp(a, b, T(0)), a, eps) || !near(slerp(a, b, T(1)), b, eps))
+    return false;
+  const quat h = quat::from_axis_angle(vec{0, 0, 1}, T(std::acos(-1.0) / 4));
+  if (!near(slerp(quat(), qz, T(0.5)), h, eps))
+    return false;
+  if (!near(slerp(quat(), quat(T(-1) * qz), T(0.5)), h, eps))
+    return false;
+  if (!near(slerp(a, a, T(0.3)), a, eps))
+    return false;
+  return true;
+}
+
+// In constant expressions.
+constexpr quaternion<int> qi(1, 2, 3, 4);
+constexpr quaternion<int> qj(5, 6, 7, 8);
+static_assert(qi * qj == quaternion<int>(-60, 12, 30, 24), "");
+static_assert(conjugate(qi) * qi == quaternion<int>(30, 0, 0, 0), "");
+static_assert(quaternion<int>(2 * qi - qj) == quaternion<int>(-3, -2, -1, 0), "");
+// Half turn about z.
+static_assert((quaternion<int>(0, 0, 0, 1) * matrix<int, 3, 1>{1, 2, 3}) == matrix<int, 3, 1>{-1, -2, 3}, "");
+
+int main()
+{
+  if (!test_type<float>(1e-5f) || !test_type<double>(1e-12))
+    return 1;
+
+  return 0;
+}
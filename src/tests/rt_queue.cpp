@@ -0,0 +1,229 @@
+#include <array>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <rtcpp/container/spsc_queue.hpp>
+#include <rtcpp/container/mpmc_queue.hpp>
+#include <rtcpp/container/forward_list.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/atomic_node_stack.hpp>
+
+template <class Q>
+bool test_single_thread(Q& q)
+{
+  using T = typename Q::value_type;
+  const std::size_t n = q.capacity();
+  if (!q.empty())
+    return false;
+
+  for (std::size_t i = 0; i < n; ++i)
+    if (!q.try_push(T(i)))
+      return false;
+  if (q.try_push(T(0)) || q.size() != n)
+    return false;
+
+  // Wraps around in batches.
+  std::vector<T> out(n);
+  if (q.pop_n(out.data(), 3) != 3 || out[0] != T(0) || out[2] != T(2))
+    return false;
+  std::vector<T> in = {T(n), T(n + 1), T(n + 2), T(n + 3)};
+  if (q.push_n(in.data(), in.size()) != 3)
+    return false;
+  if (q.pop_n(out.data(), 2 * n) != n)
+    return false;
+  for (std::size_t i = 0; i < n; ++i)
+    if (out[i] != T(i + 3))
+      return false;
+
+  T v;
+  return !q.try_pop(v) && q.empty();
+}
+
+bool test_spsc_threads()
+{
+  const std::uint64_t n = 200000;
+  std::vector<char> buffer(rt::spsc_queue<std::uint64_t>::bytes_for(64));
+  rt::spsc_queue<std::uint64_t> q(buffer);
+  if (q.capacity() != 64)
+    return false;
+
+  std::thread producer([&]()
+  {
+    std::uint64_t batch[5];
+    for (std::uint64_t i = 0; i < n;) {
+      std::size_t k = 0;
+      if (i % 2) {
+        k = q.try_push(i);
+      } else {
+        k = std::min<std::uint64_t>(5, n - i);
+        for (std::uint64_t j = 0; j < k; ++j)
+          batch[j] = i + j;
+        k = q.push_n(batch, k);
+      }
+      if (k == 0)
+        std::this_thread::yield();
+      i += k;
+    }
+  });
+
+  // In order, each exactly once.
+  bool ok = true;
+  std::uint64_t next = 0;
+  std::uint64_t out[7];
+  while (next < n) {
+    const std::size_t k = q.pop_n(out, 7);
+    if (k == 0)
+      std::this_thread::yield();
+    for (std::size_t j = 0; j < k; ++j)
+      ok = ok && out[j] == next++;
+  }
+  producer.join();
+  return ok && q.empty();
+}
+
+bool test_mpmc_threads()
+{
+  const int n_threads = 3;
+  const std::uint64_t n = 50000;
+  std::vector<char> buffer(rt::mpmc_queue<std::uint64_t>::bytes_for(128));
+  rt::mpmc_queue<std::uint64_t> q(buffer);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&q, t, n]()
+    {
+      const std::uint64_t tag = std::uint64_t(t) << 32;
+      std::uint64_t batch[4];
+      for (std::uint64_t i = 0; i < n;) {
+        std::size_t k = 0;
+        if (i % 3) {
+          k = q.try_push(tag | i);
+        } else {
+          k = std::min<std::uint64_t>(4, n - i);
+          for (std::uint64_t j = 0; j < k; ++j)
+            batch[j] = tag | (i + j);
+          k = q.push_n(batch, k);
+        }
+        if (k == 0)
+          std::this_thread::yield();
+        i += k;
+      }
+    });
+  }
+
+  // The elements of one producer are seen in order by each consumer.
+  std::vector<std::vector<std::uint64_t>> seen(n_threads);
+  std::vector<bool> ordered(n_threads, true);
+  std::atomic<std::uint64_t> popped(0);
+  for (int t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&, t]()
+    {
+      std::vector<std::uint64_t> last(n_threads, 0);
+      std::uint64_t out[3];
+      while (popped.load() < n_threads * n) {
+        const std::size_t k = t == 0 ? q.try_pop(out[0]) : q.pop_n(out, 3);
+        if (k == 0)
+          std::this_thread::yield();
+        for (std::size_t j = 0; j < k; ++j) {
+          const std::uint64_t p = out[j] >> 32;
+          const std::uint64_t i = out[j] & 0xffffffff;
+          if (i + 1 <= last[p])
+            ordered[t] = false;
+          last[p] = i + 1;
+          seen[t].push_back(out[j]);
+        }
+        popped += k;
+      }
+    });
+  }
+
+  for (auto& t: threads)
+    t.join();
+
+  std::vector<std::uint64_t> all;
+  for (auto& s: seen)
+    all.insert(std::end(all), std::begin(s), std::end(s));
+  std::sort(std::begin(all), std::end(all));
+  if (all.size() != n_threads * n
+      || std::adjacent_find(std::begin(all), std::end(all)) != std::end(all))
+    return false;
+
+  return std::count(std::begin(ordered), std::end(ordered), false) == 0
+      && q.empty();
+}
+
+// Nodes allocated by one thread from a shared pool and released by
+// another, only the pointers go through the queue.
+bool test_node_handoff()
+{
+  using node_type = rt::forward_list_node<int, void*>;
+  using alloc_type = rt::node_allocator<int, node_type, rt::atomic_node_stack>;
+  using node_alloc_type = alloc_type::rebind<node_type>::other;
+  const int n = 100000;
+  std::vector<node_type> pool(65);
+  rt::node_alloc_header header(pool);
+  // Links the pool before it is shared.
+  const alloc_type base(&header);
+  const node_alloc_type alloc(base);
+
+  std::array<node_type*, 32> buffer;
+  rt::spsc_queue<node_type*> q(buffer);
+
+  std::thread producer([&]()
+  {
+    node_alloc_type a(alloc);
+    for (int i = 0; i < n; ++i) {
+      node_type* p = a.allocate_node();
+      p->info = i;
+      while (!q.try_push(p))
+        std::this_thread::yield();
+    }
+  });
+
+  bool ok = true;
+  node_alloc_type a(alloc);
+  for (int i = 0; i < n; ++i) {
+    node_type* p = 0;
+    while (!q.try_pop(p))
+      std::this_thread::yield();
+    ok = ok && p->info == i;
+    a.deallocate_node(p);
+  }
+  producer.join();
+  return ok;
+}
+
+int main()
+{
+  std::array<std::uint64_t, 20> b1;
+  rt::spsc_queue<int> q1(b1);
+  if (q1.capacity() != 32 || !test_single_thread(q1))
+    return 1;
+
+  // Non trivial elements, some are left for the destructor.
+  std::vector<char> b2(rt::spsc_queue<std::string>::bytes_for(8));
+  rt::spsc_queue<std::string> q2(b2);
+  if (q2.capacity() != 8)
+    return 1;
+  for (int i = 0; i < 20; ++i) {
+    std::vector<std::string> tmp(2);
+    q2.try_emplace(i + 1, 'a');
+    q2.try_push(std::string(30, char('a' + i)));
+    if (q2.pop_n(tmp.data(), 1) != 1 || tmp[0].empty())
+      return 1;
+  }
+
+  std::vector<char> b3(rt::mpmc_queue<long>::bytes_for(16));
+  rt::mpmc_queue<long> q3(b3);
+  if (q3.capacity() != 16 || !test_single_thread(q3))
+    return 1;
+
+  if (!test_spsc_threads() || !test_mpmc_threads() || !test_node_handoff())
+    return 1;
+
+  return 0;
+}
+
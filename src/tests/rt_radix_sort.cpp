@@ -0,0 +1,96 @@
+#include <deque>
+#include <limits>
+#include <random>
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+
+#include <rtcpp/algorithm/radix_sort.hpp>
+
+template <unsigned Bits, class T>
+bool sorts(std::vector<T> v)
+{
+  std::vector<T> ref = v;
+  std::sort(std::begin(ref), std::end(ref));
+  std::vector<T> scratch(v.size());
+  if (Bits <= 11) {
+    rt::radix_sort<(Bits <= 11 ? Bits : 11)>(std::begin(v), std::end(v), scratch.data());
+  } else {
+    std::vector<std::size_t> count(std::size_t(1) << Bits);
+    rt::radix_sort<Bits>(std::begin(v), std::end(v), scratch.data(), count.data());
+  }
+  return v == ref;
+}
+
+template <class T>
+std::vector<T> random_values(std::size_t n, T a, T b)
+{
+  std::mt19937_64 gen(n);
+  std::vector<T> v(n);
+  for (auto& o: v) {
+    const double f = std::uniform_real_distribution<double>(0, 1)(gen);
+    o = static_cast<T>(a + f * (double(b) - double(a)));
+  }
+  return v;
+}
+
+template <unsigned Bits>
+bool test_keys()
+{
+  const std::size_t n = 10000;
+  const auto u32 = std::numeric_limits<std::uint32_t>::max();
+  const auto i64 = std::numeric_limits<std::int64_t>::max() / 2;
+  std::vector<float> f = random_values<float>(n, -1e6f, 1e6f);
+  f.push_back(-0.0f);
+  f.push_back(0.0f);
+  f.push_back(std::numeric_limits<float>::infinity());
+  f.push_back(-std::numeric_limits<float>::infinity());
+  f.push_back(std::numeric_limits<float>::lowest());
+  // Timestamps, the high bytes are the same.
+  std::vector<std::uint64_t> ts = random_values<std::uint64_t>(n, 1600000000000000000ull, 1600000000001000000ull);
+  return sorts<Bits>(random_values<std::uint32_t>(n, 0, u32))
+      && sorts<Bits>(random_values<std::int64_t>(n, -i64, i64))
+      && sorts<Bits>(random_values<int>(n, -100, 100))
+      && sorts<Bits>(random_values<double>(n, -1e300, 1e300))
+      && sorts<Bits>(random_values<signed char>(n, -128, 127))
+      && sorts<Bits>(f)
+      && sorts<Bits>(ts)
+      && sorts<Bits>(std::vector<int>())
+      && sorts<Bits>(std::vector<int>(1, 3));
+}
+
+struct record {
+  std::int32_t key;
+  std::size_t seq;
+};
+
+// Sorts by a key functor, equal keys keep their order.
+bool test_stable()
+{
+  std::vector<int> keys = random_values<int>(5000, -50, 50);
+  std::deque<record> v;
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    v.push_back(record {keys[i], i});
+  std::vector<record> scratch(v.size());
+  rt::radix_sort<11>( std::begin(v), std::end(v), scratch.data()
+                    , [](const record& r) { return r.key; });
+  for (std::size_t i = 1; i < v.size(); ++i) {
+    if (v[i - 1].key > v[i].key)
+      return false;
+    if (v[i - 1].key == v[i].key && v[i - 1].seq > v[i].seq)
+      return false;
+  }
+  return true;
+}
+
+int main()
+{
+  if (!test_keys<8>() || !test_keys<11>() || !test_keys<16>())
+    return 1;
+  if (!test_stable())
+    return 1;
+
+  return 0;
+}
+
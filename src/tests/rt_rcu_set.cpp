@@ -0,0 +1,152 @@
+#include <set>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/container/rcu_set.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+
+using node_type = rt::set<int>::node_type;
+using alloc_type = rt::node_allocator<int, node_type>;
+using rcu_type = rt::rcu_set<int, std::less<int>, alloc_type>;
+
+// Pools of n nodes for v versions.
+struct pools {
+  std::vector<std::vector<node_type>> buffers;
+  std::vector<rt::node_alloc_header> headers;
+  std::vector<alloc_type> allocs;
+  pools(std::size_t v, std::size_t n)
+  : buffers(v, std::vector<node_type>(n))
+  {
+    headers.reserve(v);
+    for (auto& b : buffers) {
+      headers.emplace_back(b);
+      allocs.emplace_back(&headers.back());
+    }
+  }
+};
+
+bool same(const rcu_type::set_type& s, const std::set<int>& ref)
+{
+  return s.size() == ref.size()
+      && std::equal(std::begin(s), std::end(s), std::begin(ref))
+      && std::equal(s.rbegin(), s.rend(), ref.rbegin());
+}
+
+bool test_single_thread()
+{
+  pools p(3, 1000);
+  rcu_type s(p.allocs, 2);
+  rcu_type::reader r(s);
+  std::set<int> ref;
+  for (int i = 0; i < 300; ++i) {
+    const int k = (i * 37) % 500;
+    if (s.insert(k) != ref.insert(k).second)
+      return false;
+  }
+  if (s.erase(37) != 1 || s.erase(37) != 0)
+    return false;
+  ref.erase(37);
+
+  if (!r.read([&](const rcu_type::set_type& v) { return same(v, ref); }))
+    return false;
+
+  // A version being read is left alone by the updates.
+  const bool kept = r.read([&](const rcu_type::set_type& v) {
+    s.update([](rcu_type::set_type& w) { w.clear(); });
+    s.insert(-1);
+    return same(v, ref) && s.reclaim(1000) == 0;
+  });
+  if (!kept)
+    return false;
+
+  // The versions replaced meanwhile are released in batches.
+  std::size_t n = 0;
+  for (std::size_t m = 1; m != 0; n += m)
+    if ((m = s.reclaim(100)) > 100)
+      return false;
+  if (n != ref.size())
+    return false;
+
+  const bool one = r.read([](const rcu_type::set_type& v) {
+    return v.size() == 1 && *std::begin(v) == -1;
+  });
+  if (!one)
+    return false;
+
+  rcu_type::reader r2(s);
+  try {
+    rcu_type::reader r3(s);
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+// The writer inserts 0, 1, 2, ... in order, every version is a prefix.
+bool test_threads()
+{
+  const int n = 2000;
+  const int n_readers = 3;
+  pools p(3, n + 2);
+  rcu_type s(p.allocs, n_readers);
+  std::atomic<bool> done(false);
+  std::atomic<bool> failed(false);
+
+  std::vector<std::thread> readers;
+  for (int t = 0; t < n_readers; ++t) {
+    readers.emplace_back([&]() {
+      rcu_type::reader r(s);
+      int last = 0;
+      while (!done.load()) {
+        const int size = r.read([&](const rcu_type::set_type& v) {
+          const int m = int(v.size());
+          int i = 0;
+          for (int k : v)
+            if (k != i++)
+              return -1;
+          return i == m ? m : -1;
+        });
+        if (size < last)
+          failed = true;
+        last = size;
+      }
+    });
+  }
+
+  for (int i = 0; i < n; i += 4) {
+    s.update([i](rcu_type::set_type& v) {
+      for (int j = i; j < i + 4; ++j)
+        v.insert(j);
+    });
+    s.reclaim(64);
+  }
+  done = true;
+  for (auto& t : readers)
+    t.join();
+
+  rcu_type::reader r(s);
+  return !failed && r.read([](const rcu_type::set_type& v) { return v.size(); }) == n;
+}
+
+int main()
+{
+  if (!test_single_thread() || !test_threads())
+    return 1;
+
+  try {
+    pools p(1, 10);
+    rcu_type s(p.allocs, 1);
+    return 1;
+  } catch (const std::runtime_error& e) {
+    std::cout << e.what() << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include <array>
+#include <memory>
+#include <cstdint>
+#include <iostream>
+
+#include <rtcpp/memory/rel_ptr.hpp>
+
+struct foo {
+  rt::rel_ptr<foo, std::int16_t> next;
+  int a;
+};
+
+int main()
+{
+  static_assert(sizeof (rt::rel_ptr<int, std::int16_t>) == 2, "");
+  static_assert(sizeof (rt::rel_ptr<int>) == 4, "");
+
+  std::array<foo, 4> arr = {{}};
+
+  for (auto& o: arr)
+    if (o.next)
+      return 1;
+
+  // Links all elements in a ring, including one to itself.
+  for (std::size_t i = 0; i < arr.size(); ++i) {
+    arr[i].a = static_cast<int>(i);
+    arr[i].next = &arr[(i + 1) % arr.size()];
+  }
+
+  foo* p = &arr[0];
+  for (std::size_t i = 0; i < arr.size(); ++i)
+    p = p->next;
+
+  if (p != &arr[0])
+    return 1;
+
+  // Copies point to the same object, not to the same distance.
+  arr[1].next = arr[3].next;
+  if (arr[1].next != &arr[0] || arr[1].next->a != 0)
+    return 1;
+
+  arr[2].next = &arr[2];
+  if (arr[2].next != &arr[2])
+    return 1;
+
+  arr[2].next = nullptr;
+  if (arr[2].next)
+    return 1;
+
+  using void_pointer = rt::rel_ptr<void, std::int16_t>;
+  using foo_pointer =
+    std::pointer_traits<void_pointer>::rebind<foo>;
+  // The pointer lives in the same buffer as its pointee.
+  struct bar {
+    foo_pointer q;
+    foo f[2];
+  } b = {};
+  b.f[1].a = 3;
+  b.q = &b.f[1];
+  if (b.q->a != 3 || (*b.q).a != 3)
+    return 1;
+
+  return 0;
+}
+
@@ -8,12 +8,19 @@
 #include <limits>
 #include <array>
 #include <vector>
+#include <string>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include <atomic>
 #include <ext/pool_allocator.h>
 #include <ext/bitmap_allocator.h>
 #include <ext/mt_allocator.h>
 
 #include <rtcpp/container/set.hpp>
+#include <rtcpp/container/set_algebra.hpp>
 #include <rtcpp/memory/node_allocator_lazy.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
 #include <rtcpp/utility/make_rand_data.hpp>
 #include <rtcpp/utility/print.hpp>
 
@@ -74,10 +81,14 @@ bool test_erase(C& t1, const std::vector<typename C::value_type>& arr)
   t1.clear();
 
   t1.insert(std::begin(arr), std::end(arr));
+  std::size_t n = t1.size();
   for (auto v : arr) { // Removes forward
     t1.erase(v);
     if (t1.find(v) != std::end(t1))
       return false;
+    t1.erase(v);
+    if (t1.size() != --n)
+      return false;
   }
 
   if (!t1.empty())
@@ -136,6 +147,7 @@ bool test_basic(C& t1, const std::vector<typename C::value_type>& tmp)
 {
   t1.clear();
   t1.insert(std::begin(tmp), std::end(tmp));
+  t1.insert(std::begin(tmp), std::end(tmp));
 
   if (t1.size() != tmp.size())
     return false;
@@ -144,7 +156,7 @@ bool test_basic(C& t1, const std::vector<typename C::value_type>& tmp)
     return false;
 
   C t3(t1);
-  if (t3 != t1)
+  if (t3 != t1 || t3.size() != t1.size())
     return false;
 
   C t4 = t3;
@@ -237,13 +249,1081 @@ bool run_tests_all()
   if (!run_tests(t9, tmp))
     return false;
 
+  // Nodes linked with 32 and 16 bits offsets.
+  using node_type = typename rt::set<T>::node_type;
+  using alloc32_type =
+    rt::node_allocator<T, node_type, rt::node_stack, std::uint32_t>;
+  using alloc16_type =
+    rt::node_allocator<T, node_type, rt::node_stack, std::uint16_t>;
+  using set32_type = rt::set<T, std::less<T>, alloc32_type>;
+  using set16_type = rt::set<T, std::less<T>, alloc16_type>;
+  static_assert( sizeof (typename set16_type::node_type) < sizeof (node_type)
+               , "Compact node is not smaller.");
+
+  std::vector<char> buffer3(2 * bsize);
+  std::vector<char> buffer4(60000);
+  rt::node_alloc_header header3(buffer3);
+  rt::node_alloc_header header4(buffer4);
+
+  alloc32_type alloc3(&header3);
+  alloc16_type alloc4(&header4);
+  set32_type t10(alloc3);
+  set16_type t11(alloc4);
+
+  if (!run_tests(t10, tmp))
+    return false;
+
+  if (!run_tests(t11, tmp))
+    return false;
+
+  using avl_type =
+    rt::set<T, std::less<T>, std::allocator<T>, rt::tbst::avl_balance>;
+  using avl16_type =
+    rt::set<T, std::less<T>, alloc16_type, rt::tbst::avl_balance>;
+  std::vector<char> buffer5(60000);
+  rt::node_alloc_header header5(buffer5);
+  alloc16_type alloc5(&header5);
+  avl_type t12;
+  avl16_type t13(alloc5);
+
+  if (!run_tests(t12, tmp))
+    return false;
+
+  if (!run_tests(t13, tmp))
+    return false;
+
+  using ranked_type =
+    rt::set<T, std::less<T>, std::allocator<T>, rt::tbst::ranked<>>;
+  ranked_type t14;
+  if (!run_tests(t14, tmp))
+    return false;
+
+  return true;
+}
+
+template <typename C>
+bool test_for_each_unordered(C& t1, const std::vector<typename C::value_type>& arr)
+{
+  using value_type = typename C::value_type;
+  t1.clear();
+  t1.insert(std::begin(arr), std::end(arr));
+  for (std::size_t i = 0; i < arr.size(); i += 3)
+    t1.erase(arr[i]);
+
+  std::vector<value_type> tmp;
+  t1.for_each_unordered([&](const value_type& o){ tmp.push_back(o);});
+  std::sort(std::begin(tmp), std::end(tmp));
+
+  if (tmp.size() != t1.size())
+    return false;
+
+  return std::equal(std::begin(tmp), std::end(tmp), std::begin(t1));
+}
+
+bool test_for_each_unordered()
+{
+  std::vector<int> arr = rt::make_rand_data<int>(1000, 1, 100000);
+
+  using node_type = rt::set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  std::vector<node_type> buffer(arr.size() + 2);
+  rt::node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  rt::set<int, std::less<int>, alloc_type> t1(alloc);
+  if (!test_for_each_unordered(t1, arr))
+    return false;
+
+  // Only the blocks marked in the bitmap are visited.
+  std::vector<node_type> buffer2(arr.size() + 2);
+  rt::node_alloc_header header2(buffer2);
+  std::vector<std::uint64_t> bitmap(header2.bitmap_words(sizeof (node_type)));
+  header2.use_bitmap(bitmap);
+  alloc_type alloc2(&header2);
+  rt::set<int, std::less<int>, alloc_type> t3(alloc2);
+  if (!test_for_each_unordered(t3, arr))
+    return false;
+
+  // Falls back to inorder traversal.
+  rt::set<int> t2;
+  if (!test_for_each_unordered(t2, arr))
+    return false;
+
+  return true;
+}
+
+// Returns the height of the subtree of p or -1 if it is not an AVL tree.
+template <class Ptr>
+int avl_height(Ptr p)
+{
+  const int l = rt::tbst::has_null_link<0>::apply(p) ? 0
+              : avl_height(static_cast<Ptr>(p->link[0]));
+  const int r = rt::tbst::has_null_link<1>::apply(p) ? 0
+              : avl_height(static_cast<Ptr>(p->link[1]));
+  if (l < 0 || r < 0)
+    return -1;
+
+  int b = 0;
+  if (p->tag & rt::tbst::detail::lhigh_bit)
+    b = -1;
+  if (p->tag & rt::tbst::detail::rhigh_bit)
+    b = 1;
+
+  if (r - l != b)
+    return -1;
+
+  return 1 + std::max(l, r);
+}
+
+template <class C>
+bool check_avl(const C& t1, std::size_t n)
+{
+  if (t1.size() != n || !std::is_sorted(std::begin(t1), std::end(t1)))
+    return false;
+
+  auto head = t1.end().m_p;
+  if (rt::tbst::has_null_link<0>::apply(head))
+    return n == 0;
+
+  const int h = avl_height(static_cast<decltype(head)>(head->link[0]));
+  return h >= 0 && h <= 1.45 * std::log2(n + 2);
+}
+
+bool test_avl_sorted()
+{
+  // Sorted keys would degenerate the unbalanced tree into a list.
+  const int n = 5000;
+  rt::set<int, std::less<int>, std::allocator<int>, rt::tbst::avl_balance> t1;
+  for (int i = 0; i < n; ++i)
+    t1.insert(i);
+
+  if (!check_avl(t1, n))
+    return false;
+
+  for (int i = n; i > -n; --i)
+    t1.insert(i);
+
+  if (!check_avl(t1, 2 * n))
+    return false;
+
+  // Erases every third key and the copy keeps the balance factors.
+  std::size_t m = 2 * n;
+  for (int i = -n + 1; i < n; i += 3) {
+    if (t1.erase(i) != 1)
+      return false;
+    --m;
+  }
+
+  if (!check_avl(t1, m))
+    return false;
+
+  auto t2 = t1;
+  if (t2 != t1 || !check_avl(t2, m))
+    return false;
+
+  std::vector<int> tmp = rt::make_rand_data<int>(2000, 1, 100000);
+  t1.clear();
+  t1.insert(std::begin(tmp), std::end(tmp));
+  for (std::size_t i = 0; i < tmp.size(); i += 2)
+    t1.erase(tmp[i]);
+
+  return check_avl(t1, tmp.size() / 2);
+}
+
+// Height of the tree, counting the root.
+template <class C>
+int tree_height(const C& t1)
+{
+  auto head = t1.end().m_p;
+  using ptr = decltype(head);
+  if (rt::tbst::has_null_link<0>::apply(head))
+    return 0;
+
+  int h = 0;
+  for (ptr p = head->link[0];; p = p->link[0]) {
+    ++h;
+    if (rt::tbst::has_null_link<0>::apply(p))
+      break;
+  }
+  return h;
+}
+
+bool test_bulk_build()
+{
+  using avl_type =
+    rt::set<int, std::less<int>, std::allocator<int>, rt::tbst::avl_balance>;
+
+  for (int n: {1, 2, 3, 7, 8, 1000, 1023, 1024, 4097}) {
+    std::vector<int> arr(n);
+    std::iota(std::begin(arr), std::end(arr), -n / 2);
+    const std::set<int> ref(std::begin(arr), std::end(arr));
+
+    // The range is detected as sorted.
+    rt::set<int> t1(std::begin(arr), std::end(arr));
+    int lg = 0;
+    while ((n >> lg) > 1)
+      ++lg;
+    if (tree_height(t1) != lg + 1)
+      return false;
+    if (!std::equal(std::begin(t1), std::end(t1), std::begin(ref))
+        || t1.size() != ref.size())
+      return false;
+    if (!std::equal(t1.rbegin(), t1.rend(), ref.rbegin()))
+      return false;
+    if (!std::all_of(std::begin(arr), std::end(arr), [&](int a)
+                     { return t1.count(a) == 1; }))
+      return false;
+
+    // The balance factors are valid and kept updated.
+    avl_type t2(rt::sorted_unique, std::begin(arr), std::end(arr));
+    if (!check_avl(t2, n))
+      return false;
+    for (int i = 0; i < n; i += 2)
+      t2.erase(arr[i]);
+    for (int i = 0; i < n; ++i)
+      t2.insert(n + i);
+    if (!check_avl(t2, n - (n + 1) / 2 + n))
+      return false;
+
+    rt::set<int> t3;
+    t3.insert(rt::sorted_unique, std::begin(arr), std::end(arr));
+    if (t3 != t1)
+      return false;
+  }
+
+  // Nodes allocated so far are released if the buffer is too small.
+  using node_type = rt::set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  std::vector<node_type> buffer(100);
+  rt::node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  std::vector<int> arr(200);
+  std::iota(std::begin(arr), std::end(arr), 0);
+  try {
+    rt::set<int, std::less<int>, alloc_type>
+      t1(rt::sorted_unique, std::begin(arr), std::end(arr), alloc);
+    return false;
+  } catch (const std::bad_alloc&) {
+  }
+
+  rt::set<int, std::less<int>, alloc_type>
+    t1(rt::sorted_unique, std::begin(arr), std::begin(arr) + 98, alloc);
+  return t1.size() == 98;
+}
+
+template <class C>
+bool test_find_many(C& t1, const std::vector<typename C::value_type>& arr)
+{
+  using value_type = typename C::value_type;
+  std::vector<typename C::iterator> res;
+  // Nothing is found in an empty set.
+  t1.clear();
+  t1.find_many(std::begin(arr), std::end(arr), std::back_inserter(res));
+  if (res.size() != arr.size() || t1.count_many(std::begin(arr), std::end(arr)))
+    return false;
+  if (!std::all_of(std::begin(res), std::end(res), [&](typename C::iterator i)
+                   { return i == t1.end(); }))
+    return false;
+
+  // Half the keys are present, the misses have key + 1.
+  for (std::size_t i = 0; i < arr.size(); i += 2)
+    t1.insert(arr[i]);
+
+  std::vector<value_type> keys;
+  for (auto o: arr) {
+    keys.push_back(o);
+    keys.push_back(o + 1);
+  }
+
+  res.clear();
+  t1.find_many(std::begin(keys), std::end(keys), std::back_inserter(res));
+  if (res.size() != keys.size())
+    return false;
+
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    if (res[i] != t1.find(keys[i]))
+      return false;
+
+  const std::size_t c = std::count_if(std::begin(keys), std::end(keys),
+    [&](const value_type& o) { return t1.count(o) != 0; });
+  return c == t1.count_many(std::begin(keys), std::end(keys));
+}
+
+template <class C>
+bool test_set_algebra(const std::vector<int>& a, const std::vector<int>& b)
+{
+  const C t1(std::begin(a), std::end(a));
+  const C t2(std::begin(b), std::end(b));
+  const std::set<int> s1(std::begin(a), std::end(a));
+  const std::set<int> s2(std::begin(b), std::end(b));
+
+  auto expect = [&](const C& r, int op) -> bool
+  {
+    std::vector<int> tmp;
+    auto out = std::back_inserter(tmp);
+    const auto b1 = std::begin(s1), e1 = std::end(s1);
+    const auto b2 = std::begin(s2), e2 = std::end(s2);
+    switch (op) {
+      case 0: std::set_union(b1, e1, b2, e2, out); break;
+      case 1: std::set_intersection(b1, e1, b2, e2, out); break;
+      case 2: std::set_difference(b1, e1, b2, e2, out); break;
+      default: std::set_symmetric_difference(b1, e1, b2, e2, out);
+    }
+    return r.size() == tmp.size()
+        && std::equal(std::begin(r), std::end(r), std::begin(tmp));
+  };
+
+  if (!expect(rt::set_union(t1, t2), 0))
+    return false;
+  if (!expect(rt::set_intersection(t1, t2), 1))
+    return false;
+  if (!expect(rt::set_difference(t1, t2), 2))
+    return false;
+  if (!expect(rt::set_symmetric_difference(t1, t2), 3))
+    return false;
+
+  // Elements present in both stay in the source.
+  C t3(t1);
+  C t4(t2);
+  t3.merge(t4);
+  if (!expect(t3, 0))
+    return false;
+
+  C t5(t1);
+  if (t4 != rt::set_intersection(t5, t2))
+    return false;
+
+  t3.merge(C(std::begin(b), std::end(b)));
+  return expect(t3, 0);
+}
+
+bool test_merge_shared_header()
+{
+  // Nodes move between sets that share the buffer.
+  using node_type = rt::set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  std::vector<node_type> buffer(2003);
+  rt::node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  std::vector<int> a(1000);
+  std::iota(std::begin(a), std::end(a), 0);
+  std::vector<int> b(1000);
+  std::iota(std::begin(b), std::end(b), 500);
+
+  rt::set<int, std::less<int>, alloc_type> t1(std::begin(a), std::end(a), alloc);
+  rt::set<int, std::less<int>, alloc_type> t2(std::begin(b), std::end(b), alloc);
+  // The buffer is full now, splicing needs no allocation.
+  t1.merge(t2);
+  if (t1.size() != 1500 || t2.size() != 500)
+    return false;
+
+  if (!std::equal(std::begin(t2), std::end(t2), std::begin(b)))
+    return false;
+
+  return std::is_sorted(std::begin(t1), std::end(t1))
+      && *t1.begin() == 0 && *t1.rbegin() == 1499;
+}
+
+bool test_node_handle()
+{
+  // Nodes move between sets sharing a full buffer.
+  using node_type = rt::set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  using set_type = rt::set<int, std::less<int>, alloc_type>;
+  std::vector<node_type> buffer(13);
+  rt::node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  set_type t1({1, 2, 3, 4, 5}, alloc);
+  set_type t2({4, 5, 6, 7, 8}, alloc);
+
+  auto nh = t1.extract(3);
+  if (nh.empty() || nh.value() != 3 || t1.size() != 4 || t1.count(3))
+    return false;
+
+  if (!t1.extract(3).empty())
+    return false;
+
+  auto r1 = t2.insert(std::move(nh));
+  if (!nh.empty() || !r1.inserted || *r1.position != 3 || t2.size() != 6)
+    return false;
+
+  // The key is already there, the node comes back.
+  auto r2 = t2.insert(t1.extract(t1.find(5)));
+  if (r2.inserted || t2.size() != 6)
+    return false;
+
+  r2.node.value() = 0;
+  auto r3 = t1.insert(std::move(r2.node));
+  if (!r3.inserted || *t1.begin() != 0)
+    return false;
+
+  // A dropped handle frees its node.
+  t1.extract(4);
+  t1.insert(9);
+  const int r[] = {0, 1, 2, 9};
+  return std::equal(std::begin(r), std::end(r), std::begin(t1))
+      && t1.size() == 4;
+}
+
+struct counting_less {
+  std::size_t* n;
+  bool operator()(int a, int b) const { ++*n; return a < b; }
+};
+
+// Extraction by position finds the parent through the threads.
+bool test_extract_position()
+{
+  std::size_t n = 0;
+  rt::set<int, counting_less> t1({1, 2, 3, 4, 5}, counting_less{&n});
+  n = 0;
+  auto nh = t1.extract(std::next(t1.begin(), 2));
+  auto nh2 = t1.extract(t1.begin());
+  const int r[] = {2, 4, 5};
+  return n == 0 && nh.value() == 3 && nh2.value() == 1 && t1.size() == 3
+      && std::equal(std::begin(r), std::end(r), std::begin(t1));
+}
+
+// Merging walks both trees, without searches the comparisons are
+// linear in the sizes.
+bool test_merge_linear()
+{
+  std::size_t n = 0;
+  std::vector<int> a(1000);
+  std::vector<int> b(1000);
+  for (int i = 0; i < 1000; ++i) {
+    a[i] = 2 * i;
+    b[i] = 3 * i;
+  }
+  std::mt19937 gen(3);
+  std::shuffle(std::begin(a), std::end(a), gen);
+  std::shuffle(std::begin(b), std::end(b), gen);
+  rt::set<int, counting_less> t1(std::begin(a), std::end(a), counting_less{&n});
+  rt::set<int, counting_less> t2(std::begin(b), std::end(b), counting_less{&n});
+  std::set<int> ref(std::begin(a), std::end(a));
+  ref.insert(std::begin(b), std::end(b));
+  n = 0;
+  t1.merge(t2);
+  return n <= 5 * (a.size() + b.size()) && t1.size() == ref.size()
+      && std::equal(std::begin(t1), std::end(t1), std::begin(ref))
+      && std::equal(t1.rbegin(), t1.rend(), ref.rbegin())
+      && t2.size() == 334 && std::all_of(std::begin(t2), std::end(t2),
+                                         [](int v) { return v % 6 == 0; });
+}
+
+bool test_emplace()
+{
+  rt::set<std::string> t1;
+  std::string a(100, 'a');
+  if (!t1.insert(std::move(a)).second || !a.empty())
+    return false;
+
+  // Nothing is moved from when the key is present.
+  std::string b(100, 'a');
+  if (t1.insert(std::move(b)).second || b.size() != 100)
+    return false;
+
+  if (!t1.emplace(3, 'b').second || t1.emplace(3, 'b').second)
+    return false;
+
+  if (*t1.emplace_hint(t1.end(), 2, 'c') != "cc" || t1.size() != 3)
+    return false;
+
+  // A wrong hint still puts the element in place.
+  t1.emplace_hint(t1.begin(), "zz");
+  t1.emplace_hint(t1.end(), "b");
+  if (!std::is_sorted(std::begin(t1), std::end(t1)) || t1.size() != 5)
+    return false;
+
+  // Appending increasing keys at the end compares each key twice only.
+  std::size_t n = 0;
+  rt::set<int, counting_less> t2(counting_less{&n});
+  const int size = 1000;
+  for (int i = 0; i < size; ++i)
+    t2.emplace_hint(t2.end(), i);
+  if (n > 2 * size || t2.size() != size || *t2.rbegin() != size - 1)
+    return false;
+
+  std::vector<int> arr = rt::make_rand_data<int>(1000, 1, 100000);
+  rt::set<int, std::less<int>, std::allocator<int>, rt::tbst::avl_balance> t3;
+  std::copy(std::begin(arr), std::end(arr), std::inserter(t3, t3.end()));
+  for (auto o: arr)
+    t3.emplace_hint(t3.find(o), o);
+  if (!check_avl(t3, arr.size()))
+    return false;
+
+  rt::set<int> t4;
+  std::copy(std::begin(arr), std::end(arr), std::inserter(t4, t4.begin()));
+  return std::equal(std::begin(t3), std::end(t3), std::begin(t4))
+      && t4.size() == arr.size();
+}
+
+template <class C>
+bool test_erase_position(const std::vector<int>& arr)
+{
+  C t1(std::begin(arr), std::end(arr));
+  std::set<int> ref(std::begin(arr), std::end(arr));
+
+  // Every other element, by iterator.
+  for (auto iter = t1.begin(); iter != t1.end();) {
+    iter = t1.erase(iter);
+    if (iter != t1.end())
+      ++iter;
+  }
+  for (auto iter = ref.begin(); iter != ref.end();) {
+    iter = ref.erase(iter);
+    if (iter != ref.end())
+      ++iter;
+  }
+  if (t1.size() != ref.size()
+      || !std::equal(std::begin(t1), std::end(t1), std::begin(ref)))
+    return false;
+
+  // A range in the middle and a prefix, like expiring a time window.
+  const std::size_t m = t1.size() / 4;
+  auto first = std::next(t1.begin(), m);
+  auto last = std::next(first, m);
+  const int next = *last;
+  if (*t1.erase(first, last) != next)
+    return false;
+  ref.erase(std::next(ref.begin(), m), std::next(ref.begin(), 2 * m));
+  t1.erase(t1.begin(), std::next(t1.begin(), 10));
+  ref.erase(ref.begin(), std::next(ref.begin(), 10));
+  if (t1.size() != ref.size()
+      || !std::equal(std::begin(t1), std::end(t1), std::begin(ref))
+      || !std::equal(t1.rbegin(), t1.rend(), ref.rbegin()))
+    return false;
+
+  auto pred = [](int a) { return a % 3 == 0; };
+  std::size_t n = 0;
+  for (auto iter = ref.begin(); iter != ref.end();) {
+    if (pred(*iter)) {
+      iter = ref.erase(iter);
+      ++n;
+    } else {
+      ++iter;
+    }
+  }
+  if (rt::erase_if(t1, pred) != n || t1.size() != ref.size()
+      || !std::equal(std::begin(t1), std::end(t1), std::begin(ref)))
+    return false;
+
+  for (auto o: ref)
+    if (t1.count(o) != 1)
+      return false;
+
+  if (t1.erase(t1.begin(), t1.end()) != t1.end() || !t1.empty())
+    return false;
+
+  // Erasing all but the last from the front.
+  C t2(std::begin(arr), std::end(arr));
+  t2.erase(t2.begin(), std::prev(t2.end()));
+  return t2.size() == 1
+      && *t2.begin() == *std::max_element(std::begin(arr), std::end(arr));
+}
+
+template <class C>
+bool test_bounds(const std::vector<int>& arr)
+{
+  const C t1(std::begin(arr), std::end(arr));
+  const std::set<int> ref(std::begin(arr), std::end(arr));
+  auto pos = [](const C& c, typename C::const_iterator iter)
+  { return std::distance(c.begin(), iter); };
+  auto ref_pos = [&](std::set<int>::const_iterator iter)
+  { return std::distance(ref.begin(), iter); };
+
+  // Present keys, their neighbours and keys outside the range.
+  std::vector<int> keys = {-1, 0, std::numeric_limits<int>::max()};
+  for (auto o: arr) {
+    keys.push_back(o);
+    keys.push_back(o + 1);
+    keys.push_back(o - 1);
+  }
+
+  for (std::size_t i = 0; i < keys.size(); i += 7) {
+    const int k = keys[i];
+    if (pos(t1, t1.lower_bound(k)) != ref_pos(ref.lower_bound(k)))
+      return false;
+    if (pos(t1, t1.upper_bound(k)) != ref_pos(ref.upper_bound(k)))
+      return false;
+    auto r = t1.equal_range(k);
+    if (std::distance(r.first, r.second) != static_cast<long>(ref.count(k)))
+      return false;
+    if (r.first != t1.lower_bound(k) || r.second != t1.upper_bound(k))
+      return false;
+  }
+
+  // A range scan.
+  const int a = *std::next(ref.begin(), ref.size() / 3);
+  const int b = a + 5000;
+  std::vector<int> tmp(t1.lower_bound(a), t1.upper_bound(b));
+  if (!std::equal(std::begin(tmp), std::end(tmp), ref.lower_bound(a))
+      || static_cast<long>(tmp.size())
+         != std::distance(ref.lower_bound(a), ref.upper_bound(b)))
+    return false;
+
+  const C t2;
+  return t2.lower_bound(1) == t2.end() && t2.upper_bound(1) == t2.end();
+}
+
+bool test_heterogeneous_bounds()
+{
+  rt::set<std::string, std::less<>> t1 = {"b", "d", "f"};
+  const char* c = "c";
+  const char* d = "d";
+  return *t1.lower_bound(c) == "d" && *t1.upper_bound(d) == "f"
+      && *t1.equal_range(d).first == "d"
+      && t1.equal_range(c).first == t1.equal_range(c).second;
+}
+
+// A run of consecutive integers, concatenating out of order fails.
+struct run {
+  int first;
+  int last;
+  bool ok;
+  run(int a) : first(a), last(a), ok(true) {}
+};
+
+struct run_concat {
+  run operator()(run a, const run& b) const
+  {
+    a.ok = a.ok && b.ok && a.last + 1 == b.first;
+    a.last = b.last;
+    return a;
+  }
+  run operator()(run a, int b) const { return (*this)(a, run(b)); }
+};
+
+template <class C>
+bool test_parallel(int n)
+{
+  std::vector<int> arr(n);
+  std::iota(std::begin(arr), std::end(arr), -n / 2);
+  const C t1(rt::sorted_unique, std::begin(arr), std::end(arr));
+  for (std::size_t threads: {1, 2, 3, 8, 0}) {
+    C t2;
+    t2.insert(rt::sorted_unique, std::begin(arr), std::end(arr), threads);
+    if (t2 != t1 || tree_height(t2) != tree_height(t1)
+        || !std::equal(t2.rbegin(), t2.rend(), t1.rbegin()))
+      return false;
+
+    for (auto o: arr)
+      if (t2.count(o) != 1)
+        return false;
+
+    std::atomic<long long> sum(0);
+    t2.parallel_for_each([&](int a) { sum += a; }, threads);
+    const long long ref = std::accumulate(std::begin(arr), std::end(arr), 0ll);
+    if (sum != ref)
+      return false;
+
+    auto plus = [](long long a, long long b) { return a + b; };
+    if (t2.parallel_reduce(7ll, plus, threads) != ref + 7)
+      return false;
+
+    // Not commutative, the ranges must be combined in order.
+    const run r = t2.parallel_reduce(run(arr.front() - 1), run_concat(), threads);
+    if (!r.ok || r.first != arr.front() - 1 || r.last != arr.back())
+      return false;
+  }
+
+  // Unbalanced trees are split as well.
+  C t3(std::begin(arr), std::begin(arr) + 1000);
+  std::atomic<int> count(0);
+  t3.parallel_for_each([&](int) { ++count; }, 4);
+  return count == 1000;
+}
+
+template <class T>
+T make_key(int i) { return i; }
+
+template <>
+std::string make_key<std::string>(int i) { return std::to_string(i); }
+
+// Blocks left in the avail stack of the header of alloc.
+template <class Node, class Alloc>
+std::size_t count_free_blocks(const Alloc& alloc)
+{
+  typename Alloc::template rebind<Node>::other a(alloc);
+  std::vector<Node*> blocks;
+  try {
+    for (;;)
+      blocks.push_back(a.allocate_node());
+  } catch (const std::bad_alloc&) {}
+  for (auto iter = blocks.rbegin(); iter != blocks.rend(); ++iter)
+    a.deallocate_node(*iter);
+  return blocks.size();
+}
+
+// Churns a set in its own buffer and compacts it a few nodes at a time.
+template <class T, class Alloc, class Balance>
+bool test_compaction(const std::vector<int>& arr, std::size_t budget)
+{
+  using set_type = rt::set<T, std::less<T>, Alloc, Balance>;
+  using node_type = typename set_type::node_type;
+  std::vector<char> buffer(2 * arr.size() * sizeof (node_type));
+  rt::node_alloc_header header(buffer);
+  Alloc alloc(&header);
+  set_type t1(alloc);
+  std::set<T> ref;
+
+  auto churn = [&]()
+  {
+    for (auto o: arr) {
+      t1.insert(make_key<T>(o));
+      ref.insert(make_key<T>(o));
+    }
+    for (auto o: arr) {
+      if (o % 3 == 0) {
+        t1.erase(make_key<T>(o));
+        ref.erase(make_key<T>(o));
+      }
+    }
+    for (auto o: arr) {
+      if (o % 6 == 0) {
+        t1.insert(make_key<T>(o + 1));
+        ref.insert(make_key<T>(o + 1));
+      }
+    }
+  };
+
+  // Nodes are in inorder from block 0, the head first, and the next
+  // allocation takes the block after them.
+  auto compacted = [&]()
+  {
+    const char* first = header.buffer + header.block_size;
+    if (t1.end().m_p != reinterpret_cast<const node_type*>(first))
+      return false;
+    std::size_t k = 1;
+    for (auto iter = t1.begin(); iter != t1.end(); ++iter, ++k)
+      if (iter.m_p != reinterpret_cast<const node_type*>(first + k * header.block_size))
+        return false;
+    const T key = make_key<T>(-1);
+    auto pos = t1.insert(key).first.m_p;
+    t1.erase(key);
+    return pos == reinterpret_cast<const node_type*>(first + k * header.block_size)
+        && std::equal(std::begin(ref), std::end(ref), std::begin(t1));
+  };
+
+  churn();
+  std::size_t n_free = count_free_blocks<node_type>(alloc);
+  {
+    typename set_type::compaction c(t1);
+    while (!c.step(budget))
+      if (t1.size() != ref.size()
+          || !std::equal(std::begin(ref), std::end(ref), std::begin(t1)))
+        return false;
+  }
+  if (!compacted() || count_free_blocks<node_type>(alloc) != n_free)
+    return false;
+
+  // Abandoned halfway, the free blocks are given back.
+  churn();
+  n_free = count_free_blocks<node_type>(alloc);
+  {
+    typename set_type::compaction c(t1);
+    c.step(n_free + t1.size() / 2);
+  }
+  if (count_free_blocks<node_type>(alloc) != n_free
+      || !std::equal(std::begin(ref), std::end(ref), std::begin(t1)))
+    return false;
+
+  t1.compact();
+  if (!compacted())
+    return false;
+
+  // Compacting again changes nothing.
+  t1.compact();
+  if (!compacted())
+    return false;
+
+  t1.clear();
+  ref.clear();
+  t1.compact();
+  return compacted();
+}
+
+bool test_compaction()
+{
+  std::vector<int> arr = rt::make_rand_data<int>(1000, 1, 100000);
+  using node_type = rt::set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  using string_node = rt::set<std::string>::node_type;
+  using string_alloc = rt::node_allocator<std::string, string_node>;
+  using node32_type = rt::set<int, std::less<int>,
+    rt::node_allocator<int, node_type, rt::node_stack, std::uint32_t>>::node_type;
+  using alloc32_type =
+    rt::node_allocator<int, node32_type, rt::node_stack, std::uint32_t>;
+  using rt::tbst::no_balance;
+  using rt::tbst::avl_balance;
+  return test_compaction<int, alloc_type, no_balance>(arr, 7)
+      && test_compaction<int, alloc_type, avl_balance>(arr, 1)
+      && test_compaction<std::string, string_alloc, no_balance>(arr, 64)
+      && test_compaction<int, alloc32_type, avl_balance>(arr, 5);
+}
+
+bool test_compact_buffer_size()
+{
+  // The buffer cannot be addressed with 16 bits offsets.
+  using node_type = rt::set<int>::node_type;
+  using alloc_type =
+    rt::node_allocator<int, node_type, rt::node_stack, std::uint16_t>;
+  std::vector<char> buffer(1 << 17);
+  rt::node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  try {
+    rt::set<int, std::less<int>, alloc_type> t1(alloc);
+  } catch (const std::exception& e) {
+    std::cout << e.what() << std::endl;
+    return true;
+  }
+  return false;
+}
+
+// Whether every key is at the same offset from the start of the
+// buffer in both sets, as after a copy of the buffer. A node by node
+// copy may put a few keys at the same offset by chance, not all.
+template <class C>
+bool same_layout( const C& s1, const rt::node_alloc_header& h1
+                , const C& s2, const rt::node_alloc_header& h2)
+{
+  auto offset = [](const typename C::value_type& k, const rt::node_alloc_header& h)
+  { return reinterpret_cast<const char*>(&k) - h.buffer; };
+  return s1.size() == s2.size()
+      && std::equal(std::begin(s1), std::end(s1), std::begin(s2),
+           [&](const typename C::value_type& a, const typename C::value_type& b)
+           { return offset(a, h1) == offset(b, h2); });
+}
+
+template <class T>
+T clone_key(int k) { return T(k); }
+
+template <>
+std::string clone_key<std::string>(int k) { return std::to_string(k); }
+
+template <class T, class Alloc>
+bool test_clone(const std::vector<int>& arr, bool bitmap, std::size_t size2, bool buffer_copy)
+{
+  using set_type = rt::set<T, std::less<T>, Alloc>;
+  using node_type = typename set_type::node_type;
+  std::vector<node_type> buffer1(arr.size() + 2);
+  std::vector<node_type> buffer2(size2);
+  rt::node_alloc_header h1(buffer1);
+  rt::node_alloc_header h2(buffer2);
+  std::vector<std::uint64_t> bits1(h1.bitmap_words(sizeof (node_type)));
+  std::vector<std::uint64_t> bits2(h2.bitmap_words(sizeof (node_type)));
+  if (bitmap) {
+    h1.use_bitmap(bits1);
+    h2.use_bitmap(bits2);
+  }
+
+  set_type s1{Alloc(&h1)};
+  for (int k : arr)
+    s1.insert(clone_key<T>(k));
+  for (std::size_t i = 0; i < arr.size(); i += 3)
+    s1.erase(clone_key<T>(arr[i]));
+  std::set<T> ref(std::begin(s1), std::end(s1));
+
+  set_type s2(s1, Alloc(&h2));
+  if (!std::equal(std::begin(s2), std::end(s2), std::begin(ref)) || s2.size() != ref.size())
+    return false;
+  if (buffer_copy != same_layout(s2, h2, s1, h1))
+    return false;
+
+  // Independent of the source, the free blocks are usable.
+  s1.clear();
+  std::set<T> ref2 = ref;
+  for (int i = 0; s2.size() + 2 < size2; ++i) {
+    s2.insert(clone_key<T>(-i));
+    ref2.insert(clone_key<T>(-i));
+  }
+  return std::equal(std::begin(s2), std::end(s2), std::begin(ref2))
+      && std::equal(s2.rbegin(), s2.rend(), ref2.rbegin()) && s1.empty();
+}
+
+// nth, rank and count_range against the sorted keys.
+template <class C>
+bool test_ranks(const C& t1)
+{
+  const std::vector<int> v(std::begin(t1), std::end(t1));
+  if (t1.nth(v.size()) != std::end(t1) || t1.rank(v.empty() ? 0 : v.back() + 1) != v.size())
+    return false;
+  for (std::size_t k = 0; k < v.size(); ++k)
+    if (*t1.nth(k) != v[k] || t1.rank(v[k]) != k || t1.rank(v[k] + 1) != k + 1)
+      return false;
+  for (std::size_t k = 0; k + 7 < v.size(); k += 7)
+    if (t1.count_range(v[k], v[k + 7]) != 7 || t1.count_range(v[k + 7], v[k]) != 0)
+      return false;
   return true;
 }
 
+template <class C>
+bool test_ranked(const std::vector<int>& arr)
+{
+  C t1;
+  if (!test_ranks(t1) || t1.rank(3) != 0)
+    return false;
+
+  std::mt19937 gen(7);
+  for (std::size_t i = 0; i < arr.size(); ++i) {
+    t1.insert(arr[i]);
+    if (i % 5 == 0)
+      t1.erase(arr[gen() % (i + 1)]);
+    if (i % 7 == 0 && !t1.empty())
+      t1.erase(t1.nth(gen() % t1.size()));
+    if (i % 100 == 0 && !test_ranks(t1))
+      return false;
+  }
+  if (!test_ranks(t1))
+    return false;
+
+  // Node handles, hints, merge and copies.
+  auto nh = t1.extract(*t1.nth(t1.size() / 2));
+  nh.value() = -1;
+  t1.insert(std::move(nh));
+  t1.insert(std::end(t1), 1 << 30);
+  C t2 = {5, -7, 100001};
+  t1.merge(t2);
+  const C t3(t1);
+  if (!test_ranks(t1) || !test_ranks(t3) || !test_ranks(t2))
+    return false;
+
+  // Sorted bulk builds, in parallel as well.
+  const int m = (1 << 30) + 1;
+  std::vector<int> sorted(std::begin(t1), std::end(t1));
+  for (int i = 0; i < 20000; ++i)
+    sorted.push_back(m + i);
+  const C t4(rt::sorted_unique, std::begin(sorted), std::end(sorted));
+  C t5;
+  t5.insert(rt::sorted_unique, std::begin(sorted), std::end(sorted), 4);
+  if (!test_ranks(t4) || !test_ranks(t5))
+    return false;
+  for (int i = 0; i < 20000; i += 3)
+    t5.erase(m + i);
+  return test_ranks(t5) && *t5.nth(t5.size() - 1) == m + 19999;
+}
+
+// Its copies throw while fail is set.
+struct throwing_key {
+  static bool fail;
+  int v;
+  throwing_key(int x) : v(x) {}
+  throwing_key(const throwing_key& rhs) : v(rhs.v)
+  {
+    if (fail)
+      throw std::runtime_error("throwing_key: Copy failed.");
+  }
+  bool operator<(const throwing_key& rhs) const { return v < rhs.v; }
+};
+
+bool throwing_key::fail = false;
+
+// An insertion whose key cannot be copied leaves the counts as they were.
+template <class Balance>
+bool test_ranked_throw()
+{
+  rt::set<throwing_key, std::less<throwing_key>, std::allocator<throwing_key>, Balance> t1;
+  for (int i = 0; i < 200; ++i)
+    t1.insert(throwing_key(2 * i));
+  for (int i = 1; i < 400; i += 40) {
+    throwing_key::fail = true;
+    try {
+      t1.insert(throwing_key(i));
+      throwing_key::fail = false;
+      return false;
+    } catch (const std::runtime_error&) {
+    }
+    throwing_key::fail = false;
+  }
+  if (t1.size() != 200)
+    return false;
+  for (int i = 0; i < 200; ++i)
+    if ((*t1.nth(i)).v != 2 * i || t1.rank(throwing_key(2 * i + 1)) != std::size_t(i + 1))
+      return false;
+  return t1.nth(200) == std::end(t1);
+}
+
+bool test_ranked()
+{
+  const std::vector<int> arr = rt::make_rand_data<int>(3000, 1, 100000);
+  using ranked_avl = rt::set<int, std::less<int>, std::allocator<int>, rt::tbst::ranked<>>;
+  using ranked_plain = rt::set< int, std::less<int>, std::allocator<int>
+                              , rt::tbst::ranked<rt::tbst::no_balance>>;
+  std::vector<int> sorted(2000);
+  std::iota(std::begin(sorted), std::end(sorted), 0);
+
+  // Compaction keeps the counts with the nodes.
+  using node_type = ranked_avl::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  using set_type = rt::set<int, std::less<int>, alloc_type, rt::tbst::ranked<>>;
+  std::vector<node_type> buffer(arr.size() + 2);
+  rt::node_alloc_header header(buffer);
+  set_type t1{alloc_type(&header)};
+  for (int k : arr)
+    t1.insert(k);
+  for (std::size_t i = 0; i < arr.size(); i += 2)
+    t1.erase(arr[i]);
+  t1.compact();
+
+  return test_ranked<ranked_avl>(arr) && test_ranked<ranked_plain>(arr)
+      && test_ranked<ranked_avl>(sorted) && test_ranked<ranked_plain>(sorted)
+      && test_ranks(t1) && test_erase_position<ranked_avl>(arr)
+      && test_bounds<ranked_plain>(arr) && test_parallel<ranked_avl>(50001)
+      && test_ranked_throw<rt::tbst::ranked<>>()
+      && test_ranked_throw<rt::tbst::ranked<rt::tbst::no_balance>>();
+}
+
+bool test_clone()
+{
+  const std::vector<int> arr = rt::make_rand_data<int>(1000, 1, 100000);
+  const std::size_t n = arr.size();
+  using node_type = rt::set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  using node32_type = rt::set<int, std::less<int>,
+    rt::node_allocator<int, node_type, rt::node_stack, std::uint32_t>>::node_type;
+  using alloc32_type =
+    rt::node_allocator<int, node32_type, rt::node_stack, std::uint32_t>;
+  using string_node = rt::set<std::string>::node_type;
+  using string_alloc = rt::node_allocator<std::string, string_node>;
+  using lazy_alloc = rt::node_allocator_lazy<int>;
+  return test_clone<int, alloc_type>(arr, false, n + 500, true)
+      && test_clone<int, alloc_type>(arr, true, n + 500, true)
+      && test_clone<int, alloc32_type>(arr, false, n + 2, true)
+      && test_clone<int, alloc32_type>(arr, true, n + 100, true)
+      // Smaller target, keys not trivially copyable, another stack.
+      && test_clone<int, alloc_type>(arr, false, n, false)
+      && test_clone<std::string, string_alloc>(arr, false, n + 500, false)
+      && test_clone<int, lazy_alloc>(arr, false, n + 500, false);
+}
+
 int main()
 {
   const bool b1 = run_tests_all<int>();
   const bool b2 = run_tests_all<long long int>();
-  return (b1 && b2) ? 0 : 1;
+  const bool b3 = test_compact_buffer_size();
+  const bool b4 = test_for_each_unordered();
+  const bool b5 = test_avl_sorted();
+  const bool b6 = test_bulk_build();
+
+  rt::set<int> t1;
+  rt::set<int, std::less<int>, std::allocator<int>, rt::tbst::avl_balance> t2;
+  std::vector<int> arr = rt::make_rand_data<int>(1000, 1, 100000);
+  const bool b7 = test_find_many(t1, arr) && test_find_many(t2, arr);
+
+  using avl_type =
+    rt::set<int, std::less<int>, std::allocator<int>, rt::tbst::avl_balance>;
+  std::vector<int> arr2 = rt::make_rand_data<int>(1000, 1, 100000);
+  arr2.insert(std::end(arr2), std::begin(arr), std::begin(arr) + 300);
+  const bool b8 = test_set_algebra<rt::set<int>>(arr, arr2)
+               && test_set_algebra<avl_type>(arr, arr2)
+               && test_merge_shared_header() && test_node_handle()
+               && test_extract_position() && test_merge_linear()
+               && test_emplace()
+               && test_erase_position<rt::set<int>>(arr)
+               && test_erase_position<avl_type>(arr);
+  const bool b9 = test_bounds<rt::set<int>>(arr) && test_bounds<avl_type>(arr)
+               && test_heterogeneous_bounds()
+               && test_parallel<rt::set<int>>(100000)
+               && test_parallel<avl_type>(50001);
+  const bool b10 = test_compaction() && test_clone() && test_ranked();
+  return (b1 && b2 && b3 && b4 && b5 && b6 && b7 && b8 && b9 && b10) ? 0 : 1;
 }
 
@@ -0,0 +1,115 @@
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <rtcpp/container/forward_list.hpp>
+#include <rtcpp/memory/shm_pool.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/atomic_node_stack.hpp>
+
+using node_type = rt::forward_list_node<int, rt::rel_ptr<void, std::int32_t>>;
+using alloc_type =
+  rt::node_allocator<int, node_type, rt::atomic_node_stack, std::uint32_t>;
+using list_type = rt::forward_list<int, alloc_type>;
+using pool_type = rt::shm_pool<node_type>;
+
+static_assert( std::is_same<list_type::node_type, node_type>::value
+             , "The list should link its nodes with rel_ptr.");
+
+const int n = 1000;
+
+// Allocates and releases from the shared free list, so that both
+// processes pop and push at the same time.
+bool churn(list_type& l, int seed)
+{
+  for (int i = 0; i < 200; ++i) {
+    for (int j = 0; j < 100; ++j)
+      l.push_front(seed + j);
+    l.clear();
+  }
+  return l.empty();
+}
+
+int child(const char* name)
+{
+  // A new mapping, at another address than the one inherited.
+  pool_type pool(name, 0);
+  if (pool.created())
+    return 1;
+
+  alloc_type alloc(&pool.header());
+  list_type l(alloc);
+  if (!churn(l, 1))
+    return 1;
+
+  for (int i = 0; i < n; ++i)
+    l.push_front(i);
+
+  pool.slot(0).store(pool.offset(l.release()), std::memory_order_release);
+  return 0;
+}
+
+int main()
+{
+  const std::string name = "/rt_shm_pool." + std::to_string(::getpid());
+  pool_type::remove(name.c_str());
+
+  bool ok = false;
+  {
+    pool_type pool(name.c_str(), 1 << 20);
+    alloc_type alloc(&pool.header());
+    list_type mine(alloc);
+
+    const pid_t pid = ::fork();
+    if (pid == 0)
+      ::_exit(child(name.c_str()));
+
+    ok = pid > 0 && pool.created() && churn(mine, 2);
+    for (int i = 0; i < n; ++i)
+      mine.push_front(-i);
+
+    int status = 0;
+    ok = ok && ::waitpid(pid, &status, 0) == pid
+       && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    // The list built by the child, nothing is copied.
+    const std::uint64_t off = pool.slot(0).load(std::memory_order_acquire);
+    if (ok && off) {
+      auto head = static_cast<node_type*>(pool.address(off));
+      list_type theirs(rt::adopt_nodes, head, alloc);
+      std::vector<int> v(theirs.begin(), theirs.end());
+      ok = static_cast<int>(v.size()) == n
+        && std::is_sorted(v.rbegin(), v.rend()) && v.front() == n - 1;
+    } else {
+      ok = false;
+    }
+
+    std::vector<int> w(mine.begin(), mine.end());
+    ok = ok && static_cast<int>(w.size()) == n && w.front() == 1 - n;
+  }
+
+  pool_type::remove(name.c_str());
+
+  // A segment too small for the pool is removed again.
+  try {
+    pool_type pool(name.c_str(), 64);
+    ok = false;
+  } catch (const std::runtime_error&) {
+  }
+  const int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+  if (fd >= 0) {
+    ::close(fd);
+    pool_type::remove(name.c_str());
+    ok = false;
+  }
+  return ok ? 0 : 1;
+}
+
@@ -0,0 +1,168 @@
+#include <new>
+#include <array>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/container/forward_list.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/memory/size_class_pool.hpp>
+#include <rtcpp/memory/size_class_node_stack.hpp>
+
+using pair_type = std::pair<int, double>;
+using array_type = std::array<long, 6>;
+
+using node_type1 = rt::set<int>::node_type;
+using node_type2 = rt::set<pair_type>::node_type;
+using node_type3 = rt::forward_list<array_type>::node_type;
+
+using alloc_type1 =
+  rt::node_allocator<int, node_type1, rt::size_class_node_stack>;
+using alloc_type2 =
+  rt::node_allocator<int, node_type2, rt::size_class_node_stack>;
+using alloc_type3 =
+  rt::node_allocator<int, node_type3, rt::size_class_node_stack>;
+
+using set_type1 = rt::set<int, std::less<int>, alloc_type1>;
+using set_type2 = rt::set<pair_type, std::less<pair_type>, alloc_type2>;
+using list_type = rt::forward_list<array_type, alloc_type3>;
+
+bool test_classes()
+{
+  using pool = rt::size_class_pool;
+  if (pool::class_size(pool::class_of(1, 1)) != pool::granularity)
+    return false;
+  if (pool::class_size(pool::class_of(24, 8)) != 24)
+    return false;
+  if (pool::class_size(pool::class_of(24, 16)) != 32)
+    return false;
+
+  try {
+    pool::class_of(pool::max_block_size + 1, 1);
+  } catch (const std::exception& e) {
+    return true;
+  }
+  return false;
+}
+
+// Three containers with different node sizes on one header.
+bool test_shared_header()
+{
+  std::vector<char> buffer(32 * 1024);
+  rt::size_class_pool pool(buffer, 512);
+  rt::node_alloc_header header(pool);
+
+  const alloc_type1 a1(&header);
+  const alloc_type2 a2(&header);
+  const alloc_type3 a3(&header);
+  set_type1 t1(a1);
+  set_type2 t2(a2);
+  list_type l1(a3);
+
+  const int n = 100;
+  for (int i = 0; i < n; ++i) {
+    t1.insert(n - i);
+    t2.insert(std::make_pair(i % 10, 0.5 * i));
+    array_type a;
+    a.fill(i);
+    l1.push_front(a);
+  }
+
+  if (t1.size() != n || *t1.begin() != 1 || t2.size() != n)
+    return false;
+  if (!std::is_sorted(std::begin(t2), std::end(t2)))
+    return false;
+  int i = n;
+  for (const auto& a: l1)
+    if (a.back() != --i)
+      return false;
+
+  // Released nodes are reused, the untouched part does not shrink.
+  const std::size_t r = pool.remaining();
+  t1.clear();
+  t2.clear();
+  l1.clear();
+  for (int i = 0; i < n; ++i) {
+    t1.insert(i);
+    t2.insert(std::make_pair(i, 0.0));
+    l1.push_front(array_type());
+  }
+  return pool.remaining() == r;
+}
+
+// The containers draw on a single budget. set::insert is noexcept,
+// the set nodes are exhausted with the allocator itself.
+bool test_exhaustion()
+{
+  using node_alloc_type1 = alloc_type1::rebind<node_type1>::other;
+  std::vector<char> buffer(4096);
+  rt::size_class_pool pool(buffer, 256);
+  rt::node_alloc_header header(pool);
+
+  const alloc_type1 a1(&header);
+  const alloc_type3 a3(&header);
+  set_type1 t1(a1);
+  list_type l1(a3);
+  for (int i = 0; i < 20; ++i)
+    t1.insert(i);
+
+  std::size_t n3 = 0;
+  try {
+    for (;; ++n3)
+      l1.push_front(array_type());
+  } catch (const std::bad_alloc&) {
+  }
+
+  node_alloc_type1 na1(a1);
+  std::vector<node_type1*> nodes;
+  try {
+    for (;;)
+      nodes.push_back(na1.allocate_node());
+  } catch (const std::bad_alloc&) {
+  }
+  for (auto p: nodes)
+    na1.deallocate_node(p);
+
+  const std::size_t bytes = (t1.size() + nodes.size()) * sizeof (node_type1)
+                          + n3 * sizeof (node_type3);
+  return n3 > 0 && bytes <= buffer.size() && bytes > buffer.size() / 2
+      && pool.remaining() < 256;
+}
+
+bool test_no_pool()
+{
+  std::vector<char> buffer(100);
+  rt::node_alloc_header header(buffer);
+  const alloc_type1 a1(&header);
+  try {
+    set_type1 t1(a1);
+  } catch (const std::exception& e) {
+    return true;
+  }
+  return false;
+}
+
+int main()
+{
+  try {
+    if (!test_classes())
+      return 1;
+
+    if (!test_shared_header())
+      return 1;
+
+    if (!test_exhaustion())
+      return 1;
+
+    if (!test_no_pool())
+      return 1;
+  } catch (const std::exception& e) {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,130 @@
+#include <vector>
+#include <iostream>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/container/forward_list.hpp>
+#include <rtcpp/memory/slab_chain.hpp>
+#include <rtcpp/memory/slab_node_stack.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+namespace {
+
+std::size_t n_upstream = 0;
+
+void* counting_allocate(std::size_t n)
+{
+  ++n_upstream;
+  return ::operator new(n);
+}
+
+void counting_deallocate(void* p, std::size_t)
+{
+  ::operator delete(p);
+}
+
+}
+
+bool test_set_growth()
+{
+  using node_type = rt::set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type, rt::slab_node_stack>;
+  using set_type = rt::set<int, std::less<int>, alloc_type>;
+
+  // The first slab holds only a couple of nodes.
+  rt::slab_chain chain(64, &counting_allocate, &counting_deallocate);
+  rt::node_alloc_header header(chain);
+  n_upstream = 0;
+
+  const int n = 2000;
+  std::vector<int> data = rt::make_rand_data<int>(n, 1, 4 * n);
+  alloc_type alloc(&header);
+  set_type t1(alloc);
+  for (auto o: data)
+    t1.insert(o);
+
+  std::sort(std::begin(data), std::end(data));
+  data.erase(std::unique(std::begin(data), std::end(data)), std::end(data));
+  if (!std::equal(std::begin(data), std::end(data), std::begin(t1)))
+    return false;
+
+  // Slabs grow geometrically.
+  if (n_upstream > 16)
+    return false;
+
+  // Released nodes are reused without touching upstream.
+  const std::size_t m = n_upstream;
+  t1.clear();
+  for (auto o: data)
+    t1.insert(o);
+
+  return n_upstream == m;
+}
+
+bool test_reserve()
+{
+  using node_type = rt::forward_list<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type, rt::slab_node_stack>;
+
+  rt::slab_chain chain(64, &counting_allocate, &counting_deallocate);
+  rt::node_alloc_header header(chain);
+  alloc_type alloc(&header);
+  rt::forward_list<int, alloc_type> l1(alloc);
+
+  const int n = 1000;
+  chain.reserve(n * chain.block_size());
+  if (chain.capacity() < n * chain.block_size())
+    return false;
+
+  n_upstream = 0;
+  for (int i = 0; i < n; ++i)
+    l1.push_front(i);
+
+  if (n_upstream != 0)
+    return false;
+
+  int i = n;
+  for (auto o: l1)
+    if (o != --i)
+      return false;
+
+  return true;
+}
+
+bool test_no_chain()
+{
+  using node_type = rt::set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type, rt::slab_node_stack>;
+  std::vector<char> buffer(100);
+  rt::node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  try {
+    rt::set<int, std::less<int>, alloc_type> t1(alloc);
+  } catch (const std::exception& e) {
+    std::cout << e.what() << std::endl;
+    return true;
+  }
+  return false;
+}
+
+int main()
+{
+  try {
+    if (!test_set_growth())
+      return 1;
+
+    if (!test_reserve())
+      return 1;
+
+    if (!test_no_chain())
+      return 1;
+  } catch (const std::exception& e) {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
@@ -0,0 +1,279 @@
+#include <set>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/container/snapshot.hpp>
+#include <rtcpp/container/forward_list.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+using set_node = rt::tbst::node<int, rt::rel_ptr<void, std::int32_t>>;
+using set_alloc = rt::node_allocator<int, set_node, rt::node_stack, std::uint32_t>;
+using set_type = rt::set<int, std::less<int>, set_alloc>;
+using avl_type = rt::set<int, std::less<int>, set_alloc, rt::tbst::avl_balance>;
+
+using list_node = rt::forward_list_node<int, rt::rel_ptr<void, std::int32_t>>;
+using list_alloc = rt::node_allocator<int, list_node, rt::node_stack, std::uint32_t>;
+using list_type = rt::forward_list<int, list_alloc>;
+
+template <class Set>
+bool same(const Set& s, const std::set<int>& ref)
+{
+  return s.size() == ref.size()
+      && std::equal(std::begin(s), std::end(s), std::begin(ref))
+      && std::equal(s.rbegin(), s.rend(), ref.rbegin());
+}
+
+bool test_stream()
+{
+  const std::vector<int> data = rt::make_rand_data<int>(3000, 1, 1000000);
+  std::set<int> ref(std::begin(data), std::end(data));
+  const rt::set<int> s(std::begin(data), std::end(data));
+
+  std::stringstream ss;
+  rt::save_snapshot(ss, s);
+
+  // Into a pool with room for more.
+  std::vector<set_node> buffer(ref.size() + 200);
+  rt::node_alloc_header h(buffer);
+  const auto nodes = rt::load_snapshot<set_type>(ss, h);
+  set_type t(rt::adopt_nodes, nodes.head, nodes.size, std::less<int>(), set_alloc(&h));
+  if (!same(t, ref))
+    return false;
+
+  for (int i = 0; i < 150; ++i) {
+    t.insert(-i);
+    ref.insert(-i);
+  }
+  for (std::size_t i = 0; i < data.size(); i += 2) {
+    t.erase(data[i]);
+    ref.erase(data[i]);
+  }
+  if (!same(t, ref))
+    return false;
+
+  // A set whose nodes are already in a pool, and the empty one.
+  std::stringstream ss2;
+  rt::save_snapshot(ss2, t);
+  rt::save_snapshot(ss2, set_type(set_alloc(&h)));
+  std::vector<set_node> buffer2(ref.size() + 2);
+  rt::node_alloc_header h2(buffer2);
+  const auto nodes2 = rt::load_snapshot<set_type>(ss2, h2);
+  set_type u(rt::adopt_nodes, nodes2.head, nodes2.size, std::less<int>(), set_alloc(&h2));
+  if (!same(u, ref))
+    return false;
+
+  std::vector<set_node> buffer3(2);
+  rt::node_alloc_header h3(buffer3);
+  const auto nodes3 = rt::load_snapshot<set_type>(ss2, h3);
+  set_type e(rt::adopt_nodes, nodes3.head, nodes3.size, std::less<int>(), set_alloc(&h3));
+  return e.empty() && std::begin(e) == std::end(e);
+}
+
+bool test_avl()
+{
+  std::vector<int> data(1000);
+  for (int i = 0; i < 1000; ++i)
+    data[i] = i;
+  std::set<int> ref(std::begin(data), std::end(data));
+  rt::set<int, std::less<int>, std::allocator<int>, rt::tbst::avl_balance> s(std::begin(data), std::end(data));
+
+  std::stringstream ss;
+  rt::save_snapshot(ss, s);
+  std::vector<set_node> buffer(2000);
+  rt::node_alloc_header h(buffer);
+  const auto nodes = rt::load_snapshot<avl_type>(ss, h);
+  avl_type t(rt::adopt_nodes, nodes.head, nodes.size, std::less<int>(), set_alloc(&h));
+  // The balance bits are kept, inserting stays balanced.
+  for (int i = 1000; i < 1900; ++i) {
+    t.insert(i);
+    ref.insert(i);
+  }
+  return same(t, ref);
+}
+
+// The counts are kept, the order statistics work on the loaded set,
+// which is not taken for a plain one.
+bool test_ranked()
+{
+  using ranked_node = rt::tbst::ranked_node<int, rt::rel_ptr<void, std::int32_t>>;
+  using ranked_alloc = rt::node_allocator<int, ranked_node, rt::node_stack, std::uint32_t>;
+  using ranked_type = rt::set<int, std::less<int>, ranked_alloc, rt::tbst::ranked<>>;
+  const std::vector<int> data = rt::make_rand_data<int>(1000, 1, 100000);
+  const rt::set<int, std::less<int>, std::allocator<int>, rt::tbst::ranked<>>
+    s(std::begin(data), std::end(data));
+  std::stringstream ss;
+  rt::save_snapshot(ss, s);
+  const std::string bytes = ss.str();
+
+  std::vector<ranked_node> buffer(s.size() + 200);
+  rt::node_alloc_header h(buffer);
+  const auto nodes = rt::load_snapshot<ranked_type>(ss, h);
+  ranked_type t(rt::adopt_nodes, nodes.head, nodes.size, std::less<int>(), ranked_alloc(&h));
+  for (int i = 0; i < 100; ++i)
+    t.insert(-i);
+  std::set<int> ref(std::begin(s), std::end(s));
+  for (int i = 0; i < 100; ++i)
+    ref.insert(-i);
+  if (!same(t, ref))
+    return false;
+  std::size_t k = 0;
+  for (int v : ref)
+    if (*t.nth(k) != v || t.rank(v) != k++)
+      return false;
+
+  std::istringstream is(bytes);
+  std::vector<set_node> buffer2(s.size() + 2);
+  rt::node_alloc_header h2(buffer2);
+  try {
+    rt::load_snapshot<avl_type>(is, h2);
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+bool test_list()
+{
+  const std::vector<int> data = {5, 3, 9, 1, 7};
+  rt::forward_list<int> l;
+  for (auto i = data.rbegin(); i != data.rend(); ++i)
+    l.push_front(*i);
+
+  std::stringstream ss;
+  rt::save_snapshot(ss, l);
+  std::vector<list_node> buffer(20);
+  rt::node_alloc_header h(buffer);
+  const auto nodes = rt::load_snapshot<list_type>(ss, h);
+  list_type m(rt::adopt_nodes, nodes.head, list_alloc(&h));
+  if (nodes.size != data.size() || !std::equal(std::begin(data), std::end(data), std::begin(m)))
+    return false;
+  m.push_front(0);
+  return *std::begin(m) == 0;
+}
+
+bool test_errors()
+{
+  const rt::set<int> s = {1, 2, 3};
+  std::stringstream ss;
+  rt::save_snapshot(ss, s);
+  const std::string good = ss.str();
+
+  auto fails = [](const std::string& bytes, std::size_t pool)
+  {
+    std::istringstream is(bytes);
+    std::vector<set_node> buffer(pool);
+    rt::node_alloc_header h(buffer);
+    try {
+      rt::load_snapshot<set_type>(is, h);
+    } catch (const std::runtime_error&) {
+      return true;
+    }
+    return false;
+  };
+
+  std::string bad = good;
+  bad[bad.size() - 1] ^= 1;
+  std::string version = good;
+  version[8] = 2;
+  std::istringstream is(good);
+  std::vector<list_node> buffer(10);
+  rt::node_alloc_header h(buffer);
+  bool kind = false;
+  try {
+    rt::load_snapshot<list_type>(is, h);
+  } catch (const std::runtime_error&) {
+    kind = true;
+  }
+  return !fails(good, 5) && fails(good, 4) && fails(bad, 5) && fails(version, 5)
+      && fails(good.substr(0, good.size() - 1), 5) && fails("", 5) && kind;
+}
+
+bool test_mapped()
+{
+  const std::string path = "rt_snapshot." + std::to_string(::getpid()) + ".bin";
+  const std::vector<int> data = rt::make_rand_data<int>(2000, 1, 1000000);
+  std::set<int> ref(std::begin(data), std::end(data));
+  {
+    const rt::set<int> s(std::begin(data), std::end(data));
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return false;
+    rt::save_snapshot(fd, s);
+    ::close(fd);
+  }
+
+  bool ok = true;
+  for (int i = 0; i < 2 && ok; ++i) {
+    // The changes of the first mapping do not reach the file.
+    rt::mapped_snapshot snap(path.c_str());
+    const auto nodes = snap.nodes<set_type>();
+    set_type s(rt::adopt_nodes, nodes.head, nodes.size, std::less<int>(), set_alloc(&snap.header()));
+    ok = snap.size() == ref.size() && same(s, ref);
+    s.erase(*std::begin(ref));
+    s.insert(-1);
+    ok = ok && s.size() == ref.size() && *std::begin(s) == -1;
+  }
+
+  {
+    std::fstream f(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(100);
+    f.put('x');
+  }
+  bool checked = false;
+  try {
+    rt::mapped_snapshot snap(path.c_str());
+  } catch (const std::runtime_error&) {
+    checked = true;
+  }
+
+  // The header is checked without the checksum as well, here a block
+  // size the image is not made of.
+  {
+    std::fstream f(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(20);
+    f.put(char(7));
+  }
+  bool header = false;
+  try {
+    rt::mapped_snapshot snap(path.c_str(), false);
+  } catch (const std::runtime_error&) {
+    header = true;
+  }
+  std::remove(path.c_str());
+  return ok && checked && header;
+}
+
+int main()
+{
+  if (!test_stream())
+    return 1;
+
+  if (!test_avl())
+    return 1;
+
+  if (!test_ranked())
+    return 1;
+
+  if (!test_list())
+    return 1;
+
+  if (!test_errors())
+    return 1;
+
+  if (!test_mapped())
+    return 1;
+
+  return 0;
+}
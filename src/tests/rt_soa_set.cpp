@@ -0,0 +1,124 @@
+#include <set>
+#include <vector>
+#include <cstdint>
+#include <numeric>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/soa_set.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+template <class Set>
+bool equal(const Set& s, const std::set<int>& ref)
+{
+  if (s.size() != ref.size())
+    return false;
+  if (!std::equal(std::begin(ref), std::end(ref), std::begin(s)))
+    return false;
+  // Backwards too.
+  return std::equal(ref.rbegin(), ref.rend(), std::make_reverse_iterator(std::end(s)));
+}
+
+template <class Balance>
+bool test_random()
+{
+  using set_type = rt::soa_set<int, std::less<int>, Balance>;
+  const int n = 2000;
+  std::vector<char> buffer(set_type::bytes_for(n));
+  set_type s(buffer);
+  if (s.capacity() < n || reinterpret_cast<std::uintptr_t>(s.keys()) % 64)
+    return false;
+
+  std::vector<int> data = rt::make_rand_data<int>(n, 1, 3 * n);
+  std::set<int> ref;
+  for (auto o: data)
+    if (s.insert(o).second != ref.insert(o).second)
+      return false;
+  if (!equal(s, ref))
+    return false;
+
+  // Erases by key and by iterator, the nodes are reused.
+  const std::size_t extent = s.extent();
+  for (std::size_t i = 0; i < data.size(); i += 3) {
+    if (s.erase(data[i]) != ref.erase(data[i]))
+      return false;
+  }
+  for (auto it = s.begin(); it != s.end();) {
+    if (*it % 2 == 0) {
+      ref.erase(*it);
+      it = s.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (!equal(s, ref))
+    return false;
+  for (auto o: data) {
+    s.insert(o);
+    ref.insert(o);
+  }
+  if (!equal(s, ref) || s.extent() != extent)
+    return false;
+
+  // Buffer order scans see the same keys.
+  std::vector<int> scanned;
+  s.for_each_key([&](int k) { scanned.push_back(k); });
+  std::sort(std::begin(scanned), std::end(scanned));
+  if (!std::equal(std::begin(ref), std::end(ref), std::begin(scanned)))
+    return false;
+  long sum = 0;
+  for (std::size_t i = 1; i < s.extent(); ++i)
+    sum += s.in_use(i) ? s.keys()[i] : 0;
+  if (sum != std::accumulate(std::begin(ref), std::end(ref), 0L))
+    return false;
+
+  for (int k: {0, 1, n, 3 * n, 3 * n + 1}) {
+    if ((s.find(k) != s.end()) != (ref.count(k) == 1))
+      return false;
+    auto it = s.lower_bound(k);
+    auto jt = ref.lower_bound(k);
+    if ((it == s.end()) != (jt == ref.end()) || (jt != ref.end() && *it != *jt))
+      return false;
+    it = s.upper_bound(k);
+    jt = ref.upper_bound(k);
+    if ((it == s.end()) != (jt == ref.end()) || (jt != ref.end() && *it != *jt))
+      return false;
+  }
+
+  s.clear();
+  return s.empty() && s.begin() == s.end() && s.extent() == 1;
+}
+
+bool test_full()
+{
+  // Small indexes, the capacity is bounded by the buffer.
+  using set_type = rt::soa_set<int, std::greater<int>, rt::tbst::avl_balance, std::uint16_t>;
+  std::vector<std::uint64_t> buffer(64);
+  set_type s(buffer);
+  const std::size_t n = s.capacity();
+  for (std::size_t i = 0; i < n; ++i)
+    s.insert(static_cast<int>(i));
+  try {
+    s.insert(-1);
+    return false;
+  } catch (const std::bad_alloc&) {
+  }
+  // A duplicate does not need a node.
+  if (s.insert(0).second || s.size() != n || *s.begin() != int(n - 1))
+    return false;
+  s.erase(3);
+  return s.insert(-1).second && *std::prev(s.end()) == -1;
+}
+
+int main()
+{
+  if (!test_random<rt::tbst::no_balance>())
+    return 1;
+  if (!test_random<rt::tbst::avl_balance>())
+    return 1;
+  if (!test_full())
+    return 1;
+
+  return 0;
+}
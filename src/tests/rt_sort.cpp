@@ -0,0 +1,109 @@
+#include <cmath>
+#include <deque>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/algorithm/sort.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+// Inputs of all sizes around the insertion sort threshold and beyond.
+std::vector<std::vector<int>> patterns(std::size_t n)
+{
+  std::vector<std::vector<int>> r;
+  r.push_back(rt::make_rand_data<int>(n, 1, 1000000, 1));
+  r.push_back(rt::make_rand_data<int>(n, 1, 4, 1));
+  std::vector<int> v(n);
+  for (std::size_t i = 0; i < n; ++i)
+    v[i] = static_cast<int>(i);
+  r.push_back(v); // Sorted.
+  std::reverse(std::begin(v), std::end(v));
+  r.push_back(v);
+  for (std::size_t i = 0; i < n; ++i) // Organ pipe.
+    v[i] = static_cast<int>(i < n / 2 ? i : n - i);
+  r.push_back(v);
+  r.push_back(std::vector<int>(n, 7));
+  return r;
+}
+
+bool test_patterns()
+{
+  for (std::size_t n: {0, 1, 2, 3, 15, 16, 17, 33, 100, 1000, 20000}) {
+    for (auto v: patterns(n)) {
+      std::vector<int> ref = v;
+      std::sort(std::begin(ref), std::end(ref));
+      rt::sort(std::begin(v), std::end(v));
+      if (v != ref)
+        return false;
+      std::deque<int> d(std::begin(ref), std::end(ref));
+      rt::sort(std::begin(d), std::end(d), std::greater<int>());
+      if (!std::equal(std::begin(ref), std::end(ref), d.rbegin()))
+        return false;
+    }
+  }
+  return true;
+}
+
+// McIlroy's adversary: the values are decided during the sort so as
+// to make quicksort quadratic.
+struct adversary {
+  std::vector<int> val;
+  int gas;
+  int n_solid = 0;
+  int candidate = 0;
+  long n_comp = 0;
+  explicit adversary(int n) : val(n, n), gas(n) {}
+  bool operator()(int x, int y)
+  {
+    ++n_comp;
+    if (val[x] == gas && val[y] == gas)
+      val[x == candidate ? x : y] = n_solid++;
+    if (val[x] == gas)
+      candidate = x;
+    else if (val[y] == gas)
+      candidate = y;
+    return val[x] < val[y];
+  }
+};
+
+bool test_worst_case()
+{
+  const int n = 50000;
+  adversary a(n);
+  std::vector<int> idx(n);
+  for (int i = 0; i < n; ++i)
+    idx[i] = i;
+  rt::sort(std::begin(idx), std::end(idx), std::ref(a));
+
+  // The values given are consistent with the result.
+  for (int i = 1; i < n; ++i)
+    if (a.val[idx[i - 1]] > a.val[idx[i]])
+      return false;
+  return a.n_comp < 8 * n * std::log2(n);
+}
+
+bool test_strings()
+{
+  std::vector<std::string> v;
+  for (auto o: rt::make_rand_data<int>(500, 1, 100000))
+    v.push_back(std::to_string(o));
+  std::vector<std::string> ref = v;
+  std::sort(std::begin(ref), std::end(ref));
+  rt::sort(std::begin(v), std::end(v));
+  return v == ref;
+}
+
+int main()
+{
+  if (!test_patterns())
+    return 1;
+  if (!test_worst_case())
+    return 1;
+  if (!test_strings())
+    return 1;
+
+  return 0;
+}
+
@@ -0,0 +1,105 @@
+#include <new>
+#include <set>
+#include <list>
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include <rtcpp/container/static_set.hpp>
+#include <rtcpp/container/static_forward_list.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+// The index widths follow the capacity.
+static_assert(std::is_same<rt::static_set<int, 100>::index_type, std::uint16_t>::value, "");
+static_assert(std::is_same<rt::static_set<int, 100000>::index_type, std::uint32_t>::value, "");
+static_assert(std::is_same<rt::static_forward_list<char, 1000>::index_type, std::uint16_t>::value, "");
+
+template <class Set>
+bool inside(const Set& s)
+{
+  const char* p = reinterpret_cast<const char*>(&s);
+  for (const auto& o: s) {
+    const char* q = reinterpret_cast<const char*>(&o);
+    if (q < p || q >= p + sizeof s)
+      return false;
+  }
+  return true;
+}
+
+template <class Balance>
+bool test_set()
+{
+  const std::size_t n = 300;
+  using set_type = rt::static_set<int, n, std::less<int>, Balance>;
+  std::vector<int> data = rt::make_rand_data<int>(4 * n, 1, 2 * n);
+  std::set<int> ref;
+  set_type s;
+  for (auto o: data) {
+    if (s.full() && !s.count(o))
+      continue;
+    if (s.insert(o).second != ref.insert(o).second)
+      return false;
+  }
+  if (!s.full() || !std::equal(std::begin(ref), std::end(ref), std::begin(s)))
+    return false;
+  if (!inside(s))
+    return false;
+
+  // Copies have buffers of their own.
+  set_type c(s);
+  for (auto it = s.begin(); it != s.end();)
+    it = *it % 2 ? s.erase(it) : std::next(it);
+  if (c.size() != n || !inside(c) || s.size() == n)
+    return false;
+  set_type d {3, 1, 2};
+  d.swap(s);
+  if (s.size() != 3 || *s.begin() != 1 || !inside(s) || !inside(d))
+    return false;
+  d = c;
+  return std::equal(std::begin(c), std::end(c), std::begin(d)) && inside(d);
+}
+
+bool test_list()
+{
+  const std::size_t n = 50;
+  using list_type = rt::static_forward_list<int, n>;
+  list_type l;
+  std::list<int> ref;
+  for (std::size_t i = 0; i < n; ++i) {
+    l.push_front(static_cast<int>(i));
+    ref.push_front(static_cast<int>(i));
+  }
+  try {
+    l.push_front(-1);
+    return false;
+  } catch (const std::bad_alloc&) {
+  }
+  if (!std::equal(std::begin(ref), std::end(ref), std::begin(l)) || !inside(l))
+    return false;
+
+  list_type c(l);
+  l.remove_if(7);
+  l.push_front(-1);
+  if (!std::equal(std::begin(ref), std::end(ref), std::begin(c)) || !inside(c))
+    return false;
+  c = {4, 5, 6};
+  const int expected[] = {4, 5, 6};
+  return std::equal(std::begin(c), std::end(c), std::begin(expected), std::end(expected))
+      && *l.begin() == -1;
+}
+
+int main()
+{
+  if (!test_set<rt::tbst::no_balance>())
+    return 1;
+  if (!test_set<rt::tbst::avl_balance>())
+    return 1;
+  if (!test_list())
+    return 1;
+
+  return 0;
+}
+
@@ -0,0 +1,65 @@
+#include <array>
+#include <vector>
+
+#include <rtcpp/algorithm/transform_batch.hpp>
+
+// Small integers, so that the results are exact.
+template <typename T, std::size_t K>
+std::vector<rt::matrix<T, K, 1>> points(std::size_t n)
+{
+  std::vector<rt::matrix<T, K, 1>> v(n);
+  for (std::size_t i = 0; i < n; ++i)
+    for (std::size_t k = 0; k < K; ++k)
+      v[i][k] = static_cast<T>((i * 7 + k * 3) % 11) - 5;
+  return v;
+}
+
+template <typename T>
+bool test_affine()
+{
+  using vec3 = rt::matrix<T, 3, 1>;
+  const rt::matrix<T, 4, 4> a = { 1, 2, 0, 4
+                                , -1, 3, 1, 0
+                                , 2, 0, -2, 7
+                                , 9, 9, 9, 9 }; // Not used.
+  const rt::matrix<T, 3, 3> r = {1, 2, 0, -1, 3, 1, 2, 0, -2};
+  const vec3 t = {4, 0, 7};
+  for (std::size_t n: {0, 1, 5, 63, 64, 65, 200}) {
+    const std::vector<vec3> in = points<T, 3>(n);
+    std::vector<vec3> out(n);
+    rt::transform_batch(a, in, out);
+    for (std::size_t i = 0; i < n; ++i)
+      if (out[i] != vec3(r * in[i] + t))
+        return false;
+    // In place.
+    std::vector<vec3> v = in;
+    rt::transform_batch(a, v.data(), v.size(), v.data());
+    if (v != out)
+      return false;
+  }
+  return true;
+}
+
+template <typename T>
+bool test_general()
+{
+  const rt::matrix<T, 2, 4> a = {1, 2, 3, 4, -4, 0, 1, 2};
+  const std::vector<rt::matrix<T, 4, 1>> in = points<T, 4>(150);
+  std::array<rt::matrix<T, 2, 1>, 150> out;
+  rt::transform_batch(a, in, out);
+  for (std::size_t i = 0; i < in.size(); ++i)
+    if (out[i] != rt::matrix<T, 2, 1>(a * in[i]))
+      return false;
+  return true;
+}
+
+int main()
+{
+  if (!test_affine<float>() || !test_affine<double>() || !test_affine<int>())
+    return 1;
+  if (!test_general<float>() || !test_general<double>())
+    return 1;
+
+  return 0;
+}
+
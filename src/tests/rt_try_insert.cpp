@@ -0,0 +1,126 @@
+#include <set>
+#include <array>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/set.hpp>
+#include <rtcpp/container/soa_set.hpp>
+#include <rtcpp/container/static_set.hpp>
+#include <rtcpp/container/forward_list.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+// Built with -fno-exceptions where the compiler has it, exhaustion is
+// only seen in the results.
+
+template <class Set>
+bool fill_until_full(Set& s, std::set<int>& ref)
+{
+  std::vector<int> data = rt::make_rand_data<int>(1000, 1, 100000);
+  for (auto o: data) {
+    const auto pair = s.try_insert(o);
+    if (pair.first == s.end()) {
+      if (pair.second || ref.count(o))
+        return false;
+      // Present keys are still found when full.
+      return !s.try_insert(*ref.begin()).second
+          && s.try_insert(*ref.begin()).first == s.find(*ref.begin());
+    }
+    if (pair.second != ref.insert(o).second || *pair.first != o)
+      return false;
+  }
+  return false;
+}
+
+template <class Set>
+bool same(const Set& s, const std::set<int>& ref)
+{
+  return s.size() == ref.size()
+      && std::equal(std::begin(ref), std::end(ref), std::begin(s));
+}
+
+template <class Balance>
+bool test_set()
+{
+  using node_type = rt::set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  using set_type = rt::set<int, std::less<int>, alloc_type, Balance>;
+  using inner_type = alloc_type::rebind<node_type>::other;
+
+  std::array<node_type, 102> buffer = {{}};
+  rt::node_alloc_header header(buffer);
+  const alloc_type alloc(&header);
+  set_type s(alloc);
+  std::set<int> ref;
+  if (!fill_until_full(s, ref) || ref.size() != 100 || !same(s, ref))
+    return false;
+
+  // The allocator reports it too.
+  inner_type inner(alloc);
+  if (inner.try_allocate_node())
+    return false;
+
+  // Freed nodes are used again.
+  s.erase(*ref.begin());
+  ref.erase(ref.begin());
+  int k = -1;
+  if (!s.try_insert(std::move(k)).second || s.try_insert(-2).first != s.end())
+    return false;
+  ref.insert(-1);
+  return same(s, ref);
+}
+
+bool test_static_set()
+{
+  rt::static_set<int, 50> s;
+  std::set<int> ref;
+  return fill_until_full(s, ref) && s.full() && same(s, ref);
+}
+
+bool test_soa_set()
+{
+  using set_type = rt::soa_set<int, std::less<int>, rt::tbst::avl_balance>;
+  std::vector<char> buffer(set_type::bytes_for(40));
+  set_type s(buffer);
+  std::set<int> ref;
+  return fill_until_full(s, ref) && ref.size() == s.capacity() && same(s, ref);
+}
+
+bool test_list()
+{
+  using node_type = rt::forward_list<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  using list_type = rt::forward_list<int, alloc_type>;
+
+  std::array<node_type, 11> buffer = {{}};
+  rt::node_alloc_header header(buffer);
+  const alloc_type alloc(&header);
+  list_type l(alloc);
+  int n = 0;
+  while (l.try_push_front(n))
+    ++n;
+  if (n != 10 || *l.begin() != 9)
+    return false;
+  l.remove_if(9);
+  int k = 42;
+  return l.try_push_front(std::move(k)) && *l.begin() == 42 && !l.try_push_front(0);
+}
+
+int main()
+{
+  if (!test_set<rt::tbst::no_balance>())
+    return 1;
+  if (!test_set<rt::tbst::avl_balance>())
+    return 1;
+  if (!test_static_set())
+    return 1;
+  if (!test_soa_set())
+    return 1;
+  if (!test_list())
+    return 1;
+
+  return 0;
+}
+
@@ -0,0 +1,172 @@
+#include <set>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+
+#include <rtcpp/container/unordered_set.hpp>
+#include <rtcpp/memory/node_allocator.hpp>
+#include <rtcpp/utility/make_rand_data.hpp>
+
+// Counts the segment allocations, the nodes go through allocate(1)
+// as well.
+static std::size_t n_arrays = 0;
+
+template <class T>
+struct counting_allocator : std::allocator<T> {
+  template <class U>
+  struct rebind { using other = counting_allocator<U>; };
+  counting_allocator() = default;
+  template <class U>
+  counting_allocator(const counting_allocator<U>&) noexcept {}
+  T* allocate(std::size_t n)
+  {
+    n_arrays += std::is_pointer<T>::value;
+    return std::allocator<T>::allocate(n);
+  }
+};
+
+template <class S>
+bool same_elements(const S& s, const std::set<int>& ref)
+{
+  std::vector<int> v(std::begin(s), std::end(s));
+  std::sort(std::begin(v), std::end(v));
+  return s.size() == ref.size()
+      && std::distance(std::begin(s), std::end(s)) == static_cast<long>(ref.size())
+      && std::equal(std::begin(v), std::end(v), std::begin(ref));
+}
+
+template <class S>
+bool test_set(S& s, const std::vector<int>& data)
+{
+  std::set<int> ref;
+  for (int v: data) {
+    const auto buckets = s.bucket_count();
+    const auto pair = s.insert(v);
+    if (pair.second != ref.insert(v).second || *pair.first != v)
+      return false;
+    // One split per insertion at most.
+    if (s.bucket_count() > buckets + 1 || s.load_factor() > s.max_load_factor())
+      return false;
+  }
+
+  if (!same_elements(s, ref))
+    return false;
+
+  for (int v: data)
+    if (s.count(v) != 1 || *s.find(v) != v)
+      return false;
+  if (s.find(-1) != s.end())
+    return false;
+
+  // By key and by position, the next iterator stays valid.
+  for (std::size_t i = 0; i < data.size(); i += 3)
+    if (s.erase(data[i]) != ref.erase(data[i]))
+      return false;
+  for (auto iter = s.begin(); iter != s.end();) {
+    if (*iter % 2) {
+      ref.erase(*iter);
+      iter = s.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+  if (!same_elements(s, ref))
+    return false;
+
+  S copy(s);
+  if (copy != s || !same_elements(copy, ref))
+    return false;
+
+  S moved(std::move(copy));
+  if (!copy.empty() || copy.begin() != copy.end() || moved != s)
+    return false;
+
+  copy = {1, 2, 3};
+  copy.swap(moved);
+  if (moved.size() != 3 || copy != s)
+    return false;
+
+  s.clear();
+  return s.empty() && s.begin() == s.end() && s.find(data[0]) == s.end();
+}
+
+bool test_reserve(const std::vector<int>& data)
+{
+  using set_type = rt::unordered_set< int, std::hash<int>, std::equal_to<int>
+                                    , counting_allocator<int>>;
+  set_type s(4);
+  s.reserve(data.size());
+  const std::size_t n = n_arrays;
+  s.insert(std::begin(data), std::end(data));
+  return n_arrays == n && s.size() == std::set<int>(std::begin(data), std::end(data)).size();
+}
+
+bool test_strings(const std::vector<int>& data)
+{
+  // The load factor is lowered half way, it comes down with one split
+  // per insertion.
+  rt::unordered_set<std::string> s;
+  s.max_load_factor(4);
+  std::set<std::string> ref;
+  float lf = 4;
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    if (i == data.size() / 2)
+      s.max_load_factor(1);
+    const auto buckets = s.bucket_count();
+    const std::string k = std::to_string(data[i]) + "-long-enough-to-allocate";
+    if (s.emplace(k).second != ref.insert(k).second)
+      return false;
+    if (s.bucket_count() > buckets + 1)
+      return false;
+    if (i >= data.size() / 2 && s.load_factor() > std::max(lf, 1.0f))
+      return false;
+    lf = s.load_factor();
+  }
+  std::vector<std::string> v(std::begin(s), std::end(s));
+  std::sort(std::begin(v), std::end(v));
+  return std::equal(std::begin(v), std::end(v), std::begin(ref), std::end(ref));
+}
+
+int main()
+{
+  const std::vector<int> data = rt::make_rand_data<int>(3000, 1, 2000);
+
+  rt::unordered_set<int> s1;
+  if (!test_set(s1, data))
+    return 1;
+
+  // The nodes come from the buffer and go back to it. The copies in
+  // test_set need room as well.
+  using node_type = rt::unordered_set<int>::node_type;
+  using alloc_type = rt::node_allocator<int, node_type>;
+  std::vector<node_type> buffer(3 * data.size() + 1);
+  rt::node_alloc_header header(buffer);
+  alloc_type alloc(&header);
+  rt::unordered_set<int, std::hash<int>, std::equal_to<int>, alloc_type> s2(alloc);
+  for (int i = 0; i < 5; ++i)
+    if (!test_set(s2, data))
+      return 1;
+
+  // A full buffer still takes keys that are already there.
+  s2.insert(std::begin(data), std::end(data));
+  try {
+    for (int i = 0; i <= static_cast<int>(buffer.size()); ++i)
+      s2.insert(-i - 1);
+    return 1;
+  } catch (const std::bad_alloc&) {
+  }
+  try {
+    for (int v: data)
+      s2.insert(v);
+  } catch (const std::bad_alloc&) {
+    return 1;
+  }
+
+  if (!test_reserve(data) || !test_strings(data))
+    return 1;
+
+  return 0;
+}
+
@@ -0,0 +1,159 @@
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <rtcpp/utility/parallel.hpp>
+#include <rtcpp/utility/workload.hpp>
+#include <rtcpp/utility/thread_pool.hpp>
+
+using rt::key_distribution;
+
+bool test_reproducible()
+{
+  // The same keys on one thread or several, chunks split among them.
+  const std::size_t n = 300001;
+  rt::spawn_executor spawn(4);
+  rt::thread_pool pool(3);
+  for (std::size_t i = 0; i < rt::key_distribution_count; ++i) {
+    rt::key_options o;
+    o.distribution = key_distribution(i);
+    o.seed = 7;
+    const std::vector<std::uint64_t> a = rt::make_keys<std::uint64_t>(n, o);
+    if (a.size() != n || a != rt::make_keys<std::uint64_t>(spawn, n, o)
+      || a != rt::make_keys<std::uint64_t>(pool, n, o))
+      return false;
+    o.seed = 8;
+    const bool random = o.distribution != key_distribution::sorted
+                     && o.distribution != key_distribution::reverse;
+    if (random == (a == rt::make_keys<std::uint64_t>(n, o)))
+      return false;
+  }
+  return rt::make_keys<int>(0, rt::key_options()).empty();
+}
+
+bool test_distributions()
+{
+  const std::size_t n = 100000;
+  rt::key_options o;
+  o.range = 1000000;
+
+  std::vector<int> a = rt::make_keys<int>(n, o);
+  if (*std::min_element(std::begin(a), std::end(a)) < 0 || *std::max_element(std::begin(a), std::end(a)) >= 1000000)
+    return false;
+
+  o.distribution = key_distribution::sorted;
+  a = rt::make_keys<int>(n, o);
+  if (a[0] != 0 || a[1] != 10 || !std::is_sorted(std::begin(a), std::end(a)))
+    return false;
+
+  o.distribution = key_distribution::reverse;
+  std::vector<int> b = rt::make_keys<int>(n, o);
+  std::reverse(std::begin(b), std::end(b));
+  if (a != b)
+    return false;
+
+  // A permutation of the sorted keys, close to in order.
+  o.distribution = key_distribution::nearly_sorted;
+  b = rt::make_keys<int>(n, o);
+  std::size_t descents = 0;
+  for (std::size_t i = 1; i < n; ++i)
+    descents += b[i] < b[i - 1];
+  if (descents == 0 || descents > n / 20)
+    return false;
+  std::sort(std::begin(b), std::end(b));
+  if (a != b)
+    return false;
+
+  // The frequency of rank k is about 1 / k.
+  o.distribution = key_distribution::zipfian;
+  o.zipf_exponent = 1;
+  o.range = 1000;
+  a = rt::make_keys<int>(n, o);
+  std::vector<double> freq(1000);
+  for (int k : a)
+    if (k >= 0 && k < 1000)
+      ++freq[k];
+  if (std::abs(freq[0] / freq[1] - 2) > 0.2 || std::abs(freq[0] / freq[9] - 10) > 2)
+    return false;
+
+  o.distribution = key_distribution::clustered;
+  o.range = 1000000;
+  o.clusters = 4;
+  o.cluster_width = 0.001;
+  a = rt::make_keys<int>(n, o);
+  std::sort(std::begin(a), std::end(a));
+  std::size_t gaps = 0;
+  for (std::size_t i = 1; i < n; ++i)
+    gaps += a[i] - a[i - 1] > 1000;
+  if (gaps > 3 || a.back() - a.front() < 1000)
+    return false;
+
+  // At most a few late arrivals, mean gap range / n.
+  o.distribution = key_distribution::time_series;
+  o.range = 10000000;
+  a = rt::make_keys<int>(n, o);
+  descents = 0;
+  for (std::size_t i = 1; i < n; ++i)
+    descents += a[i] < a[i - 1];
+  if (descents == 0 || descents > n / 20)
+    return false;
+  const double last = *std::max_element(std::begin(a), std::end(a));
+  return std::abs(last / 1e7 - 1) < 0.01;
+}
+
+bool test_trace()
+{
+  rt::key_options o;
+  o.range = 100;
+  const std::size_t m = 100000;
+  rt::spawn_executor spawn(2);
+  const auto t = rt::make_trace<int>(m, o, {0.1, 0.6, 0.3});
+  const auto u = rt::make_trace<int>(spawn, m, o, {0.1, 0.6, 0.3});
+  std::size_t counts[3] = {0, 0, 0};
+  for (std::size_t i = 0; i < m; ++i) {
+    if (t[i].op != u[i].op || t[i].key != u[i].key || t[i].key < 0 || t[i].key >= 100)
+      return false;
+    ++counts[static_cast<int>(t[i].op)];
+  }
+  if ( std::abs(counts[0] / double(m) - 0.1) > 0.01 || std::abs(counts[1] / double(m) - 0.6) > 0.01
+    || std::abs(counts[2] / double(m) - 0.3) > 0.01)
+    return false;
+
+#if RTCPP_EXCEPTIONS
+  try {
+    rt::make_trace<int>(10, o, {0, 0, 0});
+    return false;
+  } catch (const std::runtime_error&) {}
+#endif
+  return true;
+}
+
+bool test_names()
+{
+  for (std::size_t i = 0; i < rt::key_distribution_count; ++i) {
+    key_distribution d;
+    const key_distribution e = key_distribution(i);
+    if (!rt::parse_key_distribution(rt::key_distribution_name(e), d) || d != e)
+      return false;
+  }
+  key_distribution d;
+  return !rt::parse_key_distribution("normal", d);
+}
+
+int main()
+{
+  if (!test_reproducible())
+    return 1;
+
+  if (!test_distributions())
+    return 1;
+
+  if (!test_trace())
+    return 1;
+
+  if (!test_names())
+    return 1;
+
+  return 0;
+}